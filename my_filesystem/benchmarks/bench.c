@@ -0,0 +1,179 @@
+/*
+    Benchmark harness and driver: runs every suite, or those named on the
+    command line (e.g. `bench_fs bitmap io`)
+*/
+
+#include "bench.h"
+#include "disk.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// results go here; stdout itself is pointed at stderr, so that the progress
+// messages of the filesystem layers do not mix with them
+static FILE* results;
+
+// === TIMING AND SAMPLES ===
+
+uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void bench_begin(struct bench* b, const char* name, const char* param_fmt, ...) {
+    memset(b, 0, sizeof(*b));
+    b->name = name;
+
+    va_list ap;
+    va_start(ap, param_fmt);
+    vsnprintf(b->param, sizeof(b->param), param_fmt, ap);
+    va_end(ap);
+}
+
+void bench_record(struct bench* b, uint64_t ns, uint32_t ops) {
+    if (ops == 0)
+        return;
+
+    if (b->count == b->cap) {
+        size_t cap = b->cap ? b->cap * 2 : 1024;
+        uint64_t* grown = realloc(b->samples, cap * sizeof(uint64_t));
+        if (!grown) {
+            fprintf(stderr, "bench: out of memory\n");
+            exit(1);
+        }
+        b->samples = grown;
+        b->cap = cap;
+    }
+
+    b->samples[b->count++] = ns / ops;
+    b->ops += ops;
+    b->total_ns += ns;
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// nearest-rank percentile of the sorted samples
+static uint64_t percentile(const struct bench* b, unsigned pct) {
+    size_t rank = (b->count * pct + 99) / 100;
+    return b->samples[rank ? rank - 1 : 0];
+}
+
+void bench_end(struct bench* b) {
+    if (b->count == 0) {
+        fprintf(stderr, "bench: %s (%s) recorded no samples\n", b->name, b->param);
+        return;
+    }
+
+    qsort(b->samples, b->count, sizeof(uint64_t), compare_u64);
+    double secs = b->total_ns / 1e9;
+
+    fprintf(results, "{\"bench\":\"%s\",\"param\":\"%s\",\"ops\":%llu,\"ops_per_sec\":%.0f",
+           b->name, b->param, (unsigned long long)b->ops, secs > 0 ? b->ops / secs : 0.0);
+    if (b->bytes > 0)
+        fprintf(results, ",\"mb_per_sec\":%.1f", secs > 0 ? b->bytes / secs / (1024.0 * 1024.0) : 0.0);
+    fprintf(results, ",\"p50_ns\":%llu,\"p90_ns\":%llu,\"p99_ns\":%llu,\"max_ns\":%llu}\n",
+           (unsigned long long)percentile(b, 50), (unsigned long long)percentile(b, 90),
+           (unsigned long long)percentile(b, 99), (unsigned long long)b->samples[b->count - 1]);
+    fflush(results);
+
+    free(b->samples);
+    b->samples = NULL;
+}
+
+// === RANDOM NUMBERS ===
+
+static uint64_t rng_state = 1;
+
+void bench_seed(uint64_t seed) {
+    rng_state = seed ? seed : 1;
+}
+
+uint32_t bench_rand(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (uint32_t)((rng_state * 2685821657736338717ull) >> 32);
+}
+
+// === FILESYSTEM FIXTURES ===
+
+filesystem_t* bench_mount(const fs_format_options_t* fopts, const fs_mount_options_t* mopts,
+                          size_t total_blocks, size_t total_inodes) {
+    size_t bs = (fopts && fopts->block_size) ? fopts->block_size : BLOCK_SIZE;
+
+    remove(BENCH_IMAGE);
+    disk_t disk = NULL;
+    filesystem_t* fs = NULL;
+    if (disk_attach(BENCH_IMAGE, total_blocks * bs, true, &disk) != DISK_SUCCESS ||
+        fs_format_with_options(disk, total_blocks, total_inodes, fopts) != SUCCESS ||
+        fs_mount_with_options(disk, mopts, &fs) != SUCCESS) {
+        fprintf(stderr, "bench: cannot set up %s\n", BENCH_IMAGE);
+        exit(1);
+    }
+    return fs;
+}
+
+void bench_unmount(filesystem_t* fs) {
+    fs_unmount(fs);                   // detaches the disk too
+    remove(BENCH_IMAGE);
+}
+
+// === DRIVER ===
+
+static const struct {
+    const char* name;
+    void (*run)(void);
+} suites[] = {
+    { "bitmap",    bench_bitmap },
+    { "inode",     bench_inode },
+    { "dentry",    bench_dentry },
+    { "path",      bench_path },
+    { "io",        bench_io },
+    { "namespace", bench_namespace },
+};
+
+#define NUM_SUITES (sizeof(suites) / sizeof(suites[0]))
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        bool known = false;
+        for (size_t s = 0; s < NUM_SUITES; s++)
+            known |= strcmp(argv[i], suites[s].name) == 0;
+        if (!known) {
+            fprintf(stderr, "usage: %s [suite...]\nsuites:", argv[0]);
+            for (size_t s = 0; s < NUM_SUITES; s++)
+                fprintf(stderr, " %s", suites[s].name);
+            fprintf(stderr, "\n");
+            return 1;
+        }
+    }
+
+    int out = dup(STDOUT_FILENO);
+    results = (out >= 0) ? fdopen(out, "w") : NULL;
+    if (!results || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+        perror("bench");
+        return 1;
+    }
+
+    for (size_t s = 0; s < NUM_SUITES; s++) {
+        bool selected = (argc == 1);
+        for (int i = 1; i < argc; i++)
+            selected |= strcmp(argv[i], suites[s].name) == 0;
+        if (!selected)
+            continue;
+
+        fprintf(stderr, "=== %s ===\n", suites[s].name);
+        bench_seed(0x5eed0000u + s);
+        suites[s].run();
+    }
+
+    fclose(results);
+    return 0;
+}
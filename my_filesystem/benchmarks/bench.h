@@ -0,0 +1,64 @@
+#pragma once
+
+#include "fs.h"
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * Benchmark harness.
+ *
+ * A benchmark is a series of timed samples: each sample covers `ops`
+ * operations (a single one for the filesystem calls, a batch for the
+ * sub-microsecond ones, whose latency is then the batch average).
+ * bench_end() prints one JSON object per line on stdout:
+ *
+ *   {"bench":"fs_read","param":"seq bs=4096","ops":4096,"ops_per_sec":...,
+ *    "mb_per_sec":...,"p50_ns":...,"p90_ns":...,"p99_ns":...,"max_ns":...}
+ *
+ * Only the timed regions count, and every input comes from a fixed seed,
+ * so two runs of the same tree do the same work.
+ */
+
+#define BENCH_IMAGE "bench.img"
+
+struct bench {
+    const char* name;                 // what is measured
+    char param[64];                   // the variant (fill ratio, size, depth...)
+    uint64_t* samples;                // per-op latency of each sample, in ns
+    size_t count, cap;
+    uint64_t ops;                     // operations over all samples
+    uint64_t total_ns;                // time over all samples
+    uint64_t bytes;                   // data moved (0 = not a throughput test)
+};
+
+// monotonic clock, in nanoseconds
+uint64_t bench_now_ns(void);
+
+void bench_begin(struct bench* b, const char* name, const char* param_fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+// adds a sample of `ops` operations that took `ns` in total
+void bench_record(struct bench* b, uint64_t ns, uint32_t ops);
+
+// prints the result line and releases the samples
+void bench_end(struct bench* b);
+
+// deterministic pseudo-random numbers (xorshift64*)
+void bench_seed(uint64_t seed);
+uint32_t bench_rand(void);
+
+// formats and mounts a fresh BENCH_IMAGE of total_blocks blocks
+filesystem_t* bench_mount(const fs_format_options_t* fopts, const fs_mount_options_t* mopts,
+                          size_t total_blocks, size_t total_inodes);
+
+// unmounts, detaches and removes the image
+void bench_unmount(filesystem_t* fs);
+
+// === SUITES ===
+
+void bench_bitmap(void);
+void bench_inode(void);
+void bench_dentry(void);
+void bench_path(void);
+void bench_io(void);
+void bench_namespace(void);
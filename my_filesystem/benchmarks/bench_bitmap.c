@@ -0,0 +1,72 @@
+/*
+    Bitmap searches at various fill ratios
+*/
+
+#include "bench.h"
+#include "bitmap.h"
+
+#define BITMAP_BITS   (1u << 20)      // a 128 KiB bitmap: 512 MiB of 512-byte blocks
+#define SEARCH_BATCH  64
+#define SEARCH_ROUNDS 500
+
+// fills about permille / 1000 of the bits; `clustered` puts them all at the
+// front (a long-lived, nearly full data area) instead of spreading them
+static void fill(struct bitmap* bmp, unsigned permille, bool clustered) {
+    bitmap_clear_all(bmp);
+    if (clustered) {
+        bitmap_set_range(bmp, 0, (size_t)BITMAP_BITS * permille / 1000);
+        return;
+    }
+    for (size_t i = 0; i < BITMAP_BITS; i++)
+        if (bench_rand() % 1000 < permille)
+            bitmap_set(bmp, i);
+}
+
+static void run_search(struct bitmap* bmp, const char* name, unsigned permille, bool clustered,
+                       int (*search)(const struct bitmap*, size_t)) {
+    fill(bmp, permille, clustered);
+
+    struct bench b;
+    bench_begin(&b, name, "fill=%u.%u%% %s", permille / 10, permille % 10,
+                clustered ? "clustered" : "random");
+
+    size_t starts[SEARCH_BATCH];
+    volatile int sink = 0;
+    for (int r = 0; r < SEARCH_ROUNDS; r++) {
+        for (int i = 0; i < SEARCH_BATCH; i++)
+            starts[i] = bench_rand() % BITMAP_BITS;
+
+        uint64_t t0 = bench_now_ns();
+        for (int i = 0; i < SEARCH_BATCH; i++)
+            sink += search(bmp, starts[i]);
+        bench_record(&b, bench_now_ns() - t0, SEARCH_BATCH);
+    }
+    (void)sink;
+    bench_end(&b);
+}
+
+// a run of 8 blocks, as a typical file extension asks for
+static int find_run_of_8(const struct bitmap* bmp, size_t start) {
+    return bitmap_find_free_run(bmp, start, 8);
+}
+
+void bench_bitmap(void) {
+    struct bitmap* bmp = bitmap_create(BITMAP_BITS);
+    if (!bmp)
+        return;
+
+    static const unsigned ratios[] = { 0, 500, 900, 990, 999 };
+    for (size_t i = 0; i < sizeof(ratios) / sizeof(ratios[0]); i++) {
+        run_search(bmp, "bitmap_find_next_free", ratios[i], false, bitmap_find_next_free);
+        run_search(bmp, "bitmap_find_next_free", ratios[i], true, bitmap_find_next_free);
+    }
+    // a randomly 90% full bitmap has almost no run of 8: every search would
+    // sweep the whole bitmap, so only the low ratios are spread out
+    for (size_t i = 0; i < sizeof(ratios) / sizeof(ratios[0]); i++) {
+        if (ratios[i] <= 500)
+            run_search(bmp, "bitmap_find_free_run", ratios[i], false, find_run_of_8);
+        run_search(bmp, "bitmap_find_free_run", ratios[i], true, find_run_of_8);
+    }
+
+    bitmap_destroy(&bmp);
+}
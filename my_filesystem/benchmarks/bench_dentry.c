@@ -0,0 +1,60 @@
+/*
+    Name lookups in a single directory, against the number of entries
+*/
+
+#include "bench.h"
+#include "fs_internal.h"
+#include "dentry.h"
+#include <stdio.h>
+
+#define LOOKUP_ROUNDS 20000
+
+static void run_lookups(const char* layout, const fs_format_options_t* fopts) {
+    static const uint32_t sizes[] = { 16, 256, 2048 };
+
+    fs_mount_options_t mopts = { .flush_policy = FS_FLUSH_ON_SYNC };
+    filesystem_t* fs = bench_mount(fopts, &mopts, 16384, 4096);
+
+    char path[64];
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        uint32_t n = sizes[s];
+        snprintf(path, sizeof(path), "/d%u", n);
+        fs_mkdir(fs, path, 0755);
+        for (uint32_t i = 0; i < n; i++) {
+            snprintf(path, sizeof(path), "/d%u/entry%05u", n, i);
+            fs_create(fs, path, 0644);
+        }
+
+        uint32_t dir;
+        snprintf(path, sizeof(path), "/d%u", n);
+        if (fs_path_to_inode(fs, path, &dir) != SUCCESS)
+            continue;
+
+        // dentry_find goes to the blocks (or the index) every time: the
+        // dentry cache sits above it, in path resolution
+        for (int miss = 0; miss <= 1; miss++) {
+            struct bench b;
+            bench_begin(&b, "dentry_find", "%s entries=%u %s", layout, n, miss ? "miss" : "hit");
+
+            struct dentry d;
+            char name[32];
+            for (int r = 0; r < LOOKUP_ROUNDS; r++) {
+                snprintf(name, sizeof(name), miss ? "absent%05u" : "entry%05u", bench_rand() % n);
+                uint64_t t0 = bench_now_ns();
+                dentry_find(fs, dir, name, &d, NULL);
+                bench_record(&b, bench_now_ns() - t0, 1);
+            }
+            bench_end(&b);
+        }
+    }
+
+    bench_unmount(fs);
+}
+
+void bench_dentry(void) {
+    fs_format_options_t fixed = { .block_size = 4096 };
+    run_lookups("fixed", &fixed);
+
+    fs_format_options_t indexed = { .block_size = 4096, .rec_len = true, .dir_index = true };
+    run_lookups("rec_len+index", &indexed);
+}
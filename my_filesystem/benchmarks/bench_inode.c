@@ -0,0 +1,91 @@
+/*
+    Inode table access, through the inode cache and straight to the table,
+    and formatting a large table in full or lazily
+*/
+
+#include "bench.h"
+#include "inode.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define INODE_COUNT  4096
+#define INODE_ROUNDS 20000
+#define FORMAT_BLOCKS 65536
+#define FORMAT_INODES 65536
+#define FORMAT_ROUNDS 5
+
+typedef int (*inode_read_fn)(struct filesystem*, uint32_t, struct inode*);
+typedef int (*inode_write_fn)(struct filesystem*, uint32_t, const struct inode*);
+
+// working set of `span` inodes: below the cache capacity it stays resident
+static void run_reads(filesystem_t* fs, const char* name, inode_read_fn fn, uint32_t span) {
+    struct bench b;
+    bench_begin(&b, name, "span=%u", span);
+
+    struct inode inode;
+    for (int r = 0; r < INODE_ROUNDS; r++) {
+        uint32_t ino = 1 + bench_rand() % span;
+        uint64_t t0 = bench_now_ns();
+        fn(fs, ino, &inode);
+        bench_record(&b, bench_now_ns() - t0, 1);
+    }
+    bench_end(&b);
+}
+
+static void run_writes(filesystem_t* fs, const char* name, inode_write_fn fn, uint32_t span) {
+    struct bench b;
+    bench_begin(&b, name, "span=%u", span);
+
+    struct inode inode;
+    for (int r = 0; r < INODE_ROUNDS; r++) {
+        uint32_t ino = 1 + bench_rand() % span;
+        inode_read(fs, ino, &inode);
+        inode.modified_time++;
+        uint64_t t0 = bench_now_ns();
+        fn(fs, ino, &inode);
+        bench_record(&b, bench_now_ns() - t0, 1);
+    }
+    bench_end(&b);
+}
+
+// format and sync of a fresh image, the table zeroed up front or on first use
+static void run_format(bool lazy) {
+    struct bench b;
+    bench_begin(&b, "fs_format", "itable=%s", lazy ? "lazy" : "full");
+
+    fs_format_options_t fopts = { .lazy_itable = lazy };
+    for (int r = 0; r < FORMAT_ROUNDS; r++) {
+        remove(BENCH_IMAGE);
+        disk_t disk = NULL;
+        if (disk_attach(BENCH_IMAGE, (size_t)FORMAT_BLOCKS * BLOCK_SIZE, true, &disk) != DISK_SUCCESS) {
+            fprintf(stderr, "bench: cannot set up %s\n", BENCH_IMAGE);
+            exit(1);
+        }
+        uint64_t t0 = bench_now_ns();
+        fs_format_with_options(disk, FORMAT_BLOCKS, FORMAT_INODES, &fopts);
+        disk_sync(disk);
+        bench_record(&b, bench_now_ns() - t0, 1);
+        disk_detach(disk);
+    }
+    remove(BENCH_IMAGE);
+    bench_end(&b);
+}
+
+void bench_inode(void) {
+    fs_mount_options_t mopts = { .flush_policy = FS_FLUSH_ON_SYNC };
+    filesystem_t* fs = bench_mount(NULL, &mopts, 16384, INODE_COUNT);
+
+    static const uint32_t spans[] = { 64, INODE_COUNT - 1 };
+    for (size_t i = 0; i < sizeof(spans) / sizeof(spans[0]); i++) {
+        run_reads(fs, "inode_read", inode_read, spans[i]);
+        run_writes(fs, "inode_write", inode_write, spans[i]);
+    }
+    // the table itself, without the cache
+    run_reads(fs, "inode_load", inode_load, INODE_COUNT - 1);
+    run_writes(fs, "inode_store", inode_store, INODE_COUNT - 1);
+
+    bench_unmount(fs);
+
+    run_format(false);
+    run_format(true);
+}
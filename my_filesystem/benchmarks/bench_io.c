@@ -0,0 +1,197 @@
+/*
+    File data throughput: sequential and random reads and writes, small
+    files with and without inline data, clones with their copy-on-write
+    first writes, and compressed files
+*/
+
+#include "bench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FILE_SIZE (32u * 1024 * 1024)
+#define SMALL_FILES 256
+#define SMALL_SIZE  48
+
+static void run_sequential(filesystem_t* fs, bool write, const char* kind, uint32_t flags,
+                           size_t chunk, uint8_t* buf) {
+    open_file_t* f;
+    if (fs_open(fs, "/data", flags, &f) != SUCCESS)
+        return;
+
+    struct bench b;
+    bench_begin(&b, write ? "fs_write" : "fs_read", "%s bs=%zu", kind, chunk);
+
+    for (uint32_t off = 0; off < FILE_SIZE; off += chunk) {
+        size_t n;
+        uint64_t t0 = bench_now_ns();
+        if (write)
+            fs_write(f, buf, chunk, &n);
+        else
+            fs_read(f, buf, chunk, &n);
+        bench_record(&b, bench_now_ns() - t0, 1);
+        b.bytes += n;
+    }
+    bench_end(&b);
+    fs_close(f);
+}
+
+// chunk-aligned offsets anywhere in the file
+static void run_random(filesystem_t* fs, bool write, const char* kind, size_t chunk, uint8_t* buf) {
+    open_file_t* f;
+    if (fs_open(fs, "/data", FS_O_RDWR, &f) != SUCCESS)
+        return;
+
+    struct bench b;
+    bench_begin(&b, write ? "fs_write" : "fs_read", "%s bs=%zu", kind, chunk);
+
+    uint32_t slots = FILE_SIZE / chunk;
+    for (uint32_t i = 0; i < 4096; i++) {
+        size_t n;
+        fs_seek(f, (bench_rand() % slots) * chunk);
+        uint64_t t0 = bench_now_ns();
+        if (write)
+            fs_write(f, buf, chunk, &n);
+        else
+            fs_read(f, buf, chunk, &n);
+        bench_record(&b, bench_now_ns() - t0, 1);
+        b.bytes += n;
+    }
+    bench_end(&b);
+    fs_close(f);
+}
+
+// open + read + close of many small files, after writing them once
+static void run_small_files(bool inline_data, const uint8_t* buf) {
+    fs_format_options_t fopts = { .inline_data = inline_data };
+    fs_mount_options_t mopts = { .flush_policy = FS_FLUSH_ON_SYNC };
+    filesystem_t* fs = bench_mount(&fopts, &mopts, 16384, 2048);
+    const char* mode = inline_data ? "inline" : "block";
+
+    char path[32];
+    struct bench b;
+    bench_begin(&b, "fs_write", "small=%d %s", SMALL_SIZE, mode);
+    for (int i = 0; i < SMALL_FILES; i++) {
+        snprintf(path, sizeof(path), "/s%04d", i);
+        fs_create(fs, path, 0644);
+        open_file_t* f;
+        if (fs_open(fs, path, FS_O_WRONLY, &f) != SUCCESS)
+            continue;
+        size_t n;
+        uint64_t t0 = bench_now_ns();
+        fs_write(f, buf, SMALL_SIZE, &n);
+        bench_record(&b, bench_now_ns() - t0, 1);
+        b.bytes += n;
+        fs_close(f);
+    }
+    bench_end(&b);
+
+    uint8_t back[SMALL_SIZE];
+    bench_begin(&b, "fs_read", "small=%d %s", SMALL_SIZE, mode);
+    for (int i = 0; i < SMALL_FILES; i++) {
+        snprintf(path, sizeof(path), "/s%04d", bench_rand() % SMALL_FILES);
+        uint64_t t0 = bench_now_ns();
+        open_file_t* f;
+        size_t n = 0;
+        if (fs_open(fs, path, FS_O_RDONLY, &f) == SUCCESS) {
+            fs_read(f, back, sizeof(back), &n);
+            fs_close(f);
+        }
+        bench_record(&b, bench_now_ns() - t0, 1);
+        b.bytes += n;
+    }
+    bench_end(&b);
+
+    bench_unmount(fs);
+}
+
+// fs_clone of a FILE_SIZE file, then random first writes to a clone (each
+// one copies the block it lands in). Block pointers: scattered copies would
+// soon use up the records of an extent-mapped file
+static void run_clones(uint8_t* buf) {
+    fs_format_options_t fopts = { .block_size = 4096, .reflink = true };
+    filesystem_t* fs = bench_mount(&fopts, NULL, 16384, 256);
+    fs_create(fs, "/data", 0644);
+    run_sequential(fs, true, "append", FS_O_WRONLY, 65536, buf);
+
+    char path[32];
+    struct bench b;
+    bench_begin(&b, "fs_clone", "size=%u", FILE_SIZE);
+    for (int i = 0; i < 64; i++) {
+        snprintf(path, sizeof(path), "/c%02d", i);
+        uint64_t t0 = bench_now_ns();
+        fs_clone(fs, "/data", path);
+        bench_record(&b, bench_now_ns() - t0, 1);
+    }
+    bench_end(&b);
+
+    open_file_t* f;
+    if (fs_open(fs, "/c00", FS_O_RDWR, &f) == SUCCESS) {
+        bench_begin(&b, "fs_write", "cow bs=4096");
+        uint32_t slots = FILE_SIZE / 4096;
+        for (uint32_t i = 0; i < 1024; i++) {
+            size_t n;
+            fs_seek(f, (bench_rand() % slots) * 4096);
+            uint64_t t0 = bench_now_ns();
+            fs_write(f, buf, 4096, &n);
+            bench_record(&b, bench_now_ns() - t0, 1);
+            b.bytes += n;
+        }
+        bench_end(&b);
+        fs_close(f);
+    }
+
+    bench_unmount(fs);
+}
+
+// a compressed file written and read back whole, then read and rewritten
+// at random (every access decompresses a chunk unless it is cached)
+static void run_compressed(uint8_t* buf) {
+    fs_format_options_t fopts = { .block_size = 4096 };
+    filesystem_t* fs = bench_mount(&fopts, NULL, 16384, 256);
+    fs_create(fs, "/data", 0644);
+    if (fs_set_compression(fs, "/data", true) != SUCCESS) {
+        bench_unmount(fs);
+        return;
+    }
+
+    run_sequential(fs, true, "compressed append", FS_O_WRONLY, 65536, buf);
+    run_sequential(fs, false, "compressed seq", FS_O_RDONLY, 65536, buf);
+    run_random(fs, false, "compressed random", 4096, buf);
+    run_random(fs, true, "compressed random", 4096, buf);
+
+    bench_unmount(fs);
+}
+
+void bench_io(void) {
+    static const size_t chunks[] = { 4096, 65536 };
+
+    uint8_t* buf = malloc(65536);
+    if (!buf)
+        return;
+    for (size_t i = 0; i < 65536; i++)
+        buf[i] = (uint8_t)(i * 7 % 251);
+
+    fs_format_options_t fopts = { .block_size = 4096, .extents = true };
+    filesystem_t* fs = bench_mount(&fopts, NULL, 16384, 256);
+    fs_create(fs, "/data", 0644);
+
+    for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+        // the first pass allocates, the second one overwrites in place
+        run_sequential(fs, true, "append", FS_O_WRONLY | FS_O_TRUNC, chunks[i], buf);
+        run_sequential(fs, true, "overwrite", FS_O_WRONLY, chunks[i], buf);
+        run_sequential(fs, false, "seq", FS_O_RDONLY, chunks[i], buf);
+    }
+    for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+        run_random(fs, false, "random", chunks[i], buf);
+        run_random(fs, true, "random", chunks[i], buf);
+    }
+
+    bench_unmount(fs);
+
+    run_small_files(false, buf);
+    run_small_files(true, buf);
+    run_clones(buf);
+    run_compressed(buf);
+    free(buf);
+}
@@ -0,0 +1,45 @@
+/*
+    Create / unlink storms in one directory
+*/
+
+#include "bench.h"
+#include <stdio.h>
+
+#define STORM_FILES 2000
+
+static void run_storm(const char* policy, const fs_mount_options_t* mopts) {
+    fs_format_options_t fopts = { .block_size = 4096, .rec_len = true, .dir_index = true };
+    filesystem_t* fs = bench_mount(&fopts, mopts, 16384, 4096);
+    fs_mkdir(fs, "/storm", 0755);
+
+    char path[64];
+    struct bench b;
+    bench_begin(&b, "fs_create", "files=%d flush=%s", STORM_FILES, policy);
+    for (int i = 0; i < STORM_FILES; i++) {
+        snprintf(path, sizeof(path), "/storm/f%05d", i);
+        uint64_t t0 = bench_now_ns();
+        fs_create(fs, path, 0644);
+        bench_record(&b, bench_now_ns() - t0, 1);
+    }
+    bench_end(&b);
+
+    // in a different order than the creates, leaving holes behind
+    bench_begin(&b, "fs_unlink", "files=%d flush=%s", STORM_FILES, policy);
+    for (int i = 0; i < STORM_FILES; i++) {
+        snprintf(path, sizeof(path), "/storm/f%05d", (i * 7) % STORM_FILES);
+        uint64_t t0 = bench_now_ns();
+        fs_unlink(fs, path);
+        bench_record(&b, bench_now_ns() - t0, 1);
+    }
+    bench_end(&b);
+
+    bench_unmount(fs);
+}
+
+void bench_namespace(void) {
+    run_storm("per_op", NULL);
+    fs_mount_options_t mapped = { .map_bitmaps = true };
+    run_storm("per_op_mapped", &mapped);
+    fs_mount_options_t on_sync = { .flush_policy = FS_FLUSH_ON_SYNC };
+    run_storm("on_sync", &on_sync);
+}
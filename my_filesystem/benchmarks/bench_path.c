@@ -0,0 +1,55 @@
+/*
+    Path resolution against the depth of the path
+*/
+
+#include "bench.h"
+#include "fs_internal.h"
+#include <stdio.h>
+#include <string.h>
+
+#define RESOLVE_ROUNDS 20000
+
+static void run_resolve(filesystem_t* fs, const char* path, const char* kind, int depth) {
+    struct bench b;
+    bench_begin(&b, "fs_path_to_inode", "depth=%d %s", depth, kind);
+
+    uint32_t ino;
+    for (int r = 0; r < RESOLVE_ROUNDS; r++) {
+        uint64_t t0 = bench_now_ns();
+        fs_path_to_inode(fs, path, &ino);
+        bench_record(&b, bench_now_ns() - t0, 1);
+    }
+    bench_end(&b);
+}
+
+void bench_path(void) {
+    static const int depths[] = { 1, 4, 16, 64 };
+
+    fs_mount_options_t mopts = { .flush_policy = FS_FLUSH_ON_SYNC };
+    filesystem_t* fs = bench_mount(NULL, &mopts, 16384, 1024);
+
+    // /p64/dir/dir/... with a file at each measured depth
+    char path[MAX_PATH] = "/p";
+    fs_mkdir(fs, path, 0755);
+    int built = 0;
+    for (size_t i = 0; i < sizeof(depths) / sizeof(depths[0]); i++) {
+        while (built < depths[i] - 1) {
+            strcat(path, "/dir");
+            fs_mkdir(fs, path, 0755);
+            built++;
+        }
+
+        char file[MAX_PATH + 8];
+        snprintf(file, sizeof(file), "%s/file", path);
+        fs_create(fs, file, 0644);
+
+        // the dentry cache is warm after the first round
+        run_resolve(fs, file, "absolute", depths[i]);
+
+        char missing[MAX_PATH + 8];
+        snprintf(missing, sizeof(missing), "%s/none", path);
+        run_resolve(fs, missing, "negative", depths[i]);
+    }
+
+    bench_unmount(fs);
+}
@@ -47,9 +47,9 @@
 
 // === SIZES AND COUNTS ===
 #define INODE_SIZE         128                               
-#define INODES_PER_BLOCK   (BLOCK_SIZE / INODE_SIZE)
+#define INODES_PER_BLOCK   (BLOCK_SIZE / INODE_SIZE)     // with the default block size
 #define DENTRY_SIZE        256
-#define DENTRIES_PER_BLOCK (BLOCK_SIZE / DENTRY_SIZE)                              
+#define DENTRIES_PER_BLOCK (BLOCK_SIZE / DENTRY_SIZE)    // with the default block size
 #define MAX_PATH           1024
 #define MAGIC_NUMBER       0x12345678
 #define BYTES_PER_INODE    4096  // 1 inode every 4KB of disk space
@@ -69,6 +69,22 @@
 #define INODE_TYPE_FILE      1
 #define INODE_TYPE_DIRECTORY 2
 
+// === INODE FLAGS ===
+#define INODE_FLAG_EXTENTS   0x01   // data mapped by extents instead of block pointers
+#define INODE_FLAG_DIR_INDEX 0x02   // directory has a hashed index (see dir_index.h)
+#define INODE_FLAG_INLINE_DATA 0x04 // file contents kept in the inode (see bmap.h)
+#define INODE_FLAG_COMPRESSED 0x08  // file data stored in compressed chunks (see fs_set_compression)
+
+// === FILESYSTEM FEATURES ===
+#define FS_FEATURE_EXTENTS   0x01   // new files are created extent-mapped
+#define FS_FEATURE_DIR_INDEX 0x02   // large directories get a hashed index
+#define FS_FEATURE_REC_LEN   0x04   // variable-length directory records
+#define FS_FEATURE_JOURNAL   0x08   // metadata changes go through a write-ahead journal
+#define FS_FEATURE_GROUPS    0x10   // block groups with their own bitmaps and inode tables
+#define FS_FEATURE_LAZY_ITABLE 0x20 // inode-table blocks are zeroed on first use
+#define FS_FEATURE_INLINE_DATA 0x40 // new files keep small contents in the inode
+#define FS_FEATURE_REFLINK   0x80   // data blocks shared by cloned files, counted in a table
+
 // === RESERVED BLOCKS ===
 #define SUPERBLOCK_BLOCK_NUM 0   // superblock location (fixed)
 
@@ -84,7 +100,7 @@
 
 // === SHARED STRUCTURES ===
 
-// Filesystem Superblock (108B)
+// Filesystem Superblock (116B)
 struct superblock {
     uint32_t magic_number;         // magic number for FS validation
 
@@ -109,18 +125,43 @@ struct superblock {
     time_t   last_mount_time;      // last mount timestamp
     uint32_t mount_count;
 
-    uint32_t reserved[8];          // reserved for future expansions
+    uint32_t features;             // FS_FEATURE_* chosen at format time
+    uint32_t journal_start;        // first block of the journal region (FS_FEATURE_JOURNAL)
+    uint32_t journal_blocks;       // number of blocks of the journal region
+
+    // block groups (FS_FEATURE_GROUPS): the *_start fields above describe
+    // group 0, the *_blocks fields the size of every group's copy
+    uint32_t blocks_per_group;     // blocks covered by each group (the last may be shorter)
+    uint32_t inodes_per_group;     // inodes in each group's inode table
+    uint32_t group_count;          // number of groups
+    uint32_t group_desc_blocks;    // blocks of the descriptor table (right after block 0)
+    uint32_t itable_zeroed;        // leading inode-table blocks initialised
+                                   // (FS_FEATURE_LAZY_ITABLE, flat layout)
+    uint32_t refcount_start;       // first block of the reference-count table (FS_FEATURE_REFLINK)
+    uint32_t refcount_blocks;      // number of blocks of the table
+} __attribute__((packed));
+
+// Block group descriptor (32B), one per group in the table after the superblock
+struct group_desc {
+    uint32_t block_bitmap;         // first block of the group's block bitmap
+    uint32_t inode_bitmap;         // first block of the group's inode bitmap
+    uint32_t inode_table;          // first block of the group's inode table
+    uint32_t first_data_block;     // first block after the group's metadata
+    uint32_t free_blocks;          // free blocks in the group
+    uint32_t free_inodes;          // free inodes in the group
+    uint32_t used_dirs;            // directories whose inode lives in the group
+    uint32_t itable_zeroed;        // leading inode-table blocks initialised (FS_FEATURE_LAZY_ITABLE)
 } __attribute__((packed));
 
 
 // Inode (128B --> 1 block contains exactly 4 inodes)
 struct inode {
     uint8_t  type;              // type: file/directory/free
-    uint8_t  pad1;              // padding or future flags
+    uint8_t  flags;             // INODE_FLAG_* bits
     uint32_t size;              // size in bytes
     uint32_t blocks_used;       // number of blocks needed by the file
-    uint32_t direct[12];        // direct pointers to data blocks
-    uint32_t indirect;          // indirect pointer
+    uint32_t direct[12];        // direct pointers to data blocks (or extents, see bmap.h)
+    uint32_t indirect;          // indirect pointer (or extent block)
 
     time_t   created_time;      // inode creation timestamp
     time_t   modified_time;     // inode modification timestamp
@@ -130,7 +171,10 @@ struct inode {
     uint16_t links_count;       // number of hard links
     uint16_t pad2;              // padding
 
-    uint32_t reserved[9];       // more padding
+    uint32_t double_indirect;   // double indirect pointer (block-pointer mapping only)
+    uint32_t triple_indirect;   // triple indirect pointer (block-pointer mapping only)
+    uint32_t parent;            // primary parent directory (0 = unknown, see fs_inode_to_path)
+    uint32_t reserved[6];       // more padding (inline data, see bmap.h)
 } __attribute__((packed));
 
 // Directory entry (256B per entry --> 1 block contains exactly 2 dentries)
@@ -138,6 +182,8 @@ struct inode {
     NOTE: in real filesystems, directory entries do not have a fixed length. 
     A rec_len field is used to see after how many bytes the next entry starts. 
     Its presence also allows efficient file deletion.
+    Filesystems formatted with FS_FEATURE_REC_LEN store struct dentry_rec
+    records on disk instead; struct dentry stays the in-memory form.
 
 */
 struct dentry {
@@ -147,19 +193,38 @@ struct dentry {
     char     name[MAX_FILENAME];    // filename string
 } __attribute__((packed));
 
+// Variable-length directory record (FS_FEATURE_REC_LEN): the records of a
+// block are chained by rec_len and cover it exactly
+struct dentry_rec {
+    uint32_t inode_num;             // inode number (0 = unused record)
+    uint16_t rec_len;               // bytes from this record to the next one
+    uint8_t  name_len;              // filename length
+    uint8_t  file_type;
+    char     name[];                // name_len bytes, not NUL-terminated
+} __attribute__((packed));
+
+#define DENTRY_REC_HEADER       8
+#define DENTRY_REC_LEN(name_len) (((DENTRY_REC_HEADER + (name_len)) + 3) & ~3u)  // 4-byte aligned
+
 // === COMPILE-TIME CHECKS ===
 _Static_assert(sizeof(struct inode) == INODE_SIZE, 
                "struct inode must be exactly INODE_SIZE bytes");
-_Static_assert((BLOCK_SIZE % INODE_SIZE) == 0, 
-               "BLOCK_SIZE must be divisible by INODE_SIZE");
+_Static_assert((BLOCK_SIZE_MIN % INODE_SIZE) == 0, 
+               "BLOCK_SIZE_MIN must be divisible by INODE_SIZE");
 _Static_assert(sizeof(struct dentry) == DENTRY_SIZE, 
                "struct dentry must be exactly DENTRY_SIZE bytes");
-_Static_assert((BLOCK_SIZE % DENTRY_SIZE) == 0, 
-               "BLOCK_SIZE must be divisible by DENTRY_SIZE");
+_Static_assert((BLOCK_SIZE_MIN % DENTRY_SIZE) == 0, 
+               "BLOCK_SIZE_MIN must be divisible by DENTRY_SIZE");
+_Static_assert(sizeof(struct superblock) <= BLOCK_SIZE_MIN,
+               "the superblock must fit in the smallest block");
+_Static_assert(sizeof(struct dentry_rec) == DENTRY_REC_HEADER,
+               "struct dentry_rec header must be DENTRY_REC_HEADER bytes");
 
 // === USEFUL MACROS ===
 #define ALIGN_TO_BLOCK(size) (((size) + BLOCK_SIZE - 1) & ~(BLOCK_SIZE - 1))    // rounds size up to the next multiple of 512
 #define BLOCKS_NEEDED(size) (ALIGN_TO_BLOCK(size) / BLOCK_SIZE)                 // calculates how many 512‑byte blocks are needed to contain size bytes
+#define BLOCKS_NEEDED_FOR(size, bs) (((size) + (bs) - 1) / (bs))                // same, for a block size chosen at format time
+#define IS_VALID_BLOCK_SIZE(bs) ((bs) >= BLOCK_SIZE_MIN && (bs) <= BLOCK_SIZE_MAX && ((bs) & ((bs) - 1)) == 0)
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 
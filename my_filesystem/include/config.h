@@ -6,7 +6,9 @@
    that must remain consistent throughout the entire system.
   
    Contents:
-    - BLOCK_SIZE: fundamental unit of disk I/O operations
+    - BLOCK_SIZE: default unit of disk I/O operations; the actual
+      block size is chosen at format time within
+      [BLOCK_SIZE_MIN, BLOCK_SIZE_MAX] and stored in the superblock
     - MAX_FILENAME: maximum length for file and directory names
   
    This configuration file is designed to be included by both low-level
@@ -20,5 +22,7 @@
 
 #pragma once
 
-#define BLOCK_SIZE 512
+#define BLOCK_SIZE     512     // default block size (and the one a disk starts with)
+#define BLOCK_SIZE_MIN 512     // smallest format-time block size
+#define BLOCK_SIZE_MAX 65536   // largest format-time block size
 #define MAX_FILENAME 250  // 250 instead of 256 so that the dentry structure is exactly 256B
\ No newline at end of file
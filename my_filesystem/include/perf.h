@@ -0,0 +1,130 @@
+/**
+   Performance counters header file.
+
+   Process-wide event counters for every layer (disk, superblock, inode,
+   dentry, bitmap, path) and a latency histogram per fs_* entry point, to
+   tell which layer a slow request spent its time in.
+
+   They are compiled in with -DFS_PERF (the Makefile's FS_PERF=1, the
+   default). Updates are relaxed atomic additions, so the counters may be
+   read while other threads work; a snapshot is not a single instant
+   across counters. Without FS_PERF the hooks below expand to nothing and
+   perf_snapshot() returns zeros.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// === COUNTERS ===
+
+enum perf_counter {
+    PERF_DISK_BLOCKS_READ = 0,        // blocks copied out of the image
+    PERF_DISK_BLOCKS_WRITTEN,         // blocks copied in, or borrowed and released dirty
+    PERF_DISK_BLOCKS_BORROWED,        // blocks accessed in place (disk_borrow_blocks*)
+    PERF_DISK_SYNCS,                  // disk_sync* calls
+    PERF_SUPERBLOCK_READS,
+    PERF_SUPERBLOCK_WRITES,
+    PERF_INODE_READS,                 // inode_read calls (cached or not)
+    PERF_INODE_WRITES,                // inode_write calls
+    PERF_INODE_TABLE_LOADS,           // inodes read from the inode table
+    PERF_INODE_TABLE_STORES,          // inodes written to the inode table one by one
+    PERF_DENTRY_BLOCKS_SCANNED,       // directory blocks looked through
+    PERF_BITMAP_BITS_SCANNED,         // bits examined by bitmap searches (whole words)
+    PERF_PATH_COMPONENTS,             // path components resolved
+    PERF_NUM_COUNTERS
+};
+
+// === ENTRY POINTS ===
+
+enum perf_op {
+    PERF_OP_OPEN = 0,
+    PERF_OP_CLOSE,
+    PERF_OP_READ,                     // fs_read, fs_readv
+    PERF_OP_WRITE,                    // fs_write, fs_writev
+    PERF_OP_PREAD,
+    PERF_OP_PWRITE,
+    PERF_OP_FSYNC,
+    PERF_OP_TRUNCATE,                 // fs_truncate, fs_ftruncate
+    PERF_OP_FALLOCATE,
+    PERF_OP_CREATE,
+    PERF_OP_UNLINK,
+    PERF_OP_LINK,
+    PERF_OP_MKDIR,
+    PERF_OP_RMDIR,
+    PERF_OP_LIST,
+    PERF_OP_READDIR,
+    PERF_OP_STAT,
+    PERF_OP_CD,
+    PERF_OP_SYNC,
+    PERF_OP_CLONE,
+    PERF_NUM_OPS
+};
+
+// bucket i counts latencies in [2^i, 2^(i+1)) ns; the last one is open-ended
+#define PERF_HIST_BUCKETS 40
+
+struct perf_op_stats {
+    uint64_t calls;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t hist[PERF_HIST_BUCKETS];
+};
+
+struct perf_stats {
+    uint64_t counters[PERF_NUM_COUNTERS];
+    struct perf_op_stats ops[PERF_NUM_OPS];
+};
+
+// === PUBLIC FUNCTIONS ===
+
+// true when the counters are compiled in
+bool perf_enabled(void);
+
+// copies the current values into out
+void perf_snapshot(struct perf_stats* out);
+
+// sets every counter and histogram back to zero
+void perf_reset(void);
+
+const char* perf_counter_name(enum perf_counter c);
+const char* perf_op_name(enum perf_op op);
+
+// upper bound of the histogram bucket holding the pct-th percentile, in ns
+// (capped at max_ns, 0 when the operation was never called)
+uint64_t perf_op_percentile(const struct perf_op_stats* op, unsigned pct);
+
+// prints the non-zero counters and the latency of every operation called
+void perf_print(const struct perf_stats* stats);
+
+// === HOOKS ===
+
+#ifdef FS_PERF
+
+extern uint64_t perf_counters[PERF_NUM_COUNTERS];
+
+struct perf_timer {
+    enum perf_op op;
+    uint64_t start_ns;
+};
+
+void perf_timer_stop(struct perf_timer* t);
+uint64_t perf_now_ns(void);
+
+#define PERF_ADD(c, n) \
+    __atomic_fetch_add(&perf_counters[(c)], (uint64_t)(n), __ATOMIC_RELAXED)
+
+// times the rest of the enclosing function, whichever return it leaves by
+#define PERF_OP(op) \
+    struct perf_timer perf_timer_ __attribute__((cleanup(perf_timer_stop))) = \
+        { (op), perf_now_ns() }
+
+#else
+
+// the arguments are still evaluated (and optimised away) so that values
+// computed only for a counter do not trigger unused-variable warnings
+#define PERF_ADD(c, n) ((void)(c), (void)(n))
+#define PERF_OP(op)    ((void)(op))
+
+#endif
@@ -0,0 +1,130 @@
+/**
+   Operation trace header file.
+
+   A fixed-size ring of the most recent fs_* calls, one event per call with
+   its path, inode, byte count, the disk blocks it moved and its duration,
+   to find the individual slow calls behind a bad percentile in perf.h.
+
+   Tracing is compiled in with -DFS_TRACE (the Makefile's FS_TRACE=1, the
+   default) and starts switched off: trace_enable() turns it on at run
+   time, and until then a traced call costs one relaxed load. Without
+   FS_TRACE the hooks below expand to nothing.
+
+   Writers never lock. Each one claims a slot with an atomic increment of
+   the ring head and publishes it by storing the slot's sequence number
+   last; a reader that sees the sequence change while copying a slot drops
+   it. Once the ring is full the oldest events are overwritten.
+
+   The blocks of an event are those its own thread read, wrote or borrowed
+   from the disk layer while the call ran.
+ */
+
+#pragma once
+
+#include "perf.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// events kept (a power of two)
+#define TRACE_RING_SIZE 4096
+
+// bytes of path kept per event; longer paths keep their tail
+#define TRACE_PATH_LEN 48
+
+// inode_num of an event whose call did not resolve one
+#define TRACE_NO_INODE 0xFFFFFFFFu
+
+struct trace_event {
+    uint64_t seq;                     // 1 for the first event recorded, 0 = empty slot
+    uint64_t start_ns;                // CLOCK_MONOTONIC at entry
+    uint64_t duration_ns;
+    uint64_t bytes;                   // bytes read or written
+    uint32_t inode_num;               // or TRACE_NO_INODE
+    uint32_t blocks;                  // disk blocks touched by the call
+    uint16_t op;                      // enum perf_op
+    uint16_t thread;                  // small per-process thread number
+    uint32_t reserved;
+    char path[TRACE_PATH_LEN];        // NUL-terminated, empty for handle calls
+};
+
+_Static_assert(sizeof(struct trace_event) == 96, "trace_event is part of the file format");
+
+// === FILE FORMAT ===
+
+// a trace file is this header followed by `count` events in host byte order
+#define TRACE_FILE_MAGIC   "FSTRACE"
+#define TRACE_FILE_VERSION 1
+
+struct trace_file_header {
+    char magic[8];                    // TRACE_FILE_MAGIC, NUL-padded
+    uint32_t version;
+    uint32_t event_size;              // sizeof(struct trace_event)
+    uint64_t count;
+};
+
+// === PUBLIC FUNCTIONS ===
+
+// true when tracing is compiled in
+bool trace_compiled(void);
+
+// starts or stops recording (no-op when not compiled in)
+void trace_enable(bool on);
+bool trace_is_enabled(void);
+
+// drops every recorded event; sequence numbers start again at 1
+void trace_clear(void);
+
+// copies the most recent events (at most max) into out, oldest first, and
+// returns how many were copied
+size_t trace_snapshot(struct trace_event* out, size_t max);
+
+// writes the current ring to path; returns SUCCESS or ERROR_IO
+int trace_save(const char* path);
+
+// reads a trace file into a malloc'd array (caller frees); returns SUCCESS,
+// ERROR_IO, or ERROR_INVALID for a file in another format
+int trace_load(const char* path, struct trace_event** out_events, size_t* out_count);
+
+// prints events as a table, start times relative to the earliest one
+void trace_print(FILE* out, const struct trace_event* events, size_t count);
+
+// === HOOKS ===
+
+#ifdef FS_TRACE
+
+extern __thread uint64_t trace_thread_blocks;
+
+struct trace_span {
+    bool active;
+    enum perf_op op;
+    const char* path;
+    uint64_t start_ns;
+    uint64_t start_blocks;
+    uint32_t inode_num;
+    uint64_t bytes;
+};
+
+void trace_span_begin(struct trace_span* s, enum perf_op op, const char* path);
+void trace_span_end(struct trace_span* s);
+
+// records the rest of the enclosing function as one event, like PERF_OP
+#define TRACE_OP(op, path) \
+    struct trace_span trace_span_ __attribute__((cleanup(trace_span_end))); \
+    trace_span_begin(&trace_span_, (op), (path))
+
+// fills in the inode and byte count of the current TRACE_OP
+#define TRACE_IO(ino, n) \
+    (trace_span_.inode_num = (ino), trace_span_.bytes = (uint64_t)(n))
+
+// blocks moved by the calling thread
+#define TRACE_BLOCKS(n) (trace_thread_blocks += (uint64_t)(n))
+
+#else
+
+#define TRACE_OP(op, path) ((void)(op), (void)(path))
+#define TRACE_IO(ino, n)   ((void)(ino), (void)(n))
+#define TRACE_BLOCKS(n)    ((void)(n))
+
+#endif
@@ -1,24 +1,19 @@
-#include "disk.h"
+#define _GNU_SOURCE          // O_DIRECT, sync_file_range
+#include "disk_internal.h"
+#include "perf.h"
+#include "trace.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <sys/mman.h>
 #include <sys/stat.h>
 #include <errno.h>
 #include <sys/types.h>
 
-// disk emulator struct definition (it is private here in disk.c)
-struct disk_emulator {
-    int fd;                          // file descriptor of file on disk
-    void* mapped_memory;             // pointer to mapped memory
-    size_t size;                     // total size in bytes
-    int block_count;                 // number of blocks
-    int block_size;                  // size of a block (512)
-    bool attached;                   // true if disk is attached
-    char filename[MAX_FILENAME];     // filename on disk
-};
+// granularity of dirty tracking: a write marks its chunks, a sync only
+// flushes marked chunks (rounded up to the page size where pages are larger)
+#define DISK_SYNC_CHUNK (64 * 1024)
 
 // === PRIVATE FUNCTIONS ===
 
@@ -28,33 +23,414 @@ static bool is_valid_block(disk_t disk, int block_num) {
 }
 
 // converts block number into offset
-static off_t block_to_offset(int block_num) {
-    return (off_t)block_num * BLOCK_SIZE;
+static off_t block_to_offset(disk_t disk, int block_num) {
+    return (off_t)block_num * disk->block_size;
+}
+
+// validates a range of count blocks starting at first_block
+static bool is_valid_range(disk_t disk, int first_block, int count) {
+    return count > 0 && is_valid_block(disk, first_block) &&
+           count <= disk->block_count - first_block;
+}
+
+static const struct disk_backend_ops* backend_ops(disk_backend_t backend) {
+    switch (backend) {
+        case DISK_BACKEND_MMAP: return &disk_mmap_ops;
+        case DISK_BACKEND_PREAD: return &disk_pread_ops;
+        case DISK_BACKEND_URING: return &disk_uring_ops;
+        default: return NULL;
+    }
+}
+
+// marks the sync chunks overlapping len bytes at offset as dirty (disk->lock held)
+static void mark_dirty(disk_t disk, size_t offset, size_t len) {
+    disk->dirty = true;
+    if (!disk->dirty_chunks || len == 0)
+        return;
+
+    size_t first = offset / disk->chunk_size;
+    size_t last = (offset + len - 1) / disk->chunk_size;
+    for (size_t c = first; c <= last; c++) {
+        uint64_t bit = 1ULL << (c % 64);
+        if (!(disk->dirty_chunks[c / 64] & bit)) {
+            disk->dirty_chunks[c / 64] |= bit;
+            disk->dirty_count++;
+        }
+    }
+}
+
+// mark_dirty for a transfer that just completed
+static void note_written(disk_t disk, size_t offset, size_t len) {
+    pthread_mutex_lock(&disk->lock);
+    mark_dirty(disk, offset, len);
+    pthread_mutex_unlock(&disk->lock);
+}
+
+// clears the chunks lying entirely inside [begin, end) (disk->lock held)
+static void clear_dirty(disk_t disk, size_t begin, size_t end) {
+    if (!disk->dirty_chunks)
+        return;
+
+    // the last chunk may be short: reaching the end of the image covers it
+    size_t first = (begin + disk->chunk_size - 1) / disk->chunk_size;
+    size_t stop = (end >= disk->size) ? disk->chunk_count : end / disk->chunk_size;
+    for (size_t c = first; c < stop; c++) {
+        uint64_t bit = 1ULL << (c % 64);
+        if (disk->dirty_chunks[c / 64] & bit) {
+            disk->dirty_chunks[c / 64] &= ~bit;
+            disk->dirty_count--;
+        }
+    }
+
+    if (disk->dirty_count == 0)
+        disk->dirty = false;
+}
+
+// backend sync over [begin, end), clipped to the image
+static int sync_span(disk_t disk, size_t begin, size_t end, bool wait) {
+    if (end > disk->size)
+        end = disk->size;
+    if (begin >= end)
+        return DISK_SUCCESS;
+
+    PERF_ADD(PERF_DISK_SYNCS, 1);
+    return disk->ops->sync(disk, begin, end, wait);
+}
+
+/*
+ * Syncs every run of dirty chunks; a synchronous pass also clears them.
+ * A run is counted clean before it is synced, with the lock dropped during
+ * the sync: a write landing meanwhile marks its chunk again, so it is never
+ * lost (a failed sync marks the run dirty again).
+ */
+static int sync_dirty(disk_t disk, bool wait) {
+    pthread_mutex_lock(&disk->lock);
+    if (!disk->dirty) {
+        pthread_mutex_unlock(&disk->lock);
+        return DISK_SUCCESS;
+    }
+
+    // untracked: the whole image
+    if (!disk->dirty_chunks) {
+        if (wait)
+            disk->dirty = false;
+        pthread_mutex_unlock(&disk->lock);
+        int res = sync_span(disk, 0, disk->size, wait);
+        if (res != DISK_SUCCESS && wait) {
+            pthread_mutex_lock(&disk->lock);
+            disk->dirty = true;
+            pthread_mutex_unlock(&disk->lock);
+        }
+        return res;
+    }
+
+    size_t c = 0;
+    while (c < disk->chunk_count) {
+        uint64_t word = disk->dirty_chunks[c / 64] >> (c % 64);
+        if (word == 0) {
+            c = (c / 64 + 1) * 64;      // skip the clean rest of the word
+            continue;
+        }
+        c += (size_t)__builtin_ctzll(word);
+        if (c >= disk->chunk_count)
+            break;
+
+        size_t run = c;
+        while (run < disk->chunk_count &&
+               (disk->dirty_chunks[run / 64] & (1ULL << (run % 64))))
+            run++;
+
+        size_t begin = c * disk->chunk_size;
+        size_t end = run * disk->chunk_size;
+        if (wait)
+            clear_dirty(disk, begin, end);
+        pthread_mutex_unlock(&disk->lock);
+
+        int res = sync_span(disk, begin, end, wait);
+
+        pthread_mutex_lock(&disk->lock);
+        if (res != DISK_SUCCESS) {
+            if (wait)
+                mark_dirty(disk, begin, (end < disk->size ? end : disk->size) - begin);
+            pthread_mutex_unlock(&disk->lock);
+            return res;
+        }
+        c = run;
+    }
+    pthread_mutex_unlock(&disk->lock);
+    return DISK_SUCCESS;
+}
+
+static inline bool is_aligned(size_t value, size_t align) {
+    return (value & (align - 1)) == 0;
+}
+
+// counts a transfer in blocks (a partial one counts as a whole)
+static inline void count_io(disk_t disk, size_t bytes, bool write) {
+    size_t blocks = (bytes + disk->block_size - 1) / disk->block_size;
+    PERF_ADD(write ? PERF_DISK_BLOCKS_WRITTEN : PERF_DISK_BLOCKS_READ, blocks);
+    TRACE_BLOCKS(blocks);
+}
+
+/*
+ * Runs n spans through the backend. Under O_DIRECT, spans whose buffer is
+ * not DISK_DIRECT_ALIGN-aligned go through an aligned bounce buffer (their
+ * offset and length are sector multiples by construction).
+ */
+static int run_spans(disk_t disk, const struct disk_span* spans, int n, bool write) {
+    for (int i = 0; i < n; i++)
+        count_io(disk, spans[i].len, write);
+
+    if (!disk->direct) {
+        return disk->ops->io(disk, spans, n, write);
+    }
+
+    struct disk_span* io = malloc((size_t)n * sizeof(struct disk_span));
+    if (!io) {
+        return DISK_ERROR;
+    }
+    memcpy(io, spans, (size_t)n * sizeof(struct disk_span));
+
+    int res = DISK_SUCCESS;
+    for (int i = 0; i < n; i++) {
+        if (is_aligned((uintptr_t)spans[i].buffer, DISK_DIRECT_ALIGN))
+            continue;
+
+        void* bounce;
+        if (posix_memalign(&bounce, DISK_DIRECT_ALIGN, spans[i].len) != 0) {
+            res = DISK_ERROR;
+            break;
+        }
+        io[i].buffer = bounce;
+        if (write)
+            memcpy(bounce, spans[i].buffer, spans[i].len);
+    }
+
+    if (res == DISK_SUCCESS)
+        res = disk->ops->io(disk, io, n, write);
+
+    for (int i = 0; i < n; i++) {
+        if (io[i].buffer == spans[i].buffer)
+            continue;
+        if (res == DISK_SUCCESS && !write)
+            memcpy(spans[i].buffer, io[i].buffer, spans[i].len);
+        free(io[i].buffer);
+    }
+
+    free(io);
+    return res;
+}
+
+/*
+ * Byte-level transfer. Under O_DIRECT an unaligned range is widened to
+ * whole sectors (read-modify-write for a write).
+ */
+static int transfer(disk_t disk, size_t offset, void* buffer, size_t size, bool write) {
+    if (!disk->direct || (is_aligned(offset, DISK_DIRECT_SECTOR) &&
+                          is_aligned(size, DISK_DIRECT_SECTOR))) {
+        struct disk_span span = { offset, size, buffer };
+        return run_spans(disk, &span, 1, write);
+    }
+
+    size_t begin = offset & ~((size_t)DISK_DIRECT_SECTOR - 1);
+    size_t end = (offset + size + DISK_DIRECT_SECTOR - 1) & ~((size_t)DISK_DIRECT_SECTOR - 1);
+    void* bounce;
+    if (posix_memalign(&bounce, DISK_DIRECT_ALIGN, end - begin) != 0) {
+        return DISK_ERROR;
+    }
+
+    struct disk_span span = { begin, end - begin, bounce };
+    count_io(disk, size, write);
+    int res = disk->ops->io(disk, &span, 1, false);
+    if (res == DISK_SUCCESS && write) {
+        memcpy((char*)bounce + (offset - begin), buffer, size);
+        res = disk->ops->io(disk, &span, 1, true);
+    } else if (res == DISK_SUCCESS) {
+        memcpy(buffer, (char*)bounce + (offset - begin), size);
+    }
+
+    free(bounce);
+    return res;
+}
+
+static struct disk_borrow* find_borrow(disk_t disk, int first_block, int count) {
+    for (struct disk_borrow* b = disk->borrows; b; b = b->next) {
+        if (b->first_block == first_block && b->count == count)
+            return b;
+    }
+    return NULL;
+}
+
+// a borrow without a mapping: an aligned copy of the range
+static int borrow_buffered(disk_t disk, int first_block, int count, void** out_ptr) {
+    struct disk_borrow* b = find_borrow(disk, first_block, count);
+    if (b) {
+        b->refs++;
+        *out_ptr = b->buffer;
+        return DISK_SUCCESS;
+    }
+
+    b = calloc(1, sizeof(struct disk_borrow));
+    if (!b) {
+        return DISK_ERROR;
+    }
+    size_t len = (size_t)count * disk->block_size;
+    if (posix_memalign(&b->buffer, DISK_DIRECT_ALIGN, len) != 0) {
+        free(b);
+        return DISK_ERROR;
+    }
+
+    struct disk_span span = { (size_t)block_to_offset(disk, first_block), len, b->buffer };
+    int res = disk->ops->io(disk, &span, 1, false);
+    if (res != DISK_SUCCESS) {
+        free(b->buffer);
+        free(b);
+        return res;
+    }
+
+    b->first_block = first_block;
+    b->count = count;
+    b->refs = 1;
+    b->next = disk->borrows;
+    disk->borrows = b;
+    *out_ptr = b->buffer;
+    return DISK_SUCCESS;
+}
+
+static void release_buffered(disk_t disk, int first_block, int count, bool dirty) {
+    struct disk_borrow** link = &disk->borrows;
+    while (*link && ((*link)->first_block != first_block || (*link)->count != count))
+        link = &(*link)->next;
+
+    struct disk_borrow* b = *link;
+    if (!b)
+        return;
+
+    b->dirty |= dirty;
+    if (--b->refs > 0)
+        return;
+
+    // last borrow of the range: write the copy back
+    if (b->dirty) {
+        size_t offset = (size_t)block_to_offset(disk, first_block);
+        struct disk_span span = { offset, (size_t)count * disk->block_size, b->buffer };
+        if (disk->ops->io(disk, &span, 1, true) != DISK_SUCCESS)
+            fprintf(stderr, "disk_release_blocks: write-back of blocks %d..%d failed\n",
+                    first_block, first_block + count - 1);
+        mark_dirty(disk, offset, span.len);
+    }
+
+    *link = b->next;
+    free(b->buffer);
+    free(b);
+}
+
+// common part of the borrow calls
+static int borrow_range(disk_t disk, int first_block, int count, void** out_ptr) {
+    if (!disk_is_attached(disk)) {
+        return DISK_ERROR_NOT_ATTACHED;
+    }
+
+    if (!out_ptr) {
+        return DISK_ERROR;
+    }
+
+    if (!is_valid_range(disk, first_block, count)) {
+        return DISK_ERROR_INVALID_BLOCK;
+    }
+
+    pthread_mutex_lock(&disk->lock);
+    if (disk->ops->map) {
+        *out_ptr = disk->ops->map(disk, (size_t)block_to_offset(disk, first_block));
+    } else {
+        int res = borrow_buffered(disk, first_block, count, out_ptr);
+        if (res != DISK_SUCCESS) {
+            pthread_mutex_unlock(&disk->lock);
+            return res;
+        }
+    }
+
+    disk->borrowed++;
+    pthread_mutex_unlock(&disk->lock);
+    PERF_ADD(PERF_DISK_BLOCKS_BORROWED, count);
+    TRACE_BLOCKS(count);
+    return DISK_SUCCESS;
+}
+
+// validates the requests of a batched call and turns them into spans
+static int build_spans(disk_t disk, const struct disk_request* reqs, int n,
+                       struct disk_span** out_spans) {
+    if (!reqs || n <= 0) {
+        return DISK_ERROR;
+    }
+
+    struct disk_span* spans = malloc((size_t)n * sizeof(struct disk_span));
+    if (!spans) {
+        return DISK_ERROR;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (!is_valid_range(disk, reqs[i].block_num, reqs[i].count)) {
+            free(spans);
+            return DISK_ERROR_INVALID_BLOCK;
+        }
+        if (!reqs[i].buffer) {
+            free(spans);
+            return DISK_ERROR;
+        }
+        spans[i].offset = (size_t)block_to_offset(disk, reqs[i].block_num);
+        spans[i].len = (size_t)reqs[i].count * disk->block_size;
+        spans[i].buffer = reqs[i].buffer;
+    }
+
+    *out_spans = spans;
+    return DISK_SUCCESS;
 }
 
 // === PUBLIC FUNCTIONS ===
 
 int disk_attach(const char* filename, size_t size, bool create_new, disk_t* disk) {
+    return disk_attach_with_options(filename, size, create_new, NULL, disk);
+}
+
+int disk_attach_with_options(const char* filename, size_t size, bool create_new,
+                             const disk_attach_options_t* opts, disk_t* disk) {
     if (!filename || !disk) {
         return DISK_ERROR;
     }
 
     *disk = NULL;
 
-    disk_t d = malloc(sizeof(struct disk_emulator));
+    disk_backend_t backend = opts ? opts->backend : DISK_BACKEND_MMAP;
+    bool direct = opts && opts->direct;
+    const struct disk_backend_ops* ops = backend_ops(backend);
+    if (!ops) {
+        return DISK_ERROR;
+    }
+    // a mapping always goes through the page cache
+    if (direct && backend == DISK_BACKEND_MMAP) {
+        return DISK_ERROR_UNSUPPORTED;
+    }
+
+    disk_t d = calloc(1, sizeof(struct disk_emulator));
     if (!d) {
         return DISK_ERROR;
     }
-    
+
     // open/create file
     int flags = create_new ? (O_RDWR | O_CREAT | O_TRUNC) : O_RDWR;
+    if (direct) {
+        flags |= O_DIRECT;
+    }
     int mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
-    
+
     d->fd = open(filename, flags, mode);
     if (d->fd == -1) {
+        int err = errno;
         perror("disk_attach: open");
         free(d);
-        return DISK_ERROR_IO;
+        // O_DIRECT is refused by filesystems that cannot honour it
+        return (direct && err == EINVAL) ? DISK_ERROR_UNSUPPORTED : DISK_ERROR_IO;
     }
 
     // if we're creating a new disk, set new size
@@ -62,7 +438,6 @@ int disk_attach(const char* filename, size_t size, bool create_new, disk_t* disk
         if (ftruncate(d->fd, size) == -1) {
             perror("disk_attach: ftruncate");
             close(d->fd);
-            d->fd = -1;
             free(d);
             return DISK_ERROR_IO;
         }
@@ -73,32 +448,52 @@ int disk_attach(const char* filename, size_t size, bool create_new, disk_t* disk
         if (fstat(d->fd, &st) == -1) {
             perror("disk_attach: fstat");
             close(d->fd);
-            d->fd = -1;
             free(d);
             return DISK_ERROR_IO;
         }
         d->size = st.st_size;
     }
 
-    // map file in memory
-    d->mapped_memory = mmap(NULL, d->size, PROT_READ | PROT_WRITE, 
-                              MAP_SHARED, d->fd, 0);
-    if (d->mapped_memory == MAP_FAILED) {
-        perror("disk_attach: mmap");
+    // direct transfers never extend past the last whole page of the image
+    if (direct && !is_aligned(d->size, DISK_DIRECT_ALIGN)) {
         close(d->fd);
-        d->fd = -1;
         free(d);
-        return DISK_ERROR_IO;
+        return DISK_ERROR;
     }
 
     // initialize struct fields
     strncpy(d->filename, filename, MAX_FILENAME - 1);
     d->filename[MAX_FILENAME - 1] = '\0';
+    d->ops = ops;
+    d->backend = backend;
+    d->direct = direct;
     d->block_count = d->size / BLOCK_SIZE;
+    d->block_size = BLOCK_SIZE;
+    d->dirty = false;
+    d->borrowed = 0;
+    d->borrows = NULL;
+    pthread_mutex_init(&d->lock, NULL);
+
+    int res = ops->open(d);
+    if (res != DISK_SUCCESS) {
+        pthread_mutex_destroy(&d->lock);
+        close(d->fd);
+        free(d);
+        return res;
+    }
     d->attached = true;
 
-    printf("Disk attached: %s (Size: %zu bytes, Blocks: %d)\n",
-           filename, d->size, d->block_count);
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    d->chunk_size = DISK_SYNC_CHUNK;
+    while (d->chunk_size % page != 0)
+        d->chunk_size *= 2;
+    d->chunk_count = (d->size + d->chunk_size - 1) / d->chunk_size;
+    d->dirty_count = 0;
+    // without the tracking bitmap a sync falls back to the whole image
+    d->dirty_chunks = calloc((d->chunk_count + 63) / 64 + 1, sizeof(uint64_t));
+
+    printf("Disk attached: %s (Size: %zu bytes, Blocks: %d, Backend: %s%s)\n",
+           filename, d->size, d->block_count, ops->name, direct ? ", direct" : "");
 
     *disk = d;
     return DISK_SUCCESS;
@@ -109,20 +504,30 @@ int disk_detach(disk_t disk) {
         return DISK_ERROR_NOT_ATTACHED;
     }
 
+    if (disk->borrowed > 0) {
+        fprintf(stderr, "disk_detach: %d block borrow(s) still outstanding\n",
+                disk->borrowed);
+    }
+
+    // copies nobody will release: their changes are lost
+    while (disk->borrows) {
+        struct disk_borrow* b = disk->borrows;
+        disk->borrows = b->next;
+        free(b->buffer);
+        free(b);
+    }
+
     // sync before detach
     disk_sync(disk);
 
-    // unmap memory
-    if (disk->mapped_memory && disk->mapped_memory != MAP_FAILED) {
-        if (munmap(disk->mapped_memory, disk->size) == -1) {
-            perror("disk_detach: munmap");
-        }
-    }
+    disk->ops->close(disk);
 
     // close file
     if (disk->fd != -1) {
         close(disk->fd);
     }
+    free(disk->dirty_chunks);
+    pthread_mutex_destroy(&disk->lock);
 
     printf("Disk detached: %s\n", disk->filename);
 
@@ -135,80 +540,230 @@ int disk_detach(disk_t disk) {
     return DISK_SUCCESS;
 }
 
+int disk_grow(disk_t disk, size_t new_size) {
+    if (!disk_is_attached(disk)) {
+        return DISK_ERROR_NOT_ATTACHED;
+    }
+
+    if (new_size < disk->size || (disk->direct && !is_aligned(new_size, DISK_DIRECT_ALIGN))) {
+        return DISK_ERROR;
+    }
+    if (new_size == disk->size) {
+        return DISK_SUCCESS;
+    }
+
+    pthread_mutex_lock(&disk->lock);
+
+    // a moved mapping would leave borrowed pointers dangling
+    if (disk->ops->map && disk->borrowed > 0) {
+        pthread_mutex_unlock(&disk->lock);
+        return DISK_ERROR;
+    }
+
+    if (ftruncate(disk->fd, (off_t)new_size) == -1) {
+        perror("disk_grow: ftruncate");
+        pthread_mutex_unlock(&disk->lock);
+        return DISK_ERROR_IO;
+    }
+
+    size_t old_size = disk->size;
+    disk->size = new_size;
+    if (disk->ops->resize) {
+        int res = disk->ops->resize(disk, old_size);
+        if (res != DISK_SUCCESS) {
+            disk->size = old_size;
+            if (ftruncate(disk->fd, (off_t)old_size) == -1)
+                perror("disk_grow: ftruncate");
+            pthread_mutex_unlock(&disk->lock);
+            return res;
+        }
+    }
+    disk->block_count = disk->size / disk->block_size;
+
+    // the added chunks start clean (the extension reads as zeros); without
+    // room for their bits, syncs fall back to the whole image
+    size_t chunk_count = (disk->size + disk->chunk_size - 1) / disk->chunk_size;
+    size_t old_words = (disk->chunk_count + 63) / 64 + 1;
+    size_t words = (chunk_count + 63) / 64 + 1;
+    if (disk->dirty_chunks) {
+        uint64_t* grown = realloc(disk->dirty_chunks, words * sizeof(uint64_t));
+        if (grown) {
+            memset(grown + old_words, 0, (words - old_words) * sizeof(uint64_t));
+            disk->dirty_chunks = grown;
+        } else {
+            free(disk->dirty_chunks);
+            disk->dirty_chunks = NULL;
+        }
+    }
+    disk->chunk_count = chunk_count;
+    pthread_mutex_unlock(&disk->lock);
+
+    printf("Disk grown: %s (Size: %zu bytes, Blocks: %d)\n",
+           disk->filename, disk->size, disk->block_count);
+    return DISK_SUCCESS;
+}
+
 int disk_read_block(disk_t disk, int block_num, void* buffer) {
     if (!disk_is_attached(disk)) {
         return DISK_ERROR_NOT_ATTACHED;
     }
-    
+
     if (!is_valid_block(disk, block_num)) {
         return DISK_ERROR_INVALID_BLOCK;
     }
-    
+
     if (!buffer) {
         return DISK_ERROR;
     }
 
-    off_t offset = block_to_offset(block_num);
-    
-    // copy from mapped memory to buffer
-    memcpy(buffer, (char*)disk->mapped_memory + offset, BLOCK_SIZE);
-    
-    return DISK_SUCCESS;
+    struct disk_span span = { (size_t)block_to_offset(disk, block_num), disk->block_size, buffer };
+    return run_spans(disk, &span, 1, false);
 }
 
 int disk_write_block(disk_t disk, int block_num, const void* buffer) {
     if (!disk_is_attached(disk)) {
         return DISK_ERROR_NOT_ATTACHED;
     }
-    
+
     if (!is_valid_block(disk, block_num)) {
         return DISK_ERROR_INVALID_BLOCK;
     }
-    
+
     if (!buffer) {
         return DISK_ERROR;
     }
 
-    off_t offset = block_to_offset(block_num);
-    
-    // copy from buffer to mapped memory
-    memcpy((char*)disk->mapped_memory + offset, buffer, BLOCK_SIZE);
-    
+    size_t offset = (size_t)block_to_offset(disk, block_num);
+    struct disk_span span = { offset, disk->block_size, (void*)buffer };
+    int res = run_spans(disk, &span, 1, true);
+    if (res == DISK_SUCCESS) {
+        note_written(disk, offset, disk->block_size);
+    }
+
+    return res;
+}
+
+int disk_read_blocks(disk_t disk, const struct disk_request* reqs, int n) {
+    if (!disk_is_attached(disk)) {
+        return DISK_ERROR_NOT_ATTACHED;
+    }
+
+    struct disk_span* spans;
+    int res = build_spans(disk, reqs, n, &spans);
+    if (res != DISK_SUCCESS) {
+        return res;
+    }
+
+    res = run_spans(disk, spans, n, false);
+    free(spans);
+    return res;
+}
+
+int disk_write_blocks(disk_t disk, const struct disk_request* reqs, int n) {
+    if (!disk_is_attached(disk)) {
+        return DISK_ERROR_NOT_ATTACHED;
+    }
+
+    struct disk_span* spans;
+    int res = build_spans(disk, reqs, n, &spans);
+    if (res != DISK_SUCCESS) {
+        return res;
+    }
+
+    res = run_spans(disk, spans, n, true);
+    if (res == DISK_SUCCESS) {
+        for (int i = 0; i < n; i++)
+            note_written(disk, spans[i].offset, spans[i].len);
+    }
+    free(spans);
+    return res;
+}
+
+int disk_set_block_size(disk_t disk, size_t block_size) {
+    if (!disk_is_attached(disk)) {
+        return DISK_ERROR_NOT_ATTACHED;
+    }
+
+    if (block_size < BLOCK_SIZE_MIN || block_size > BLOCK_SIZE_MAX ||
+        (block_size & (block_size - 1)) != 0) {
+        return DISK_ERROR;
+    }
+
+    // outstanding pointers were computed with the old geometry
+    if (disk->borrowed > 0) {
+        return DISK_ERROR;
+    }
+
+    disk->block_size = (int)block_size;
+    disk->block_count = disk->size / block_size;
     return DISK_SUCCESS;
 }
 
+int disk_borrow_blocks(disk_t disk, int first_block, int count, const void** out_ptr) {
+    return borrow_range(disk, first_block, count, (void**)out_ptr);
+}
+
+int disk_borrow_blocks_mut(disk_t disk, int first_block, int count, void** out_ptr) {
+    return borrow_range(disk, first_block, count, out_ptr);
+}
+
+void disk_release_blocks(disk_t disk, int first_block, int count, bool dirty) {
+    if (!disk_is_attached(disk) || !is_valid_range(disk, first_block, count)) {
+        return;
+    }
+
+    pthread_mutex_lock(&disk->lock);
+    if (disk->borrowed > 0) {
+        disk->borrowed--;
+    }
+
+    if (dirty) {
+        PERF_ADD(PERF_DISK_BLOCKS_WRITTEN, count);
+    }
+
+    if (!disk->ops->map) {
+        release_buffered(disk, first_block, count, dirty);
+    } else if (dirty) {
+        mark_dirty(disk, (size_t)block_to_offset(disk, first_block),
+                   (size_t)count * disk->block_size);
+    }
+    pthread_mutex_unlock(&disk->lock);
+}
+
 int disk_read(disk_t disk, off_t offset, void* buffer, size_t size) {
     if (!disk_is_attached(disk)) {
         return DISK_ERROR_NOT_ATTACHED;
     }
-    
+
     if (!buffer || size == 0) {
         return DISK_ERROR;
     }
-    
-    if (offset + size > disk->size) {
+
+    if (offset < 0 || offset + size > disk->size) {
         return DISK_ERROR_INVALID_BLOCK;
     }
-    
-    memcpy(buffer, (char*)disk->mapped_memory + offset, size);
-    return DISK_SUCCESS;
+
+    return transfer(disk, (size_t)offset, buffer, size, false);
 }
 
 int disk_write(disk_t disk, off_t offset, const void* buffer, size_t size) {
     if (!disk_is_attached(disk)) {
         return DISK_ERROR_NOT_ATTACHED;
     }
-    
+
     if (!buffer || size == 0) {
         return DISK_ERROR;
     }
-    
-    if (offset + size > disk->size) {
+
+    if (offset < 0 || offset + size > disk->size) {
         return DISK_ERROR_INVALID_BLOCK;
     }
-    
-    memcpy((char*)disk->mapped_memory + offset, buffer, size);
-    return DISK_SUCCESS;
+
+    int res = transfer(disk, (size_t)offset, (void*)buffer, size, true);
+    if (res == DISK_SUCCESS) {
+        note_written(disk, (size_t)offset, size);
+    }
+    return res;
 }
 
 size_t disk_get_size(disk_t disk) {
@@ -239,6 +794,22 @@ bool disk_is_attached(disk_t disk) {
     return disk->attached;
 }
 
+disk_backend_t disk_get_backend(disk_t disk) {
+    if (!disk_is_attached(disk)) {
+        return DISK_BACKEND_MMAP;
+    }
+    return disk->backend;
+}
+
+bool disk_is_mapped(disk_t disk) {
+    return disk_is_attached(disk) && disk->ops->map != NULL;
+}
+
+const char* disk_backend_name(disk_backend_t backend) {
+    const struct disk_backend_ops* ops = backend_ops(backend);
+    return ops ? ops->name : "unknown";
+}
+
 const char* disk_get_filename(disk_t disk) {
     if (!disk_is_attached(disk)) {
         return NULL;
@@ -250,16 +821,161 @@ int disk_sync(disk_t disk) {
     if (!disk_is_attached(disk)) {
         return DISK_ERROR_NOT_ATTACHED;
     }
-    
-    // force write on disk
-    if (msync(disk->mapped_memory, disk->size, MS_SYNC) == -1) {
-        perror("disk_sync: msync");
+
+    // force the chunks written since the last sync to disk
+    return sync_dirty(disk, true);
+}
+
+int disk_sync_async(disk_t disk) {
+    if (!disk_is_attached(disk)) {
+        return DISK_ERROR_NOT_ATTACHED;
+    }
+
+    // only schedules write-back: the chunks stay dirty until a disk_sync
+    return sync_dirty(disk, false);
+}
+
+static int sync_range(disk_t disk, off_t offset, size_t len, bool wait) {
+    if (!disk_is_attached(disk)) {
+        return DISK_ERROR_NOT_ATTACHED;
+    }
+
+    if (offset < 0 || len == 0 || (size_t)offset > disk->size ||
+        len > disk->size - (size_t)offset) {
+        return DISK_ERROR_INVALID_BLOCK;
+    }
+
+    pthread_mutex_lock(&disk->lock);
+    if (!disk->dirty) {
+        pthread_mutex_unlock(&disk->lock);
+        return DISK_SUCCESS;
+    }
+
+    // widened to whole chunks so that they can be counted clean; the
+    // kernel skips the clean pages of the widened part
+    size_t begin = (size_t)offset;
+    size_t end = begin + len;
+    if (disk->dirty_chunks) {
+        begin -= begin % disk->chunk_size;
+        end = (end + disk->chunk_size - 1) / disk->chunk_size * disk->chunk_size;
+    }
+
+    // counted clean first, as in sync_dirty
+    if (wait)
+        clear_dirty(disk, begin, end);
+    pthread_mutex_unlock(&disk->lock);
+
+    int res = sync_span(disk, begin, end, wait);
+    if (res != DISK_SUCCESS && wait) {
+        pthread_mutex_lock(&disk->lock);
+        mark_dirty(disk, begin, (end < disk->size ? end : disk->size) - begin);
+        pthread_mutex_unlock(&disk->lock);
+    }
+    return res;
+}
+
+int disk_sync_range(disk_t disk, off_t offset, size_t len) {
+    return sync_range(disk, offset, len, true);
+}
+
+int disk_sync_range_async(disk_t disk, off_t offset, size_t len) {
+    return sync_range(disk, offset, len, false);
+}
+
+int disk_sync_blocks(disk_t disk, int first_block, int count) {
+    if (!disk_is_attached(disk)) {
+        return DISK_ERROR_NOT_ATTACHED;
+    }
+
+    if (!is_valid_range(disk, first_block, count)) {
+        return DISK_ERROR_INVALID_BLOCK;
+    }
+
+    return disk_sync_range(disk, block_to_offset(disk, first_block),
+                           (size_t)count * disk->block_size);
+}
+
+int disk_fd_sync(disk_t disk, size_t begin, size_t end, bool wait) {
+    if (wait) {
+        // no portable way to make part of a file durable: the data of the
+        // whole file is, which covers the range
+        if (fdatasync(disk->fd) == -1) {
+            perror("disk_sync: fdatasync");
+            return DISK_ERROR_IO;
+        }
+        return DISK_SUCCESS;
+    }
+
+    if (sync_file_range(disk->fd, (off_t)begin, (off_t)(end - begin),
+                        SYNC_FILE_RANGE_WRITE) == -1) {
+        perror("disk_sync: sync_file_range");
         return DISK_ERROR_IO;
     }
-    
     return DISK_SUCCESS;
 }
 
+int disk_fd_advise(disk_t disk, size_t begin, size_t end, disk_advice_t advice) {
+    // the page cache is bypassed: nothing to prefetch or drop
+    if (disk->direct) {
+        return DISK_SUCCESS;
+    }
+
+    int flag;
+    switch (advice) {
+        case DISK_ADVICE_SEQUENTIAL: flag = POSIX_FADV_SEQUENTIAL; break;
+        case DISK_ADVICE_RANDOM: flag = POSIX_FADV_RANDOM; break;
+        case DISK_ADVICE_WILLNEED: flag = POSIX_FADV_WILLNEED; break;
+        case DISK_ADVICE_DONTNEED: flag = POSIX_FADV_DONTNEED; break;
+        case DISK_ADVICE_NORMAL:
+        default: flag = POSIX_FADV_NORMAL; break;
+    }
+
+    // returns the error number instead of setting errno
+    int err = posix_fadvise(disk->fd, (off_t)begin, (off_t)(end - begin), flag);
+    if (err != 0) {
+        fprintf(stderr, "disk_advise: posix_fadvise: %s\n", strerror(err));
+        return DISK_ERROR_IO;
+    }
+    return DISK_SUCCESS;
+}
+
+int disk_advise_blocks(disk_t disk, int first_block, int count, disk_advice_t advice) {
+    if (!disk_is_attached(disk)) {
+        return DISK_ERROR_NOT_ATTACHED;
+    }
+
+    if (!is_valid_range(disk, first_block, count)) {
+        return DISK_ERROR_INVALID_BLOCK;
+    }
+
+    if (advice < DISK_ADVICE_NORMAL || advice > DISK_ADVICE_DONTNEED) {
+        return DISK_ERROR;
+    }
+
+    size_t begin = (size_t)block_to_offset(disk, first_block);
+    return disk->ops->advise(disk, begin, begin + (size_t)count * disk->block_size, advice);
+}
+
+size_t disk_get_dirty_bytes(disk_t disk) {
+    if (!disk_is_attached(disk)) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&disk->lock);
+    size_t bytes;
+    if (!disk->dirty) {
+        bytes = 0;
+    } else if (!disk->dirty_chunks) {
+        bytes = disk->size;             // untracked: anything may be dirty
+    } else {
+        bytes = disk->dirty_count * disk->chunk_size;
+        if (bytes > disk->size)
+            bytes = disk->size;
+    }
+    pthread_mutex_unlock(&disk->lock);
+    return bytes;
+}
+
 void disk_print_info(disk_t disk) {
     if (!disk_is_attached(disk)) {
         printf("Disk not attached\n");
@@ -271,6 +987,8 @@ void disk_print_info(disk_t disk) {
     printf("  Size: %zu bytes\n", disk->size);
     printf("  Blocks: %d\n", disk->block_count);
     printf("  Block size: %d bytes\n", disk->block_size);
+    printf("  Backend: %s%s\n", disk->ops->name, disk->direct ? " (O_DIRECT)" : "");
+    printf("  Dirty: %zu bytes\n", disk_get_dirty_bytes(disk));
     printf("  Attached: %s\n", disk->attached ? "yes" : "no");
 }
 
@@ -284,6 +1002,7 @@ const char* disk_error_string(int error_code) {
         case DISK_ERROR_INVALID_BLOCK: return "Invalid block number";
         case DISK_ERROR_IO: return "I/O error";
         case DISK_ERROR_NO_SPACE: return "No space available";
+        case DISK_ERROR_UNSUPPORTED: return "Not supported";
         default: return "Unknown error";
     }
-}
\ No newline at end of file
+}
@@ -15,19 +15,96 @@
 #define DISK_ERROR_INVALID_BLOCK -5
 #define DISK_ERROR_IO -6
 #define DISK_ERROR_NO_SPACE -7
+#define DISK_ERROR_UNSUPPORTED -8
 
 typedef struct disk_emulator* disk_t;   // opaque pointer 
 
+// === BACKENDS ===
+
+/**
+ * How the image file is accessed. Every backend serves the same API; they
+ * differ in what the kernel does underneath.
+ */
+typedef enum disk_backend {
+    DISK_BACKEND_MMAP = 0,            // one shared mapping of the image (default)
+    DISK_BACKEND_PREAD,               // pread / pwrite, no address space needed
+    DISK_BACKEND_URING                // io_uring, batched requests submitted at once
+} disk_backend_t;
+
+/**
+ * Options accepted by disk_attach_with_options().
+ */
+typedef struct disk_attach_options {
+    disk_backend_t backend;
+    bool direct;                      // O_DIRECT, bypassing the page cache (not with mmap;
+                                      // the image size must be a multiple of 4 KiB)
+} disk_attach_options_t;
+
+/**
+ * Access-pattern hints for a block range (disk_advise_blocks). With mmap
+ * they become madvise() on the mapping, without it posix_fadvise() on the
+ * file (WILLNEED then reads the range into the page cache asynchronously).
+ */
+typedef enum disk_advice {
+    DISK_ADVICE_NORMAL = 0,
+    DISK_ADVICE_SEQUENTIAL,           // read ahead aggressively, drop behind
+    DISK_ADVICE_RANDOM,               // no kernel readahead
+    DISK_ADVICE_WILLNEED,             // start reading the range now
+    DISK_ADVICE_DONTNEED              // the cached pages can go
+} disk_advice_t;
+
+/**
+ * One request of a batched call: count blocks starting at block_num,
+ * to / from buffer (count * block size bytes).
+ */
+struct disk_request {
+    int block_num;
+    int count;
+    void* buffer;
+};
+
 // === PUBLIC FUNCTIONS ===
 
-// attachment
+// attachment: disk_attach() is equivalent to passing NULL options (mmap);
+// DISK_ERROR_UNSUPPORTED means the backend is not available here
 int disk_attach(const char* filename, size_t size, bool create_new, disk_t* disk);
+int disk_attach_with_options(const char* filename, size_t size, bool create_new,
+                             const disk_attach_options_t* opts, disk_t* disk);
 int disk_detach(disk_t disk);
 
+// extends the image file to new_size bytes (zero-filled) while attached; with
+// mmap the mapping is remapped and may move, so no borrow may be outstanding
+int disk_grow(disk_t disk, size_t new_size);
+
+// block geometry: a disk starts out with BLOCK_SIZE-byte blocks; a filesystem
+// switches it to its own block size (a power of two in
+// [BLOCK_SIZE_MIN, BLOCK_SIZE_MAX]) while nothing is borrowed
+int disk_set_block_size(disk_t disk, size_t block_size);
+
 // I/O operations - block level
 int disk_read_block(disk_t disk, int block_num, void* buffer);
 int disk_write_block(disk_t disk, int block_num, const void* buffer);
 
+// batched block I/O: the n requests are issued together (one submission on
+// io_uring) and the call returns once all of them completed
+int disk_read_blocks(disk_t disk, const struct disk_request* reqs, int n);
+int disk_write_blocks(disk_t disk, const struct disk_request* reqs, int n);
+
+// zero-copy access: returns a bounds-checked pointer into the mapped image
+// covering `count` consecutive blocks starting at first_block. The pointer
+// is valid until the matching disk_release_blocks(); callers that modified
+// the blocks through a mutable borrow must release them with dirty = true.
+// Without a mapping (pread, io_uring) the pointer is a private copy, written
+// back by a dirty release; borrows of the same range share one copy, so
+// overlapping borrows of different ranges must not both be written.
+int disk_borrow_blocks(disk_t disk, int first_block, int count, const void** out_ptr);
+int disk_borrow_blocks_mut(disk_t disk, int first_block, int count, void** out_ptr);
+void disk_release_blocks(disk_t disk, int first_block, int count, bool dirty);
+
+// access-pattern hint for count blocks starting at first_block; a hint
+// never changes data, and is ignored where it has no meaning (O_DIRECT)
+int disk_advise_blocks(disk_t disk, int first_block, int count, disk_advice_t advice);
+
 // I/O Operations - raw level (for specific operations needing offset)
 int disk_read(disk_t disk, off_t offset, void* buffer, size_t size);
 int disk_write(disk_t disk, off_t offset, const void* buffer, size_t size);
@@ -37,11 +114,30 @@ size_t disk_get_size(disk_t disk);
 size_t disk_get_blocks(disk_t disk);
 size_t disk_get_block_size(disk_t disk);
 bool disk_is_attached(disk_t disk);
+disk_backend_t disk_get_backend(disk_t disk);
+// true when borrows point into the image itself rather than at a copy, so
+// that a borrow may be kept for as long as the disk stays attached
+bool disk_is_mapped(disk_t disk);
+const char* disk_backend_name(disk_backend_t backend);
 const char* disk_get_filename(disk_t disk);
 
-// synchronization
+// synchronization: writes (disk_write_block, disk_write and dirty releases)
+// mark the chunks of the image they touch, and a sync flushes only those
 int disk_sync(disk_t disk);
 
+// forces only len bytes at offset (or count blocks starting at first_block)
+// to stable storage; the rest of the image stays as dirty as it was
+int disk_sync_range(disk_t disk, off_t offset, size_t len);
+int disk_sync_blocks(disk_t disk, int first_block, int count);
+
+// MS_ASYNC variants: start write-back without waiting for it; nothing is
+// durable (or counted clean) until a synchronous sync covers it
+int disk_sync_async(disk_t disk);
+int disk_sync_range_async(disk_t disk, off_t offset, size_t len);
+
+// upper bound of the bytes written since they were last synced
+size_t disk_get_dirty_bytes(disk_t disk);
+
 // utilities
 void disk_print_info(disk_t disk);
 const char* disk_error_string(int error_code);
\ No newline at end of file
@@ -0,0 +1,87 @@
+#pragma once
+
+/*
+ * Private interface between the generic disk layer (disk.c) and its
+ * backends (disk_mmap.c, disk_pread.c, disk_uring.c). Not part of the
+ * public API.
+ */
+
+#include "disk.h"
+#include <pthread.h>
+
+// O_DIRECT needs sector-aligned offsets / lengths and aligned buffers
+#define DISK_DIRECT_SECTOR BLOCK_SIZE_MIN
+#define DISK_DIRECT_ALIGN  4096
+
+// one contiguous transfer, already bounds-checked (and aligned under O_DIRECT)
+struct disk_span {
+    size_t offset;
+    size_t len;
+    void* buffer;
+};
+
+struct disk_backend_ops {
+    const char* name;
+
+    // called once the file is open and sized / torn down before close
+    int (*open)(disk_t disk);
+    void (*close)(disk_t disk);
+
+    // performs n transfers; returns once all of them completed
+    int (*io)(disk_t disk, const struct disk_span* spans, int n, bool write);
+
+    // forces [begin, end) to stable storage (wait) or only starts write-back
+    int (*sync)(disk_t disk, size_t begin, size_t end, bool wait);
+
+    // access-pattern hint over [begin, end)
+    int (*advise)(disk_t disk, size_t begin, size_t end, disk_advice_t advice);
+
+    // pointer into a mapping of the image, or NULL for a backend without
+    // one (borrows are then served from buffers written back on release)
+    void* (*map)(disk_t disk, size_t offset);
+
+    // follows the image growing from old_size to disk->size (NULL: nothing
+    // in the backend depends on the size)
+    int (*resize)(disk_t disk, size_t old_size);
+};
+
+extern const struct disk_backend_ops disk_mmap_ops;
+extern const struct disk_backend_ops disk_pread_ops;
+extern const struct disk_backend_ops disk_uring_ops;
+
+// a buffered borrow (backends without map)
+struct disk_borrow {
+    int first_block;
+    int count;
+    void* buffer;
+    int refs;                        // borrows of this exact range sharing the buffer
+    bool dirty;
+    struct disk_borrow* next;
+};
+
+// disk emulator struct definition (private to the disk layer)
+struct disk_emulator {
+    int fd;                          // file descriptor of file on disk
+    const struct disk_backend_ops* ops;
+    disk_backend_t backend;
+    void* backend_data;              // owned by the backend
+    bool direct;                     // opened with O_DIRECT
+    size_t size;                     // total size in bytes
+    int block_count;                 // number of blocks
+    int block_size;                  // size of a block (BLOCK_SIZE until a filesystem sets it)
+    bool attached;                   // true if disk is attached
+    bool dirty;                      // image written since last sync
+    uint64_t* dirty_chunks;          // one bit per sync chunk written since it was last synced
+                                     // (NULL = untracked, a sync covers the whole image)
+    size_t chunk_size;               // bytes per sync chunk (a multiple of the page size)
+    size_t chunk_count;
+    size_t dirty_count;              // chunks marked in dirty_chunks
+    int borrowed;                    // outstanding zero-copy borrows
+    struct disk_borrow* borrows;     // buffered borrows outstanding
+    pthread_mutex_t lock;            // borrow bookkeeping and dirty tracking
+    char filename[MAX_FILENAME];     // filename on disk
+};
+
+// descriptor-based sync / hints shared by the backends without a mapping
+int disk_fd_sync(disk_t disk, size_t begin, size_t end, bool wait);
+int disk_fd_advise(disk_t disk, size_t begin, size_t end, disk_advice_t advice);
@@ -0,0 +1,110 @@
+#include "disk_internal.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/*
+ * mmap backend: the whole image is one shared mapping. Borrows point
+ * straight into it and transfers are memcpy; the kernel pages the image
+ * in and out underneath.
+ */
+
+static int mmap_open(disk_t disk) {
+    void* mem = mmap(NULL, disk->size, PROT_READ | PROT_WRITE, MAP_SHARED, disk->fd, 0);
+    if (mem == MAP_FAILED) {
+        perror("disk_attach: mmap");
+        return DISK_ERROR_IO;
+    }
+
+    disk->backend_data = mem;
+    return DISK_SUCCESS;
+}
+
+static void mmap_close(disk_t disk) {
+    if (disk->backend_data && munmap(disk->backend_data, disk->size) == -1) {
+        perror("disk_detach: munmap");
+    }
+    disk->backend_data = NULL;
+}
+
+static int mmap_io(disk_t disk, const struct disk_span* spans, int n, bool write) {
+    char* mem = (char*)disk->backend_data;
+    for (int i = 0; i < n; i++) {
+        if (write)
+            memcpy(mem + spans[i].offset, spans[i].buffer, spans[i].len);
+        else
+            memcpy(spans[i].buffer, mem + spans[i].offset, spans[i].len);
+    }
+    return DISK_SUCCESS;
+}
+
+static int mmap_sync(disk_t disk, size_t begin, size_t end, bool wait) {
+    // msync wants a page-aligned start
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    begin -= begin % page;
+
+    if (msync((char*)disk->backend_data + begin, end - begin, wait ? MS_SYNC : MS_ASYNC) == -1) {
+        perror("disk_sync: msync");
+        return DISK_ERROR_IO;
+    }
+    return DISK_SUCCESS;
+}
+
+static int mmap_advise(disk_t disk, size_t begin, size_t end, disk_advice_t advice) {
+    int flag;
+    switch (advice) {
+        case DISK_ADVICE_SEQUENTIAL: flag = MADV_SEQUENTIAL; break;
+        case DISK_ADVICE_RANDOM: flag = MADV_RANDOM; break;
+        case DISK_ADVICE_WILLNEED: flag = MADV_WILLNEED; break;
+        // MADV_DONTNEED would discard changes of a private mapping only, but
+        // on a shared one a later access faults the (written back) page in
+        case DISK_ADVICE_DONTNEED: flag = MADV_DONTNEED; break;
+        case DISK_ADVICE_NORMAL:
+        default: flag = MADV_NORMAL; break;
+    }
+
+    // madvise wants a page-aligned start too
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    begin -= begin % page;
+
+    if (madvise((char*)disk->backend_data + begin, end - begin, flag) == -1) {
+        perror("disk_advise: madvise");
+        return DISK_ERROR_IO;
+    }
+    return DISK_SUCCESS;
+}
+
+// maps the grown file afresh instead of mremap(): access advice on parts of
+// the image splits the mapping into several areas, and mremap() cannot grow
+// a range spanning more than one. Both map the same shared pages, so
+// nothing is copied. The mapping moves: callers make sure no borrow is
+// outstanding
+static int mmap_resize(disk_t disk, size_t old_size) {
+    void* mem = mmap(NULL, disk->size, PROT_READ | PROT_WRITE, MAP_SHARED, disk->fd, 0);
+    if (mem == MAP_FAILED) {
+        perror("disk_grow: mmap");
+        return DISK_ERROR_IO;
+    }
+
+    if (munmap(disk->backend_data, old_size) == -1) {
+        perror("disk_grow: munmap");
+    }
+    disk->backend_data = mem;
+    return DISK_SUCCESS;
+}
+
+static void* mmap_map(disk_t disk, size_t offset) {
+    return (char*)disk->backend_data + offset;
+}
+
+const struct disk_backend_ops disk_mmap_ops = {
+    .name = "mmap",
+    .open = mmap_open,
+    .close = mmap_close,
+    .io = mmap_io,
+    .sync = mmap_sync,
+    .advise = mmap_advise,
+    .map = mmap_map,
+    .resize = mmap_resize,
+};
@@ -0,0 +1,58 @@
+#include "disk_internal.h"
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+
+/*
+ * pread / pwrite backend: no mapping, so the image does not have to fit in
+ * the address space and can be opened with O_DIRECT. Borrows are buffered
+ * (see disk_internal.h).
+ */
+
+static int pread_open(disk_t disk) {
+    (void)disk;
+    return DISK_SUCCESS;
+}
+
+static void pread_close(disk_t disk) {
+    (void)disk;
+}
+
+// one whole transfer, retried over short counts and interruptions
+static int transfer_all(disk_t disk, const struct disk_span* span, bool write) {
+    size_t done = 0;
+    while (done < span->len) {
+        char* p = (char*)span->buffer + done;
+        off_t off = (off_t)(span->offset + done);
+        ssize_t r = write ? pwrite(disk->fd, p, span->len - done, off)
+                          : pread(disk->fd, p, span->len - done, off);
+        if (r < 0 && errno == EINTR)
+            continue;
+        if (r <= 0) {
+            perror(write ? "disk: pwrite" : "disk: pread");
+            return DISK_ERROR_IO;
+        }
+        done += (size_t)r;
+    }
+    return DISK_SUCCESS;
+}
+
+static int pread_io(disk_t disk, const struct disk_span* spans, int n, bool write) {
+    for (int i = 0; i < n; i++) {
+        int res = transfer_all(disk, &spans[i], write);
+        if (res != DISK_SUCCESS)
+            return res;
+    }
+    return DISK_SUCCESS;
+}
+
+const struct disk_backend_ops disk_pread_ops = {
+    .name = "pread",
+    .open = pread_open,
+    .close = pread_close,
+    .io = pread_io,
+    .sync = disk_fd_sync,
+    .advise = disk_fd_advise,
+    .map = NULL,
+    .resize = NULL,
+};
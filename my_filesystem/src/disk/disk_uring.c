@@ -0,0 +1,234 @@
+#include "disk_internal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/*
+ * io_uring backend: a batch of transfers is queued as one submission and
+ * reaped together, so a multi-block call keeps up to URING_DEPTH requests
+ * in flight. The ring is driven with the raw system calls (no liburing).
+ * Borrows are buffered (see disk_internal.h). The ring is single-producer,
+ * so concurrent callers take turns on ring_lock.
+ */
+
+#define URING_DEPTH 64
+
+struct uring {
+    int fd;
+    pthread_mutex_t ring_lock;
+
+    // submission queue
+    void* sq_ring;
+    size_t sq_ring_size;
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+
+    // completion queue
+    void* cq_ring;
+    size_t cq_ring_size;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+};
+
+static int sys_uring_setup(unsigned entries, struct io_uring_params* p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static void uring_free(struct uring* r) {
+    if (r->sqes && r->sqes != MAP_FAILED)
+        munmap(r->sqes, r->sqes_size);
+    if (r->cq_ring && r->cq_ring != MAP_FAILED && r->cq_ring != r->sq_ring)
+        munmap(r->cq_ring, r->cq_ring_size);
+    if (r->sq_ring && r->sq_ring != MAP_FAILED)
+        munmap(r->sq_ring, r->sq_ring_size);
+    if (r->fd >= 0)
+        close(r->fd);
+    pthread_mutex_destroy(&r->ring_lock);
+    free(r);
+}
+
+static int uring_open(disk_t disk) {
+    struct uring* r = calloc(1, sizeof(struct uring));
+    if (!r) {
+        return DISK_ERROR;
+    }
+    pthread_mutex_init(&r->ring_lock, NULL);
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    r->fd = sys_uring_setup(URING_DEPTH, &p);
+    if (r->fd < 0) {
+        // old kernel, or io_uring disabled / filtered here
+        int err = errno;
+        uring_free(r);
+        return (err == ENOSYS || err == EPERM || err == EACCES) ? DISK_ERROR_UNSUPPORTED
+                                                                 : DISK_ERROR_IO;
+    }
+
+    r->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_ring_size > r->sq_ring_size)
+            r->sq_ring_size = r->cq_ring_size;
+        r->cq_ring_size = r->sq_ring_size;
+    }
+
+    r->sq_ring = mmap(NULL, r->sq_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ring == MAP_FAILED) {
+        uring_free(r);
+        return DISK_ERROR_IO;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_ring = r->sq_ring;
+    } else {
+        r->cq_ring = mmap(NULL, r->cq_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_ring == MAP_FAILED) {
+            uring_free(r);
+            return DISK_ERROR_IO;
+        }
+    }
+
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        uring_free(r);
+        return DISK_ERROR_IO;
+    }
+
+    char* sq = (char*)r->sq_ring;
+    r->sq_head = (unsigned*)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned*)(sq + p.sq_off.array);
+
+    char* cq = (char*)r->cq_ring;
+    r->cq_head = (unsigned*)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+
+    disk->backend_data = r;
+    return DISK_SUCCESS;
+}
+
+static void uring_close(disk_t disk) {
+    if (disk->backend_data)
+        uring_free((struct uring*)disk->backend_data);
+    disk->backend_data = NULL;
+}
+
+// queues one transfer; user_data is its index in the batch
+static void queue_span(struct uring* r, int fd, const struct disk_span* span, bool write,
+                       uint64_t user_data) {
+    unsigned tail = *r->sq_tail;
+    unsigned idx = tail & *r->sq_mask;
+
+    struct io_uring_sqe* sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)span->buffer;
+    sqe->len = (uint32_t)span->len;
+    sqe->off = span->offset;
+    sqe->user_data = user_data;
+
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+// uring_io with ring_lock held
+static int ring_io(disk_t disk, const struct disk_span* spans, int n, bool write) {
+    struct uring* r = (struct uring*)disk->backend_data;
+    int res = DISK_SUCCESS;
+
+    // a transfer the ring cannot describe in one request takes the slow path
+    for (int i = 0; i < n; i++) {
+        if (spans[i].len > UINT32_MAX)
+            return disk_pread_ops.io(disk, spans, n, write);
+    }
+
+    for (int first = 0; first < n; first += URING_DEPTH) {
+        int batch = (n - first < URING_DEPTH) ? n - first : URING_DEPTH;
+        for (int i = 0; i < batch; i++)
+            queue_span(r, disk->fd, &spans[first + i], write, (uint64_t)(first + i));
+
+        // submit the whole batch and wait for all of it in one call
+        int submitted = 0, completed = 0;
+        while (completed < batch) {
+            int ret = sys_uring_enter(r->fd, (unsigned)(batch - submitted),
+                                      (unsigned)(batch - completed), IORING_ENTER_GETEVENTS);
+            if (ret < 0) {
+                if (errno == EINTR)
+                    continue;
+                perror("disk: io_uring_enter");
+                return DISK_ERROR_IO;
+            }
+            submitted += ret;
+            if (submitted > batch)
+                submitted = batch;
+
+            unsigned head = *r->cq_head;
+            while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+                struct io_uring_cqe* cqe = &r->cqes[head & *r->cq_mask];
+                const struct disk_span* span = &spans[cqe->user_data];
+                if (cqe->res < 0) {
+                    fprintf(stderr, "disk: io_uring %s: %s\n", write ? "write" : "read",
+                            strerror(-cqe->res));
+                    res = DISK_ERROR_IO;
+                } else if ((size_t)cqe->res < span->len) {
+                    // short transfer: finish the rest synchronously
+                    struct disk_span rest = {
+                        span->offset + (size_t)cqe->res, span->len - (size_t)cqe->res,
+                        (char*)span->buffer + cqe->res
+                    };
+                    if (disk_pread_ops.io(disk, &rest, 1, write) != DISK_SUCCESS)
+                        res = DISK_ERROR_IO;
+                }
+                head++;
+                completed++;
+            }
+            __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+        }
+    }
+
+    return res;
+}
+
+static int uring_io(disk_t disk, const struct disk_span* spans, int n, bool write) {
+    struct uring* r = (struct uring*)disk->backend_data;
+
+    pthread_mutex_lock(&r->ring_lock);
+    int res = ring_io(disk, spans, n, write);
+    pthread_mutex_unlock(&r->ring_lock);
+    return res;
+}
+
+const struct disk_backend_ops disk_uring_ops = {
+    .name = "io_uring",
+    .open = uring_open,
+    .close = uring_close,
+    .io = uring_io,
+    .sync = disk_fd_sync,
+    .advise = disk_fd_advise,
+    .map = NULL,
+    .resize = NULL,
+};
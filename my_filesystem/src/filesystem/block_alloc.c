@@ -0,0 +1,768 @@
+#include "block_alloc.h"
+#include "fs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+_Static_assert(BLOCK_GROUP_ALIGN == BITMAP_CHUNK_BYTES * 8,
+               "a group's bits must start a bitmap chunk and summary word");
+
+// === PRIVATE FUNCTIONS ===
+
+// first block of the data area (bitmap bits below it are metadata)
+static uint32_t data_start(const struct filesystem* fs) {
+    return fs->sb.first_data_block > 0 ? fs->sb.first_data_block : 1;
+}
+
+// length of the free run starting at start, capped at max and at end
+static uint32_t free_run_length(const struct bitmap* bmp, uint32_t start, uint32_t end,
+                                uint32_t max) {
+    int used = bitmap_find_next_used_in(bmp, start, end);
+    size_t len = ((used < 0) ? end : (size_t)used) - start;
+    return (uint32_t)(len < max ? len : max);
+}
+
+// allocates from blocks [lo, hi) with the lock guarding them held; a goal
+// of 0 starts at *rotor, and with from_rotor the rotor moves past the run
+static int alloc_run(struct filesystem* fs, uint32_t lo, uint32_t hi, uint32_t* rotor,
+                     bool from_rotor, uint32_t goal, uint32_t want,
+                     uint32_t* out_start, uint32_t* out_count) {
+    struct bitmap* bmp = fs->block_bitmap;
+
+    if (goal == 0)
+        goal = *rotor;
+    if (goal < lo || goal >= hi)
+        goal = lo;
+
+    int start;
+    uint32_t count;
+
+    if (!bitmap_get(bmp, goal)) {
+        // extend right where the caller wants to be
+        start = (int)goal;
+        count = free_run_length(bmp, goal, hi, want);
+    } else {
+        // a full run after the goal, then from the start of the range
+        start = bitmap_find_free_run_in(bmp, goal, hi, want);
+        if (start < 0)
+            start = bitmap_find_free_run_in(bmp, lo, hi, want);
+
+        if (start >= 0) {
+            count = want;
+        } else {
+            // fragmented: nearest free run, however short
+            start = bitmap_find_next_free_in(bmp, goal, hi);
+            if (start < 0)
+                start = bitmap_find_next_free_in(bmp, lo, hi);
+            if (start < 0)
+                return ERROR_NO_SPACE;
+            count = free_run_length(bmp, (uint32_t)start, hi, want);
+        }
+    }
+
+    if (bitmap_set_range(bmp, (size_t)start, count) != SUCCESS)
+        return ERROR_GENERIC;
+
+    // a stale image of the blocks must not be replayed over their new contents
+    journal_note_alloc(fs->journal, (uint32_t)start, count);
+
+    if (from_rotor)
+        *rotor = (uint32_t)start + count;
+
+    *out_start = (uint32_t)start;
+    *out_count = count;
+    return SUCCESS;
+}
+
+static inline uint32_t group_of_block(const struct filesystem* fs, uint32_t block) {
+    uint32_t g = block / fs->sb.blocks_per_group;
+    return g < fs->sb.group_count ? g : 0;
+}
+
+static inline uint32_t group_of_inode(const struct filesystem* fs, uint32_t inode_num) {
+    uint32_t g = inode_num / fs->sb.inodes_per_group;
+    return g < fs->sb.group_count ? g : 0;
+}
+
+static inline uint32_t group_free_blocks(const struct block_group* grp) {
+    return __atomic_load_n(&grp->desc.free_blocks, __ATOMIC_RELAXED);
+}
+
+static inline void groups_touch(struct filesystem* fs) {
+    __atomic_store_n(&fs->groups_dirty, true, __ATOMIC_RELAXED);
+}
+
+// block_alloc over the groups, starting with the goal's
+static int alloc_grouped(struct filesystem* fs, uint32_t goal, uint32_t want,
+                         uint32_t* out_start, uint32_t* out_count) {
+    uint32_t n = fs->sb.group_count;
+    uint32_t first = group_of_block(fs, goal);
+
+    for (uint32_t i = 0; i < n; i++) {
+        struct block_group* grp = &fs->groups[(first + i) % n];
+        if (group_free_blocks(grp) == 0)
+            continue;
+
+        // other groups are entered at their own rotor; a goal equal to the
+        // rotor is a new file (block_group_goal)
+        pthread_mutex_lock(&grp->lock);
+        uint32_t g_goal = (i == 0) ? goal : 0;
+        int res = alloc_run(fs, grp->desc.first_data_block, grp->end_block, &grp->rotor,
+                            g_goal == 0 || g_goal == grp->rotor, g_goal, want,
+                            out_start, out_count);
+        if (res == SUCCESS) {
+            __atomic_sub_fetch(&grp->desc.free_blocks, *out_count, __ATOMIC_RELAXED);
+            groups_touch(fs);
+        }
+        pthread_mutex_unlock(&grp->lock);
+
+        if (res != ERROR_NO_SPACE)
+            return res;
+    }
+
+    return ERROR_NO_SPACE;
+}
+
+// === PUBLIC FUNCTIONS ===
+
+int block_alloc(struct filesystem* fs, uint32_t goal, uint32_t want,
+                uint32_t* out_start, uint32_t* out_count) {
+    if (!fs || !fs->block_bitmap || !out_start || !out_count || want == 0)
+        return ERROR_INVALID;
+
+    if (fs->groups)
+        return alloc_grouped(fs, goal, want, out_start, out_count);
+
+    pthread_mutex_lock(&fs->alloc_lock);
+    int res = alloc_run(fs, data_start(fs), (uint32_t)fs->block_bitmap->size_bits,
+                        &fs->alloc_rotor, goal == 0, goal, want, out_start, out_count);
+    pthread_mutex_unlock(&fs->alloc_lock);
+    return res;
+}
+
+// clears the bits of a run, whatever the reference counts say
+static void release_run(struct filesystem* fs, uint32_t start, uint32_t count) {
+    if (!fs->groups) {
+        pthread_mutex_lock(&fs->alloc_lock);
+        bitmap_clear_range(fs->block_bitmap, start, count);
+        pthread_mutex_unlock(&fs->alloc_lock);
+        return;
+    }
+
+    // a run never crosses a group's metadata, but split it all the same
+    uint32_t end = start + count;
+    while (start < end && start < fs->sb.total_blocks) {
+        struct block_group* grp = &fs->groups[group_of_block(fs, start)];
+        uint32_t piece_end = MIN(end, grp->end_block);
+
+        pthread_mutex_lock(&grp->lock);
+        uint32_t used = (uint32_t)bitmap_count_used_in(fs->block_bitmap, start, piece_end);
+        bitmap_clear_range(fs->block_bitmap, start, piece_end - start);
+        __atomic_add_fetch(&grp->desc.free_blocks, used, __ATOMIC_RELAXED);
+        groups_touch(fs);
+        pthread_mutex_unlock(&grp->lock);
+
+        start = piece_end;
+    }
+}
+
+static int refs_scan(struct filesystem* fs, uint32_t start, uint32_t count, bool drop,
+                     bool* out_shared, uint32_t* out_run);
+
+uint32_t block_free_run(struct filesystem* fs, uint32_t start, uint32_t count) {
+    if (!fs || !fs->block_bitmap || count == 0)
+        return 0;
+
+    if (!(fs->sb.features & FS_FEATURE_REFLINK)) {
+        release_run(fs, start, count);
+        return count;
+    }
+
+    // shared blocks only lose a reference; the others go back in runs
+    uint32_t released = 0;
+    uint32_t end = start + count;
+    while (start < end) {
+        bool shared;
+        uint32_t run;
+        if (refs_scan(fs, start, end - start, true, &shared, &run) != SUCCESS || run == 0)
+            break;                    // unreadable table: leak rather than free a shared block
+        if (!shared) {
+            release_run(fs, start, run);
+            released += run;
+        }
+        start += run;
+    }
+    return released;
+}
+
+uint32_t block_group_goal(struct filesystem* fs, uint32_t inode_num) {
+    if (!fs || !fs->groups || inode_num == INVALID_INODE_NUM)
+        return 0;
+
+    struct block_group* grp = &fs->groups[group_of_inode(fs, inode_num)];
+    pthread_mutex_lock(&grp->lock);
+    uint32_t goal = grp->rotor;
+    pthread_mutex_unlock(&grp->lock);
+    return goal;
+}
+
+// === LAZY INODE TABLE ===
+
+#define ITABLE_ZERO_BATCH 64          // blocks zeroed per borrow
+
+// index of inode_num's block within its inode table
+static uint32_t itable_index(const struct filesystem* fs, uint32_t inode_num) {
+    if (fs->sb.features & FS_FEATURE_GROUPS)
+        inode_num %= fs->sb.inodes_per_group;
+    return inode_num / (fs->sb.block_size / fs->sb.inode_size);
+}
+
+// table holding inode_num (its group, or the only one)
+static uint32_t itable_of(const struct filesystem* fs, uint32_t inode_num) {
+    return fs->groups ? group_of_inode(fs, inode_num) : 0;
+}
+
+// first block of table t
+static uint32_t itable_start(const struct filesystem* fs, uint32_t t) {
+    return fs->groups ? fs->groups[t].desc.inode_table : fs->sb.inode_table_start;
+}
+
+// leading blocks of table t known to be initialised; readers check the
+// mark without the lock, so it is published after the zeroes
+static uint32_t itable_mark(const struct filesystem* fs, uint32_t t) {
+    return fs->groups ? __atomic_load_n(&fs->groups[t].desc.itable_zeroed, __ATOMIC_ACQUIRE)
+                      : __atomic_load_n(&fs->sb.itable_zeroed, __ATOMIC_ACQUIRE);
+}
+
+// zeroes the blocks of table t from its mark up to end (fs->alloc_lock held)
+static int itable_extend(struct filesystem* fs, uint32_t t, uint32_t end) {
+    uint32_t from = itable_mark(fs, t);
+    if (end <= from)
+        return SUCCESS;
+
+    uint32_t first = itable_start(fs, t) + from;
+    int res = itable_zero_blocks(fs->disk, first, end - from);
+    if (res != SUCCESS)
+        return res;
+    journal_add(fs->journal, first, end - from);
+
+    if (fs->groups) {
+        __atomic_store_n(&fs->groups[t].desc.itable_zeroed, end, __ATOMIC_RELEASE);
+        groups_touch(fs);
+    } else {
+        __atomic_store_n(&fs->sb.itable_zeroed, end, __ATOMIC_RELEASE);
+    }
+    return SUCCESS;
+}
+
+bool itable_is_initialised(const struct filesystem* fs, uint32_t inode_num) {
+    if (!fs || !(fs->sb.features & FS_FEATURE_LAZY_ITABLE))
+        return true;
+    if ((fs->sb.features & FS_FEATURE_GROUPS) && !fs->groups)
+        return true;
+    return itable_index(fs, inode_num) < itable_mark(fs, itable_of(fs, inode_num));
+}
+
+int itable_zero_blocks(disk_t disk, uint32_t block, uint32_t count) {
+    if (!disk)
+        return ERROR_INVALID;
+
+    size_t block_size = disk_get_block_size(disk);
+    while (count > 0) {
+        uint32_t n = count < ITABLE_ZERO_BATCH ? count : ITABLE_ZERO_BATCH;
+        void* ptr;
+        if (disk_borrow_blocks_mut(disk, (int)block, (int)n, &ptr) != DISK_SUCCESS)
+            return ERROR_IO;
+        memset(ptr, 0, (size_t)n * block_size);
+        disk_release_blocks(disk, (int)block, (int)n, true);
+        block += n;
+        count -= n;
+    }
+    return SUCCESS;
+}
+
+int itable_init_some(struct filesystem* fs, uint32_t max_blocks, uint32_t* out_remaining) {
+    if (!fs)
+        return ERROR_INVALID;
+
+    int res = SUCCESS;
+    uint32_t remaining = 0;
+    pthread_mutex_lock(&fs->alloc_lock);
+    if (fs->sb.features & FS_FEATURE_LAZY_ITABLE) {
+        uint32_t tables = fs->groups ? fs->sb.group_count : 1;
+        for (uint32_t t = 0; t < tables; t++) {
+            uint32_t mark = itable_mark(fs, t);
+            uint32_t todo = fs->sb.inode_table_blocks - mark;
+            uint32_t n = todo < max_blocks ? todo : max_blocks;
+            if (res == SUCCESS && n > 0) {
+                res = itable_extend(fs, t, mark + n);
+                if (res == SUCCESS) {
+                    max_blocks -= n;
+                    todo -= n;
+                }
+            }
+            remaining += todo;
+        }
+    }
+    pthread_mutex_unlock(&fs->alloc_lock);
+
+    if (out_remaining)
+        *out_remaining = remaining;
+    return res;
+}
+
+// === INODE NUMBERS ===
+
+// group for a new directory (fs->alloc_lock held): most free blocks among
+// the groups with at least the average number of free inodes
+static uint32_t pick_dir_group(struct filesystem* fs) {
+    uint32_t n = fs->sb.group_count;
+    uint64_t total_free = 0;
+    for (uint32_t g = 0; g < n; g++)
+        total_free += fs->groups[g].desc.free_inodes;
+    uint32_t avg = (uint32_t)(total_free / n);
+
+    // equal candidates are taken in turn, starting after the last choice
+    uint32_t best = UINT32_MAX, best_blocks = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t g = (fs->dir_rotor + i) % n;
+        const struct block_group* grp = &fs->groups[g];
+        if (grp->desc.free_inodes == 0 || grp->desc.free_inodes < avg)
+            continue;
+        uint32_t blocks = group_free_blocks(grp);
+        if (best == UINT32_MAX || blocks > best_blocks) {
+            best = g;
+            best_blocks = blocks;
+        }
+    }
+
+    if (best != UINT32_MAX)
+        fs->dir_rotor = best + 1;
+    return best;
+}
+
+// inode_num_alloc with block groups (fs->alloc_lock held)
+static int alloc_inode_grouped(struct filesystem* fs, uint32_t parent, uint8_t type,
+                               uint32_t* out_inode_num) {
+    uint32_t n = fs->sb.group_count;
+    uint32_t ipg = fs->sb.inodes_per_group;
+
+    uint32_t first = 0;
+    if (parent != INVALID_INODE_NUM) {
+        first = group_of_inode(fs, parent);
+        if (type == INODE_TYPE_DIRECTORY) {
+            uint32_t g = pick_dir_group(fs);
+            if (g != UINT32_MAX)
+                first = g;
+        }
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t g = (first + i) % n;
+        struct block_group* grp = &fs->groups[g];
+        if (grp->desc.free_inodes == 0)
+            continue;
+
+        int idx = bitmap_find_next_free_in(fs->inode_bitmap, g * ipg, (g + 1) * ipg);
+        if (idx < 0)
+            continue;
+
+        bitmap_set(fs->inode_bitmap, (size_t)idx);
+        grp->desc.free_inodes--;
+        if (type == INODE_TYPE_DIRECTORY)
+            grp->desc.used_dirs++;
+        groups_touch(fs);
+        *out_inode_num = (uint32_t)idx;
+        return SUCCESS;
+    }
+
+    return ERROR_NO_SPACE;
+}
+
+int inode_num_alloc(struct filesystem* fs, uint32_t parent, uint8_t type, uint32_t* out_inode_num) {
+    if (!fs || !fs->inode_bitmap || !out_inode_num)
+        return ERROR_INVALID;
+
+    int res = SUCCESS;
+    pthread_mutex_lock(&fs->alloc_lock);
+    if (fs->groups) {
+        res = alloc_inode_grouped(fs, parent, type, out_inode_num);
+    } else {
+        int idx = bitmap_find_first_free(fs->inode_bitmap);
+        if (idx >= 0) {
+            bitmap_set(fs->inode_bitmap, (size_t)idx);
+            *out_inode_num = (uint32_t)idx;
+        } else {
+            res = ERROR_NO_SPACE;
+        }
+    }
+
+    // the new inode's table block must not hand out stale contents
+    bool lazy = res == SUCCESS && (fs->sb.features & FS_FEATURE_LAZY_ITABLE);
+    if (lazy)
+        res = itable_extend(fs, itable_of(fs, *out_inode_num), itable_index(fs, *out_inode_num) + 1);
+    pthread_mutex_unlock(&fs->alloc_lock);
+
+    if (lazy && res != SUCCESS)
+        inode_num_free(fs, *out_inode_num, type);
+    return res;
+}
+
+void inode_num_free(struct filesystem* fs, uint32_t inode_num, uint8_t type) {
+    if (!fs || !fs->inode_bitmap)
+        return;
+
+    pthread_mutex_lock(&fs->alloc_lock);
+    if (fs->groups && bitmap_get(fs->inode_bitmap, inode_num)) {
+        struct block_group* grp = &fs->groups[group_of_inode(fs, inode_num)];
+        grp->desc.free_inodes++;
+        if (type == INODE_TYPE_DIRECTORY && grp->desc.used_dirs > 0)
+            grp->desc.used_dirs--;
+        groups_touch(fs);
+    }
+    bitmap_clear(fs->inode_bitmap, inode_num);
+    pthread_mutex_unlock(&fs->alloc_lock);
+}
+
+// === SHARED BLOCKS ===
+
+static inline uint32_t refs_per_block(const struct filesystem* fs) {
+    return fs->sb.block_size / sizeof(uint16_t);
+}
+
+// borrows the table block holding the entry of `block`; *out_first is the
+// block whose entry opens it
+static int refs_borrow(struct filesystem* fs, uint32_t block, bool write,
+                       uint16_t** out_entries, uint32_t* out_first) {
+    uint32_t table_block = fs->sb.refcount_start + block / refs_per_block(fs);
+    void* ptr;
+    int res = write ? disk_borrow_blocks_mut(fs->disk, table_block, 1, &ptr)
+                    : disk_borrow_blocks(fs->disk, table_block, 1, (const void**)&ptr);
+    if (res != DISK_SUCCESS)
+        return ERROR_IO;
+    *out_entries = (uint16_t*)ptr;
+    *out_first = block - block % refs_per_block(fs);
+    return SUCCESS;
+}
+
+static void refs_release(struct filesystem* fs, uint32_t block, bool dirty) {
+    uint32_t table_block = fs->sb.refcount_start + block / refs_per_block(fs);
+    disk_release_blocks(fs->disk, table_block, 1, dirty);
+    if (dirty)
+        journal_add(fs->journal, table_block, 1);
+}
+
+/*
+ * Measures the leading run of [start, start + count) whose blocks are all
+ * shared or all not; with drop, the shared ones lose a reference. Blocks
+ * past the end of the table are never shared.
+ */
+static int refs_scan(struct filesystem* fs, uint32_t start, uint32_t count, bool drop,
+                     bool* out_shared, uint32_t* out_run) {
+    *out_shared = false;
+    *out_run = count;
+    if (start >= fs->sb.total_blocks)
+        return SUCCESS;
+    count = MIN(count, fs->sb.total_blocks - start);
+
+    pthread_mutex_lock(&fs->refcount_lock);
+    int res = SUCCESS;
+    uint32_t n = 0;
+    while (n < count) {
+        uint16_t* entries;
+        uint32_t first;
+        res = refs_borrow(fs, start + n, drop, &entries, &first);
+        if (res != SUCCESS)
+            break;
+
+        uint32_t i = start + n - first;
+        uint32_t limit = MIN(refs_per_block(fs) - i, count - n);
+        if (n == 0)
+            *out_shared = entries[i] != 0;
+
+        uint32_t k = 0;
+        while (k < limit && (entries[i + k] != 0) == *out_shared) {
+            if (drop && *out_shared)
+                entries[i + k]--;
+            k++;
+        }
+        refs_release(fs, start + n, drop && *out_shared && k > 0);
+
+        n += k;
+        if (k < limit)
+            break;
+    }
+    pthread_mutex_unlock(&fs->refcount_lock);
+
+    *out_run = n;
+    return res;
+}
+
+int block_is_shared(struct filesystem* fs, uint32_t start, uint32_t count,
+                    bool* out_shared, uint32_t* out_run) {
+    if (!fs || !out_shared || !out_run)
+        return ERROR_INVALID;
+    if (!(fs->sb.features & FS_FEATURE_REFLINK) || count == 0) {
+        *out_shared = false;
+        *out_run = count;
+        return SUCCESS;
+    }
+    return refs_scan(fs, start, count, false, out_shared, out_run);
+}
+
+int block_share_run(struct filesystem* fs, uint32_t start, uint32_t count) {
+    if (!fs || !(fs->sb.features & FS_FEATURE_REFLINK) || count == 0 ||
+        start >= fs->sb.total_blocks || count > fs->sb.total_blocks - start)
+        return ERROR_INVALID;
+
+    pthread_mutex_lock(&fs->refcount_lock);
+
+    // a full count anywhere changes nothing: check the run first
+    int res = SUCCESS;
+    for (int pass = 0; pass < 2 && res == SUCCESS; pass++) {
+        bool add = (pass == 1);
+        for (uint32_t n = 0; n < count && res == SUCCESS; ) {
+            uint16_t* entries;
+            uint32_t first;
+            res = refs_borrow(fs, start + n, add, &entries, &first);
+            if (res != SUCCESS)
+                break;
+
+            uint32_t i = start + n - first;
+            uint32_t limit = MIN(refs_per_block(fs) - i, count - n);
+            for (uint32_t k = 0; k < limit; k++) {
+                if (add)
+                    entries[i + k]++;
+                else if (entries[i + k] == REFCOUNT_MAX)
+                    res = ERROR_NO_SPACE;
+            }
+            refs_release(fs, start + n, add);
+            n += limit;
+        }
+    }
+
+    pthread_mutex_unlock(&fs->refcount_lock);
+    return res;
+}
+
+int block_refs_get(struct filesystem* fs, uint32_t first, uint32_t count, uint16_t* out) {
+    if (!fs || !out || !(fs->sb.features & FS_FEATURE_REFLINK) ||
+        first >= fs->sb.total_blocks || count > fs->sb.total_blocks - first)
+        return ERROR_INVALID;
+
+    pthread_mutex_lock(&fs->refcount_lock);
+    int res = SUCCESS;
+    for (uint32_t n = 0; n < count; ) {
+        uint16_t* entries;
+        uint32_t block_first;
+        res = refs_borrow(fs, first + n, false, &entries, &block_first);
+        if (res != SUCCESS)
+            break;
+        uint32_t i = first + n - block_first;
+        uint32_t limit = MIN(refs_per_block(fs) - i, count - n);
+        memcpy(out + n, entries + i, limit * sizeof(uint16_t));
+        refs_release(fs, first + n, false);
+        n += limit;
+    }
+    pthread_mutex_unlock(&fs->refcount_lock);
+    return res;
+}
+
+int block_refs_set(struct filesystem* fs, uint32_t block, uint16_t refs) {
+    if (!fs || !(fs->sb.features & FS_FEATURE_REFLINK) || block >= fs->sb.total_blocks)
+        return ERROR_INVALID;
+
+    pthread_mutex_lock(&fs->refcount_lock);
+    uint16_t* entries;
+    uint32_t first;
+    int res = refs_borrow(fs, block, true, &entries, &first);
+    if (res == SUCCESS) {
+        entries[block - first] = refs;
+        refs_release(fs, block, true);
+    }
+    pthread_mutex_unlock(&fs->refcount_lock);
+    return res;
+}
+
+// === GROUP DESCRIPTORS ===
+
+// allocates fs->groups with their layout (counters left to the caller)
+static int groups_create(struct filesystem* fs) {
+    uint32_t n = fs->sb.group_count;
+    fs->groups = calloc(n, sizeof(struct block_group));
+    if (!fs->groups)
+        return ERROR_NO_SPACE;
+
+    for (uint32_t g = 0; g < n; g++) {
+        struct block_group* grp = &fs->groups[g];
+        superblock_group_desc(&fs->sb, g, &grp->desc);
+        grp->end_block = g * fs->sb.blocks_per_group + superblock_group_blocks(&fs->sb, g);
+        grp->rotor = grp->desc.first_data_block;
+        pthread_mutex_init(&grp->lock, NULL);
+    }
+    fs->groups_dirty = false;
+    fs->dir_rotor = 0;
+    return SUCCESS;
+}
+
+int block_groups_load(struct filesystem* fs) {
+    if (!fs)
+        return ERROR_INVALID;
+    if (!(fs->sb.features & FS_FEATURE_GROUPS))
+        return SUCCESS;
+
+    int res = groups_create(fs);
+    if (res != SUCCESS)
+        return res;
+
+    const void* ptr;
+    if (disk_borrow_blocks(fs->disk, SUPERBLOCK_BLOCK_NUM + 1, fs->sb.group_desc_blocks,
+                           &ptr) != DISK_SUCCESS) {
+        block_groups_destroy(fs);
+        return ERROR_IO;
+    }
+
+    // the locations must be the ones the superblock geometry implies
+    const struct group_desc* table = ptr;
+    for (uint32_t g = 0; g < fs->sb.group_count && res == SUCCESS; g++) {
+        struct group_desc* d = &fs->groups[g].desc;
+        if (table[g].block_bitmap != d->block_bitmap || table[g].inode_bitmap != d->inode_bitmap ||
+            table[g].inode_table != d->inode_table ||
+            table[g].first_data_block != d->first_data_block ||
+            table[g].free_inodes > fs->sb.inodes_per_group ||
+            table[g].free_blocks > superblock_group_blocks(&fs->sb, g) ||
+            table[g].itable_zeroed > fs->sb.inode_table_blocks) {
+            res = ERROR_INVALID;
+            break;
+        }
+        *d = table[g];
+    }
+
+    disk_release_blocks(fs->disk, SUPERBLOCK_BLOCK_NUM + 1, fs->sb.group_desc_blocks, false);
+    if (res != SUCCESS)
+        block_groups_destroy(fs);
+    return res;
+}
+
+int block_groups_format(struct filesystem* fs) {
+    if (!fs || !fs->block_bitmap || !fs->inode_bitmap)
+        return ERROR_INVALID;
+    if (!(fs->sb.features & FS_FEATURE_GROUPS))
+        return SUCCESS;
+
+    int res = groups_create(fs);
+    if (res != SUCCESS)
+        return res;
+
+    uint32_t ipg = fs->sb.inodes_per_group;
+    for (uint32_t g = 0; g < fs->sb.group_count; g++) {
+        struct block_group* grp = &fs->groups[g];
+        uint32_t first = g * fs->sb.blocks_per_group;
+        grp->desc.free_blocks = (grp->end_block - first) -
+            (uint32_t)bitmap_count_used_in(fs->block_bitmap, first, grp->end_block);
+        grp->desc.free_inodes = ipg -
+            (uint32_t)bitmap_count_used_in(fs->inode_bitmap, g * ipg, (g + 1) * ipg);
+    }
+    fs->groups_dirty = true;
+    return SUCCESS;
+}
+
+int block_groups_grow(struct filesystem* fs, uint32_t old_count) {
+    if (!fs || !fs->block_bitmap || !fs->inode_bitmap)
+        return ERROR_INVALID;
+    if (!fs->groups)
+        return SUCCESS;
+
+    uint32_t n = fs->sb.group_count;
+    struct block_group* groups = calloc(n, sizeof(struct block_group));
+    if (!groups)
+        return ERROR_NO_SPACE;
+
+    uint32_t ipg = fs->sb.inodes_per_group;
+    for (uint32_t g = 0; g < n; g++) {
+        struct block_group* grp = &groups[g];
+        uint32_t first = g * fs->sb.blocks_per_group;
+        grp->end_block = first + superblock_group_blocks(&fs->sb, g);
+        pthread_mutex_init(&grp->lock, NULL);
+        if (g < old_count) {
+            grp->desc = fs->groups[g].desc;
+            grp->rotor = fs->groups[g].rotor;
+        } else {
+            superblock_group_desc(&fs->sb, g, &grp->desc);
+            grp->rotor = grp->desc.first_data_block;
+            grp->desc.free_inodes = ipg -
+                (uint32_t)bitmap_count_used_in(fs->inode_bitmap, g * ipg, (g + 1) * ipg);
+        }
+
+        // the old last group may have been extended too
+        if (g + 1 >= old_count)
+            grp->desc.free_blocks = (grp->end_block - first) -
+                (uint32_t)bitmap_count_used_in(fs->block_bitmap, first, grp->end_block);
+    }
+
+    for (uint32_t g = 0; g < old_count; g++)
+        pthread_mutex_destroy(&fs->groups[g].lock);
+    free(fs->groups);
+    fs->groups = groups;
+    fs->groups_dirty = true;
+    return SUCCESS;
+}
+
+int block_groups_save(struct filesystem* fs) {
+    if (!fs || !fs->groups || !fs->groups_dirty)
+        return SUCCESS;
+
+    void* ptr;
+    uint32_t blocks = fs->sb.group_desc_blocks;
+    if (disk_borrow_blocks_mut(fs->disk, SUPERBLOCK_BLOCK_NUM + 1, blocks, &ptr) != DISK_SUCCESS)
+        return ERROR_IO;
+
+    memset(ptr, 0, (size_t)blocks * fs_block_size(fs));
+    struct group_desc* table = ptr;
+    for (uint32_t g = 0; g < fs->sb.group_count; g++)
+        table[g] = fs->groups[g].desc;
+
+    disk_release_blocks(fs->disk, SUPERBLOCK_BLOCK_NUM + 1, blocks, true);
+    journal_add(fs->journal, SUPERBLOCK_BLOCK_NUM + 1, blocks);
+    fs->groups_dirty = false;
+    return SUCCESS;
+}
+
+void block_groups_lock_all(struct filesystem* fs) {
+    if (!fs || !fs->groups)
+        return;
+    for (uint32_t g = 0; g < fs->sb.group_count; g++)
+        pthread_mutex_lock(&fs->groups[g].lock);
+}
+
+void block_groups_unlock_all(struct filesystem* fs) {
+    if (!fs || !fs->groups)
+        return;
+    for (uint32_t g = fs->sb.group_count; g-- > 0; )
+        pthread_mutex_unlock(&fs->groups[g].lock);
+}
+
+void block_groups_destroy(struct filesystem* fs) {
+    if (!fs || !fs->groups)
+        return;
+    for (uint32_t g = 0; g < fs->sb.group_count; g++)
+        pthread_mutex_destroy(&fs->groups[g].lock);
+    free(fs->groups);
+    fs->groups = NULL;
+}
+
+void block_groups_print(const struct filesystem* fs) {
+    if (!fs || !fs->groups)
+        return;
+
+    printf("Block groups:\n");
+    for (uint32_t g = 0; g < fs->sb.group_count; g++) {
+        const struct group_desc* d = &fs->groups[g].desc;
+        printf("  Group %-4u: blocks %u..%u, data from %u, %u free blocks, %u free inodes, %u dirs",
+               g, g * fs->sb.blocks_per_group, fs->groups[g].end_block - 1, d->first_data_block,
+               d->free_blocks, d->free_inodes, d->used_dirs);
+        if (fs->sb.features & FS_FEATURE_LAZY_ITABLE)
+            printf(", inode table %u/%u initialised", d->itable_zeroed, fs->sb.inode_table_blocks);
+        printf("\n");
+    }
+}
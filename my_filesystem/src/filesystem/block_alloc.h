@@ -0,0 +1,147 @@
+#pragma once
+
+#include "common.h"
+#include "disk.h"
+#include <pthread.h>
+
+/*
+ * Block allocator for file and directory data.
+ *
+ * Allocation is goal-directed: callers pass the block they would like to get
+ * (normally the one right after the file's last block) and receive the free
+ * run closest to it, wrapping around to the start of the data area. A goal
+ * of 0 means "new file": the search starts at fs->alloc_rotor, which then
+ * moves past the allocation so that files created one after another do not
+ * interleave.
+ *
+ * Only the block bitmap is updated: callers adjust fs->sb.free_blocks for
+ * the blocks they actually use (and release: see block_free_run). Both
+ * calls take fs->alloc_lock.
+ *
+ * With block groups (FS_FEATURE_GROUPS) every group has its own lock,
+ * rotor and free counters instead: an allocation stays in the goal's group
+ * while it has a run to offer and only then moves on to the next groups, so
+ * writers working in different groups never wait for each other. A new file
+ * starts at the rotor of its inode's group (see block_group_goal).
+ */
+
+struct filesystem;
+
+// in-memory state of a block group
+struct block_group {
+    struct group_desc desc;           // on-disk descriptor, counters kept current
+    uint32_t end_block;               // one past the group's last block
+    uint32_t rotor;                   // goal for the next new file in the group
+    pthread_mutex_t lock;             // the group's block bitmap bits, rotor, desc.free_blocks
+};
+
+// allocates between 1 and `want` contiguous blocks near goal (0 = rotor)
+int block_alloc(struct filesystem* fs, uint32_t goal, uint32_t want,
+                uint32_t* out_start, uint32_t* out_count);
+
+// releases count blocks starting at start; shared blocks (see below) only
+// lose a reference. Returns the blocks actually released
+uint32_t block_free_run(struct filesystem* fs, uint32_t start, uint32_t count);
+
+// goal for the first block of a file without any: the rotor of the inode's
+// group (0 = no preference, and always with the flat layout)
+uint32_t block_group_goal(struct filesystem* fs, uint32_t inode_num);
+
+// === INODE NUMBERS ===
+
+/*
+ * Inode numbers come from the inode bitmap under fs->alloc_lock. With block
+ * groups a file goes to its parent directory's group (the first one with a
+ * free inode after it), while a directory is spread out to the group with
+ * the most free blocks among those with an above-average share of free
+ * inodes, so that unrelated trees land in different groups.
+ */
+
+// reserves an inode number (parent = INVALID_INODE_NUM: no preference)
+int inode_num_alloc(struct filesystem* fs, uint32_t parent, uint8_t type, uint32_t* out_inode_num);
+
+// releases an inode number of the given type
+void inode_num_free(struct filesystem* fs, uint32_t inode_num, uint8_t type);
+
+// === LAZY INODE TABLE ===
+
+/*
+ * With FS_FEATURE_LAZY_ITABLE only the leading sb.itable_zeroed blocks of
+ * the inode table (with block groups: desc.itable_zeroed of each group's
+ * table) are known to be initialised; the rest still holds whatever the
+ * image held before the format. inode_num_alloc zeroes the blocks up to the
+ * new inode's and advances the mark before handing the number out, and
+ * inode_load reads an inode past the mark as a free one. Marks only grow.
+ */
+
+// true when inode_num lies in an initialised block of its inode table
+bool itable_is_initialised(const struct filesystem* fs, uint32_t inode_num);
+
+// zeroes count blocks starting at block, in bounded batches
+int itable_zero_blocks(disk_t disk, uint32_t block, uint32_t count);
+
+// initialises up to max_blocks more table blocks (caller holds no fs lock);
+// *out_remaining receives the blocks still uninitialised afterwards
+int itable_init_some(struct filesystem* fs, uint32_t max_blocks, uint32_t* out_remaining);
+
+// === SHARED BLOCKS ===
+
+/*
+ * With FS_FEATURE_REFLINK a data block may be mapped by several files
+ * (fs_clone). The reference-count table (sb.refcount_start, one 16-bit
+ * entry per block, in block order) holds the references a block has beyond
+ * the first: 0 for a block with a single owner, and for every free block.
+ * Mapping blocks (pointer / extent blocks) and directories are never
+ * shared.
+ *
+ * A mapping owner never races with itself: a block that is not shared can
+ * only become shared through a clone of the file mapping it, which holds
+ * that file's inode lock, so the owner may release or overwrite it without
+ * rechecking. The table is changed in place under fs->refcount_lock and
+ * its blocks join the running journal transaction.
+ */
+
+#define REFCOUNT_MAX UINT16_MAX       // references beyond the first a block can hold
+
+// *out_shared tells whether the block at start is shared, *out_run how many
+// blocks from start (at most count) are in the same state. Never shared
+// without the feature
+int block_is_shared(struct filesystem* fs, uint32_t start, uint32_t count,
+                    bool* out_shared, uint32_t* out_run);
+
+// adds a reference to every block of the run; ERROR_NO_SPACE (nothing
+// changed) when one is already at REFCOUNT_MAX, ERROR_INVALID without the
+// feature
+int block_share_run(struct filesystem* fs, uint32_t start, uint32_t count);
+
+// copies the entries of blocks [first, first + count) (for fs_check)
+int block_refs_get(struct filesystem* fs, uint32_t first, uint32_t count, uint16_t* out);
+
+// sets the entry of one block (fs_check repair)
+int block_refs_set(struct filesystem* fs, uint32_t block, uint16_t refs);
+
+// === GROUP DESCRIPTORS ===
+
+// builds fs->groups from the descriptor table (no-op without block groups)
+int block_groups_load(struct filesystem* fs);
+
+// builds fs->groups for a fresh format, counting from the in-memory bitmaps
+int block_groups_format(struct filesystem* fs);
+
+// rebuilds fs->groups once fs->sb describes more groups than the old_count
+// it was built for (fs_grow): the existing groups keep their state, the
+// extended last one and the new ones are counted from the in-memory bitmaps.
+// The caller holds fs->alloc_lock with the filesystem frozen
+int block_groups_grow(struct filesystem* fs, uint32_t old_count);
+
+// writes the descriptor table back if a counter changed (caller holds
+// fs->alloc_lock and every group lock, see block_groups_lock_all)
+int block_groups_save(struct filesystem* fs);
+
+void block_groups_lock_all(struct filesystem* fs);
+void block_groups_unlock_all(struct filesystem* fs);
+
+void block_groups_destroy(struct filesystem* fs);
+
+// prints per-group usage
+void block_groups_print(const struct filesystem* fs);
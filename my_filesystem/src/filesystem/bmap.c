@@ -0,0 +1,1117 @@
+#include "bmap.h"
+#include "fs.h"
+#include "fs_internal.h"
+#include <stddef.h>
+#include <string.h>
+
+_Static_assert(BMAP_INODE_EXTENTS * sizeof(struct extent) == BMAP_DIRECT_BLOCKS * sizeof(uint32_t),
+               "in-inode extents must exactly cover direct[]");
+_Static_assert(offsetof(struct inode, indirect) ==
+               offsetof(struct inode, direct) + BMAP_DIRECT_BLOCKS * sizeof(uint32_t) &&
+               offsetof(struct inode, triple_indirect) ==
+               offsetof(struct inode, double_indirect) + sizeof(uint32_t),
+               "inline data segments must be contiguous");
+
+// === PRIVATE FUNCTIONS ===
+
+static inline bool uses_extents(const struct inode* inode) {
+    return (inode->flags & INODE_FLAG_EXTENTS) != 0;
+}
+
+// allocates one zero-filled mapping block near goal
+static int alloc_meta_block(struct filesystem* fs, uint32_t goal, uint32_t* out_block) {
+    uint32_t block, count;
+    int res = block_alloc(fs, goal, 1, &block, &count);
+    if (res != SUCCESS)
+        return res;
+
+    void* ptr;
+    if (disk_borrow_blocks_mut(fs->disk, block, 1, &ptr) != DISK_SUCCESS) {
+        block_free_run(fs, block, 1);
+        return ERROR_IO;
+    }
+    memset(ptr, 0, fs_block_size(fs));
+    disk_release_blocks(fs->disk, block, 1, true);
+    journal_add(fs->journal, block, 1);
+
+    *out_block = block;
+    return SUCCESS;
+}
+
+// --- inline data ---
+
+// the inline area, in order: direct[] + indirect, the two deeper tree roots, reserved[]
+static const struct {
+    size_t offset;
+    size_t len;
+} inline_segments[] = {
+    { offsetof(struct inode, direct), (BMAP_DIRECT_BLOCKS + 1) * sizeof(uint32_t) },
+    { offsetof(struct inode, double_indirect), 2 * sizeof(uint32_t) },
+    { offsetof(struct inode, reserved), sizeof(((struct inode*)0)->reserved) },
+};
+
+#define INLINE_SEGMENTS (sizeof(inline_segments) / sizeof(inline_segments[0]))
+
+/*
+ * Calls fn on the pieces of the inline range [offset, offset + len), with
+ * the byte of the inode at the start of each piece and the position of
+ * that piece within the range.
+ */
+static void inline_for_range(const struct inode* inode, uint32_t offset, uint32_t len,
+                             void (*fn)(uint8_t* bytes, size_t pos, size_t n, void* arg),
+                             void* arg) {
+    size_t seg_start = 0;
+    size_t pos = 0;
+    for (size_t i = 0; i < INLINE_SEGMENTS && pos < len; i++) {
+        size_t seg_end = seg_start + inline_segments[i].len;
+        if (offset + pos < seg_end) {
+            size_t in_seg = offset + pos - seg_start;
+            size_t n = MIN(seg_end - (offset + pos), len - pos);
+            fn((uint8_t*)inode + inline_segments[i].offset + in_seg, pos, n, arg);
+            pos += n;
+        }
+        seg_start = seg_end;
+    }
+}
+
+static void copy_out(uint8_t* bytes, size_t pos, size_t n, void* arg) {
+    memcpy((uint8_t*)arg + pos, bytes, n);
+}
+
+static void copy_in(uint8_t* bytes, size_t pos, size_t n, void* arg) {
+    memcpy(bytes, (const uint8_t*)arg + pos, n);
+}
+
+static void zero_out(uint8_t* bytes, size_t pos, size_t n, void* arg) {
+    (void)pos;
+    (void)arg;
+    memset(bytes, 0, n);
+}
+
+// --- block pointers ---
+
+/*
+ * Logical blocks past direct[] are served by pointer trees of depth 1
+ * (indirect), 2 (double_indirect) and 3 (triple_indirect). A "leaf" is a
+ * pointer block whose entries are data blocks.
+ */
+#define PTR_DEPTHS 3
+
+static inline uint32_t ptrs_per_block(const struct filesystem* fs) {
+    return fs_block_size(fs) / sizeof(uint32_t);
+}
+
+// log2(ptrs_per_block)
+static inline uint32_t ptr_shift(const struct filesystem* fs) {
+    return fs_block_shift(fs) - 2;
+}
+
+// logical blocks served by one entry of a pointer block of the given depth
+// (depth - 1 levels below it); 64-bit, as deep trees of large blocks
+// outgrow 32 bits
+static inline uint64_t tree_span(const struct filesystem* fs, uint32_t depth) {
+    return (uint64_t)1 << (depth * ptr_shift(fs));
+}
+
+// first logical block served by the tree of the given depth
+static uint64_t tree_start(const struct filesystem* fs, uint32_t depth) {
+    uint64_t start = BMAP_DIRECT_BLOCKS;
+    for (uint32_t d = 1; d < depth; d++)
+        start += tree_span(fs, d);
+    return start;
+}
+
+static uint32_t tree_root(const struct inode* inode, uint32_t depth) {
+    switch (depth) {
+        case 1:  return inode->indirect;
+        case 2:  return inode->double_indirect;
+        default: return inode->triple_indirect;
+    }
+}
+
+static void set_tree_root(struct inode* inode, uint32_t depth, uint32_t block) {
+    switch (depth) {
+        case 1:  inode->indirect = block; break;
+        case 2:  inode->double_indirect = block; break;
+        default: inode->triple_indirect = block; break;
+    }
+}
+
+// depth of the tree serving logical block idx (idx >= BMAP_DIRECT_BLOCKS)
+static uint32_t tree_of(const struct filesystem* fs, uint32_t idx) {
+    uint32_t depth = 1;
+    while (depth < PTR_DEPTHS && idx >= tree_start(fs, depth) + tree_span(fs, depth))
+        depth++;
+    return depth;
+}
+
+static void leaf_release(struct filesystem* fs, struct bmap_cursor* cur) {
+    if (cur->leaf_ptrs) {
+        disk_release_blocks(fs->disk, cur->leaf_block, 1, cur->leaf_dirty);
+        if (cur->leaf_dirty)
+            journal_add(fs->journal, cur->leaf_block, 1);
+    }
+    cur->leaf_valid = false;
+    cur->leaf_dirty = false;
+    cur->leaf_ptrs = NULL;
+}
+
+/*
+ * Points the cursor at the leaf serving logical block idx, walking down
+ * from the tree root. With `create`, missing pointer blocks on the way are
+ * allocated near goal (and counted in *meta); otherwise a missing block
+ * leaves cur->leaf_block at 0.
+ */
+static int leaf_load(struct filesystem* fs, struct inode* inode, struct bmap_cursor* cur,
+                     uint32_t idx, bool create, uint32_t goal, uint32_t* meta) {
+    leaf_release(fs, cur);
+
+    uint32_t depth = tree_of(fs, idx);
+    uint32_t rel = idx - (uint32_t)tree_start(fs, depth);
+    uint32_t slot_mask = ptrs_per_block(fs) - 1;
+
+    uint32_t block = tree_root(inode, depth);
+    if (block == 0 && create) {
+        int res = alloc_meta_block(fs, goal, &block);
+        if (res != SUCCESS)
+            return res;
+        set_tree_root(inode, depth, block);
+        inode->blocks_used++;
+        (*meta)++;
+    }
+
+    // interior levels: pick the child covering rel
+    for (uint32_t level = depth - 1; level >= 1 && block != 0; level--) {
+        uint32_t slot = (uint32_t)(((uint64_t)rel >> (level * ptr_shift(fs))) & slot_mask);
+        void* ptr;
+        int res = create ? disk_borrow_blocks_mut(fs->disk, block, 1, &ptr)
+                         : disk_borrow_blocks(fs->disk, block, 1, (const void**)&ptr);
+        if (res != DISK_SUCCESS)
+            return ERROR_IO;
+        uint32_t* ptrs = (uint32_t*)ptr;
+
+        uint32_t child = ptrs[slot];
+        bool dirty = false;
+        if (child == 0 && create) {
+            res = alloc_meta_block(fs, goal, &child);
+            if (res != SUCCESS) {
+                disk_release_blocks(fs->disk, block, 1, false);
+                return res;
+            }
+            ptrs[slot] = child;
+            inode->blocks_used++;
+            (*meta)++;
+            dirty = true;
+        }
+        disk_release_blocks(fs->disk, block, 1, dirty);
+        if (dirty)
+            journal_add(fs->journal, block, 1);
+        block = child;
+    }
+
+    cur->leaf_valid = true;
+    cur->leaf_first = idx - (rel & slot_mask);
+    cur->leaf_block = block;
+
+    // borrowed writable so that a later bmap_map() can patch it in place;
+    // released clean unless an entry changed
+    if (block != 0) {
+        void* ptr;
+        if (disk_borrow_blocks_mut(fs->disk, block, 1, &ptr) != DISK_SUCCESS) {
+            cur->leaf_valid = false;
+            return ERROR_IO;
+        }
+        cur->leaf_ptrs = (uint32_t*)ptr;
+    }
+    return SUCCESS;
+}
+
+static inline bool leaf_covers(const struct filesystem* fs, const struct bmap_cursor* cur,
+                               uint32_t idx) {
+    return cur->leaf_valid && idx >= cur->leaf_first &&
+           idx - cur->leaf_first < ptrs_per_block(fs);
+}
+
+// pointer of logical block j (0 = hole)
+static int ptr_get(struct filesystem* fs, const struct inode* inode, struct bmap_cursor* cur,
+                   uint32_t j, uint32_t* out) {
+    if (j < BMAP_DIRECT_BLOCKS) {
+        *out = inode->direct[j];
+        return SUCCESS;
+    }
+    if (!leaf_covers(fs, cur, j)) {
+        // read-only walk: the inode is not modified
+        int res = leaf_load(fs, (struct inode*)inode, cur, j, false, 0, NULL);
+        if (res != SUCCESS)
+            return res;
+    }
+    *out = cur->leaf_ptrs ? cur->leaf_ptrs[j - cur->leaf_first] : 0;
+    return SUCCESS;
+}
+
+static int ptr_lookup(struct filesystem* fs, const struct inode* inode, struct bmap_cursor* cur,
+                      uint32_t idx, uint32_t limit, uint32_t* out_phys, uint32_t* out_run) {
+    uint32_t first;
+    int res = ptr_get(fs, inode, cur, idx, &first);
+
+    // a run may cross from direct[] into the trees and from leaf to leaf
+    uint32_t run = 1;
+    while (res == SUCCESS && run < limit) {
+        uint32_t next;
+        res = ptr_get(fs, inode, cur, idx + run, &next);
+        if (res != SUCCESS || next != (first ? first + run : 0))
+            break;
+        run++;
+    }
+
+    if (res != SUCCESS)
+        return res;
+
+    *out_phys = first;
+    *out_run = run;
+    return SUCCESS;
+}
+
+static int ptr_map(struct filesystem* fs, struct inode* inode, struct bmap_cursor* cur,
+                   uint32_t idx, uint32_t phys, uint32_t count, uint32_t* out_meta_blocks) {
+    int res = SUCCESS;
+
+    for (uint32_t j = idx; j < idx + count; j++) {
+        if (j < BMAP_DIRECT_BLOCKS) {
+            inode->direct[j] = phys + (j - idx);
+            continue;
+        }
+        // a leaf the cursor found missing during lookup is created now
+        if (!leaf_covers(fs, cur, j) || !cur->leaf_ptrs) {
+            // pointer blocks go right after the data run so they do not split it
+            res = leaf_load(fs, inode, cur, j, true, phys + count, out_meta_blocks);
+            if (res != SUCCESS)
+                break;
+        }
+        cur->leaf_ptrs[j - cur->leaf_first] = phys + (j - idx);
+        cur->leaf_dirty = true;
+    }
+
+    return res;
+}
+
+// blocks a punch took out of the mapping, and those of them actually
+// released (a shared block only loses a reference)
+struct punched {
+    uint32_t unmapped;
+    uint32_t released;
+};
+
+static inline void punch_run(struct filesystem* fs, struct punched* p, uint32_t start,
+                             uint32_t count) {
+    p->released += block_free_run(fs, start, count);
+    p->unmapped += count;
+}
+
+/*
+ * Frees the entries of the pointer block `block` (depth 1 = leaf) that map
+ * logical blocks in [from, end); base is the first logical block it serves.
+ * *out_empty tells whether the block no longer maps anything.
+ */
+static int free_tree(struct filesystem* fs, uint32_t block, uint32_t depth, uint64_t base,
+                     uint32_t from, uint32_t end, struct punched* freed, bool* out_empty) {
+    void* ptr;
+    if (disk_borrow_blocks_mut(fs->disk, block, 1, &ptr) != DISK_SUCCESS)
+        return ERROR_IO;
+    uint32_t* ptrs = (uint32_t*)ptr;
+
+    uint64_t span = tree_span(fs, depth - 1);
+    bool empty = true;
+    bool dirty = false;
+    int res = SUCCESS;
+
+    uint32_t n = ptrs_per_block(fs);
+    for (uint32_t i = 0; i < n; i++) {
+        if (ptrs[i] == 0) continue;
+
+        uint64_t entry_base = base + i * span;
+        if (entry_base + span <= from || entry_base >= end) {
+            empty = false;      // entirely outside the range
+            continue;
+        }
+
+        if (depth > 1) {
+            bool child_empty;
+            res = free_tree(fs, ptrs[i], depth - 1, entry_base, from, end, freed, &child_empty);
+            if (res != SUCCESS)
+                break;
+            if (!child_empty) {
+                empty = false;
+                continue;
+            }
+        }
+
+        punch_run(fs, freed, ptrs[i], 1);
+        ptrs[i] = 0;
+        dirty = true;
+    }
+
+    disk_release_blocks(fs->disk, block, 1, dirty);
+    if (dirty)
+        journal_add(fs->journal, block, 1);
+    *out_empty = empty;
+    return res;
+}
+
+static int ptr_punch(struct filesystem* fs, struct inode* inode, uint32_t from, uint32_t end,
+                     uint32_t* out_freed) {
+    struct punched freed = { 0, 0 };
+    int res = SUCCESS;
+
+    for (uint32_t j = from; j < MIN(end, (uint32_t)BMAP_DIRECT_BLOCKS); j++) {
+        if (inode->direct[j] == 0) continue;
+        punch_run(fs, &freed, inode->direct[j], 1);
+        inode->direct[j] = 0;
+    }
+
+    for (uint32_t depth = 1; depth <= PTR_DEPTHS && res == SUCCESS; depth++) {
+        uint32_t root = tree_root(inode, depth);
+        uint64_t start = tree_start(fs, depth);
+        if (root == 0 || end <= start || from >= start + tree_span(fs, depth)) continue;
+
+        bool empty;
+        res = free_tree(fs, root, depth, start, from, end, &freed, &empty);
+        if (res == SUCCESS && empty) {
+            punch_run(fs, &freed, root, 1);
+            set_tree_root(inode, depth, 0);
+        }
+    }
+
+    inode->blocks_used -= MIN(freed.unmapped, inode->blocks_used);
+    *out_freed = freed.released;
+    return res;
+}
+
+static uint32_t ptr_goal(struct filesystem* fs, const struct inode* inode, struct bmap_cursor* cur,
+                         uint32_t idx) {
+    uint32_t goal = 0;
+
+    // the previous block is mapped for appends; do not scan far for anything else
+    uint32_t stop = (idx > ptrs_per_block(fs)) ? idx - ptrs_per_block(fs) : 0;
+    for (uint32_t j = idx; j-- > stop; ) {
+        uint32_t block;
+        if (ptr_get(fs, inode, cur, j, &block) != SUCCESS)
+            break;
+        if (block != 0) {
+            goal = block + (idx - j);
+            break;
+        }
+    }
+
+    return goal;
+}
+
+// --- extents ---
+
+// gathers the in-inode records and the extent block into ext[]
+static int extents_load(struct filesystem* fs, const struct inode* inode,
+                        struct extent* ext, uint32_t* out_count) {
+    uint32_t n = 0;
+
+    struct extent in_inode[BMAP_INODE_EXTENTS];
+    memcpy(in_inode, inode->direct, sizeof(in_inode));
+    for (uint32_t i = 0; i < BMAP_INODE_EXTENTS && in_inode[i].length != 0; i++)
+        ext[n++] = in_inode[i];
+
+    if (inode->indirect != 0) {
+        const void* ptr;
+        if (disk_borrow_blocks(fs->disk, inode->indirect, 1, &ptr) != DISK_SUCCESS)
+            return ERROR_IO;
+        const struct extent* blk = (const struct extent*)ptr;
+        for (uint32_t i = 0; i < BMAP_BLOCK_EXTENTS && blk[i].length != 0; i++)
+            ext[n++] = blk[i];
+        disk_release_blocks(fs->disk, inode->indirect, 1, false);
+    }
+
+    *out_count = n;
+    return SUCCESS;
+}
+
+// writes ext[0..n) back, allocating the extent block when the inode overflows
+static int extents_store(struct filesystem* fs, struct inode* inode,
+                         const struct extent* ext, uint32_t n, uint32_t* out_meta_blocks) {
+    if (n > BMAP_INODE_EXTENTS && inode->indirect == 0) {
+        const struct extent* last = &ext[n - 1];
+        uint32_t block;
+        int res = alloc_meta_block(fs, last->physical + last->length, &block);
+        if (res != SUCCESS)
+            return res;
+        inode->indirect = block;
+        inode->blocks_used++;
+        (*out_meta_blocks)++;
+    }
+
+    struct extent in_inode[BMAP_INODE_EXTENTS];
+    memset(in_inode, 0, sizeof(in_inode));
+    memcpy(in_inode, ext, MIN(n, BMAP_INODE_EXTENTS) * sizeof(struct extent));
+    memcpy(inode->direct, in_inode, sizeof(in_inode));
+
+    if (inode->indirect != 0) {
+        void* ptr;
+        if (disk_borrow_blocks_mut(fs->disk, inode->indirect, 1, &ptr) != DISK_SUCCESS)
+            return ERROR_IO;
+        // records past the last one stay zeroed (length 0 ends the list)
+        memset(ptr, 0, fs_block_size(fs));
+        if (n > BMAP_INODE_EXTENTS)
+            memcpy(ptr, ext + BMAP_INODE_EXTENTS,
+                   (n - BMAP_INODE_EXTENTS) * sizeof(struct extent));
+        disk_release_blocks(fs->disk, inode->indirect, 1, true);
+        journal_add(fs->journal, inode->indirect, 1);
+    }
+
+    return SUCCESS;
+}
+
+// the inode's extent list, loaded into the cursor on first use
+static int cursor_extents(struct filesystem* fs, const struct inode* inode,
+                          struct bmap_cursor* cur) {
+    if (cur->ext_valid)
+        return SUCCESS;
+
+    int res = extents_load(fs, inode, cur->ext, &cur->ext_count);
+    if (res == SUCCESS)
+        cur->ext_valid = true;
+    return res;
+}
+
+static int ext_lookup(struct filesystem* fs, const struct inode* inode, struct bmap_cursor* cur,
+                      uint32_t idx, uint32_t limit, uint32_t* out_phys, uint32_t* out_run) {
+    int res = cursor_extents(fs, inode, cur);
+    if (res != SUCCESS)
+        return res;
+
+    const struct extent* ext = cur->ext;
+    uint32_t n = cur->ext_count;
+
+    for (uint32_t i = 0; i < n; i++) {
+        if (idx < ext[i].logical) {
+            // hole up to the next extent
+            *out_phys = 0;
+            *out_run = MIN(limit, ext[i].logical - idx);
+            return SUCCESS;
+        }
+        if (idx - ext[i].logical < ext[i].length) {
+            uint32_t into = idx - ext[i].logical;
+            *out_phys = ext[i].physical + into;
+            *out_run = MIN(limit, ext[i].length - into);
+            return SUCCESS;
+        }
+    }
+
+    // hole past the last extent
+    *out_phys = 0;
+    *out_run = limit;
+    return SUCCESS;
+}
+
+static int ext_map(struct filesystem* fs, struct inode* inode, struct bmap_cursor* cur,
+                   uint32_t idx, uint32_t phys, uint32_t count, uint32_t* out_meta_blocks) {
+    int res = cursor_extents(fs, inode, cur);
+    if (res != SUCCESS)
+        return res;
+
+    // edited in place: the cursor keeps matching the inode
+    struct extent* ext = cur->ext;
+    uint32_t n = cur->ext_count;
+
+    // first extent after the hole being mapped
+    uint32_t p = 0;
+    while (p < n && ext[p].logical < idx)
+        p++;
+
+    struct extent* prev = (p > 0) ? &ext[p - 1] : NULL;
+    struct extent* next = (p < n) ? &ext[p] : NULL;
+
+    if (prev && prev->logical + prev->length == idx && prev->physical + prev->length == phys) {
+        // grow the previous extent, then absorb the next one if they now touch
+        prev->length += count;
+        if (next && prev->logical + prev->length == next->logical &&
+            prev->physical + prev->length == next->physical) {
+            prev->length += next->length;
+            memmove(&ext[p], &ext[p + 1], (n - p - 1) * sizeof(struct extent));
+            n--;
+        }
+    } else if (next && idx + count == next->logical && phys + count == next->physical) {
+        next->logical = idx;
+        next->physical = phys;
+        next->length += count;
+    } else {
+        if (n == BMAP_MAX_EXTENTS)
+            return ERROR_NO_SPACE;
+        memmove(&ext[p + 1], &ext[p], (n - p) * sizeof(struct extent));
+        ext[p].logical = idx;
+        ext[p].physical = phys;
+        ext[p].length = count;
+        n++;
+    }
+    cur->ext_count = n;
+
+    res = extents_store(fs, inode, ext, n, out_meta_blocks);
+    if (res != SUCCESS)
+        cur->ext_valid = false;     // reload from the (unchanged) inode next time
+    return res;
+}
+
+/*
+ * Points the mapped range [idx, idx + count), which lies within one
+ * extent, at [phys, phys + count): the extent is split around it and the
+ * new piece joins a neighbour it continues.
+ */
+static int ext_remap(struct filesystem* fs, struct inode* inode, struct bmap_cursor* cur,
+                     uint32_t idx, uint32_t phys, uint32_t count, uint32_t* out_meta_blocks) {
+    int res = cursor_extents(fs, inode, cur);
+    if (res != SUCCESS)
+        return res;
+
+    const struct extent* ext = cur->ext;
+    uint32_t n = cur->ext_count;
+    uint32_t i = 0;
+    while (i < n && ext[i].logical + ext[i].length <= idx)
+        i++;
+    if (i == n || ext[i].logical > idx || idx + count > ext[i].logical + ext[i].length)
+        return ERROR_INVALID;
+
+    struct extent out[BMAP_MAX_EXTENTS + 2];
+    memcpy(out, ext, i * sizeof(struct extent));
+    uint32_t k = i;
+
+    struct extent e = ext[i];
+    uint32_t e_end = e.logical + e.length;
+    if (idx > e.logical)
+        out[k++] = (struct extent){ e.logical, e.physical, idx - e.logical };
+
+    // the new piece, merged into the record before it when it continues it
+    struct extent* prev = (k > 0) ? &out[k - 1] : NULL;
+    if (prev && prev->logical + prev->length == idx && prev->physical + prev->length == phys)
+        prev->length += count;
+    else
+        out[k++] = (struct extent){ idx, phys, count };
+
+    uint32_t next = i + 1;
+    if (idx + count < e_end) {
+        out[k++] = (struct extent){ idx + count, e.physical + (idx + count - e.logical),
+                                    e_end - (idx + count) };
+    } else if (next < n && ext[next].logical == idx + count &&
+               ext[next].physical == phys + count) {
+        out[k - 1].length += ext[next].length;
+        next++;
+    }
+    for (; next < n; next++)
+        out[k++] = ext[next];
+
+    if (k > BMAP_MAX_EXTENTS)
+        return ERROR_NO_SPACE;       // nothing changed
+
+    memcpy(cur->ext, out, k * sizeof(struct extent));
+    cur->ext_count = k;
+    res = extents_store(fs, inode, out, k, out_meta_blocks);
+    if (res != SUCCESS)
+        cur->ext_valid = false;
+    return res;
+}
+
+static int ext_punch(struct filesystem* fs, struct inode* inode, uint32_t from, uint32_t end,
+                     uint32_t* out_freed) {
+    struct extent ext[BMAP_MAX_EXTENTS];
+    uint32_t n;
+    int res = extents_load(fs, inode, ext, &n);
+    if (res != SUCCESS)
+        return res;
+
+    // what survives: the parts of each extent outside [from, end); punching
+    // the middle of an extent splits it in two
+    struct extent kept[BMAP_MAX_EXTENTS + 1];
+    uint32_t k = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        struct extent e = ext[i];
+        uint32_t e_end = e.logical + e.length;
+        if (e_end <= from || e.logical >= end) {
+            kept[k++] = e;
+            continue;
+        }
+        if (e.logical < from)
+            kept[k++] = (struct extent){ e.logical, e.physical, from - e.logical };
+        if (e_end > end)
+            kept[k++] = (struct extent){ end, e.physical + (end - e.logical), e_end - end };
+    }
+    if (k > BMAP_MAX_EXTENTS)
+        return ERROR_NO_SPACE;      // nothing freed yet
+
+    struct punched freed = { 0, 0 };
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t lo = MAX(ext[i].logical, from);
+        uint32_t hi = MIN(ext[i].logical + ext[i].length, end);
+        if (lo >= hi) continue;
+        punch_run(fs, &freed, ext[i].physical + (lo - ext[i].logical), hi - lo);
+    }
+
+    // a split may move records out of the inode into a new extent block
+    uint32_t meta = 0;
+    res = extents_store(fs, inode, kept, k, &meta);
+    if (res != SUCCESS)
+        return res;
+
+    if (k <= BMAP_INODE_EXTENTS && inode->indirect != 0) {
+        punch_run(fs, &freed, inode->indirect, 1);
+        inode->indirect = 0;
+    }
+
+    inode->blocks_used -= MIN(freed.unmapped, inode->blocks_used);
+
+    // splitting an extent of shared blocks can take more than it gives back
+    if (freed.released < meta) {
+        fs_free_blocks_sub(fs, meta - freed.released);
+        *out_freed = 0;
+    } else {
+        *out_freed = freed.released - meta;
+    }
+    return SUCCESS;
+}
+
+static uint32_t ext_goal(struct filesystem* fs, const struct inode* inode, struct bmap_cursor* cur,
+                         uint32_t idx) {
+    if (cursor_extents(fs, inode, cur) != SUCCESS)
+        return 0;
+
+    uint32_t goal = 0;
+    for (uint32_t i = 0; i < cur->ext_count && cur->ext[i].logical < idx; i++)
+        goal = cur->ext[i].physical + (idx - cur->ext[i].logical);
+    return goal;
+}
+
+// --- clones ---
+
+// frees pointer block `block` (depth 1 = leaf) and the pointer blocks below
+// it, leaving the data blocks they map alone
+static void free_ptr_blocks(struct filesystem* fs, uint32_t block, uint32_t depth) {
+    if (depth > 1) {
+        const void* ptr;
+        if (disk_borrow_blocks(fs->disk, block, 1, &ptr) == DISK_SUCCESS) {
+            const uint32_t* ptrs = (const uint32_t*)ptr;
+            for (uint32_t i = 0; i < ptrs_per_block(fs); i++)
+                if (ptrs[i] != 0)
+                    free_ptr_blocks(fs, ptrs[i], depth - 1);
+            disk_release_blocks(fs->disk, block, 1, false);
+        }
+    }
+    block_free_run(fs, block, 1);
+}
+
+/*
+ * Copies pointer block `block` (depth 1 = leaf) and the pointer blocks below
+ * it into new blocks near goal, counted in *meta; the data block pointers are
+ * copied as they are. On failure nothing new stays allocated.
+ */
+static int copy_tree(struct filesystem* fs, uint32_t block, uint32_t depth, uint32_t goal,
+                     uint32_t* out_copy, uint32_t* meta) {
+    uint32_t copy;
+    int res = alloc_meta_block(fs, goal, &copy);
+    if (res != SUCCESS)
+        return res;
+
+    const void* src;
+    void* dst;
+    if (disk_borrow_blocks(fs->disk, block, 1, &src) != DISK_SUCCESS) {
+        block_free_run(fs, copy, 1);
+        return ERROR_IO;
+    }
+    if (disk_borrow_blocks_mut(fs->disk, copy, 1, &dst) != DISK_SUCCESS) {
+        disk_release_blocks(fs->disk, block, 1, false);
+        block_free_run(fs, copy, 1);
+        return ERROR_IO;
+    }
+    memcpy(dst, src, fs_block_size(fs));
+    disk_release_blocks(fs->disk, block, 1, false);
+
+    uint32_t copied = 1;
+    uint32_t* ptrs = (uint32_t*)dst;
+    uint32_t n = ptrs_per_block(fs);
+    for (uint32_t i = 0; i < n && depth > 1; i++) {
+        if (ptrs[i] == 0) continue;
+        res = copy_tree(fs, ptrs[i], depth - 1, copy + 1, &ptrs[i], &copied);
+        if (res != SUCCESS) {
+            // the entries not copied yet still point into the source tree
+            memset(&ptrs[i], 0, (n - i) * sizeof(uint32_t));
+            break;
+        }
+    }
+    disk_release_blocks(fs->disk, copy, 1, true);
+    journal_add(fs->journal, copy, 1);
+
+    if (res != SUCCESS) {
+        free_ptr_blocks(fs, copy, depth);
+        return res;
+    }
+    *out_copy = copy;
+    *meta += copied;
+    return SUCCESS;
+}
+
+static int ptr_clone(struct filesystem* fs, const struct inode* src, struct inode* dst,
+                     uint32_t* meta) {
+    memcpy(dst->direct, src->direct, sizeof(dst->direct));
+
+    int res = SUCCESS;
+    uint32_t depth;
+    for (depth = 1; depth <= PTR_DEPTHS; depth++) {
+        uint32_t root = tree_root(src, depth), copy = 0;
+        if (root != 0 && (res = copy_tree(fs, root, depth, root, &copy, meta)) != SUCCESS)
+            break;
+        set_tree_root(dst, depth, copy);
+    }
+    if (res == SUCCESS)
+        return SUCCESS;
+
+    while (--depth >= 1)
+        if (tree_root(dst, depth) != 0)
+            free_ptr_blocks(fs, tree_root(dst, depth), depth);
+    *meta = 0;
+    return res;
+}
+
+static int ext_clone(struct filesystem* fs, const struct inode* src, struct inode* dst,
+                     uint32_t* meta) {
+    memcpy(dst->direct, src->direct, sizeof(dst->direct));
+    if (src->indirect == 0)
+        return SUCCESS;
+
+    uint32_t copy;
+    int res = alloc_meta_block(fs, src->indirect, &copy);
+    if (res != SUCCESS)
+        return res;
+
+    const void* from;
+    void* to;
+    if (disk_borrow_blocks(fs->disk, src->indirect, 1, &from) != DISK_SUCCESS) {
+        block_free_run(fs, copy, 1);
+        return ERROR_IO;
+    }
+    if (disk_borrow_blocks_mut(fs->disk, copy, 1, &to) != DISK_SUCCESS) {
+        disk_release_blocks(fs->disk, src->indirect, 1, false);
+        block_free_run(fs, copy, 1);
+        return ERROR_IO;
+    }
+    memcpy(to, from, fs_block_size(fs));
+    disk_release_blocks(fs->disk, src->indirect, 1, false);
+    disk_release_blocks(fs->disk, copy, 1, true);
+    journal_add(fs->journal, copy, 1);
+
+    dst->indirect = copy;
+    *meta = 1;
+    return SUCCESS;
+}
+
+// --- block walk ---
+
+// reports the blocks below pointer block `block` (depth 1 = leaf), then
+// the block itself; bad pointers are reported but not followed
+static int walk_tree(struct filesystem* fs, uint32_t block, uint32_t depth,
+                     bmap_block_fn fn, void* arg) {
+    if (block < fs->sb.total_blocks) {
+        const void* ptr;
+        if (disk_borrow_blocks(fs->disk, block, 1, &ptr) != DISK_SUCCESS)
+            return ERROR_IO;
+        const uint32_t* ptrs = (const uint32_t*)ptr;
+
+        int res = 0;
+        uint32_t n = ptrs_per_block(fs);
+        uint32_t run_start = 0, run_len = 0;
+        for (uint32_t i = 0; i < n && res == 0; i++) {
+            if (ptrs[i] == 0) continue;
+            if (depth > 1) {
+                res = walk_tree(fs, ptrs[i], depth - 1, fn, arg);
+                continue;
+            }
+            // leaf entries: physically contiguous neighbours make one run
+            if (run_len > 0 && ptrs[i] == run_start + run_len) {
+                run_len++;
+                continue;
+            }
+            if (run_len > 0)
+                res = fn(run_start, run_len, false, arg);
+            run_start = ptrs[i];
+            run_len = 1;
+        }
+        if (res == 0 && run_len > 0)
+            res = fn(run_start, run_len, false, arg);
+
+        disk_release_blocks(fs->disk, block, 1, false);
+        if (res != 0)
+            return res;
+    }
+    return fn(block, 1, true, arg);
+}
+
+static int ptr_for_each(struct filesystem* fs, const struct inode* inode,
+                        bmap_block_fn fn, void* arg) {
+    int res = 0;
+    for (uint32_t j = 0; j < BMAP_DIRECT_BLOCKS && res == 0; j++)
+        if (inode->direct[j] != 0)
+            res = fn(inode->direct[j], 1, false, arg);
+
+    for (uint32_t depth = 1; depth <= PTR_DEPTHS && res == 0; depth++)
+        if (tree_root(inode, depth) != 0)
+            res = walk_tree(fs, tree_root(inode, depth), depth, fn, arg);
+    return res;
+}
+
+static int ext_for_each(struct filesystem* fs, const struct inode* inode,
+                        bmap_block_fn fn, void* arg) {
+    struct extent ext[BMAP_MAX_EXTENTS];
+    uint32_t n = 0;
+    int res;
+    if (inode->indirect != 0 && inode->indirect >= fs->sb.total_blocks) {
+        // only the in-inode records can be trusted
+        struct inode copy = *inode;
+        copy.indirect = 0;
+        res = extents_load(fs, &copy, ext, &n);
+    } else {
+        res = extents_load(fs, inode, ext, &n);
+    }
+    if (res != SUCCESS)
+        return res;
+
+    res = 0;
+    for (uint32_t i = 0; i < n && res == 0; i++)
+        res = fn(ext[i].physical, ext[i].length, false, arg);
+    if (res == 0 && inode->indirect != 0)
+        res = fn(inode->indirect, 1, true, arg);
+    return res;
+}
+
+// === PUBLIC FUNCTIONS ===
+
+void bmap_cursor_init(struct bmap_cursor* cur) {
+    if (!cur)
+        return;
+    cur->leaf_valid = false;
+    cur->leaf_dirty = false;
+    cur->leaf_ptrs = NULL;
+    cur->ext_valid = false;
+}
+
+void bmap_cursor_release(struct filesystem* fs, struct bmap_cursor* cur) {
+    if (!fs || !cur)
+        return;
+    leaf_release(fs, cur);
+    cur->ext_valid = false;
+}
+
+uint32_t bmap_capacity(const struct filesystem* fs, const struct inode* inode) {
+    if (inode && bmap_is_inline(inode))
+        return 0;
+
+    // any 32-bit file size
+    uint64_t file_blocks = ((uint64_t)UINT32_MAX + 1) >> fs_block_shift(fs);
+    if (inode && uses_extents(inode))
+        return (uint32_t)file_blocks;
+    return (uint32_t)MIN(tree_start(fs, PTR_DEPTHS) + tree_span(fs, PTR_DEPTHS), file_blocks);
+}
+
+int bmap_lookup(struct filesystem* fs, const struct inode* inode, struct bmap_cursor* cursor,
+                uint32_t idx, uint32_t max, uint32_t* out_phys, uint32_t* out_run) {
+    if (!fs || !inode || !out_phys || !out_run)
+        return ERROR_INVALID;
+
+    uint32_t cap = bmap_capacity(fs, inode);
+    if (idx >= cap)
+        return ERROR_NO_SPACE;
+
+    struct bmap_cursor local;
+    struct bmap_cursor* cur = cursor ? cursor : &local;
+    if (!cursor)
+        bmap_cursor_init(&local);
+
+    uint32_t limit = MIN(MAX(max, 1u), cap - idx);
+    int res = uses_extents(inode)
+        ? ext_lookup(fs, inode, cur, idx, limit, out_phys, out_run)
+        : ptr_lookup(fs, inode, cur, idx, limit, out_phys, out_run);
+
+    if (!cursor)
+        bmap_cursor_release(fs, &local);
+    return res;
+}
+
+int bmap_map(struct filesystem* fs, struct inode* inode, struct bmap_cursor* cursor,
+             uint32_t idx, uint32_t phys, uint32_t count, uint32_t* out_meta_blocks) {
+    if (!fs || !inode || !out_meta_blocks || phys == 0 || count == 0)
+        return ERROR_INVALID;
+    if (idx >= bmap_capacity(fs, inode) || count > bmap_capacity(fs, inode) - idx)
+        return ERROR_NO_SPACE;
+
+    struct bmap_cursor local;
+    struct bmap_cursor* cur = cursor ? cursor : &local;
+    if (!cursor)
+        bmap_cursor_init(&local);
+
+    *out_meta_blocks = 0;
+    int res = uses_extents(inode)
+        ? ext_map(fs, inode, cur, idx, phys, count, out_meta_blocks)
+        : ptr_map(fs, inode, cur, idx, phys, count, out_meta_blocks);
+
+    if (!cursor)
+        bmap_cursor_release(fs, &local);
+    if (res != SUCCESS)
+        return res;
+
+    inode->blocks_used += count;
+    return SUCCESS;
+}
+
+int bmap_remap(struct filesystem* fs, struct inode* inode, struct bmap_cursor* cursor,
+               uint32_t idx, uint32_t phys, uint32_t count, uint32_t* out_meta_blocks) {
+    if (!fs || !inode || !out_meta_blocks || phys == 0 || count == 0)
+        return ERROR_INVALID;
+    if (idx >= bmap_capacity(fs, inode) || count > bmap_capacity(fs, inode) - idx)
+        return ERROR_NO_SPACE;
+
+    struct bmap_cursor local;
+    struct bmap_cursor* cur = cursor ? cursor : &local;
+    if (!cursor)
+        bmap_cursor_init(&local);
+
+    // a pointer entry is simply overwritten; the leaves on the way exist
+    *out_meta_blocks = 0;
+    int res = uses_extents(inode)
+        ? ext_remap(fs, inode, cur, idx, phys, count, out_meta_blocks)
+        : ptr_map(fs, inode, cur, idx, phys, count, out_meta_blocks);
+
+    if (!cursor)
+        bmap_cursor_release(fs, &local);
+    return res;
+}
+
+int bmap_clone(struct filesystem* fs, const struct inode* src, struct inode* dst,
+               uint32_t* out_meta_blocks) {
+    if (!fs || !src || !dst || !out_meta_blocks)
+        return ERROR_INVALID;
+
+    const uint32_t format = INODE_FLAG_EXTENTS | INODE_FLAG_INLINE_DATA | INODE_FLAG_COMPRESSED;
+    dst->flags = (dst->flags & ~format) | (src->flags & format);
+    *out_meta_blocks = 0;
+
+    if (bmap_is_inline(src)) {
+        uint8_t bytes[BMAP_INLINE_MAX];
+        bmap_inline_read(src, 0, bytes, BMAP_INLINE_MAX);
+        bmap_inline_write(dst, 0, bytes, BMAP_INLINE_MAX);
+        dst->blocks_used = 0;
+        return SUCCESS;
+    }
+
+    int res = uses_extents(src) ? ext_clone(fs, src, dst, out_meta_blocks)
+                                : ptr_clone(fs, src, dst, out_meta_blocks);
+    if (res != SUCCESS) {
+        memset(dst->direct, 0, sizeof(dst->direct));
+        dst->indirect = dst->double_indirect = dst->triple_indirect = 0;
+        dst->flags &= ~format;
+        return res;
+    }
+    dst->blocks_used = src->blocks_used;
+    return SUCCESS;
+}
+
+int bmap_punch(struct filesystem* fs, struct inode* inode, uint32_t idx, uint32_t count,
+               uint32_t* out_freed) {
+    if (!fs || !fs->block_bitmap || !inode)
+        return ERROR_INVALID;
+
+    uint32_t cap = bmap_capacity(fs, inode);
+    uint32_t end = (count > cap || idx > cap - count) ? cap : idx + count;
+
+    uint32_t freed = 0;
+    int res = SUCCESS;
+    if (idx < end) {
+        res = uses_extents(inode)
+            ? ext_punch(fs, inode, idx, end, &freed)
+            : ptr_punch(fs, inode, idx, end, &freed);
+    }
+
+    if (out_freed)
+        *out_freed = freed;
+    return res;
+}
+
+int bmap_truncate(struct filesystem* fs, struct inode* inode, uint32_t from,
+                  uint32_t* out_freed) {
+    return bmap_punch(fs, inode, from, UINT32_MAX, out_freed);
+}
+
+uint32_t bmap_goal(struct filesystem* fs, uint32_t inode_num, const struct inode* inode,
+                   struct bmap_cursor* cursor, uint32_t idx) {
+    if (!fs || !inode)
+        return 0;
+
+    struct bmap_cursor local;
+    struct bmap_cursor* cur = cursor ? cursor : &local;
+    if (!cursor)
+        bmap_cursor_init(&local);
+
+    uint32_t goal = 0;
+    if (!bmap_is_inline(inode))
+        goal = uses_extents(inode) ? ext_goal(fs, inode, cur, idx) : ptr_goal(fs, inode, cur, idx);
+
+    if (!cursor)
+        bmap_cursor_release(fs, &local);
+    return goal ? goal : block_group_goal(fs, inode_num);
+}
+
+int bmap_get_extents(struct filesystem* fs, const struct inode* inode,
+                     struct extent* out, uint32_t max, uint32_t* out_count) {
+    if (!fs || !inode || !out || !out_count || !uses_extents(inode) || bmap_is_inline(inode))
+        return ERROR_INVALID;
+
+    struct extent ext[BMAP_MAX_EXTENTS];
+    uint32_t n;
+    int res = extents_load(fs, inode, ext, &n);
+    if (res != SUCCESS)
+        return res;
+
+    uint32_t copied = MIN(n, max);
+    memcpy(out, ext, copied * sizeof(struct extent));
+    *out_count = n;
+    return SUCCESS;
+}
+
+int bmap_for_each_block(struct filesystem* fs, const struct inode* inode,
+                        bmap_block_fn fn, void* arg) {
+    if (!fs || !inode || !fn)
+        return ERROR_INVALID;
+    if (bmap_is_inline(inode))
+        return 0;
+    return uses_extents(inode) ? ext_for_each(fs, inode, fn, arg)
+                               : ptr_for_each(fs, inode, fn, arg);
+}
+
+// === INLINE DATA ===
+
+void bmap_inline_read(const struct inode* inode, uint32_t offset, void* buf, uint32_t len) {
+    if (!inode || !buf || offset > BMAP_INLINE_MAX || len > BMAP_INLINE_MAX - offset)
+        return;
+    inline_for_range(inode, offset, len, copy_out, buf);
+}
+
+void bmap_inline_write(struct inode* inode, uint32_t offset, const void* buf, uint32_t len) {
+    if (!inode || !buf || offset > BMAP_INLINE_MAX || len > BMAP_INLINE_MAX - offset)
+        return;
+    inline_for_range(inode, offset, len, copy_in, (void*)buf);
+}
+
+void bmap_inline_zero(struct inode* inode, uint32_t offset) {
+    if (!inode || offset >= BMAP_INLINE_MAX)
+        return;
+    inline_for_range(inode, offset, BMAP_INLINE_MAX - offset, zero_out, NULL);
+}
+
+void bmap_inline_detach(struct inode* inode, void* out) {
+    if (!inode || !out)
+        return;
+    bmap_inline_read(inode, 0, out, BMAP_INLINE_MAX);
+    bmap_inline_zero(inode, 0);
+    inode->flags &= ~INODE_FLAG_INLINE_DATA;
+    inode->blocks_used = 0;
+}
@@ -0,0 +1,180 @@
+#pragma once
+
+#include "common.h"
+
+/*
+ * Logical-to-physical block mapping of an inode.
+ *
+ * Two on-disk formats are supported, selected per inode by INODE_FLAG_EXTENTS:
+ *
+ *  - block pointers (default): direct[12], then single-, double- and
+ *    triple-indirect pointer trees of block_size / 4 entries per block
+ *    (about 1 GiB with 512-byte blocks, the whole 4 GiB file size from
+ *    4 KiB blocks on)
+ *  - extents: (logical, physical, length) records. The first
+ *    BMAP_INODE_EXTENTS live in the space of direct[]; `indirect` points to
+ *    an extent block holding up to BMAP_BLOCK_EXTENTS more, terminated by a
+ *    zero-length record. Records are sorted by logical start and adjacent
+ *    records are merged. The extent block bound does not grow with the
+ *    block size, so extent lists keep a fixed in-memory size.
+ *
+ * Every lookup answers with a run (a physically contiguous range, or a
+ * hole), so callers move data one run at a time instead of one block at
+ * a time.
+ *
+ * The mapping owns the inode's block fields and blocks_used, including the
+ * metadata blocks (pointer blocks / extent block) it allocates or frees; the
+ * superblock free-block counter is left to the caller (except for a punch
+ * that allocates more mapping blocks than it releases: it takes the
+ * difference itself).
+ *
+ * A third state, INODE_FLAG_INLINE_DATA, keeps the contents of a small
+ * regular file (at most BMAP_INLINE_MAX bytes) in the inode itself, in the
+ * space of the block fields and the reserved words; such an inode owns no
+ * blocks. It maps nothing: bmap_capacity() is 0, so lookups and maps fail
+ * with ERROR_NO_SPACE and punches free nothing. The bytes are moved with
+ * bmap_inline_read / bmap_inline_write, and bmap_inline_detach turns the
+ * inode into an empty mapped one (extents if INODE_FLAG_EXTENTS is set
+ * too) before it grows past the limit. Inline bytes past the file size are
+ * kept zero.
+ */
+
+struct filesystem;
+
+struct extent {
+    uint32_t logical;                 // first logical block
+    uint32_t physical;                // first physical block
+    uint32_t length;                  // blocks in the extent (0 = unused record)
+};
+
+#define BMAP_DIRECT_BLOCKS  12
+#define BMAP_INODE_EXTENTS  (BMAP_DIRECT_BLOCKS * sizeof(uint32_t) / sizeof(struct extent))
+#define BMAP_BLOCK_EXTENTS  (BLOCK_SIZE_MIN / sizeof(struct extent))
+#define BMAP_MAX_EXTENTS    (BMAP_INODE_EXTENTS + BMAP_BLOCK_EXTENTS)
+
+// direct[] and indirect, double_indirect and triple_indirect, reserved[]
+#define BMAP_INLINE_MAX     (BMAP_DIRECT_BLOCKS * sizeof(uint32_t) + 3 * sizeof(uint32_t) + \
+                             sizeof(((struct inode*)0)->reserved))
+
+/*
+ * Mapping state carried across the lookups of one read or write call, so
+ * that sequential access resolves each pointer block once per boundary
+ * crossing: the pointer-tree leaf last resolved (kept borrowed) or the
+ * loaded extent list. Functions taking a cursor accept NULL (one-shot).
+ * Release it when the call is done: dirty leaf entries are written back
+ * then. A cursor must not be held across a bmap_truncate() / bmap_punch()
+ * of the inode.
+ */
+struct bmap_cursor {
+    bool leaf_valid;                  // leaf_first/leaf_block describe a leaf
+    bool leaf_dirty;                  // leaf entries modified
+    uint32_t leaf_first;              // first logical block the leaf serves
+    uint32_t leaf_block;              // leaf block (0 = not allocated: all holes)
+    uint32_t* leaf_ptrs;              // borrowed entries (NULL when leaf_block == 0)
+
+    bool ext_valid;                   // ext[] holds the inode's extent list
+    uint32_t ext_count;
+    struct extent ext[BMAP_MAX_EXTENTS];
+};
+
+void bmap_cursor_init(struct bmap_cursor* cursor);
+void bmap_cursor_release(struct filesystem* fs, struct bmap_cursor* cursor);
+
+// number of logical blocks the inode's format can address
+uint32_t bmap_capacity(const struct filesystem* fs, const struct inode* inode);
+
+/*
+ * Maps logical block idx. *out_phys is the physical block (0 = hole) and
+ * *out_run the number of blocks, at most max, that continue the same way
+ * (physically contiguous, or still a hole).
+ * Returns ERROR_NO_SPACE when idx is beyond bmap_capacity().
+ */
+int bmap_lookup(struct filesystem* fs, const struct inode* inode, struct bmap_cursor* cursor,
+                uint32_t idx, uint32_t max, uint32_t* out_phys, uint32_t* out_run);
+
+/*
+ * Maps the hole [idx, idx + count) onto physical blocks [phys, phys + count).
+ * The data blocks are already allocated by the caller; mapping blocks needed
+ * on the way are allocated here and reported in *out_meta_blocks.
+ */
+int bmap_map(struct filesystem* fs, struct inode* inode, struct bmap_cursor* cursor,
+             uint32_t idx, uint32_t phys, uint32_t count, uint32_t* out_meta_blocks);
+
+/*
+ * Points the mapped blocks [idx, idx + count), one run from bmap_lookup(),
+ * at the allocated blocks [phys, phys + count) instead (copying a shared run
+ * on write). The old blocks are left to the caller and blocks_used only
+ * grows by the mapping blocks reported in *out_meta_blocks: splitting an
+ * extent may need the extent block, or fail with ERROR_NO_SPACE (nothing
+ * changed).
+ */
+int bmap_remap(struct filesystem* fs, struct inode* inode, struct bmap_cursor* cursor,
+               uint32_t idx, uint32_t phys, uint32_t count, uint32_t* out_meta_blocks);
+
+/*
+ * Gives the empty inode dst the mapping of src: the same data blocks, in
+ * the same format (compression included), with copies of src's mapping
+ * blocks (counted in *out_meta_blocks). Inline contents are copied. The data blocks become
+ * mapped twice; taking the extra references is left to the caller. On
+ * failure dst is left empty.
+ */
+int bmap_clone(struct filesystem* fs, const struct inode* src, struct inode* dst,
+               uint32_t* out_meta_blocks);
+
+/*
+ * Unmaps and frees every block at logical index >= from, plus the mapping
+ * blocks no longer needed. *out_freed receives the number of blocks released
+ * to the free pool: a shared block (see block_share_run) only loses a
+ * reference.
+ */
+int bmap_truncate(struct filesystem* fs, struct inode* inode, uint32_t from,
+                  uint32_t* out_freed);
+
+/*
+ * Unmaps and frees the blocks of [idx, idx + count), leaving a hole. Punching
+ * the middle of an extent splits it; ERROR_NO_SPACE (nothing changed) when
+ * the split does not fit. *out_freed is the net number of blocks released,
+ * as for bmap_truncate().
+ */
+int bmap_punch(struct filesystem* fs, struct inode* inode, uint32_t idx, uint32_t count,
+               uint32_t* out_freed);
+
+// physical block a new block at logical index idx should ideally go to (0 = none);
+// a file without blocks nearby starts in its inode's block group (inode_num
+// INVALID_INODE_NUM: unknown)
+uint32_t bmap_goal(struct filesystem* fs, uint32_t inode_num, const struct inode* inode,
+                   struct bmap_cursor* cursor, uint32_t idx);
+
+// copies the extent records of an extent-mapped inode (for stat / debugging)
+int bmap_get_extents(struct filesystem* fs, const struct inode* inode,
+                     struct extent* out, uint32_t max, uint32_t* out_count);
+
+/*
+ * Calls fn for every run of physical blocks the inode owns: its data
+ * blocks, then the mapping blocks (pointer blocks / extent block) with
+ * `meta` set. Block numbers are reported as stored, even past the end of
+ * the disk (such pointers are not followed), so a checker sees corrupt
+ * mappings too. Stops at the first nonzero return of fn and returns it.
+ */
+typedef int (*bmap_block_fn)(uint32_t start, uint32_t count, bool meta, void* arg);
+
+int bmap_for_each_block(struct filesystem* fs, const struct inode* inode,
+                        bmap_block_fn fn, void* arg);
+
+// === INLINE DATA ===
+
+static inline bool bmap_is_inline(const struct inode* inode) {
+    return (inode->flags & INODE_FLAG_INLINE_DATA) != 0;
+}
+
+// copies len bytes at offset out of / into the inline area (offset + len
+// at most BMAP_INLINE_MAX)
+void bmap_inline_read(const struct inode* inode, uint32_t offset, void* buf, uint32_t len);
+void bmap_inline_write(struct inode* inode, uint32_t offset, const void* buf, uint32_t len);
+
+// zeroes the inline bytes from offset on (shrinking an inline file)
+void bmap_inline_zero(struct inode* inode, uint32_t offset);
+
+// copies the inline area to out (BMAP_INLINE_MAX bytes), then clears it
+// and the flag: the inode is left mapped, without blocks
+void bmap_inline_detach(struct inode* inode, void* out);
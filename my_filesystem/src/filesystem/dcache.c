@@ -0,0 +1,206 @@
+#include "dcache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// === PRIVATE FUNCTIONS ===
+
+static uint32_t hash_of(uint32_t parent, const char* name) {
+    // FNV-1a over the name, seeded with the parent inode
+    uint32_t h = 2166136261u ^ (parent * 2654435761u);
+    for (const unsigned char* p = (const unsigned char*)name; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static inline uint32_t bucket_of(uint32_t hash) {
+    return hash & (DCACHE_BUCKETS - 1);
+}
+
+// detaches an entry from the LRU list
+static void lru_unlink(struct dcache* c, struct dcache_entry* e) {
+    if (e->lru_prev) e->lru_prev->lru_next = e->lru_next;
+    else c->lru_head = e->lru_next;
+
+    if (e->lru_next) e->lru_next->lru_prev = e->lru_prev;
+    else c->lru_tail = e->lru_prev;
+
+    e->lru_prev = e->lru_next = NULL;
+}
+
+// inserts an entry as most recently used
+static void lru_push_front(struct dcache* c, struct dcache_entry* e) {
+    e->lru_prev = NULL;
+    e->lru_next = c->lru_head;
+    if (c->lru_head) c->lru_head->lru_prev = e;
+    c->lru_head = e;
+    if (!c->lru_tail) c->lru_tail = e;
+}
+
+// inserts an entry as the next one to recycle
+static void lru_push_back(struct dcache* c, struct dcache_entry* e) {
+    e->lru_next = NULL;
+    e->lru_prev = c->lru_tail;
+    if (c->lru_tail) c->lru_tail->lru_next = e;
+    c->lru_tail = e;
+    if (!c->lru_head) c->lru_head = e;
+}
+
+static void hash_remove(struct dcache* c, struct dcache_entry* e) {
+    struct dcache_entry** link = &c->buckets[bucket_of(e->hash)];
+    while (*link) {
+        if (*link == e) {
+            *link = e->hash_next;
+            break;
+        }
+        link = &(*link)->hash_next;
+    }
+    e->hash_next = NULL;
+}
+
+static struct dcache_entry* hash_lookup(struct dcache* c, uint32_t hash,
+                                        uint32_t parent, const char* name) {
+    struct dcache_entry* e = c->buckets[bucket_of(hash)];
+    while (e) {
+        if (e->hash == hash && e->parent == parent && strcmp(e->name, name) == 0)
+            return e;
+        e = e->hash_next;
+    }
+    return NULL;
+}
+
+// empties a slot and makes it the first one to be recycled
+static void entry_drop(struct dcache* c, struct dcache_entry* e) {
+    hash_remove(c, e);
+    e->valid = false;
+    lru_unlink(c, e);
+    lru_push_back(c, e);
+}
+
+// === CREATION AND CLEANUP ===
+
+struct dcache* dcache_create(void) {
+    struct dcache* c = calloc(1, sizeof(struct dcache));
+    if (!c)
+        return NULL;
+
+    // every slot starts on the LRU list as a free (invalid) slot
+    for (int i = 0; i < DCACHE_CAPACITY; i++)
+        lru_push_front(c, &c->entries[i]);
+
+    pthread_mutex_init(&c->lock, NULL);
+    return c;
+}
+
+void dcache_destroy(struct dcache** cache) {
+    if (!cache || !(*cache))
+        return;
+
+    pthread_mutex_destroy(&(*cache)->lock);
+    free(*cache);
+    *cache = NULL;
+}
+
+// === LOOKUP AND UPDATE ===
+
+bool dcache_lookup(struct dcache* c, uint32_t parent, const char* name,
+                   uint32_t* out_inode_num) {
+    if (!c || !name || !out_inode_num)
+        return false;
+
+    pthread_mutex_lock(&c->lock);
+    struct dcache_entry* e = hash_lookup(c, hash_of(parent, name), parent, name);
+    if (!e) {
+        c->misses++;
+        pthread_mutex_unlock(&c->lock);
+        return false;
+    }
+
+    c->hits++;
+    if (e->inode_num == 0)
+        c->negative_hits++;
+    lru_unlink(c, e);
+    lru_push_front(c, e);
+
+    *out_inode_num = e->inode_num;
+    pthread_mutex_unlock(&c->lock);
+    return true;
+}
+
+void dcache_insert(struct dcache* c, uint32_t parent, const char* name, uint32_t inode_num) {
+    if (!c || !name || strlen(name) >= MAX_FILENAME)
+        return;
+
+    uint32_t hash = hash_of(parent, name);
+    pthread_mutex_lock(&c->lock);
+    struct dcache_entry* e = hash_lookup(c, hash, parent, name);
+    if (!e) {
+        // recycle the least recently used slot
+        e = c->lru_tail;
+        if (e->valid)
+            hash_remove(c, e);
+
+        e->parent = parent;
+        e->hash = hash;
+        e->valid = true;
+        strcpy(e->name, name);
+
+        uint32_t b = bucket_of(hash);
+        e->hash_next = c->buckets[b];
+        c->buckets[b] = e;
+    }
+
+    e->inode_num = inode_num;
+    lru_unlink(c, e);
+    lru_push_front(c, e);
+    pthread_mutex_unlock(&c->lock);
+}
+
+void dcache_invalidate(struct dcache* c, uint32_t parent, const char* name) {
+    if (!c || !name)
+        return;
+
+    pthread_mutex_lock(&c->lock);
+    struct dcache_entry* e = hash_lookup(c, hash_of(parent, name), parent, name);
+    if (e)
+        entry_drop(c, e);
+    pthread_mutex_unlock(&c->lock);
+}
+
+void dcache_invalidate_dir(struct dcache* c, uint32_t dir) {
+    if (!c)
+        return;
+
+    pthread_mutex_lock(&c->lock);
+    for (int i = 0; i < DCACHE_CAPACITY; i++) {
+        struct dcache_entry* e = &c->entries[i];
+        if (e->valid && e->parent == dir)
+            entry_drop(c, e);
+    }
+    pthread_mutex_unlock(&c->lock);
+}
+
+// === UTILITIES ===
+
+void dcache_print_stats(const struct dcache* cache) {
+    if (!cache) {
+        printf("Dentry cache: disabled\n");
+        return;
+    }
+
+    uint32_t used = 0, negative = 0;
+    for (int i = 0; i < DCACHE_CAPACITY; i++) {
+        const struct dcache_entry* e = &cache->entries[i];
+        if (!e->valid) continue;
+        used++;
+        if (e->inode_num == 0) negative++;
+    }
+
+    printf("Dentry cache:\n");
+    printf("  Names cached   : %u / %d (%u negative)\n", used, DCACHE_CAPACITY, negative);
+    printf("  Hits / misses  : %llu / %llu (%llu negative hits)\n",
+           (unsigned long long)cache->hits, (unsigned long long)cache->misses,
+           (unsigned long long)cache->negative_hits);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "common.h"
+#include <pthread.h>
+
+/*
+ * Dentry cache for path resolution.
+ *
+ * Maps (parent directory inode, name) to the inode the name resolves to, so
+ * that repeated lookups of the same path components cost no directory block
+ * reads. Misses are cached too, as negative entries (inode 0), so probing a
+ * name that does not exist is just as cheap. A fixed number of slots is
+ * recycled in LRU order.
+ *
+ * The cache never goes stale on its own: dentry_add() and dentry_remove()
+ * drop the entry of the name they change, and removing a directory drops
+ * every entry below it (its inode number may be reused).
+ *
+ * Lookups reorder the LRU list, so every call takes the cache lock.
+ */
+
+#define DCACHE_CAPACITY 256    // number of cached names
+#define DCACHE_BUCKETS  512    // hash buckets (power of two)
+
+struct dcache_entry {
+    uint32_t parent;                  // directory the name lives in
+    uint32_t inode_num;               // what it resolves to (0 = negative entry)
+    uint32_t hash;                    // of (parent, name)
+    bool valid;                       // slot holds a name
+    char name[MAX_FILENAME];
+    struct dcache_entry* hash_next;   // bucket chain
+    struct dcache_entry* lru_prev;    // towards most recently used
+    struct dcache_entry* lru_next;    // towards least recently used
+};
+
+struct dcache {
+    struct dcache_entry entries[DCACHE_CAPACITY];
+    struct dcache_entry* buckets[DCACHE_BUCKETS];
+    struct dcache_entry* lru_head;    // most recently used
+    struct dcache_entry* lru_tail;    // least recently used
+    pthread_mutex_t lock;
+
+    // statistics
+    uint64_t hits;
+    uint64_t negative_hits;           // hits on negative entries (subset of hits)
+    uint64_t misses;
+};
+
+// creation and cleanup
+struct dcache* dcache_create(void);
+void dcache_destroy(struct dcache** cache);
+
+/*
+ * Looks (parent, name) up. Returns true on a hit, with *out_inode_num set
+ * to the cached inode (0 for a negative entry: the name does not exist).
+ * Every function accepts a NULL cache (always misses / does nothing).
+ */
+bool dcache_lookup(struct dcache* cache, uint32_t parent, const char* name,
+                   uint32_t* out_inode_num);
+
+// caches what (parent, name) resolves to (inode_num 0 = does not exist)
+void dcache_insert(struct dcache* cache, uint32_t parent, const char* name, uint32_t inode_num);
+
+// drops the entry of one name
+void dcache_invalidate(struct dcache* cache, uint32_t parent, const char* name);
+
+// drops every entry whose parent is dir
+void dcache_invalidate_dir(struct dcache* cache, uint32_t dir);
+
+// utilities
+void dcache_print_stats(const struct dcache* cache);
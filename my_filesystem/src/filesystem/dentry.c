@@ -1,107 +1,392 @@
 #include "dentry.h"
+#include "dir_index.h"
 #include "inode.h"
+#include "fs.h"
+#include "fs_internal.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
 // === PRIVATE FUNCTIONS ===
 
-// helper: scans a single data block for a matching dentry
-static int scan_dentry_block(disk_t disk, uint32_t block_num, const char* name, 
-                             struct dentry* out_dentry, uint32_t* out_index, 
-                             uint32_t* global_index) {
-    if (block_num == 0)
-        return ERROR_NOT_FOUND;
+// --- single dentry block ---
 
-    char buffer[BLOCK_SIZE];
-    if (disk_read_block(disk, block_num, buffer) != DISK_SUCCESS)
-        return ERROR_IO;
+/*
+ * Two on-disk layouts, chosen at format time:
+ *  - fixed: block_size / DENTRY_SIZE struct dentry slots (inode_num 0 = free)
+ *  - rec_len (FS_FEATURE_REC_LEN): struct dentry_rec records chained by
+ *    rec_len and covering the whole block. An entry is added by splitting
+ *    the slack off a record; a removed record is merged into the previous
+ *    one, so the free space of a block never fragments.
+ * In both, an entry is addressed by its byte offset ("pos") in the block.
+ */
 
-    struct dentry* entries = (struct dentry*)buffer;
-    for (uint32_t j = 0; j < DENTRIES_PER_BLOCK; j++) {
-        if (entries[j].inode_num != 0 && strcmp(entries[j].name, name) == 0) {
-            if (out_dentry) *out_dentry = entries[j];
-            if (out_index) *out_index = *global_index;
-            return SUCCESS;
+static inline bool uses_rec_len(const struct filesystem* fs) {
+    return (fs->sb.features & FS_FEATURE_REC_LEN) != 0;
+}
+
+static inline struct dentry_rec* rec_at(const void* blk, uint32_t pos) {
+    return (struct dentry_rec*)((char*)blk + pos);
+}
+
+// guards the record walk against a corrupted chain
+static inline bool rec_valid(const struct dentry_rec* r, uint32_t pos, uint32_t bs) {
+    return r->rec_len >= DENTRY_REC_HEADER && (r->rec_len & 3) == 0 &&
+           r->rec_len <= bs - pos &&
+           DENTRY_REC_LEN(r->inode_num ? r->name_len : 0) <= r->rec_len;
+}
+
+static void rec_to_dentry(const struct dentry_rec* r, struct dentry* out) {
+    memset(out, 0, sizeof(*out));
+    out->inode_num = r->inode_num;
+    out->file_type = r->file_type;
+    out->name_len = r->name_len;
+    memcpy(out->name, r->name, r->name_len);
+}
+
+// an unused block: all slots free / one free record spanning it
+static void block_init(const struct filesystem* fs, void* blk) {
+    uint32_t bs = fs_block_size(fs);
+    memset(blk, 0, bs);
+    if (uses_rec_len(fs))
+        rec_at(blk, 0)->rec_len = bs;
+}
+
+/*
+ * Reads the next live entry at or after *pos into out (when not NULL) and
+ * sets *pos to it. Returns false when the block has no more entries; pass
+ * *pos + 1 to continue after an entry.
+ */
+static bool block_next(const struct filesystem* fs, const void* blk, uint32_t* pos,
+                       struct dentry* out) {
+    uint32_t bs = fs_block_size(fs);
+    if (!uses_rec_len(fs)) {
+        const struct dentry* entries = (const struct dentry*)blk;
+        for (uint32_t j = (*pos + DENTRY_SIZE - 1) / DENTRY_SIZE; j < bs / DENTRY_SIZE; j++) {
+            if (entries[j].inode_num != 0) {
+                if (out) *out = entries[j];
+                *pos = j * DENTRY_SIZE;
+                return true;
+            }
         }
-        (*global_index)++;
+        return false;
     }
 
-    return ERROR_NOT_FOUND;
+    for (uint32_t off = 0; off < bs; ) {
+        const struct dentry_rec* r = rec_at(blk, off);
+        if (!rec_valid(r, off, bs))
+            return false;
+        if (off >= *pos && r->inode_num != 0) {
+            if (out) rec_to_dentry(r, out);
+            *pos = off;
+            return true;
+        }
+        off += r->rec_len;
+    }
+    return false;
 }
 
-// helper: removes a dentry from a single block if found
-static int remove_dentry_from_block(disk_t disk, uint32_t block_num, 
-                                    const char* name, bool* found) {
-    if (block_num == 0)
-        return ERROR_INVALID;
-    
-    char buffer[BLOCK_SIZE];
-    if (disk_read_block(disk, block_num, buffer) != DISK_SUCCESS)
-        return ERROR_IO;
-    
-    struct dentry* entries = (struct dentry*)buffer;
-    for (uint32_t j = 0; j < DENTRIES_PER_BLOCK; j++) {
-        if (entries[j].inode_num != 0 && strcmp(entries[j].name, name) == 0) {
-            *found = true;
-            // found - mark as free
-            memset(&entries[j], 0, sizeof(struct dentry));
-            
-            if (disk_write_block(disk, block_num, buffer) != DISK_SUCCESS)
-                return ERROR_IO;
-            
-            return SUCCESS;
+// position of the len-byte `name` in the block, or -1; both layouts compare
+// the stored length first and the bytes in place
+static int block_find(const struct filesystem* fs, const void* blk, const char* name,
+                      size_t len, struct dentry* out) {
+    uint32_t bs = fs_block_size(fs);
+    if (len == 0 || len >= MAX_FILENAME)
+        return -1;
+
+    if (!uses_rec_len(fs)) {
+        const struct dentry* entries = (const struct dentry*)blk;
+        for (uint32_t j = 0; j < bs / DENTRY_SIZE; j++) {
+            if (entries[j].inode_num != 0 && entries[j].name_len == len &&
+                memcmp(entries[j].name, name, len) == 0) {
+                if (out) *out = entries[j];
+                return (int)(j * DENTRY_SIZE);
+            }
         }
+        return -1;
     }
-    
-    *found = false;
-    return SUCCESS;
+
+    for (uint32_t off = 0; off < bs; ) {
+        const struct dentry_rec* r = rec_at(blk, off);
+        if (!rec_valid(r, off, bs))
+            break;
+        if (r->inode_num != 0 && r->name_len == len && memcmp(r->name, name, len) == 0) {
+            if (out) rec_to_dentry(r, out);
+            return (int)off;
+        }
+        off += r->rec_len;
+    }
+    return -1;
 }
 
-// helper: counts valid dentries in a single block
-static int count_dentries_in_block(disk_t disk, uint32_t block_num, uint32_t* count) {
-    if (block_num == 0) {
-        *count = 0;
-        return SUCCESS;
+// slides the live records to the front of the block, leaving all the free
+// space in the last record
+static void rec_compact(void* blk, uint32_t bs) {
+    uint32_t dst = 0;
+    uint32_t last = bs;
+    for (uint32_t off = 0; off < bs; ) {
+        struct dentry_rec* r = rec_at(blk, off);
+        if (!rec_valid(r, off, bs))
+            break;
+        uint32_t next = off + r->rec_len;
+        if (r->inode_num != 0) {
+            uint32_t used = DENTRY_REC_LEN(r->name_len);
+            memmove(rec_at(blk, dst), r, used);
+            rec_at(blk, dst)->rec_len = used;
+            last = dst;
+            dst += used;
+        }
+        off = next;
     }
-    
-    char buffer[BLOCK_SIZE];
-    if (disk_read_block(disk, block_num, buffer) != DISK_SUCCESS)
-        return ERROR_IO;
-    
-    struct dentry* entries = (struct dentry*)buffer;
-    uint32_t local_count = 0;
-    
-    for (uint32_t j = 0; j < DENTRIES_PER_BLOCK; j++) {
-        if (entries[j].inode_num != 0)
-            local_count++;
+
+    if (last == bs) {
+        memset(blk, 0, bs);
+        rec_at(blk, 0)->rec_len = bs;
+    } else {
+        rec_at(blk, last)->rec_len += bs - dst;
     }
-    
-    *count = local_count;
-    return SUCCESS;
 }
 
-// helper: fills array with dentries from a single block
-static int fill_dentries_from_block(disk_t disk, uint32_t block_num, 
-                                    struct dentry* array, uint32_t* idx) {
-    if (block_num == 0)
-        return SUCCESS;
-    
-    char buffer[BLOCK_SIZE];
-    if (disk_read_block(disk, block_num, buffer) != DISK_SUCCESS)
+// stores d in the first place with room for it; false when the block is full
+static bool block_insert(const struct filesystem* fs, void* blk, const struct dentry* d) {
+    uint32_t bs = fs_block_size(fs);
+    if (!uses_rec_len(fs)) {
+        struct dentry* entries = (struct dentry*)blk;
+        for (uint32_t j = 0; j < bs / DENTRY_SIZE; j++) {
+            if (entries[j].inode_num == 0) {
+                entries[j] = *d;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint32_t needed = DENTRY_REC_LEN(d->name_len);
+    uint32_t slack = 0;
+    for (uint32_t off = 0; off < bs; ) {
+        struct dentry_rec* r = rec_at(blk, off);
+        if (!rec_valid(r, off, bs))
+            return false;
+
+        uint32_t used = r->inode_num ? DENTRY_REC_LEN(r->name_len) : 0;
+        slack += r->rec_len - used;
+        if (r->rec_len - used >= needed) {
+            if (used > 0) {
+                // split the slack off the live record
+                struct dentry_rec* n = rec_at(blk, off + used);
+                n->rec_len = r->rec_len - used;
+                r->rec_len = used;
+                r = n;
+            }
+            r->inode_num = d->inode_num;
+            r->file_type = d->file_type;
+            r->name_len = d->name_len;
+            memcpy(r->name, d->name, d->name_len);
+            return true;
+        }
+        off += r->rec_len;
+    }
+
+    // enough room in total but no single gap: compact, then use the tail
+    if (slack < needed)
+        return false;
+    rec_compact(blk, bs);
+    return block_insert(fs, blk, d);
+}
+
+// removes the entry at pos (as returned by block_find)
+static void block_remove(const struct filesystem* fs, void* blk, uint32_t pos) {
+    uint32_t bs = fs_block_size(fs);
+    if (!uses_rec_len(fs)) {
+        memset(rec_at(blk, pos), 0, sizeof(struct dentry));
+        return;
+    }
+
+    // merge into the previous record; the first one just becomes unused
+    uint32_t prev = 0;
+    for (uint32_t off = 0; off < pos; ) {
+        const struct dentry_rec* r = rec_at(blk, off);
+        if (!rec_valid(r, off, bs))
+            return;
+        prev = off;
+        off += r->rec_len;
+    }
+
+    struct dentry_rec* r = rec_at(blk, pos);
+    if (pos == 0) {
+        r->inode_num = 0;
+    } else {
+        rec_at(blk, prev)->rec_len += r->rec_len;
+    }
+}
+
+static bool block_is_empty(const struct filesystem* fs, const void* blk) {
+    uint32_t pos = 0;
+    return !block_next(fs, blk, &pos, NULL);
+}
+
+static uint32_t block_count(const struct filesystem* fs, const void* blk) {
+    uint32_t count = 0;
+    for (uint32_t pos = 0; block_next(fs, blk, &pos, NULL); pos++)
+        count++;
+    return count;
+}
+
+// --- directory walk ---
+
+/*
+ * Advances *idx to the next mapped dentry block at or after it (holes left
+ * by dentry_remove are skipped a run at a time). Returns ERROR_NOT_FOUND past
+ * the last one.
+ */
+static int next_dir_block(struct filesystem* fs, const struct inode* dir,
+                          struct bmap_cursor* cur, uint32_t* idx, uint32_t* out_phys) {
+    while (*idx < DIR_MAX_BLOCKS) {
+        uint32_t phys, run;
+        int res = bmap_lookup(fs, dir, cur, *idx, DIR_MAX_BLOCKS - *idx, &phys, &run);
+        if (res != SUCCESS)
+            return res;
+        if (phys != 0) {
+            *out_phys = phys;
+            return SUCCESS;
+        }
+        *idx += run;
+    }
+    return ERROR_NOT_FOUND;
+}
+
+// looks `name` up in dentry block `idx` (a hole or unknown block just misses)
+static int search_block(struct filesystem* fs, const struct inode* dir, struct bmap_cursor* cur,
+                        uint32_t idx, const char* name, size_t len, struct dentry* out_dentry,
+                        uint32_t* out_pos) {
+    uint32_t phys, run;
+    if (idx >= DIR_MAX_BLOCKS)
+        return ERROR_NOT_FOUND;
+    int res = bmap_lookup(fs, dir, cur, idx, 1, &phys, &run);
+    if (res != SUCCESS)
+        return res;
+    if (phys == 0)
+        return ERROR_NOT_FOUND;
+
+    const void* ptr;
+    if (disk_borrow_blocks(fs->disk, phys, 1, &ptr) != DISK_SUCCESS)
         return ERROR_IO;
-    
-    struct dentry* entries = (struct dentry*)buffer;
-    
-    for (uint32_t j = 0; j < DENTRIES_PER_BLOCK; j++) {
-        if (entries[j].inode_num != 0) {
-            array[(*idx)++] = entries[j];
+    PERF_ADD(PERF_DENTRY_BLOCKS_SCANNED, 1);
+
+    int pos = block_find(fs, ptr, name, len, out_dentry);
+    if (pos >= 0 && out_pos)
+        *out_pos = (uint32_t)pos;
+
+    disk_release_blocks(fs->disk, phys, 1, false);
+    return (pos >= 0) ? SUCCESS : ERROR_NOT_FOUND;
+}
+
+/*
+ * Finds the dentry block of `name` and its position in it: through the hash index when the
+ * directory has one (only blocks with a matching hash are read), otherwise
+ * by scanning every dentry block.
+ */
+static int dir_lookup(struct filesystem* fs, const struct inode* dir, const char* name,
+                      struct dentry* out_dentry, uint32_t* out_block, uint32_t* out_pos) {
+    struct bmap_cursor cur;
+    bmap_cursor_init(&cur);
+    size_t len = strlen(name);
+    int res;
+
+    if (dir_index_enabled(dir)) {
+        struct dir_index_probe probe;
+        dir_index_probe_init(&probe, dir_index_hash(name));
+
+        uint32_t idx;
+        while ((res = dir_index_probe_next(fs, dir, &probe, &idx)) == SUCCESS) {
+            res = search_block(fs, dir, &cur, idx, name, len, out_dentry, out_pos);
+            if (res != ERROR_NOT_FOUND) {
+                if (res == SUCCESS && out_block) *out_block = idx;
+                break;
+            }
+        }
+    } else {
+        uint32_t idx = 0, phys;
+        while ((res = next_dir_block(fs, dir, &cur, &idx, &phys)) == SUCCESS) {
+            res = search_block(fs, dir, &cur, idx, name, len, out_dentry, out_pos);
+            if (res != ERROR_NOT_FOUND) {
+                if (res == SUCCESS && out_block) *out_block = idx;
+                break;
+            }
+            idx++;
         }
     }
-    
+
+    bmap_cursor_release(fs, &cur);
+    return res;
+}
+
+// number of live entries in the directory
+static int count_entries(struct filesystem* fs, const struct inode* dir, uint32_t* out_count) {
+    struct bmap_cursor cur;
+    bmap_cursor_init(&cur);
+
+    uint32_t total = 0;
+    uint32_t idx = 0, phys;
+    int res;
+    while ((res = next_dir_block(fs, dir, &cur, &idx, &phys)) == SUCCESS) {
+        const void* ptr;
+        if (disk_borrow_blocks(fs->disk, phys, 1, &ptr) != DISK_SUCCESS) {
+            res = ERROR_IO;
+            break;
+        }
+        PERF_ADD(PERF_DENTRY_BLOCKS_SCANNED, 1);
+        total += block_count(fs, ptr);
+        disk_release_blocks(fs->disk, phys, 1, false);
+        idx++;
+    }
+
+    bmap_cursor_release(fs, &cur);
+    if (res != ERROR_NOT_FOUND)
+        return res;
+    *out_count = total;
     return SUCCESS;
 }
 
+/*
+ * (Re)builds the hash index from the dentry blocks, sized for the current
+ * entries. Used when a directory first crosses DIR_INDEX_MIN_BLOCKS and when
+ * the table gets too loaded.
+ */
+static int index_rebuild(struct filesystem* fs, struct inode* dir, uint32_t* io_allocated) {
+    uint32_t entries;
+    int res = count_entries(fs, dir, &entries);
+    if (res != SUCCESS)
+        return res;
+
+    res = dir_index_build(fs, dir, entries, io_allocated);
+    if (res != SUCCESS)
+        return res;
+
+    struct bmap_cursor cur;
+    bmap_cursor_init(&cur);
+
+    uint32_t idx = 0, phys;
+    while ((res = next_dir_block(fs, dir, &cur, &idx, &phys)) == SUCCESS) {
+        const void* ptr;
+        if (disk_borrow_blocks(fs->disk, phys, 1, &ptr) != DISK_SUCCESS) {
+            res = ERROR_IO;
+            break;
+        }
+        PERF_ADD(PERF_DENTRY_BLOCKS_SCANNED, 1);
+        struct dentry e;
+        for (uint32_t pos = 0; res == SUCCESS && block_next(fs, ptr, &pos, &e); pos++)
+            res = dir_index_insert(fs, dir, dir_index_hash(e.name), idx);
+        disk_release_blocks(fs->disk, phys, 1, false);
+        if (res != SUCCESS)
+            break;
+        idx++;
+    }
+
+    bmap_cursor_release(fs, &cur);
+    return (res == ERROR_NOT_FOUND) ? SUCCESS : res;
+}
+
 // === PUBLIC FUNCTIONS ===
 
 bool dentry_is_valid(const struct dentry* dentry) {
@@ -181,65 +466,35 @@ int dentry_create(const char* name, uint32_t inode_num,
     return SUCCESS;
 }
 
-int dentry_find(disk_t disk, uint32_t dir_inode_num, 
+int dentry_find(struct filesystem* fs, uint32_t dir_inode_num, 
                 const char* name, struct dentry* out_dentry, 
                 uint32_t* out_index) {
-    if (!disk || !name) 
+    if (!fs || !name) 
         return ERROR_INVALID;
-    
+
     // read directory inode
     struct inode dir_inode;
-    if (inode_read(disk, dir_inode_num, &dir_inode) != SUCCESS) 
+    if (inode_read(fs, dir_inode_num, &dir_inode) != SUCCESS) 
         return ERROR_IO;
     
     // verify it's a directory
     if (dir_inode.type != INODE_TYPE_DIRECTORY) 
         return ERROR_INVALID;
     
-    uint32_t dentry_index = 0;
-    int result;
-    
-    // scan direct blocks
-    for (uint32_t i = 0; i < 12; i++) {
-        if (dir_inode.direct[i] == 0) continue;
-        result = scan_dentry_block(disk, dir_inode.direct[i], name, 
-                                   out_dentry, out_index, &dentry_index);
-        if (result == SUCCESS)
-            return SUCCESS;
-        if (result == ERROR_IO)
-            return ERROR_IO;
-    }
-    
-    // scan indirect block (if exists)
-    if (dir_inode.indirect != 0) {
-        char indirect_buffer[BLOCK_SIZE];
-        if (disk_read_block(disk, dir_inode.indirect, indirect_buffer) != DISK_SUCCESS)
-            return ERROR_IO;
-        
-        uint32_t* block_ptrs = (uint32_t*)indirect_buffer;
-        uint32_t max_ptrs = BLOCK_SIZE / sizeof(uint32_t);  // 128 pointers
-        
-        for (uint32_t i = 0; i < max_ptrs; i++) {
-            if (block_ptrs[i] == 0) continue;
-            result = scan_dentry_block(disk, block_ptrs[i], name, 
-                                       out_dentry, out_index, &dentry_index);
-            if (result == SUCCESS)
-                return SUCCESS;
-            if (result == ERROR_IO)
-                return ERROR_IO;
-        }
-    }
-    
-    return ERROR_NOT_FOUND;
+    uint32_t block, pos;
+    int result = dir_lookup(fs, &dir_inode, name, out_dentry, &block, &pos);
+    if (result == SUCCESS && out_index)
+        *out_index = block * fs_block_size(fs) + pos;
+    return result;
 }
 
-int dentry_add(disk_t disk, uint32_t dir_inode_num, 
+int dentry_add(struct filesystem* fs, uint32_t dir_inode_num, 
                const struct dentry* new_dentry,
-               struct bitmap* block_bitmap,
                uint32_t* out_blocks_allocated) {
-    if (!disk || !new_dentry || !block_bitmap) 
+    if (!fs || !new_dentry || !fs->block_bitmap) 
         return ERROR_INVALID;
 
+    uint32_t allocated = 0;
     if (out_blocks_allocated)
         *out_blocks_allocated = 0;
     
@@ -248,412 +503,257 @@ int dentry_add(disk_t disk, uint32_t dir_inode_num,
     
     // read directory inode
     struct inode dir_inode;
-    if (inode_read(disk, dir_inode_num, &dir_inode) != SUCCESS) 
+    if (inode_read(fs, dir_inode_num, &dir_inode) != SUCCESS) 
         return ERROR_IO;
     
     if (dir_inode.type != INODE_TYPE_DIRECTORY) 
         return ERROR_INVALID;
     
     // check if entry already exists
-    if (dentry_find(disk, dir_inode_num, new_dentry->name, NULL, NULL) == SUCCESS) 
+    if (dir_lookup(fs, &dir_inode, new_dentry->name, NULL, NULL, NULL) == SUCCESS) 
         return ERROR_EXISTS;
-    
-    // find first free slot (in existing direct blocks or allocate new one)
-    char buffer[BLOCK_SIZE];
-    
-    for (uint32_t i = 0; i < 12; i++) {
-        // if this slot has no block allocated yet
-        if (dir_inode.direct[i] == 0) {
-            // allocate a new block
-            int new_block = bitmap_find_first_free(block_bitmap);
-            if (new_block < 0)
-                return ERROR_NO_SPACE;  // disk full
-            
-            // mark block as used
-            if (bitmap_set(block_bitmap, new_block) != SUCCESS)
-                return ERROR_GENERIC;
 
-            if (out_blocks_allocated)
-                (*out_blocks_allocated)++;
-            
-            // update directory inode
-            dir_inode.direct[i] = new_block;
-            dir_inode.blocks_used++;
-            dir_inode.size += BLOCK_SIZE;
-            dir_inode.modified_time = time(NULL);
-            
-            // write updated inode to disk
-            if (inode_write(disk, dir_inode_num, &dir_inode) != SUCCESS) {
-                // rollback: free the block
-                bitmap_clear(block_bitmap, new_block);
-                if (out_blocks_allocated)
-                    (*out_blocks_allocated)--;
-                return ERROR_IO;
-            }
-            
-            // initialize new block (all zero = all dentry slots free)
-            memset(buffer, 0, BLOCK_SIZE);
-            struct dentry* entries = (struct dentry*)buffer;
-            
-            // put new dentry in first slot
-            entries[0] = *new_dentry;
-            
-            // write block to disk
-            if (disk_write_block(disk, new_block, buffer) != DISK_SUCCESS) {
-                // rollback: revert inode changes and free block
-                dir_inode.direct[i] = 0;
-                dir_inode.blocks_used--;
-                inode_write(disk, dir_inode_num, &dir_inode);
-                bitmap_clear(block_bitmap, new_block);
-                if (out_blocks_allocated)
-                    (*out_blocks_allocated)--;
-                return ERROR_IO;
-            }
-            
-            return SUCCESS;
-        }
-        
-        // block exists, check for free slot inside it
-        if (disk_read_block(disk, dir_inode.direct[i], buffer) != DISK_SUCCESS)
-            return ERROR_IO;
-        
-        struct dentry* entries = (struct dentry*)buffer;
-        for (uint32_t j = 0; j < DENTRIES_PER_BLOCK; j++) {
-            if (entries[j].inode_num == 0) {
-                // found free slot in existing block
-                entries[j] = *new_dentry;
-                
-                if (disk_write_block(disk, dir_inode.direct[i], buffer) != DISK_SUCCESS)
-                    return ERROR_IO;
-                
-                // update directory modification time
-                dir_inode.modified_time = time(NULL);
-                inode_write(disk, dir_inode_num, &dir_inode);
-                
-                return SUCCESS;
-            }
-        }
-    }
-    
-    // if all 12 direct blocks are full, try indirect block
-    if (dir_inode.indirect == 0) {
-        // allocate indirect block
-        int indirect_block = bitmap_find_first_free(block_bitmap);
-        if (indirect_block < 0)
-            return ERROR_NO_SPACE;
-        
-        if (bitmap_set(block_bitmap, indirect_block) != SUCCESS)
-            return ERROR_GENERIC;
-        
-        if (out_blocks_allocated)
-            (*out_blocks_allocated)++;
-        
-        dir_inode.indirect = indirect_block;
-        dir_inode.blocks_used++;
-        
-        if (inode_write(disk, dir_inode_num, &dir_inode) != SUCCESS) {
-            bitmap_clear(block_bitmap, indirect_block);
-            if (out_blocks_allocated)
-                (*out_blocks_allocated)--;
-            return ERROR_IO;
-        }
-        
-        // initialize indirect block (all zeros = no data blocks allocated)
-        char indirect_buffer[BLOCK_SIZE];
-        memset(indirect_buffer, 0, BLOCK_SIZE);
-        if (disk_write_block(disk, indirect_block, indirect_buffer) != DISK_SUCCESS) {
-            dir_inode.indirect = 0;
-            dir_inode.blocks_used--;
-            inode_write(disk, dir_inode_num, &dir_inode);
-            bitmap_clear(block_bitmap, indirect_block);
-            if (out_blocks_allocated)
-                (*out_blocks_allocated)--;
-            return ERROR_IO;
+    bool indexed = dir_index_enabled(&dir_inode);
+    int res = SUCCESS;
+
+    // first block with room: indexed directories remember where to start looking
+    uint32_t idx = 0;
+    if (indexed && dir_index_get_hint(fs, &dir_inode, &idx) != SUCCESS)
+        idx = 0;
+
+    struct bmap_cursor cur;
+    bmap_cursor_init(&cur);
+
+    bool placed = false;
+    while (!placed && idx < DIR_MAX_BLOCKS) {
+        uint32_t phys, run;
+        res = bmap_lookup(fs, &dir_inode, &cur, idx, 1, &phys, &run);
+        if (res != SUCCESS || phys == 0)
+            break;      // a hole (or the end): a new block goes here
+
+        void* ptr;
+        if (disk_borrow_blocks_mut(fs->disk, phys, 1, &ptr) != DISK_SUCCESS) {
+            res = ERROR_IO;
+            break;
         }
+        PERF_ADD(PERF_DENTRY_BLOCKS_SCANNED, 1);
+        placed = block_insert(fs, ptr, new_dentry);
+        disk_release_blocks(fs->disk, phys, 1, placed);
+        if (placed)
+            journal_add(fs->journal, phys, 1);
+        else
+            idx++;
     }
-    
-    // read indirect block
-    char indirect_buffer[BLOCK_SIZE];
-    if (disk_read_block(disk, dir_inode.indirect, indirect_buffer) != DISK_SUCCESS)
-        return ERROR_IO;
-    
-    uint32_t* block_ptrs = (uint32_t*)indirect_buffer;
-    uint32_t max_ptrs = BLOCK_SIZE / sizeof(uint32_t);  // 128
-    
-    // search for free slot in indirect blocks
-    for (uint32_t i = 0; i < max_ptrs; i++) {
-        if (block_ptrs[i] == 0) {
-            // allocate new data block
-            int new_block = bitmap_find_first_free(block_bitmap);
-            if (new_block < 0)
-                return ERROR_NO_SPACE;
-            
-            if (bitmap_set(block_bitmap, new_block) != SUCCESS)
-                return ERROR_GENERIC;
-            
-            if (out_blocks_allocated)
-                (*out_blocks_allocated)++;
-            
-            // update indirect block
-            block_ptrs[i] = new_block;
-            if (disk_write_block(disk, dir_inode.indirect, indirect_buffer) != DISK_SUCCESS) {
-                bitmap_clear(block_bitmap, new_block);
-                if (out_blocks_allocated)
-                    (*out_blocks_allocated)--;
-                return ERROR_IO;
-            }
-            
-            // update inode
-            dir_inode.blocks_used++;
-            dir_inode.size += BLOCK_SIZE;
-            dir_inode.modified_time = time(NULL);
-            if (inode_write(disk, dir_inode_num, &dir_inode) != SUCCESS) {
-                // rollback
-                block_ptrs[i] = 0;
-                disk_write_block(disk, dir_inode.indirect, indirect_buffer);
-                bitmap_clear(block_bitmap, new_block);
-                if (out_blocks_allocated)
-                    (*out_blocks_allocated)--;
-                return ERROR_IO;
+
+    if (res == SUCCESS && !placed) {
+        if (idx >= DIR_MAX_BLOCKS) {
+            res = ERROR_NO_SPACE;
+        } else {
+            // allocate a new block, next to the previous one of the directory
+            uint32_t new_block, count, meta_blocks;
+            res = block_alloc(fs, bmap_goal(fs, dir_inode_num, &dir_inode, &cur, idx), 1,
+                              &new_block, &count);
+            if (res == SUCCESS) {
+                res = bmap_map(fs, &dir_inode, &cur, idx, new_block, 1, &meta_blocks);
+                if (res != SUCCESS)
+                    block_free_run(fs, new_block, 1);
             }
-            
-            // initialize new data block and add dentry
-            char buffer[BLOCK_SIZE];
-            memset(buffer, 0, BLOCK_SIZE);
-            struct dentry* entries = (struct dentry*)buffer;
-            entries[0] = *new_dentry;
-            
-            if (disk_write_block(disk, new_block, buffer) != DISK_SUCCESS) {
-                // rollback
-                block_ptrs[i] = 0;
-                disk_write_block(disk, dir_inode.indirect, indirect_buffer);
-                bitmap_clear(block_bitmap, new_block);
-                if (out_blocks_allocated)
-                    (*out_blocks_allocated)--;
-                return ERROR_IO;
+
+            void* ptr;
+            if (res == SUCCESS &&
+                disk_borrow_blocks_mut(fs->disk, new_block, 1, &ptr) != DISK_SUCCESS)
+                res = ERROR_IO;
+
+            if (res == SUCCESS) {
+                block_init(fs, ptr);
+                block_insert(fs, ptr, new_dentry);
+                disk_release_blocks(fs->disk, new_block, 1, true);
+                journal_add(fs->journal, new_block, 1);
+
+                allocated += 1 + meta_blocks;
+                dir_inode.size += fs_block_size(fs);
+                placed = true;
             }
-            
-            return SUCCESS;
         }
-        
-        // check for free slot in existing indirect data block
-        char buffer[BLOCK_SIZE];
-        if (disk_read_block(disk, block_ptrs[i], buffer) != DISK_SUCCESS)
-            return ERROR_IO;
-        
-        struct dentry* entries = (struct dentry*)buffer;
-        for (uint32_t j = 0; j < DENTRIES_PER_BLOCK; j++) {
-            if (entries[j].inode_num == 0) {
-                entries[j] = *new_dentry;
-                
-                if (disk_write_block(disk, block_ptrs[i], buffer) != DISK_SUCCESS)
-                    return ERROR_IO;
-                
-                dir_inode.modified_time = time(NULL);
-                inode_write(disk, dir_inode_num, &dir_inode);
-                
-                return SUCCESS;
-            }
+    }
+
+    bmap_cursor_release(fs, &cur);
+
+    if (placed) {
+        // a negative entry cached for the name is now wrong
+        dcache_invalidate(fs->dcache, dir_inode_num, new_dentry->name);
+
+        if (indexed) {
+            dir_index_set_hint(fs, &dir_inode, idx);
+            res = dir_index_insert(fs, &dir_inode, dir_index_hash(new_dentry->name), idx);
+            if (res == ERROR_NO_SPACE)
+                res = index_rebuild(fs, &dir_inode, &allocated);   // grow the table
+        } else if ((fs->sb.features & FS_FEATURE_DIR_INDEX) &&
+                   (dir_inode.size >> fs_block_shift(fs)) >= DIR_INDEX_MIN_BLOCKS) {
+            res = index_rebuild(fs, &dir_inode, &allocated);
         }
+        // an index that could not be built or updated is dropped: the
+        // directory stays readable by a linear scan
+        if (res != SUCCESS) {
+            dir_inode.flags &= ~INODE_FLAG_DIR_INDEX;
+            res = SUCCESS;
+        }
+
+        // update directory inode
+        dir_inode.modified_time = time(NULL);
+        if (inode_write(fs, dir_inode_num, &dir_inode) != SUCCESS)
+            res = ERROR_IO;
     }
-    
-    return ERROR_NO_SPACE;
+
+    if (out_blocks_allocated)
+        *out_blocks_allocated = allocated;
+    return res;
 }
 
-int dentry_remove(disk_t disk, struct bitmap* block_bitmap, struct superblock* sb, 
-                  uint32_t dir_inode_num, const char* name) {
-    if (!disk || !name || !block_bitmap || !sb)
+int dentry_remove(struct filesystem* fs, uint32_t dir_inode_num, const char* name) {
+    if (!fs || !name || !fs->block_bitmap)
         return ERROR_INVALID;
-    
+
     struct inode dir_inode;
-    if (inode_read(disk, dir_inode_num, &dir_inode) != SUCCESS) 
+    if (inode_read(fs, dir_inode_num, &dir_inode) != SUCCESS) 
         return ERROR_IO;
     
     if (dir_inode.type != INODE_TYPE_DIRECTORY) 
         return ERROR_INVALID;
     
-    bool found = false;
-    int result;
-    
-    // search in direct blocks
-    for (uint32_t i = 0; i < 12; i++) {
-        // skip unallocated blocks (sparse holes) and superblock (always block number 0)
-        if (dir_inode.direct[i] == 0) continue;
-
-        result = remove_dentry_from_block(disk, dir_inode.direct[i], name, &found);
-        if (result != SUCCESS) return result;
-
-        if (found) {
-            // check if block is empty
-            uint32_t count = 0;
-            result = count_dentries_in_block(disk, dir_inode.direct[i], &count);
-            if (result != SUCCESS) return result;
-
-            if (count == 0) {
-                // free block in bitmap
-                bitmap_clear(block_bitmap, dir_inode.direct[i]);
-                sb->free_blocks++;
-                dir_inode.direct[i] = 0; // logic hole
-                dir_inode.blocks_used--;
-                dir_inode.size -= BLOCK_SIZE;
-            }
-            dir_inode.modified_time = time(NULL);
-            result = inode_write(disk, dir_inode_num, &dir_inode);
-            if (result != SUCCESS) return result;
-            return SUCCESS;
-        }
+    uint32_t idx, pos;
+    int result = dir_lookup(fs, &dir_inode, name, NULL, &idx, &pos);
+    if (result != SUCCESS)
+        return result;
+
+    uint32_t phys, run;
+    result = bmap_lookup(fs, &dir_inode, NULL, idx, 1, &phys, &run);
+    if (result != SUCCESS)
+        return result;
+
+    // found - free it in place
+    void* ptr;
+    if (disk_borrow_blocks_mut(fs->disk, phys, 1, &ptr) != DISK_SUCCESS)
+        return ERROR_IO;
+    block_remove(fs, ptr, pos);
+    bool empty = block_is_empty(fs, ptr);
+    disk_release_blocks(fs->disk, phys, 1, true);
+    journal_add(fs->journal, phys, 1);
+    dcache_invalidate(fs->dcache, dir_inode_num, name);
+
+    if (dir_index_enabled(&dir_inode)) {
+        uint32_t hint;
+        if (dir_index_delete(fs, &dir_inode, dir_index_hash(name), idx) != SUCCESS)
+            dir_inode.flags &= ~INODE_FLAG_DIR_INDEX;   // fall back to linear scans
+        else if (dir_index_get_hint(fs, &dir_inode, &hint) == SUCCESS && idx < hint)
+            dir_index_set_hint(fs, &dir_inode, idx);
     }
-    
-    // search in indirect blocks
-    if (dir_inode.indirect != 0) {
-        char indirect_buffer[BLOCK_SIZE];
-        result = disk_read_block(disk, dir_inode.indirect, indirect_buffer);
-        if (result != SUCCESS) return result;
-        
-        uint32_t* block_ptrs = (uint32_t*)indirect_buffer;
-        uint32_t max_ptrs = BLOCK_SIZE / sizeof(uint32_t);
-        bool indirect_block_modified = false;
-        
-        for (uint32_t i = 0; i < max_ptrs; i++) {
-            if (block_ptrs[i] == 0) continue;
-
-            result = remove_dentry_from_block(disk, block_ptrs[i], name, &found);
-            if (result != SUCCESS) return result;
-            
-            if (found) {
-                uint32_t count = 0;
-                result = count_dentries_in_block(disk, block_ptrs[i], &count);
-                if (result != SUCCESS) return result;
-
-                if (count == 0) {
-                    // free data block pointed by indirect
-                    bitmap_clear(block_bitmap, block_ptrs[i]);
-                    sb->free_blocks++;
-                    block_ptrs[i] = 0;
-                    dir_inode.blocks_used--;
-                    dir_inode.size -= BLOCK_SIZE;
-                    indirect_block_modified = true;
-                }
-
-                bool indirect_empty = true;
-                for (uint32_t j = 0; j < max_ptrs; j++) {
-                    if (block_ptrs[j] != 0) {
-                        indirect_empty = false;
-                        break;
-                    }
-                }
-                // deallocate indirect block if it's not pointing to any data block
-                if (indirect_empty) {
-                    bitmap_clear(block_bitmap, dir_inode.indirect);
-                    sb->free_blocks++;
-                    dir_inode.indirect = 0;
-                    dir_inode.blocks_used--;
-                }
-
-                dir_inode.modified_time = time(NULL);
-                result = inode_write(disk, dir_inode_num, &dir_inode);
-                if (result != SUCCESS) return result;
-
-                // if a pointer was removed but indirect still exists, update indirect block on disk
-                if (indirect_block_modified && !indirect_empty) {
-                    result = disk_write_block(disk, dir_inode.indirect, indirect_buffer);
-                    if (result != SUCCESS) return result;
-                }
-
-                return SUCCESS;
-            }
+
+    if (empty) {
+        // release the block (logic hole), and the pointer block if now unused
+        uint32_t freed;
+        if (bmap_punch(fs, &dir_inode, idx, 1, &freed) == SUCCESS) {
+            fs_free_blocks_add(fs, freed);
+            dir_inode.size -= fs_block_size(fs);
         }
     }
-    
-    return ERROR_NOT_FOUND;
+
+    dir_inode.modified_time = time(NULL);
+    return inode_write(fs, dir_inode_num, &dir_inode);
 }
 
-int dentry_list(disk_t disk, uint32_t dir_inode_num, 
-                struct dentry** out_entries, uint32_t* out_count) {
-    if (!disk || !out_entries || !out_count) 
+int dentry_iterate(struct filesystem* fs, uint32_t dir_inode_num, uint32_t* io_pos,
+                   struct dentry* out_entries, uint32_t max, uint32_t* out_count) {
+    if (!fs || !io_pos || (!out_entries && max > 0) || !out_count)
         return ERROR_INVALID;
-    
-    struct inode dir_inode;
-    if (inode_read(disk, dir_inode_num, &dir_inode) != SUCCESS) 
+
+    struct inode dir;
+    if (inode_read(fs, dir_inode_num, &dir) != SUCCESS)
         return ERROR_IO;
-    
-    if (dir_inode.type != INODE_TYPE_DIRECTORY) 
+    if (dir.type != INODE_TYPE_DIRECTORY)
         return ERROR_INVALID;
-    
-    // === COUNT PHASE ===
-    uint32_t total_count = 0;
-    uint32_t block_count;
-    
-    // count in direct blocks
-    for (uint32_t i = 0; i < 12; i++) {
-        if (dir_inode.direct[i] == 0) continue;
-        if (count_dentries_in_block(disk, dir_inode.direct[i], &block_count) != SUCCESS)
-            return ERROR_IO;
-        total_count += block_count;
-    }
-    
-    // count in indirect blocks
-    if (dir_inode.indirect != 0) {
-        char indirect_buffer[BLOCK_SIZE];
-        if (disk_read_block(disk, dir_inode.indirect, indirect_buffer) != DISK_SUCCESS)
-            return ERROR_IO;
-        
-        uint32_t* block_ptrs = (uint32_t*)indirect_buffer;
-        uint32_t max_ptrs = BLOCK_SIZE / sizeof(uint32_t);
-        
-        for (uint32_t i = 0; i < max_ptrs; i++) {
-            if (block_ptrs[i] == 0) continue;
-            if (count_dentries_in_block(disk, block_ptrs[i], &block_count) != SUCCESS)
-                return ERROR_IO;
-            total_count += block_count;
+
+    // *io_pos is a byte position: dentry block index * block size + offset
+    uint32_t bs = fs_block_size(fs);
+    uint32_t idx = *io_pos / bs, off = *io_pos % bs;
+
+    struct bmap_cursor cur;
+    bmap_cursor_init(&cur);
+
+    uint32_t n = 0, phys;
+    int res = SUCCESS;
+    while (n < max) {
+        uint32_t want = idx;
+        if ((res = next_dir_block(fs, &dir, &cur, &idx, &phys)) != SUCCESS)
+            break;
+        if (idx != want)
+            off = 0;                      // skipped a hole
+
+        const void* ptr;
+        if (disk_borrow_blocks(fs->disk, phys, 1, &ptr) != DISK_SUCCESS) {
+            res = ERROR_IO;
+            break;
         }
-    }
-    
-    // empty directory
-    if (total_count == 0) {
-        *out_entries = NULL;
-        *out_count = 0;
-        return SUCCESS;
-    }
-    
-    // === ALLOCATION PHASE ===
-    struct dentry* result = malloc(total_count * sizeof(struct dentry));
-    if (!result) 
-        return ERROR_GENERIC;
-    
-    uint32_t idx = 0;
-    
-    // fill from direct blocks
-    for (uint32_t i = 0; i < 12; i++) {
-        if (dir_inode.direct[i] == 0) continue;
-        if (fill_dentries_from_block(disk, dir_inode.direct[i], result, &idx) != SUCCESS) {
-            free(result);
-            return ERROR_IO;
+        PERF_ADD(PERF_DENTRY_BLOCKS_SCANNED, 1);
+        bool more;
+        while ((more = block_next(fs, ptr, &off, &out_entries[n])) && ++n < max)
+            off++;
+        disk_release_blocks(fs->disk, phys, 1, false);
+
+        if (more) {
+            off++;                        // batch full: resume after this entry
+        } else {
+            idx++;
+            off = 0;
         }
     }
-    
-    // fill from indirect blocks
-    if (dir_inode.indirect != 0) {
-        char indirect_buffer[BLOCK_SIZE];
-        if (disk_read_block(disk, dir_inode.indirect, indirect_buffer) != DISK_SUCCESS) {
-            free(result);
-            return ERROR_IO;
-        }
-        
-        uint32_t* block_ptrs = (uint32_t*)indirect_buffer;
-        uint32_t max_ptrs = BLOCK_SIZE / sizeof(uint32_t);
-        
-        for (uint32_t i = 0; i < max_ptrs; i++) {
-            if (block_ptrs[i] == 0) continue;
-            if (fill_dentries_from_block(disk, block_ptrs[i], result, &idx) != SUCCESS) {
+
+    bmap_cursor_release(fs, &cur);
+    if (res != SUCCESS && res != ERROR_NOT_FOUND)
+        return res;
+    *io_pos = idx * bs + off;
+    *out_count = n;
+    return SUCCESS;
+}
+
+int dentry_list(struct filesystem* fs, uint32_t dir_inode_num, 
+                struct dentry** out_entries, uint32_t* out_count) {
+    if (!fs || !out_entries || !out_count) 
+        return ERROR_INVALID;
+
+    // one pass over the blocks, growing the array as entries come
+    struct dentry* result = NULL;
+    uint32_t n = 0, cap = 0, pos = 0;
+    for (;;) {
+        if (n == cap) {
+            cap = cap ? cap * 2 : 16;
+            struct dentry* grown = realloc(result, cap * sizeof(struct dentry));
+            if (!grown) {
                 free(result);
-                return ERROR_IO;
+                return ERROR_GENERIC;
             }
+            result = grown;
         }
+
+        uint32_t got;
+        int res = dentry_iterate(fs, dir_inode_num, &pos, result + n, cap - n, &got);
+        if (res != SUCCESS) {
+            free(result);
+            return res;
+        }
+        if (got == 0)
+            break;
+        n += got;
     }
-    
+
+    // empty directory
+    if (n == 0) {
+        free(result);
+        result = NULL;
+    }
+
     *out_entries = result;
-    *out_count = total_count;
+    *out_count = n;
     return SUCCESS;
 }
 
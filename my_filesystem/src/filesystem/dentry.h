@@ -4,6 +4,8 @@
 #include "disk.h"
 #include "bitmap.h"
 
+struct filesystem;   // mounted filesystem context (see fs.h)
+
 // === VALIDATION ===
 
 // checks if a dentry structure is valid
@@ -20,23 +22,31 @@ int dentry_create(const char* name, uint32_t inode_num,
 
 // === DIRECTORY OPERATIONS ===
 
-// finds a dentry by name within a directory (finds first free slot and writes the dentry)
-int dentry_find(disk_t disk, uint32_t dir_inode_num, 
+// finds a dentry by name within a directory (via its hash index when it has one);
+// *out_index is the byte position of the entry in the directory
+int dentry_find(struct filesystem* fs, uint32_t dir_inode_num, 
                 const char* name, struct dentry* out_dentry, 
                 uint32_t* out_index);
 
 // adds a new dentry to a directory
-int dentry_add(disk_t disk, uint32_t dir_inode_num, 
+// (new blocks are taken from fs->block_bitmap; caller updates fs->sb.free_blocks)
+int dentry_add(struct filesystem* fs, uint32_t dir_inode_num, 
                const struct dentry* new_dentry,
-               struct bitmap* block_bitmap,
                uint32_t* out_blocks_allocated);
 
 // removes a dentry from a directory by marking it as free
-int dentry_remove(disk_t disk, struct bitmap* block_bitmap, struct superblock* sb, 
-                  uint32_t dir_inode_num, const char* name);
-
-// lists all valid dentries in a directory
-int dentry_list(disk_t disk, uint32_t dir_inode_num, 
+// (emptied blocks are released and fs->sb.free_blocks is updated)
+int dentry_remove(struct filesystem* fs, uint32_t dir_inode_num, const char* name);
+
+// reads up to max live entries of a directory into out_entries, starting at
+// position *io_pos (0 = first entry) and moving it past the last one read;
+// *out_count is 0 once the end is reached. The position stays valid while
+// entries are added and removed (an entry may then be seen twice or not at all)
+int dentry_iterate(struct filesystem* fs, uint32_t dir_inode_num, uint32_t* io_pos,
+                   struct dentry* out_entries, uint32_t max, uint32_t* out_count);
+
+// lists all valid dentries in a directory (malloc'd array, NULL when empty)
+int dentry_list(struct filesystem* fs, uint32_t dir_inode_num, 
                 struct dentry** out_entries, uint32_t* out_count);
 
 // === UTILITIES ===
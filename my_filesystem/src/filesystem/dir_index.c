@@ -0,0 +1,390 @@
+#include "dir_index.h"
+#include "fs.h"
+#include <string.h>
+
+#define DIR_INDEX_MAGIC   0x58444948u    // "HIDX"
+
+struct dir_index_header {
+    uint32_t magic;
+    uint32_t slot_blocks;             // slot blocks after the header (power of two)
+    uint32_t used;                    // live slots
+    uint32_t deleted;                 // tombstones
+    uint32_t free_hint;               // lowest dentry block that may have room
+};
+
+struct dir_index_slot {
+    uint32_t hash;                    // dir_index_hash() of the name
+    uint32_t block;                   // dentry block + 1 (SLOT_EMPTY / SLOT_DELETED)
+};
+
+#define SLOT_EMPTY        0
+#define SLOT_DELETED      UINT32_MAX
+
+// === PRIVATE FUNCTIONS ===
+
+// slots in one table block (a power of two, as the block size is)
+static inline uint32_t slots_per_block(const struct filesystem* fs) {
+    return fs_block_size(fs) / sizeof(struct dir_index_slot);
+}
+
+// physical block behind logical block idx of the directory (must be mapped)
+static int index_phys(struct filesystem* fs, const struct inode* dir, struct bmap_cursor* cur,
+                      uint32_t idx, uint32_t* out_phys) {
+    uint32_t run;
+    int res = bmap_lookup(fs, dir, cur, idx, 1, out_phys, &run);
+    if (res != SUCCESS)
+        return res;
+    return (*out_phys != 0) ? SUCCESS : ERROR_INVALID;
+}
+
+static int header_borrow(struct filesystem* fs, const struct inode* dir,
+                         struct dir_index_header** out_hdr, uint32_t* out_phys) {
+    if (!dir_index_enabled(dir))
+        return ERROR_INVALID;
+
+    int res = index_phys(fs, dir, NULL, DIR_INDEX_HEADER_BLOCK, out_phys);
+    if (res != SUCCESS)
+        return res;
+
+    void* ptr;
+    if (disk_borrow_blocks_mut(fs->disk, *out_phys, 1, &ptr) != DISK_SUCCESS)
+        return ERROR_IO;
+
+    struct dir_index_header* hdr = (struct dir_index_header*)ptr;
+    if (hdr->magic != DIR_INDEX_MAGIC || hdr->slot_blocks == 0) {
+        disk_release_blocks(fs->disk, *out_phys, 1, false);
+        return ERROR_INVALID;
+    }
+
+    *out_hdr = hdr;
+    return SUCCESS;
+}
+
+/*
+ * Table walk shared by insert / delete / probe: keeps the slot block of the
+ * current position borrowed and moves to the next one only when the probe
+ * sequence crosses a block boundary.
+ */
+struct slot_walk {
+    struct bmap_cursor cur;
+    uint32_t block;                   // slot block borrowed (index in the table)
+    uint32_t phys;                    // its physical block (0 = none borrowed)
+    bool dirty;
+    struct dir_index_slot* slots;
+};
+
+static void walk_init(struct slot_walk* w) {
+    bmap_cursor_init(&w->cur);
+    w->phys = 0;
+    w->dirty = false;
+    w->slots = NULL;
+}
+
+// gives back the slot block borrowed, if any
+static void walk_put(struct filesystem* fs, struct slot_walk* w) {
+    if (w->phys != 0) {
+        disk_release_blocks(fs->disk, w->phys, 1, w->dirty);
+        if (w->dirty)
+            journal_add(fs->journal, w->phys, 1);
+    }
+    w->phys = 0;
+    w->dirty = false;
+}
+
+static void walk_release(struct filesystem* fs, struct slot_walk* w) {
+    walk_put(fs, w);
+    bmap_cursor_release(fs, &w->cur);
+}
+
+static int walk_slot(struct filesystem* fs, const struct inode* dir, struct slot_walk* w,
+                     uint32_t pos, struct dir_index_slot** out_slot) {
+    uint32_t block = pos / slots_per_block(fs);
+    if (w->phys == 0 || w->block != block) {
+        walk_put(fs, w);
+
+        uint32_t phys;
+        int res = index_phys(fs, dir, &w->cur, DIR_INDEX_HEADER_BLOCK + 1 + block, &phys);
+        if (res != SUCCESS)
+            return res;
+
+        void* ptr;
+        if (disk_borrow_blocks_mut(fs->disk, phys, 1, &ptr) != DISK_SUCCESS)
+            return ERROR_IO;
+        w->phys = phys;
+        w->block = block;
+        w->slots = (struct dir_index_slot*)ptr;
+    }
+
+    *out_slot = &w->slots[pos & (slots_per_block(fs) - 1)];
+    return SUCCESS;
+}
+
+// === PUBLIC FUNCTIONS ===
+
+uint32_t dir_index_hash(const char* name) {
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)name; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+int dir_index_build(struct filesystem* fs, struct inode* dir, uint32_t entries,
+                    uint32_t* io_allocated) {
+    if (!fs || !dir || !io_allocated)
+        return ERROR_INVALID;
+
+    // room for every entry at half load
+    uint32_t slot_blocks = 1;
+    while (slot_blocks * slots_per_block(fs) < 2 * entries)
+        slot_blocks <<= 1;
+
+    // an existing table is reused, never shrunk
+    if (dir_index_enabled(dir)) {
+        struct dir_index_header* hdr;
+        uint32_t phys;
+        if (header_borrow(fs, dir, &hdr, &phys) == SUCCESS) {
+            slot_blocks = MAX(slot_blocks, hdr->slot_blocks);
+            disk_release_blocks(fs->disk, phys, 1, false);
+        }
+    }
+
+    struct bmap_cursor cur;
+    bmap_cursor_init(&cur);
+
+    // map and clear the header and slot blocks, one run at a time
+    uint32_t idx = DIR_INDEX_HEADER_BLOCK;
+    uint32_t end = idx + 1 + slot_blocks;
+    uint32_t goal = bmap_goal(fs, INVALID_INODE_NUM, dir, &cur, idx);
+    int res = SUCCESS;
+
+    while (idx < end) {
+        uint32_t phys, run;
+        res = bmap_lookup(fs, dir, &cur, idx, end - idx, &phys, &run);
+        if (res != SUCCESS)
+            break;
+
+        if (phys == 0) {
+            uint32_t count, meta_blocks;
+            res = block_alloc(fs, goal, run, &phys, &count);
+            if (res != SUCCESS)
+                break;
+            res = bmap_map(fs, dir, &cur, idx, phys, count, &meta_blocks);
+            if (res != SUCCESS) {
+                block_free_run(fs, phys, count);
+                break;
+            }
+            *io_allocated += count + meta_blocks;
+            run = count;
+        }
+
+        void* ptr;
+        if (disk_borrow_blocks_mut(fs->disk, phys, run, &ptr) != DISK_SUCCESS) {
+            res = ERROR_IO;
+            break;
+        }
+        memset(ptr, 0, (size_t)run * fs_block_size(fs));
+        disk_release_blocks(fs->disk, phys, run, true);
+        journal_add(fs->journal, phys, run);
+
+        idx += run;
+        goal = phys + run;
+    }
+
+    bmap_cursor_release(fs, &cur);
+    if (res != SUCCESS)
+        return res;
+
+    uint32_t phys;
+    res = index_phys(fs, dir, NULL, DIR_INDEX_HEADER_BLOCK, &phys);
+    if (res != SUCCESS)
+        return res;
+
+    void* ptr;
+    if (disk_borrow_blocks_mut(fs->disk, phys, 1, &ptr) != DISK_SUCCESS)
+        return ERROR_IO;
+    struct dir_index_header* hdr = (struct dir_index_header*)ptr;
+    hdr->magic = DIR_INDEX_MAGIC;
+    hdr->slot_blocks = slot_blocks;
+    disk_release_blocks(fs->disk, phys, 1, true);
+    journal_add(fs->journal, phys, 1);
+
+    dir->flags |= INODE_FLAG_DIR_INDEX;
+    return SUCCESS;
+}
+
+int dir_index_insert(struct filesystem* fs, const struct inode* dir,
+                     uint32_t name_hash, uint32_t block) {
+    if (!fs || !dir)
+        return ERROR_INVALID;
+
+    struct dir_index_header* hdr;
+    uint32_t hdr_phys;
+    int res = header_borrow(fs, dir, &hdr, &hdr_phys);
+    if (res != SUCCESS)
+        return res;
+
+    // keep the table at most 3/4 full, tombstones included
+    uint32_t nslots = hdr->slot_blocks * slots_per_block(fs);
+    if ((hdr->used + hdr->deleted + 1) * 4 > nslots * 3) {
+        disk_release_blocks(fs->disk, hdr_phys, 1, false);
+        return ERROR_NO_SPACE;
+    }
+
+    struct slot_walk w;
+    walk_init(&w);
+
+    res = ERROR_NO_SPACE;
+    for (uint32_t step = 0; step < nslots; step++) {
+        struct dir_index_slot* slot;
+        int r = walk_slot(fs, dir, &w, (name_hash + step) & (nslots - 1), &slot);
+        if (r != SUCCESS) {
+            res = r;
+            break;
+        }
+        if (slot->block != SLOT_EMPTY && slot->block != SLOT_DELETED)
+            continue;
+
+        if (slot->block == SLOT_DELETED)
+            hdr->deleted--;
+        hdr->used++;
+        slot->hash = name_hash;
+        slot->block = block + 1;
+        w.dirty = true;
+        res = SUCCESS;
+        break;
+    }
+
+    walk_release(fs, &w);
+    disk_release_blocks(fs->disk, hdr_phys, 1, res == SUCCESS);
+    if (res == SUCCESS)
+        journal_add(fs->journal, hdr_phys, 1);
+    return res;
+}
+
+int dir_index_delete(struct filesystem* fs, const struct inode* dir,
+                     uint32_t name_hash, uint32_t block) {
+    if (!fs || !dir)
+        return ERROR_INVALID;
+
+    struct dir_index_header* hdr;
+    uint32_t hdr_phys;
+    int res = header_borrow(fs, dir, &hdr, &hdr_phys);
+    if (res != SUCCESS)
+        return res;
+
+    uint32_t nslots = hdr->slot_blocks * slots_per_block(fs);
+    struct slot_walk w;
+    walk_init(&w);
+
+    res = ERROR_NOT_FOUND;
+    for (uint32_t step = 0; step < nslots; step++) {
+        struct dir_index_slot* slot;
+        int r = walk_slot(fs, dir, &w, (name_hash + step) & (nslots - 1), &slot);
+        if (r != SUCCESS) {
+            res = r;
+            break;
+        }
+        if (slot->block == SLOT_EMPTY)
+            break;
+        if (slot->block != block + 1 || slot->hash != name_hash)
+            continue;
+
+        // a tombstone keeps later slots of the probe sequence reachable
+        slot->block = SLOT_DELETED;
+        hdr->used--;
+        hdr->deleted++;
+        w.dirty = true;
+        res = SUCCESS;
+        break;
+    }
+
+    walk_release(fs, &w);
+    disk_release_blocks(fs->disk, hdr_phys, 1, res == SUCCESS);
+    if (res == SUCCESS)
+        journal_add(fs->journal, hdr_phys, 1);
+    return res;
+}
+
+void dir_index_probe_init(struct dir_index_probe* probe, uint32_t name_hash) {
+    if (!probe)
+        return;
+    probe->hash = name_hash;
+    probe->steps = 0;
+}
+
+int dir_index_probe_next(struct filesystem* fs, const struct inode* dir,
+                         struct dir_index_probe* probe, uint32_t* out_block) {
+    if (!fs || !dir || !probe || !out_block)
+        return ERROR_INVALID;
+
+    struct dir_index_header* hdr;
+    uint32_t hdr_phys;
+    int res = header_borrow(fs, dir, &hdr, &hdr_phys);
+    if (res != SUCCESS)
+        return res;
+    uint32_t nslots = hdr->slot_blocks * slots_per_block(fs);
+    disk_release_blocks(fs->disk, hdr_phys, 1, false);
+
+    struct slot_walk w;
+    walk_init(&w);
+
+    res = ERROR_NOT_FOUND;
+    while (probe->steps < nslots) {
+        struct dir_index_slot* slot;
+        int r = walk_slot(fs, dir, &w, (probe->hash + probe->steps) & (nslots - 1), &slot);
+        if (r != SUCCESS) {
+            res = r;
+            break;
+        }
+        probe->steps++;
+
+        if (slot->block == SLOT_EMPTY) {
+            probe->steps = nslots;      // end of the sequence
+            break;
+        }
+        if (slot->block != SLOT_DELETED && slot->hash == probe->hash) {
+            *out_block = slot->block - 1;
+            res = SUCCESS;
+            break;
+        }
+    }
+
+    walk_release(fs, &w);
+    return res;
+}
+
+int dir_index_get_hint(struct filesystem* fs, const struct inode* dir, uint32_t* out_block) {
+    if (!fs || !dir || !out_block)
+        return ERROR_INVALID;
+
+    struct dir_index_header* hdr;
+    uint32_t phys;
+    int res = header_borrow(fs, dir, &hdr, &phys);
+    if (res != SUCCESS)
+        return res;
+
+    *out_block = hdr->free_hint;
+    disk_release_blocks(fs->disk, phys, 1, false);
+    return SUCCESS;
+}
+
+int dir_index_set_hint(struct filesystem* fs, const struct inode* dir, uint32_t block) {
+    if (!fs || !dir)
+        return ERROR_INVALID;
+
+    struct dir_index_header* hdr;
+    uint32_t phys;
+    int res = header_borrow(fs, dir, &hdr, &phys);
+    if (res != SUCCESS)
+        return res;
+
+    bool changed = (hdr->free_hint != block);
+    hdr->free_hint = block;
+    disk_release_blocks(fs->disk, phys, 1, changed);
+    if (changed)
+        journal_add(fs->journal, phys, 1);
+    return SUCCESS;
+}
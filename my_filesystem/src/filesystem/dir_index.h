@@ -0,0 +1,77 @@
+#pragma once
+
+#include "common.h"
+#include "bmap.h"
+
+/*
+ * Hashed directory index (in the spirit of ext3 htree, flattened to a single
+ * open-addressing table).
+ *
+ * A directory keeps its entries in logical blocks [0, DIR_MAX_BLOCKS). Once
+ * it grows past DIR_INDEX_MIN_BLOCKS on a filesystem formatted with
+ * FS_FEATURE_DIR_INDEX, an index is built in the directory's own logical
+ * blocks right after that range, and the inode gets INODE_FLAG_DIR_INDEX:
+ *
+ *  - DIR_INDEX_HEADER_BLOCK: header (slot block count, live / deleted slot
+ *    counters, free-slot hint)
+ *  - the following slot blocks: linear-probing table of (name hash, dentry
+ *    block) slots
+ *
+ * A lookup only reads the dentry blocks whose slot hash matches the name.
+ * The index is owned by the directory mapping, so truncating the directory
+ * (inode_free) releases it as well. Smaller directories stay linear.
+ */
+
+struct filesystem;
+
+// the dentry range is fixed in blocks (direct[] plus one 512-byte pointer
+// block's worth), so the index sits at the same logical block whatever
+// the block size
+#define DIR_MAX_BLOCKS          (BMAP_DIRECT_BLOCKS + BLOCK_SIZE_MIN / 4)   // dentry blocks
+#define DIR_INDEX_HEADER_BLOCK  DIR_MAX_BLOCKS                              // logical block
+#define DIR_INDEX_MIN_BLOCKS    4                                           // index from here on
+
+// probe sequence of one name hash through the table
+struct dir_index_probe {
+    uint32_t hash;
+    uint32_t pos;                     // next slot to look at
+    uint32_t steps;                   // slots looked at so far
+};
+
+static inline bool dir_index_enabled(const struct inode* dir) {
+    return (dir->flags & INODE_FLAG_DIR_INDEX) != 0;
+}
+
+// hash of a filename as stored in the index
+uint32_t dir_index_hash(const char* name);
+
+/*
+ * (Re)initializes an empty index able to hold `entries` names at half load,
+ * allocating the header and slot blocks still missing (the table never
+ * shrinks). Blocks allocated are added to *io_allocated; the caller updates
+ * fs->sb.free_blocks and writes the directory inode back.
+ */
+int dir_index_build(struct filesystem* fs, struct inode* dir, uint32_t entries,
+                    uint32_t* io_allocated);
+
+// records that `name_hash` lives in dentry block `block`;
+// ERROR_NO_SPACE when the table is too loaded (rebuild it bigger)
+int dir_index_insert(struct filesystem* fs, const struct inode* dir,
+                     uint32_t name_hash, uint32_t block);
+
+// forgets one (name_hash, block) slot
+int dir_index_delete(struct filesystem* fs, const struct inode* dir,
+                     uint32_t name_hash, uint32_t block);
+
+/*
+ * Walks the dentry blocks that may hold a name with this hash:
+ * dir_index_probe_init() once, then dir_index_probe_next() until it returns
+ * ERROR_NOT_FOUND (no more candidates).
+ */
+void dir_index_probe_init(struct dir_index_probe* probe, uint32_t name_hash);
+int dir_index_probe_next(struct filesystem* fs, const struct inode* dir,
+                         struct dir_index_probe* probe, uint32_t* out_block);
+
+// lowest dentry block that may have a free slot (search for room from there)
+int dir_index_get_hint(struct filesystem* fs, const struct inode* dir, uint32_t* out_block);
+int dir_index_set_hint(struct filesystem* fs, const struct inode* dir, uint32_t block);
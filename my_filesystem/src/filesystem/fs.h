@@ -5,36 +5,217 @@
 #include "superblock.h"
 #include "inode.h"
 #include "dentry.h"
+#include "inode_cache.h"
+#include "dcache.h"
+#include "journal.h"
+#include "block_alloc.h"
+#include "bmap.h"
 #include "bitmap.h"
 #include "path.h"
+#include "perf.h"
+#include "trace.h"
 #include <stdbool.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+// === METADATA FLUSH POLICY ===
+
+/**
+ * Selects when metadata changed by an operation (bitmaps, superblock,
+ * dirty cached inodes) is written back to the disk image.
+ */
+typedef enum fs_flush_policy {
+    FS_FLUSH_PER_OP = 0,              // after every metadata-changing operation (default)
+    FS_FLUSH_EVERY_N,                 // every flush_interval operations
+    FS_FLUSH_ON_SYNC                  // only on fs_sync / fs_unmount
+} fs_flush_policy_t;
+
+// === ACCESS TIME ===
+
+/**
+ * When reads update an inode's access time.
+ */
+typedef enum fs_atime_mode {
+    FS_ATIME_STRICT = 0,              // on every read (default)
+    FS_ATIME_RELATIME,                // when not newer than the modification time, or
+                                      // older than FS_RELATIME_INTERVAL
+    FS_ATIME_NOATIME                  // never
+} fs_atime_mode_t;
+
+#define FS_RELATIME_INTERVAL (24 * 60 * 60)  // seconds after which relatime updates anyway
+
+/**
+ * Options accepted by fs_mount_with_options().
+ */
+typedef struct fs_mount_options {
+    fs_flush_policy_t flush_policy;   // when metadata is persisted
+    uint32_t flush_interval;          // operations between flushes (FS_FLUSH_EVERY_N)
+    fs_atime_mode_t atime;            // access-time updates
+    bool lazytime;                    // keep access times in memory until the last
+                                      // handle closes, fs_sync or unmount
+    bool map_bitmaps;                 // work on the bitmaps in place in the mapped image
+                                      // (see fs_mount_with_options)
+} fs_mount_options_t;
+
+// === FORMAT OPTIONS ===
+
+/**
+ * Options accepted by fs_format_with_options().
+ */
+typedef struct fs_format_options {
+    bool extents;                     // map new files with extents (FS_FEATURE_EXTENTS)
+    bool dir_index;                   // index large directories (FS_FEATURE_DIR_INDEX)
+    bool rec_len;                     // variable-length dentries (FS_FEATURE_REC_LEN)
+    uint32_t block_size;              // bytes per block, power of two (0 = BLOCK_SIZE);
+                                      // rec_len needs blocks below 64 KiB
+    uint32_t journal_blocks;          // metadata journal size (0 = no journal)
+    bool block_groups;                // block-group layout (FS_FEATURE_GROUPS)
+    uint32_t blocks_per_group;        // blocks per group, a multiple of BLOCK_GROUP_ALIGN
+                                      // (0 = 8 * block_size, one bitmap block per group)
+    bool lazy_itable;                 // leave the inode table to be zeroed on first use
+                                      // (FS_FEATURE_LAZY_ITABLE, see fs_itable_init)
+    bool inline_data;                 // new files keep up to BMAP_INLINE_MAX bytes in
+                                      // their inode (FS_FEATURE_INLINE_DATA)
+    bool reflink;                     // reference-count table for fs_clone
+                                      // (FS_FEATURE_REFLINK)
+} fs_format_options_t;
 
 // === FILESYSTEM CONTEXT ===
 
+#define FS_INODE_LOCKS 64             // per-inode locks, striped by inode number (power of two)
+
 /**
  * Represents a mounted filesystem instance.
  * Holds all the metadata and state required to perform filesystem operations.
+ *
+ * A mounted filesystem can be used from several threads at once (an open
+ * file handle by one thread at a time, except for fs_pread / fs_pwrite on
+ * an unbuffered handle).
+ * Locks, in the order they nest:
+ *
+ *   ns_lock       the namespace: shared by lookups, fs_open, fs_stat,
+ *                 fs_list, fs_readdir; exclusive for fs_create, fs_unlink,
+ *                 fs_mkdir, fs_rmdir, fs_link, fs_cd (and fs_open creating
+ *                 or truncating). Directory contents and the current
+ *                 directory change only under it.
+ *   inode locks   the contents and pinned copy of a file inode: shared by
+ *                 the reads and fs_stat, exclusive by the writes and by the
+ *                 namespace operations changing the inode
+ *   meta_lock     metadata flushes and the flush-policy counter
+ *   alloc_lock    block and inode bitmaps, alloc_rotor; with block groups
+ *                 only the inode bitmap, the groups' inode counters and
+ *                 dir_rotor
+ *   group locks   with block groups: a group's block bitmap bits, rotor
+ *                 and free block counter (see block_alloc.h)
+ *   refcount_lock the reference-count table (FS_FEATURE_REFLINK); never
+ *                 held while taking another filesystem lock
+ *
+ * The inode cache, the dentry cache, the chunk cache, the journal and the
+ * disk lock themselves (innermost). The free counters in sb are updated atomically.
+ * A flush may write out an inode a writer is changing at that moment;
+ * the inode stays dirty and the next flush writes it again.
  */
+struct chunk_cache;
+
 typedef struct filesystem {
     disk_t disk;                      // disk emulator handle
     struct superblock sb;             // in-memory copy of superblock
     struct bitmap* block_bitmap;      // in-memory bitmap for data blocks
     struct bitmap* inode_bitmap;      // in-memory bitmap for inodes
+    struct inode_cache* icache;       // write-back inode cache (NULL = uncached)
+    struct dcache* dcache;            // path lookup cache (NULL = uncached)
+    struct chunk_cache* ccache;       // decompressed chunks of compressed files (NULL = uncached)
+    struct journal* journal;          // metadata journal (NULL = none)
+    uint32_t alloc_rotor;             // allocation goal for files without blocks
+    struct block_group* groups;       // per-group allocator state (NULL = flat layout)
+    bool groups_dirty;                // a descriptor changed since the table was written
+    uint32_t dir_rotor;               // group the next directory search starts at
+    fs_flush_policy_t flush_policy;   // when metadata is persisted
+    uint32_t flush_interval;          // operations between flushes (FS_FLUSH_EVERY_N)
+    uint32_t ops_since_flush;         // operations committed since the last flush
+    fs_atime_mode_t atime_mode;       // access-time updates
+    bool lazytime;                    // access times wait for close / sync
+    bool bitmaps_mapped;              // the bitmaps live in the mapped image (map_bitmaps)
     bool is_mounted;                  // mount status
-    uint32_t current_dir_inode;       // current working directory (for shell)
+    uint32_t current_dir_inode;       // current working directory (for shell; ns_lock)
+
+    pthread_rwlock_t ns_lock;         // namespace
+    pthread_rwlock_t inode_locks[FS_INODE_LOCKS];
+    pthread_mutex_t meta_lock;        // metadata flush
+    pthread_mutex_t alloc_lock;       // allocator state
+    pthread_mutex_t refcount_lock;    // shared-block reference counts
 } filesystem_t;
 
+// === BLOCK GEOMETRY ===
+
+/*
+ * The block size is fixed at format time (sb.block_size, a power of two in
+ * [BLOCK_SIZE_MIN, BLOCK_SIZE_MAX]); block-sized quantities derive from it.
+ * Offsets are split into block index and in-block offset with shifts and
+ * masks, so a 4 KiB filesystem pays no division on the I/O path.
+ */
+static inline uint32_t fs_block_size(const filesystem_t* fs) {
+    return fs->sb.block_size;
+}
+
+static inline uint32_t fs_block_shift(const filesystem_t* fs) {
+    return (uint32_t)__builtin_ctz(fs->sb.block_size);
+}
+
+static inline uint32_t fs_block_mask(const filesystem_t* fs) {
+    return fs->sb.block_size - 1;
+}
+
 // === OPEN FILE DESCRIPTOR ===
 
+#define FS_READAHEAD_MIN (16 * 1024)  // first readahead window of a stream, in bytes
+#define FS_READAHEAD_MAX (512 * 1024) // largest window, in bytes
+
+/**
+ * Sequential-read detection of one handle. A read starting where the
+ * previous one ended (the first read: at offset 0) continues a stream, and
+ * the blocks up to a window past it are hinted to the disk (WILLNEED and
+ * SEQUENTIAL) before they are needed; the window doubles each time it is
+ * refilled, up to FS_READAHEAD_MAX. Any other read ends the stream, and a
+ * run of them hints the blocks read as RANDOM.
+ */
+struct fs_readahead {
+    uint32_t next;                    // offset a sequential read would start at
+    uint32_t window;                  // blocks kept ahead of the stream (0 = no stream)
+    uint32_t ahead_end;               // logical block the readahead issued so far reaches
+    uint32_t random;                  // consecutive non-sequential reads
+    uint64_t blocks;                  // blocks read ahead on this handle (statistics)
+};
+
+#define FS_WRITE_BUFFER (64 * 1024)   // write-back buffer of an FS_O_BUFFERED handle, in bytes
+
+/**
+ * Write-back buffer of a handle opened with FS_O_BUFFERED. A write that
+ * continues the previous one is only copied here: blocks, the inode and
+ * the bitmaps are left alone until the buffer is flushed, and the flush
+ * then allocates the blocks of the whole buffer at once (delayed
+ * allocation). It is flushed when full, before any other access through
+ * the handle (read, seek, positional or non-adjacent write), and on
+ * fs_fsync and fs_close. Other handles see the data once it is flushed.
+ */
+struct fs_write_buffer {
+    uint8_t* data;                    // FS_WRITE_BUFFER bytes (NULL = unbuffered handle)
+    uint32_t offset;                  // file position of data[0]
+    uint32_t len;                     // bytes pending
+};
+
 /**
  * Represents an open file with a cursor position for read/write operations.
  */
 typedef struct open_file {
     uint32_t inode_num;               // inode number
-    struct inode inode;               // in-memory copy of the inode
+    struct inode* inode;              // pinned inode-cache copy, shared by all handles
     uint32_t offset;                  // current read/write position
     uint32_t flags;                   // open flags (read/write/append)
     filesystem_t* fs;                 // reference to filesystem
+    struct bmap_cursor cursor;        // block-map state reused within each read/write
+    struct fs_readahead ra;           // sequential-read state
+    struct fs_write_buffer wbuf;      // pending writes (FS_O_BUFFERED)
 } open_file_t;
 
 // === OPEN FLAGS ===
@@ -44,6 +225,10 @@ typedef struct open_file {
 #define FS_O_CREAT     0x08           // create file if it doesn't exist
 #define FS_O_APPEND    0x10           // append writes to end of file
 #define FS_O_TRUNC     0x20           // truncate file upon opening
+#define FS_O_BUFFERED  0x40           // gather small writes (see struct fs_write_buffer)
+
+// === FALLOCATE FLAGS ===
+#define FS_FALLOC_KEEP_SIZE 0x01      // preallocate past the end without growing the file
 
 // === FILESYSTEM LIFECYCLE ===
 
@@ -58,6 +243,25 @@ typedef struct open_file {
  */
 int fs_format(disk_t disk, size_t total_blocks, size_t total_inodes);
 
+/**
+ * Formats a disk with explicit options.
+ * fs_format() is equivalent to passing NULL (block-pointer mapped files).
+ *
+ * The inode table is zeroed in full, so a reused image cannot leave stale
+ * inodes behind. With lazy_itable only the table block holding the root
+ * inode is: on a sparse image file the rest of the table is never
+ * written, and each block is zeroed when its first inode is allocated
+ * (or by fs_itable_init), which makes formatting a large image quick.
+ * 
+ * @param disk The disk to format
+ * @param total_blocks Total number of blocks on the disk
+ * @param total_inodes Total number of inodes to allocate
+ * @param opts Format options, or NULL for defaults
+ * @return SUCCESS or error code
+ */
+int fs_format_with_options(disk_t disk, size_t total_blocks, size_t total_inodes,
+                           const fs_format_options_t* opts);
+
 /**
  * Mounts an existing filesystem from disk.
  * Loads superblock and bitmaps into memory.
@@ -68,6 +272,80 @@ int fs_format(disk_t disk, size_t total_blocks, size_t total_inodes);
  */
 int fs_mount(disk_t disk, filesystem_t** out_fs);
 
+/**
+ * Mounts an existing filesystem with explicit options.
+ * fs_mount() is equivalent to passing NULL (per-operation flushing).
+ *
+ * With map_bitmaps the block and inode bitmaps are not copied into memory:
+ * they point at their regions of the mapped image, so mounting allocates
+ * and copies nothing for them (only their free-space summary is built) and
+ * a metadata flush only marks the changed bitmap blocks for the next sync.
+ * Changed bits can reach the image file before that flush. It takes the
+ * mmap backend and the flat layout without a journal, whose log must see
+ * every metadata block before its home location does. Otherwise the
+ * option is ignored and the bitmaps are copied as usual (see
+ * fs->bitmaps_mapped).
+ * 
+ * @param disk The disk containing the filesystem
+ * @param opts Mount options, or NULL for defaults
+ * @param out_fs Pointer to receive the filesystem handle
+ * @return SUCCESS or error code
+ */
+int fs_mount_with_options(disk_t disk, const fs_mount_options_t* opts, filesystem_t** out_fs);
+
+/**
+ * Flushes all cached metadata (dirty inodes, bitmaps, superblock) to disk
+ * and syncs the disk image.
+ * 
+ * @param fs The filesystem to sync
+ * @return SUCCESS or error code
+ */
+int fs_sync(filesystem_t* fs);
+
+/**
+ * Zeroes up to max_blocks inode-table blocks a lazy format left
+ * uninitialised (see fs_format_with_options), lowest first, and commits
+ * the new marks according to the flush policy. Meant to be called
+ * repeatedly, e.g. from a low-priority thread, with small batches:
+ * allocating inode numbers waits for each batch.
+ *
+ * @param fs The mounted filesystem
+ * @param max_blocks Most table blocks to zero in this call
+ * @param out_remaining Receives the blocks still uninitialised (may be NULL)
+ * @return SUCCESS or error code
+ */
+int fs_itable_init(filesystem_t* fs, uint32_t max_blocks, uint32_t* out_remaining);
+
+/**
+ * Grows a mounted filesystem onto a larger image, without reformatting.
+ * The image file is extended to new_size bytes (remapped with mmap), the
+ * added blocks become free space, and the new geometry is committed with
+ * the bitmaps and superblock in one metadata flush (one journal
+ * transaction). The filesystem is frozen meanwhile, as for fs_check.
+ *
+ * The flat layout grows into the spare bits of its block bitmap; inodes
+ * are not added. With block groups the last group is filled up and whole
+ * groups, each with its own bitmaps and inode table (zeroed unless the
+ * format was lazy), are appended while the descriptor table has room; a
+ * remainder too short for a group's metadata stays unused. With
+ * FS_FEATURE_REFLINK the reference-count table bounds the size too.
+ *
+ * @param fs The mounted filesystem
+ * @param new_size Image size in bytes
+ * @return SUCCESS (also when new_size adds no whole group), ERROR_INVALID
+ *         for a size below the current one, ERROR_NO_SPACE past what the
+ *         layout can address (see fs_grow_limit)
+ */
+int fs_grow(filesystem_t* fs, size_t new_size);
+
+/**
+ * Largest image size in bytes fs_grow() accepts for this filesystem.
+ *
+ * @param fs The mounted filesystem
+ * @return The size, or 0 for a NULL filesystem
+ */
+size_t fs_grow_limit(const filesystem_t* fs);
+
 /**
  * Unmounts a filesystem, writes back metadata, and frees all resources.
  * 
@@ -101,13 +379,23 @@ int fs_cd(filesystem_t* fs, const char* path);
 int fs_open(filesystem_t* fs, const char* path, uint32_t flags, open_file_t** out_file);
 
 /**
- * Closes an open file descriptor.
+ * Closes an open file descriptor, flushing its write-back buffer.
+ * The handle is released even if the flush fails.
  * 
  * @param file The file to close
- * @return SUCCESS or error code
+ * @return SUCCESS or error code of the flush
  */
 int fs_close(open_file_t* file);
 
+/**
+ * Flushes the handle's write-back buffer, then makes every metadata
+ * change and the disk image durable (as fs_sync).
+ * 
+ * @param file The open file
+ * @return SUCCESS or error code
+ */
+int fs_fsync(open_file_t* file);
+
 /**
  * Reads data from an open file.
  * 
@@ -130,6 +418,57 @@ int fs_read(open_file_t* file, void* buffer, size_t size, size_t* bytes_read);
  */
 int fs_write(open_file_t* file, const void* buffer, size_t size, size_t* bytes_written);
 
+/**
+ * Reads from an explicit position; the file cursor is left unchanged.
+ * One handle may be used by several threads at once for fs_pread/fs_pwrite.
+ * 
+ * @param file The open file
+ * @param buffer Buffer to receive data
+ * @param size Number of bytes to read
+ * @param offset Position to read from
+ * @param bytes_read Pointer to receive actual bytes read (short at end of file)
+ * @return SUCCESS or error code
+ */
+int fs_pread(open_file_t* file, void* buffer, size_t size, uint32_t offset, size_t* bytes_read);
+
+/**
+ * Writes at an explicit position; the file cursor is left unchanged.
+ * 
+ * @param file The open file
+ * @param buffer Data to write
+ * @param size Number of bytes to write
+ * @param offset Position to write at
+ * @param bytes_written Pointer to receive actual bytes written
+ * @return SUCCESS or error code
+ */
+int fs_pwrite(open_file_t* file, const void* buffer, size_t size, uint32_t offset,
+              size_t* bytes_written);
+
+/**
+ * Reads into several buffers in turn, from the cursor, in one call.
+ * The buffers are filled in order; the read stops early at end of file.
+ * 
+ * @param file The open file
+ * @param iov Buffers to fill
+ * @param iovcnt Number of buffers
+ * @param bytes_read Pointer to receive the total bytes read
+ * @return SUCCESS or error code
+ */
+int fs_readv(open_file_t* file, const struct iovec* iov, int iovcnt, size_t* bytes_read);
+
+/**
+ * Writes several buffers back to back, from the cursor, in one call.
+ * The whole batch is written under one lock hold and the metadata is
+ * persisted once, after the last buffer.
+ * 
+ * @param file The open file
+ * @param iov Buffers to write
+ * @param iovcnt Number of buffers
+ * @param bytes_written Pointer to receive the total bytes written
+ * @return SUCCESS or error code
+ */
+int fs_writev(open_file_t* file, const struct iovec* iov, int iovcnt, size_t* bytes_written);
+
 /**
  * Moves the file cursor to a specific position.
  * 
@@ -139,6 +478,42 @@ int fs_write(open_file_t* file, const void* buffer, size_t size, size_t* bytes_w
  */
 int fs_seek(open_file_t* file, uint32_t offset);
 
+/**
+ * Sets the size of a file. Shrinking releases the blocks past the new end
+ * (preallocated ones too); growing leaves a hole that reads as zeros.
+ * 
+ * @param fs The filesystem
+ * @param path Path to the file
+ * @param new_size New size in bytes
+ * @return SUCCESS or error code
+ */
+int fs_truncate(filesystem_t* fs, const char* path, uint32_t new_size);
+
+/**
+ * fs_truncate() through an open (writable) handle; the cursor is left
+ * where it is.
+ * 
+ * @param file The open file
+ * @param new_size New size in bytes
+ * @return SUCCESS or error code
+ */
+int fs_ftruncate(open_file_t* file, uint32_t new_size);
+
+/**
+ * Allocates zeroed blocks for every hole in [offset, offset + len), as few
+ * contiguous runs as the free space allows, so that later writes to the
+ * range neither allocate nor touch the bitmaps. The file grows to cover the
+ * range unless FS_FALLOC_KEEP_SIZE is given. On ERROR_NO_SPACE the blocks
+ * allocated so far are kept.
+ * 
+ * @param file The open (writable) file
+ * @param offset Start of the range
+ * @param len Length of the range (> 0)
+ * @param flags 0 or FS_FALLOC_KEEP_SIZE
+ * @return SUCCESS or error code
+ */
+int fs_fallocate(open_file_t* file, uint32_t offset, uint32_t len, uint32_t flags);
+
 // === FILE/DIRECTORY CREATION AND DELETION ===
 
 /**
@@ -193,6 +568,62 @@ int fs_rmdir(filesystem_t* fs, const char* path);
  */
 int fs_link(filesystem_t* fs, const char* existing_path, const char* new_path);
 
+// === FILE CLONES ===
+
+/**
+ * Creates new_path as a copy of the file at existing_path that shares its
+ * data blocks (a reflink): only the mapping is copied, so the time taken
+ * depends on the mapping blocks, not on the size. Each shared block holds
+ * one reference per file mapping it (see block_alloc.h); the first write
+ * to it through either file moves that file's range to fresh blocks
+ * (copy-on-write), and it is freed with its last reference. The two files
+ * are independent otherwise: the clone is a new inode with its own link
+ * count and times, and the permissions of the source.
+ *
+ * Sharing blocks needs FS_FEATURE_REFLINK (fs_format_options_t.reflink);
+ * without it only files without blocks (empty or inline) can be cloned.
+ * Bytes still in another handle's write-back buffer are not part of the
+ * clone. In an extent-mapped file each copied range splits an extent, so
+ * scattered writes to a clone fail with ERROR_NO_SPACE once the
+ * BMAP_MAX_EXTENTS records are used up, as scattered holes do.
+ *
+ * @param fs The filesystem
+ * @param existing_path Path to the file to clone
+ * @param new_path Path for the clone (must not exist)
+ * @return SUCCESS, ERROR_EXISTS, ERROR_INVALID (a directory, or blocks
+ *         without FS_FEATURE_REFLINK), ERROR_NO_SPACE (mapping blocks, or a
+ *         block already shared by too many files) or another error code
+ */
+int fs_clone(filesystem_t* fs, const char* existing_path, const char* new_path);
+
+// === FILE COMPRESSION ===
+
+#define FS_COMPRESS_CHUNK (32 * 1024) // bytes compressed as a unit (at least four blocks)
+
+/**
+ * Switches a regular file to compressed storage or back (on = false),
+ * rewriting its data. A compressed file (INODE_FLAG_COMPRESSED) is cut
+ * into chunks of FS_COMPRESS_CHUNK bytes (four blocks with larger
+ * blocks), each compressed on its own with LZ4 when that saves at least
+ * one block and stored as is otherwise; reads decompress whole chunks and
+ * writes recompress the chunks they touch, so the mode suits files that
+ * are read far more than they are written. Recently decompressed chunks
+ * are cached. The file keeps its size; fs_stat tells the blocks it uses.
+ *
+ * Compressed files are mapped with block pointers whatever the format
+ * (a compressed chunk leaves a hole behind it, an extent record each),
+ * and cannot be preallocated: fs_fallocate only moves their size. An
+ * inline file only takes the flag, and is compressed once it leaves the
+ * inode.
+ *
+ * @param fs The filesystem
+ * @param path Path to the file
+ * @param on true to compress, false to store the data plainly
+ * @return SUCCESS, ERROR_INVALID (not a regular file), ERROR_NO_SPACE (the
+ *         file is left as it was) or another error code
+ */
+int fs_set_compression(filesystem_t* fs, const char* path, bool on);
+
 // === DIRECTORY LISTING ===
 
 /**
@@ -206,6 +637,64 @@ int fs_link(filesystem_t* fs, const char* existing_path, const char* new_path);
  */
 int fs_list(filesystem_t* fs, const char* path, struct dentry** out_entries, uint32_t* out_count);
 
+/**
+ * Directory stream: reads entries straight from the dentry blocks, a
+ * caller-sized batch at a time, without copying the whole directory.
+ * Each fs_readdir call takes ns_lock shared on its own, so entries added
+ * or removed between calls may or may not be returned.
+ */
+typedef struct fs_dir {
+    filesystem_t* fs;                 // reference to filesystem
+    uint32_t inode_num;               // directory being read
+    uint32_t pos;                     // position of the next entry (see fs_telldir)
+} fs_dir_t;
+
+/**
+ * Opens a directory stream positioned at the first entry.
+ *
+ * @param fs The filesystem
+ * @param path Path to the directory
+ * @param out_dir Pointer to receive the stream
+ * @return SUCCESS, ERROR_NOT_FOUND, or ERROR_INVALID if path is not a directory
+ */
+int fs_opendir(filesystem_t* fs, const char* path, fs_dir_t** out_dir);
+
+/**
+ * Reads the next entries of a directory stream.
+ *
+ * @param dir The directory stream
+ * @param out_entries Array receiving up to max entries
+ * @param max Capacity of out_entries
+ * @param out_count Pointer to receive the number of entries read (0 at the end)
+ * @return SUCCESS or error code
+ */
+int fs_readdir(fs_dir_t* dir, struct dentry* out_entries, uint32_t max, uint32_t* out_count);
+
+/**
+ * Returns the position of the next entry, to be passed to fs_seekdir later
+ * (on this or another stream of the same directory).
+ *
+ * @param dir The directory stream
+ * @return Current position
+ */
+uint32_t fs_telldir(const fs_dir_t* dir);
+
+/**
+ * Moves a directory stream to a position returned by fs_telldir
+ * (0 = back to the first entry).
+ *
+ * @param dir The directory stream
+ * @param pos Position to resume from
+ */
+void fs_seekdir(fs_dir_t* dir, uint32_t pos);
+
+/**
+ * Closes a directory stream.
+ *
+ * @param dir The directory stream
+ */
+void fs_closedir(fs_dir_t* dir);
+
 // === FILE/DIRECTORY INFORMATION ===
 
 /**
@@ -220,6 +709,9 @@ int fs_getcwd(filesystem_t* fs, char* buffer, size_t size);
 
 /**
  * Retrieves information about a file or directory.
+ * The inode's size is the logical size of the contents; blocks_used
+ * (times the block size) is the space they take, mapping blocks included,
+ * which is less for a sparse or compressed file.
  * 
  * @param fs The filesystem
  * @param path Path to the file/directory
@@ -231,6 +723,84 @@ int fs_getcwd(filesystem_t* fs, char* buffer, size_t size);
  */
 int fs_stat(filesystem_t* fs, const char* path, struct inode* out_inode, uint32_t* out_inode_num, char* out_abs_path, size_t out_abs_path_size);
 
+// === CONSISTENCY CHECK ===
+
+#define FS_CHECK_MAX_THREADS 16       // workers fs_check starts at most
+
+/**
+ * Options accepted by fs_check().
+ */
+typedef struct fs_check_options {
+    uint32_t threads;                 // workers (0 = one per online CPU)
+    bool repair;                      // fix what can be fixed safely
+    bool verbose;                     // print every problem found
+} fs_check_options_t;
+
+/**
+ * What fs_check() found. The error counters describe the filesystem as it
+ * was before any repair.
+ */
+typedef struct fs_check_report {
+    uint32_t threads;                 // workers used
+    uint32_t inodes_used;             // inodes found in use in the table
+    uint32_t directories;             // directories scanned
+    uint64_t blocks_owned;            // blocks mapped by inodes (data and mapping)
+
+    uint32_t bad_inodes;              // unknown type, or a free root
+    uint32_t inode_bitmap_errors;     // bitmap bit disagrees with the inode table
+    uint32_t bad_blocks;              // block pointers outside the disk
+    uint32_t duplicate_blocks;        // blocks claimed twice, or metadata claimed
+    uint32_t blocks_used_errors;      // blocks_used differs from the mapping
+    uint32_t block_leaks;             // marked used in the bitmap, owned by nobody
+    uint32_t blocks_unmarked;         // owned, marked free in the bitmap
+    uint32_t dir_errors;              // missing or wrong "." / "..", unreadable directory
+    uint32_t dangling_entries;        // entries naming a free or unknown inode
+    uint32_t link_count_errors;       // links_count differs from the entries found
+    uint32_t orphans;                 // inodes in use that no entry names
+    uint32_t counter_errors;          // superblock / group free counters off
+    uint32_t refcount_errors;         // shared-block reference counts off
+
+    uint32_t errors;                  // sum of the counters above
+    uint32_t repaired;                // problems fixed (repair mode)
+} fs_check_report_t;
+
+/**
+ * Checks a mounted filesystem for consistency: the inode table against the
+ * inode bitmap, block ownership against the block bitmap (double
+ * allocations, leaks, blocks in use but marked free), the "." and ".."
+ * entries of every directory, and every links_count against the entries
+ * naming the inode. With FS_FEATURE_REFLINK a data block may be mapped by
+ * several files: it is a duplicate only when the reference-count table
+ * does not account for every file mapping it.
+ *
+ * The inode table is split into ranges of whole table blocks, scanned by
+ * several threads in two passes: the first claims every inode's blocks
+ * in a shared ownership map, the second walks the directories and counts
+ * references; a final single-threaded pass compares the results with the
+ * bitmaps and counters. The filesystem is frozen meanwhile (ns_lock and
+ * every inode lock held exclusively) after its metadata is flushed.
+ *
+ * With repair, dangling entries are removed, "." and ".." rewritten,
+ * links_count set to the references found, and the bitmaps, free
+ * counters and reference counts rebuilt from the blocks and inodes
+ * actually in use. Duplicate
+ * blocks and orphans are only reported.
+ *
+ * @param fs The filesystem
+ * @param opts Check options, or NULL (read-only, one thread per CPU)
+ * @param out_report Receives the findings
+ * @return SUCCESS when the check ran (see out_report->errors), or an error
+ *         code if it could not complete
+ */
+int fs_check(filesystem_t* fs, const fs_check_options_t* opts, fs_check_report_t* out_report);
+
+/**
+ * Prints a fs_check() report.
+ *
+ * @param report The report
+ */
+void fs_check_print(const fs_check_report_t* report);
+
 // === UTILITIES ===
 
 /**
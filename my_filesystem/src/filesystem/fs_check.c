@@ -0,0 +1,718 @@
+#include "fs.h"
+#include "fs_internal.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// owner recorded for the blocks of the filesystem's own metadata
+#define OWNER_METADATA UINT32_MAX
+
+// entries read per dentry_iterate call in the directory pass
+#define CHECK_DIR_BATCH 32
+
+// === CHECK STATE ===
+
+// an entry to remove in repair mode
+struct dangling {
+    uint32_t dir;
+    char name[MAX_FILENAME];
+};
+
+struct check_worker {
+    struct check_ctx* ctx;
+    pthread_t thread;
+    uint32_t first, end;              // inode range [first, end)
+    bool threaded;                    // runs in its own thread (joined after the pass)
+    int status;
+};
+
+struct check_ctx {
+    filesystem_t* fs;
+    bool repair;
+    bool verbose;
+    bool quiet;                       // rescan after a repair: nothing is reported
+
+    // shared by the workers, one slot per block / inode
+    uint32_t* owner;                  // inode owning each block (0 = nobody)
+    uint8_t* type;                    // inode type found in the table (bad ones: free)
+    uint32_t* refs;                   // entries naming each inode
+    uint32_t* dot;                    // target of a directory's "." (0 = none)
+    uint32_t* dotdot;                 // target of a directory's ".." (0 = none)
+    uint32_t* named_in;               // directory holding the entry of a subdirectory
+
+    // FS_FEATURE_REFLINK only (NULL otherwise)
+    uint16_t* shared;                 // reference-count table entries as found
+    uint16_t* claims;                 // data mappings naming each block
+
+    struct dangling* dangling;        // entries to remove (repair mode)
+    uint32_t dangling_count, dangling_cap;
+
+    struct check_worker workers[FS_CHECK_MAX_THREADS];
+    uint32_t nworkers;
+
+    pthread_mutex_t lock;             // dangling list and printing
+    fs_check_report_t report;         // counters updated atomically
+};
+
+// === PRIVATE FUNCTIONS ===
+
+static void problem(struct check_ctx* ctx, uint32_t* counter, const char* fmt, ...) {
+    if (ctx->quiet)
+        return;
+    __atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);
+    if (!ctx->verbose)
+        return;
+
+    va_list args;
+    va_start(args, fmt);
+    pthread_mutex_lock(&ctx->lock);
+    printf("fsck: ");
+    vprintf(fmt, args);
+    printf("\n");
+    pthread_mutex_unlock(&ctx->lock);
+    va_end(args);
+}
+
+static inline bool in_use(const struct check_ctx* ctx, uint32_t inode_num) {
+    return inode_num != INVALID_INODE_NUM && inode_num < ctx->fs->sb.total_inodes &&
+           ctx->type[inode_num] != INODE_TYPE_FREE;
+}
+
+// the superblock, group descriptors, bitmaps, inode tables and journal
+static void claim_metadata(struct check_ctx* ctx) {
+    const struct superblock* sb = &ctx->fs->sb;
+    memset(ctx->owner, 0, (size_t)sb->total_blocks * sizeof(uint32_t));
+    if (ctx->claims)
+        memset(ctx->claims, 0, (size_t)sb->total_blocks * sizeof(uint16_t));
+
+    uint32_t groups = (sb->features & FS_FEATURE_GROUPS) ? sb->group_count : 1;
+    for (uint32_t g = 0; g < groups; g++) {
+        struct group_desc d;
+        superblock_group_desc(sb, g, &d);
+        uint32_t first = (g == 0) ? SUPERBLOCK_BLOCK_NUM : d.block_bitmap;
+        for (uint32_t b = first; b < d.first_data_block && b < sb->total_blocks; b++)
+            ctx->owner[b] = OWNER_METADATA;
+    }
+}
+
+// --- table pass ---
+
+struct claim {
+    struct check_ctx* ctx;
+    uint32_t inode_num;
+    uint64_t blocks;                  // blocks the mapping names
+};
+
+static int claim_run(uint32_t start, uint32_t count, bool meta, void* arg) {
+    struct claim* c = arg;
+    struct check_ctx* ctx = c->ctx;
+    uint32_t total = ctx->fs->sb.total_blocks;
+
+    c->blocks += count;
+    uint64_t end = (uint64_t)start + count;
+    if (end > total) {
+        problem(ctx, &ctx->report.bad_blocks, "inode %u: blocks %u..%llu past the end of the disk",
+                c->inode_num, MAX(start, total), (unsigned long long)end - 1);
+        end = total;
+    }
+
+    for (uint64_t b = start; b < end; b++) {
+        if (ctx->claims && !meta)
+            __atomic_add_fetch(&ctx->claims[b], 1, __ATOMIC_RELAXED);
+
+        uint32_t prev = 0;
+        if (__atomic_compare_exchange_n(&ctx->owner[b], &prev, c->inode_num, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            continue;
+        // a data block the table marks shared may have several owners; the
+        // count itself is checked in merge_blocks
+        if (ctx->shared && !meta && prev != OWNER_METADATA && ctx->shared[b] > 0)
+            continue;
+        if (prev == OWNER_METADATA)
+            problem(ctx, &ctx->report.duplicate_blocks,
+                    "inode %u: block %llu is filesystem metadata", c->inode_num,
+                    (unsigned long long)b);
+        else
+            problem(ctx, &ctx->report.duplicate_blocks,
+                    "block %llu claimed by inodes %u and %u", (unsigned long long)b,
+                    prev, c->inode_num);
+    }
+    return 0;
+}
+
+// inode types against the inode bitmap, and block ownership
+static void* table_pass(void* arg) {
+    struct check_worker* w = arg;
+    struct check_ctx* ctx = w->ctx;
+    filesystem_t* fs = ctx->fs;
+
+    for (uint32_t ino = MAX(w->first, 1u); ino < w->end; ino++) {
+        struct inode inode;
+        if (inode_load(fs, ino, &inode) != SUCCESS) {
+            w->status = ERROR_IO;
+            break;
+        }
+
+        bool marked = bitmap_get(fs->inode_bitmap, ino);
+        if (inode.type != INODE_TYPE_FREE && inode.type != INODE_TYPE_FILE &&
+            inode.type != INODE_TYPE_DIRECTORY) {
+            problem(ctx, &ctx->report.bad_inodes, "inode %u: unknown type %u", ino, inode.type);
+            ctx->type[ino] = INODE_TYPE_FREE;
+            continue;
+        }
+        ctx->type[ino] = inode.type;
+
+        if (inode.type == INODE_TYPE_FREE) {
+            if (marked)
+                problem(ctx, &ctx->report.inode_bitmap_errors,
+                        "inode %u is free but marked in use", ino);
+            continue;
+        }
+
+        if (!ctx->quiet)
+            __atomic_add_fetch(&ctx->report.inodes_used, 1, __ATOMIC_RELAXED);
+        if (!marked)
+            problem(ctx, &ctx->report.inode_bitmap_errors,
+                    "inode %u is in use but marked free", ino);
+
+        struct claim c = { ctx, ino, 0 };
+        int res = bmap_for_each_block(fs, &inode, claim_run, &c);
+        if (res != SUCCESS) {
+            w->status = res;
+            break;
+        }
+        if (!ctx->quiet)
+            __atomic_add_fetch(&ctx->report.blocks_owned, c.blocks, __ATOMIC_RELAXED);
+        if (c.blocks != inode.blocks_used)
+            problem(ctx, &ctx->report.blocks_used_errors,
+                    "inode %u: blocks_used %u, mapping has %llu", ino, inode.blocks_used,
+                    (unsigned long long)c.blocks);
+        if (bmap_is_inline(&inode) &&
+            (inode.type != INODE_TYPE_FILE || inode.size > BMAP_INLINE_MAX))
+            problem(ctx, &ctx->report.bad_inodes, "inode %u: %u bytes of inline data in a %s",
+                    ino, inode.size, inode.type == INODE_TYPE_FILE ? "file" : "directory");
+    }
+    return NULL;
+}
+
+// --- directory pass ---
+
+static void note_dangling(struct check_ctx* ctx, uint32_t dir, const char* name) {
+    if (!ctx->repair)
+        return;
+
+    pthread_mutex_lock(&ctx->lock);
+    if (ctx->dangling_count == ctx->dangling_cap) {
+        uint32_t cap = ctx->dangling_cap ? ctx->dangling_cap * 2 : 16;
+        struct dangling* grown = realloc(ctx->dangling, cap * sizeof(struct dangling));
+        if (!grown) {
+            pthread_mutex_unlock(&ctx->lock);
+            return;                   // left for the next run
+        }
+        ctx->dangling = grown;
+        ctx->dangling_cap = cap;
+    }
+    struct dangling* d = &ctx->dangling[ctx->dangling_count++];
+    d->dir = dir;
+    strncpy(d->name, name, MAX_FILENAME - 1);
+    d->name[MAX_FILENAME - 1] = '\0';
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+static void check_entry(struct check_ctx* ctx, uint32_t dir, const struct dentry* e) {
+    uint32_t target = e->inode_num;
+    bool is_dot = strcmp(e->name, ".") == 0;
+    bool is_dotdot = strcmp(e->name, "..") == 0;
+
+    if (is_dot)
+        ctx->dot[dir] = target;
+    else if (is_dotdot)
+        ctx->dotdot[dir] = target;
+
+    if (!in_use(ctx, target)) {
+        // wrong dots are reported (and fixed) with the directory
+        if (is_dot || is_dotdot)
+            return;
+        problem(ctx, &ctx->report.dangling_entries,
+                "directory %u: entry '%s' names free inode %u", dir, e->name, target);
+        note_dangling(ctx, dir, e->name);
+        return;
+    }
+    __atomic_add_fetch(&ctx->refs[target], 1, __ATOMIC_RELAXED);
+
+    // a subdirectory is named by exactly one entry besides its own dots
+    if (is_dot || is_dotdot || ctx->type[target] != INODE_TYPE_DIRECTORY)
+        return;
+    uint32_t prev = 0;
+    if (!__atomic_compare_exchange_n(&ctx->named_in[target], &prev, dir, false,
+                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        problem(ctx, &ctx->report.dir_errors, "directory %u is named in directories %u and %u",
+                target, prev, dir);
+}
+
+// directory entries: dots, dangling names, references
+static void* dir_pass(void* arg) {
+    struct check_worker* w = arg;
+    struct check_ctx* ctx = w->ctx;
+
+    struct dentry entries[CHECK_DIR_BATCH];
+    for (uint32_t ino = MAX(w->first, 1u); ino < w->end; ino++) {
+        if (ctx->type[ino] != INODE_TYPE_DIRECTORY)
+            continue;
+        __atomic_add_fetch(&ctx->report.directories, 1, __ATOMIC_RELAXED);
+
+        uint32_t pos = 0, count;
+        do {
+            if (dentry_iterate(ctx->fs, ino, &pos, entries, CHECK_DIR_BATCH, &count) != SUCCESS) {
+                problem(ctx, &ctx->report.dir_errors, "directory %u cannot be read", ino);
+                break;
+            }
+            for (uint32_t i = 0; i < count; i++)
+                check_entry(ctx, ino, &entries[i]);
+        } while (count > 0);
+    }
+    return NULL;
+}
+
+// runs pass over every worker's inode range, each in its own thread
+static int run_pass(struct check_ctx* ctx, void* (*pass)(void*)) {
+    for (uint32_t i = 0; i < ctx->nworkers; i++) {
+        struct check_worker* w = &ctx->workers[i];
+        w->status = SUCCESS;
+        w->threaded = pthread_create(&w->thread, NULL, pass, w) == 0;
+        if (!w->threaded)
+            pass(w);                  // no thread: do the range here
+    }
+
+    int res = SUCCESS;
+    for (uint32_t i = 0; i < ctx->nworkers; i++) {
+        struct check_worker* w = &ctx->workers[i];
+        if (w->threaded)
+            pthread_join(w->thread, NULL);
+        if (res == SUCCESS)
+            res = w->status;
+    }
+    return res;
+}
+
+// splits the inode table into ranges of whole table blocks
+static void plan_workers(struct check_ctx* ctx, uint32_t threads) {
+    const struct superblock* sb = &ctx->fs->sb;
+    uint32_t per_block = sb->block_size / sb->inode_size;
+    uint32_t units = (sb->total_inodes + per_block - 1) / per_block;
+
+    if (threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (uint32_t)cpus : 1;
+    }
+    threads = MAX(1u, MIN(threads, MIN((uint32_t)FS_CHECK_MAX_THREADS, units)));
+
+    uint32_t per_worker = (units + threads - 1) / threads;
+    ctx->nworkers = 0;
+    for (uint32_t u = 0; u < units; u += per_worker) {
+        struct check_worker* w = &ctx->workers[ctx->nworkers++];
+        w->ctx = ctx;
+        w->first = u * per_block;
+        w->end = MIN((u + per_worker) * per_block, sb->total_inodes);
+    }
+}
+
+// --- merge ---
+
+static uint32_t expected_parent(const struct check_ctx* ctx, uint32_t dir) {
+    return dir == ROOT_INODE_NUM ? ROOT_INODE_NUM : ctx->named_in[dir];
+}
+
+// directory dots and link counts
+static void merge_inodes(struct check_ctx* ctx) {
+    filesystem_t* fs = ctx->fs;
+
+    if (ctx->type[ROOT_INODE_NUM] != INODE_TYPE_DIRECTORY)
+        problem(ctx, &ctx->report.bad_inodes, "root inode %u is not a directory", ROOT_INODE_NUM);
+
+    for (uint32_t ino = 1; ino < fs->sb.total_inodes; ino++) {
+        if (!in_use(ctx, ino))
+            continue;
+
+        if (ctx->type[ino] == INODE_TYPE_DIRECTORY) {
+            if (ctx->dot[ino] != ino)
+                problem(ctx, &ctx->report.dir_errors, "directory %u: '.' names %u",
+                        ino, ctx->dot[ino]);
+            uint32_t parent = expected_parent(ctx, ino);
+            if (parent != 0 && ctx->dotdot[ino] != parent)
+                problem(ctx, &ctx->report.dir_errors, "directory %u: '..' names %u, parent is %u",
+                        ino, ctx->dotdot[ino], parent);
+        }
+
+        struct inode inode;
+        if (inode_read(fs, ino, &inode) != SUCCESS)
+            continue;
+        if (ctx->refs[ino] == 0)
+            problem(ctx, &ctx->report.orphans, "inode %u is in use but no entry names it", ino);
+        else if (inode.links_count != ctx->refs[ino])
+            problem(ctx, &ctx->report.link_count_errors, "inode %u: links_count %u, %u entries",
+                    ino, inode.links_count, ctx->refs[ino]);
+    }
+}
+
+// blocks owned in [first, end)
+static uint32_t owned_in(const struct check_ctx* ctx, uint32_t first, uint32_t end) {
+    uint32_t n = 0;
+    for (uint32_t b = first; b < end; b++)
+        n += ctx->owner[b] != 0;
+    return n;
+}
+
+// inodes in use in [first, end), and the directories among them
+static uint32_t used_in(const struct check_ctx* ctx, uint32_t first, uint32_t end) {
+    uint32_t n = 0;
+    for (uint32_t i = MAX(first, 1u); i < end; i++)
+        n += ctx->type[i] != INODE_TYPE_FREE;
+    return n;
+}
+
+static uint32_t dirs_in(const struct check_ctx* ctx, uint32_t first, uint32_t end) {
+    uint32_t n = 0;
+    for (uint32_t i = MAX(first, 1u); i < end; i++)
+        n += ctx->type[i] == INODE_TYPE_DIRECTORY;
+    return n;
+}
+
+// reference-count table entry block b should have: its mappings beyond the first
+static inline uint16_t refs_wanted(const struct check_ctx* ctx, uint32_t b) {
+    return ctx->claims[b] > 1 ? (uint16_t)(ctx->claims[b] - 1) : 0;
+}
+
+// the bitmaps and free counters against what is actually in use
+static void merge_blocks(struct check_ctx* ctx) {
+    filesystem_t* fs = ctx->fs;
+    const struct superblock* sb = &fs->sb;
+
+    for (uint32_t b = 0; b < sb->total_blocks; b++) {
+        bool used = ctx->owner[b] != 0;
+        bool marked = bitmap_get(fs->block_bitmap, b);
+        if (used && !marked)
+            problem(ctx, &ctx->report.blocks_unmarked, "block %u is in use but marked free", b);
+        else if (!used && marked)
+            problem(ctx, &ctx->report.block_leaks, "block %u is marked in use but unowned", b);
+        if (ctx->shared && ctx->shared[b] != refs_wanted(ctx, b))
+            problem(ctx, &ctx->report.refcount_errors,
+                    "block %u: %u extra references recorded, %u mapped", b, ctx->shared[b],
+                    refs_wanted(ctx, b));
+    }
+    if (!bitmap_get(fs->inode_bitmap, INVALID_INODE_NUM))
+        problem(ctx, &ctx->report.inode_bitmap_errors, "reserved inode 0 is marked free");
+
+    uint32_t free_blocks = sb->total_blocks - owned_in(ctx, 0, sb->total_blocks);
+    uint32_t free_inodes = sb->total_inodes - 1 -
+                           used_in(ctx, 0, sb->total_inodes);
+    if (__atomic_load_n(&fs->sb.free_blocks, __ATOMIC_RELAXED) != free_blocks)
+        problem(ctx, &ctx->report.counter_errors, "superblock: %u free blocks, %u counted",
+                fs->sb.free_blocks, free_blocks);
+    if (__atomic_load_n(&fs->sb.free_inodes, __ATOMIC_RELAXED) != free_inodes)
+        problem(ctx, &ctx->report.counter_errors, "superblock: %u free inodes, %u counted",
+                fs->sb.free_inodes, free_inodes);
+
+    for (uint32_t g = 0; fs->groups && g < sb->group_count; g++) {
+        const struct block_group* grp = &fs->groups[g];
+        uint32_t first = g * sb->blocks_per_group;
+        uint32_t ifirst = g * sb->inodes_per_group, iend = ifirst + sb->inodes_per_group;
+        uint32_t reserved = (g == 0) ? 1 : 0;   // inode 0
+
+        if (grp->desc.free_blocks != (grp->end_block - first) - owned_in(ctx, first, grp->end_block) ||
+            grp->desc.free_inodes != sb->inodes_per_group - reserved -
+                                     used_in(ctx, ifirst, iend) ||
+            grp->desc.used_dirs != dirs_in(ctx, ifirst, iend))
+            problem(ctx, &ctx->report.counter_errors, "group %u: counters off", g);
+    }
+}
+
+// --- repair ---
+
+// replaces entry `name` of dir (if any) with one naming target
+static int rewrite_entry(struct check_ctx* ctx, uint32_t dir, const char* name,
+                         uint32_t old_target, uint32_t target) {
+    filesystem_t* fs = ctx->fs;
+    if (old_target != 0) {
+        int res = dentry_remove(fs, dir, name);
+        if (res != SUCCESS)
+            return res;
+        if (in_use(ctx, old_target))
+            ctx->refs[old_target]--;
+    }
+
+    struct dentry entry;
+    uint32_t allocated = 0;
+    int res = dentry_create(name, target, INODE_TYPE_DIRECTORY, &entry);
+    if (res == SUCCESS)
+        res = dentry_add(fs, dir, &entry, &allocated);
+    if (res != SUCCESS)
+        return res;
+    ctx->refs[target]++;
+    return SUCCESS;
+}
+
+// entries and links_count; returns whether a directory changed
+static bool repair_namespace(struct check_ctx* ctx) {
+    filesystem_t* fs = ctx->fs;
+    bool changed = false;
+
+    for (uint32_t i = 0; i < ctx->dangling_count; i++) {
+        struct dangling* d = &ctx->dangling[i];
+        if (dentry_remove(fs, d->dir, d->name) != SUCCESS)
+            continue;
+        ctx->report.repaired++;
+        changed = true;
+    }
+
+    for (uint32_t ino = 1; ino < fs->sb.total_inodes; ino++) {
+        if (ctx->type[ino] != INODE_TYPE_DIRECTORY)
+            continue;
+        if (ctx->dot[ino] != ino &&
+            rewrite_entry(ctx, ino, ".", ctx->dot[ino], ino) == SUCCESS) {
+            ctx->report.repaired++;
+            changed = true;
+        }
+        uint32_t parent = expected_parent(ctx, ino);
+        if (parent != 0 && ctx->dotdot[ino] != parent &&
+            rewrite_entry(ctx, ino, "..", ctx->dotdot[ino], parent) == SUCCESS) {
+            ctx->report.repaired++;
+            changed = true;
+        }
+    }
+
+    for (uint32_t ino = 1; ino < fs->sb.total_inodes; ino++) {
+        struct inode inode;
+        if (inode_load(fs, ino, &inode) != SUCCESS)
+            continue;
+
+        // unknown types are released; their blocks go with the bitmap rebuild
+        if (ctx->type[ino] == INODE_TYPE_FREE) {
+            if (inode.type != INODE_TYPE_FREE) {
+                struct inode zero = { 0 };
+                if (inode_write(fs, ino, &zero) == SUCCESS)
+                    ctx->report.repaired++;
+            }
+            continue;
+        }
+
+        if (inode_read(fs, ino, &inode) != SUCCESS || ctx->refs[ino] == 0 ||
+            inode.links_count == ctx->refs[ino])
+            continue;
+        inode.links_count = (uint16_t)ctx->refs[ino];
+        if (inode_write(fs, ino, &inode) == SUCCESS)
+            ctx->report.repaired++;
+    }
+    return changed;
+}
+
+// bits of bmp in [first, end) set to want(i); returns the bits changed
+static uint32_t fix_bits(struct bitmap* bmp, uint32_t first, uint32_t end,
+                         bool (*want)(const struct check_ctx*, uint32_t),
+                         const struct check_ctx* ctx) {
+    uint32_t fixed = 0;
+    for (uint32_t i = first; i < end; i++) {
+        bool used = want(ctx, i);
+        if (used == bitmap_get(bmp, i))
+            continue;
+        if (used)
+            bitmap_set(bmp, i);
+        else
+            bitmap_clear(bmp, i);
+        fixed++;
+    }
+    return fixed;
+}
+
+static bool block_wanted(const struct check_ctx* ctx, uint32_t b) {
+    return ctx->owner[b] != 0;
+}
+
+static bool inode_wanted(const struct check_ctx* ctx, uint32_t i) {
+    return i == INVALID_INODE_NUM || ctx->type[i] != INODE_TYPE_FREE;
+}
+
+// bitmaps and free counters rebuilt from the ownership map
+static void repair_allocation(struct check_ctx* ctx) {
+    filesystem_t* fs = ctx->fs;
+    struct superblock* sb = &fs->sb;
+
+    pthread_mutex_lock(&fs->alloc_lock);
+    block_groups_lock_all(fs);
+
+    ctx->report.repaired += fix_bits(fs->block_bitmap, 0, sb->total_blocks, block_wanted, ctx);
+    ctx->report.repaired += fix_bits(fs->inode_bitmap, 0, sb->total_inodes, inode_wanted, ctx);
+
+    uint32_t free_blocks = sb->total_blocks - owned_in(ctx, 0, sb->total_blocks);
+    uint32_t free_inodes = sb->total_inodes - 1 -
+                           used_in(ctx, 0, sb->total_inodes);
+    if (sb->free_blocks != free_blocks || sb->free_inodes != free_inodes) {
+        __atomic_store_n(&sb->free_blocks, free_blocks, __ATOMIC_RELAXED);
+        __atomic_store_n(&sb->free_inodes, free_inodes, __ATOMIC_RELAXED);
+        ctx->report.repaired++;
+    }
+
+    for (uint32_t g = 0; fs->groups && g < sb->group_count; g++) {
+        struct block_group* grp = &fs->groups[g];
+        uint32_t first = g * sb->blocks_per_group;
+        uint32_t ifirst = g * sb->inodes_per_group, iend = ifirst + sb->inodes_per_group;
+        struct group_desc want = grp->desc;
+        want.free_blocks = (grp->end_block - first) - owned_in(ctx, first, grp->end_block);
+        want.free_inodes = sb->inodes_per_group - (g == 0 ? 1 : 0) -
+                           used_in(ctx, ifirst, iend);
+        want.used_dirs = dirs_in(ctx, ifirst, iend);
+        if (memcmp(&want, &grp->desc, sizeof(want)) != 0) {
+            grp->desc = want;
+            fs->groups_dirty = true;
+            ctx->report.repaired++;
+        }
+    }
+
+    block_groups_unlock_all(fs);
+    pthread_mutex_unlock(&fs->alloc_lock);
+}
+
+// reference-count table rewritten from the mappings found
+static void repair_refcounts(struct check_ctx* ctx) {
+    for (uint32_t b = 0; ctx->shared && b < ctx->fs->sb.total_blocks; b++) {
+        uint16_t want = refs_wanted(ctx, b);
+        if (ctx->shared[b] != want && block_refs_set(ctx->fs, b, want) == SUCCESS) {
+            ctx->shared[b] = want;
+            ctx->report.repaired++;
+        }
+    }
+}
+
+static void sum_errors(fs_check_report_t* r) {
+    r->errors = r->bad_inodes + r->inode_bitmap_errors + r->bad_blocks + r->duplicate_blocks +
+                r->blocks_used_errors + r->block_leaks + r->blocks_unmarked + r->dir_errors +
+                r->dangling_entries + r->link_count_errors + r->orphans + r->counter_errors +
+                r->refcount_errors;
+}
+
+static int check_frozen(struct check_ctx* ctx) {
+    filesystem_t* fs = ctx->fs;
+
+    // the passes read the inode table directly
+    int res = flush_metadata(fs);
+    if (res != SUCCESS)
+        return res;
+
+    if (ctx->shared &&
+        (res = block_refs_get(fs, 0, fs->sb.total_blocks, ctx->shared)) != SUCCESS)
+        return res;
+
+    claim_metadata(ctx);
+    if ((res = run_pass(ctx, table_pass)) != SUCCESS)
+        return res;
+    if ((res = run_pass(ctx, dir_pass)) != SUCCESS)
+        return res;
+    merge_inodes(ctx);
+    merge_blocks(ctx);
+    sum_errors(&ctx->report);
+
+    if (!ctx->repair || ctx->report.errors == 0)
+        return SUCCESS;
+
+    if (repair_namespace(ctx)) {
+        // directories may have gained or dropped blocks: claim them again
+        if ((res = flush_metadata(fs)) != SUCCESS)
+            return res;
+        ctx->quiet = true;
+        claim_metadata(ctx);
+        if ((res = run_pass(ctx, table_pass)) != SUCCESS)
+            return res;
+    }
+    repair_allocation(ctx);
+    repair_refcounts(ctx);
+    return commit_metadata(fs);
+}
+
+// === PUBLIC FUNCTIONS ===
+
+int fs_check(filesystem_t* fs, const fs_check_options_t* opts, fs_check_report_t* out_report) {
+    if (!fs || !fs->is_mounted || !out_report)
+        return ERROR_INVALID;
+
+    struct check_ctx* ctx = calloc(1, sizeof(struct check_ctx));
+    if (!ctx)
+        return ERROR_NO_SPACE;
+    ctx->fs = fs;
+    ctx->repair = opts && opts->repair;
+    ctx->verbose = opts && opts->verbose;
+    pthread_mutex_init(&ctx->lock, NULL);
+
+    int res = ERROR_NO_SPACE;
+    size_t inodes = fs->sb.total_inodes;
+    ctx->owner = malloc((size_t)fs->sb.total_blocks * sizeof(uint32_t));
+    ctx->type = calloc(inodes, sizeof(uint8_t));
+    ctx->refs = calloc(inodes, sizeof(uint32_t));
+    ctx->dot = calloc(inodes, sizeof(uint32_t));
+    ctx->dotdot = calloc(inodes, sizeof(uint32_t));
+    ctx->named_in = calloc(inodes, sizeof(uint32_t));
+    if (!ctx->owner || !ctx->type || !ctx->refs || !ctx->dot || !ctx->dotdot || !ctx->named_in)
+        goto cleanup;
+    if (fs->sb.features & FS_FEATURE_REFLINK) {
+        ctx->shared = malloc((size_t)fs->sb.total_blocks * sizeof(uint16_t));
+        ctx->claims = malloc((size_t)fs->sb.total_blocks * sizeof(uint16_t));
+        if (!ctx->shared || !ctx->claims)
+            goto cleanup;
+    }
+
+    plan_workers(ctx, opts ? opts->threads : 0);
+    ctx->report.threads = ctx->nworkers;
+
+    fs_freeze(fs);
+    res = check_frozen(ctx);
+    fs_thaw(fs);
+
+    *out_report = ctx->report;
+
+cleanup:
+    free(ctx->owner);
+    free(ctx->type);
+    free(ctx->refs);
+    free(ctx->dot);
+    free(ctx->dotdot);
+    free(ctx->named_in);
+    free(ctx->shared);
+    free(ctx->claims);
+    free(ctx->dangling);
+    pthread_mutex_destroy(&ctx->lock);
+    free(ctx);
+    return res;
+}
+
+void fs_check_print(const fs_check_report_t* r) {
+    if (!r)
+        return;
+
+    printf("Checked %u inodes (%u directories), %llu blocks, with %u thread(s)\n",
+           r->inodes_used, r->directories, (unsigned long long)r->blocks_owned, r->threads);
+
+    const struct { const char* what; uint32_t n; } lines[] = {
+        { "bad inodes", r->bad_inodes },
+        { "inode bitmap errors", r->inode_bitmap_errors },
+        { "bad block pointers", r->bad_blocks },
+        { "duplicate blocks", r->duplicate_blocks },
+        { "blocks_used errors", r->blocks_used_errors },
+        { "leaked blocks", r->block_leaks },
+        { "blocks in use marked free", r->blocks_unmarked },
+        { "directory errors", r->dir_errors },
+        { "dangling entries", r->dangling_entries },
+        { "link count errors", r->link_count_errors },
+        { "orphaned inodes", r->orphans },
+        { "free counter errors", r->counter_errors },
+        { "reference count errors", r->refcount_errors },
+    };
+    for (size_t i = 0; i < sizeof(lines) / sizeof(lines[0]); i++)
+        if (lines[i].n > 0)
+            printf("  %-26s %u\n", lines[i].what, lines[i].n);
+
+    if (r->errors == 0)
+        printf("Filesystem is clean\n");
+    else
+        printf("%u problem(s) found, %u repaired\n", r->errors, r->repaired);
+}
@@ -0,0 +1,628 @@
+#include "fs.h"
+#include "fs_internal.h"
+#include "lz.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Storage of INODE_FLAG_COMPRESSED files.
+ *
+ * The file is cut into chunks of compress_chunk_bytes() bytes, each one
+ * owning the logical blocks of its bytes and holding the span of the file
+ * inside it (the whole chunk but for the last one). What the blocks under
+ * the span map tells how the chunk is stored:
+ *
+ *  - nothing: the chunk is zeros
+ *  - all of them: the span as is (raw)
+ *  - some leading ones: compressed. The first block starts with the
+ *    32-bit length of an LZ4 block (lz.h) that expands to exactly the
+ *    span, and the blocks after it are holes
+ *
+ * Since the state depends on the span, a partial last chunk is stored
+ * again whenever the size moves it. Chunks are only ever replaced as a
+ * whole: the new blocks are written first, then the old ones unmapped and
+ * the new ones mapped in their place, so blocks shared with a clone are
+ * never written. Compressed files are mapped with block pointers, a
+ * compressed chunk being followed by a hole.
+ *
+ * Compressed chunks read recently are kept decompressed in the mount's
+ * chunk cache, keyed by their first physical block and span. Every chunk
+ * compressed into blocks passes through chunk_store(), which refreshes the
+ * entry of its new first block, so an entry left behind by freed blocks is
+ * replaced before those blocks can hold another compressed chunk.
+ */
+
+#define CHUNK_MAX_BLOCKS (FS_COMPRESS_CHUNK / BLOCK_SIZE_MIN)
+#define CHUNK_HEADER     sizeof(uint32_t)  // compressed length, in the first block
+#define CHUNK_CACHE_SLOTS 16               // decompressed chunks kept per mount
+
+_Static_assert(FS_COMPRESS_CHUNK % BLOCK_SIZE_MIN == 0, "chunks are whole blocks");
+
+// === CHUNK CACHE ===
+
+struct chunk_slot {
+    uint32_t block;                   // first physical block of the chunk (0 = free slot)
+    uint32_t span;                    // bytes in data
+    uint64_t used;                    // cache clock at the last hit
+    uint8_t* data;
+};
+
+struct chunk_cache {
+    struct chunk_slot slots[CHUNK_CACHE_SLOTS];
+    uint32_t chunk_bytes;             // size of every slot's buffer
+    uint64_t clock;
+    pthread_mutex_t lock;
+};
+
+struct chunk_cache* chunk_cache_create(uint32_t chunk_bytes) {
+    struct chunk_cache* cache = calloc(1, sizeof(*cache));
+    if (!cache) {
+        return NULL;
+    }
+    for (int i = 0; i < CHUNK_CACHE_SLOTS; i++) {
+        cache->slots[i].data = malloc(chunk_bytes);
+        if (!cache->slots[i].data) {
+            for (int k = 0; k < i; k++) {
+                free(cache->slots[k].data);
+            }
+            free(cache);
+            return NULL;
+        }
+    }
+    cache->chunk_bytes = chunk_bytes;
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+void chunk_cache_destroy(struct chunk_cache** cache) {
+    if (!cache || !*cache) {
+        return;
+    }
+    for (int i = 0; i < CHUNK_CACHE_SLOTS; i++) {
+        free((*cache)->slots[i].data);
+    }
+    pthread_mutex_destroy(&(*cache)->lock);
+    free(*cache);
+    *cache = NULL;
+}
+
+static struct chunk_slot* cache_find(struct chunk_cache* cache, uint32_t block, uint32_t span) {
+    for (int i = 0; i < CHUNK_CACHE_SLOTS; i++) {
+        if (cache->slots[i].block == block && cache->slots[i].span == span) {
+            return &cache->slots[i];
+        }
+    }
+    return NULL;
+}
+
+// copies the cached chunk out; false on a miss (or without a cache)
+static bool cache_get(struct chunk_cache* cache, uint32_t block, uint32_t span, void* out) {
+    if (!cache) {
+        return false;
+    }
+    pthread_mutex_lock(&cache->lock);
+    struct chunk_slot* slot = cache_find(cache, block, span);
+    if (slot) {
+        memcpy(out, slot->data, span);
+        slot->used = ++cache->clock;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return slot != NULL;
+}
+
+// keeps a copy of the chunk starting at block, in the least recently used slot
+static void cache_put(struct chunk_cache* cache, uint32_t block, uint32_t span, const void* data) {
+    if (!cache || span > cache->chunk_bytes) {
+        return;
+    }
+    pthread_mutex_lock(&cache->lock);
+    struct chunk_slot* slot = NULL;
+    for (int i = 0; i < CHUNK_CACHE_SLOTS; i++) {
+        if (cache->slots[i].block == block) {
+            slot = &cache->slots[i];      // any older chunk at this block is stale
+            break;
+        }
+        if (!slot || cache->slots[i].used < slot->used) {
+            slot = &cache->slots[i];
+        }
+    }
+    memcpy(slot->data, data, span);
+    slot->block = block;
+    slot->span = span;
+    slot->used = ++cache->clock;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+// === CHUNK GEOMETRY ===
+
+// bytes of chunk c inside a file of size bytes (0 past the end)
+static inline uint32_t chunk_span(uint32_t cb, uint32_t c, uint32_t size) {
+    uint64_t start = (uint64_t)c * cb;
+    if (start >= size) {
+        return 0;
+    }
+    return (size - start < cb) ? (uint32_t)(size - start) : cb;
+}
+
+static inline uint32_t bytes_to_blocks(const filesystem_t* fs, uint64_t bytes) {
+    return (uint32_t)((bytes + fs_block_mask(fs)) >> fs_block_shift(fs));
+}
+
+// === CHUNK I/O ===
+
+// copies len bytes from logical block idx on into dst (holes read as zeros)
+static int read_blocks(filesystem_t* fs, const struct inode* inode, struct bmap_cursor* cursor,
+                       uint32_t idx, uint32_t len, uint8_t* dst) {
+    const uint32_t shift = fs_block_shift(fs);
+    while (len > 0) {
+        uint32_t phys, run;
+        int res = bmap_lookup(fs, inode, cursor, idx, bytes_to_blocks(fs, len), &phys, &run);
+        if (res != SUCCESS) {
+            return res;
+        }
+        uint64_t run_bytes = (uint64_t)run << shift;
+        uint32_t n = (len < run_bytes) ? len : (uint32_t)run_bytes;
+        if (phys == 0) {
+            memset(dst, 0, n);
+        } else {
+            const void* src;
+            if (disk_borrow_blocks(fs->disk, phys, run, &src) != DISK_SUCCESS) {
+                return ERROR_IO;
+            }
+            memcpy(dst, src, n);
+            disk_release_blocks(fs->disk, phys, run, false);
+        }
+        dst += n;
+        len -= n;
+        idx += run;
+    }
+    return SUCCESS;
+}
+
+/*
+ * Looks at the first `blocks` blocks of the chunk starting at logical block
+ * idx: *out_first is the physical block of the first one (0 = hole) and
+ * *out_mapped the number mapped. ERROR_IO when a mapped block follows a
+ * hole, which no chunk state allows.
+ */
+static int chunk_layout(filesystem_t* fs, const struct inode* inode, struct bmap_cursor* cursor,
+                        uint32_t idx, uint32_t blocks, uint32_t* out_first, uint32_t* out_mapped) {
+    uint32_t done = 0;
+    *out_first = 0;
+    *out_mapped = 0;
+    while (done < blocks) {
+        uint32_t phys, run;
+        int res = bmap_lookup(fs, inode, cursor, idx + done, blocks - done, &phys, &run);
+        if (res != SUCCESS) {
+            return res;
+        }
+        if (phys != 0) {
+            if (*out_mapped != done) {
+                return ERROR_IO;
+            }
+            if (done == 0) {
+                *out_first = phys;
+            }
+            *out_mapped += run;
+        }
+        done += run;
+    }
+    return SUCCESS;
+}
+
+// reads the span bytes of chunk c into out
+static int chunk_load(filesystem_t* fs, const struct inode* inode, struct bmap_cursor* cursor,
+                      uint32_t c, uint32_t span, uint8_t* out) {
+    const uint32_t bs = fs_block_size(fs);
+    uint32_t idx = c * (compress_chunk_bytes(fs) >> fs_block_shift(fs));
+    uint32_t blocks = bytes_to_blocks(fs, span);
+
+    uint32_t first, mapped;
+    int res = chunk_layout(fs, inode, cursor, idx, blocks, &first, &mapped);
+    if (res != SUCCESS) {
+        return res;
+    }
+    if (mapped == 0) {
+        memset(out, 0, span);
+        return SUCCESS;
+    }
+    if (mapped == blocks) {
+        return read_blocks(fs, inode, cursor, idx, span, out);
+    }
+
+    if (cache_get(fs->ccache, first, span, out)) {
+        return SUCCESS;
+    }
+    uint8_t* packed = malloc((size_t)mapped * bs);
+    if (!packed) {
+        return ERROR_NO_SPACE;
+    }
+    res = read_blocks(fs, inode, cursor, idx, mapped * bs, packed);
+    if (res == SUCCESS) {
+        uint32_t clen;
+        memcpy(&clen, packed, CHUNK_HEADER);
+        if (clen > (uint64_t)mapped * bs - CHUNK_HEADER ||
+            lz_decompress(packed + CHUNK_HEADER, clen, out, span) != (int)span) {
+            res = ERROR_IO;
+        }
+    }
+    free(packed);
+    if (res == SUCCESS) {
+        cache_put(fs->ccache, first, span, out);
+    }
+    return res;
+}
+
+static bool all_zero(const uint8_t* data, uint32_t len) {
+    return len == 0 || (data[0] == 0 && memcmp(data, data + 1, len - 1) == 0);
+}
+
+/*
+ * Replaces the blocks of chunk c with the span bytes of data: nothing for
+ * zeros, else compressed when asked and that saves a block, else as is.
+ * The inode is not written back. On failure before the old blocks are
+ * unmapped the chunk is left as it was; a failure to map the new ones
+ * (out of space for a pointer block) leaves it a hole.
+ */
+static int chunk_store(filesystem_t* fs, struct inode* inode, uint32_t inode_num,
+                       uint32_t c, const uint8_t* data, uint32_t span, bool compress) {
+    const uint32_t bs = fs_block_size(fs);
+    const uint32_t shift = fs_block_shift(fs);
+    uint32_t idx = c * (compress_chunk_bytes(fs) >> shift);
+    uint32_t blocks = bytes_to_blocks(fs, span);
+
+    const uint8_t* src = data;
+    uint32_t len = span;
+    uint8_t* packed = NULL;
+    if (all_zero(data, span)) {
+        len = 0;
+    } else if (compress && blocks > 1) {
+        packed = malloc((size_t)(blocks - 1) * bs);
+        if (!packed) {
+            return ERROR_NO_SPACE;
+        }
+        size_t clen = lz_compress(data, span, packed + CHUNK_HEADER,
+                                  (blocks - 1) * bs - CHUNK_HEADER);
+        if (clen > 0) {
+            uint32_t header = (uint32_t)clen;
+            memcpy(packed, &header, CHUNK_HEADER);
+            src = packed;
+            len = CHUNK_HEADER + (uint32_t)clen;
+        }
+    }
+    uint32_t want = bytes_to_blocks(fs, len);
+
+    // the new blocks first, possibly in several runs
+    struct {
+        uint32_t start;
+        uint32_t count;
+    } runs[CHUNK_MAX_BLOCKS];
+    uint32_t nruns = 0;
+    uint32_t got = 0;
+    uint32_t goal = bmap_goal(fs, inode_num, inode, NULL, idx);
+    int res = SUCCESS;
+    while (got < want) {
+        uint32_t start, count;
+        res = block_alloc(fs, goal, want - got, &start, &count);
+        if (res != SUCCESS) {
+            goto fail;
+        }
+        runs[nruns].start = start;
+        runs[nruns].count = count;
+        nruns++;
+
+        void* dst;
+        if (disk_borrow_blocks_mut(fs->disk, start, count, &dst) != DISK_SUCCESS) {
+            res = ERROR_IO;
+            goto fail;
+        }
+        uint64_t room = (uint64_t)count << shift;
+        uint32_t off = got << shift;
+        uint32_t n = (len - off < room) ? len - off : (uint32_t)room;
+        memcpy(dst, src + off, n);
+        memset((uint8_t*)dst + n, 0, room - n);
+        disk_release_blocks(fs->disk, start, count, true);
+
+        got += count;
+        goal = start + count;
+    }
+
+    // then the swap
+    uint32_t freed = 0;
+    res = bmap_punch(fs, inode, idx, blocks, &freed);
+    if (res != SUCCESS) {
+        goto fail;
+    }
+    fs_free_blocks_add(fs, freed);
+
+    uint32_t at = idx;
+    for (uint32_t i = 0; i < nruns; i++) {
+        uint32_t meta_blocks;
+        res = bmap_map(fs, inode, NULL, at, runs[i].start, runs[i].count, &meta_blocks);
+        if (res != SUCCESS) {
+            // back to a hole: what is mapped goes with the punch, the rest here
+            bmap_punch(fs, inode, idx, blocks, &freed);
+            fs_free_blocks_add(fs, freed);
+            for (uint32_t k = i; k < nruns; k++) {
+                block_free_run(fs, runs[k].start, runs[k].count);
+            }
+            free(packed);
+            return res;
+        }
+        fs_free_blocks_sub(fs, runs[i].count + meta_blocks);
+        at += runs[i].count;
+    }
+
+    if (src == packed) {
+        cache_put(fs->ccache, runs[0].start, span, data);
+    }
+    free(packed);
+    return SUCCESS;
+
+fail:
+    for (uint32_t k = 0; k < nruns; k++) {
+        block_free_run(fs, runs[k].start, runs[k].count);
+    }
+    free(packed);
+    return res;
+}
+
+// === COMPRESSED FILE DATA ===
+
+int read_compressed(filesystem_t* fs, const struct inode* inode, struct bmap_cursor* cursor,
+                    uint32_t offset, void* buffer, size_t size, size_t* bytes_read) {
+    const uint32_t cb = compress_chunk_bytes(fs);
+    uint32_t available = (offset < inode->size) ? (inode->size - offset) : 0;
+    uint32_t to_read = (size < available) ? (uint32_t)size : available;
+    uint8_t* out = buffer;
+    uint8_t* chunk = NULL;
+    int res = SUCCESS;
+
+    uint32_t pos = offset;
+    uint32_t end = offset + to_read;
+    while (pos < end) {
+        uint32_t c = pos / cb;
+        uint32_t start = c * cb;
+        uint32_t span = chunk_span(cb, c, inode->size);
+        uint32_t lo = pos - start;
+        uint32_t hi = (end - start < span) ? end - start : span;
+
+        if (lo == 0 && hi == span) {
+            // the whole chunk: straight into the caller's buffer
+            res = chunk_load(fs, inode, cursor, c, span, out);
+        } else {
+            if (!chunk && !(chunk = malloc(cb))) {
+                res = ERROR_NO_SPACE;
+                break;
+            }
+            res = chunk_load(fs, inode, cursor, c, span, chunk);
+            if (res == SUCCESS) {
+                memcpy(out, chunk + lo, hi - lo);
+            }
+        }
+        if (res != SUCCESS) {
+            break;
+        }
+        out += hi - lo;
+        pos = start + hi;
+    }
+
+    free(chunk);
+    bmap_cursor_release(fs, cursor);
+    *bytes_read = (res == SUCCESS) ? to_read : 0;
+    return res;
+}
+
+int write_compressed(filesystem_t* fs, struct inode* inode, uint32_t inode_num,
+                     struct bmap_cursor* cursor, uint32_t offset,
+                     const void* buffer, size_t size, size_t* bytes_written) {
+    // chunks are replaced through the mapping: no cursor may be held
+    bmap_cursor_release(fs, cursor);
+    *bytes_written = 0;
+    if (size == 0) {
+        return SUCCESS;
+    }
+
+    const uint32_t cb = compress_chunk_bytes(fs);
+    const uint8_t* in = buffer;
+    uint32_t old_size = inode->size;
+    uint32_t end = offset + (uint32_t)size;
+    uint32_t new_size = (end > old_size) ? end : old_size;
+    uint32_t first = offset / cb;
+    uint32_t last = (end - 1) / cb;
+
+    uint8_t* chunk = malloc(cb);
+    if (!chunk) {
+        return ERROR_NO_SPACE;
+    }
+
+    // a partial last chunk before the write grows to a full one
+    int res = SUCCESS;
+    uint32_t tail = old_size / cb;
+    if (old_size % cb != 0 && tail < first) {
+        uint32_t span = chunk_span(cb, tail, old_size);
+        res = chunk_load(fs, inode, NULL, tail, span, chunk);
+        if (res == SUCCESS) {
+            memset(chunk + span, 0, cb - span);
+            res = chunk_store(fs, inode, inode_num, tail, chunk, cb, true);
+        }
+    }
+
+    uint32_t c;
+    for (c = first; res == SUCCESS && c <= last; c++) {
+        uint32_t start = c * cb;
+        uint32_t old_span = chunk_span(cb, c, old_size);
+        uint32_t new_span = chunk_span(cb, c, new_size);
+        uint32_t lo = (offset > start) ? offset - start : 0;
+        uint32_t hi = (end - start < new_span) ? end - start : new_span;
+
+        // keep what the write does not cover
+        if (old_span > 0 && (lo > 0 || hi < new_span)) {
+            res = chunk_load(fs, inode, NULL, c, old_span, chunk);
+            if (res != SUCCESS) {
+                break;
+            }
+            memset(chunk + old_span, 0, new_span - old_span);
+        } else {
+            memset(chunk, 0, new_span);
+        }
+        memcpy(chunk + lo, in + (start + lo - offset), hi - lo);
+
+        res = chunk_store(fs, inode, inode_num, c, chunk, new_span, true);
+        if (res != SUCCESS) {
+            break;
+        }
+        *bytes_written += hi - lo;
+    }
+    free(chunk);
+
+    // on failure the chunks before c are stored with full spans: the file
+    // may grow up to there
+    if (res == SUCCESS) {
+        inode->size = new_size;
+    } else if (c > first && (uint64_t)c * cb > old_size) {
+        inode->size = c * cb;
+    }
+    inode->modified_time = time(NULL);
+    if (inode_write(fs, inode_num, inode) != SUCCESS) {
+        return ERROR_IO;
+    }
+    return res;
+}
+
+int resize_compressed(filesystem_t* fs, struct inode* inode, uint32_t inode_num, uint32_t new_size) {
+    const uint32_t cb = compress_chunk_bytes(fs);
+    uint32_t old_size = inode->size;
+    if (new_size == old_size) {
+        return SUCCESS;
+    }
+
+    // the chunk the old or the new end falls in changes its span
+    uint32_t c = (new_size > old_size) ? old_size / cb : new_size / cb;
+    uint32_t old_span = chunk_span(cb, c, old_size);
+    uint32_t new_span = chunk_span(cb, c, new_size);
+    int res = SUCCESS;
+    if (old_span != 0 && new_span != 0 && old_span != new_span) {
+        uint8_t* chunk = malloc(cb);
+        if (!chunk) {
+            return ERROR_NO_SPACE;
+        }
+        res = chunk_load(fs, inode, NULL, c, old_span, chunk);
+        if (res == SUCCESS) {
+            if (new_span > old_span) {
+                memset(chunk + old_span, 0, new_span - old_span);
+            }
+            res = chunk_store(fs, inode, inode_num, c, chunk, new_span, true);
+        }
+        free(chunk);
+        if (res != SUCCESS) {
+            return res;
+        }
+    }
+
+    if (new_size < old_size) {
+        uint32_t freed = 0;
+        res = bmap_truncate(fs, inode, bytes_to_blocks(fs, new_size), &freed);
+        if (res != SUCCESS) {
+            return res;
+        }
+        fs_free_blocks_add(fs, freed);
+    }
+    inode->size = new_size;
+    return SUCCESS;
+}
+
+// === CONVERSION ===
+
+/*
+ * Rewrites the data of a mapped file into a shadow inode in the other
+ * storage mode, then hands the shadow's mapping over (inode lock held
+ * exclusively). Until the hand-over the file is untouched.
+ */
+static int convert_file(filesystem_t* fs, struct inode* inode, uint32_t inode_num, bool on) {
+    const uint32_t cb = compress_chunk_bytes(fs);
+    uint32_t plain = (fs->sb.features & FS_FEATURE_EXTENTS) ? INODE_FLAG_EXTENTS : 0;
+
+    struct inode shadow = *inode;
+    memset(shadow.direct, 0, sizeof(shadow.direct));
+    shadow.indirect = shadow.double_indirect = shadow.triple_indirect = 0;
+    shadow.blocks_used = 0;
+    shadow.flags &= ~(INODE_FLAG_EXTENTS | INODE_FLAG_COMPRESSED);
+    shadow.flags |= on ? INODE_FLAG_COMPRESSED : plain;
+
+    uint8_t* chunk = malloc(cb);
+    if (!chunk) {
+        return ERROR_NO_SPACE;
+    }
+    int res = SUCCESS;
+    for (uint32_t c = 0; res == SUCCESS && (uint64_t)c * cb < inode->size; c++) {
+        uint32_t span = chunk_span(cb, c, inode->size);
+        if (on) {
+            size_t got;
+            res = read_inode_data(fs, inode, NULL, c * cb, chunk, span, &got);
+        } else {
+            res = chunk_load(fs, inode, NULL, c, span, chunk);
+        }
+        if (res == SUCCESS) {
+            res = chunk_store(fs, &shadow, inode_num, c, chunk, span, on);
+        }
+    }
+    free(chunk);
+
+    uint32_t freed = 0;
+    if (res != SUCCESS) {
+        bmap_truncate(fs, &shadow, 0, &freed);
+        fs_free_blocks_add(fs, freed);
+        return res;
+    }
+    res = bmap_truncate(fs, inode, 0, &freed);
+    fs_free_blocks_add(fs, freed);
+    if (res != SUCCESS) {
+        bmap_truncate(fs, &shadow, 0, &freed);
+        fs_free_blocks_add(fs, freed);
+        return res;
+    }
+    *inode = shadow;
+    return SUCCESS;
+}
+
+int fs_set_compression(filesystem_t* fs, const char* path, bool on) {
+    if (!fs || !path) {
+        return ERROR_INVALID;
+    }
+
+    pthread_rwlock_rdlock(&fs->ns_lock);
+    uint32_t inode_num;
+    int res = fs_path_to_inode(fs, path, &inode_num);
+    bool changed = false;
+    if (res == SUCCESS) {
+        pthread_rwlock_wrlock(fs_inode_lock(fs, inode_num));
+        struct inode inode;
+        res = (inode_read(fs, inode_num, &inode) == SUCCESS) ? SUCCESS : ERROR_IO;
+        if (res == SUCCESS && inode.type != INODE_TYPE_FILE) {
+            res = ERROR_INVALID;
+        }
+        if (res == SUCCESS && ((inode.flags & INODE_FLAG_COMPRESSED) != 0) != on) {
+            if (bmap_is_inline(&inode) || inode.blocks_used == 0) {
+                // nothing stored in blocks: only the mode changes
+                uint32_t plain = (fs->sb.features & FS_FEATURE_EXTENTS) ? INODE_FLAG_EXTENTS : 0;
+                inode.flags &= ~(INODE_FLAG_EXTENTS | INODE_FLAG_COMPRESSED);
+                inode.flags |= on ? INODE_FLAG_COMPRESSED : plain;
+            } else {
+                res = convert_file(fs, &inode, inode_num, on);
+            }
+            if (res == SUCCESS) {
+                res = inode_write(fs, inode_num, &inode);
+                changed = true;
+            }
+        }
+        pthread_rwlock_unlock(fs_inode_lock(fs, inode_num));
+    }
+    pthread_rwlock_unlock(&fs->ns_lock);
+
+    if (res != SUCCESS || !changed) {
+        return res;
+    }
+    return (commit_metadata(fs) == SUCCESS) ? SUCCESS : ERROR_IO;
+}
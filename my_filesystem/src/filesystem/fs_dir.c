@@ -9,9 +9,9 @@
  * Validates that a given inode is a directory.
  * Helper to reduce code duplication.
  */
-int validate_parent_directory(disk_t disk, uint32_t inode_num) {
+int validate_parent_directory(filesystem_t* fs, uint32_t inode_num) {
     struct inode inode;
-    if (inode_read(disk, inode_num, &inode) != SUCCESS) {
+    if (inode_read(fs, inode_num, &inode) != SUCCESS) {
         return ERROR_IO;
     }
     if (inode.type != INODE_TYPE_DIRECTORY) {
@@ -33,27 +33,25 @@ int fs_prepare_create(filesystem_t* fs, const char* path,
     if (!path_is_valid(path))
         return ERROR_INVALID;
 
-    char* normalized = path_normalize(path);
-    if (!normalized) return ERROR_INVALID;
+    char normalized[MAX_PATH];
+    if (path_normalize_into(path, normalized, sizeof(normalized)) != SUCCESS)
+        return ERROR_INVALID;
 
-    if (path_split(normalized, parent_path, name) != SUCCESS) {
-        free(normalized);
+    if (path_split(normalized, parent_path, name) != SUCCESS)
         return ERROR_INVALID;
-    }
-    free(normalized);
 
     if (!filename_is_valid(name)) return ERROR_INVALID;
 
-    // resolve parent directory
-    int res = fs_path_to_inode(fs, parent_path, parent_inode_num);
+    // resolve parent directory (already valid and normalized)
+    int res = fs_lookup_normalized(fs, parent_path, parent_inode_num);
     if (res != SUCCESS) return res;
 
-    if (validate_parent_directory(fs->disk, *parent_inode_num) != SUCCESS)
+    if (validate_parent_directory(fs, *parent_inode_num) != SUCCESS)
         return ERROR_INVALID;
 
     // check if name already exists
     struct dentry tmp;
-    res = (dentry_find(fs->disk, *parent_inode_num, name, &tmp, NULL));
+    res = (dentry_find(fs, *parent_inode_num, name, &tmp, NULL));
     if (res == SUCCESS) {
         return ERROR_EXISTS;
     } else if (res != ERROR_NOT_FOUND) {
@@ -63,7 +61,7 @@ int fs_prepare_create(filesystem_t* fs, const char* path,
     return SUCCESS;
 }
 
-int fs_mkdir(filesystem_t* fs, const char* path, uint16_t permissions) {
+static int make_directory(filesystem_t* fs, const char* path, uint16_t permissions) {
     int status = SUCCESS;
     char parent_path[MAX_PATH];
     char dirname[MAX_FILENAME];
@@ -75,11 +73,11 @@ int fs_mkdir(filesystem_t* fs, const char* path, uint16_t permissions) {
     // allocate inode for directory
     struct inode new_dir_inode;
     uint32_t new_dir_inode_num;
-    if (inode_alloc(fs->disk, fs->inode_bitmap, INODE_TYPE_DIRECTORY, permissions,
-                   &new_dir_inode, &new_dir_inode_num) != SUCCESS) {
+    if (inode_alloc_near(fs, parent_inode_num, INODE_TYPE_DIRECTORY, permissions,
+                         &new_dir_inode, &new_dir_inode_num) != SUCCESS) {
         return ERROR_NO_SPACE;
     }
-    fs->sb.free_inodes--;
+    fs_free_inodes_sub(fs, 1);
 
     // create dentry in parent directory
     struct dentry new_dentry;
@@ -89,11 +87,11 @@ int fs_mkdir(filesystem_t* fs, const char* path, uint16_t permissions) {
     }
 
     uint32_t parent_dentry_blocks = 0;
-    if (dentry_add(fs->disk, parent_inode_num, &new_dentry, fs->block_bitmap, &parent_dentry_blocks) != SUCCESS) {
+    if (dentry_add(fs, parent_inode_num, &new_dentry, &parent_dentry_blocks) != SUCCESS) {
         status = ERROR_IO;
         goto cleanup_inode;
     }
-    fs->sb.free_blocks -= parent_dentry_blocks;
+    fs_free_blocks_sub(fs, parent_dentry_blocks);
 
     // add "." and ".." entries
     struct dentry dot, dotdot;
@@ -104,11 +102,11 @@ int fs_mkdir(filesystem_t* fs, const char* path, uint16_t permissions) {
     }
 
     uint32_t dot_blocks = 0;
-    if (dentry_add(fs->disk, new_dir_inode_num, &dot, fs->block_bitmap, &dot_blocks) != SUCCESS) {
+    if (dentry_add(fs, new_dir_inode_num, &dot, &dot_blocks) != SUCCESS) {
         status = ERROR_IO;
         goto cleanup_remove_parent_dentry;
     }
-    fs->sb.free_blocks -= dot_blocks;
+    fs_free_blocks_sub(fs, dot_blocks);
 
     if (dentry_create("..", parent_inode_num, INODE_TYPE_DIRECTORY, &dotdot) != SUCCESS) {
         status = ERROR_INVALID;
@@ -116,74 +114,87 @@ int fs_mkdir(filesystem_t* fs, const char* path, uint16_t permissions) {
     }
 
     uint32_t dotdot_blocks = 0;
-    if (dentry_add(fs->disk, new_dir_inode_num, &dotdot, fs->block_bitmap, &dotdot_blocks) != SUCCESS) {
+    if (dentry_add(fs, new_dir_inode_num, &dotdot, &dotdot_blocks) != SUCCESS) {
         status = ERROR_IO;
         goto cleanup_remove_parent_dentry;
     }
-    fs->sb.free_blocks -= dotdot_blocks;
+    fs_free_blocks_sub(fs, dotdot_blocks);
 
     // update new directory link count (for "." reference)
-    if (inode_read(fs->disk, new_dir_inode_num, &new_dir_inode) != SUCCESS) {
+    if (inode_read(fs, new_dir_inode_num, &new_dir_inode) != SUCCESS) {
         status = ERROR_IO;
         goto cleanup_remove_parent_dentry;
     }
     new_dir_inode.links_count = 2;
+    new_dir_inode.parent = parent_inode_num;
     new_dir_inode.modified_time = time(NULL);
-    if (inode_write(fs->disk, new_dir_inode_num, &new_dir_inode) != SUCCESS) {
+    if (inode_write(fs, new_dir_inode_num, &new_dir_inode) != SUCCESS) {
         status = ERROR_IO;
         goto cleanup_remove_parent_dentry;
     }
 
     // update parent link count (for ".." reference)
     struct inode parent_inode;
-    if (inode_read(fs->disk, parent_inode_num, &parent_inode) != SUCCESS) {
+    if (inode_read(fs, parent_inode_num, &parent_inode) != SUCCESS) {
         status = ERROR_IO;
         goto cleanup_remove_parent_dentry;
     }
     parent_inode.links_count++;
     parent_inode.modified_time = time(NULL);
-    if (inode_write(fs->disk, parent_inode_num, &parent_inode) != SUCCESS) {
+    if (inode_write(fs, parent_inode_num, &parent_inode) != SUCCESS) {
         status = ERROR_IO;
         goto cleanup_remove_parent_dentry;
     }
 
-    // update superblock
-    if (superblock_write(fs->disk, &fs->sb) != SUCCESS) {
+    // persist superblock and bitmaps (per flush policy)
+    if (commit_metadata(fs) != SUCCESS) {
         status = ERROR_IO;
         goto cleanup_revert_parent_link;
     }
-    save_bitmaps(fs);
 
     return SUCCESS;
 
     cleanup_revert_parent_link:
     // revert parent link count increment
-    if (inode_read(fs->disk, parent_inode_num, &parent_inode) == SUCCESS) {
+    if (inode_read(fs, parent_inode_num, &parent_inode) == SUCCESS) {
         parent_inode.links_count--;
-        inode_write(fs->disk, parent_inode_num, &parent_inode);
+        inode_write(fs, parent_inode_num, &parent_inode);
     }
 
     cleanup_remove_parent_dentry:
         // remove dentry from parent directory (rollback)
-        dentry_remove(fs->disk, fs->block_bitmap, &fs->sb, parent_inode_num, dirname);
+        dentry_remove(fs, parent_inode_num, dirname);
 
         // restore only blocks allocated in the parent directory
-        fs->sb.free_blocks += parent_dentry_blocks;
+        fs_free_blocks_add(fs, parent_dentry_blocks);
 
     cleanup_inode: {
         // free inode and its blocks
         uint32_t freed_blocks = 0;
-        inode_free(fs->disk, fs->inode_bitmap, fs->block_bitmap, new_dir_inode_num, &freed_blocks);
-        fs->sb.free_inodes++;
-        fs->sb.free_blocks += freed_blocks;
-        save_bitmaps(fs);
-        superblock_write(fs->disk, &fs->sb);
+        inode_free(fs, new_dir_inode_num, &freed_blocks);
+        fs_free_inodes_add(fs, 1);
+        fs_free_blocks_add(fs, freed_blocks);
+        commit_metadata(fs);
     }
 
     return status;
 }
 
-int fs_rmdir(filesystem_t* fs, const char* path) {
+int fs_mkdir(filesystem_t* fs, const char* path, uint16_t permissions) {
+    PERF_OP(PERF_OP_MKDIR);
+    TRACE_OP(PERF_OP_MKDIR, path);
+
+    if (!fs) {
+        return ERROR_INVALID;
+    }
+
+    pthread_rwlock_wrlock(&fs->ns_lock);
+    int res = make_directory(fs, path, permissions);
+    pthread_rwlock_unlock(&fs->ns_lock);
+    return res;
+}
+
+static int remove_directory(filesystem_t* fs, const char* path) {
     if (!fs || !path) {
         return ERROR_INVALID;
     }
@@ -201,7 +212,7 @@ int fs_rmdir(filesystem_t* fs, const char* path) {
     if (res != SUCCESS) return res;
 
     struct inode target_inode;
-    if (inode_read(fs->disk, target_inode_num, &target_inode) != SUCCESS) {
+    if (inode_read(fs, target_inode_num, &target_inode) != SUCCESS) {
         return ERROR_IO;
     }
 
@@ -209,81 +220,86 @@ int fs_rmdir(filesystem_t* fs, const char* path) {
         return ERROR_INVALID;
     }
 
-    // check if empty (only . and .. allowed)
-    struct dentry* entries = NULL;
-    uint32_t count = 0;
-    if (dentry_list(fs->disk, target_inode_num, &entries, &count) != SUCCESS) {
-        return ERROR_IO;
-    }
-
-    uint32_t non_special = 0;
-    for (uint32_t i = 0; i < count; i++) {
-        if (strcmp(entries[i].name, ".") != 0 && strcmp(entries[i].name, "..") != 0) {
-            non_special++;
+    // check if empty (only . and .. allowed): the first other entry settles it
+    struct dentry entries[4];
+    uint32_t pos = 0, count;
+    do {
+        if (dentry_iterate(fs, target_inode_num, &pos, entries, 4, &count) != SUCCESS) {
+            return ERROR_IO;
         }
-    }
-    free(entries);
-
-    if (non_special > 0) {
-        return ERROR_GENERIC;
-    }
+        for (uint32_t i = 0; i < count; i++) {
+            if (strcmp(entries[i].name, ".") != 0 && strcmp(entries[i].name, "..") != 0) {
+                return ERROR_GENERIC;
+            }
+        }
+    } while (count > 0);
 
-    char* normalized = path_normalize(path);
-    if (!normalized) {
+    char normalized[MAX_PATH];
+    if (path_normalize_into(path, normalized, sizeof(normalized)) != SUCCESS) {
         return ERROR_INVALID;
     }
 
     char parent_path[MAX_PATH];
     char dirname[MAX_FILENAME];
     if (path_split(normalized, parent_path, dirname) != SUCCESS) {
-        free(normalized);
         return ERROR_INVALID;
     }
-    free(normalized);
 
     uint32_t parent_inode_num;
-    res = fs_path_to_inode(fs, parent_path, &parent_inode_num);
+    res = fs_lookup_normalized(fs, parent_path, &parent_inode_num);
     if (res != SUCCESS) return res;
 
     // remove from parent directory
-    res = dentry_remove(fs->disk, fs->block_bitmap, &fs->sb, parent_inode_num, dirname);
+    res = dentry_remove(fs, parent_inode_num, dirname);
     if (res != SUCCESS) return res;
 
     // decrement parent link count
     struct inode parent_inode;
-    if (inode_read(fs->disk, parent_inode_num, &parent_inode) != SUCCESS) {
+    if (inode_read(fs, parent_inode_num, &parent_inode) != SUCCESS) {
         return ERROR_IO;
     }
 
     parent_inode.links_count--;
     parent_inode.modified_time = time(NULL);
 
-    if (inode_write(fs->disk, parent_inode_num, &parent_inode) != SUCCESS) {
+    if (inode_write(fs, parent_inode_num, &parent_inode) != SUCCESS) {
         return ERROR_IO;
     }
 
+    // cached names below it must not outlive the inode number
+    dcache_invalidate_dir(fs->dcache, target_inode_num);
+
     // free target directory inode and its blocks
     uint32_t freed_blocks = 0;
-    if (inode_free(fs->disk, fs->inode_bitmap, fs->block_bitmap,
-                   target_inode_num, &freed_blocks) != SUCCESS) {
+    if (inode_free(fs, target_inode_num, &freed_blocks) != SUCCESS) {
         return ERROR_IO;
     }
 
-    fs->sb.free_inodes++;
-    fs->sb.free_blocks += freed_blocks;
+    fs_free_inodes_add(fs, 1);
+    fs_free_blocks_add(fs, freed_blocks);
 
-    if (save_bitmaps(fs) != SUCCESS) {
+    if (commit_metadata(fs) != SUCCESS) {
         return ERROR_IO;
     }
 
-    if (superblock_write(fs->disk, &fs->sb) != SUCCESS) {
-        return ERROR_IO;
+    return SUCCESS;
+}
+
+int fs_rmdir(filesystem_t* fs, const char* path) {
+    PERF_OP(PERF_OP_RMDIR);
+    TRACE_OP(PERF_OP_RMDIR, path);
+
+    if (!fs) {
+        return ERROR_INVALID;
     }
 
-    return SUCCESS;
+    pthread_rwlock_wrlock(&fs->ns_lock);
+    int res = remove_directory(fs, path);
+    pthread_rwlock_unlock(&fs->ns_lock);
+    return res;
 }
 
-int fs_cd(filesystem_t* fs, const char* path) {
+static int change_directory(filesystem_t* fs, const char* path) {
     if (!fs || !path) {
         return ERROR_INVALID;
     }
@@ -299,7 +315,7 @@ int fs_cd(filesystem_t* fs, const char* path) {
 
     // check that inode_num is a directory
     struct inode inode;
-    if (inode_read(fs->disk, inode_num, &inode) != SUCCESS) {
+    if (inode_read(fs, inode_num, &inode) != SUCCESS) {
         return ERROR_IO;
     }
 
@@ -312,7 +328,21 @@ int fs_cd(filesystem_t* fs, const char* path) {
     return SUCCESS;
 }
 
-int fs_list(filesystem_t* fs, const char* path, struct dentry** out_entries, uint32_t* out_count) {
+int fs_cd(filesystem_t* fs, const char* path) {
+    PERF_OP(PERF_OP_CD);
+
+    if (!fs) {
+        return ERROR_INVALID;
+    }
+
+    // exclusive: every relative lookup reads the current directory
+    pthread_rwlock_wrlock(&fs->ns_lock);
+    int res = change_directory(fs, path);
+    pthread_rwlock_unlock(&fs->ns_lock);
+    return res;
+}
+
+static int list_directory(filesystem_t* fs, const char* path, struct dentry** out_entries, uint32_t* out_count) {
     if (!fs || !path || !out_entries || !out_count) {
         return ERROR_INVALID;
     }
@@ -329,7 +359,7 @@ int fs_list(filesystem_t* fs, const char* path, struct dentry** out_entries, uin
 
     // read inode
     struct inode inode;
-    if (inode_read(fs->disk, inode_num, &inode) != SUCCESS) {
+    if (inode_read(fs, inode_num, &inode) != SUCCESS) {
         return ERROR_IO;
     }
 
@@ -338,5 +368,81 @@ int fs_list(filesystem_t* fs, const char* path, struct dentry** out_entries, uin
         return ERROR_INVALID;
     }
 
-    return dentry_list(fs->disk, inode_num, out_entries, out_count);
-}
\ No newline at end of file
+    return dentry_list(fs, inode_num, out_entries, out_count);
+}
+
+int fs_list(filesystem_t* fs, const char* path, struct dentry** out_entries, uint32_t* out_count) {
+    PERF_OP(PERF_OP_LIST);
+
+    if (!fs) {
+        return ERROR_INVALID;
+    }
+
+    pthread_rwlock_rdlock(&fs->ns_lock);
+    int res = list_directory(fs, path, out_entries, out_count);
+    pthread_rwlock_unlock(&fs->ns_lock);
+    return res;
+}
+
+// === DIRECTORY STREAMS ===
+
+static int open_directory(filesystem_t* fs, const char* path, uint32_t* out_inode_num) {
+    if (!path_is_valid(path)) {
+        return ERROR_INVALID;
+    }
+
+    int res = fs_path_to_inode(fs, path, out_inode_num);
+    if (res != SUCCESS) return res;
+
+    return validate_parent_directory(fs, *out_inode_num);
+}
+
+int fs_opendir(filesystem_t* fs, const char* path, fs_dir_t** out_dir) {
+    if (!fs || !path || !out_dir) {
+        return ERROR_INVALID;
+    }
+
+    uint32_t inode_num;
+    pthread_rwlock_rdlock(&fs->ns_lock);
+    int res = open_directory(fs, path, &inode_num);
+    pthread_rwlock_unlock(&fs->ns_lock);
+    if (res != SUCCESS) return res;
+
+    fs_dir_t* dir = malloc(sizeof(fs_dir_t));
+    if (!dir) {
+        return ERROR_GENERIC;
+    }
+    dir->fs = fs;
+    dir->inode_num = inode_num;
+    dir->pos = 0;
+
+    *out_dir = dir;
+    return SUCCESS;
+}
+
+int fs_readdir(fs_dir_t* dir, struct dentry* out_entries, uint32_t max, uint32_t* out_count) {
+    PERF_OP(PERF_OP_READDIR);
+
+    if (!dir || !out_entries || max == 0 || !out_count) {
+        return ERROR_INVALID;
+    }
+
+    pthread_rwlock_rdlock(&dir->fs->ns_lock);
+    int res = dentry_iterate(dir->fs, dir->inode_num, &dir->pos, out_entries, max, out_count);
+    pthread_rwlock_unlock(&dir->fs->ns_lock);
+    return res;
+}
+
+uint32_t fs_telldir(const fs_dir_t* dir) {
+    return dir ? dir->pos : 0;
+}
+
+void fs_seekdir(fs_dir_t* dir, uint32_t pos) {
+    if (dir) {
+        dir->pos = pos;
+    }
+}
+
+void fs_closedir(fs_dir_t* dir) {
+    free(dir);
+}
@@ -5,7 +5,8 @@
 #include <string.h>
 #include <time.h>
 
-int fs_create(filesystem_t* fs, const char* path, uint16_t permissions) {
+int fs_create_locked(filesystem_t* fs, const char* path, uint16_t permissions,
+                     uint32_t* out_inode_num) {
 
     printf("[DEBUG fs_create] path=%s\n", path);
 
@@ -20,11 +21,18 @@ int fs_create(filesystem_t* fs, const char* path, uint16_t permissions) {
     // allocate inode
     struct inode new_inode;
     uint32_t new_inode_num;
-    if (inode_alloc(fs->disk, fs->inode_bitmap, INODE_TYPE_FILE, permissions,
-                    &new_inode, &new_inode_num) != SUCCESS) {
+    if (inode_alloc_near(fs, parent_inode_num, INODE_TYPE_FILE, permissions,
+                         &new_inode, &new_inode_num) != SUCCESS) {
         return ERROR_NO_SPACE;
     }
-    fs->sb.free_inodes--;
+    fs_free_inodes_sub(fs, 1);
+
+    if (fs->sb.features & FS_FEATURE_EXTENTS) {
+        new_inode.flags |= INODE_FLAG_EXTENTS;
+    }
+    if (fs->sb.features & FS_FEATURE_INLINE_DATA) {
+        new_inode.flags |= INODE_FLAG_INLINE_DATA;   // until it outgrows the inode
+    }
 
     // create dentry
     struct dentry new_dentry;
@@ -35,42 +43,57 @@ int fs_create(filesystem_t* fs, const char* path, uint16_t permissions) {
 
     uint32_t allocated_blocks = 0;
     // add to parent directory
-    if (dentry_add(fs->disk, parent_inode_num, &new_dentry, fs->block_bitmap, &allocated_blocks) != SUCCESS) {
+    if (dentry_add(fs, parent_inode_num, &new_dentry, &allocated_blocks) != SUCCESS) {
         status = ERROR_IO;
         goto cleanup_inode;
     }
-    fs->sb.free_blocks -= allocated_blocks;
+    fs_free_blocks_sub(fs, allocated_blocks);
 
     // update inode
+    new_inode.parent = parent_inode_num;
     new_inode.modified_time = time(NULL);
     new_inode.accessed_time = time(NULL);
-    if (inode_write(fs->disk, new_inode_num, &new_inode) != SUCCESS) {
+    if (inode_write(fs, new_inode_num, &new_inode) != SUCCESS) {
         status = ERROR_IO;
         goto cleanup_remove_parent_dentry;
     }
 
     // update superblock and save
-    save_bitmaps(fs);
-    superblock_write(fs->disk, &fs->sb);
+    commit_metadata(fs);
 
+    if (out_inode_num)
+        *out_inode_num = new_inode_num;
     return SUCCESS;
 
     cleanup_remove_parent_dentry:
-        dentry_remove(fs->disk, fs->block_bitmap, &fs->sb, parent_inode_num, filename);
-        fs->sb.free_blocks += allocated_blocks;
+        dentry_remove(fs, parent_inode_num, filename);
+        fs_free_blocks_add(fs, allocated_blocks);
 
     cleanup_inode:
         uint32_t freed_blocks = 0;
-        inode_free(fs->disk, fs->inode_bitmap, fs->block_bitmap, new_inode_num, &freed_blocks);
-        fs->sb.free_inodes++;
-        fs->sb.free_blocks += freed_blocks;
-        save_bitmaps(fs);
-        superblock_write(fs->disk, &fs->sb);
+        inode_free(fs, new_inode_num, &freed_blocks);
+        fs_free_inodes_add(fs, 1);
+        fs_free_blocks_add(fs, freed_blocks);
+        commit_metadata(fs);
 
     return status;
 }
 
-int fs_link(filesystem_t* fs, const char* existing_path, const char* new_path) {
+int fs_create(filesystem_t* fs, const char* path, uint16_t permissions) {
+    PERF_OP(PERF_OP_CREATE);
+    TRACE_OP(PERF_OP_CREATE, path);
+
+    if (!fs) {
+        return ERROR_INVALID;
+    }
+
+    pthread_rwlock_wrlock(&fs->ns_lock);
+    int res = fs_create_locked(fs, path, permissions, NULL);
+    pthread_rwlock_unlock(&fs->ns_lock);
+    return res;
+}
+
+static int link_file(filesystem_t* fs, const char* existing_path, const char* new_path) {
     if (!fs || !existing_path || !new_path) {
         return ERROR_INVALID;
     }
@@ -87,7 +110,7 @@ int fs_link(filesystem_t* fs, const char* existing_path, const char* new_path) {
 
     // read inode
     struct inode inode;
-    if (inode_read(fs->disk, existing_inode_num, &inode) != SUCCESS) {
+    if (inode_read(fs, existing_inode_num, &inode) != SUCCESS) {
         return ERROR_IO;
     }
 
@@ -96,8 +119,8 @@ int fs_link(filesystem_t* fs, const char* existing_path, const char* new_path) {
         return ERROR_INVALID;
     }
 
-    char* normalized = path_normalize(new_path);
-    if (!normalized) {
+    char normalized[MAX_PATH];
+    if (path_normalize_into(new_path, normalized, sizeof(normalized)) != SUCCESS) {
         return ERROR_INVALID;
     }
 
@@ -105,10 +128,8 @@ int fs_link(filesystem_t* fs, const char* existing_path, const char* new_path) {
     char parent_path[MAX_PATH];
     char filename[MAX_FILENAME];
     if (path_split(normalized, parent_path, filename) != SUCCESS) {
-        free(normalized);
         return ERROR_INVALID;
     }
-    free(normalized);
 
     // validate filename
     if (!filename_is_valid(filename)) {
@@ -117,16 +138,16 @@ int fs_link(filesystem_t* fs, const char* existing_path, const char* new_path) {
 
     // resolve parent
     uint32_t parent_inode_num;
-    res = fs_path_to_inode(fs, parent_path, &parent_inode_num);
+    res = fs_lookup_normalized(fs, parent_path, &parent_inode_num);
     if (res != SUCCESS) return res;
 
     // validate parent is a directory
-    if (validate_parent_directory(fs->disk, parent_inode_num) != SUCCESS) {
+    if (validate_parent_directory(fs, parent_inode_num) != SUCCESS) {
         return ERROR_INVALID;
     }
 
     // check if new path exists
-    if (dentry_find(fs->disk, parent_inode_num, filename, NULL, NULL) == SUCCESS) {
+    if (dentry_find(fs, parent_inode_num, filename, NULL, NULL) == SUCCESS) {
         return ERROR_EXISTS;
     }
 
@@ -136,30 +157,52 @@ int fs_link(filesystem_t* fs, const char* existing_path, const char* new_path) {
 
     uint32_t allocated_blocks = 0;
 
-    if (dentry_add(fs->disk, parent_inode_num, &new_dentry, fs->block_bitmap, &allocated_blocks) != SUCCESS) {
+    if (dentry_add(fs, parent_inode_num, &new_dentry, &allocated_blocks) != SUCCESS) {
         return ERROR_IO;
     }
-    fs->sb.free_blocks -= allocated_blocks;
+    fs_free_blocks_sub(fs, allocated_blocks);
+
+    // increment link count; the file may be open and written meanwhile,
+    // so its inode is re-read under its lock
+    pthread_rwlock_wrlock(fs_inode_lock(fs, existing_inode_num));
+    res = inode_read(fs, existing_inode_num, &inode);
+    if (res == SUCCESS) {
+        inode.links_count++;
+        if (inode.parent == INVALID_INODE_NUM)
+            inode.parent = parent_inode_num;   // adopt the new name as primary
+        inode.modified_time = time(NULL);
+        res = inode_write(fs, existing_inode_num, &inode);
+    }
+    pthread_rwlock_unlock(fs_inode_lock(fs, existing_inode_num));
 
-    // increment link count
-    inode.links_count++;
-    inode.modified_time = time(NULL);
-    if (inode_write(fs->disk, existing_inode_num, &inode) != SUCCESS) {
+    if (res != SUCCESS) {
         // rollback the dentry
-        dentry_remove(fs->disk, fs->block_bitmap, &fs->sb, parent_inode_num, filename);
-        fs->sb.free_blocks += allocated_blocks;
+        dentry_remove(fs, parent_inode_num, filename);
+        fs_free_blocks_add(fs, allocated_blocks);
         return ERROR_IO;
     }
 
-    save_bitmaps(fs);
-    if (superblock_write(fs->disk, &fs->sb) != SUCCESS) {
+    if (commit_metadata(fs) != SUCCESS) {
         return ERROR_IO;
     }
 
     return SUCCESS;
 }
 
-int fs_unlink(filesystem_t* fs, const char* path) {
+int fs_link(filesystem_t* fs, const char* existing_path, const char* new_path) {
+    PERF_OP(PERF_OP_LINK);
+
+    if (!fs) {
+        return ERROR_INVALID;
+    }
+
+    pthread_rwlock_wrlock(&fs->ns_lock);
+    int res = link_file(fs, existing_path, new_path);
+    pthread_rwlock_unlock(&fs->ns_lock);
+    return res;
+}
+
+static int unlink_file(filesystem_t* fs, const char* path) {
     if (!fs || !path) {
         return ERROR_INVALID;
     }
@@ -176,7 +219,7 @@ int fs_unlink(filesystem_t* fs, const char* path) {
 
     // read inode
     struct inode inode;
-    if (inode_read(fs->disk, inode_num, &inode) != SUCCESS) {
+    if (inode_read(fs, inode_num, &inode) != SUCCESS) {
         return ERROR_IO;
     }
 
@@ -185,8 +228,8 @@ int fs_unlink(filesystem_t* fs, const char* path) {
         return ERROR_INVALID;
     }
 
-    char* normalized = path_normalize(path);
-    if (!normalized) {
+    char normalized[MAX_PATH];
+    if (path_normalize_into(path, normalized, sizeof(normalized)) != SUCCESS) {
         return ERROR_INVALID;
     }
 
@@ -194,41 +237,187 @@ int fs_unlink(filesystem_t* fs, const char* path) {
     char parent_path[MAX_PATH];
     char filename[MAX_FILENAME];
     if (path_split(normalized, parent_path, filename) != SUCCESS) {
-        free(normalized);
         return ERROR_INVALID;
     }
-    free(normalized);
 
     uint32_t parent_inode_num;
-    res = fs_path_to_inode(fs, parent_path, &parent_inode_num);
+    res = fs_lookup_normalized(fs, parent_path, &parent_inode_num);
     if (res != SUCCESS) return res;
 
-    res = dentry_remove(fs->disk, fs->block_bitmap, &fs->sb, parent_inode_num, filename);
+    res = dentry_remove(fs, parent_inode_num, filename);
     if (res != SUCCESS) return res;
 
-    // decrement link count
-    inode.links_count--;
+    // decrement link count (re-read under the inode's lock, as in link_file)
+    pthread_rwlock_wrlock(fs_inode_lock(fs, inode_num));
+    res = inode_read(fs, inode_num, &inode);
+    if (res == SUCCESS) {
+        inode.links_count--;
+
+        // free resources if links_count reaches 0
+        if (inode.links_count == 0) {
+            uint32_t freed_blocks = 0;
+
+            res = inode_free(fs, inode_num, &freed_blocks);
+            if (res == SUCCESS) {
+                fs_free_inodes_add(fs, 1);
+                fs_free_blocks_add(fs, freed_blocks);
+            }
+        } else {
+            // the primary name is gone: fs_inode_to_path finds another one
+            if (inode.parent == parent_inode_num)
+                inode.parent = INVALID_INODE_NUM;
+
+            // update inode with decremented link count
+            res = inode_write(fs, inode_num, &inode);
+        }
+    }
+    pthread_rwlock_unlock(fs_inode_lock(fs, inode_num));
 
-    // free resources if links_count reaches 0
-    if (inode.links_count == 0) {
-        uint32_t freed_blocks = 0;
+    if (res != SUCCESS) {
+        return ERROR_IO;
+    }
 
-        if (inode_free(fs->disk, fs->inode_bitmap, fs->block_bitmap, inode_num, &freed_blocks) != SUCCESS) {
-            return ERROR_IO;
-        }
+    // save
+    if (commit_metadata(fs) != SUCCESS) return ERROR_IO;
+
+    return SUCCESS;
+}
+
+int fs_unlink(filesystem_t* fs, const char* path) {
+    PERF_OP(PERF_OP_UNLINK);
+    TRACE_OP(PERF_OP_UNLINK, path);
+
+    if (!fs) {
+        return ERROR_INVALID;
+    }
+
+    pthread_rwlock_wrlock(&fs->ns_lock);
+    int res = unlink_file(fs, path);
+    pthread_rwlock_unlock(&fs->ns_lock);
+    return res;
+}
+
+// === CLONES ===
+
+// references taken on a source's data runs, so that a failed clone can drop them
+struct shared_runs {
+    filesystem_t* fs;
+    uint32_t runs;                    // runs shared so far / left to drop
+};
 
-        fs->sb.free_inodes++;
-        fs->sb.free_blocks += freed_blocks;
-    } else {
-        // update inode with decremented link count
-        if (inode_write(fs->disk, inode_num, &inode) != SUCCESS) {
-            return ERROR_IO;
+static int share_data_run(uint32_t start, uint32_t count, bool meta, void* arg) {
+    struct shared_runs* s = arg;
+    if (meta) return 0;
+    int res = block_share_run(s->fs, start, count);
+    if (res == SUCCESS) s->runs++;
+    return res;
+}
+
+static int unshare_data_run(uint32_t start, uint32_t count, bool meta, void* arg) {
+    struct shared_runs* s = arg;
+    if (meta) return 0;
+    if (s->runs == 0) return 1;       // stop: the rest was never shared
+    s->runs--;
+    block_free_run(s->fs, start, count);
+    return 0;
+}
+
+static int clone_file(filesystem_t* fs, const char* existing_path, const char* new_path) {
+    if (!fs || !existing_path || !new_path) {
+        return ERROR_INVALID;
+    }
+
+    // validate paths
+    if (!path_is_valid(existing_path) || !path_is_valid(new_path)) {
+        return ERROR_INVALID;
+    }
+
+    // resolve the source: a regular file
+    uint32_t src_num;
+    int res = fs_path_to_inode(fs, existing_path, &src_num);
+    if (res != SUCCESS) return res;
+
+    struct inode src;
+    if (inode_read(fs, src_num, &src) != SUCCESS) {
+        return ERROR_IO;
+    }
+    if (src.type != INODE_TYPE_FILE) {
+        return ERROR_INVALID;
+    }
+    bool reflink = (fs->sb.features & FS_FEATURE_REFLINK) != 0;
+    if (!reflink && !bmap_is_inline(&src) && src.blocks_used != 0) {
+        return ERROR_INVALID;
+    }
+
+    uint32_t dst_num;
+    res = fs_create_locked(fs, new_path, src.permissions, &dst_num);
+    if (res != SUCCESS) return res;
+
+    // the source may be open and written meanwhile: both inodes are handled
+    // under their locks, taken in address order (stripes may coincide)
+    pthread_rwlock_t* first = fs_inode_lock(fs, src_num);
+    pthread_rwlock_t* second = fs_inode_lock(fs, dst_num);
+    if (first > second) {
+        pthread_rwlock_t* tmp = first;
+        first = second;
+        second = tmp;
+    }
+    pthread_rwlock_wrlock(first);
+    if (second != first) pthread_rwlock_wrlock(second);
+
+    struct inode dst;
+    struct shared_runs shared = { fs, 0 };
+    uint32_t meta_blocks = 0;
+    res = inode_read(fs, src_num, &src);
+    if (res == SUCCESS) res = inode_read(fs, dst_num, &dst);
+    if (res == SUCCESS && !reflink && !bmap_is_inline(&src) && src.blocks_used != 0) {
+        res = ERROR_INVALID;            // grew out of the inode since
+    }
+    if (res == SUCCESS) {
+        res = bmap_for_each_block(fs, &src, share_data_run, &shared);
+    }
+    if (res == SUCCESS) {
+        res = bmap_clone(fs, &src, &dst, &meta_blocks);
+    }
+    if (res == SUCCESS) {
+        fs_free_blocks_sub(fs, meta_blocks);
+        dst.size = src.size;
+        res = inode_write(fs, dst_num, &dst);
+        if (res != SUCCESS) {
+            // the mapping goes again; the data blocks only lose their references
+            uint32_t freed_blocks = 0;
+            bmap_truncate(fs, &dst, 0, &freed_blocks);
+            fs_free_blocks_add(fs, freed_blocks);
+            shared.runs = 0;
         }
     }
+    if (res != SUCCESS && shared.runs > 0) {
+        bmap_for_each_block(fs, &src, unshare_data_run, &shared);
+    }
 
-    // save
-    if (save_bitmaps(fs) != SUCCESS) return ERROR_IO;
-    if (superblock_write(fs->disk, &fs->sb) != SUCCESS) return ERROR_IO;
+    if (second != first) pthread_rwlock_unlock(second);
+    pthread_rwlock_unlock(first);
+
+    if (res != SUCCESS) {
+        unlink_file(fs, new_path);
+        return res;
+    }
+
+    if (commit_metadata(fs) != SUCCESS) return ERROR_IO;
 
     return SUCCESS;
-}
\ No newline at end of file
+}
+
+int fs_clone(filesystem_t* fs, const char* existing_path, const char* new_path) {
+    PERF_OP(PERF_OP_CLONE);
+    TRACE_OP(PERF_OP_CLONE, new_path);
+
+    if (!fs) {
+        return ERROR_INVALID;
+    }
+
+    pthread_rwlock_wrlock(&fs->ns_lock);
+    int res = clone_file(fs, existing_path, new_path);
+    pthread_rwlock_unlock(&fs->ns_lock);
+    return res;
+}
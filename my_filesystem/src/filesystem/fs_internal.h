@@ -2,11 +2,59 @@
 
 #include "fs.h"
 
-int load_bitmaps(filesystem_t* fs);
+// === LOCKING ===
+
+void fs_locks_init(filesystem_t* fs);
+void fs_locks_destroy(filesystem_t* fs);
+
+// holds off every other operation: ns_lock and every inode lock exclusively
+// (see the lock order in fs.h)
+void fs_freeze(filesystem_t* fs);
+void fs_thaw(filesystem_t* fs);
+
+// lock of an inode's contents (see fs.h); inodes share FS_INODE_LOCKS stripes
+static inline pthread_rwlock_t* fs_inode_lock(filesystem_t* fs, uint32_t inode_num) {
+    return &fs->inode_locks[inode_num & (FS_INODE_LOCKS - 1)];
+}
+
+// free-space counters: adjusted from several threads without a lock
+static inline void fs_free_blocks_add(filesystem_t* fs, uint32_t n) {
+    __atomic_add_fetch(&fs->sb.free_blocks, n, __ATOMIC_RELAXED);
+}
+
+static inline void fs_free_blocks_sub(filesystem_t* fs, uint32_t n) {
+    __atomic_sub_fetch(&fs->sb.free_blocks, n, __ATOMIC_RELAXED);
+}
+
+static inline void fs_free_inodes_add(filesystem_t* fs, uint32_t n) {
+    __atomic_add_fetch(&fs->sb.free_inodes, n, __ATOMIC_RELAXED);
+}
+
+static inline void fs_free_inodes_sub(filesystem_t* fs, uint32_t n) {
+    __atomic_sub_fetch(&fs->sb.free_inodes, n, __ATOMIC_RELAXED);
+}
+
+// === METADATA ===
+
+// map: work in place on the mapped image when the disk and layout allow it
+// (sets fs->bitmaps_mapped)
+int load_bitmaps(filesystem_t* fs, bool map);
 int save_bitmaps(filesystem_t* fs);
+void free_bitmaps(filesystem_t* fs);
+
+// writes back dirty inodes, dirty bitmap chunks and the superblock
+int flush_metadata(filesystem_t* fs);
+
+// ends a metadata-changing operation: flushes according to fs->flush_policy
+int commit_metadata(filesystem_t* fs);
 
 int fs_path_to_inode(filesystem_t* fs, const char* path, uint32_t* out_inode_num);
 
+// fs_create for a caller already holding fs->ns_lock exclusively; the new
+// file's inode goes to *out_inode_num (may be NULL)
+int fs_create_locked(filesystem_t* fs, const char* path, uint16_t permissions,
+                     uint32_t* out_inode_num);
+
 /**
  * Reconstructs the absolute filesystem path of a file/directory from its inode number.
  * 
@@ -18,12 +66,40 @@ int fs_path_to_inode(filesystem_t* fs, const char* path, uint32_t* out_inode_num
  */
 int fs_inode_to_path(filesystem_t* fs, uint32_t inode_num, char* out_path, size_t out_size);
 
-int validate_parent_directory(disk_t disk, uint32_t inode_num);
+// fs_path_to_inode for a path already validated and in path_normalize() form
+// (so also the parent from path_split of one); allocates nothing
+int fs_lookup_normalized(filesystem_t* fs, const char* normalized, uint32_t* out_inode_num);
+
+int validate_parent_directory(filesystem_t* fs, uint32_t inode_num);
 int fs_prepare_create(filesystem_t* fs, const char* path,
                       char* parent_path, char* name,
                       uint32_t* parent_inode_num);
 
-int read_inode_data(filesystem_t* fs, const struct inode* inode,
+// cursor: block-map state for the call (NULL = private), released before returning
+int read_inode_data(filesystem_t* fs, const struct inode* inode, struct bmap_cursor* cursor,
                     uint32_t offset, void* buffer, size_t size, size_t* bytes_read);
 int write_inode_data(filesystem_t* fs, struct inode* inode, uint32_t inode_num,
-                     uint32_t offset, const void* buffer, size_t size, size_t* bytes_written);
\ No newline at end of file
+                     struct bmap_cursor* cursor, uint32_t offset,
+                     const void* buffer, size_t size, size_t* bytes_written);
+// === COMPRESSED FILES (see fs_compress.c) ===
+
+// bytes compressed as a unit: FS_COMPRESS_CHUNK, at least four blocks
+static inline uint32_t compress_chunk_bytes(const filesystem_t* fs) {
+    uint32_t four_blocks = 4 * fs_block_size(fs);
+    return (FS_COMPRESS_CHUNK > four_blocks) ? FS_COMPRESS_CHUNK : four_blocks;
+}
+
+// decompressed-chunk cache of a mount
+struct chunk_cache* chunk_cache_create(uint32_t chunk_bytes);
+void chunk_cache_destroy(struct chunk_cache** cache);
+
+// read_inode_data / write_inode_data for INODE_FLAG_COMPRESSED files
+int read_compressed(filesystem_t* fs, const struct inode* inode, struct bmap_cursor* cursor,
+                    uint32_t offset, void* buffer, size_t size, size_t* bytes_read);
+int write_compressed(filesystem_t* fs, struct inode* inode, uint32_t inode_num,
+                     struct bmap_cursor* cursor, uint32_t offset,
+                     const void* buffer, size_t size, size_t* bytes_written);
+
+// moves the size of a compressed file (inode lock held exclusively), not
+// writing the inode back
+int resize_compressed(filesystem_t* fs, struct inode* inode, uint32_t inode_num, uint32_t new_size);
@@ -4,16 +4,27 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+
 /**
  * Reads data from an inode's data blocks.
- * Handles direct and indirect blocks.
+ * The block map is walked one run at a time: data is copied straight from
+ * the mapped disk image into the caller's buffer, one memcpy per run of
+ * physically contiguous blocks (holes read as zeros). The cursor (NULL =
+ * a private one) is released before returning.
  */
-int read_inode_data(filesystem_t* fs, const struct inode* inode,
+int read_inode_data(filesystem_t* fs, const struct inode* inode, struct bmap_cursor* cursor,
                            uint32_t offset, void* buffer, size_t size, size_t* bytes_read) {
     if (!fs || !inode || !buffer || !bytes_read) {
         return ERROR_INVALID;
     }
 
+    struct bmap_cursor local;
+    if (!cursor) {
+        bmap_cursor_init(&local);
+        cursor = &local;
+    }
+    int res = SUCCESS;
+
     // calculate how much data is available
     uint32_t available = (offset < inode->size) ? (inode->size - offset) : 0;
     size_t to_read = (size < available) ? size : available;
@@ -23,73 +34,148 @@ int read_inode_data(filesystem_t* fs, const struct inode* inode,
         return SUCCESS;
     }
 
-    uint32_t start_block_idx = offset / BLOCK_SIZE;
-    uint32_t start_offset = offset % BLOCK_SIZE;
+    // small files: the contents came with the inode
+    if (bmap_is_inline(inode)) {
+        bmap_inline_read(inode, offset, buffer, (uint32_t)to_read);
+        *bytes_read = to_read;
+        return SUCCESS;
+    }
+    if (inode->flags & INODE_FLAG_COMPRESSED) {
+        return read_compressed(fs, inode, cursor, offset, buffer, to_read, bytes_read);
+    }
+
+    const uint32_t shift = fs_block_shift(fs);
+    const uint32_t mask = fs_block_mask(fs);
+    uint32_t block_idx = offset >> shift;
+    uint32_t start_offset = offset & mask;
     uint32_t remaining = to_read;
     uint8_t* buf_ptr = (uint8_t*)buffer;
 
-    char block_buffer[BLOCK_SIZE];
-
     while (remaining > 0) {
-        uint32_t block_num = 0;
-
-        // determine which block to read
-        if (start_block_idx < 12) {
-            // direct block
-            block_num = inode->direct[start_block_idx];
-        } else {
-            // indirect block
-            if (inode->indirect == 0) {
-                return ERROR_INVALID;
-            }
-
-            char indirect_buffer[BLOCK_SIZE];
-            if (disk_read_block(fs->disk, inode->indirect, indirect_buffer) != DISK_SUCCESS) {
-                return ERROR_IO;
-            }
+        uint32_t blocks_left = (uint32_t)(((uint64_t)start_offset + remaining + mask) >> shift);
 
-            uint32_t* block_ptrs = (uint32_t*)indirect_buffer;
-            uint32_t indirect_idx = start_block_idx - 12;
-            
-            if (indirect_idx >= BLOCK_SIZE / sizeof(uint32_t)) {
-                return ERROR_INVALID;
-            }
-            
-            block_num = block_ptrs[indirect_idx];
+        uint32_t block_num, run;
+        res = bmap_lookup(fs, inode, cursor, block_idx, blocks_left, &block_num, &run);
+        if (res != SUCCESS) {
+            goto cleanup;
         }
 
+        uint64_t run_bytes = ((uint64_t)run << shift) - start_offset;
+        uint32_t chunk = (remaining < run_bytes) ? remaining : (uint32_t)run_bytes;
+
         if (block_num == 0) {
             // sparse file (hole) - return zeros
-            uint32_t chunk = (remaining < BLOCK_SIZE - start_offset) ? remaining : (BLOCK_SIZE - start_offset);
             memset(buf_ptr, 0, chunk);
-            buf_ptr += chunk;
-            remaining -= chunk;
         } else {
-            // read actual block
-            if (disk_read_block(fs->disk, block_num, block_buffer) != DISK_SUCCESS) {
-                return ERROR_IO;
+            const void* src;
+            if (disk_borrow_blocks(fs->disk, block_num, run, &src) != DISK_SUCCESS) {
+                res = ERROR_IO;
+                goto cleanup;
             }
-
-            uint32_t chunk = (remaining < BLOCK_SIZE - start_offset) ? remaining : (BLOCK_SIZE - start_offset);
-            memcpy(buf_ptr, block_buffer + start_offset, chunk);
-            buf_ptr += chunk;
-            remaining -= chunk;
+            memcpy(buf_ptr, (const uint8_t*)src + start_offset, chunk);
+            disk_release_blocks(fs->disk, block_num, run, false);
         }
 
-        start_block_idx++;
+        buf_ptr += chunk;
+        remaining -= chunk;
+        block_idx += run;
         start_offset = 0;
     }
 
     *bytes_read = to_read;
+
+cleanup:
+    bmap_cursor_release(fs, cursor);
+    return res;
+}
+
+/*
+ * Moves the contents of an inline file into a data block, leaving it mapped
+ * (inode lock held exclusively). On failure the inode is left inline.
+ */
+static int spill_inline(filesystem_t* fs, struct inode* inode, uint32_t inode_num) {
+    struct inode saved = *inode;
+    uint8_t data[BMAP_INLINE_MAX];
+    bmap_inline_detach(inode, data);
+    if (inode->size == 0) {
+        return SUCCESS;
+    }
+
+    size_t written = 0;
+    int res = write_inode_data(fs, inode, inode_num, NULL, 0, data, inode->size, &written);
+    if (res != SUCCESS) {
+        uint32_t freed = 0;
+        bmap_truncate(fs, inode, 0, &freed);
+        fs_free_blocks_add(fs, freed);
+        *inode = saved;
+        inode_write(fs, inode_num, inode);
+    }
+    return res;
+}
+
+/*
+ * Gives the inode a private copy of the start of the shared run mapped at
+ * logical block idx (physical old, count blocks): new blocks are allocated
+ * near goal, the old bytes outside [keep_from, keep_to) (offsets into the
+ * run, the part the caller is about to overwrite) are copied over, and the
+ * old blocks lose this file's reference. *out_block and *out_count describe
+ * the copy, which may be shorter than the run.
+ */
+static int unshare_run(filesystem_t* fs, struct inode* inode, struct bmap_cursor* cursor,
+                       uint32_t idx, uint32_t old, uint32_t count, uint32_t goal,
+                       uint64_t keep_from, uint64_t keep_to,
+                       uint32_t* out_block, uint32_t* out_count) {
+    uint32_t block, n, meta_blocks;
+    int res = block_alloc(fs, goal, count, &block, &n);
+    if (res != SUCCESS) {
+        return res;
+    }
+
+    const uint32_t shift = fs_block_shift(fs);
+    uint64_t bytes = (uint64_t)n << shift;
+    const void* src;
+    void* dst;
+    if (disk_borrow_blocks(fs->disk, old, n, &src) != DISK_SUCCESS) {
+        block_free_run(fs, block, n);
+        return ERROR_IO;
+    }
+    if (disk_borrow_blocks_mut(fs->disk, block, n, &dst) != DISK_SUCCESS) {
+        disk_release_blocks(fs->disk, old, n, false);
+        block_free_run(fs, block, n);
+        return ERROR_IO;
+    }
+    keep_to = (keep_to < bytes) ? keep_to : bytes;
+    keep_from = (keep_from < keep_to) ? keep_from : keep_to;
+    memcpy(dst, src, keep_from);
+    memcpy((uint8_t*)dst + keep_to, (const uint8_t*)src + keep_to, bytes - keep_to);
+    disk_release_blocks(fs->disk, old, n, false);
+    disk_release_blocks(fs->disk, block, n, true);
+
+    res = bmap_remap(fs, inode, cursor, idx, block, n, &meta_blocks);
+    if (res != SUCCESS) {
+        block_free_run(fs, block, n);
+        return res;
+    }
+
+    fs_free_blocks_sub(fs, n + meta_blocks);
+    fs_free_blocks_add(fs, block_free_run(fs, old, n));
+    *out_block = block;
+    *out_count = n;
     return SUCCESS;
 }
 
 /**
  * Writes data to an inode's data blocks.
- * Allocates new blocks as needed.
+ * Works one run at a time: mapped runs are overwritten in place, and each
+ * hole the write covers is filled with one contiguous allocation placed
+ * right after the file's previous block. Pointer blocks touched on the way
+ * are written back once, when the cursor (NULL = a private one) is released
+ * before returning. An inline file is written in the inode while it stays
+ * within BMAP_INLINE_MAX bytes, and moved to a block first otherwise.
  */
 int write_inode_data(filesystem_t* fs, struct inode* inode, uint32_t inode_num,
-                            uint32_t offset, const void* buffer, size_t size, size_t* bytes_written) {
+                     struct bmap_cursor* cursor, uint32_t offset,
+                     const void* buffer, size_t size, size_t* bytes_written) {
     if (!fs || !inode || !buffer || !bytes_written) {
         return ERROR_INVALID;
     }
@@ -101,217 +187,317 @@ int write_inode_data(filesystem_t* fs, struct inode* inode, uint32_t inode_num,
 
     *bytes_written = 0;
 
-    uint32_t start_block_idx = offset / BLOCK_SIZE;
-    uint32_t start_offset = offset % BLOCK_SIZE;
+    if (bmap_is_inline(inode)) {
+        if (offset + size <= BMAP_INLINE_MAX) {
+            // bytes between the old end and offset are already zero
+            bmap_inline_write(inode, offset, buffer, (uint32_t)size);
+            *bytes_written = size;
+            if (offset + size > inode->size) {
+                inode->size = offset + (uint32_t)size;
+            }
+            inode->modified_time = time(NULL);
+            return (inode_write(fs, inode_num, inode) == SUCCESS) ? SUCCESS : ERROR_IO;
+        }
+        int spilled = spill_inline(fs, inode, inode_num);
+        if (spilled != SUCCESS) {
+            return spilled;
+        }
+    }
+    if (inode->flags & INODE_FLAG_COMPRESSED) {
+        return write_compressed(fs, inode, inode_num, cursor, offset, buffer, size, bytes_written);
+    }
+
+    const uint32_t shift = fs_block_shift(fs);
+    const uint32_t mask = fs_block_mask(fs);
+    uint32_t block_idx = offset >> shift;
+    uint32_t start_offset = offset & mask;
     uint32_t remaining = size;
     const uint8_t* buf_ptr = (const uint8_t*)buffer;
 
-    char block_buffer[BLOCK_SIZE];
     bool inode_modified = false;
+    int res = SUCCESS;
 
-    while (remaining > 0) {
-        uint32_t block_num = 0;
-        uint32_t* block_num_ptr = NULL;
-        bool needs_indirect_write = false;
-        char indirect_buffer[BLOCK_SIZE];
-
-        bool allocated_indirect_block = false;
-        uint32_t allocated_indirect_block_num = 0;
-
-        bool allocated_data_block = false;
-        uint32_t allocated_data_block_num = 0;
-
-        // determine which block to write
-        if (start_block_idx < 12) {
-            // direct block — do not take address of packed member
-            block_num = inode->direct[start_block_idx];
-            block_num_ptr = NULL;
-        } else {
-            // indirect block
-            uint32_t indirect_idx = start_block_idx - 12;
-
-            if (indirect_idx >= BLOCK_SIZE / sizeof(uint32_t)) {
-                return ERROR_NO_SPACE;
-            }
-
-            if (inode->indirect == 0) {
-                int new_block = bitmap_find_first_free(fs->block_bitmap);
-                if (new_block < 0) {
-                    return ERROR_NO_SPACE;
-                }
-
-                if (bitmap_set(fs->block_bitmap, new_block) != SUCCESS) {
-                    return ERROR_GENERIC;
-                }
-
-                fs->sb.free_blocks--;
-                inode->indirect = new_block;
-                inode->blocks_used++;
-                inode_modified = true;
-
-                allocated_indirect_block = true;
-                allocated_indirect_block_num = new_block;
+    struct bmap_cursor local;
+    if (!cursor) {
+        bmap_cursor_init(&local);
+        cursor = &local;
+    }
 
-                memset(indirect_buffer, 0, BLOCK_SIZE);
-                if (disk_write_block(fs->disk, new_block, indirect_buffer) != DISK_SUCCESS) {
-                    bitmap_clear(fs->block_bitmap, new_block);
-                    fs->sb.free_blocks++;
-                    inode->indirect = 0;
-                    inode->blocks_used--;
-                    return ERROR_IO;
-                }
-            }
+    // where the next allocated block should go
+    uint32_t goal = bmap_goal(fs, inode_num, inode, cursor, block_idx);
 
-            if (disk_read_block(fs->disk, inode->indirect, indirect_buffer) != DISK_SUCCESS) {
-                return ERROR_IO;
-            }
+    while (remaining > 0) {
+        // blocks this write still touches, including the current one
+        uint32_t blocks_left = (uint32_t)(((uint64_t)start_offset + remaining + mask) >> shift);
 
-            uint32_t* block_ptrs = (uint32_t*)indirect_buffer;
-            block_num = block_ptrs[indirect_idx];
-            block_num_ptr = &block_ptrs[indirect_idx];
-            needs_indirect_write = true;
+        uint32_t block_num, run;
+        res = bmap_lookup(fs, inode, cursor, block_idx, blocks_left, &block_num, &run);
+        if (res != SUCCESS) {
+            break;
         }
 
-        // allocate block if needed
-        if (block_num == 0) {
-            int new_block = bitmap_find_first_free(fs->block_bitmap);
-            if (new_block < 0) {
-                if (allocated_indirect_block) {
-                    bitmap_clear(fs->block_bitmap, allocated_indirect_block_num);
-                    fs->sb.free_blocks++;
-                    inode->indirect = 0;
-                    inode->blocks_used--;
-                }
-                return ERROR_NO_SPACE;
+        bool fresh = (block_num == 0);
+        if (fresh) {
+            // fill (part of) the hole with one contiguous run
+            uint32_t count, meta_blocks;
+            res = block_alloc(fs, goal, run, &block_num, &count);
+            if (res != SUCCESS) {
+                break;
             }
 
-            if (bitmap_set(fs->block_bitmap, new_block) != SUCCESS) {
-                if (allocated_indirect_block) {
-                    bitmap_clear(fs->block_bitmap, allocated_indirect_block_num);
-                    fs->sb.free_blocks++;
-                    inode->indirect = 0;
-                    inode->blocks_used--;
-                }
-                return ERROR_GENERIC;
+            res = bmap_map(fs, inode, cursor, block_idx, block_num, count, &meta_blocks);
+            if (res != SUCCESS) {
+                block_free_run(fs, block_num, count);
+                break;
             }
 
-            fs->sb.free_blocks--;
-            block_num = new_block;
-            inode->blocks_used++;
+            fs_free_blocks_sub(fs, count + meta_blocks);
+            run = count;
             inode_modified = true;
-
-            if (needs_indirect_write) {
-                *block_num_ptr = new_block;
-            } else {
-                inode->direct[start_block_idx] = new_block;
-            }
-
-            allocated_data_block = true;
-            allocated_data_block_num = new_block;
-
-            memset(block_buffer, 0, BLOCK_SIZE);
-
-            if (needs_indirect_write) {
-                if (disk_write_block(fs->disk, inode->indirect, indirect_buffer) != DISK_SUCCESS) {
-                    bitmap_clear(fs->block_bitmap, new_block);
-                    fs->sb.free_blocks++;
-                    *block_num_ptr = 0;
-                    inode->blocks_used--;
-
-                    if (allocated_indirect_block) {
-                        bitmap_clear(fs->block_bitmap, allocated_indirect_block_num);
-                        fs->sb.free_blocks++;
-                        inode->indirect = 0;
-                        inode->blocks_used--;
-                    }
-
-                    return ERROR_IO;
-                }
-            }
         } else {
-            if (start_offset != 0 || remaining < BLOCK_SIZE) {
-                if (disk_read_block(fs->disk, block_num, block_buffer) != DISK_SUCCESS) {
-                    return ERROR_IO;
-                }
-            } else {
-                memset(block_buffer, 0, BLOCK_SIZE);
+            // blocks shared with a clone are copied before being written
+            bool shared;
+            uint32_t same;
+            res = block_is_shared(fs, block_num, run, &shared, &same);
+            if (res != SUCCESS) {
+                break;
             }
-        }
-
-        // write data to block buffer
-        uint32_t chunk = (remaining < BLOCK_SIZE - start_offset) ? remaining : (BLOCK_SIZE - start_offset);
-        memcpy(block_buffer + start_offset, buf_ptr, chunk);
-
-        // write block to disk
-        if (disk_write_block(fs->disk, block_num, block_buffer) != DISK_SUCCESS) {
-            if (allocated_data_block) {
-                bitmap_clear(fs->block_bitmap, allocated_data_block_num);
-                fs->sb.free_blocks++;
-                if (needs_indirect_write) {
-                    *block_num_ptr = 0;
-                    // sync indirect block back to disk after rollback
-                    disk_write_block(fs->disk, inode->indirect, indirect_buffer);
-                } else {
-                    inode->direct[start_block_idx] = 0;
+            run = same;
+            if (shared) {
+                res = unshare_run(fs, inode, cursor, block_idx, block_num, run, goal,
+                                  start_offset, (uint64_t)start_offset + remaining,
+                                  &block_num, &run);
+                if (res != SUCCESS) {
+                    break;
                 }
-                inode->blocks_used--;
+                inode_modified = true;
             }
+        }
 
-            if (allocated_indirect_block) {
-                bitmap_clear(fs->block_bitmap, allocated_indirect_block_num);
-                fs->sb.free_blocks++;
-                inode->indirect = 0;
-                inode->blocks_used--;
-            }
+        uint64_t run_bytes = ((uint64_t)run << shift) - start_offset;
+        uint32_t chunk = (remaining < run_bytes) ? remaining : (uint32_t)run_bytes;
 
-            return ERROR_IO;
+        void* dst;
+        if (disk_borrow_blocks_mut(fs->disk, block_num, run, &dst) != DISK_SUCCESS) {
+            res = ERROR_IO;
+            break;
         }
+        uint8_t* run_ptr = (uint8_t*)dst;
+        if (fresh) {
+            // new blocks: zero whatever this write does not cover
+            memset(run_ptr, 0, start_offset);
+            memset(run_ptr + start_offset + chunk, 0, run_bytes - chunk);
+        }
+        memcpy(run_ptr + start_offset, buf_ptr, chunk);
+        disk_release_blocks(fs->disk, block_num, run, true);
 
         buf_ptr += chunk;
         remaining -= chunk;
         *bytes_written += chunk;
-        start_block_idx++;
+        block_idx += run;
         start_offset = 0;
+        goal = block_num + run;
     }
 
-    // update inode size if needed
-    uint32_t end_pos = offset + size;
+    bmap_cursor_release(fs, cursor);
+
+    // the file grows by what actually reached its blocks
+    uint32_t end_pos = offset + *bytes_written;
     if (end_pos > inode->size) {
         inode->size = end_pos;
         inode_modified = true;
     }
 
-    if(inode_modified) {
-        // update modification time and write inode back to disk
+    if (inode_modified) {
+        // update modification time and write inode back
         inode->modified_time = time(NULL);
-        if (inode_write(fs->disk, inode_num, inode) != SUCCESS) {
+        if (inode_write(fs, inode_num, inode) != SUCCESS) {
             return ERROR_IO;
         }
     }
 
-    return SUCCESS;
+    return res;
 }
 
-int fs_open(filesystem_t* fs, const char* path, uint32_t flags, open_file_t** out_file) {
-    if (!fs || !path || !out_file) {
+// === READAHEAD ===
+
+// non-sequential reads in a row after which the blocks read are hinted RANDOM
+#define READAHEAD_RANDOM_AFTER 2
+
+/*
+ * Passes advice for the logical blocks [idx, idx + count) of the file to the
+ * disk, one call per physical run (holes are skipped). Returns the number of
+ * blocks advised. Hints are best effort: errors are ignored.
+ */
+static uint32_t advise_file_blocks(open_file_t* file, uint32_t idx, uint32_t count,
+                                   disk_advice_t advice) {
+    filesystem_t* fs = file->fs;
+    uint32_t advised = 0;
+
+    while (count > 0) {
+        uint32_t phys, run;
+        if (bmap_lookup(fs, file->inode, &file->cursor, idx, count, &phys, &run) != SUCCESS ||
+            run == 0) {
+            break;
+        }
+        if (phys != 0 && disk_advise_blocks(fs->disk, (int)phys, (int)run, advice) == DISK_SUCCESS)
+            advised += run;
+        idx += run;
+        count -= run;
+    }
+
+    bmap_cursor_release(fs, &file->cursor);
+    return advised;
+}
+
+// updates the stream state after len bytes were read at offset (len > 0)
+static void readahead_update(open_file_t* file, uint32_t offset, size_t len) {
+    filesystem_t* fs = file->fs;
+    struct fs_readahead* ra = &file->ra;
+    uint32_t shift = fs_block_shift(fs);
+
+    bool sequential = (offset == ra->next);
+    ra->next = offset + (uint32_t)len;
+
+    uint32_t first = offset >> shift;
+    uint32_t after = ((ra->next - 1) >> shift) + 1;     // first block past the read
+
+    if (!sequential) {
+        ra->window = 0;
+        ra->ahead_end = 0;
+        if (++ra->random >= READAHEAD_RANDOM_AFTER)
+            advise_file_blocks(file, first, after - first, DISK_ADVICE_RANDOM);
+        return;
+    }
+    ra->random = 0;
+
+    uint32_t min_window = FS_READAHEAD_MIN >> shift;
+    uint32_t max_window = FS_READAHEAD_MAX >> shift;
+    if (min_window == 0)
+        min_window = 1;
+
+    if (ra->window == 0) {
+        ra->window = min_window;
+        ra->ahead_end = after;
+    }
+
+    // refill once the stream has consumed half of what was read ahead
+    if (ra->ahead_end > after + ra->window / 2)
+        return;
+
+    uint32_t file_blocks = (uint32_t)(((uint64_t)file->inode->size + fs_block_mask(fs)) >> shift);
+    uint32_t from = (ra->ahead_end > after) ? ra->ahead_end : after;
+    uint32_t to = after + ra->window;
+    if (to > file_blocks)
+        to = file_blocks;
+
+    if (from < to) {
+        advise_file_blocks(file, from, to - from, DISK_ADVICE_SEQUENTIAL);
+        ra->blocks += advise_file_blocks(file, from, to - from, DISK_ADVICE_WILLNEED);
+        ra->ahead_end = to;
+    }
+
+    ra->window = (ra->window * 2 < max_window) ? ra->window * 2 : max_window;
+}
+
+// === SIZE CHANGES ===
+
+/*
+ * Sets the size of a file (inode lock held exclusively). Blocks past the new
+ * end, preallocated ones included, are released run by run; the rest of a
+ * kept partial last block is zeroed, so that growing the file again reads
+ * zeros there. Growing only moves the size: the new range is a hole.
+ */
+static int truncate_locked(filesystem_t* fs, uint32_t inode_num, uint32_t new_size) {
+    struct inode inode;
+    if (inode_read(fs, inode_num, &inode) != SUCCESS) {
+        return ERROR_IO;
+    }
+    if (inode.type != INODE_TYPE_FILE) {
         return ERROR_INVALID;
     }
 
-    // validate path
-    if (!path_is_valid(path)) {
+    if (bmap_is_inline(&inode)) {
+        if (new_size <= BMAP_INLINE_MAX) {
+            if (new_size < inode.size) {
+                bmap_inline_zero(&inode, new_size);
+            }
+            inode.size = new_size;
+            inode.modified_time = time(NULL);
+            return inode_write(fs, inode_num, &inode);
+        }
+        int res = spill_inline(fs, &inode, inode_num);
+        if (res != SUCCESS) {
+            return res;
+        }
+    }
+    if (inode.flags & INODE_FLAG_COMPRESSED) {
+        int res = resize_compressed(fs, &inode, inode_num, new_size);
+        if (res != SUCCESS) {
+            return res;
+        }
+        inode.modified_time = time(NULL);
+        return inode_write(fs, inode_num, &inode);
+    }
+
+    const uint32_t shift = fs_block_shift(fs);
+    const uint32_t mask = fs_block_mask(fs);
+    uint32_t keep = (uint32_t)(((uint64_t)new_size + mask) >> shift);
+
+    // a kept partial block shared with a clone gets a private copy to zero,
+    // before anything is released
+    int res;
+    if (new_size < inode.size && (new_size & mask) != 0) {
+        uint32_t phys, run;
+        bool shared = false;
+        if (bmap_lookup(fs, &inode, NULL, keep - 1, 1, &phys, &run) == SUCCESS && phys != 0) {
+            res = block_is_shared(fs, phys, 1, &shared, &run);
+            if (res == SUCCESS && shared) {
+                res = unshare_run(fs, &inode, NULL, keep - 1, phys, 1, phys, new_size & mask,
+                                  fs_block_size(fs), &phys, &run);
+            }
+            if (res != SUCCESS) {
+                return res;
+            }
+        }
+    }
+
+    uint32_t freed_blocks = 0;
+    res = bmap_truncate(fs, &inode, keep, &freed_blocks);
+    if (res != SUCCESS) {
+        return res;
+    }
+    fs_free_blocks_add(fs, freed_blocks);
+
+    if (new_size < inode.size && (new_size & mask) != 0) {
+        uint32_t phys, run;
+        if (bmap_lookup(fs, &inode, NULL, keep - 1, 1, &phys, &run) == SUCCESS && phys != 0) {
+            void* dst;
+            if (disk_borrow_blocks_mut(fs->disk, phys, 1, &dst) != DISK_SUCCESS) {
+                return ERROR_IO;
+            }
+            memset((uint8_t*)dst + (new_size & mask), 0, fs_block_size(fs) - (new_size & mask));
+            disk_release_blocks(fs->disk, phys, 1, true);
+        }
+    }
+
+    inode.size = new_size;
+    inode.modified_time = time(NULL);
+    return inode_write(fs, inode_num, &inode);
+}
+
+static int open_file(filesystem_t* fs, const char* path, uint32_t flags, open_file_t** out_file) {
+    if (!fs || !path || !out_file) {
         return ERROR_INVALID;
     }
 
+    // a new file reports its inode: the path is not resolved again
     uint32_t inode_num;
     int res = fs_path_to_inode(fs, path, &inode_num);
 
     // create file if doesn't exist and FS_O_CREAT is set
     if (res == ERROR_NOT_FOUND && (flags & FS_O_CREAT)) {
-        res = fs_create(fs, path, 0644);
-        if (res != SUCCESS) {
-            return res;
-        }
-        res = fs_path_to_inode(fs, path, &inode_num);
+        res = fs_create_locked(fs, path, 0644, &inode_num);
     }
 
     if (res != SUCCESS) {
@@ -320,7 +506,7 @@ int fs_open(filesystem_t* fs, const char* path, uint32_t flags, open_file_t** ou
 
     // read inode
     struct inode inode;
-    if (inode_read(fs->disk, inode_num, &inode) != SUCCESS) {
+    if (inode_read(fs, inode_num, &inode) != SUCCESS) {
         return ERROR_IO;
     }
 
@@ -329,43 +515,16 @@ int fs_open(filesystem_t* fs, const char* path, uint32_t flags, open_file_t** ou
         return ERROR_INVALID;
     }
 
-    // truncate if requested
+    // truncate if requested (other handles may be writing: re-read under the lock)
     if (flags & FS_O_TRUNC) {
-        // free all data blocks
-        for (int i = 0; i < 12; i++) {
-            if (inode.direct[i] == 0) continue;
-            bitmap_clear(fs->block_bitmap, inode.direct[i]);
-            fs->sb.free_blocks++;
-            inode.direct[i] = 0;
-        }
-
-        if (inode.indirect != 0) {
-            char indirect_buffer[BLOCK_SIZE];
-            if (disk_read_block(fs->disk, inode.indirect, indirect_buffer) != DISK_SUCCESS) {
-                return ERROR_IO;
-            }
-            uint32_t* block_ptrs = (uint32_t*)indirect_buffer;
-
-            for (uint32_t i = 0; i < BLOCK_SIZE / sizeof(uint32_t); i++) {
-                if (block_ptrs[i] == 0) continue;
-                bitmap_clear(fs->block_bitmap, block_ptrs[i]);
-                fs->sb.free_blocks++;
-            }
-
-            bitmap_clear(fs->block_bitmap, inode.indirect);
-            fs->sb.free_blocks++;
-            inode.indirect = 0;
-        }
-
-        inode.size = 0;
-        inode.blocks_used = 0;
-        inode.modified_time = time(NULL);
-        if (inode_write(fs->disk, inode_num, &inode) != SUCCESS) {
+        pthread_rwlock_wrlock(fs_inode_lock(fs, inode_num));
+        res = truncate_locked(fs, inode_num, 0);
+        pthread_rwlock_unlock(fs_inode_lock(fs, inode_num));
+        if (res != SUCCESS) {
             return ERROR_IO;
         }
 
-        save_bitmaps(fs);
-        superblock_write(fs->disk, &fs->sb);
+        commit_metadata(fs);
     }
 
     // create file descriptor
@@ -374,14 +533,31 @@ int fs_open(filesystem_t* fs, const char* path, uint32_t flags, open_file_t** ou
         return ERROR_GENERIC;
     }
 
+    // pin the cached inode: every handle on this inode shares the same copy
+    res = inode_cache_pin(fs, inode_num, &file->inode);
+    if (res != SUCCESS) {
+        free(file);
+        return res;
+    }
+
     file->inode_num = inode_num;
-    file->inode = inode;
     file->flags = flags;
     file->fs = fs;
+    bmap_cursor_init(&file->cursor);
+    memset(&file->ra, 0, sizeof(file->ra));
+    memset(&file->wbuf, 0, sizeof(file->wbuf));
+    if (flags & FS_O_BUFFERED) {
+        file->wbuf.data = malloc(FS_WRITE_BUFFER);
+        if (!file->wbuf.data) {
+            inode_cache_unpin(fs, inode_num);
+            free(file);
+            return ERROR_GENERIC;
+        }
+    }
 
     // set offset
     if (flags & FS_O_APPEND) {
-        file->offset = inode.size;
+        file->offset = file->inode->size;
     } else {
         file->offset = 0;
     }
@@ -390,38 +566,301 @@ int fs_open(filesystem_t* fs, const char* path, uint32_t flags, open_file_t** ou
     return SUCCESS;
 }
 
-int fs_close(open_file_t* file) {
-    if (!file) {
+int fs_open(filesystem_t* fs, const char* path, uint32_t flags, open_file_t** out_file) {
+    PERF_OP(PERF_OP_OPEN);
+    TRACE_OP(PERF_OP_OPEN, path);
+
+    if (!fs) {
         return ERROR_INVALID;
     }
 
-    free(file);
+    // creating or truncating changes the namespace / the file
+    if (flags & (FS_O_CREAT | FS_O_TRUNC))
+        pthread_rwlock_wrlock(&fs->ns_lock);
+    else
+        pthread_rwlock_rdlock(&fs->ns_lock);
+    int res = open_file(fs, path, flags, out_file);
+    pthread_rwlock_unlock(&fs->ns_lock);
+    if (res == SUCCESS)
+        TRACE_IO((*out_file)->inode_num, 0);
+    return res;
+}
+
+// === READ / WRITE ===
+
+// FS_O_RDWR has both access bits set
+static inline bool fs_can_read(const open_file_t* file) {
+    return (file->flags & FS_O_RDONLY) != 0;
+}
+
+static inline bool fs_can_write(const open_file_t* file) {
+    return (file->flags & FS_O_WRONLY) != 0;
+}
+
+/*
+ * Stamps the access time after a read, per the mount's atime mode (in the
+ * cache only: written back with the next flush, or with lazytime only once
+ * the last handle closes or on fs_sync). Readers share the inode lock,
+ * hence the atomic accesses.
+ */
+static void update_atime(open_file_t* file) {
+    filesystem_t* fs = file->fs;
+    if (fs->atime_mode == FS_ATIME_NOATIME)
+        return;
+
+    time_t now = time(NULL);
+    time_t atime = __atomic_load_n(&file->inode->accessed_time, __ATOMIC_RELAXED);
+    if (atime == now)
+        return;
+    if (fs->atime_mode == FS_ATIME_RELATIME && atime > file->inode->modified_time &&
+        now - atime < FS_RELATIME_INTERVAL)
+        return;
+
+    __atomic_store_n(&file->inode->accessed_time, now, __ATOMIC_RELAXED);
+    if (fs->lazytime)
+        inode_cache_mark_lazy(fs, file->inode_num);
+    else
+        inode_cache_mark_dirty(fs, file->inode_num);
+}
+
+// reads the buffers in turn from offset, stopping at end of file (inode lock held)
+static int read_vec(open_file_t* file, struct bmap_cursor* cursor, uint32_t offset,
+                    const struct iovec* iov, int iovcnt, size_t* bytes_read) {
+    *bytes_read = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len == 0)
+            continue;
+        size_t got = 0;
+        int res = read_inode_data(file->fs, file->inode, cursor, offset + (uint32_t)*bytes_read,
+                                  iov[i].iov_base, iov[i].iov_len, &got);
+        if (res != SUCCESS)
+            return res;
+        *bytes_read += got;
+        if (got < iov[i].iov_len)
+            break;
+    }
+
+    update_atime(file);
     return SUCCESS;
 }
 
-int fs_read(open_file_t* file, void* buffer, size_t size, size_t* bytes_read) {
-    if (!file || !buffer || !bytes_read) {
+// writes the buffers in turn from offset, then persists the metadata once
+// (inode lock held exclusively)
+static int write_vec(open_file_t* file, struct bmap_cursor* cursor, uint32_t offset,
+                     const struct iovec* iov, int iovcnt, size_t* bytes_written) {
+    *bytes_written = 0;
+    for (int i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len == 0)
+            continue;
+        if (iov[i].iov_len > UINT32_MAX - offset - *bytes_written)
+            return ERROR_INVALID;
+
+        size_t done = 0;
+        int res = write_inode_data(file->fs, file->inode, file->inode_num, cursor,
+                                   offset + (uint32_t)*bytes_written,
+                                   iov[i].iov_base, iov[i].iov_len, &done);
+        *bytes_written += done;
+        if (res != SUCCESS)
+            return res;
+    }
+
+    // persist updated metadata (per flush policy)
+    return (commit_metadata(file->fs) == SUCCESS) ? SUCCESS : ERROR_IO;
+}
+
+static bool iov_valid(const struct iovec* iov, int iovcnt) {
+    if (iovcnt < 0 || (iovcnt > 0 && !iov))
+        return false;
+    for (int i = 0; i < iovcnt; i++) {
+        if (!iov[i].iov_base && iov[i].iov_len > 0)
+            return false;
+    }
+    return true;
+}
+
+// === WRITE-BACK BUFFER ===
+
+// writes the pending bytes out; they are dropped on failure
+static int wbuf_flush(open_file_t* file) {
+    struct fs_write_buffer* wb = &file->wbuf;
+    if (wb->len == 0)
+        return SUCCESS;
+
+    struct iovec iov = { wb->data, wb->len };
+    size_t done = 0;
+    pthread_rwlock_t* lock = fs_inode_lock(file->fs, file->inode_num);
+    pthread_rwlock_wrlock(lock);
+    int res = write_vec(file, &file->cursor, wb->offset, &iov, 1, &done);
+    pthread_rwlock_unlock(lock);
+
+    wb->len = 0;
+    return res;
+}
+
+// fs_writev through the write-back buffer
+static int buffered_writev(open_file_t* file, const struct iovec* iov, int iovcnt,
+                           size_t* bytes_written) {
+    struct fs_write_buffer* wb = &file->wbuf;
+    int res = SUCCESS;
+
+    for (int i = 0; i < iovcnt && res == SUCCESS; i++) {
+        const uint8_t* src = iov[i].iov_base;
+        size_t left = iov[i].iov_len;
+        if (left > UINT32_MAX - file->offset)
+            return ERROR_INVALID;
+
+        while (left > 0 && res == SUCCESS) {
+            // only a write continuing the pending bytes joins them
+            if (wb->len > 0 && file->offset != wb->offset + wb->len) {
+                res = wbuf_flush(file);
+                if (res != SUCCESS)
+                    break;
+            }
+
+            size_t n;
+            if (wb->len == 0 && left >= FS_WRITE_BUFFER) {
+                // nothing to gather: large writes go straight to the file
+                struct iovec direct = { (void*)src, left };
+                pthread_rwlock_t* lock = fs_inode_lock(file->fs, file->inode_num);
+                pthread_rwlock_wrlock(lock);
+                res = write_vec(file, &file->cursor, file->offset, &direct, 1, &n);
+                pthread_rwlock_unlock(lock);
+            } else {
+                if (wb->len == 0)
+                    wb->offset = file->offset;
+                n = MIN(left, (size_t)(FS_WRITE_BUFFER - wb->len));
+                memcpy(wb->data + wb->len, src, n);
+                wb->len += (uint32_t)n;
+                if (wb->len == FS_WRITE_BUFFER)
+                    res = wbuf_flush(file);
+            }
+
+            src += n;
+            left -= n;
+            file->offset += (uint32_t)n;
+            *bytes_written += n;
+        }
+    }
+
+    return res;
+}
+
+int fs_readv(open_file_t* file, const struct iovec* iov, int iovcnt, size_t* bytes_read) {
+    PERF_OP(PERF_OP_READ);
+    TRACE_OP(PERF_OP_READ, NULL);
+
+    if (!file || !bytes_read || !iov_valid(iov, iovcnt)) {
         return ERROR_INVALID;
     }
 
     // check permissions
-    if (!(file->flags & (FS_O_RDONLY | FS_O_RDWR))) {
+    if (!fs_can_read(file)) {
         return ERROR_PERMISSION;
     }
 
-    int res = read_inode_data(file->fs, &file->inode, file->offset, buffer, size, bytes_read);
+    int res = wbuf_flush(file);
+    if (res != SUCCESS) {
+        return res;
+    }
+
+    pthread_rwlock_t* lock = fs_inode_lock(file->fs, file->inode_num);
+    pthread_rwlock_rdlock(lock);
+    res = read_vec(file, &file->cursor, file->offset, iov, iovcnt, bytes_read);
     if (res == SUCCESS) {
+        if (*bytes_read > 0)
+            readahead_update(file, file->offset, *bytes_read);
         file->offset += *bytes_read;
+    }
+    pthread_rwlock_unlock(lock);
+    TRACE_IO(file->inode_num, *bytes_read);
+
+    return res;
+}
+
+int fs_writev(open_file_t* file, const struct iovec* iov, int iovcnt, size_t* bytes_written) {
+    PERF_OP(PERF_OP_WRITE);
+    TRACE_OP(PERF_OP_WRITE, NULL);
+
+    if (!file || !bytes_written || !iov_valid(iov, iovcnt)) {
+        return ERROR_INVALID;
+    }
+
+    *bytes_written = 0;
+
+    // check permissions
+    if (!fs_can_write(file)) {
+        return ERROR_PERMISSION;
+    }
 
-        // update access time
-        file->inode.accessed_time = time(NULL);
-        inode_write(file->fs->disk, file->inode_num, &file->inode);
+    int res;
+    if (file->wbuf.data) {
+        res = buffered_writev(file, iov, iovcnt, bytes_written);
+        TRACE_IO(file->inode_num, *bytes_written);
+        return res;
     }
 
+    pthread_rwlock_t* lock = fs_inode_lock(file->fs, file->inode_num);
+    pthread_rwlock_wrlock(lock);
+    res = write_vec(file, &file->cursor, file->offset, iov, iovcnt, bytes_written);
+    file->offset += *bytes_written;
+    pthread_rwlock_unlock(lock);
+    TRACE_IO(file->inode_num, *bytes_written);
+
     return res;
 }
 
+int fs_read(open_file_t* file, void* buffer, size_t size, size_t* bytes_read) {
+    if (!buffer) {
+        return ERROR_INVALID;
+    }
+    struct iovec iov = { buffer, size };
+    return fs_readv(file, &iov, 1, bytes_read);
+}
+
 int fs_write(open_file_t* file, const void* buffer, size_t size, size_t* bytes_written) {
+    if (!buffer) {
+        return ERROR_INVALID;
+    }
+    struct iovec iov = { (void*)buffer, size };
+    return fs_writev(file, &iov, 1, bytes_written);
+}
+
+// the positional calls leave the handle's offset, cursor and readahead
+// state alone, so that several threads can share one handle
+
+int fs_pread(open_file_t* file, void* buffer, size_t size, uint32_t offset, size_t* bytes_read) {
+    PERF_OP(PERF_OP_PREAD);
+    TRACE_OP(PERF_OP_PREAD, NULL);
+
+    if (!file || !buffer || !bytes_read) {
+        return ERROR_INVALID;
+    }
+
+    // check permissions
+    if (!fs_can_read(file)) {
+        return ERROR_PERMISSION;
+    }
+
+    int res = wbuf_flush(file);
+    if (res != SUCCESS) {
+        return res;
+    }
+
+    struct iovec iov = { buffer, size };
+    pthread_rwlock_t* lock = fs_inode_lock(file->fs, file->inode_num);
+    pthread_rwlock_rdlock(lock);
+    res = read_vec(file, NULL, offset, &iov, 1, bytes_read);
+    pthread_rwlock_unlock(lock);
+    TRACE_IO(file->inode_num, *bytes_read);
+
+    return res;
+}
+
+int fs_pwrite(open_file_t* file, const void* buffer, size_t size, uint32_t offset,
+              size_t* bytes_written) {
+    PERF_OP(PERF_OP_PWRITE);
+    TRACE_OP(PERF_OP_PWRITE, NULL);
+
     if (!file || !buffer || !bytes_written) {
         return ERROR_INVALID;
     }
@@ -429,36 +868,232 @@ int fs_write(open_file_t* file, const void* buffer, size_t size, size_t* bytes_w
     *bytes_written = 0;
 
     // check permissions
-    if (!(file->flags & (FS_O_WRONLY | FS_O_RDWR))) {
+    if (!fs_can_write(file)) {
         return ERROR_PERMISSION;
     }
 
-    int res = write_inode_data(file->fs, &file->inode, file->inode_num,
-                               file->offset, buffer, size, bytes_written);
+    int res = wbuf_flush(file);
     if (res != SUCCESS) {
         return res;
     }
 
-    file->offset += *bytes_written;
+    struct iovec iov = { (void*)buffer, size };
+    pthread_rwlock_t* lock = fs_inode_lock(file->fs, file->inode_num);
+    pthread_rwlock_wrlock(lock);
+    res = write_vec(file, NULL, offset, &iov, 1, bytes_written);
+    pthread_rwlock_unlock(lock);
+    TRACE_IO(file->inode_num, *bytes_written);
 
-    // persist updated metadata
-    if (save_bitmaps(file->fs) != SUCCESS) {
-        return ERROR_IO;
+    return res;
+}
+
+int fs_close(open_file_t* file) {
+    PERF_OP(PERF_OP_CLOSE);
+
+    if (!file) {
+        return ERROR_INVALID;
     }
 
-    if (superblock_write(file->fs->disk, &file->fs->sb) != SUCCESS) {
-        return ERROR_IO;
+    int res = wbuf_flush(file);
+    inode_cache_unpin(file->fs, file->inode_num);
+    free(file->wbuf.data);
+    free(file);
+    return res;
+}
+
+int fs_fsync(open_file_t* file) {
+    PERF_OP(PERF_OP_FSYNC);
+    TRACE_OP(PERF_OP_FSYNC, NULL);
+
+    if (!file) {
+        return ERROR_INVALID;
     }
+    TRACE_IO(file->inode_num, 0);
 
-    return SUCCESS;
+    int res = wbuf_flush(file);
+    if (res != SUCCESS) {
+        return res;
+    }
+    return fs_sync(file->fs);
 }
 
 int fs_seek(open_file_t* file, uint32_t offset) {
     if (!file) {
         return ERROR_INVALID;
     }
-    if (offset > file->inode.size) offset = file->inode.size;
+
+    int res = wbuf_flush(file);
+    if (res != SUCCESS) {
+        return res;
+    }
+
+    pthread_rwlock_rdlock(fs_inode_lock(file->fs, file->inode_num));
+    if (offset > file->inode->size) offset = file->inode->size;
+    pthread_rwlock_unlock(fs_inode_lock(file->fs, file->inode_num));
 
     file->offset = offset;
     return SUCCESS;
-}
\ No newline at end of file
+}
+
+int fs_truncate(filesystem_t* fs, const char* path, uint32_t new_size) {
+    PERF_OP(PERF_OP_TRUNCATE);
+
+    if (!fs || !path) {
+        return ERROR_INVALID;
+    }
+
+    pthread_rwlock_rdlock(&fs->ns_lock);
+    uint32_t inode_num;
+    int res = fs_path_to_inode(fs, path, &inode_num);
+    if (res == SUCCESS) {
+        pthread_rwlock_wrlock(fs_inode_lock(fs, inode_num));
+        res = truncate_locked(fs, inode_num, new_size);
+        pthread_rwlock_unlock(fs_inode_lock(fs, inode_num));
+    }
+    pthread_rwlock_unlock(&fs->ns_lock);
+
+    if (res != SUCCESS) {
+        return res;
+    }
+    return (commit_metadata(fs) == SUCCESS) ? SUCCESS : ERROR_IO;
+}
+
+int fs_ftruncate(open_file_t* file, uint32_t new_size) {
+    PERF_OP(PERF_OP_TRUNCATE);
+
+    if (!file) {
+        return ERROR_INVALID;
+    }
+
+    // check permissions
+    if (!fs_can_write(file)) {
+        return ERROR_PERMISSION;
+    }
+
+    int res = wbuf_flush(file);
+    if (res != SUCCESS) {
+        return res;
+    }
+
+    pthread_rwlock_wrlock(fs_inode_lock(file->fs, file->inode_num));
+    res = truncate_locked(file->fs, file->inode_num, new_size);
+    pthread_rwlock_unlock(fs_inode_lock(file->fs, file->inode_num));
+
+    if (res != SUCCESS) {
+        return res;
+    }
+    return (commit_metadata(file->fs) == SUCCESS) ? SUCCESS : ERROR_IO;
+}
+
+/*
+ * Maps every hole of logical blocks [idx, end) onto zeroed blocks, one
+ * contiguous allocation per hole piece, each placed after the previous one.
+ * An error keeps what was allocated before it.
+ */
+static int allocate_range(filesystem_t* fs, struct inode* inode, uint32_t inode_num,
+                          uint32_t idx, uint32_t end, bool* out_modified) {
+    struct bmap_cursor cursor;
+    bmap_cursor_init(&cursor);
+    uint32_t goal = bmap_goal(fs, inode_num, inode, &cursor, idx);
+    int res = SUCCESS;
+
+    while (idx < end) {
+        uint32_t phys, run;
+        res = bmap_lookup(fs, inode, &cursor, idx, end - idx, &phys, &run);
+        if (res != SUCCESS) {
+            break;
+        }
+        if (phys != 0) {
+            idx += run;
+            goal = phys + run;
+            continue;
+        }
+
+        uint32_t start, count, meta_blocks;
+        res = block_alloc(fs, goal, run, &start, &count);
+        if (res != SUCCESS) {
+            break;
+        }
+
+        // preallocated blocks read as zeros until written
+        void* dst;
+        if (disk_borrow_blocks_mut(fs->disk, start, count, &dst) != DISK_SUCCESS) {
+            block_free_run(fs, start, count);
+            res = ERROR_IO;
+            break;
+        }
+        memset(dst, 0, (size_t)count << fs_block_shift(fs));
+        disk_release_blocks(fs->disk, start, count, true);
+
+        res = bmap_map(fs, inode, &cursor, idx, start, count, &meta_blocks);
+        if (res != SUCCESS) {
+            block_free_run(fs, start, count);
+            break;
+        }
+        fs_free_blocks_sub(fs, count + meta_blocks);
+        *out_modified = true;
+
+        idx += count;
+        goal = start + count;
+    }
+
+    bmap_cursor_release(fs, &cursor);
+    return res;
+}
+
+int fs_fallocate(open_file_t* file, uint32_t offset, uint32_t len, uint32_t flags) {
+    PERF_OP(PERF_OP_FALLOCATE);
+
+    if (!file || len == 0 || len > UINT32_MAX - offset || (flags & ~FS_FALLOC_KEEP_SIZE)) {
+        return ERROR_INVALID;
+    }
+
+    // check permissions
+    if (!fs_can_write(file)) {
+        return ERROR_PERMISSION;
+    }
+
+    int res = wbuf_flush(file);
+    if (res != SUCCESS) {
+        return res;
+    }
+
+    filesystem_t* fs = file->fs;
+    const uint32_t shift = fs_block_shift(fs);
+    uint32_t first = offset >> shift;
+    uint32_t end = (uint32_t)(((uint64_t)offset + len + fs_block_mask(fs)) >> shift);
+
+    pthread_rwlock_wrlock(fs_inode_lock(fs, file->inode_num));
+    struct inode* inode = file->inode;
+    bool modified = false;
+    if (bmap_is_inline(inode)) {
+        // preallocation means blocks: leave the inode
+        res = spill_inline(fs, inode, file->inode_num);
+        modified = (res == SUCCESS);
+    }
+    if (res == SUCCESS && (inode->flags & INODE_FLAG_COMPRESSED)) {
+        // compressed chunks are never preallocated: only the size moves
+        if (!(flags & FS_FALLOC_KEEP_SIZE) && offset + len > inode->size) {
+            res = resize_compressed(fs, inode, file->inode_num, offset + len);
+            modified = true;
+        }
+    } else if (res == SUCCESS) {
+        res = allocate_range(fs, inode, file->inode_num, first, end, &modified);
+
+        if (res == SUCCESS && !(flags & FS_FALLOC_KEEP_SIZE) && offset + len > inode->size) {
+            inode->size = offset + len;
+            modified = true;
+        }
+    }
+    if (modified) {
+        inode->modified_time = time(NULL);
+        if (inode_write(fs, file->inode_num, inode) != SUCCESS)
+            res = ERROR_IO;
+    }
+    pthread_rwlock_unlock(fs_inode_lock(fs, file->inode_num));
+
+    if (modified && commit_metadata(fs) != SUCCESS) {
+        return ERROR_IO;
+    }
+    return res;
+}
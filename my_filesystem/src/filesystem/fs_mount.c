@@ -1,14 +1,151 @@
 #include "fs.h"
 #include "fs_internal.h"
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+// === LOCKING ===
+
+void fs_locks_init(filesystem_t* fs) {
+    pthread_rwlock_init(&fs->ns_lock, NULL);
+    for (int i = 0; i < FS_INODE_LOCKS; i++)
+        pthread_rwlock_init(&fs->inode_locks[i], NULL);
+    pthread_mutex_init(&fs->meta_lock, NULL);
+    pthread_mutex_init(&fs->alloc_lock, NULL);
+    pthread_mutex_init(&fs->refcount_lock, NULL);
+}
+
+void fs_locks_destroy(filesystem_t* fs) {
+    pthread_rwlock_destroy(&fs->ns_lock);
+    for (int i = 0; i < FS_INODE_LOCKS; i++)
+        pthread_rwlock_destroy(&fs->inode_locks[i]);
+    pthread_mutex_destroy(&fs->meta_lock);
+    pthread_mutex_destroy(&fs->alloc_lock);
+    pthread_mutex_destroy(&fs->refcount_lock);
+}
+
+void fs_freeze(filesystem_t* fs) {
+    pthread_rwlock_wrlock(&fs->ns_lock);
+    for (int i = 0; i < FS_INODE_LOCKS; i++)
+        pthread_rwlock_wrlock(&fs->inode_locks[i]);
+}
+
+void fs_thaw(filesystem_t* fs) {
+    for (int i = FS_INODE_LOCKS; i-- > 0; )
+        pthread_rwlock_unlock(&fs->inode_locks[i]);
+    pthread_rwlock_unlock(&fs->ns_lock);
+}
+
+// === BITMAPS ===
+
+// copies an on-disk bitmap region into an in-memory bitmap with one memcpy
+// (the free-space summary is rebuilt from the loaded bits)
+static int copy_bitmap_from_disk(disk_t disk, uint32_t start, uint32_t blocks,
+                                 struct bitmap* bmp) {
+    if (blocks == 0)
+        return SUCCESS;
+
+    const void* src;
+    if (disk_borrow_blocks(disk, start, blocks, &src) != DISK_SUCCESS)
+        return ERROR_IO;
+
+    int res = bitmap_load_bytes(bmp, src, (size_t)blocks * disk_get_block_size(disk));
+
+    disk_release_blocks(disk, start, blocks, false);
+    return res;
+}
+
+// bytes of each group's slice of the block / inode bitmap
+static size_t group_block_bytes(const struct superblock* sb, uint32_t g) {
+    return (superblock_group_blocks(sb, g) + 7) / 8;
+}
+
+static size_t group_inode_bytes(const struct superblock* sb) {
+    return sb->inodes_per_group / 8;
+}
+
+// gathers every group's bitmap regions into the in-memory bitmaps
+static int copy_group_bitmaps_from_disk(filesystem_t* fs) {
+    const struct superblock* sb = &fs->sb;
+    uint8_t* blocks = calloc(1, fs->block_bitmap->size_bytes);
+    uint8_t* inodes = calloc(1, fs->inode_bitmap->size_bytes);
+    int res = (blocks && inodes) ? SUCCESS : ERROR_NO_SPACE;
+
+    for (uint32_t g = 0; g < sb->group_count && res == SUCCESS; g++) {
+        struct group_desc d;
+        superblock_group_desc(sb, g, &d);
+
+        const void* src;
+        if (disk_borrow_blocks(fs->disk, d.block_bitmap, sb->block_bitmap_blocks, &src) != DISK_SUCCESS) {
+            res = ERROR_IO;
+            break;
+        }
+        memcpy(blocks + (size_t)g * (sb->blocks_per_group / 8), src, group_block_bytes(sb, g));
+        disk_release_blocks(fs->disk, d.block_bitmap, sb->block_bitmap_blocks, false);
+
+        if (disk_borrow_blocks(fs->disk, d.inode_bitmap, sb->inode_bitmap_blocks, &src) != DISK_SUCCESS) {
+            res = ERROR_IO;
+            break;
+        }
+        memcpy(inodes + (size_t)g * group_inode_bytes(sb), src, group_inode_bytes(sb));
+        disk_release_blocks(fs->disk, d.inode_bitmap, sb->inode_bitmap_blocks, false);
+    }
+
+    if (res == SUCCESS)
+        res = bitmap_load_bytes(fs->block_bitmap, blocks, fs->block_bitmap->size_bytes);
+    if (res == SUCCESS)
+        res = bitmap_load_bytes(fs->inode_bitmap, inodes, fs->inode_bitmap->size_bytes);
+
+    free(blocks);
+    free(inodes);
+    return res;
+}
+
+// true when the bitmaps may point straight into the image (see
+// fs_mount_with_options): groups scatter them, and a journal has to log
+// every change before it reaches the home location
+static bool can_map_bitmaps(const filesystem_t* fs) {
+    const struct superblock* sb = &fs->sb;
+    size_t bits_per_block = (size_t)sb->block_size * 8;
+    return disk_is_mapped(fs->disk) &&
+           !(sb->features & (FS_FEATURE_GROUPS | FS_FEATURE_JOURNAL)) &&
+           (size_t)sb->block_bitmap_blocks * bits_per_block >= sb->total_blocks &&
+           (size_t)sb->inode_bitmap_blocks * bits_per_block >= sb->total_inodes;
+}
+
+// a bitmap over an on-disk region, which stays borrowed until free_bitmaps
+static struct bitmap* map_bitmap_region(disk_t disk, uint32_t start, uint32_t blocks,
+                                        size_t bits) {
+    void* mem;
+    if (disk_borrow_blocks_mut(disk, start, blocks, &mem) != DISK_SUCCESS)
+        return NULL;
+
+    struct bitmap* bmp = bitmap_create_from_memory(mem, bits);
+    if (!bmp)
+        disk_release_blocks(disk, start, blocks, false);
+    return bmp;
+}
+
 /**
- * Loads bitmaps from disk into memory.
+ * Loads bitmaps from disk into memory, or maps them in place.
  */
-int load_bitmaps(filesystem_t* fs) {
+int load_bitmaps(filesystem_t* fs, bool map) {
+    fs->bitmaps_mapped = false;
+    if (map && can_map_bitmaps(fs)) {
+        fs->bitmaps_mapped = true;
+        fs->block_bitmap = map_bitmap_region(fs->disk, fs->sb.block_bitmap_start,
+                                             fs->sb.block_bitmap_blocks, fs->sb.total_blocks);
+        fs->inode_bitmap = map_bitmap_region(fs->disk, fs->sb.inode_bitmap_start,
+                                             fs->sb.inode_bitmap_blocks, fs->sb.total_inodes);
+        if (!fs->block_bitmap || !fs->inode_bitmap) {
+            free_bitmaps(fs);
+            return ERROR_IO;
+        }
+        return SUCCESS;
+    }
+
     // calculate bitmap sizes
     size_t block_bitmap_bits = fs->sb.total_blocks;
     size_t inode_bitmap_bits = fs->sb.total_inodes;
@@ -23,98 +160,296 @@ int load_bitmaps(filesystem_t* fs) {
         return ERROR_GENERIC;
     }
 
-    // read block bitmap from disk
-    for (uint32_t i = 0; i < fs->sb.block_bitmap_blocks; i++) {
-        char buffer[BLOCK_SIZE];
-        if (disk_read_block(fs->disk, fs->sb.block_bitmap_start + i, buffer) != DISK_SUCCESS) {
-            bitmap_destroy(&fs->block_bitmap);
-            bitmap_destroy(&fs->inode_bitmap);
-            return ERROR_IO;
-        }
-        
-        size_t bytes_to_copy = BLOCK_SIZE;
-        size_t offset = i * BLOCK_SIZE;
-        if (offset + bytes_to_copy > fs->block_bitmap->size_bytes) {
-            bytes_to_copy = fs->block_bitmap->size_bytes - offset;
-        }
-        memcpy(fs->block_bitmap->data + offset, buffer, bytes_to_copy);
+    // copy each bitmap straight out of the mapped image
+    int res;
+    if (fs->sb.features & FS_FEATURE_GROUPS) {
+        res = copy_group_bitmaps_from_disk(fs);
+    } else if ((res = copy_bitmap_from_disk(fs->disk, fs->sb.block_bitmap_start,
+                                            fs->sb.block_bitmap_blocks, fs->block_bitmap)) == SUCCESS) {
+        res = copy_bitmap_from_disk(fs->disk, fs->sb.inode_bitmap_start,
+                                    fs->sb.inode_bitmap_blocks, fs->inode_bitmap);
+    }
+    if (res != SUCCESS) {
+        bitmap_destroy(&fs->block_bitmap);
+        bitmap_destroy(&fs->inode_bitmap);
+        return ERROR_IO;
+    }
+
+    // in-memory copies now match the disk
+    bitmap_clear_dirty(fs->block_bitmap);
+    bitmap_clear_dirty(fs->inode_bitmap);
+
+    return SUCCESS;
+}
+
+/**
+ * Frees the bitmaps, ending the borrows of mapped ones.
+ */
+void free_bitmaps(filesystem_t* fs) {
+    if (fs->bitmaps_mapped) {
+        if (fs->block_bitmap)
+            disk_release_blocks(fs->disk, fs->sb.block_bitmap_start, fs->sb.block_bitmap_blocks, false);
+        if (fs->inode_bitmap)
+            disk_release_blocks(fs->disk, fs->sb.inode_bitmap_start, fs->sb.inode_bitmap_blocks, false);
+        fs->bitmaps_mapped = false;
     }
+    bitmap_destroy(&fs->block_bitmap);
+    bitmap_destroy(&fs->inode_bitmap);
+}
 
-    // read inode bitmap from disk
-    for (uint32_t i = 0; i < fs->sb.inode_bitmap_blocks; i++) {
-        char buffer[BLOCK_SIZE];
-        if (disk_read_block(fs->disk, fs->sb.inode_bitmap_start + i, buffer) != DISK_SUCCESS) {
-            bitmap_destroy(&fs->block_bitmap);
-            bitmap_destroy(&fs->inode_bitmap);
+// true when a chunk holding any of bitmap bytes [first, first + len) is dirty
+static bool bytes_dirty(const struct bitmap* bmp, size_t first, size_t len) {
+    for (size_t c = first / BITMAP_CHUNK_BYTES; c <= (first + len - 1) / BITMAP_CHUNK_BYTES; c++) {
+        if (bitmap_chunk_is_dirty(bmp, c))
+            return true;
+    }
+    return false;
+}
+
+// writes the dirty chunks of bitmap bytes [first, first + len) to an on-disk
+// region (a chunk is BITMAP_CHUNK_BYTES, a block holds one or more of them);
+// the region past them is zeroed when the whole bitmap is dirty (a fresh
+// format). The blocks written join the running journal transaction
+static int write_bitmap_to_disk(disk_t disk, struct journal* journal, uint32_t start,
+                                uint32_t blocks, struct bitmap* bmp, size_t first, size_t len) {
+    if (blocks == 0 || !bitmap_is_dirty(bmp))
+        return SUCCESS;
+
+    void* dst;
+    if (disk_borrow_blocks_mut(disk, start, blocks, &dst) != DISK_SUCCESS)
+        return ERROR_IO;
+
+    bool all_dirty = !bmp->dirty_chunks || bmp->dirty_count == bmp->num_chunks;
+    size_t region = (size_t)blocks * disk_get_block_size(disk);
+    for (size_t offset = 0; offset < region; offset += BITMAP_CHUNK_BYTES) {
+        size_t bytes_to_copy = (offset < len) ? MIN((size_t)BITMAP_CHUNK_BYTES, len - offset) : 0;
+        if (bytes_to_copy > 0 ? !bytes_dirty(bmp, first + offset, bytes_to_copy) : !all_dirty)
+            continue;
+
+        // bytes past the end of the bitmap are zero on disk
+        memcpy((char*)dst + offset, bmp->data + first + offset, bytes_to_copy);
+        memset((char*)dst + offset + bytes_to_copy, 0, BITMAP_CHUNK_BYTES - bytes_to_copy);
+        journal_add(journal, start + (uint32_t)(offset / disk_get_block_size(disk)), 1);
+    }
+
+    disk_release_blocks(disk, start, blocks, true);
+    return SUCCESS;
+}
+
+// a mapped bitmap's bits are already in place: its dirty chunks only mark
+// their image blocks for the next sync
+static int mark_bitmap_blocks_dirty(disk_t disk, uint32_t start, uint32_t blocks,
+                                    const struct bitmap* bmp) {
+    if (!bitmap_is_dirty(bmp))
+        return SUCCESS;
+
+    size_t block_size = disk_get_block_size(disk);
+    for (uint32_t b = 0; b < blocks; b++) {
+        size_t first = (size_t)b * block_size;
+        if (first >= bmp->size_bytes)
+            break;
+        if (!bytes_dirty(bmp, first, MIN(block_size, bmp->size_bytes - first)))
+            continue;
+
+        void* ptr;
+        if (disk_borrow_blocks_mut(disk, start + b, 1, &ptr) != DISK_SUCCESS)
             return ERROR_IO;
-        }
-        
-        size_t bytes_to_copy = BLOCK_SIZE;
-        size_t offset = i * BLOCK_SIZE;
-        if (offset + bytes_to_copy > fs->inode_bitmap->size_bytes) {
-            bytes_to_copy = fs->inode_bitmap->size_bytes - offset;
-        }
-        memcpy(fs->inode_bitmap->data + offset, buffer, bytes_to_copy);
+        disk_release_blocks(disk, start + b, 1, true);
     }
+    return SUCCESS;
+}
 
+// write_bitmap_to_disk for every group's slices
+static int write_group_bitmaps_to_disk(filesystem_t* fs) {
+    const struct superblock* sb = &fs->sb;
+    for (uint32_t g = 0; g < sb->group_count; g++) {
+        struct group_desc d;
+        superblock_group_desc(sb, g, &d);
+        if (write_bitmap_to_disk(fs->disk, fs->journal, d.block_bitmap, sb->block_bitmap_blocks,
+                                 fs->block_bitmap, (size_t)g * (sb->blocks_per_group / 8),
+                                 group_block_bytes(sb, g)) != SUCCESS ||
+            write_bitmap_to_disk(fs->disk, fs->journal, d.inode_bitmap, sb->inode_bitmap_blocks,
+                                 fs->inode_bitmap, (size_t)g * group_inode_bytes(sb),
+                                 group_inode_bytes(sb)) != SUCCESS)
+            return ERROR_IO;
+    }
     return SUCCESS;
 }
 
 /**
- * Saves bitmaps from memory to disk.
+ * Saves bitmaps (and block group descriptors) from memory to disk.
+ * Only the bitmap blocks modified since the last save are written.
  */
 int save_bitmaps(filesystem_t* fs) {
     if (!fs || !fs->block_bitmap || !fs->inode_bitmap) {
         return ERROR_INVALID;
     }
 
-    // write block bitmap to disk
-    for (uint32_t i = 0; i < fs->sb.block_bitmap_blocks; i++) {
-        char buffer[BLOCK_SIZE];
-        memset(buffer, 0, BLOCK_SIZE);
-        
-        size_t bytes_to_copy = BLOCK_SIZE;
-        size_t offset = i * BLOCK_SIZE;
-        if (offset + bytes_to_copy > fs->block_bitmap->size_bytes) {
-            bytes_to_copy = fs->block_bitmap->size_bytes - offset;
-        }
-        memcpy(buffer, fs->block_bitmap->data + offset, bytes_to_copy);
-        
-        if (disk_write_block(fs->disk, fs->sb.block_bitmap_start + i, buffer) != DISK_SUCCESS) {
-            return ERROR_IO;
-        }
+    int res = SUCCESS;
+    pthread_mutex_lock(&fs->alloc_lock);
+    block_groups_lock_all(fs);
+    if (fs->bitmaps_mapped) {
+        if (mark_bitmap_blocks_dirty(fs->disk, fs->sb.block_bitmap_start,
+                                     fs->sb.block_bitmap_blocks, fs->block_bitmap) != SUCCESS ||
+            mark_bitmap_blocks_dirty(fs->disk, fs->sb.inode_bitmap_start,
+                                     fs->sb.inode_bitmap_blocks, fs->inode_bitmap) != SUCCESS)
+            res = ERROR_IO;
+    } else if (fs->sb.features & FS_FEATURE_GROUPS) {
+        if (write_group_bitmaps_to_disk(fs) != SUCCESS || block_groups_save(fs) != SUCCESS)
+            res = ERROR_IO;
+    } else if (write_bitmap_to_disk(fs->disk, fs->journal, fs->sb.block_bitmap_start,
+                                    fs->sb.block_bitmap_blocks, fs->block_bitmap,
+                                    0, fs->block_bitmap->size_bytes) != SUCCESS ||
+               write_bitmap_to_disk(fs->disk, fs->journal, fs->sb.inode_bitmap_start,
+                                    fs->sb.inode_bitmap_blocks, fs->inode_bitmap,
+                                    0, fs->inode_bitmap->size_bytes) != SUCCESS) {
+        res = ERROR_IO;
+    }
+    if (res == SUCCESS) {
+        bitmap_clear_dirty(fs->block_bitmap);
+        bitmap_clear_dirty(fs->inode_bitmap);
     }
+    block_groups_unlock_all(fs);
+    pthread_mutex_unlock(&fs->alloc_lock);
 
-    // write inode bitmap to disk
-    for (uint32_t i = 0; i < fs->sb.inode_bitmap_blocks; i++) {
-        char buffer[BLOCK_SIZE];
-        memset(buffer, 0, BLOCK_SIZE);
-        
-        size_t bytes_to_copy = BLOCK_SIZE;
-        size_t offset = i * BLOCK_SIZE;
-        if (offset + bytes_to_copy > fs->inode_bitmap->size_bytes) {
-            bytes_to_copy = fs->inode_bitmap->size_bytes - offset;
-        }
-        memcpy(buffer, fs->inode_bitmap->data + offset, bytes_to_copy);
-        
-        if (disk_write_block(fs->disk, fs->sb.inode_bitmap_start + i, buffer) != DISK_SUCCESS) {
-            return ERROR_IO;
-        }
+    return res;
+}
+
+// === METADATA FLUSH ===
+
+// flush_metadata with fs->meta_lock held (lazy: also the inodes whose
+// access time only is pending)
+static int flush_locked(filesystem_t* fs, bool lazy) {
+    // write back dirty inodes
+    if ((lazy ? inode_cache_sync(fs) : inode_cache_flush(fs)) != SUCCESS) {
+        return ERROR_IO;
+    }
+
+    if (save_bitmaps(fs) != SUCCESS) {
+        return ERROR_IO;
+    }
+
+    // the free counters move under other threads (fs_free_blocks_add and
+    // co. take no lock): copy around them and load them atomically; the
+    // rest of the superblock only changes under meta_lock
+    struct superblock sb;
+    size_t counters = offsetof(struct superblock, free_blocks);
+    size_t rest = offsetof(struct superblock, block_size);
+    memcpy(&sb, &fs->sb, counters);
+    memcpy((char*)&sb + rest, (const char*)&fs->sb + rest, sizeof(sb) - rest);
+    sb.free_blocks = __atomic_load_n(&fs->sb.free_blocks, __ATOMIC_RELAXED);
+    sb.free_inodes = __atomic_load_n(&fs->sb.free_inodes, __ATOMIC_RELAXED);
+
+    if (superblock_write(fs->disk, &sb) != SUCCESS) {
+        return ERROR_IO;
+    }
+    journal_add(fs->journal, SUPERBLOCK_BLOCK_NUM, 1);
+
+    // everything written above becomes durable as one transaction
+    if (journal_commit(fs->journal, fs->disk) != SUCCESS) {
+        return ERROR_IO;
     }
 
+    fs->ops_since_flush = 0;
     return SUCCESS;
 }
 
+/**
+ * Writes back every piece of in-memory metadata.
+ */
+int flush_metadata(filesystem_t* fs) {
+    if (!fs) {
+        return ERROR_INVALID;
+    }
+
+    pthread_mutex_lock(&fs->meta_lock);
+    int res = flush_locked(fs, true);
+    pthread_mutex_unlock(&fs->meta_lock);
+    return res;
+}
+
+/**
+ * Called once a metadata-changing operation completed (or rolled back).
+ */
+int commit_metadata(filesystem_t* fs) {
+    if (!fs) {
+        return ERROR_INVALID;
+    }
+
+    pthread_mutex_lock(&fs->meta_lock);
+    fs->ops_since_flush++;
+
+    int res = SUCCESS;
+    switch (fs->flush_policy) {
+        case FS_FLUSH_PER_OP:
+            res = flush_locked(fs, false);
+            break;
+        case FS_FLUSH_EVERY_N:
+            if (fs->ops_since_flush >= fs->flush_interval)
+                res = flush_locked(fs, false);
+            break;
+        case FS_FLUSH_ON_SYNC:
+        default:
+            break;
+    }
+    pthread_mutex_unlock(&fs->meta_lock);
+    return res;
+}
+
 int fs_format(disk_t disk, size_t total_blocks, size_t total_inodes) {
+    return fs_format_with_options(disk, total_blocks, total_inodes, NULL);
+}
+
+int fs_format_with_options(disk_t disk, size_t total_blocks, size_t total_inodes,
+                           const fs_format_options_t* opts) {
     int status = SUCCESS;
     if (!disk) {
         return ERROR_INVALID;
     }
 
+    // total_blocks is counted in the filesystem's block size
+    uint32_t block_size = (opts && opts->block_size) ? opts->block_size : BLOCK_SIZE;
+    if (!IS_VALID_BLOCK_SIZE(block_size)) {
+        return ERROR_INVALID;
+    }
+    // a rec_len record spanning a whole block must fit its 16-bit length
+    if (opts && opts->rec_len && block_size > UINT16_MAX) {
+        return ERROR_INVALID;
+    }
+    if (disk_set_block_size(disk, block_size) != DISK_SUCCESS) {
+        return ERROR_INVALID;
+    }
+
     struct superblock sb;
-    int res = superblock_init(disk, &sb, total_blocks, total_inodes);
+    int res = (opts && opts->block_groups)
+        ? superblock_init_grouped(disk, &sb, total_blocks, total_inodes, opts->blocks_per_group)
+        : superblock_init(disk, &sb, total_blocks, total_inodes);
     if (res != SUCCESS) return res;
 
+    if (opts && opts->extents) {
+        sb.features |= FS_FEATURE_EXTENTS;
+    }
+    if (opts && opts->dir_index) {
+        sb.features |= FS_FEATURE_DIR_INDEX;
+    }
+    if (opts && opts->rec_len) {
+        sb.features |= FS_FEATURE_REC_LEN;
+    }
+    if (opts && opts->journal_blocks) {
+        res = superblock_add_journal(&sb, opts->journal_blocks);
+        if (res != SUCCESS) return res;
+    }
+    if (opts && opts->reflink) {
+        res = superblock_add_refcounts(&sb);
+        if (res != SUCCESS) return res;
+    }
+    if (opts && opts->inline_data) {
+        sb.features |= FS_FEATURE_INLINE_DATA;
+    }
+    if (opts && opts->lazy_itable) {
+        sb.features |= FS_FEATURE_LAZY_ITABLE;  // marks start at 0: nothing initialised
+    }
+
     res = superblock_write(disk, &sb);
     if (res != SUCCESS) return ERROR_IO;
 
@@ -124,36 +459,100 @@ int fs_format(disk_t disk, size_t total_blocks, size_t total_inodes) {
     temp_fs.sb   = sb;
     temp_fs.block_bitmap = NULL;
     temp_fs.inode_bitmap = NULL;
+    temp_fs.icache = NULL;   // format writes straight to the inode table
+    temp_fs.dcache = NULL;
+    temp_fs.ccache = NULL;
+    temp_fs.journal = NULL;  // the log is only written once the format is complete
+    temp_fs.groups = NULL;
+    temp_fs.alloc_rotor = sb.first_data_block;
+    fs_locks_init(&temp_fs);
+
+    // bring the bitmaps into memory
+    res = load_bitmaps(&temp_fs, false);
+    if (res != SUCCESS) {
+        fs_locks_destroy(&temp_fs);
+        return ERROR_IO;
+    }
 
-    // load empty bitmaps from disk to memory
-    res = load_bitmaps(&temp_fs);
-    if (res != SUCCESS) return ERROR_IO;
+    // a fresh format rewrites every bitmap block (a reused image may hold old bits)
+    bitmap_clear_all(temp_fs.block_bitmap);
+    bitmap_clear_all(temp_fs.inode_bitmap);
+    bitmap_mark_all_dirty(temp_fs.block_bitmap);
+    bitmap_mark_all_dirty(temp_fs.inode_bitmap);
 
     // mark reserved blocks in block bitmap:
     //  - blocks holding the block bitmap
     //  - blocks holding the inode bitmap
     //  - blocks holding the inode table
+    //  - blocks holding the journal
+    //  - blocks holding the reference-count table
     //  - superblock block
-    for (uint32_t i = 0; i < sb.block_bitmap_blocks; i++)
-        bitmap_set(temp_fs.block_bitmap, sb.block_bitmap_start + i);
+    if (sb.features & FS_FEATURE_GROUPS) {
+        // each group's metadata is contiguous (for group 0 from the superblock
+        // and descriptor table to the end of the journal and reference-count table)
+        for (uint32_t g = 0; g < sb.group_count; g++) {
+            struct group_desc d;
+            superblock_group_desc(&sb, g, &d);
+            uint32_t first = (g == 0) ? SUPERBLOCK_BLOCK_NUM : d.block_bitmap;
+            bitmap_set_range(temp_fs.block_bitmap, first, d.first_data_block - first);
+        }
+    } else {
+        for (uint32_t i = 0; i < sb.block_bitmap_blocks; i++)
+            bitmap_set(temp_fs.block_bitmap, sb.block_bitmap_start + i);
 
-    for (uint32_t i = 0; i < sb.inode_bitmap_blocks; i++)
-        bitmap_set(temp_fs.block_bitmap, sb.inode_bitmap_start + i);
+        for (uint32_t i = 0; i < sb.inode_bitmap_blocks; i++)
+            bitmap_set(temp_fs.block_bitmap, sb.inode_bitmap_start + i);
 
-    for (uint32_t i = 0; i < sb.inode_table_blocks; i++)
-        bitmap_set(temp_fs.block_bitmap, sb.inode_table_start + i);
+        for (uint32_t i = 0; i < sb.inode_table_blocks; i++)
+            bitmap_set(temp_fs.block_bitmap, sb.inode_table_start + i);
 
-    bitmap_set(temp_fs.block_bitmap, SUPERBLOCK_BLOCK_NUM);
+        for (uint32_t i = 0; i < sb.journal_blocks; i++)
+            bitmap_set(temp_fs.block_bitmap, sb.journal_start + i);
+
+        for (uint32_t i = 0; i < sb.refcount_blocks; i++)
+            bitmap_set(temp_fs.block_bitmap, sb.refcount_start + i);
+
+        bitmap_set(temp_fs.block_bitmap, SUPERBLOCK_BLOCK_NUM);
+    }
 
     // mark reserved inodes in inode bitmap
     bitmap_set(temp_fs.inode_bitmap, INVALID_INODE_NUM);
 
+    // group descriptors start from the reserved blocks and inodes
+    res = block_groups_format(&temp_fs);
+    if (res != SUCCESS) {
+        status = res;
+        goto cleanup_bitmaps;
+    }
+
+    // whatever the image held before must not come back as inodes
+    if (!(sb.features & FS_FEATURE_LAZY_ITABLE)) {
+        uint32_t tables = (sb.features & FS_FEATURE_GROUPS) ? sb.group_count : 1;
+        for (uint32_t t = 0; t < tables && res == SUCCESS; t++) {
+            uint32_t start = temp_fs.groups ? temp_fs.groups[t].desc.inode_table
+                                            : sb.inode_table_start;
+            res = itable_zero_blocks(disk, start, sb.inode_table_blocks);
+        }
+        if (res != SUCCESS) {
+            status = res;
+            goto cleanup_bitmaps;
+        }
+    }
+
+    // every block starts with at most one owner
+    if (sb.features & FS_FEATURE_REFLINK) {
+        res = itable_zero_blocks(disk, sb.refcount_start, sb.refcount_blocks);
+        if (res != SUCCESS) {
+            status = res;
+            goto cleanup_bitmaps;
+        }
+    }
+
     // allocate root directory inode
     struct inode root_inode;
     uint32_t root_inode_num = 999999;  // sentinel value
 
-    res = inode_alloc(disk, temp_fs.inode_bitmap,
-                      INODE_TYPE_DIRECTORY, 0755,
+    res = inode_alloc(&temp_fs, INODE_TYPE_DIRECTORY, 0755,
                       &root_inode, &root_inode_num);
 
     if (res != SUCCESS) {
@@ -184,31 +583,39 @@ int fs_format(disk_t disk, size_t total_blocks, size_t total_inodes) {
     uint32_t allocated_blocks = 0;
 
     // add entries to root directory's data block
-    res = dentry_add(disk, root_inode_num, &dot_dentry, temp_fs.block_bitmap, &allocated_blocks);
+    res = dentry_add(&temp_fs, root_inode_num, &dot_dentry, &allocated_blocks);
     if (res != SUCCESS) { status = res; goto cleanup_inode; }
     sb.free_blocks -= allocated_blocks;
 
     allocated_blocks = 0;
-    res = dentry_add(disk, root_inode_num, &dotdot_dentry, temp_fs.block_bitmap, &allocated_blocks);
+    res = dentry_add(&temp_fs, root_inode_num, &dotdot_dentry, &allocated_blocks);
     if (res != SUCCESS) { status = res; goto cleanup_inode; }
     sb.free_blocks -= allocated_blocks;
 
     // read root inode from disk since it's been modified by previous dentry_add
-    res = inode_read(disk, root_inode_num, &root_inode);
+    res = inode_read(&temp_fs, root_inode_num, &root_inode);
     if (res != SUCCESS) { status = res; goto cleanup_inode; }
     // set links_count for root and write inode back
     root_inode.links_count = 2;
-    res = inode_write(disk, root_inode_num, &root_inode);
+    root_inode.parent = ROOT_INODE_NUM;
+    res = inode_write(&temp_fs, root_inode_num, &root_inode);
     if (res != SUCCESS) { status = res; goto cleanup_inode; }
 
     // save bitmaps to disk
     res = save_bitmaps(&temp_fs);
     if (res != SUCCESS) { status = res; goto cleanup_inode; }
 
-    // write superblock to disk
+    // write superblock to disk (with the table blocks the root inode initialised)
+    sb.itable_zeroed = temp_fs.sb.itable_zeroed;
     res = superblock_write(disk, &sb);
     if (res != SUCCESS) { status = res; goto cleanup_inode; }
 
+    // empty log
+    if (sb.features & FS_FEATURE_JOURNAL) {
+        res = journal_format(disk, &sb);
+        if (res != SUCCESS) { status = res; goto cleanup_inode; }
+    }
+
     // success: cleanup memory and return
     printf("Filesystem formatted successfully.\n");
     printf("Root inode %u created and initialized with '.' and '..'\n", root_inode_num);
@@ -218,25 +625,37 @@ cleanup_inode:
     printf("[CLEANUP] cleanup_inode triggered\n");
     {
         uint32_t freed_blocks = 0;
-        inode_free(disk, temp_fs.inode_bitmap, temp_fs.block_bitmap,
-                   root_inode_num, &freed_blocks);
+        inode_free(&temp_fs, root_inode_num, &freed_blocks);
         sb.free_inodes++;
         sb.free_blocks += freed_blocks;
         superblock_write(disk, &sb);
     }
 
 cleanup_bitmaps:
-    if (temp_fs.block_bitmap) bitmap_destroy(&temp_fs.block_bitmap);
-    if (temp_fs.inode_bitmap) bitmap_destroy(&temp_fs.inode_bitmap);
+    block_groups_destroy(&temp_fs);
+    free_bitmaps(&temp_fs);
+    fs_locks_destroy(&temp_fs);
 
     return status;
 }
 
 int fs_mount(disk_t disk, filesystem_t** out_fs) {
+    return fs_mount_with_options(disk, NULL, out_fs);
+}
+
+int fs_mount_with_options(disk_t disk, const fs_mount_options_t* opts, filesystem_t** out_fs) {
     if (!disk || !out_fs) {
         return ERROR_INVALID;
     }
 
+    if (opts && opts->flush_policy == FS_FLUSH_EVERY_N && opts->flush_interval == 0) {
+        return ERROR_INVALID;
+    }
+
+    if (opts && (opts->atime < FS_ATIME_STRICT || opts->atime > FS_ATIME_NOATIME)) {
+        return ERROR_INVALID;
+    }
+
     filesystem_t* fs = (filesystem_t*)malloc(sizeof(filesystem_t));
     if (!fs) {
         return ERROR_GENERIC;
@@ -246,6 +665,17 @@ int fs_mount(disk_t disk, filesystem_t** out_fs) {
     fs->is_mounted = false;
     fs->block_bitmap = NULL;
     fs->inode_bitmap = NULL;
+    fs->icache = NULL;
+    fs->dcache = NULL;
+    fs->ccache = NULL;
+    fs->journal = NULL;
+    fs->groups = NULL;
+    fs->flush_policy = opts ? opts->flush_policy : FS_FLUSH_PER_OP;
+    fs->flush_interval = opts ? opts->flush_interval : 1;
+    fs->ops_since_flush = 0;
+    fs->atime_mode = opts ? opts->atime : FS_ATIME_STRICT;
+    fs->lazytime = opts ? opts->lazytime : false;
+    fs->bitmaps_mapped = false;
 
     // load superblock
     if (superblock_read(disk, &fs->sb) != SUCCESS) {
@@ -259,12 +689,64 @@ int fs_mount(disk_t disk, filesystem_t** out_fs) {
         return ERROR_INVALID;
     }
 
+    // from now on the disk is addressed in the filesystem's blocks
+    if (disk_set_block_size(disk, fs->sb.block_size) != DISK_SUCCESS ||
+        fs->sb.total_blocks > disk_get_blocks(disk)) {
+        free(fs);
+        return ERROR_INVALID;
+    }
+
+    // replay what the last session committed before anything is loaded
+    if (fs->sb.features & FS_FEATURE_JOURNAL) {
+        uint32_t replayed = 0;
+        int res = journal_open(disk, &fs->sb, &fs->journal, &replayed);
+        if (res != SUCCESS) {
+            free(fs);
+            return res;
+        }
+        if (replayed > 0) {
+            printf("Journal: replayed %u transaction(s)\n", replayed);
+            if (superblock_read(disk, &fs->sb) != SUCCESS || !superblock_is_valid(&fs->sb)) {
+                journal_destroy(&fs->journal);
+                free(fs);
+                return ERROR_INVALID;
+            }
+        }
+    }
+
+    fs->alloc_rotor = fs->sb.first_data_block;
+
     // load bitmaps
-    if (load_bitmaps(fs) != SUCCESS) {
+    if (load_bitmaps(fs, opts && opts->map_bitmaps) != SUCCESS) {
+        journal_destroy(&fs->journal);
         free(fs);
         return ERROR_IO;
     }
 
+    // block group descriptors
+    int groups_res = block_groups_load(fs);
+    if (groups_res != SUCCESS) {
+        journal_destroy(&fs->journal);
+        free_bitmaps(fs);
+        free(fs);
+        return groups_res;
+    }
+
+    // inode, dentry and chunk caches
+    fs->icache = inode_cache_create();
+    fs->dcache = dcache_create();
+    fs->ccache = chunk_cache_create(compress_chunk_bytes(fs));
+    if (!fs->icache || !fs->dcache || !fs->ccache) {
+        inode_cache_destroy(&fs->icache);
+        dcache_destroy(&fs->dcache);
+        chunk_cache_destroy(&fs->ccache);
+        journal_destroy(&fs->journal);
+        block_groups_destroy(fs);
+        free_bitmaps(fs);
+        free(fs);
+        return ERROR_GENERIC;
+    }
+
     // set current directory to root
     fs->current_dir_inode = ROOT_INODE_NUM;
     fs->is_mounted = true;
@@ -275,12 +757,18 @@ int fs_mount(disk_t disk, filesystem_t** out_fs) {
     
     // release memory if mount fails
     if (superblock_write(disk, &fs->sb) != SUCCESS) {
-        bitmap_destroy(&fs->block_bitmap);
-        bitmap_destroy(&fs->inode_bitmap);
+        inode_cache_destroy(&fs->icache);
+        dcache_destroy(&fs->dcache);
+        chunk_cache_destroy(&fs->ccache);
+        journal_destroy(&fs->journal);
+        block_groups_destroy(fs);
+        free_bitmaps(fs);
         free(fs);
         return ERROR_IO;
     }
 
+    fs_locks_init(fs);
+
     *out_fs = fs;
     printf("Filesystem mounted successfully.\n");
     superblock_print(&fs->sb);
@@ -288,6 +776,158 @@ int fs_mount(disk_t disk, filesystem_t** out_fs) {
     return SUCCESS;
 }
 
+int fs_sync(filesystem_t* fs) {
+    PERF_OP(PERF_OP_SYNC);
+
+    if (!fs) {
+        return ERROR_INVALID;
+    }
+
+    if (flush_metadata(fs) != SUCCESS) {
+        return ERROR_IO;
+    }
+
+    // with a journal, syncing the whole image also empties the log
+    if (fs->journal) {
+        return journal_checkpoint(fs->journal, fs->disk);
+    }
+
+    if (disk_sync(fs->disk) != DISK_SUCCESS) {
+        return ERROR_IO;
+    }
+
+    return SUCCESS;
+}
+
+int fs_itable_init(filesystem_t* fs, uint32_t max_blocks, uint32_t* out_remaining) {
+    if (!fs) {
+        return ERROR_INVALID;
+    }
+
+    uint32_t remaining = 0;
+    int res = itable_init_some(fs, max_blocks, &remaining);
+    if (res == SUCCESS) {
+        res = commit_metadata(fs);
+    }
+    if (out_remaining) {
+        *out_remaining = remaining;
+    }
+    return res;
+}
+
+// === ONLINE GROWTH ===
+
+// marks the metadata of groups [first, group_count) in use and zeroes their
+// inode tables unless the format is lazy (fs->alloc_lock held)
+static int init_new_groups(filesystem_t* fs, uint32_t first) {
+    const struct superblock* sb = &fs->sb;
+    for (uint32_t g = first; g < sb->group_count; g++) {
+        struct group_desc d;
+        superblock_group_desc(sb, g, &d);
+        bitmap_set_range(fs->block_bitmap, d.block_bitmap, d.first_data_block - d.block_bitmap);
+        if (!(sb->features & FS_FEATURE_LAZY_ITABLE)) {
+            // durable before the commit naming the group: the table is not logged
+            int res = itable_zero_blocks(fs->disk, d.inode_table, sb->inode_table_blocks);
+            if (res != SUCCESS)
+                return res;
+            if (disk_sync_blocks(fs->disk, d.inode_table, sb->inode_table_blocks) != DISK_SUCCESS)
+                return ERROR_IO;
+        }
+    }
+    return SUCCESS;
+}
+
+/*
+ * Switches the in-memory state to the grown geometry, the image being
+ * large enough already (fs->alloc_lock held, filesystem frozen). Every
+ * allocation comes first, the block bitmap last: until it has grown, no
+ * block past the old end can be handed out and the old geometry stays in
+ * force. Mapped bitmaps were released by the caller and are mapped again.
+ */
+static int grow_locked(filesystem_t* fs, const struct superblock* grown, bool mapped) {
+    uint32_t old_blocks = fs->sb.total_blocks;
+    uint32_t old_groups = fs->sb.group_count;
+
+    if (mapped) {
+        fs->sb = *grown;
+        int res = load_bitmaps(fs, true);
+        if (res != SUCCESS)
+            return res;
+        // bits past the old end were never used, but make sure of it
+        bitmap_clear_range(fs->block_bitmap, old_blocks, grown->total_blocks - old_blocks);
+        return SUCCESS;
+    }
+
+    if (bitmap_grow(fs->inode_bitmap, grown->total_inodes) != SUCCESS ||
+        journal_grow(fs->journal, grown->total_blocks) != SUCCESS ||
+        bitmap_grow(fs->block_bitmap, grown->total_blocks) != SUCCESS)
+        return ERROR_NO_SPACE;
+
+    fs->sb = *grown;
+    int res = init_new_groups(fs, old_groups);
+    if (res == SUCCESS)
+        res = block_groups_grow(fs, old_groups);
+    return res;
+}
+
+size_t fs_grow_limit(const filesystem_t* fs) {
+    if (!fs) {
+        return 0;
+    }
+    return (size_t)superblock_max_blocks(&fs->sb) * fs_block_size(fs);
+}
+
+int fs_grow(filesystem_t* fs, size_t new_size) {
+    if (!fs) {
+        return ERROR_INVALID;
+    }
+
+    fs_freeze(fs);
+    pthread_mutex_lock(&fs->meta_lock);
+
+    // what is pending goes out with the old geometry
+    int res = flush_locked(fs, true);
+    if (res != SUCCESS) {
+        goto out;
+    }
+
+    struct superblock grown = fs->sb;
+    res = superblock_grow(&grown, new_size / fs_block_size(fs));
+    if (res != SUCCESS) {
+        goto out;
+    }
+
+    // mapped bitmaps are borrows, which would pin the mapping in place
+    bool mapped = fs->bitmaps_mapped && grown.total_blocks != fs->sb.total_blocks;
+    if (mapped) {
+        free_bitmaps(fs);
+    }
+
+    if (new_size > disk_get_size(fs->disk) && disk_grow(fs->disk, new_size) != DISK_SUCCESS) {
+        res = ERROR_IO;
+        grown = fs->sb;               // nothing changes but the bitmaps come back
+    }
+
+    if (grown.total_blocks != fs->sb.total_blocks || mapped) {
+        pthread_mutex_lock(&fs->alloc_lock);
+        int grow_res = grow_locked(fs, &grown, mapped);
+        pthread_mutex_unlock(&fs->alloc_lock);
+        if (res == SUCCESS) {
+            res = grow_res;
+        }
+    }
+
+    // the new geometry, bitmaps and descriptors become durable together
+    if (res == SUCCESS) {
+        res = flush_locked(fs, false);
+    }
+
+out:
+    pthread_mutex_unlock(&fs->meta_lock);
+    fs_thaw(fs);
+    return res;
+}
+
 int fs_unmount(filesystem_t* fs) {
     int status = SUCCESS;
 
@@ -295,29 +935,30 @@ int fs_unmount(filesystem_t* fs) {
         return ERROR_INVALID;
     }
 
-    // save bitmap
-    if (save_bitmaps(fs) != SUCCESS) {
+    // write back dirty inodes, bitmaps and superblock
+    if (flush_metadata(fs) != SUCCESS) {
         status = ERROR_IO;
         goto cleanup;
     }
 
-    // save superblock
-    if (superblock_write(fs->disk, &fs->sb) != SUCCESS) {
+    // a clean image leaves nothing to replay
+    if (journal_checkpoint(fs->journal, fs->disk) != SUCCESS) {
         status = ERROR_IO;
         goto cleanup;
     }
 
 cleanup:
     // cleanup is always executed
-    if (fs->block_bitmap) {
-        bitmap_destroy(&fs->block_bitmap);
-    }
-    if (fs->inode_bitmap) {
-        bitmap_destroy(&fs->inode_bitmap);
-    }
+    inode_cache_destroy(&fs->icache);
+    dcache_destroy(&fs->dcache);
+    chunk_cache_destroy(&fs->ccache);
+    journal_destroy(&fs->journal);
+    block_groups_destroy(fs);
+    free_bitmaps(fs);
 
     fs->is_mounted = false;
     disk_detach(fs->disk); // detach before freeing fs
+    fs_locks_destroy(fs);
     free(fs);
 
     if (status == SUCCESS) {
@@ -5,12 +5,63 @@
 #include <string.h>
 #include <time.h>
 
+/*
+ * Resolves one path component in directory dir, through the dentry cache:
+ * hits (negative ones included) read no directory block, misses are
+ * cached either way.
+ */
+static int lookup_component(filesystem_t* fs, uint32_t dir, const char* name,
+                            uint32_t* out_inode_num) {
+    PERF_ADD(PERF_PATH_COMPONENTS, 1);
+
+    uint32_t cached;
+    if (dcache_lookup(fs->dcache, dir, name, &cached)) {
+        if (cached == 0)
+            return ERROR_NOT_FOUND;
+        *out_inode_num = cached;
+        return SUCCESS;
+    }
+
+    struct dentry entry;
+    int res = dentry_find(fs, dir, name, &entry, NULL);
+    if (res == SUCCESS) {
+        dcache_insert(fs->dcache, dir, name, entry.inode_num);
+        *out_inode_num = entry.inode_num;
+    } else if (res == ERROR_NOT_FOUND) {
+        dcache_insert(fs->dcache, dir, name, 0);
+    }
+    return res;
+}
+
+// finds the name under which inode_num is linked in directory dir
+// ("." and ".." excluded); out_name must hold MAX_FILENAME bytes
+static int find_name_in_dir(filesystem_t* fs, uint32_t dir, uint32_t inode_num,
+                            char* out_name) {
+    struct dentry batch[16];
+    uint32_t pos = 0, count;
+    do {
+        if (dentry_iterate(fs, dir, &pos, batch, 16, &count) != SUCCESS)
+            return ERROR_IO;
+        for (uint32_t i = 0; i < count; i++) {
+            if (strcmp(batch[i].name, ".") == 0 || strcmp(batch[i].name, "..") == 0)
+                continue;
+            if (batch[i].inode_num == inode_num) {
+                strncpy(out_name, batch[i].name, MAX_FILENAME);
+                out_name[MAX_FILENAME - 1] = '\0';
+                return SUCCESS;
+            }
+        }
+    } while (count > 0);
+
+    return ERROR_NOT_FOUND;
+}
+
 /**
  * Resolves a path to an inode number.
  * Supports absolute and relative paths.
  */
 int fs_path_to_inode(filesystem_t* fs, const char* path, uint32_t* out_inode_num) {
-if (!fs || !path || !out_inode_num) {
+    if (!fs || !path || !out_inode_num) {
         return ERROR_INVALID;
     }
 
@@ -20,64 +71,57 @@ if (!fs || !path || !out_inode_num) {
     }
 
     // normalize path to handle ".", "..", and redundant separators
-    char* normalized = path_normalize(path);
-    if (!normalized) {
+    char normalized[MAX_PATH];
+    if (path_normalize_into(path, normalized, sizeof(normalized)) != SUCCESS) {
         return ERROR_INVALID;
     }
 
-    // handle root
-    if (path_is_root(normalized)) {
-        *out_inode_num = ROOT_INODE_NUM;
-        free(normalized);
-        return SUCCESS;
-    }
-
-    // parse path
-    struct path_components* pc = path_parse(normalized);
-    free(normalized);
-    
-    if (!pc) {
-        return ERROR_INVALID;
-    }
+    return fs_lookup_normalized(fs, normalized, out_inode_num);
+}
 
+int fs_lookup_normalized(filesystem_t* fs, const char* normalized, uint32_t* out_inode_num) {
     // start from root or current directory
-    uint32_t current_inode = pc->is_absolute ? ROOT_INODE_NUM : fs->current_dir_inode;
-
-    // traverse components
-    for (int i = 0; i < pc->count; i++) {
-        const char* component = pc->components[i];
-
-        // skip "." (should already be handled by normalize, but just in case)
-        if (strcmp(component, ".") == 0) {
+    uint32_t current_inode = path_is_absolute(normalized) ? ROOT_INODE_NUM : fs->current_dir_inode;
+
+    // traverse components, viewed in place: only the name being looked up
+    // is copied, to terminate it
+    struct path_iter it;
+    struct path_token tok;
+    path_iter_init(&it, normalized);
+    while (path_iter_next(&it, &tok)) {
+        // skip "." (only left for the current directory itself)
+        if (path_token_equals(&tok, CURRENT_DIR)) {
             continue;
         }
 
         // handle ".."
-        if (strcmp(component, "..") == 0) {
-            struct dentry parent_entry;
-            if (dentry_find(fs->disk, current_inode, "..", &parent_entry, NULL) == SUCCESS) {
-                current_inode = parent_entry.inode_num;
-            } else {
+        if (path_token_equals(&tok, PARENT_DIR)) {
+            uint32_t parent_inode;
+            if (lookup_component(fs, current_inode, PARENT_DIR, &parent_inode) == SUCCESS) {
+                current_inode = parent_inode;
+            } else if (current_inode != ROOT_INODE_NUM) {
                 // root has no parent
-                if (current_inode != ROOT_INODE_NUM) {
-                    path_components_free(pc);
-                    return ERROR_NOT_FOUND;
-                }
+                return ERROR_NOT_FOUND;
             }
             continue;
         }
 
+        if (tok.len >= MAX_FILENAME) {
+            return ERROR_INVALID;
+        }
+        char component[MAX_FILENAME];
+        memcpy(component, tok.name, tok.len);
+        component[tok.len] = '\0';
+
         // regular lookup
-        struct dentry entry;
-        if (dentry_find(fs->disk, current_inode, component, &entry, NULL) != SUCCESS) {
-            path_components_free(pc);
+        uint32_t next_inode;
+        if (lookup_component(fs, current_inode, component, &next_inode) != SUCCESS) {
             return ERROR_NOT_FOUND;
         }
 
-        current_inode = entry.inode_num;
+        current_inode = next_inode;
     }
 
-    path_components_free(pc);
     *out_inode_num = current_inode;
     return SUCCESS;
 }
@@ -106,88 +150,64 @@ int fs_inode_to_path(filesystem_t* fs, uint32_t inode_num, char* out_path, size_
     // Files don't have "." and ".." entries, so we need to find
     // the file's name inside its parent before starting the climb.
     struct inode starting_inode;
-    if (inode_read(fs->disk, inode_num, &starting_inode) != SUCCESS)
+    if (inode_read(fs, inode_num, &starting_inode) != SUCCESS)
         return ERROR_IO;
 
     if (starting_inode.type != INODE_TYPE_DIRECTORY) {
-        // it's a file: since fs_path_to_inode already
-        // works, we flip the problem: find parent via dentry reverse lookup
-        // using fs->current_dir_inode as a hint, or walk from root.
-
-        uint32_t total_inodes = fs->sb.total_inodes;
-        uint32_t found_parent = 0;
-        int found_name = 0;
-
-        for (uint32_t candidate = ROOT_INODE_NUM;
-             candidate <= total_inodes && !found_name;
-             candidate++) {
-
-            if (!bitmap_get(fs->inode_bitmap, candidate))
-                continue;
-
-            struct inode candidate_inode;
-            if (inode_read(fs->disk, candidate, &candidate_inode) != SUCCESS)
-                continue;
-
-            if (candidate_inode.type != INODE_TYPE_DIRECTORY)
-                continue;
+        // it's a file: files don't have "..", but the inode remembers the
+        // directory it was created in. Only if that hint is missing or stale
+        // (the primary name was unlinked) do we fall back to scanning every
+        // directory, and then record what we found for next time.
+        uint32_t found_parent = starting_inode.parent;
+        if (found_parent == INVALID_INODE_NUM || found_parent > fs->sb.total_inodes ||
+            find_name_in_dir(fs, found_parent, inode_num, components[depth]) != SUCCESS) {
+            found_parent = 0;
+
+            for (uint32_t candidate = ROOT_INODE_NUM;
+                 candidate <= fs->sb.total_inodes && !found_parent;
+                 candidate++) {
+
+                if (!bitmap_get(fs->inode_bitmap, candidate))
+                    continue;
 
-            uint32_t count = 0;
-            struct dentry* list = NULL;
-            if (dentry_list(fs->disk, candidate, &list, &count) != SUCCESS)
-                continue;
+                struct inode candidate_inode;
+                if (inode_read(fs, candidate, &candidate_inode) != SUCCESS)
+                    continue;
 
-            for (uint32_t i = 0; i < count; i++) {
-                if (strcmp(list[i].name, ".") == 0 || strcmp(list[i].name, "..") == 0)
+                if (candidate_inode.type != INODE_TYPE_DIRECTORY)
                     continue;
-                if (list[i].inode_num == inode_num) {
-                    strncpy(components[depth], list[i].name, MAX_FILENAME);
-                    components[depth][MAX_FILENAME - 1] = '\0';
-                    depth++;
+
+                if (find_name_in_dir(fs, candidate, inode_num, components[depth]) == SUCCESS)
                     found_parent = candidate;
-                    found_name = 1;
-                    break;
-                }
             }
-            free(list);
-        }
 
-        if (!found_name)
-            return ERROR_NOT_FOUND;
+            if (!found_parent)
+                return ERROR_NOT_FOUND;
 
+            // heal the hint (best effort: the path is already known)
+            starting_inode.parent = found_parent;
+            inode_write(fs, inode_num, &starting_inode);
+        }
+
+        depth++;
         // continue climbing from found_parent
         current = found_parent;
     }
 
     // climb up the directory tree
     while (current != ROOT_INODE_NUM) {
+        if (depth >= 64)
+            return ERROR_NO_SPACE;
+
         struct dentry parent;
-        if (dentry_find(fs->disk, current, "..", &parent, NULL) != SUCCESS)
+        if (dentry_find(fs, current, "..", &parent, NULL) != SUCCESS)
             return ERROR_IO;
 
         uint32_t parent_inode = parent.inode_num;
 
-        uint32_t count = 0;
-        struct dentry* list = NULL;
-        if (dentry_list(fs->disk, parent_inode, &list, &count) != SUCCESS)
-            return ERROR_IO;
-
-        int found = 0;
-        for (uint32_t i = 0; i < count; i++) {
-            if (strcmp(list[i].name, ".") == 0 || strcmp(list[i].name, "..") == 0)
-                continue;
-            if (list[i].inode_num == current) {
-                strncpy(components[depth], list[i].name, MAX_FILENAME);
-                components[depth][MAX_FILENAME - 1] = '\0';
-                found = 1;
-                break;
-            }
-        }
-
-        free(list);
-
-        if (!found)
-            return ERROR_NOT_FOUND;
+        int status = find_name_in_dir(fs, parent_inode, current, components[depth]);
+        if (status != SUCCESS)
+            return status;
 
         depth++;
         current = parent_inode;
@@ -218,5 +238,8 @@ int fs_getcwd(filesystem_t* fs, char* buffer, size_t size) {
     if (!fs || !buffer || size == 0)
         return ERROR_INVALID;
 
-    return fs_inode_to_path(fs, fs->current_dir_inode, buffer, size);
+    pthread_rwlock_rdlock(&fs->ns_lock);
+    int res = fs_inode_to_path(fs, fs->current_dir_inode, buffer, size);
+    pthread_rwlock_unlock(&fs->ns_lock);
+    return res;
 }
\ No newline at end of file
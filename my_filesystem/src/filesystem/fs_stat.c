@@ -5,8 +5,8 @@
 #include <string.h>
 #include <time.h>
 
-int fs_stat(filesystem_t* fs, const char* path, struct inode* out_inode,
-            uint32_t* out_inode_num, char* out_abs_path, size_t out_abs_path_size) {
+static int stat_path(filesystem_t* fs, const char* path, struct inode* out_inode,
+                     uint32_t* out_inode_num, char* out_abs_path, size_t out_abs_path_size) {
     if (!fs || !path || !out_inode)
         return ERROR_INVALID;
 
@@ -17,7 +17,10 @@ int fs_stat(filesystem_t* fs, const char* path, struct inode* out_inode,
     int res = fs_path_to_inode(fs, path, &inode_num);
     if (res != SUCCESS) return res;
 
-    res = inode_read(fs->disk, inode_num, out_inode);
+    // a consistent copy, even while the file is written
+    pthread_rwlock_rdlock(fs_inode_lock(fs, inode_num));
+    res = inode_read(fs, inode_num, out_inode);
+    pthread_rwlock_unlock(fs_inode_lock(fs, inode_num));
     if (res != SUCCESS) return res;
 
     if (out_inode_num)
@@ -25,11 +28,10 @@ int fs_stat(filesystem_t* fs, const char* path, struct inode* out_inode,
 
     if (out_abs_path && out_abs_path_size > 0) {
         if (path_is_absolute(path)) {
-            char* normalized = path_normalize(path);
-            if (normalized) {
+            char normalized[MAX_PATH];
+            if (path_normalize_into(path, normalized, sizeof(normalized)) == SUCCESS) {
                 strncpy(out_abs_path, normalized, out_abs_path_size - 1);
                 out_abs_path[out_abs_path_size - 1] = '\0';
-                free(normalized);
             }
         } else {
             char cwd[MAX_PATH];
@@ -41,11 +43,10 @@ int fs_stat(filesystem_t* fs, const char* path, struct inode* out_inode,
             if (written < 0 || written >= (int)sizeof(tmp))
                 tmp[sizeof(tmp) - 1] = '\0';  // truncate
 
-            char* normalized = path_normalize(tmp);
-            if (normalized) {
+            char normalized[MAX_PATH];
+            if (path_normalize_into(tmp, normalized, sizeof(normalized)) == SUCCESS) {
                 strncpy(out_abs_path, normalized, out_abs_path_size - 1);
                 out_abs_path[out_abs_path_size - 1] = '\0';
-                free(normalized);
             }
         }
     }
@@ -53,6 +54,20 @@ int fs_stat(filesystem_t* fs, const char* path, struct inode* out_inode,
     return SUCCESS;
 }
 
+int fs_stat(filesystem_t* fs, const char* path, struct inode* out_inode,
+            uint32_t* out_inode_num, char* out_abs_path, size_t out_abs_path_size) {
+    PERF_OP(PERF_OP_STAT);
+    TRACE_OP(PERF_OP_STAT, path);
+
+    if (!fs)
+        return ERROR_INVALID;
+
+    pthread_rwlock_rdlock(&fs->ns_lock);
+    int res = stat_path(fs, path, out_inode, out_inode_num, out_abs_path, out_abs_path_size);
+    pthread_rwlock_unlock(&fs->ns_lock);
+    return res;
+}
+
 void fs_print_stats(filesystem_t* fs) {
     if (!fs) {
         return;
@@ -60,6 +75,11 @@ void fs_print_stats(filesystem_t* fs) {
 
     printf("\n=== Filesystem Statistics ===\n");
     superblock_print(&fs->sb);
+    block_groups_print(fs);
     printf("Mounted: %s\n", fs->is_mounted ? "Yes" : "No");
     printf("Current directory inode: %u\n", fs->current_dir_inode);
+    printf("Bitmaps: %s\n", fs->bitmaps_mapped ? "mapped in place" : "in memory");
+    inode_cache_print_stats(fs->icache);
+    dcache_print_stats(fs->dcache);
+    journal_print_stats(fs->journal);
 }
\ No newline at end of file
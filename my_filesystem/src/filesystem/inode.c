@@ -1,79 +1,113 @@
 #include "inode.h"
 #include "superblock.h"
+#include "inode_cache.h"
+#include "fs.h"
 #include <stdio.h>
 #include <string.h>
 
-// === PRIVATE FUNCTIONS ===
+// === LAYOUT ===
 
 // computes block position and offset for a given inode_num
-static void inode_get_disk_position(const struct superblock* sb, uint32_t inode_num, uint32_t* block_num, uint32_t* block_offset) {
+void inode_get_disk_position(const struct superblock* sb, uint32_t inode_num, uint32_t* block_num, uint32_t* block_offset) {
     uint32_t first_inode_block = sb->inode_table_start;
     uint32_t inodes_per_block = sb->block_size / sb->inode_size;
+
+    // with block groups, each group's table holds inodes_per_group of them
+    if (sb->features & FS_FEATURE_GROUPS) {
+        uint32_t group = inode_num / sb->inodes_per_group;
+        if (group > 0)
+            first_inode_block = group * sb->blocks_per_group + sb->block_bitmap_blocks +
+                                sb->inode_bitmap_blocks;
+        inode_num %= sb->inodes_per_group;
+    }
+
     *block_num   = first_inode_block + (inode_num / inodes_per_block);
     *block_offset = (inode_num % inodes_per_block) * sb->inode_size;
 }
 
-// === PUBLIC FUNCTIONS ===
+// === RAW INODE-TABLE ACCESS ===
+
+int inode_load(struct filesystem* fs, uint32_t inode_num, struct inode* out_inode) {
+    if (!fs || !out_inode)
+        return ERROR_INVALID;
+
+    // layout info comes from the in-memory superblock
+    if (inode_num >= fs->sb.total_inodes)
+        return ERROR_INVALID;
+
+    // a table block never zeroed yet (lazy format) holds only free inodes
+    if (!itable_is_initialised(fs, inode_num)) {
+        memset(out_inode, 0, sizeof(struct inode));
+        return SUCCESS;
+    }
 
-int inode_read(disk_t disk, uint32_t inode_num, struct inode* out_inode) {
-    // allocate superblock on the stack (uninitialized memory)
-    struct superblock sb;
-    
-    //read superblock from disk (block 0) and populate sb
-    if (superblock_read(disk, &sb) != SUCCESS) 
-        return ERROR_IO;
-    
     // calculate where the requested inode is located
     uint32_t block_num, block_offset;
-    inode_get_disk_position(&sb, inode_num, &block_num, &block_offset);
+    inode_get_disk_position(&fs->sb, inode_num, &block_num, &block_offset);
     
-    // read the block containing the inode
-    char buffer[BLOCK_SIZE];
-    if (disk_read_block(disk, block_num, buffer) != DISK_SUCCESS) 
+    // copy the inode straight out of the mapped inode-table block
+    PERF_ADD(PERF_INODE_TABLE_LOADS, 1);
+    const void* ptr;
+    if (disk_borrow_blocks(fs->disk, block_num, 1, &ptr) != DISK_SUCCESS) 
         return ERROR_IO;
-    // buffer now contains 512 bytes of the block (with 4 inodes inside)
-    
-    // copy the specific inode from buffer to output structure
-    memcpy(out_inode, buffer + block_offset, sizeof(struct inode));
-    // copies 128 bytes from the correct offset in buffer to out_inode
+    memcpy(out_inode, (const char*)ptr + block_offset, sizeof(struct inode));
+    disk_release_blocks(fs->disk, block_num, 1, false);
     
     return SUCCESS;
 }
 
-int inode_write(disk_t disk, uint32_t inode_num, const struct inode* in_inode) {
-    // load superblock from disk to get layout info
-    struct superblock sb;
-    if (superblock_read(disk, &sb) != SUCCESS) 
-        return ERROR_IO;
+int inode_store(struct filesystem* fs, uint32_t inode_num, const struct inode* in_inode) {
+    if (!fs || !in_inode)
+        return ERROR_INVALID;
+
+    if (inode_num >= fs->sb.total_inodes)
+        return ERROR_INVALID;
     
     // calculate position of the inode on disk
     uint32_t block_num, block_offset;
-    inode_get_disk_position(&sb, inode_num, &block_num, &block_offset);
-    
-    // read the existing block (to preserve other inodes)
-    char buffer[BLOCK_SIZE];
-    if (disk_read_block(disk, block_num, buffer) != DISK_SUCCESS) 
-        return ERROR_IO;
-    
-    // update only the specific inode in the buffer
-    memcpy(buffer + block_offset, in_inode, sizeof(struct inode));
+    inode_get_disk_position(&fs->sb, inode_num, &block_num, &block_offset);
     
-    // write the entire block back to disk
-    if (disk_write_block(disk, block_num, buffer) != DISK_SUCCESS) 
+    // patch only this inode in place; the other inodes of the block are untouched
+    PERF_ADD(PERF_INODE_TABLE_STORES, 1);
+    void* ptr;
+    if (disk_borrow_blocks_mut(fs->disk, block_num, 1, &ptr) != DISK_SUCCESS) 
         return ERROR_IO;
+    memcpy((char*)ptr + block_offset, in_inode, sizeof(struct inode));
+    disk_release_blocks(fs->disk, block_num, 1, true);
+    journal_add(fs->journal, block_num, 1);
     
     return SUCCESS;
 }
 
+// === PUBLIC FUNCTIONS ===
+
+int inode_read(struct filesystem* fs, uint32_t inode_num, struct inode* out_inode) {
+    PERF_ADD(PERF_INODE_READS, 1);
+    if (fs && fs->icache)
+        return inode_cache_read(fs, inode_num, out_inode);
+    return inode_load(fs, inode_num, out_inode);
+}
+
+int inode_write(struct filesystem* fs, uint32_t inode_num, const struct inode* in_inode) {
+    PERF_ADD(PERF_INODE_WRITES, 1);
+    if (fs && fs->icache)
+        return inode_cache_write(fs, inode_num, in_inode);
+    return inode_store(fs, inode_num, in_inode);
+}
 
 // allocates a free inode of the specified type and updates bitmap
-int inode_alloc(disk_t disk, struct bitmap* inode_bitmap, uint8_t type, uint16_t permissions,
-                struct inode* out_inode, uint32_t* out_inode_num) {                 
+int inode_alloc(struct filesystem* fs, uint8_t type, uint16_t permissions,
+                struct inode* out_inode, uint32_t* out_inode_num) {
+    return inode_alloc_near(fs, INVALID_INODE_NUM, type, permissions, out_inode, out_inode_num);
+}
 
-    int free_idx = bitmap_find_first_free(inode_bitmap);
-    if (free_idx < 0) return ERROR_NO_SPACE;
-    
-    bitmap_set(inode_bitmap, free_idx);
+int inode_alloc_near(struct filesystem* fs, uint32_t parent, uint8_t type, uint16_t permissions,
+                     struct inode* out_inode, uint32_t* out_inode_num) {
+    if (!fs || !fs->inode_bitmap) return ERROR_INVALID;
+
+    uint32_t free_idx;
+    int res = inode_num_alloc(fs, parent, type, &free_idx);
+    if (res != SUCCESS) return res;
 
     struct inode new_inode = {0};
     new_inode.type = type;  // INODE_TYPE_FILE or INODE_TYPE_DIRECTORY
@@ -87,9 +121,9 @@ int inode_alloc(disk_t disk, struct bitmap* inode_bitmap, uint8_t type, uint16_t
     // direct and indirect pointers are already zeroed by = {0}
 
     // write inode to disk
-    if (inode_write(disk, free_idx, &new_inode) != SUCCESS) {
+    if (inode_write(fs, free_idx, &new_inode) != SUCCESS) {
         // rollback: free the bitmap bit on error
-        bitmap_clear(inode_bitmap, free_idx);
+        inode_num_free(fs, free_idx, type);
         return ERROR_IO;
     }
     
@@ -101,44 +135,25 @@ int inode_alloc(disk_t disk, struct bitmap* inode_bitmap, uint8_t type, uint16_t
 }
 
 // frees an inode and updates bitmap
-int inode_free(disk_t disk, struct bitmap* inode_bitmap, struct bitmap* block_bitmap,
-                uint32_t inode_num, uint32_t* out_num_freed_blocks) {
+int inode_free(struct filesystem* fs, uint32_t inode_num, uint32_t* out_num_freed_blocks) {
+    if (!fs || !fs->inode_bitmap || !fs->block_bitmap) return ERROR_INVALID;
+
     uint32_t freed_blocks = 0;
     struct inode inode;
-    if (inode_read(disk, inode_num, &inode) != SUCCESS) {
+    if (inode_read(fs, inode_num, &inode) != SUCCESS) {
         return ERROR_IO;
     }
 
-    // free direct blocks
-    for (int i = 0; i < 12; i++) {
-        if (inode.direct[i] != 0) {
-            bitmap_clear(block_bitmap, inode.direct[i]);
-            freed_blocks++;
-        }
-    }
-
-    // free indirect blocks
-    if (inode.indirect != 0) {
-        char indirect_buffer[BLOCK_SIZE];
-        if (disk_read_block(disk, inode.indirect, indirect_buffer) != DISK_SUCCESS) {
-            return ERROR_IO;
-        }
-        uint32_t* block_ptrs = (uint32_t*)indirect_buffer;
-        for (uint32_t i = 0; i < BLOCK_SIZE / sizeof(uint32_t); i++) {
-            if (block_ptrs[i] != 0) {
-                bitmap_clear(block_bitmap, block_ptrs[i]);
-                freed_blocks++;
-            }
-        }
-        bitmap_clear(block_bitmap, inode.indirect);
-        freed_blocks++;
+    // free data blocks and mapping blocks
+    if (bmap_truncate(fs, &inode, 0, &freed_blocks) != SUCCESS) {
+        return ERROR_IO;
     }
 
-    bitmap_clear(inode_bitmap, inode_num);
+    inode_num_free(fs, inode_num, inode.type);
 
     struct inode zero_inode = {0};
     zero_inode.type = INODE_TYPE_FREE;
-    if (inode_write(disk, inode_num, &zero_inode) != SUCCESS) {
+    if (inode_write(fs, inode_num, &zero_inode) != SUCCESS) {
         return ERROR_IO;
     }
 
@@ -162,11 +177,28 @@ void inode_print(const struct inode* inode, uint32_t inode_num) {
     printf("  Type: %u\n", inode->type);
     printf("  Size: %u bytes\n", inode->size);
     printf("  Links: %u\n", inode->links_count);
+    printf("  Parent: %u\n", inode->parent);
     printf("  Permissions: %u\n", inode->permissions);
-    printf("  Direct: ");
-    for (int i=0; i<12; i++)
-        printf("%u ", inode->direct[i]);
-    printf("\n  Indirect: %u\n", inode->indirect);
+    if (inode->flags & INODE_FLAG_INLINE_DATA) {
+        printf("  Inline data: %u of %zu bytes\n", inode->size, (size_t)BMAP_INLINE_MAX);
+    } else if (inode->flags & INODE_FLAG_EXTENTS) {
+        printf("  Extents: ");
+        struct extent ext[BMAP_INODE_EXTENTS];
+        memcpy(ext, inode->direct, sizeof(ext));
+        for (uint32_t i = 0; i < BMAP_INODE_EXTENTS && ext[i].length != 0; i++)
+            printf("[%u+%u -> %u] ", ext[i].logical, ext[i].length, ext[i].physical);
+        printf("\n  Extent block: %u\n", inode->indirect);
+    } else {
+        printf("  Direct: ");
+        for (int i=0; i<12; i++)
+            printf("%u ", inode->direct[i]);
+        printf("\n  Indirect: %u (double %u, triple %u)\n", inode->indirect,
+               inode->double_indirect, inode->triple_indirect);
+    }
+    if (inode->flags & INODE_FLAG_DIR_INDEX)
+        printf("  Hashed index: yes\n");
+    if (inode->flags & INODE_FLAG_COMPRESSED)
+        printf("  Compressed: yes\n");
     printf("  Created: "); print_timestamp(inode->created_time); printf("\n");
     printf("  Modified: "); print_timestamp(inode->modified_time); printf("\n");
     printf("  Accessed: "); print_timestamp(inode->accessed_time); printf("\n");
@@ -4,17 +4,36 @@
 #include "disk.h"
 #include "bitmap.h"
 
-int inode_read(disk_t disk, uint32_t inode_num, struct inode* out_inode);
-int inode_write(disk_t disk, uint32_t inode_num, const struct inode* in_inode);
+/* Inode operations take the mounted filesystem context (defined in fs.h):
+ * the inode table layout is computed from the in-memory superblock (fs->sb)
+ * instead of re-reading block 0 from disk on every call.
+ */
+struct filesystem;
+
+// computes the inode-table block holding inode_num and the byte offset inside it
+void inode_get_disk_position(const struct superblock* sb, uint32_t inode_num,
+                             uint32_t* block_num, uint32_t* block_offset);
+
+// goes through fs->icache when the filesystem has one (write-back),
+// otherwise straight to the inode table
+int inode_read(struct filesystem* fs, uint32_t inode_num, struct inode* out_inode);
+int inode_write(struct filesystem* fs, uint32_t inode_num, const struct inode* in_inode);
+
+// raw inode-table access, bypassing the cache
+int inode_load(struct filesystem* fs, uint32_t inode_num, struct inode* out_inode);
+int inode_store(struct filesystem* fs, uint32_t inode_num, const struct inode* in_inode);
+
+int inode_alloc(struct filesystem* fs, uint8_t type, uint16_t permissions, struct inode* out_inode, uint32_t* out_inode_num);
 
-int inode_alloc(disk_t disk, struct bitmap* inode_bitmap, uint8_t type, uint16_t permissions, struct inode* out_inode, uint32_t* out_inode_num);
+// same, placed for a new entry of directory `parent` (see block_alloc.h)
+int inode_alloc_near(struct filesystem* fs, uint32_t parent, uint8_t type, uint16_t permissions,
+                     struct inode* out_inode, uint32_t* out_inode_num);
 
 /* Frees an inode and its blocks, updates bitmaps.
  * NOTE: caller must update superblock (free_inodes++,
  * free_blocks += out_num_freed_blocks) after calling it.
  */
-int inode_free(disk_t disk, struct bitmap* inode_bitmap, struct bitmap* block_bitmap,
-                uint32_t inode_num, uint32_t* out_num_freed_blocks);
+int inode_free(struct filesystem* fs, uint32_t inode_num, uint32_t* out_num_freed_blocks);
 
 int inode_is_valid(const struct inode* inode);
 void inode_print(const struct inode* inode, uint32_t inode_num);
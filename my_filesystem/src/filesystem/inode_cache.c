@@ -0,0 +1,336 @@
+#include "inode_cache.h"
+#include "inode.h"
+#include "fs.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// === PRIVATE FUNCTIONS ===
+
+static inline uint32_t bucket_of(uint32_t inode_num) {
+    // multiplicative hash: consecutive inode numbers spread across buckets
+    return (inode_num * 2654435761u) & (INODE_CACHE_BUCKETS - 1);
+}
+
+// detaches an entry from the LRU list
+static void lru_unlink(struct inode_cache* c, struct inode_cache_entry* e) {
+    if (e->lru_prev) e->lru_prev->lru_next = e->lru_next;
+    else c->lru_head = e->lru_next;
+
+    if (e->lru_next) e->lru_next->lru_prev = e->lru_prev;
+    else c->lru_tail = e->lru_prev;
+
+    e->lru_prev = e->lru_next = NULL;
+}
+
+// inserts an entry as most recently used
+static void lru_push_front(struct inode_cache* c, struct inode_cache_entry* e) {
+    e->lru_prev = NULL;
+    e->lru_next = c->lru_head;
+    if (c->lru_head) c->lru_head->lru_prev = e;
+    c->lru_head = e;
+    if (!c->lru_tail) c->lru_tail = e;
+}
+
+static void hash_remove(struct inode_cache* c, struct inode_cache_entry* e) {
+    struct inode_cache_entry** link = &c->buckets[bucket_of(e->inode_num)];
+    while (*link) {
+        if (*link == e) {
+            *link = e->hash_next;
+            break;
+        }
+        link = &(*link)->hash_next;
+    }
+    e->hash_next = NULL;
+}
+
+static struct inode_cache_entry* hash_lookup(struct inode_cache* c, uint32_t inode_num) {
+    struct inode_cache_entry* e = c->buckets[bucket_of(inode_num)];
+    while (e) {
+        if (e->inode_num == inode_num) return e;
+        e = e->hash_next;
+    }
+    return NULL;
+}
+
+/*
+ * Returns the slot caching inode_num, loading it from disk on a miss when
+ * `load` is set. The least recently used unpinned slot is recycled (written
+ * back first if dirty). Returns ERROR_NO_SPACE if every slot is pinned.
+ */
+static int cache_get(struct filesystem* fs, uint32_t inode_num, bool load,
+                     struct inode_cache_entry** out_entry) {
+    struct inode_cache* c = fs->icache;
+
+    if (inode_num >= fs->sb.total_inodes)
+        return ERROR_INVALID;
+
+    struct inode_cache_entry* e = hash_lookup(c, inode_num);
+    if (e) {
+        c->hits++;
+        lru_unlink(c, e);
+        lru_push_front(c, e);
+        *out_entry = e;
+        return SUCCESS;
+    }
+    c->misses++;
+
+    // pick a victim starting from the least recently used end
+    struct inode_cache_entry* victim = c->lru_tail;
+    while (victim && victim->pin_count > 0)
+        victim = victim->lru_prev;
+    if (!victim)
+        return ERROR_NO_SPACE;
+
+    if (victim->valid) {
+        if (victim->dirty || victim->lazy) {
+            if (inode_store(fs, victim->inode_num, &victim->inode) != SUCCESS)
+                return ERROR_IO;
+            c->writebacks++;
+        }
+        hash_remove(c, victim);
+        victim->valid = false;
+        victim->dirty = false;
+        victim->lazy = false;
+    }
+
+    if (load && inode_load(fs, inode_num, &victim->inode) != SUCCESS)
+        return ERROR_IO;
+
+    victim->inode_num = inode_num;
+    victim->valid = true;
+    victim->dirty = false;
+    victim->lazy = false;
+    victim->pin_count = 0;
+
+    uint32_t b = bucket_of(inode_num);
+    victim->hash_next = c->buckets[b];
+    c->buckets[b] = victim;
+
+    lru_unlink(c, victim);
+    lru_push_front(c, victim);
+
+    *out_entry = victim;
+    return SUCCESS;
+}
+
+static int compare_entries_by_inode(const void* a, const void* b) {
+    const struct inode_cache_entry* ea = *(const struct inode_cache_entry* const*)a;
+    const struct inode_cache_entry* eb = *(const struct inode_cache_entry* const*)b;
+    return (ea->inode_num > eb->inode_num) - (ea->inode_num < eb->inode_num);
+}
+
+// === CREATION AND CLEANUP ===
+
+struct inode_cache* inode_cache_create(void) {
+    struct inode_cache* c = calloc(1, sizeof(struct inode_cache));
+    if (!c)
+        return NULL;
+
+    // every slot starts on the LRU list as a free (invalid) slot
+    for (int i = 0; i < INODE_CACHE_CAPACITY; i++)
+        lru_push_front(c, &c->entries[i]);
+
+    pthread_mutex_init(&c->lock, NULL);
+    return c;
+}
+
+void inode_cache_destroy(struct inode_cache** cache) {
+    if (!cache || !(*cache))
+        return;
+
+    pthread_mutex_destroy(&(*cache)->lock);
+    free(*cache);
+    *cache = NULL;
+}
+
+// === CACHED ACCESS ===
+
+int inode_cache_read(struct filesystem* fs, uint32_t inode_num, struct inode* out_inode) {
+    if (!fs || !fs->icache || !out_inode)
+        return ERROR_INVALID;
+
+    pthread_mutex_lock(&fs->icache->lock);
+    struct inode_cache_entry* e;
+    int res = cache_get(fs, inode_num, true, &e);
+    if (res == ERROR_NO_SPACE)
+        res = inode_load(fs, inode_num, out_inode);  // every slot pinned: bypass
+    else if (res == SUCCESS)
+        *out_inode = e->inode;
+    pthread_mutex_unlock(&fs->icache->lock);
+    return res;
+}
+
+int inode_cache_write(struct filesystem* fs, uint32_t inode_num, const struct inode* in_inode) {
+    if (!fs || !fs->icache || !in_inode)
+        return ERROR_INVALID;
+
+    // the whole inode is overwritten, so a miss does not need to load it
+    pthread_mutex_lock(&fs->icache->lock);
+    struct inode_cache_entry* e;
+    int res = cache_get(fs, inode_num, false, &e);
+    if (res == ERROR_NO_SPACE) {
+        res = inode_store(fs, inode_num, in_inode);  // every slot pinned: write-through
+    } else if (res == SUCCESS) {
+        // open files pass the pinned copy itself
+        if (&e->inode != in_inode)
+            e->inode = *in_inode;
+        e->dirty = true;
+    }
+    pthread_mutex_unlock(&fs->icache->lock);
+    return res;
+}
+
+// === PINNING ===
+
+int inode_cache_pin(struct filesystem* fs, uint32_t inode_num, struct inode** out_inode) {
+    if (!fs || !fs->icache || !out_inode)
+        return ERROR_INVALID;
+
+    pthread_mutex_lock(&fs->icache->lock);
+    struct inode_cache_entry* e;
+    int res = cache_get(fs, inode_num, true, &e);
+    if (res == SUCCESS) {
+        e->pin_count++;
+        *out_inode = &e->inode;
+    }
+    pthread_mutex_unlock(&fs->icache->lock);
+    return res;
+}
+
+void inode_cache_unpin(struct filesystem* fs, uint32_t inode_num) {
+    if (!fs || !fs->icache)
+        return;
+
+    pthread_mutex_lock(&fs->icache->lock);
+    struct inode_cache_entry* e = hash_lookup(fs->icache, inode_num);
+    if (e && e->pin_count > 0 && --e->pin_count == 0 && e->lazy) {
+        // last handle closed: a pending access time joins the next flush
+        e->dirty = true;
+        e->lazy = false;
+    }
+    pthread_mutex_unlock(&fs->icache->lock);
+}
+
+void inode_cache_mark_dirty(struct filesystem* fs, uint32_t inode_num) {
+    if (!fs || !fs->icache)
+        return;
+
+    pthread_mutex_lock(&fs->icache->lock);
+    struct inode_cache_entry* e = hash_lookup(fs->icache, inode_num);
+    if (e)
+        e->dirty = true;
+    pthread_mutex_unlock(&fs->icache->lock);
+}
+
+void inode_cache_mark_lazy(struct filesystem* fs, uint32_t inode_num) {
+    if (!fs || !fs->icache)
+        return;
+
+    pthread_mutex_lock(&fs->icache->lock);
+    struct inode_cache_entry* e = hash_lookup(fs->icache, inode_num);
+    if (e && !e->dirty)
+        e->lazy = true;
+    pthread_mutex_unlock(&fs->icache->lock);
+}
+
+// === WRITE-BACK ===
+
+// inode_cache_flush / inode_cache_sync with the cache lock held
+static int write_back_dirty(struct filesystem* fs, bool lazy) {
+    struct inode_cache* c = fs->icache;
+
+    // collect dirty slots, sorted so that inodes sharing a table block are adjacent
+    struct inode_cache_entry* dirty[INODE_CACHE_CAPACITY];
+    int n = 0;
+    for (int i = 0; i < INODE_CACHE_CAPACITY; i++) {
+        const struct inode_cache_entry* e = &c->entries[i];
+        if (e->valid && (e->dirty || (lazy && e->lazy)))
+            dirty[n++] = &c->entries[i];
+    }
+    if (n == 0)
+        return SUCCESS;
+
+    qsort(dirty, n, sizeof(dirty[0]), compare_entries_by_inode);
+
+    int i = 0;
+    while (i < n) {
+        uint32_t block_num, block_offset;
+        inode_get_disk_position(&fs->sb, dirty[i]->inode_num, &block_num, &block_offset);
+
+        void* ptr;
+        if (disk_borrow_blocks_mut(fs->disk, block_num, 1, &ptr) != DISK_SUCCESS)
+            return ERROR_IO;
+
+        // patch every dirty inode living in this block
+        int j = i;
+        while (j < n) {
+            uint32_t b, off;
+            inode_get_disk_position(&fs->sb, dirty[j]->inode_num, &b, &off);
+            if (b != block_num) break;
+            memcpy((char*)ptr + off, &dirty[j]->inode, sizeof(struct inode));
+            j++;
+        }
+
+        disk_release_blocks(fs->disk, block_num, 1, true);
+        journal_add(fs->journal, block_num, 1);
+        c->writebacks++;
+
+        for (int k = i; k < j; k++)
+            dirty[k]->dirty = dirty[k]->lazy = false;
+        i = j;
+    }
+
+    return SUCCESS;
+}
+
+int inode_cache_flush(struct filesystem* fs) {
+    if (!fs)
+        return ERROR_INVALID;
+    if (!fs->icache)
+        return SUCCESS;
+
+    pthread_mutex_lock(&fs->icache->lock);
+    int res = write_back_dirty(fs, false);
+    pthread_mutex_unlock(&fs->icache->lock);
+    return res;
+}
+
+int inode_cache_sync(struct filesystem* fs) {
+    if (!fs)
+        return ERROR_INVALID;
+    if (!fs->icache)
+        return SUCCESS;
+
+    pthread_mutex_lock(&fs->icache->lock);
+    int res = write_back_dirty(fs, true);
+    pthread_mutex_unlock(&fs->icache->lock);
+    return res;
+}
+
+// === UTILITIES ===
+
+void inode_cache_print_stats(const struct inode_cache* cache) {
+    if (!cache) {
+        printf("Inode cache: disabled\n");
+        return;
+    }
+
+    uint32_t used = 0, dirty = 0, lazy = 0, pinned = 0;
+    for (int i = 0; i < INODE_CACHE_CAPACITY; i++) {
+        const struct inode_cache_entry* e = &cache->entries[i];
+        if (!e->valid) continue;
+        used++;
+        if (e->dirty) dirty++;
+        if (e->lazy) lazy++;
+        if (e->pin_count > 0) pinned++;
+    }
+
+    printf("Inode cache:\n");
+    printf("  Slots used     : %u / %d\n", used, INODE_CACHE_CAPACITY);
+    printf("  Dirty / pinned : %u / %u\n", dirty, pinned);
+    printf("  Lazy atimes    : %u\n", lazy);
+    printf("  Hits / misses  : %llu / %llu\n",
+           (unsigned long long)cache->hits, (unsigned long long)cache->misses);
+    printf("  Block writes   : %llu\n", (unsigned long long)cache->writebacks);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "common.h"
+#include <pthread.h>
+
+/*
+ * Write-back inode cache.
+ *
+ * A fixed number of slots holding in-memory copies of inodes, indexed by a
+ * hash on the inode number and recycled in LRU order. inode_read/inode_write
+ * go through the cache when fs->icache is set: reads are served from memory
+ * and writes only mark the slot dirty. Dirty slots reach the inode table on
+ * eviction or on inode_cache_flush(), which groups them by inode-table block
+ * so that each block is borrowed and patched once.
+ *
+ * Open files pin their slot, so every handle on the same inode shares one
+ * copy and pinned slots are never evicted.
+ *
+ * A slot whose only change is its access time can be marked lazy instead
+ * (lazytime mounts): it is skipped by inode_cache_flush() and written by
+ * inode_cache_sync(), on eviction, or with the next flush once its last
+ * pin is dropped.
+ *
+ * The cache structure is guarded by its own lock; the contents of a pinned
+ * copy are guarded by the inode's lock in the filesystem (fs.h).
+ */
+
+#define INODE_CACHE_CAPACITY 128    // number of cached inodes
+#define INODE_CACHE_BUCKETS  256    // hash buckets (power of two)
+
+struct filesystem;
+
+struct inode_cache_entry {
+    uint32_t inode_num;
+    struct inode inode;                   // cached copy
+    bool valid;                           // slot holds an inode
+    bool dirty;                           // cached copy differs from disk
+    bool lazy;                            // only the access time differs from disk
+    uint32_t pin_count;                   // open files referencing the slot
+    struct inode_cache_entry* hash_next;  // bucket chain
+    struct inode_cache_entry* lru_prev;   // towards most recently used
+    struct inode_cache_entry* lru_next;   // towards least recently used
+};
+
+struct inode_cache {
+    struct inode_cache_entry entries[INODE_CACHE_CAPACITY];
+    struct inode_cache_entry* buckets[INODE_CACHE_BUCKETS];
+    struct inode_cache_entry* lru_head;   // most recently used
+    struct inode_cache_entry* lru_tail;   // least recently used
+    pthread_mutex_t lock;
+
+    // statistics
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t writebacks;                  // inode-table blocks written
+};
+
+// creation and cleanup (destroy does NOT flush)
+struct inode_cache* inode_cache_create(void);
+void inode_cache_destroy(struct inode_cache** cache);
+
+// cached access (used by inode_read / inode_write)
+int inode_cache_read(struct filesystem* fs, uint32_t inode_num, struct inode* out_inode);
+int inode_cache_write(struct filesystem* fs, uint32_t inode_num, const struct inode* in_inode);
+
+// pinning: returns a pointer to the shared cached copy (for open files).
+// Callers that modify *out_inode must call inode_cache_mark_dirty().
+int inode_cache_pin(struct filesystem* fs, uint32_t inode_num, struct inode** out_inode);
+void inode_cache_unpin(struct filesystem* fs, uint32_t inode_num);
+void inode_cache_mark_dirty(struct filesystem* fs, uint32_t inode_num);
+void inode_cache_mark_lazy(struct filesystem* fs, uint32_t inode_num);
+
+// writes every dirty inode back, one in-place patch per inode-table block
+int inode_cache_flush(struct filesystem* fs);
+
+// inode_cache_flush, including the lazy inodes
+int inode_cache_sync(struct filesystem* fs);
+
+// utilities
+void inode_cache_print_stats(const struct inode_cache* cache);
@@ -0,0 +1,473 @@
+#include "journal.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define JOURNAL_MAGIC 0x4C4E524Au    // "JRNL"
+
+enum journal_block_type {
+    JOURNAL_HEADER = 1,
+    JOURNAL_DESCRIPTOR = 2,
+    JOURNAL_COMMIT = 3,
+};
+
+// block 0 of the region
+struct journal_header {
+    uint32_t magic;
+    uint32_t type;
+    uint32_t start_seq;               // sequence number of the first transaction in the log
+};
+
+// followed in the log by `count` block images
+struct journal_descriptor {
+    uint32_t magic;
+    uint32_t type;
+    uint32_t seq;                     // transaction it belongs to
+    uint32_t count;
+    uint32_t targets[];               // home block of each image
+};
+
+// ends a transaction
+struct journal_commit_block {
+    uint32_t magic;
+    uint32_t type;
+    uint32_t seq;
+    uint32_t blocks;                  // images in the transaction
+    uint32_t checksum;                // over every (target, image) of the transaction
+};
+
+// === PRIVATE FUNCTIONS ===
+
+static inline uint32_t tags_per_descriptor(uint32_t block_size) {
+    return (block_size - sizeof(struct journal_descriptor)) / sizeof(uint32_t);
+}
+
+// FNV-1a, continued from h
+static uint32_t checksum_update(uint32_t h, const void* data, size_t len) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+#define CHECKSUM_SEED 2166136261u
+
+// (re)starts the log: the next transaction is `seq`, written at log block 1
+static int write_header(disk_t disk, uint32_t start, uint32_t block_size, uint32_t seq) {
+    void* ptr;
+    if (disk_borrow_blocks_mut(disk, start, 1, &ptr) != DISK_SUCCESS)
+        return ERROR_IO;
+    memset(ptr, 0, block_size);
+    struct journal_header* hdr = (struct journal_header*)ptr;
+    hdr->magic = JOURNAL_MAGIC;
+    hdr->type = JOURNAL_HEADER;
+    hdr->start_seq = seq;
+    disk_release_blocks(disk, start, 1, true);
+
+    return (disk_sync_blocks(disk, start, 1) == DISK_SUCCESS) ? SUCCESS : ERROR_IO;
+}
+
+// a home block a transaction may legitimately log
+static bool valid_target(const struct superblock* sb, uint32_t block) {
+    return block < sb->total_blocks &&
+           (block < sb->journal_start || block >= sb->journal_start + sb->journal_blocks);
+}
+
+/*
+ * Reads the transaction `seq` starting at log block pos. Returns true when
+ * it is complete (commit block present, checksum matching), with its
+ * targets / log positions in targets[] / images[] and the log block after
+ * it in *out_next.
+ */
+static bool scan_transaction(disk_t disk, const struct superblock* sb, uint32_t pos, uint32_t seq,
+                             uint32_t* targets, uint32_t* images, uint32_t* out_count,
+                             uint32_t* out_next) {
+    uint32_t start = sb->journal_start;
+    uint32_t n = sb->journal_blocks;
+    uint32_t per = tags_per_descriptor(sb->block_size);
+    uint32_t count = 0;
+    uint32_t h = CHECKSUM_SEED;
+
+    while (pos < n) {
+        const void* ptr;
+        if (disk_borrow_blocks(disk, start + pos, 1, &ptr) != DISK_SUCCESS)
+            return false;
+        const struct journal_descriptor* d = (const struct journal_descriptor*)ptr;
+
+        bool ok = d->magic == JOURNAL_MAGIC && d->seq == seq;
+        if (ok && d->type == JOURNAL_COMMIT) {
+            const struct journal_commit_block* c = (const struct journal_commit_block*)ptr;
+            ok = c->blocks == count && c->checksum == h;
+            disk_release_blocks(disk, start + pos, 1, false);
+            if (ok) {
+                *out_count = count;
+                *out_next = pos + 1;
+            }
+            return ok;
+        }
+
+        ok = ok && d->type == JOURNAL_DESCRIPTOR && d->count > 0 && d->count <= per &&
+             d->count < n - pos;
+        for (uint32_t i = 0; ok && i < d->count; i++) {
+            uint32_t target = d->targets[i];
+            const void* img;
+            if (!valid_target(sb, target) ||
+                disk_borrow_blocks(disk, start + pos + 1 + i, 1, &img) != DISK_SUCCESS) {
+                ok = false;
+                break;
+            }
+            h = checksum_update(h, &target, sizeof(target));
+            h = checksum_update(h, img, sb->block_size);
+            disk_release_blocks(disk, start + pos + 1 + i, 1, false);
+
+            targets[count] = target;
+            images[count] = pos + 1 + i;
+            count++;
+        }
+        uint32_t next = ok ? pos + 1 + d->count : pos;
+        disk_release_blocks(disk, start + pos, 1, false);
+        if (!ok)
+            return false;
+        pos = next;
+    }
+    return false;
+}
+
+// copies the images of one transaction home
+static int apply_transaction(disk_t disk, const struct superblock* sb, const uint32_t* targets,
+                             const uint32_t* images, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        const void* src;
+        void* dst;
+        if (disk_borrow_blocks(disk, sb->journal_start + images[i], 1, &src) != DISK_SUCCESS)
+            return ERROR_IO;
+        if (disk_borrow_blocks_mut(disk, targets[i], 1, &dst) != DISK_SUCCESS) {
+            disk_release_blocks(disk, sb->journal_start + images[i], 1, false);
+            return ERROR_IO;
+        }
+        memcpy(dst, src, sb->block_size);
+        disk_release_blocks(disk, targets[i], 1, true);
+        disk_release_blocks(disk, sb->journal_start + images[i], 1, false);
+    }
+    return SUCCESS;
+}
+
+// replays every committed transaction; *out_next_seq is the one to use next
+static int replay(disk_t disk, const struct superblock* sb, uint32_t* out_next_seq,
+                  uint32_t* out_replayed) {
+    const void* ptr;
+    if (disk_borrow_blocks(disk, sb->journal_start, 1, &ptr) != DISK_SUCCESS)
+        return ERROR_IO;
+    const struct journal_header* hdr = (const struct journal_header*)ptr;
+    bool valid = hdr->magic == JOURNAL_MAGIC && hdr->type == JOURNAL_HEADER;
+    uint32_t seq = hdr->start_seq;
+    disk_release_blocks(disk, sb->journal_start, 1, false);
+    if (!valid)
+        return ERROR_INVALID;
+
+    // a transaction never holds more images than the log has blocks
+    uint32_t* targets = malloc(sb->journal_blocks * sizeof(uint32_t));
+    uint32_t* images = malloc(sb->journal_blocks * sizeof(uint32_t));
+    if (!targets || !images) {
+        free(targets);
+        free(images);
+        return ERROR_GENERIC;
+    }
+
+    int res = SUCCESS;
+    uint32_t replayed = 0;
+    uint32_t pos = 1, count, next;
+    while (scan_transaction(disk, sb, pos, seq, targets, images, &count, &next)) {
+        res = apply_transaction(disk, sb, targets, images, count);
+        if (res != SUCCESS)
+            break;
+        replayed++;
+        seq++;
+        pos = next;
+    }
+
+    free(targets);
+    free(images);
+
+    // what was replayed must be home before the log restarts
+    if (res == SUCCESS && replayed > 0 && disk_sync(disk) != DISK_SUCCESS)
+        res = ERROR_IO;
+
+    *out_next_seq = seq;
+    *out_replayed = replayed;
+    return res;
+}
+
+static void tx_clear(struct journal* j) {
+    for (uint32_t i = 0; i < j->tx_count; i++)
+        bitmap_clear(j->in_tx, j->tx[i]);
+    j->tx_count = 0;
+}
+
+// === CREATION AND CLEANUP ===
+
+int journal_format(disk_t disk, const struct superblock* sb) {
+    if (!disk || !sb || sb->journal_blocks < 2)
+        return ERROR_INVALID;
+
+    // a log left by an earlier filesystem on this image must not replay
+    void* ptr;
+    if (disk_borrow_blocks_mut(disk, sb->journal_start + 1, 1, &ptr) != DISK_SUCCESS)
+        return ERROR_IO;
+    memset(ptr, 0, sb->block_size);
+    disk_release_blocks(disk, sb->journal_start + 1, 1, true);
+
+    return write_header(disk, sb->journal_start, sb->block_size, 1);
+}
+
+int journal_open(disk_t disk, const struct superblock* sb, struct journal** out_journal,
+                 uint32_t* out_replayed) {
+    if (!disk || !sb || !out_journal || !out_replayed)
+        return ERROR_INVALID;
+
+    if (sb->journal_blocks < 2 || sb->journal_start == 0 ||
+        sb->journal_start + sb->journal_blocks > sb->total_blocks)
+        return ERROR_INVALID;
+
+    uint32_t seq;
+    int res = replay(disk, sb, &seq, out_replayed);
+    if (res != SUCCESS)
+        return res;
+
+    struct journal* j = calloc(1, sizeof(struct journal));
+    if (!j)
+        return ERROR_GENERIC;
+
+    j->start = sb->journal_start;
+    j->blocks = sb->journal_blocks;
+    j->block_size = sb->block_size;
+    j->seq = seq;
+    j->head = 1;
+    j->tx_capacity = 64;
+    pthread_mutex_init(&j->lock, NULL);
+    j->tx = malloc(j->tx_capacity * sizeof(uint32_t));
+    j->in_tx = bitmap_create(sb->total_blocks);
+    j->logged = bitmap_create(sb->total_blocks);
+    if (!j->tx || !j->in_tx || !j->logged) {
+        journal_destroy(&j);
+        return ERROR_GENERIC;
+    }
+
+    res = write_header(disk, j->start, j->block_size, j->seq);
+    if (res != SUCCESS) {
+        journal_destroy(&j);
+        return res;
+    }
+
+    *out_journal = j;
+    return SUCCESS;
+}
+
+void journal_destroy(struct journal** journal) {
+    if (!journal || !(*journal))
+        return;
+
+    struct journal* j = *journal;
+    free(j->tx);
+    bitmap_destroy(&j->in_tx);
+    bitmap_destroy(&j->logged);
+    pthread_mutex_destroy(&j->lock);
+    free(j);
+    *journal = NULL;
+}
+
+int journal_grow(struct journal* j, uint32_t total_blocks) {
+    if (!j)
+        return SUCCESS;
+
+    pthread_mutex_lock(&j->lock);
+    int res = bitmap_grow(j->in_tx, total_blocks);
+    if (res == SUCCESS)
+        res = bitmap_grow(j->logged, total_blocks);
+    pthread_mutex_unlock(&j->lock);
+    return res;
+}
+
+// === TRANSACTIONS ===
+
+void journal_add(struct journal* j, uint32_t block, uint32_t count) {
+    if (!j)
+        return;
+
+    pthread_mutex_lock(&j->lock);
+    for (uint32_t b = block; b < block + count; b++) {
+        if (!bitmap_is_valid_index(j->in_tx, b) || bitmap_get(j->in_tx, b))
+            continue;
+
+        if (j->tx_count == j->tx_capacity) {
+            uint32_t* grown = realloc(j->tx, 2 * j->tx_capacity * sizeof(uint32_t));
+            if (!grown) {
+                // cannot track it: the next commit syncs the image in place first
+                j->checkpoint_needed = true;
+                continue;
+            }
+            j->tx = grown;
+            j->tx_capacity *= 2;
+        }
+
+        bitmap_set(j->in_tx, b);
+        j->tx[j->tx_count++] = b;
+    }
+    pthread_mutex_unlock(&j->lock);
+}
+
+void journal_note_alloc(struct journal* j, uint32_t block, uint32_t count) {
+    if (!j)
+        return;
+
+    pthread_mutex_lock(&j->lock);
+    for (uint32_t b = block; b < block + count && !j->checkpoint_needed; b++) {
+        if (bitmap_is_valid_index(j->logged, b) && bitmap_get(j->logged, b))
+            j->checkpoint_needed = true;
+    }
+    pthread_mutex_unlock(&j->lock);
+}
+
+static int checkpoint(struct journal* j, disk_t disk);
+
+// journal_commit with the lock held
+static int commit(struct journal* j, disk_t disk) {
+    if (j->tx_count == 0)
+        return SUCCESS;
+
+    uint32_t per = tags_per_descriptor(j->block_size);
+    uint32_t needed = j->tx_count + (j->tx_count + per - 1) / per + 1;
+
+    // too big for the log: make it durable in place instead
+    if (needed > j->blocks - 1) {
+        j->overflows++;
+        int res = checkpoint(j, disk);
+        tx_clear(j);
+        return res;
+    }
+
+    if (j->checkpoint_needed || j->head + needed > j->blocks) {
+        int res = checkpoint(j, disk);
+        if (res != SUCCESS)
+            return res;
+    }
+
+    uint32_t first = j->start + j->head;
+    uint32_t pos = first;
+    uint32_t h = CHECKSUM_SEED;
+
+    for (uint32_t i = 0; i < j->tx_count; i += per) {
+        uint32_t n = MIN(per, j->tx_count - i);
+
+        void* ptr;
+        if (disk_borrow_blocks_mut(disk, pos, 1, &ptr) != DISK_SUCCESS)
+            return ERROR_IO;
+        memset(ptr, 0, j->block_size);
+        struct journal_descriptor* d = (struct journal_descriptor*)ptr;
+        d->magic = JOURNAL_MAGIC;
+        d->type = JOURNAL_DESCRIPTOR;
+        d->seq = j->seq;
+        d->count = n;
+        memcpy(d->targets, &j->tx[i], n * sizeof(uint32_t));
+        disk_release_blocks(disk, pos, 1, true);
+
+        for (uint32_t k = 0; k < n; k++) {
+            uint32_t target = j->tx[i + k];
+            const void* src;
+            void* dst;
+            if (disk_borrow_blocks(disk, target, 1, &src) != DISK_SUCCESS)
+                return ERROR_IO;
+            if (disk_borrow_blocks_mut(disk, pos + 1 + k, 1, &dst) != DISK_SUCCESS) {
+                disk_release_blocks(disk, target, 1, false);
+                return ERROR_IO;
+            }
+            memcpy(dst, src, j->block_size);
+            h = checksum_update(h, &target, sizeof(target));
+            h = checksum_update(h, dst, j->block_size);
+            disk_release_blocks(disk, pos + 1 + k, 1, true);
+            disk_release_blocks(disk, target, 1, false);
+        }
+        pos += 1 + n;
+    }
+
+    void* ptr;
+    if (disk_borrow_blocks_mut(disk, pos, 1, &ptr) != DISK_SUCCESS)
+        return ERROR_IO;
+    memset(ptr, 0, j->block_size);
+    struct journal_commit_block* c = (struct journal_commit_block*)ptr;
+    c->magic = JOURNAL_MAGIC;
+    c->type = JOURNAL_COMMIT;
+    c->seq = j->seq;
+    c->blocks = j->tx_count;
+    c->checksum = h;
+    disk_release_blocks(disk, pos, 1, true);
+    pos++;
+
+    // the commit point: only the log blocks just written are forced out
+    if (disk_sync_blocks(disk, first, pos - first) != DISK_SUCCESS)
+        return ERROR_IO;
+
+    for (uint32_t i = 0; i < j->tx_count; i++)
+        bitmap_set(j->logged, j->tx[i]);
+    j->head = pos - j->start;
+    j->seq++;
+    j->commits++;
+    j->blocks_logged += j->tx_count;
+    tx_clear(j);
+    return SUCCESS;
+}
+
+int journal_commit(struct journal* j, disk_t disk) {
+    if (!j)
+        return SUCCESS;
+
+    pthread_mutex_lock(&j->lock);
+    int res = commit(j, disk);
+    pthread_mutex_unlock(&j->lock);
+    return res;
+}
+
+static int checkpoint(struct journal* j, disk_t disk) {
+    // every block the log covers reaches its home location
+    if (disk_sync(disk) != DISK_SUCCESS)
+        return ERROR_IO;
+
+    int res = write_header(disk, j->start, j->block_size, j->seq);
+    if (res != SUCCESS)
+        return res;
+
+    j->head = 1;
+    j->checkpoint_needed = false;
+    bitmap_clear_all(j->logged);
+    j->checkpoints++;
+    return SUCCESS;
+}
+
+int journal_checkpoint(struct journal* j, disk_t disk) {
+    if (!j)
+        return SUCCESS;
+
+    pthread_mutex_lock(&j->lock);
+    int res = checkpoint(j, disk);
+    pthread_mutex_unlock(&j->lock);
+    return res;
+}
+
+// === UTILITIES ===
+
+void journal_print_stats(const struct journal* j) {
+    if (!j) {
+        printf("Journal: disabled\n");
+        return;
+    }
+
+    printf("Journal:\n");
+    printf("  Log in use     : %u / %u blocks (next transaction %u)\n",
+           j->head - 1, j->blocks - 1, j->seq);
+    printf("  Commits        : %llu (%llu blocks logged)\n",
+           (unsigned long long)j->commits, (unsigned long long)j->blocks_logged);
+    printf("  Checkpoints    : %llu (%llu oversized transactions)\n",
+           (unsigned long long)j->checkpoints, (unsigned long long)j->overflows);
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "common.h"
+#include "disk.h"
+#include "bitmap.h"
+#include <pthread.h>
+
+/*
+ * Write-ahead journal for metadata blocks (FS_FEATURE_JOURNAL).
+ *
+ * The journal region (sb.journal_start, sb.journal_blocks) holds a header
+ * block followed by a log of transactions:
+ *
+ *   descriptor (home block numbers) | block images ... | [descriptor | images ...] | commit
+ *
+ * Every metadata block changed in place by an operation (inode table,
+ * bitmap, superblock, dentry, pointer / extent and directory index blocks)
+ * is added to the running transaction with journal_add(). At each metadata
+ * flush, journal_commit() copies the current image of those blocks into the
+ * log and forces only the log blocks it wrote to stable storage: that is the
+ * commit point, so the flush policy doubles as group commit (FS_FLUSH_EVERY_N
+ * puts N operations in one transaction) and no whole-image sync is needed.
+ *
+ * The log is appended to until it would overflow. Then (or when a logged
+ * block gets reallocated, so that replaying its stale image cannot clobber
+ * new contents) the whole image is synced once and the log restarts empty:
+ * a checkpoint. fs_sync() and unmount checkpoint too, so a clean image has
+ * an empty log.
+ *
+ * journal_open() replays the committed transactions (checked by sequence
+ * number and checksum) before the filesystem is loaded. Metadata is
+ * updated in place (through the mapping, or when a buffered borrow is
+ * released), so those writes cannot be held back until commit:
+ * what the journal guarantees is that the metadata of every committed
+ * transaction is durable and comes back as a whole; blocks changed after
+ * the last commit may survive a crash only in part.
+ *
+ * Every function below takes the journal's lock, so blocks can be added
+ * from several threads.
+ */
+
+#define JOURNAL_DEFAULT_BLOCKS 256   // journal size picked by "format ... journal"
+
+struct journal {
+    uint32_t start;                  // first block of the region (the header)
+    uint32_t blocks;                 // blocks in the region, header included
+    uint32_t block_size;
+    uint32_t head;                   // next log block to write (1 = empty log)
+    uint32_t seq;                    // sequence number of the next transaction
+    bool checkpoint_needed;          // a block logged since the last checkpoint was reallocated
+    pthread_mutex_t lock;
+
+    // running transaction
+    uint32_t* tx;                    // home blocks, in the order they were added
+    uint32_t tx_count;
+    uint32_t tx_capacity;
+    struct bitmap* in_tx;            // membership in tx[], by block number
+    struct bitmap* logged;           // blocks in the log since the last checkpoint
+
+    // statistics
+    uint64_t commits;
+    uint64_t blocks_logged;
+    uint64_t checkpoints;
+    uint64_t overflows;              // transactions too big for the log (synced in place)
+};
+
+// writes an empty log into the region described by sb (format)
+int journal_format(disk_t disk, const struct superblock* sb);
+
+/*
+ * Replays the committed transactions found in the log, then restarts it
+ * empty and returns the journal of the mounted filesystem.
+ * *out_replayed receives the number of transactions replayed (the caller
+ * re-reads the metadata they may have rewritten, superblock included).
+ */
+int journal_open(disk_t disk, const struct superblock* sb, struct journal** out_journal,
+                 uint32_t* out_replayed);
+void journal_destroy(struct journal** journal);
+
+// follows the filesystem growing to total_blocks blocks (fs_grow), so that
+// the blocks added can join transactions
+int journal_grow(struct journal* journal, uint32_t total_blocks);
+
+/*
+ * Adds count blocks starting at block to the running transaction. Like
+ * every function below it accepts a NULL journal (does nothing).
+ */
+void journal_add(struct journal* journal, uint32_t block, uint32_t count);
+
+// tells the journal that count blocks starting at block were (re)allocated
+void journal_note_alloc(struct journal* journal, uint32_t block, uint32_t count);
+
+// makes the running transaction durable (see above)
+int journal_commit(struct journal* journal, disk_t disk);
+
+// syncs the whole image and empties the log
+int journal_checkpoint(struct journal* journal, disk_t disk);
+
+// utilities
+void journal_print_stats(const struct journal* journal);
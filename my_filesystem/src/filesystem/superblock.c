@@ -1,26 +1,26 @@
 #include "superblock.h"
+#include "perf.h"
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
 
 int superblock_read(disk_t disk, struct superblock* sb) {
     if (!disk || !sb) return ERROR_INVALID;
+    PERF_ADD(PERF_SUPERBLOCK_READS, 1);
 
-    uint8_t buffer[BLOCK_SIZE];
-    int res = disk_read_block(disk, SUPERBLOCK_BLOCK_NUM, buffer);
+    // the superblock sits at the start of block 0 whatever the block size,
+    // which is only known once it has been read
+    int res = disk_read(disk, 0, sb, sizeof(struct superblock));
     if (res != DISK_SUCCESS) return ERROR_IO;
 
-    memcpy(sb, buffer, sizeof(struct superblock));
     return superblock_is_valid(sb) ? SUCCESS : ERROR_INVALID;
 }
 
 int superblock_write(disk_t disk, const struct superblock* sb) {
     if (!disk || !sb) return ERROR_INVALID;
+    PERF_ADD(PERF_SUPERBLOCK_WRITES, 1);
 
-    uint8_t buffer[BLOCK_SIZE] = {0};
-    memcpy(buffer, sb, sizeof(struct superblock));
-
-    int res = disk_write_block(disk, SUPERBLOCK_BLOCK_NUM, buffer);
+    int res = disk_write(disk, 0, sb, sizeof(struct superblock));
     if (res != DISK_SUCCESS) return ERROR_IO;
 
     return SUCCESS;
@@ -29,6 +29,9 @@ int superblock_write(disk_t disk, const struct superblock* sb) {
 int superblock_init(disk_t disk, struct superblock* sb, size_t total_blocks, size_t total_inodes) {
     if (!disk || !sb) return ERROR_INVALID;
     if(total_blocks > disk_get_blocks(disk)) return ERROR_NO_SPACE;
+
+    // blocks are counted in the disk's current block size
+    uint32_t block_size = (uint32_t)disk_get_block_size(disk);
     
     memset(sb, 0, sizeof(struct superblock));
     
@@ -36,7 +39,7 @@ int superblock_init(disk_t disk, struct superblock* sb, size_t total_blocks, siz
     sb->magic_number = MAGIC_NUMBER;
     sb->total_blocks = total_blocks;
     sb->total_inodes = total_inodes;
-    sb->block_size = BLOCK_SIZE;
+    sb->block_size = block_size;
     sb->inode_size = INODE_SIZE;
     
     // === calculate layout ===
@@ -45,20 +48,20 @@ int superblock_init(disk_t disk, struct superblock* sb, size_t total_blocks, siz
     // data block bitmap
     size_t block_bitmap_bits = total_blocks;
     size_t block_bitmap_bytes = (block_bitmap_bits + 7) / 8;
-    sb->block_bitmap_blocks = BLOCKS_NEEDED(block_bitmap_bytes);
+    sb->block_bitmap_blocks = BLOCKS_NEEDED_FOR(block_bitmap_bytes, block_size);
     sb->block_bitmap_start = current_block;
     current_block += sb->block_bitmap_blocks;
     
     // inode bitmap
     size_t inode_bitmap_bits = total_inodes;
     size_t inode_bitmap_bytes = (inode_bitmap_bits + 7) / 8;
-    sb->inode_bitmap_blocks = BLOCKS_NEEDED(inode_bitmap_bytes);
+    sb->inode_bitmap_blocks = BLOCKS_NEEDED_FOR(inode_bitmap_bytes, block_size);
     sb->inode_bitmap_start = current_block;
     current_block += sb->inode_bitmap_blocks;
     
     // inode table
     size_t inode_table_bytes = total_inodes * INODE_SIZE;
-    sb->inode_table_blocks = BLOCKS_NEEDED(inode_table_bytes);
+    sb->inode_table_blocks = BLOCKS_NEEDED_FOR(inode_table_bytes, block_size);
     sb->inode_table_start = current_block;
     current_block += sb->inode_table_blocks;
     
@@ -80,6 +83,201 @@ int superblock_init(disk_t disk, struct superblock* sb, size_t total_blocks, siz
     return SUCCESS;
 }
 
+// metadata blocks at the start of group g
+static uint32_t group_overhead(const struct superblock* sb, uint32_t g) {
+    uint32_t blocks = sb->block_bitmap_blocks + sb->inode_bitmap_blocks + sb->inode_table_blocks;
+    if (g == 0)
+        blocks += 1 + sb->group_desc_blocks;  // superblock and descriptor table
+    return blocks;
+}
+
+// derives the per-group sizes for the current group_count
+static void size_groups(struct superblock* sb, size_t total_inodes) {
+    uint32_t block_size = sb->block_size;
+    uint32_t inodes_per_block = block_size / INODE_SIZE;
+
+    // whole inode-table blocks, whole bitmap bytes
+    uint32_t unit = MAX(inodes_per_block, 8u);
+    uint32_t ipg = (uint32_t)((total_inodes + sb->group_count - 1) / sb->group_count);
+    ipg = (ipg + unit - 1) / unit * unit;
+
+    sb->inodes_per_group = ipg;
+    sb->total_inodes = ipg * sb->group_count;
+    sb->group_desc_blocks = BLOCKS_NEEDED_FOR(sb->group_count * sizeof(struct group_desc), block_size);
+    sb->block_bitmap_blocks = BLOCKS_NEEDED_FOR(sb->blocks_per_group / 8, block_size);
+    sb->inode_bitmap_blocks = BLOCKS_NEEDED_FOR(ipg / 8, block_size);
+    sb->inode_table_blocks = ipg / inodes_per_block;
+}
+
+int superblock_init_grouped(disk_t disk, struct superblock* sb, size_t total_blocks,
+                            size_t total_inodes, uint32_t blocks_per_group) {
+    if (!disk || !sb || total_inodes == 0) return ERROR_INVALID;
+    if (total_blocks > disk_get_blocks(disk)) return ERROR_NO_SPACE;
+
+    uint32_t block_size = (uint32_t)disk_get_block_size(disk);
+    if (blocks_per_group == 0)
+        blocks_per_group = MAX(block_size * 8, (uint32_t)BLOCK_GROUP_ALIGN);
+    if (blocks_per_group % BLOCK_GROUP_ALIGN != 0) return ERROR_INVALID;
+
+    memset(sb, 0, sizeof(struct superblock));
+
+    // === basic metadata ===
+    sb->magic_number = MAGIC_NUMBER;
+    sb->block_size = block_size;
+    sb->inode_size = INODE_SIZE;
+    sb->features = FS_FEATURE_GROUPS;
+    sb->blocks_per_group = blocks_per_group;
+
+    // === calculate layout ===
+    sb->group_count = (uint32_t)((total_blocks + blocks_per_group - 1) / blocks_per_group);
+    if (sb->group_count == 0) return ERROR_NO_SPACE;
+    size_groups(sb, total_inodes);
+
+    // a trailing group that cannot hold its own metadata plus a data block is
+    // left out (dropping it can only shrink the others' overhead)
+    for (;;) {
+        uint32_t last = sb->group_count - 1;
+        size_t last_blocks = total_blocks - (size_t)last * blocks_per_group;
+        if (last_blocks > group_overhead(sb, last))
+            break;
+        if (last == 0) return ERROR_NO_SPACE;
+        sb->group_count--;
+        total_blocks = (size_t)sb->group_count * blocks_per_group;
+        size_groups(sb, total_inodes);
+    }
+    sb->total_blocks = (uint32_t)total_blocks;
+
+    // group 0 locations are kept in the flat-layout fields
+    sb->block_bitmap_start = 1 + sb->group_desc_blocks;
+    sb->inode_bitmap_start = sb->block_bitmap_start + sb->block_bitmap_blocks;
+    sb->inode_table_start = sb->inode_bitmap_start + sb->inode_bitmap_blocks;
+    sb->first_data_block = sb->inode_table_start + sb->inode_table_blocks;
+
+    uint32_t overhead = 0;
+    for (uint32_t g = 0; g < sb->group_count; g++)
+        overhead += group_overhead(sb, g);
+    sb->free_blocks = sb->total_blocks - overhead;
+    sb->free_inodes = sb->total_inodes - 1;  // inode 0 is not allocatable
+
+    // === timestamps ===
+    sb->created_time = time(NULL);
+
+    return SUCCESS;
+}
+
+uint32_t superblock_group_blocks(const struct superblock* sb, uint32_t g) {
+    if (!(sb->features & FS_FEATURE_GROUPS))
+        return g == 0 ? sb->total_blocks : 0;
+
+    uint32_t base = g * sb->blocks_per_group;
+    if (g >= sb->group_count || base >= sb->total_blocks)
+        return 0;
+    return MIN(sb->blocks_per_group, sb->total_blocks - base);
+}
+
+void superblock_group_desc(const struct superblock* sb, uint32_t g, struct group_desc* out) {
+    memset(out, 0, sizeof(*out));
+    if (g == 0) {
+        out->block_bitmap = sb->block_bitmap_start;
+        out->inode_bitmap = sb->inode_bitmap_start;
+        out->inode_table = sb->inode_table_start;
+        out->first_data_block = sb->first_data_block;  // past the journal, if any
+        return;
+    }
+
+    // every other group starts straight with its bitmaps
+    out->block_bitmap = g * sb->blocks_per_group;
+    out->inode_bitmap = out->block_bitmap + sb->block_bitmap_blocks;
+    out->inode_table = out->inode_bitmap + sb->inode_bitmap_blocks;
+    out->first_data_block = out->inode_table + sb->inode_table_blocks;
+}
+
+int superblock_add_journal(struct superblock* sb, uint32_t blocks) {
+    if (!sb || blocks < 2) return ERROR_INVALID;
+
+    // the journal takes the first blocks of the data area
+    if (blocks >= sb->free_blocks) return ERROR_NO_SPACE;
+    if ((sb->features & FS_FEATURE_GROUPS) &&
+        sb->first_data_block + blocks >= superblock_group_blocks(sb, 0))
+        return ERROR_NO_SPACE;
+
+    sb->journal_start = sb->first_data_block;
+    sb->journal_blocks = blocks;
+    sb->first_data_block += blocks;
+    sb->free_blocks -= blocks;
+    sb->features |= FS_FEATURE_JOURNAL;
+    return SUCCESS;
+}
+
+int superblock_add_refcounts(struct superblock* sb) {
+    if (!sb) return ERROR_INVALID;
+
+    uint32_t blocks = (uint32_t)BLOCKS_NEEDED_FOR((uint64_t)sb->total_blocks * sizeof(uint16_t),
+                                                  sb->block_size);
+    if (blocks >= sb->free_blocks) return ERROR_NO_SPACE;
+    if ((sb->features & FS_FEATURE_GROUPS) &&
+        sb->first_data_block + blocks >= superblock_group_blocks(sb, 0))
+        return ERROR_NO_SPACE;
+
+    sb->refcount_start = sb->first_data_block;
+    sb->refcount_blocks = blocks;
+    sb->first_data_block += blocks;
+    sb->free_blocks -= blocks;
+    sb->features |= FS_FEATURE_REFLINK;
+    return SUCCESS;
+}
+
+uint32_t superblock_max_blocks(const struct superblock* sb) {
+    if (!sb) return 0;
+
+    // every bit of the block bitmap (of each group's descriptor) addresses a block
+    uint64_t max;
+    if (sb->features & FS_FEATURE_GROUPS) {
+        uint64_t descs = (uint64_t)sb->group_desc_blocks * sb->block_size / sizeof(struct group_desc);
+        max = descs * sb->blocks_per_group;
+    } else {
+        max = (uint64_t)sb->block_bitmap_blocks * sb->block_size * 8;
+    }
+
+    // and needs an entry in the reference-count table
+    if (sb->features & FS_FEATURE_REFLINK)
+        max = MIN(max, (uint64_t)sb->refcount_blocks * sb->block_size / sizeof(uint16_t));
+    return (uint32_t)MIN(max, (uint64_t)INT32_MAX);
+}
+
+int superblock_grow(struct superblock* sb, size_t total_blocks) {
+    if (!sb || total_blocks < sb->total_blocks) return ERROR_INVALID;
+    if (total_blocks > superblock_max_blocks(sb)) return ERROR_NO_SPACE;
+
+    if (!(sb->features & FS_FEATURE_GROUPS)) {
+        sb->free_blocks += (uint32_t)total_blocks - sb->total_blocks;
+        sb->total_blocks = (uint32_t)total_blocks;
+        return SUCCESS;
+    }
+
+    // the last group first fills up to blocks_per_group
+    uint32_t bpg = sb->blocks_per_group;
+    size_t filled = MIN(total_blocks, (size_t)sb->group_count * bpg);
+    sb->free_blocks += (uint32_t)filled - sb->total_blocks;
+    sb->total_blocks = (uint32_t)filled;
+
+    // then whole groups, as long as the last has room for a data block
+    while (sb->total_blocks < total_blocks) {
+        uint32_t g = sb->group_count;
+        uint32_t blocks = (uint32_t)MIN((size_t)bpg, total_blocks - sb->total_blocks);
+        if (blocks <= group_overhead(sb, g) ||
+            (uint64_t)sb->total_inodes + sb->inodes_per_group > UINT32_MAX)
+            break;
+
+        sb->group_count++;
+        sb->total_blocks += blocks;
+        sb->total_inodes += sb->inodes_per_group;
+        sb->free_blocks += blocks - group_overhead(sb, g);
+        sb->free_inodes += sb->inodes_per_group;
+    }
+    return SUCCESS;
+}
+
 void superblock_print(const struct superblock* sb) {
     if (!sb) {
         printf("Superblock: NULL\n");
@@ -94,6 +292,28 @@ void superblock_print(const struct superblock* sb) {
     printf("  Block size     : %u\n", sb->block_size);
     printf("  Inode size     : %u\n", sb->inode_size);
     printf("  First data block : %u\n", sb->first_data_block);
+    printf("  Features       :%s%s%s%s%s%s%s%s%s\n",
+           (sb->features & FS_FEATURE_EXTENTS) ? " extents" : "",
+           (sb->features & FS_FEATURE_DIR_INDEX) ? " dir_index" : "",
+           (sb->features & FS_FEATURE_REC_LEN) ? " rec_len" : "",
+           (sb->features & FS_FEATURE_JOURNAL) ? " journal" : "",
+           (sb->features & FS_FEATURE_GROUPS) ? " groups" : "",
+           (sb->features & FS_FEATURE_LAZY_ITABLE) ? " lazy_itable" : "",
+           (sb->features & FS_FEATURE_INLINE_DATA) ? " inline_data" : "",
+           (sb->features & FS_FEATURE_REFLINK) ? " reflink" : "",
+           sb->features ? "" : " (none)");
+    if (sb->features & FS_FEATURE_GROUPS)
+        printf("  Block groups   : %u x %u blocks, %u inodes each\n", sb->group_count,
+               sb->blocks_per_group, sb->inodes_per_group);
+    if ((sb->features & FS_FEATURE_LAZY_ITABLE) && !(sb->features & FS_FEATURE_GROUPS))
+        printf("  Inode table    : %u of %u blocks initialised\n", sb->itable_zeroed,
+               sb->inode_table_blocks);
+    if (sb->features & FS_FEATURE_JOURNAL)
+        printf("  Journal        : blocks %u..%u\n", sb->journal_start,
+               sb->journal_start + sb->journal_blocks - 1);
+    if (sb->features & FS_FEATURE_REFLINK)
+        printf("  Refcount table : blocks %u..%u\n", sb->refcount_start,
+               sb->refcount_start + sb->refcount_blocks - 1);
     printf("  Created        : ");
     print_timestamp(sb->created_time);
     printf("\n  Last mount     : ");
@@ -110,7 +330,7 @@ bool superblock_is_valid(const struct superblock* sb) {
         return false;
     
     // check 2: sizes
-    if (sb->block_size != BLOCK_SIZE || sb->inode_size != INODE_SIZE)
+    if (!IS_VALID_BLOCK_SIZE(sb->block_size) || sb->inode_size != INODE_SIZE)
         return false;
     
     // check 3: counters
@@ -119,6 +339,34 @@ bool superblock_is_valid(const struct superblock* sb) {
     
     if (sb->free_inodes > sb->total_inodes)
         return false;
+
+    // check 4: group geometry covers exactly the blocks and inodes
+    if (sb->features & FS_FEATURE_GROUPS) {
+        if (sb->group_count == 0 || sb->blocks_per_group == 0 ||
+            sb->blocks_per_group % BLOCK_GROUP_ALIGN != 0)
+            return false;
+        if ((uint64_t)sb->inodes_per_group * sb->group_count != sb->total_inodes)
+            return false;
+        uint64_t covered = (uint64_t)sb->blocks_per_group * sb->group_count;
+        if (sb->total_blocks > covered || sb->total_blocks <= covered - sb->blocks_per_group)
+            return false;
+    }
+
+    // check 5: the initialised part of a lazily zeroed inode table
+    if ((sb->features & FS_FEATURE_LAZY_ITABLE) && !(sb->features & FS_FEATURE_GROUPS) &&
+        sb->itable_zeroed > sb->inode_table_blocks)
+        return false;
+
+    // check 6: the reference-count table lies before the data area and
+    // has an entry for every block
+    if (sb->features & FS_FEATURE_REFLINK) {
+        if (sb->refcount_start == 0 ||
+            (uint64_t)sb->refcount_start + sb->refcount_blocks > sb->first_data_block)
+            return false;
+        if ((uint64_t)sb->refcount_blocks * sb->block_size <
+            (uint64_t)sb->total_blocks * sizeof(uint16_t))
+            return false;
+    }
     
     return true;
 }
@@ -3,15 +3,57 @@
 #include "common.h"
 #include "disk.h"
 
+// blocks_per_group granularity: a group's bits start a fresh bitmap dirty
+// chunk and summary word (see bitmap.h), so groups can be allocated from
+// concurrently
+#define BLOCK_GROUP_ALIGN (BLOCK_SIZE_MIN * 8)
+
 // load superblock from disk
 int superblock_read(disk_t disk, struct superblock* sb);
 
 // writes superblock on disk 
 int superblock_write(disk_t disk, const struct superblock* sb);
 
-// initializes and saves a new superblock (format)
+// initializes and saves a new superblock (format); the layout uses the
+// disk's current block size (see disk_set_block_size)
 int superblock_init(disk_t disk, struct superblock* sb, size_t total_blocks, size_t total_inodes);
 
+// same with a block-group layout (FS_FEATURE_GROUPS): every group of
+// blocks_per_group blocks (0 = 8 * block size, one bitmap block) carries its
+// own block bitmap, inode bitmap and slice of the inode table, described by
+// a descriptor table after the superblock. total_inodes is rounded up to
+// fill whole inode-table blocks in every group; a last group too short for
+// its own metadata is dropped
+int superblock_init_grouped(disk_t disk, struct superblock* sb, size_t total_blocks,
+                            size_t total_inodes, uint32_t blocks_per_group);
+
+// fills the location fields of group g's descriptor (counters are zeroed)
+void superblock_group_desc(const struct superblock* sb, uint32_t g, struct group_desc* out);
+
+// blocks covered by group g
+uint32_t superblock_group_blocks(const struct superblock* sb, uint32_t g);
+
+// reserves a journal region of `blocks` blocks right after the inode table
+// (moves the data area; with block groups, group 0's) and sets FS_FEATURE_JOURNAL
+int superblock_add_journal(struct superblock* sb, uint32_t blocks);
+
+// reserves the reference-count table (one 16-bit count per block, see
+// block_alloc.h) right after the journal, moving the data area the same way,
+// and sets FS_FEATURE_REFLINK
+int superblock_add_refcounts(struct superblock* sb);
+
+// largest total_blocks the layout can grow to: what the block bitmap (with
+// block groups: the descriptor table) and the reference-count table address
+uint32_t superblock_max_blocks(const struct superblock* sb);
+
+// grows the geometry to total_blocks (fs_grow). The flat layout only uses
+// the spare bits of its block bitmap; with block groups the last group is
+// extended to blocks_per_group and whole groups are added after it, a
+// trailing one too short for its own metadata left out (total_blocks may
+// then end below the request). The free counters gain the new data blocks
+// and inodes. ERROR_NO_SPACE past superblock_max_blocks
+int superblock_grow(struct superblock* sb, size_t total_blocks);
+
 // prints superblock info
 void superblock_print(const struct superblock* sb);
 
@@ -1,7 +1,26 @@
 #include "shell.h"
+#include <stdio.h>
+#include <string.h>
 
-int main(void)
+// no argument: interactive shell; a script path or '-' (stdin): batch mode
+int main(int argc, char** argv)
 {
-    shell_run();
-    return 0;
+    if (argc == 1) {
+        shell_run();
+        return 0;
+    }
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s [script|-]\n", argv[0]);
+        return 1;
+    }
+
+    FILE* in = strcmp(argv[1], "-") == 0 ? stdin : fopen(argv[1], "r");
+    if (!in) {
+        perror(argv[1]);
+        return 1;
+    }
+    int failed = shell_run_batch(in);
+    if (in != stdin)
+        fclose(in);
+    return failed ? 1 : 0;
 }
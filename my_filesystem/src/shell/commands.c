@@ -1,8 +1,15 @@
 #include "commands.h"
 #include "common.h"
+#include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TRANSFER_BUFFER (1024 * 1024)   // bytes moved per call by import / export / cp
 
 static const char* fs_error_to_string(int code) {
     switch (code) {
@@ -34,11 +41,51 @@ static const char* inode_type_to_string(uint8_t type) {
     }
 }
 
-// format <diskname> <size> (used standalone, not inside mounted shell typically)
+// format <diskname> <size> [extents] [dir_index] [rec_len] [bs=<bytes>] [journal[=<blocks>]] [lazy_itable] [inline_data] [reflink] (used standalone, not inside mounted shell typically)
 int cmd_format(int argc, char** argv) {
-    if (argc != 3) {
-        printf("Usage: format <diskname> <size_in_bytes>\n");
-        return 0;
+    if (argc < 3 || argc > 11) {
+        printf("Usage: format <diskname> <size_in_bytes> [extents] [dir_index] [rec_len] [bs=<bytes>] [journal[=<blocks>]] [lazy_itable] [inline_data] [reflink]\n");
+        return ERROR_INVALID;
+    }
+
+    fs_format_options_t opts = { .extents = false, .dir_index = false, .rec_len = false,
+                                 .block_size = BLOCK_SIZE, .journal_blocks = 0 };
+    for (int i = 3; i < argc; i++) {
+        if (strncmp(argv[i], "bs=", 3) == 0) {
+            char* end = NULL;
+            unsigned long bs = strtoul(argv[i] + 3, &end, 10);
+            if (!end || *end != '\0' || !IS_VALID_BLOCK_SIZE(bs)) {
+                printf("format: invalid block size '%s' (power of two, %d to %d)\n",
+                       argv[i] + 3, BLOCK_SIZE_MIN, BLOCK_SIZE_MAX);
+                return ERROR_INVALID;
+            }
+            opts.block_size = (uint32_t)bs;
+        } else if (strncmp(argv[i], "journal=", 8) == 0) {
+            char* end = NULL;
+            unsigned long blocks = strtoul(argv[i] + 8, &end, 10);
+            if (!end || *end != '\0' || blocks < 2 || blocks > UINT32_MAX) {
+                printf("format: invalid journal size '%s' (at least 2 blocks)\n", argv[i] + 8);
+                return ERROR_INVALID;
+            }
+            opts.journal_blocks = (uint32_t)blocks;
+        } else if (strcmp(argv[i], "journal") == 0) {
+            opts.journal_blocks = JOURNAL_DEFAULT_BLOCKS;
+        } else if (strcmp(argv[i], "extents") == 0) {
+            opts.extents = true;
+        } else if (strcmp(argv[i], "dir_index") == 0) {
+            opts.dir_index = true;
+        } else if (strcmp(argv[i], "rec_len") == 0) {
+            opts.rec_len = true;
+        } else if (strcmp(argv[i], "lazy_itable") == 0) {
+            opts.lazy_itable = true;
+        } else if (strcmp(argv[i], "inline_data") == 0) {
+            opts.inline_data = true;
+        } else if (strcmp(argv[i], "reflink") == 0) {
+            opts.reflink = true;
+        } else {
+            printf("format: unknown option '%s'\n", argv[i]);
+            return ERROR_INVALID;
+        }
     }
 
     const char* filename = argv[1];
@@ -46,97 +93,155 @@ int cmd_format(int argc, char** argv) {
 
     if (input_size <= 0) {
         printf("format: invalid size '%s'\n", argv[2]);
-        return 0;
+        return ERROR_INVALID;
     }
 
-    // ensure size is aligned to BLOCK_SIZE
-    int remainder = input_size % BLOCK_SIZE;
+    // ensure size is aligned to the block size
+    int remainder = input_size % opts.block_size;
     long long aligned_size = input_size;
 
     if (remainder != 0) {
-        aligned_size = input_size + (BLOCK_SIZE - remainder);
-        printf("format: size %d is not aligned to 512 bytes, rounding up to %lld\n",
-               input_size, aligned_size);
+        aligned_size = input_size + (opts.block_size - remainder);
+        printf("format: size %d is not aligned to %u bytes, rounding up to %lld\n",
+               input_size, opts.block_size, aligned_size);
     }
 
     disk_t disk;
     if (disk_attach(filename, aligned_size, true, &disk) != DISK_SUCCESS) {
         printf("format: cannot attach %s\n", filename);
-        return 0;
+        return ERROR_IO;
     }
 
     // compute inode count using bytes-per-inode ratio
     uint64_t total_bytes = (uint64_t)aligned_size;
     uint32_t total_inodes = total_bytes / BYTES_PER_INODE;
-    uint32_t total_blocks = total_bytes / BLOCK_SIZE;
+    uint32_t total_blocks = total_bytes / opts.block_size;
 
-    // round up to next multiple of INODES_PER_BLOCK
-    if (total_inodes % INODES_PER_BLOCK != 0) {
-        total_inodes += INODES_PER_BLOCK - (total_inodes % INODES_PER_BLOCK);
+    // round up to fill the last inode table block
+    uint32_t inodes_per_block = opts.block_size / INODE_SIZE;
+    if (total_inodes % inodes_per_block != 0) {
+        total_inodes += inodes_per_block - (total_inodes % inodes_per_block);
     }
 
     if (total_inodes < MIN_INODES) total_inodes = MIN_INODES;
 
-    if (fs_format(disk, total_blocks, total_inodes) != SUCCESS) {
+    int res = fs_format_with_options(disk, total_blocks, total_inodes, &opts);
+    if (res != SUCCESS) {
         printf("format: failed to format '%s'\n", filename);
         disk_detach(disk);
-        return 0;
+        return res;
     }
      printf("Filesystem '%s' formatted (%lld bytes, %d blocks, %u inodes)\n",
            filename, aligned_size, total_blocks, total_inodes);
 
     disk_detach(disk);
-    return 0;
+    return SUCCESS;
 }
 
 // mount
+// parses the optional flush mode of mount: "op", "sync" or a number of operations
+static int parse_flush_mode(const char* arg, fs_mount_options_t* opts) {
+    if (strcmp(arg, "op") == 0) {
+        opts->flush_policy = FS_FLUSH_PER_OP;
+        opts->flush_interval = 1;
+        return SUCCESS;
+    }
+    if (strcmp(arg, "sync") == 0) {
+        opts->flush_policy = FS_FLUSH_ON_SYNC;
+        opts->flush_interval = 0;
+        return SUCCESS;
+    }
+
+    char* end = NULL;
+    unsigned long n = strtoul(arg, &end, 10);
+    if (!end || *end != '\0' || n == 0 || n > UINT32_MAX) {
+        return ERROR_INVALID;
+    }
+    opts->flush_policy = FS_FLUSH_EVERY_N;
+    opts->flush_interval = (uint32_t)n;
+    return SUCCESS;
+}
+
 int cmd_mount(int argc, char** argv, filesystem_t** fs_p) {
-    if (argc != 2) {
-        printf("Usage: mount <disk.img>\n");
-        return 0;
+    if (argc < 2 || argc > 8) {
+        printf("Usage: mount <disk.img> [op|sync|<N>] [mmap|pread|uring] [direct] "
+               "[strictatime|relatime|noatime] [lazytime] [mapbitmaps]\n");
+        return ERROR_INVALID;
+    }
+
+    fs_mount_options_t opts = { FS_FLUSH_PER_OP, 1, FS_ATIME_STRICT, false, false };
+    disk_attach_options_t dopts = { DISK_BACKEND_MMAP, false };
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "mmap") == 0) {
+            dopts.backend = DISK_BACKEND_MMAP;
+        } else if (strcmp(argv[i], "pread") == 0) {
+            dopts.backend = DISK_BACKEND_PREAD;
+        } else if (strcmp(argv[i], "uring") == 0) {
+            dopts.backend = DISK_BACKEND_URING;
+        } else if (strcmp(argv[i], "direct") == 0) {
+            dopts.direct = true;
+        } else if (strcmp(argv[i], "strictatime") == 0) {
+            opts.atime = FS_ATIME_STRICT;
+        } else if (strcmp(argv[i], "relatime") == 0) {
+            opts.atime = FS_ATIME_RELATIME;
+        } else if (strcmp(argv[i], "noatime") == 0) {
+            opts.atime = FS_ATIME_NOATIME;
+        } else if (strcmp(argv[i], "lazytime") == 0) {
+            opts.lazytime = true;
+        } else if (strcmp(argv[i], "mapbitmaps") == 0) {
+            opts.map_bitmaps = true;
+        } else if (parse_flush_mode(argv[i], &opts) != SUCCESS) {
+            printf("mount: invalid option '%s' (expected op, sync, a positive number, "
+                   "mmap, pread, uring, direct, strictatime, relatime, noatime, lazytime or mapbitmaps)\n",
+                   argv[i]);
+            return ERROR_INVALID;
+        }
     }
 
     if (*fs_p != NULL) {
         printf("mount: a filesystem is already mounted\n");
-        return 0;
+        return ERROR_EXISTS;
     }
 
     char* filename = argv[1];
     disk_t disk;
-    if (disk_attach(filename, 0, false, &disk) != DISK_SUCCESS) {
-        printf("mount: cannot open disk '%s'\n", filename);
-        return 0;
+    int res = disk_attach_with_options(filename, 0, false, &dopts, &disk);
+    if (res != DISK_SUCCESS) {
+        printf("mount: cannot open disk '%s' (%s)\n", filename, disk_error_string(res));
+        return ERROR_IO;
     }
 
     filesystem_t* fs = NULL;
-    if (fs_mount(disk, &fs) != SUCCESS) {
+    res = fs_mount_with_options(disk, &opts, &fs);
+    if (res != SUCCESS) {
         printf("mount: failed to mount '%s'\n", filename);
         disk_detach(disk);
-        return 0;
+        return res;
     }
 
     *fs_p = fs;
     printf("Mounted %s\n", filename);
-    return 0;
+    return SUCCESS;
 }
 
 // unmount
 int cmd_unmount(filesystem_t** fs_p) {
     if (*fs_p == NULL) {
         printf("unmount: no filesystem mounted\n");
-        return 0;
+        return ERROR_INVALID;
     }
 
     filesystem_t* fs = *fs_p;
 
-    if (fs_unmount(fs) != SUCCESS) {
+    int res = fs_unmount(fs);
+    if (res != SUCCESS) {
         printf("unmount: failed\n");
-        return 0;
+        return res;
     }
 
     *fs_p = NULL;
     printf("Filesystem unmounted.\n");
-    return 0;
+    return SUCCESS;
 }
 
 // pwd
@@ -161,19 +266,19 @@ int cmd_pwd(filesystem_t* fs, int argc, char** argv) {
 int cmd_cd(filesystem_t* fs, int argc, char** argv) {
     if (argc != 2) {
         printf("Usage: cd <path>\n");
-        return 0;
+        return ERROR_INVALID;
     }
     int ret = fs_cd(fs, argv[1]);
     if (ret != SUCCESS)
         print_fs_error("cd", ret, argv[1]);
-    return 0;
+    return ret;
 }
 
 // mkdir
 int cmd_mkdir(filesystem_t* fs, int argc, char** argv) {
     if (argc != 2) {
         printf("Usage: mkdir <dir>\n");
-        return 0;
+        return ERROR_INVALID;
     }
     int ret = fs_mkdir(fs, argv[1], 0755);
     if (ret != SUCCESS)
@@ -185,49 +290,50 @@ int cmd_mkdir(filesystem_t* fs, int argc, char** argv) {
 int cmd_rmdir(filesystem_t* fs, int argc, char** argv) {
     if (argc != 2) {
         printf("Usage: rmdir <dir>\n");
-        return 0;
+        return ERROR_INVALID;
     }
     int ret = fs_rmdir(fs, argv[1]);
     if (ret != SUCCESS)
         print_fs_error("rmdir", ret, argv[1]);
-    return 0;
+    return ret;
 }
 
 // touch
 int cmd_touch(filesystem_t* fs, int argc, char** argv) {
     if (argc != 2) {
         printf("Usage: touch <file>\n");
-        return 0;
+        return ERROR_INVALID;
     }
     int ret = fs_create(fs, argv[1], 0644);
     if (ret != SUCCESS)
         print_fs_error("touch", ret, argv[1]);
-    return 0;
+    return ret;
 }
 
 // rm
 int cmd_rm(filesystem_t* fs, int argc, char** argv) {
     if (argc != 2) {
         printf("Usage: rm <file>\n");
-        return 0;
+        return ERROR_INVALID;
     }
     int ret = fs_unlink(fs, argv[1]);
     if (ret != SUCCESS)
         print_fs_error("rm", ret, argv[1]);
-    return 0;
+    return ret;
 }
 
 // cat
 int cmd_cat(filesystem_t* fs, int argc, char** argv) {
     if (argc != 2) {
         printf("Usage: cat <file>\n");
-        return 0;
+        return ERROR_INVALID;
     }
 
     open_file_t* f;
-    if (fs_open(fs, argv[1], FS_O_RDONLY, &f) != SUCCESS) {
+    int res = fs_open(fs, argv[1], FS_O_RDONLY, &f);
+    if (res != SUCCESS) {
         printf("cat: cannot open %s\n", argv[1]);
-        return 0;
+        return res;
     }
 
     char buf[1024];
@@ -238,7 +344,7 @@ int cmd_cat(filesystem_t* fs, int argc, char** argv) {
         if (ret != SUCCESS) {
             print_fs_error("cat", ret, argv[1]);
             fs_close(f);
-            return 0;
+            return ret;
         }
 
         if (bytes_read == 0) break;
@@ -249,20 +355,21 @@ int cmd_cat(filesystem_t* fs, int argc, char** argv) {
     printf("\n");
 
     fs_close(f);
-    return 0;
+    return SUCCESS;
 }
 
 // write
 int cmd_write(filesystem_t* fs, int argc, char** argv) {
     if (argc != 3) {
         printf("Usage: write <file> \"text\"\n");
-        return 0;
+        return ERROR_INVALID;
     }
 
     open_file_t* f;
-    if (fs_open(fs, argv[1], FS_O_WRONLY | FS_O_TRUNC, &f) != SUCCESS) {
+    int res = fs_open(fs, argv[1], FS_O_WRONLY | FS_O_TRUNC, &f);
+    if (res != SUCCESS) {
         printf("write: cannot open %s\n", argv[1]);
-        return 0;
+        return res;
     }
 
     size_t w;
@@ -272,20 +379,21 @@ int cmd_write(filesystem_t* fs, int argc, char** argv) {
     }
     
     fs_close(f);
-    return 0;
+    return ret;
 }
 
 // append
 int cmd_append(filesystem_t* fs, int argc, char** argv) {
     if (argc != 3) {
         printf("Usage: append <file> \"text\"\n");
-        return 0;
+        return ERROR_INVALID;
     }
 
     open_file_t* f;
-    if (fs_open(fs, argv[1], FS_O_WRONLY | FS_O_APPEND, &f) != SUCCESS) {
+    int res = fs_open(fs, argv[1], FS_O_WRONLY | FS_O_APPEND, &f);
+    if (res != SUCCESS) {
         printf("append: cannot open %s\n", argv[1]);
-        return 0;
+        return res;
     }
 
     size_t w;
@@ -295,48 +403,52 @@ int cmd_append(filesystem_t* fs, int argc, char** argv) {
     }
     
     fs_close(f);
-    return 0;
+    return ret;
 }
 
 // ls
 int cmd_ls(filesystem_t* fs, int argc, char** argv) {
     const char* path = (argc == 2) ? argv[1] : ".";
 
-    struct dentry* list;
-    uint32_t count;
-
-    int ret = fs_list(fs, path, &list, &count);
+    fs_dir_t* dir;
+    int ret = fs_opendir(fs, path, &dir);
     if (ret != SUCCESS) {
         print_fs_error("ls", ret, path);
-        return 0;
+        return ret;
     }
 
-    for (uint32_t i = 0; i < count; i++)
-        printf("%s  ", list[i].name);
+    struct dentry batch[16];
+    uint32_t count;
+    while ((ret = fs_readdir(dir, batch, 16, &count)) == SUCCESS && count > 0) {
+        for (uint32_t i = 0; i < count; i++)
+            printf("%s  ", batch[i].name);
+    }
     printf("\n");
+    if (ret != SUCCESS)
+        print_fs_error("ls", ret, path);
 
-    free(list);
-    return 0;
+    fs_closedir(dir);
+    return ret;
 }
 
 // ln
 int cmd_ln(filesystem_t* fs, int argc, char** argv) {
     if (argc != 3) {
         printf("Usage: ln <src> <dest>\n");
-        return 0;
+        return ERROR_INVALID;
     }
 
     int ret = fs_link(fs, argv[1], argv[2]);
     if (ret != SUCCESS)
         printf("ln: cannot link %s -> %s: %s\n", argv[1], argv[2], fs_error_to_string(ret));
-    return 0;
+    return ret;
 }
 
 // stat
 int cmd_stat(filesystem_t* fs, int argc, char** argv) {
     if (argc != 2) {
         printf("Usage: stat <path>\n");
-        return 0;
+        return ERROR_INVALID;
     }
 
     struct inode st;
@@ -346,7 +458,7 @@ int cmd_stat(filesystem_t* fs, int argc, char** argv) {
     int ret = fs_stat(fs, argv[1], &st, &inode_num, abs_path, sizeof(abs_path));
     if (ret != SUCCESS) {
         print_fs_error("stat", ret, argv[1]);
-        return 0;
+        return ret;
     }
     printf("[DEBUG cmd_stat] argv[1]='%s' inode_num=%u\n", argv[1], inode_num);
 
@@ -355,7 +467,11 @@ int cmd_stat(filesystem_t* fs, int argc, char** argv) {
     printf("Path          : %s\n", abs_path);
     printf("Type          : %s\n", inode_type_to_string(st.type));
     printf("Size          : %u bytes\n", st.size);
-    printf("Blocks used   : %u\n", st.blocks_used);
+    printf("Blocks used   : %u (%llu bytes)\n", st.blocks_used,
+           (unsigned long long)st.blocks_used * fs->sb.block_size);
+    if ((st.flags & INODE_FLAG_COMPRESSED) && st.blocks_used > 0)
+        printf("Compressed    : %.2fx\n",
+               (double)st.size / ((double)st.blocks_used * fs->sb.block_size));
     printf("Links count   : %u\n", st.links_count);
     printf("Permissions   : %o\n", st.permissions);
 
@@ -368,20 +484,45 @@ int cmd_stat(filesystem_t* fs, int argc, char** argv) {
     printf("\nAccessed      : ");
     print_timestamp(st.accessed_time);
 
-    printf("\nDirect blocks : ");
-    for (int i = 0; i < 12; i++) {
-        if (st.direct[i] == 0) continue;
-        printf("%u ", st.direct[i]);
-    }
-    printf("\n");
+    if (st.flags & INODE_FLAG_INLINE_DATA) {
+        printf("\nInline data   : %u of %zu bytes in the inode\n", st.size, (size_t)BMAP_INLINE_MAX);
+    } else if (st.flags & INODE_FLAG_EXTENTS) {
+        struct extent ext[BMAP_MAX_EXTENTS];
+        uint32_t count = 0;
+        printf("\nExtents       : ");
+        if (bmap_get_extents(fs, &st, ext, BMAP_MAX_EXTENTS, &count) == SUCCESS) {
+            for (uint32_t i = 0; i < count; i++)
+                printf("[%u..%u -> %u] ", ext[i].logical,
+                       ext[i].logical + ext[i].length - 1, ext[i].physical);
+        }
+        printf("\n");
+
+        if (st.indirect != 0)
+            printf("Extent blk    : %u\n", st.indirect);
+        else
+            printf("Extent blk    : (none)\n");
+    } else {
+        printf("\nDirect blocks : ");
+        for (int i = 0; i < 12; i++) {
+            if (st.direct[i] == 0) continue;
+            printf("%u ", st.direct[i]);
+        }
+        printf("\n");
 
-    if (st.indirect != 0)
-        printf("Indirect blk  : %u\n", st.indirect);
-    else
-        printf("Indirect blk  : (none)\n");
+        if (st.indirect != 0)
+            printf("Indirect blk  : %u\n", st.indirect);
+        else
+            printf("Indirect blk  : (none)\n");
+        if (st.double_indirect != 0)
+            printf("Double ind.   : %u\n", st.double_indirect);
+        if (st.triple_indirect != 0)
+            printf("Triple ind.   : %u\n", st.triple_indirect);
+    }
+    if (st.flags & INODE_FLAG_DIR_INDEX)
+        printf("Dir index     : hashed\n");
 
     printf("==============\n\n");
-    return 0;
+    return SUCCESS;
 }
 
 // fsinfo
@@ -389,3 +530,383 @@ int cmd_fsinfo(filesystem_t* fs) {
     fs_print_stats(fs);
     return SUCCESS;
 }
+
+// perf
+int cmd_perf(filesystem_t* fs, int argc, char** argv) {
+    (void)fs;
+    if (argc > 2 || (argc == 2 && strcmp(argv[1], "reset") != 0)) {
+        printf("Usage: perf [reset]\n");
+        return ERROR_INVALID;
+    }
+    if (argc == 2) {
+        perf_reset();
+        return SUCCESS;
+    }
+    struct perf_stats stats;
+    perf_snapshot(&stats);
+    perf_print(&stats);
+    return SUCCESS;
+}
+
+// trace
+int cmd_trace(filesystem_t* fs, int argc, char** argv) {
+    (void)fs;
+    const char* sub = argc >= 2 ? argv[1] : "";
+
+    if (argc == 1) {
+        printf("Tracing: %s\n", !trace_compiled() ? "not compiled in (build with FS_TRACE=1)"
+                                 : trace_is_enabled() ? "on" : "off");
+        return SUCCESS;
+    }
+    if (argc == 2 && (strcmp(sub, "on") == 0 || strcmp(sub, "off") == 0)) {
+        if (!trace_compiled()) {
+            printf("trace: not compiled in (build with FS_TRACE=1)\n");
+            return ERROR_INVALID;
+        }
+        trace_enable(strcmp(sub, "on") == 0);
+        return SUCCESS;
+    }
+    if (argc == 2 && strcmp(sub, "clear") == 0) {
+        trace_clear();
+        return SUCCESS;
+    }
+    if ((argc == 2 || argc == 3) && strcmp(sub, "dump") == 0) {
+        size_t max = argc == 3 ? strtoul(argv[2], NULL, 10) : 20;
+        if (max == 0 || max > TRACE_RING_SIZE)
+            max = TRACE_RING_SIZE;
+        struct trace_event* events = malloc(sizeof(struct trace_event) * max);
+        if (!events)
+            return ERROR_NO_SPACE;
+        size_t n = trace_snapshot(events, max);
+        trace_print(stdout, events, n);
+        free(events);
+        return SUCCESS;
+    }
+    if (argc == 3 && strcmp(sub, "save") == 0) {
+        int res = trace_save(argv[2]);
+        if (res != SUCCESS)
+            printf("trace: cannot write %s\n", argv[2]);
+        return res;
+    }
+
+    printf("Usage: trace [on|off|clear|dump [N]|save <file>]\n");
+    return ERROR_INVALID;
+}
+
+// sync
+int cmd_sync(filesystem_t* fs, int argc, char** argv) {
+    (void)argv;
+    if (argc != 1) {
+        printf("Usage: sync\n");
+        return ERROR_INVALID;
+    }
+    int res = fs_sync(fs);
+    if (res != SUCCESS) {
+        printf("sync: failed to write back filesystem state\n");
+        return res;
+    }
+    return SUCCESS;
+}
+
+// fsck
+int cmd_fsck(filesystem_t* fs, int argc, char** argv) {
+    fs_check_options_t opts = { 0, false, false };
+    for (int i = 1; i < argc; i++) {
+        char* end;
+        if (strcmp(argv[i], "-r") == 0) {
+            opts.repair = true;
+        } else if (strcmp(argv[i], "-v") == 0) {
+            opts.verbose = true;
+        } else if ((opts.threads = (uint32_t)strtoul(argv[i], &end, 10)) == 0 || *end != '\0') {
+            printf("Usage: fsck [-r] [-v] [threads]\n");
+            return ERROR_INVALID;
+        }
+    }
+
+    fs_check_report_t report;
+    int res = fs_check(fs, &opts, &report);
+    if (res != SUCCESS) {
+        printf("fsck: check failed: %s\n", error_string(res));
+        return res;
+    }
+    fs_check_print(&report);
+    return SUCCESS;
+}
+
+// resize <size_in_bytes>
+int cmd_resize(filesystem_t* fs, int argc, char** argv) {
+    char* end = NULL;
+    unsigned long long size = (argc == 2) ? strtoull(argv[1], &end, 10) : 0;
+    if (argc != 2 || !end || *end != '\0' || size == 0) {
+        printf("Usage: resize <size_in_bytes>\n");
+        return ERROR_INVALID;
+    }
+
+    uint32_t before = fs->sb.total_blocks;
+    int res = fs_grow(fs, (size_t)size);
+    if (res == ERROR_INVALID) {
+        printf("resize: cannot shrink below %llu bytes\n",
+               (unsigned long long)before * fs_block_size(fs));
+        return res;
+    }
+    if (res == ERROR_NO_SPACE) {
+        printf("resize: this layout grows to at most %zu bytes\n", fs_grow_limit(fs));
+        return res;
+    }
+    if (res != SUCCESS) {
+        print_fs_error("resize", res, NULL);
+        return res;
+    }
+    printf("resize: %u -> %u blocks, %u free\n", before, fs->sb.total_blocks, fs->sb.free_blocks);
+    return SUCCESS;
+}
+
+// === HOST TRANSFERS ===
+
+static double elapsed_ms(const struct timespec* t0) {
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (double)(t1.tv_sec - t0->tv_sec) * 1e3 + (double)(t1.tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+static void print_transfer(const char* cmd, uint64_t bytes, double ms) {
+    printf("%s: %llu bytes in %.1f ms (%.1f MB/s)\n", cmd, (unsigned long long)bytes, ms,
+           ms > 0 ? (double)bytes / (ms * 1e3) : 0.0);
+}
+
+// import <hostfile> <fsfile>
+int cmd_import(filesystem_t* fs, int argc, char** argv) {
+    if (argc != 3) {
+        printf("Usage: import <hostfile> <fsfile>\n");
+        return ERROR_INVALID;
+    }
+
+    int fd = open(argv[1], O_RDONLY);
+    if (fd < 0) {
+        printf("import: cannot open %s: %s\n", argv[1], strerror(errno));
+        return ERROR_IO;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || (uint64_t)st.st_size > UINT32_MAX) {
+        printf("import: %s is not a regular file of at most 4 GiB\n", argv[1]);
+        close(fd);
+        return ERROR_INVALID;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    uint8_t* buf = malloc(TRANSFER_BUFFER);
+    open_file_t* f = NULL;
+    int res = buf ? fs_open(fs, argv[2], FS_O_WRONLY | FS_O_CREAT | FS_O_TRUNC, &f)
+                  : ERROR_NO_SPACE;
+    if (res != SUCCESS) {
+        print_fs_error("import", res, argv[2]);
+        free(buf);
+        close(fd);
+        return res;
+    }
+
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    // one contiguous allocation up front (small files stay inline); the
+    // writes then fill it in place and move the size
+    uint32_t size = (uint32_t)st.st_size;
+    if (size > BMAP_INLINE_MAX)
+        res = fs_fallocate(f, 0, size, FS_FALLOC_KEEP_SIZE);
+
+    uint64_t copied = 0;
+    while (res == SUCCESS) {
+        ssize_t n = read(fd, buf, TRANSFER_BUFFER);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            printf("import: cannot read %s: %s\n", argv[1], strerror(errno));
+            res = ERROR_IO;
+            break;
+        }
+        if (n == 0)
+            break;
+
+        size_t written = 0;
+        res = fs_write(f, buf, (size_t)n, &written);
+        copied += written;
+        if (res == SUCCESS && written != (size_t)n)
+            res = ERROR_NO_SPACE;
+    }
+
+    // whatever was preallocated past the copy goes back
+    if (res != SUCCESS || copied < size)
+        fs_ftruncate(f, (uint32_t)copied);
+    fs_close(f);
+    free(buf);
+    close(fd);
+
+    if (res != SUCCESS) {
+        print_fs_error("import", res, argv[2]);
+        return res;
+    }
+    print_transfer("import", copied, elapsed_ms(&t0));
+    return SUCCESS;
+}
+
+// export <fsfile> <hostfile>
+int cmd_export(filesystem_t* fs, int argc, char** argv) {
+    if (argc != 3) {
+        printf("Usage: export <fsfile> <hostfile>\n");
+        return ERROR_INVALID;
+    }
+
+    open_file_t* f = NULL;
+    int res = fs_open(fs, argv[1], FS_O_RDONLY, &f);
+    if (res != SUCCESS) {
+        print_fs_error("export", res, argv[1]);
+        return res;
+    }
+    int fd = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        printf("export: cannot create %s: %s\n", argv[2], strerror(errno));
+        fs_close(f);
+        return ERROR_IO;
+    }
+    uint8_t* buf = malloc(TRANSFER_BUFFER);
+    if (!buf) {
+        fs_close(f);
+        close(fd);
+        return ERROR_NO_SPACE;
+    }
+
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    // sequential reads: the handle's readahead keeps the disk ahead of us
+    uint64_t copied = 0;
+    while (res == SUCCESS) {
+        size_t n = 0;
+        res = fs_read(f, buf, TRANSFER_BUFFER, &n);
+        if (res != SUCCESS || n == 0)
+            break;
+
+        for (size_t done = 0; done < n;) {
+            ssize_t w = write(fd, buf + done, n - done);
+            if (w < 0 && errno == EINTR)
+                continue;
+            if (w < 0) {
+                printf("export: cannot write %s: %s\n", argv[2], strerror(errno));
+                res = ERROR_IO;
+                break;
+            }
+            done += (size_t)w;
+        }
+        copied += n;
+    }
+
+    fs_close(f);
+    free(buf);
+    if (close(fd) != 0 && res == SUCCESS) {
+        printf("export: cannot write %s: %s\n", argv[2], strerror(errno));
+        res = ERROR_IO;
+    }
+
+    if (res != SUCCESS) {
+        print_fs_error("export", res, argv[1]);
+        return res;
+    }
+    print_transfer("export", copied, elapsed_ms(&t0));
+    return SUCCESS;
+}
+
+// === COPIES ===
+
+// cp [--reflink] <src> <dst>
+int cmd_cp(filesystem_t* fs, int argc, char** argv) {
+    bool reflink = (argc == 4 && strcmp(argv[1], "--reflink") == 0);
+    if (argc != 3 && !reflink) {
+        printf("Usage: cp [--reflink] <src> <dst>\n");
+        return ERROR_INVALID;
+    }
+    const char* src = argv[argc - 2];
+    const char* dst = argv[argc - 1];
+
+    struct timespec t0;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    // a clone shares the blocks: only the mapping is copied
+    if (reflink) {
+        int res = fs_clone(fs, src, dst);
+        if (res != SUCCESS) {
+            printf("cp: cannot clone %s -> %s: %s\n", src, dst, fs_error_to_string(res));
+            return res;
+        }
+        printf("cp: cloned %s in %.1f ms\n", dst, elapsed_ms(&t0));
+        return SUCCESS;
+    }
+
+    open_file_t* in = NULL;
+    open_file_t* out = NULL;
+    uint8_t* buf = malloc(TRANSFER_BUFFER);
+    int res = buf ? fs_open(fs, src, FS_O_RDONLY, &in) : ERROR_NO_SPACE;
+    if (res != SUCCESS) {
+        print_fs_error("cp", res, src);
+        free(buf);
+        return res;
+    }
+    res = fs_open(fs, dst, FS_O_WRONLY | FS_O_CREAT | FS_O_TRUNC, &out);
+    if (res != SUCCESS) {
+        print_fs_error("cp", res, dst);
+        fs_close(in);
+        free(buf);
+        return res;
+    }
+
+    uint64_t copied = 0;
+    while (res == SUCCESS) {
+        size_t n = 0, written = 0;
+        res = fs_read(in, buf, TRANSFER_BUFFER, &n);
+        if (res != SUCCESS || n == 0)
+            break;
+        res = fs_write(out, buf, n, &written);
+        copied += written;
+        if (res == SUCCESS && written != n)
+            res = ERROR_NO_SPACE;
+    }
+
+    fs_close(out);
+    fs_close(in);
+    free(buf);
+
+    if (res != SUCCESS) {
+        print_fs_error("cp", res, dst);
+        return res;
+    }
+    print_transfer("cp", copied, elapsed_ms(&t0));
+    return SUCCESS;
+}
+
+// === COMPRESSION ===
+
+// compress <file> [off]
+int cmd_compress(filesystem_t* fs, int argc, char** argv) {
+    bool off = (argc == 3 && strcmp(argv[2], "off") == 0);
+    if (argc != 2 && !off) {
+        printf("Usage: compress <file> [off]\n");
+        return ERROR_INVALID;
+    }
+
+    struct inode st;
+    uint32_t inode_num;
+    int res = fs_stat(fs, argv[1], &st, &inode_num, NULL, 0);
+    uint32_t before = (res == SUCCESS) ? st.blocks_used : 0;
+    if (res == SUCCESS) {
+        res = fs_set_compression(fs, argv[1], !off);
+    }
+    if (res == SUCCESS) {
+        res = fs_stat(fs, argv[1], &st, &inode_num, NULL, 0);
+    }
+    if (res != SUCCESS) {
+        print_fs_error("compress", res, argv[1]);
+        return res;
+    }
+    printf("compress: %s %s, %u -> %u blocks\n", argv[1],
+           off ? "stored plainly" : "compressed", before, st.blocks_used);
+    return SUCCESS;
+}
@@ -19,12 +19,29 @@ int cmd_cat(filesystem_t* fs, int argc, char** argv);
 int cmd_write(filesystem_t* fs, int argc, char** argv);
 int cmd_append(filesystem_t* fs, int argc, char** argv);
 
+// host transfers (streamed in TRANSFER_BUFFER chunks)
+int cmd_import(filesystem_t* fs, int argc, char** argv);
+int cmd_export(filesystem_t* fs, int argc, char** argv);
+
 // listing 
 int cmd_ls(filesystem_t* fs, int argc, char** argv);
 
 // links 
 int cmd_ln(filesystem_t* fs, int argc, char** argv);
 
+// copies (--reflink: a clone sharing the blocks, see fs_clone)
+int cmd_cp(filesystem_t* fs, int argc, char** argv);
+
+// compressed storage of a file (see fs_set_compression)
+int cmd_compress(filesystem_t* fs, int argc, char** argv);
+
 // metadata 
 int cmd_stat(filesystem_t* fs, int argc, char** argv);
 int cmd_fsinfo(filesystem_t* fs);
+int cmd_perf(filesystem_t* fs, int argc, char** argv);
+int cmd_trace(filesystem_t* fs, int argc, char** argv);
+int cmd_sync(filesystem_t* fs, int argc, char** argv);
+int cmd_fsck(filesystem_t* fs, int argc, char** argv);
+
+// online growth of the mounted image (see fs_grow)
+int cmd_resize(filesystem_t* fs, int argc, char** argv);
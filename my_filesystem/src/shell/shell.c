@@ -23,22 +23,30 @@ static void shell_print_prompt(filesystem_t* fs) {
     printf("[%s:%s]$ ", disk_get_filename(fs->disk), path_buf);
 }
 
-void shell_run(void) {
+// reads commands from in until EOF or exit; without interactive there is no
+// banner or prompt, '#' lines are comments, and the return value counts the
+// commands that reported an error
+static int shell_loop(FILE* in, bool interactive) {
     char* line = NULL;
     size_t len = 0;
     char* argv[MAX_ARGS];
     filesystem_t* current_fs = NULL;
+    int failed = 0;
 
-    printf("\nWhatTheShell v1.0\n");
-    printf("Type 'help' to get available commands.\n");
-    printf("Type 'exit' to quit.\n");
-    printf("\n");
+    if (interactive) {
+        printf("\nWhatTheShell v1.0\n");
+        printf("Type 'help' to get available commands.\n");
+        printf("Type 'exit' to quit.\n");
+        printf("\n");
+    }
 
     while (1) {
-        shell_print_prompt(current_fs);
-        fflush(stdout);   // ensure prompt is visible before blocking on input
+        if (interactive) {
+            shell_print_prompt(current_fs);
+            fflush(stdout);   // ensure prompt is visible before blocking on input
+        }
 
-        ssize_t nread = getline(&line, &len, stdin);
+        ssize_t nread = getline(&line, &len, in);
         if (nread == -1)   /* EOF o errore */
             break;
 
@@ -54,24 +62,39 @@ void shell_run(void) {
 
         trim_newline(line);
 
+        if (!interactive && line[strspn(line, " \t")] == '#')
+            continue;
+
         int argc = parse_line(line, argv, MAX_ARGS);
         if (argc == 0)
             continue;
 
         if (argc < 0) {
             printf("error: malformed input (unclosed quote or too many tokens)\n");
+            failed++;
             continue;
         }
 
         int status = shell_dispatch(&current_fs, argc, argv);
         if (status == SHELL_EXIT)
             break;
+        if (status < 0)
+            failed++;
     }
 
     free(line);
 
     if (current_fs)
         fs_unmount(current_fs);
+    return failed;
+}
+
+void shell_run(void) {
+    shell_loop(stdin, true);
+}
+
+int shell_run_batch(FILE* in) {
+    return shell_loop(in, false);
 }
 
 /* type for commands that do NOT require a mounted filesystem */
@@ -100,8 +123,9 @@ static int handle_exit(filesystem_t** fs, int argc, char** argv) {
 static int handle_help(filesystem_t** fs, int argc, char** argv) {
     (void)fs; (void)argc; (void)argv;
     printf("Available commands:\n");
-    printf("  format <diskname> <size_in_bytes>\n");
-    printf("  mount <diskname>\n");
+    printf("  format <diskname> <size_in_bytes> [extents] [dir_index] [rec_len] [bs=<bytes>] [journal[=<blocks>]] [lazy_itable] [inline_data] [reflink]\n");
+    printf("  mount <diskname> [op|sync|<N>] [mmap|pread|uring] [direct]\n");
+    printf("        [strictatime|relatime|noatime] [lazytime] [mapbitmaps]\n");
     printf("  unmount\n");
     printf("  pwd\n");
     printf("  cd <path>\n");
@@ -113,8 +137,17 @@ static int handle_help(filesystem_t** fs, int argc, char** argv) {
     printf("  mkdir <dir>\n");
     printf("  rmdir <dir>\n");
     printf("  ln <src> <dst>\n");
+    printf("  cp [--reflink] <src> <dst>\n");
+    printf("  compress <file> [off]\n");
     printf("  stat <path>\n");
     printf("  fsinfo\n");
+    printf("  perf [reset]\n");
+    printf("  trace [on|off|clear|dump [N]|save <file>]\n");
+    printf("  sync\n");
+    printf("  fsck [-r] [-v] [threads]\n");
+    printf("  resize <size_in_bytes>\n");
+    printf("  import <hostfile> <fsfile>\n");
+    printf("  export <fsfile> <hostfile>\n");
     printf("  cat <file>\n");
     printf("  help\n");
     printf("  exit\n");
@@ -125,7 +158,7 @@ static int handle_format(filesystem_t** fs, int argc, char** argv) {
     if (*fs != NULL) {
         printf("format: cannot format while a filesystem is mounted.\n");
         printf("Please run 'unmount' first.\n");
-        return 0;
+        return ERROR_INVALID;
     }
     return cmd_format(argc, argv);
 }
@@ -168,8 +201,17 @@ static const cmd_with_fs_entry_t cmds_with_fs[] = {
     { "mkdir",  cmd_mkdir  },
     { "rmdir",  cmd_rmdir  },
     { "ln",     cmd_ln     },
+    { "cp",     cmd_cp     },
+    { "compress", cmd_compress },
     { "stat",   cmd_stat   },
     { "fsinfo", handle_fsinfo }, // wrapper needed: cmd_fsinfo only takes fs
+    { "perf",   cmd_perf   },
+    { "trace",  cmd_trace  },
+    { "sync",   cmd_sync   },
+    { "fsck",   cmd_fsck   },
+    { "resize", cmd_resize },
+    { "import", cmd_import },
+    { "export", cmd_export },
     { NULL, NULL }
 };
 
@@ -189,7 +231,7 @@ int shell_dispatch(filesystem_t** current_fs, int argc, char** argv) {
             if (*current_fs == NULL) {
                 printf("Error: '%s' requires a mounted filesystem.\n", cmd);
                 printf("Use 'mount <diskname>' first.\n");
-                return 0;
+                return ERROR_INVALID;
             }
             return cmds_with_fs[i].fn(*current_fs, argc, argv);
         }
@@ -197,5 +239,5 @@ int shell_dispatch(filesystem_t** current_fs, int argc, char** argv) {
 
     // command not found in either table
     printf("Unknown command: '%s'. Type 'help' for available commands.\n", cmd);
-    return 0;
+    return ERROR_INVALID;
 }
\ No newline at end of file
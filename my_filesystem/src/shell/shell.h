@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdio.h>
 #include "fs.h"
 #include "parser.h"
 
@@ -12,7 +13,16 @@
  */
 void shell_run(void);
 
+/**
+ * Runs the commands read from in, without banner, prompt or echo.
+ * Lines starting with '#' are comments.
+ * Returns the number of commands that reported an error.
+ */
+int shell_run_batch(FILE* in);
+
 /**
  * Dispatches a parsed command to the correct handler.
+ * Returns SHELL_EXIT, SUCCESS, or a negative error code when the command
+ * failed, is unknown or needs a filesystem that is not mounted.
  */
 int shell_dispatch(filesystem_t** current_fs, int argc, char** argv);
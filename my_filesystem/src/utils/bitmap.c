@@ -1,4 +1,5 @@
 #include "bitmap.h"
+#include "perf.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -15,6 +16,229 @@ static inline size_t bits_to_bytes(size_t num_bits) {
     return (num_bits + 7) / 8;  // equivalent to ALIGN_TO_8(num_bits) / 8
 }
 
+// flags the chunk holding byte_idx as needing a write-back
+static inline void mark_byte_dirty(struct bitmap* bmp, size_t byte_idx) {
+    if (!bmp->dirty_chunks) {
+        return;
+    }
+    size_t chunk = byte_idx / BITMAP_CHUNK_BYTES;
+    if (!bmp->dirty_chunks[chunk]) {
+        bmp->dirty_chunks[chunk] = 1;
+        __atomic_add_fetch(&bmp->dirty_count, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// flags every chunk overlapping bits [start, start + count)
+static void mark_range_dirty(struct bitmap* bmp, size_t start, size_t count) {
+    if (!bmp->dirty_chunks || count == 0) {
+        return;
+    }
+    size_t first = BYTE_INDEX(start) / BITMAP_CHUNK_BYTES;
+    size_t last = BYTE_INDEX(start + count - 1) / BITMAP_CHUNK_BYTES;
+    for (size_t c = first; c <= last; c++) {
+        mark_byte_dirty(bmp, c * BITMAP_CHUNK_BYTES);
+    }
+}
+
+// === WORD-AT-A-TIME HELPERS ===
+// Bit i lives in byte i / 8 at position i % 8, so a little-endian 64-bit
+// load of bytes [8w, 8w + 8) holds bits [64w, 64w + 64) in order.
+
+#define WORD_BITS 64
+
+static inline size_t num_words(const struct bitmap* bmp) {
+    return (bmp->size_bits + WORD_BITS - 1) / WORD_BITS;
+}
+
+// loads word w; bytes past the end of the bitmap read as zero
+static inline uint64_t load_word(const struct bitmap* bmp, size_t w) {
+    uint64_t word = 0;
+    size_t offset = w * 8;
+    size_t avail = bmp->size_bytes - offset;
+    memcpy(&word, bmp->data + offset, avail < 8 ? avail : 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    word = __builtin_bswap64(word);
+#endif
+    return word;
+}
+
+// mask of the bits of word w below bit `end`
+static inline uint64_t mask_below(size_t end, size_t w) {
+    size_t tail = end - w * WORD_BITS;
+    return tail >= WORD_BITS ? ~0ULL : ((1ULL << tail) - 1);
+}
+
+// mask of the bits of word w that belong to the bitmap
+static inline uint64_t valid_mask(const struct bitmap* bmp, size_t w) {
+    return mask_below(bmp->size_bits, w);
+}
+
+// === FREE-SPACE SUMMARY ===
+// A summary_l1 word covers 4096 bits (one dirty chunk), so callers changing
+// disjoint 4096-bit-aligned ranges under different locks never share one;
+// summary_l2 words and the counters are shared and updated atomically.
+
+#define SUMMARY_BIT(idx)   (1ULL << ((idx) % WORD_BITS))
+
+// a summary word counts as full when all its meaningful bits are set
+static inline bool summary_word_full(uint64_t word, size_t idx, size_t total_bits) {
+    size_t tail = total_bits - idx * WORD_BITS;
+    uint64_t mask = tail >= WORD_BITS ? ~0ULL : ((1ULL << tail) - 1);
+    return (word | ~mask) == ~0ULL;
+}
+
+// refreshes the summary bits of data word w
+static void update_summary(struct bitmap* bmp, size_t w) {
+    size_t j = w / WORD_BITS;
+    bool full = (load_word(bmp, w) | ~valid_mask(bmp, w)) == ~0ULL;
+
+    if (full) bmp->summary_l1[j] |= SUMMARY_BIT(w);
+    else bmp->summary_l1[j] &= ~SUMMARY_BIT(w);
+
+    uint64_t* l2 = &bmp->summary_l2[j / WORD_BITS];
+    if (summary_word_full(bmp->summary_l1[j], j, num_words(bmp)))
+        __atomic_fetch_or(l2, SUMMARY_BIT(j), __ATOMIC_RELAXED);
+    else
+        __atomic_fetch_and(l2, ~SUMMARY_BIT(j), __ATOMIC_RELAXED);
+}
+
+// refreshes the summary bits of data words [first_w, last_w]
+static void update_summary_range(struct bitmap* bmp, size_t first_w, size_t last_w) {
+    for (size_t w = first_w; w <= last_w; w++)
+        update_summary(bmp, w);
+}
+
+static void rebuild_summary(struct bitmap* bmp) {
+    memset(bmp->summary_l1, 0, bmp->l1_words * sizeof(uint64_t));
+    memset(bmp->summary_l2, 0, bmp->l2_words * sizeof(uint64_t));
+
+    size_t words = num_words(bmp);
+    bmp->used_count = 0;
+    for (size_t w = 0; w < words; w++) {
+        bmp->used_count += __builtin_popcountll(load_word(bmp, w) & valid_mask(bmp, w));
+        update_summary(bmp, w);
+    }
+}
+
+static int alloc_summary(struct bitmap* bmp) {
+    bmp->l1_words = (num_words(bmp) + WORD_BITS - 1) / WORD_BITS;
+    bmp->l2_words = (bmp->l1_words + WORD_BITS - 1) / WORD_BITS;
+    bmp->summary_l1 = calloc(bmp->l1_words, sizeof(uint64_t));
+    bmp->summary_l2 = calloc(bmp->l2_words, sizeof(uint64_t));
+    if (!bmp->summary_l1 || !bmp->summary_l2) {
+        free(bmp->summary_l1);
+        free(bmp->summary_l2);
+        bmp->summary_l1 = bmp->summary_l2 = NULL;
+        return ERROR_NO_SPACE;
+    }
+    return SUCCESS;
+}
+
+// first data word in [w, words) that is not fully used, or `words` if none.
+// Fully used 4096-bit regions are skipped through summary_l2.
+static size_t next_nonfull_word(const struct bitmap* bmp, size_t w, size_t words) {
+    if (w >= words)
+        return words;
+
+    // rest of the current summary_l1 word
+    size_t j = w / WORD_BITS;
+    uint64_t cand = ~bmp->summary_l1[j] & (~0ULL << (w % WORD_BITS));
+    if (cand) {
+        size_t found = j * WORD_BITS + __builtin_ctzll(cand);
+        return found < words ? found : words;
+    }
+
+    // next summary_l1 word that is not all ones
+    size_t l1_end = (words + WORD_BITS - 1) / WORD_BITS;
+    j++;
+    while (j < l1_end) {
+        size_t k = j / WORD_BITS;
+        uint64_t l2 = __atomic_load_n(&bmp->summary_l2[k], __ATOMIC_RELAXED);
+        uint64_t free_l1 = ~l2 & (~0ULL << (j % WORD_BITS));
+        if (free_l1) {
+            j = k * WORD_BITS + __builtin_ctzll(free_l1);
+            if (j >= l1_end)
+                break;
+            size_t found = j * WORD_BITS + __builtin_ctzll(~bmp->summary_l1[j]);
+            return found < words ? found : words;
+        }
+        j = (k + 1) * WORD_BITS;
+    }
+
+    return words;
+}
+
+// first bit in [start, end) whose value is `want`, or ERROR_NOT_FOUND
+static int find_next_bit(const struct bitmap* bmp, size_t start, size_t end, bool want) {
+    size_t words = (end + WORD_BITS - 1) / WORD_BITS;
+    size_t w = start / WORD_BITS;
+    size_t first = w;
+
+    // ignore bits below start in the first word
+    uint64_t skip = ~0ULL << (start % WORD_BITS);
+    for (; w < words; w++) {
+        uint64_t word = load_word(bmp, w);
+        uint64_t candidates = (want ? word : ~word) & skip & mask_below(end, w);
+        if (candidates) {
+            PERF_ADD(PERF_BITMAP_BITS_SCANNED, (w - first + 1) * WORD_BITS);
+            return (int)(w * WORD_BITS + __builtin_ctzll(candidates));
+        }
+        skip = ~0ULL;
+    }
+
+    PERF_ADD(PERF_BITMAP_BITS_SCANNED, (w - first) * WORD_BITS);
+    return ERROR_NOT_FOUND;
+}
+
+// writes `value` into bits [start, start + count): partial bytes bit by bit,
+// whole bytes with memset
+static void fill_range(struct bitmap* bmp, size_t start, size_t count, bool value) {
+    size_t i = start;
+    size_t end = start + count;
+
+    for (; i < end && BIT_OFFSET(i) != 0; i++) {
+        if (value) bmp->data[BYTE_INDEX(i)] |= BIT_MASK(i);
+        else bmp->data[BYTE_INDEX(i)] &= ~BIT_MASK(i);
+    }
+
+    size_t whole_bytes = (end - i) / 8;
+    if (whole_bytes > 0) {
+        memset(bmp->data + BYTE_INDEX(i), value ? 0xFF : 0x00, whole_bytes);
+        i += whole_bytes * 8;
+    }
+
+    for (; i < end; i++) {
+        if (value) bmp->data[BYTE_INDEX(i)] |= BIT_MASK(i);
+        else bmp->data[BYTE_INDEX(i)] &= ~BIT_MASK(i);
+    }
+
+    mark_range_dirty(bmp, start, count);
+}
+
+// fill_range plus summary and used count maintenance
+static void fill_range_tracked(struct bitmap* bmp, size_t start, size_t count, bool value) {
+    if (count == 0)
+        return;
+
+    size_t first_w = start / WORD_BITS;
+    size_t last_w = (start + count - 1) / WORD_BITS;
+
+    size_t before = 0, after = 0;
+    for (size_t w = first_w; w <= last_w; w++)
+        before += __builtin_popcountll(load_word(bmp, w) & valid_mask(bmp, w));
+
+    fill_range(bmp, start, count, value);
+
+    for (size_t w = first_w; w <= last_w; w++)
+        after += __builtin_popcountll(load_word(bmp, w) & valid_mask(bmp, w));
+
+    if (after > before)
+        __atomic_add_fetch(&bmp->used_count, after - before, __ATOMIC_RELAXED);
+    else
+        __atomic_sub_fetch(&bmp->used_count, before - after, __ATOMIC_RELAXED);
+    update_summary_range(bmp, first_w, last_w);
+}
+
 // === INITIALIZATION AND CLEANUP ===
 
 struct bitmap* bitmap_create(size_t num_bits) {
@@ -35,6 +259,26 @@ struct bitmap* bitmap_create(size_t num_bits) {
         free(bmp);
         return NULL;
     }
+    bmp->owns_data = true;
+
+    // nothing has been persisted yet: every chunk starts dirty
+    bmp->num_chunks = (bmp->size_bytes + BITMAP_CHUNK_BYTES - 1) / BITMAP_CHUNK_BYTES;
+    bmp->dirty_chunks = malloc(bmp->num_chunks);
+    if (!bmp->dirty_chunks) {
+        free(bmp->data);
+        free(bmp);
+        return NULL;
+    }
+    bitmap_mark_all_dirty(bmp);
+
+    // all free: empty summary
+    if (alloc_summary(bmp) != SUCCESS) {
+        free(bmp->dirty_chunks);
+        free(bmp->data);
+        free(bmp);
+        return NULL;
+    }
+    bmp->used_count = 0;
     
     return bmp;
 }
@@ -44,9 +288,12 @@ void bitmap_destroy(struct bitmap** bmp) {
         return;
     }
     
-    if ((*bmp)->data) {
+    if ((*bmp)->data && (*bmp)->owns_data) {
         free((*bmp)->data);
     }
+    free((*bmp)->dirty_chunks);
+    free((*bmp)->summary_l1);
+    free((*bmp)->summary_l2);
     free(*bmp);
     *bmp = NULL;
 }
@@ -57,12 +304,118 @@ int bitmap_init_from_memory(struct bitmap* bmp, void* memory, size_t num_bits) {
     }
     
     bmp->data = (uint8_t*)memory;
+    bmp->owns_data = false;
     bmp->size_bits = num_bits;
     bmp->size_bytes = bits_to_bytes(num_bits);
+
+    // caller-owned memory is not tracked
+    bmp->dirty_chunks = NULL;
+    bmp->num_chunks = (bmp->size_bytes + BITMAP_CHUNK_BYTES - 1) / BITMAP_CHUNK_BYTES;
+    bmp->dirty_count = 0;
+
+    if (alloc_summary(bmp) != SUCCESS) {
+        return ERROR_NO_SPACE;
+    }
+    rebuild_summary(bmp);
     
     return SUCCESS;
 }
 
+struct bitmap* bitmap_create_from_memory(void* memory, size_t num_bits) {
+    if (!memory || num_bits == 0) {
+        return NULL;
+    }
+
+    struct bitmap* bmp = calloc(1, sizeof(struct bitmap));
+    if (!bmp) {
+        return NULL;
+    }
+
+    bmp->data = (uint8_t*)memory;
+    bmp->owns_data = false;
+    bmp->size_bits = num_bits;
+    bmp->size_bytes = bits_to_bytes(num_bits);
+
+    // the memory already holds the persisted bits: every chunk starts clean
+    bmp->num_chunks = (bmp->size_bytes + BITMAP_CHUNK_BYTES - 1) / BITMAP_CHUNK_BYTES;
+    bmp->dirty_chunks = calloc(bmp->num_chunks, 1);
+    if (!bmp->dirty_chunks || alloc_summary(bmp) != SUCCESS) {
+        free(bmp->dirty_chunks);
+        free(bmp);
+        return NULL;
+    }
+    bmp->dirty_count = 0;
+    rebuild_summary(bmp);
+
+    return bmp;
+}
+
+int bitmap_grow(struct bitmap* bmp, size_t num_bits) {
+    if (!bmp || !bmp->data || !bmp->owns_data || num_bits < bmp->size_bits) {
+        return ERROR_INVALID;
+    }
+    if (num_bits == bmp->size_bits) {
+        return SUCCESS;
+    }
+
+    size_t old_bits = bmp->size_bits;
+    size_t old_bytes = bmp->size_bytes;
+    size_t new_bytes = bits_to_bytes(num_bits);
+    size_t new_chunks = (new_bytes + BITMAP_CHUNK_BYTES - 1) / BITMAP_CHUNK_BYTES;
+
+    uint8_t* data = realloc(bmp->data, new_bytes);
+    if (!data) {
+        return ERROR_NO_SPACE;
+    }
+    bmp->data = data;
+    memset(data + old_bytes, 0, new_bytes - old_bytes);
+
+    if (bmp->dirty_chunks) {
+        uint8_t* dirty = realloc(bmp->dirty_chunks, new_chunks);
+        if (!dirty) {
+            return ERROR_NO_SPACE;  // data is larger, but still valid for old_bits
+        }
+        memset(dirty + bmp->num_chunks, 0, new_chunks - bmp->num_chunks);
+        bmp->dirty_chunks = dirty;
+    }
+
+    uint64_t* old_l1 = bmp->summary_l1;
+    uint64_t* old_l2 = bmp->summary_l2;
+    size_t old_l1_words = bmp->l1_words;
+    size_t old_l2_words = bmp->l2_words;
+    bmp->size_bits = num_bits;
+    if (alloc_summary(bmp) != SUCCESS) {
+        bmp->size_bits = old_bits;
+        bmp->summary_l1 = old_l1;
+        bmp->summary_l2 = old_l2;
+        bmp->l1_words = old_l1_words;
+        bmp->l2_words = old_l2_words;
+        return ERROR_NO_SPACE;
+    }
+    free(old_l1);
+    free(old_l2);
+    bmp->size_bytes = new_bytes;
+    bmp->num_chunks = new_chunks;
+
+    // the old last byte may hold stray bits past the old end
+    fill_range(bmp, old_bits, num_bits - old_bits, false);
+    rebuild_summary(bmp);
+    return SUCCESS;
+}
+
+int bitmap_load_bytes(struct bitmap* bmp, const void* src, size_t size) {
+    if (!bmp || !bmp->data || !src) {
+        return ERROR_INVALID;
+    }
+
+    size_t bytes_to_copy = MIN(size, bmp->size_bytes);
+    memcpy(bmp->data, src, bytes_to_copy);
+    memset(bmp->data + bytes_to_copy, 0, bmp->size_bytes - bytes_to_copy);
+    rebuild_summary(bmp);
+
+    return SUCCESS;
+}
+
 // === BIT OPERATIONS ===
 
 bool bitmap_get(const struct bitmap* bmp, size_t bit_index) {
@@ -84,7 +437,12 @@ int bitmap_set(struct bitmap* bmp, size_t bit_index) {
     size_t byte_idx = BYTE_INDEX(bit_index);
     uint8_t mask = BIT_MASK(bit_index);
     
-    bmp->data[byte_idx] |= mask;
+    if (!(bmp->data[byte_idx] & mask)) {
+        bmp->data[byte_idx] |= mask;
+        __atomic_add_fetch(&bmp->used_count, 1, __ATOMIC_RELAXED);
+        update_summary(bmp, bit_index / WORD_BITS);
+    }
+    mark_byte_dirty(bmp, byte_idx);
     
     return SUCCESS;
 }
@@ -97,7 +455,12 @@ int bitmap_clear(struct bitmap* bmp, size_t bit_index) {
     size_t byte_idx = BYTE_INDEX(bit_index);
     uint8_t mask = BIT_MASK(bit_index);
     
-    bmp->data[byte_idx] &= ~mask;
+    if (bmp->data[byte_idx] & mask) {
+        bmp->data[byte_idx] &= ~mask;
+        __atomic_sub_fetch(&bmp->used_count, 1, __ATOMIC_RELAXED);
+        update_summary(bmp, bit_index / WORD_BITS);
+    }
+    mark_byte_dirty(bmp, byte_idx);
     
     return SUCCESS;
 }
@@ -110,7 +473,11 @@ int bitmap_toggle(struct bitmap* bmp, size_t bit_index) {
     size_t byte_idx = BYTE_INDEX(bit_index);
     uint8_t mask = BIT_MASK(bit_index);
     
+    if (bmp->data[byte_idx] & mask) __atomic_sub_fetch(&bmp->used_count, 1, __ATOMIC_RELAXED);
+    else __atomic_add_fetch(&bmp->used_count, 1, __ATOMIC_RELAXED);
     bmp->data[byte_idx] ^= mask;
+    update_summary(bmp, bit_index / WORD_BITS);
+    mark_byte_dirty(bmp, byte_idx);
     
     return SUCCESS;
 }
@@ -123,6 +490,8 @@ void bitmap_set_all(struct bitmap* bmp) {
     }
     
     memset(bmp->data, 0xFF, bmp->size_bytes);
+    bitmap_mark_all_dirty(bmp);
+    rebuild_summary(bmp);
 }
 
 void bitmap_clear_all(struct bitmap* bmp) {
@@ -131,6 +500,8 @@ void bitmap_clear_all(struct bitmap* bmp) {
     }
     
     memset(bmp->data, 0x00, bmp->size_bytes);
+    bitmap_mark_all_dirty(bmp);
+    rebuild_summary(bmp);
 }
 
 int bitmap_set_range(struct bitmap* bmp, size_t start, size_t count) {
@@ -142,9 +513,7 @@ int bitmap_set_range(struct bitmap* bmp, size_t start, size_t count) {
         return ERROR_INVALID;
     }
     
-    for (size_t i = 0; i < count; i++) {
-        bitmap_set(bmp, start + i);
-    }
+    fill_range_tracked(bmp, start, count, true);
     
     return SUCCESS;
 }
@@ -158,9 +527,7 @@ int bitmap_clear_range(struct bitmap* bmp, size_t start, size_t count) {
         return ERROR_INVALID;
     }
     
-    for (size_t i = 0; i < count; i++) {
-        bitmap_clear(bmp, start + i);
-    }
+    fill_range_tracked(bmp, start, count, false);
     
     return SUCCESS;
 }
@@ -172,17 +539,33 @@ int bitmap_find_first_free(const struct bitmap* bmp) {
 }
 
 int bitmap_find_next_free(const struct bitmap* bmp, size_t start_from) {
-    if (!bmp || !bmp->data || start_from >= bmp->size_bits) {
+    return bitmap_find_next_free_in(bmp, start_from, bmp ? bmp->size_bits : 0);
+}
+
+int bitmap_find_next_free_in(const struct bitmap* bmp, size_t start_from, size_t end) {
+    if (!bmp || !bmp->data || end > bmp->size_bits || start_from >= end) {
         return ERROR_NOT_FOUND;
     }
     
-    // optimization: scans byte per byte
-    for (size_t i = start_from; i < bmp->size_bits; i++) {
-        if (!bitmap_get(bmp, i)) {
-            return (int)i;
+    // the summary points straight at words with a free bit
+    size_t words = (end + WORD_BITS - 1) / WORD_BITS;
+    size_t start_w = start_from / WORD_BITS;
+    size_t w = start_w;
+    size_t loaded = 0;
+
+    while ((w = next_nonfull_word(bmp, w, words)) < words) {
+        // ignore bits below start_from in its own word
+        uint64_t skip = (w == start_w) ? ~0ULL << (start_from % WORD_BITS) : ~0ULL;
+        uint64_t candidates = ~load_word(bmp, w) & skip & mask_below(end, w);
+        loaded++;
+        if (candidates) {
+            PERF_ADD(PERF_BITMAP_BITS_SCANNED, loaded * WORD_BITS);
+            return (int)(w * WORD_BITS + __builtin_ctzll(candidates));
         }
+        w++;
     }
     
+    PERF_ADD(PERF_BITMAP_BITS_SCANNED, loaded * WORD_BITS);
     return ERROR_NOT_FOUND;
 }
 
@@ -191,10 +574,44 @@ int bitmap_find_first_used(const struct bitmap* bmp) {
         return ERROR_NOT_FOUND;
     }
     
-    for (size_t i = 0; i < bmp->size_bits; i++) {
-        if (bitmap_get(bmp, i)) {
-            return (int)i;
+    return find_next_bit(bmp, 0, bmp->size_bits, true);
+}
+
+int bitmap_find_next_used(const struct bitmap* bmp, size_t start_from) {
+    return bitmap_find_next_used_in(bmp, start_from, bmp ? bmp->size_bits : 0);
+}
+
+int bitmap_find_next_used_in(const struct bitmap* bmp, size_t start_from, size_t end) {
+    if (!bmp || !bmp->data || end > bmp->size_bits || start_from >= end) {
+        return ERROR_NOT_FOUND;
+    }
+    
+    return find_next_bit(bmp, start_from, end, true);
+}
+
+int bitmap_find_free_run(const struct bitmap* bmp, size_t start, size_t len) {
+    return bitmap_find_free_run_in(bmp, start, bmp ? bmp->size_bits : 0, len);
+}
+
+int bitmap_find_free_run_in(const struct bitmap* bmp, size_t start, size_t end, size_t len) {
+    if (!bmp || !bmp->data || len == 0 || end > bmp->size_bits || len > end) {
+        return ERROR_NOT_FOUND;
+    }
+    
+    // alternate between the next free bit and the used bit that ends its run
+    size_t pos = start;
+    while (pos + len <= end) {
+        int free_bit = bitmap_find_next_free_in(bmp, pos, end);
+        if (free_bit < 0 || (size_t)free_bit + len > end) {
+            return ERROR_NOT_FOUND;
+        }
+        
+        int used_bit = find_next_bit(bmp, free_bit, end, true);
+        size_t run_end = (used_bit < 0) ? end : (size_t)used_bit;
+        if (run_end - (size_t)free_bit >= len) {
+            return free_bit;
         }
+        pos = run_end;
     }
     
     return ERROR_NOT_FOUND;
@@ -205,14 +622,7 @@ int bitmap_count_free(const struct bitmap* bmp) {
         return 0;
     }
     
-    int count = 0;
-    for (size_t i = 0; i < bmp->size_bits; i++) {
-        if (!bitmap_get(bmp, i)) {
-            count++;
-        }
-    }
-    
-    return count;
+    return (int)bmp->size_bits - bitmap_count_used(bmp);
 }
 
 int bitmap_count_used(const struct bitmap* bmp) {
@@ -220,7 +630,65 @@ int bitmap_count_used(const struct bitmap* bmp) {
         return 0;
     }
     
-    return (int)bmp->size_bits - bitmap_count_free(bmp);
+    // maintained incrementally by every mutator
+    return (int)__atomic_load_n(&bmp->used_count, __ATOMIC_RELAXED);
+}
+
+int bitmap_count_used_in(const struct bitmap* bmp, size_t start, size_t end) {
+    if (!bmp || !bmp->data || end > bmp->size_bits || start >= end) {
+        return 0;
+    }
+
+    size_t count = 0;
+    size_t last_w = (end - 1) / WORD_BITS;
+    uint64_t skip = ~0ULL << (start % WORD_BITS);
+    for (size_t w = start / WORD_BITS; w <= last_w; w++) {
+        count += __builtin_popcountll(load_word(bmp, w) & skip & mask_below(end, w));
+        skip = ~0ULL;
+    }
+    return (int)count;
+}
+
+// === DIRTY TRACKING ===
+
+size_t bitmap_chunk_count(const struct bitmap* bmp) {
+    if (!bmp) {
+        return 0;
+    }
+    return bmp->num_chunks;
+}
+
+bool bitmap_chunk_is_dirty(const struct bitmap* bmp, size_t chunk) {
+    if (!bmp || chunk >= bmp->num_chunks) {
+        return false;
+    }
+    if (!bmp->dirty_chunks) {
+        return true;
+    }
+    return bmp->dirty_chunks[chunk] != 0;
+}
+
+bool bitmap_is_dirty(const struct bitmap* bmp) {
+    if (!bmp) {
+        return false;
+    }
+    return !bmp->dirty_chunks || __atomic_load_n(&bmp->dirty_count, __ATOMIC_RELAXED) > 0;
+}
+
+void bitmap_mark_all_dirty(struct bitmap* bmp) {
+    if (!bmp || !bmp->dirty_chunks) {
+        return;
+    }
+    memset(bmp->dirty_chunks, 1, bmp->num_chunks);
+    bmp->dirty_count = bmp->num_chunks;
+}
+
+void bitmap_clear_dirty(struct bitmap* bmp) {
+    if (!bmp || !bmp->dirty_chunks) {
+        return;
+    }
+    memset(bmp->dirty_chunks, 0, bmp->num_chunks);
+    bmp->dirty_count = 0;
 }
 
 // === UTILITY FUNCTIONS ===
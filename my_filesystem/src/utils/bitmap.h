@@ -4,11 +4,29 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+// dirty-tracking granularity: the smallest on-disk bitmap block (larger
+// blocks hold several chunks)
+#define BITMAP_CHUNK_BYTES BLOCK_SIZE_MIN
+
 // === BITMAP STRUCTURE ===
 struct bitmap {
     uint8_t* data;          // array of bits
+    bool owns_data;         // false: data is caller memory, not freed by bitmap_destroy
     size_t size_bits;       // total number of bits
     size_t size_bytes;      // number of bytes needed
+    uint8_t* dirty_chunks;  // one flag per BITMAP_CHUNK_BYTES of data (NULL = untracked)
+    size_t num_chunks;      // number of chunks
+    size_t dirty_count;     // number of dirty chunks
+
+    // free-space summary, kept in sync by every mutator:
+    //  - summary_l1 bit w is set when 64-bit data word w is fully used
+    //  - summary_l2 bit j is set when summary_l1 word j is all ones,
+    //    i.e. the 4096 bits (512 bytes) it covers are fully used
+    uint64_t* summary_l1;
+    uint64_t* summary_l2;
+    size_t l1_words;        // number of summary_l1 words
+    size_t l2_words;        // number of summary_l2 words
+    size_t used_count;      // number of set bits
 };
 
 // === PUBLIC FUNCTIONS ===
@@ -18,6 +36,19 @@ struct bitmap* bitmap_create(size_t num_bits);
 void bitmap_destroy(struct bitmap** bmp);
 int bitmap_init_from_memory(struct bitmap* bmp, void* memory, size_t num_bits);
 
+// a bitmap working in place on caller memory (e.g. a mapped disk region),
+// which must outlive it. Unlike bitmap_init_from_memory the chunks are
+// tracked, starting clean: the memory is taken to be what is persisted
+struct bitmap* bitmap_create_from_memory(void* memory, size_t num_bits);
+
+// extends a bitmap owning its data to num_bits (>= its size); the new bits
+// are free and their chunks dirty, the existing bits are kept
+int bitmap_grow(struct bitmap* bmp, size_t num_bits);
+
+// replaces the bitmap contents with `size` raw bytes (e.g. read from disk)
+// and rebuilds the summary; leaves dirty flags untouched
+int bitmap_load_bytes(struct bitmap* bmp, const void* src, size_t size);
+
 // bit operations
 bool bitmap_get(const struct bitmap* bmp, size_t bit_index);
 int bitmap_set(struct bitmap* bmp, size_t bit_index);
@@ -34,9 +65,29 @@ int bitmap_clear_range(struct bitmap* bmp, size_t start, size_t count);
 int bitmap_find_first_free(const struct bitmap* bmp);
 int bitmap_find_next_free(const struct bitmap* bmp, size_t start_from);
 int bitmap_find_first_used(const struct bitmap* bmp);
+int bitmap_find_next_used(const struct bitmap* bmp, size_t start_from);
+
+// first index >= start beginning a run of len free bits, or ERROR_NOT_FOUND
+int bitmap_find_free_run(const struct bitmap* bmp, size_t start, size_t len);
 int bitmap_count_free(const struct bitmap* bmp);
 int bitmap_count_used(const struct bitmap* bmp);
 
+// the same, limited to bits below `end`. Callers changing disjoint ranges
+// aligned to BITMAP_CHUNK_BYTES * 8 bits may run these and the mutators on
+// their own range concurrently (no word outside the range is touched)
+int bitmap_find_next_free_in(const struct bitmap* bmp, size_t start_from, size_t end);
+int bitmap_find_next_used_in(const struct bitmap* bmp, size_t start_from, size_t end);
+int bitmap_find_free_run_in(const struct bitmap* bmp, size_t start, size_t end, size_t len);
+int bitmap_count_used_in(const struct bitmap* bmp, size_t start, size_t end);
+
+// dirty tracking: every modification marks the chunk holding the bit.
+// New bitmaps start fully dirty; untracked bitmaps always report dirty.
+size_t bitmap_chunk_count(const struct bitmap* bmp);
+bool bitmap_chunk_is_dirty(const struct bitmap* bmp, size_t chunk);
+bool bitmap_is_dirty(const struct bitmap* bmp);
+void bitmap_mark_all_dirty(struct bitmap* bmp);
+void bitmap_clear_dirty(struct bitmap* bmp);
+
 // utility functions
 void bitmap_print(const struct bitmap* bmp, size_t max_bits_to_show);
 bool bitmap_is_valid_index(const struct bitmap* bmp, size_t bit_index);
\ No newline at end of file
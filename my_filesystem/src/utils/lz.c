@@ -0,0 +1,193 @@
+#include "lz.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// === FORMAT LIMITS ===
+
+#define MIN_MATCH     4
+#define LAST_LITERALS 5        // the block always ends with at least this many literals
+#define MFLIMIT       12       // no match may start within this many bytes of the end
+#define MAX_OFFSET    65535
+#define HASH_SIZE     (1u << LZ_HASH_BITS)
+#define RUN_MASK      15       // token nibble meaning "more length bytes follow"
+
+// === PRIVATE FUNCTIONS ===
+
+static inline uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint32_t hash32(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// bytes needed to encode the part of a length past its token nibble
+static inline size_t length_bytes(size_t len) {
+    return len >= RUN_MASK ? (len - RUN_MASK) / 255 + 1 : 0;
+}
+
+static uint8_t* put_length(uint8_t* op, size_t len) {
+    len -= RUN_MASK;
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+// emits one sequence: literals [anchor, anchor + lit), then a match of mlen
+// bytes at offset (mlen == 0: the final literals-only sequence). NULL when
+// it does not fit before oend
+static uint8_t* put_sequence(uint8_t* op, uint8_t* oend, const uint8_t* anchor,
+                              size_t lit, size_t offset, size_t mlen) {
+    size_t mcode = mlen ? mlen - MIN_MATCH : 0;
+    size_t need = 1 + length_bytes(lit) + lit + (mlen ? 2 + length_bytes(mcode) : 0);
+    if ((size_t)(oend - op) < need)
+        return NULL;
+
+    uint8_t* token = op++;
+    *token = (uint8_t)((lit >= RUN_MASK ? RUN_MASK : lit) << 4);
+    if (lit >= RUN_MASK)
+        op = put_length(op, lit);
+    memcpy(op, anchor, lit);
+    op += lit;
+
+    if (mlen) {
+        *op++ = (uint8_t)(offset & 0xFF);
+        *op++ = (uint8_t)(offset >> 8);
+        *token |= (uint8_t)(mcode >= RUN_MASK ? RUN_MASK : mcode);
+        if (mcode >= RUN_MASK)
+            op = put_length(op, mcode);
+    }
+    return op;
+}
+
+// reads the extra length bytes after a saturated nibble; false past the end
+static bool get_length(const uint8_t** ip, const uint8_t* iend, size_t* len) {
+    uint8_t b;
+    do {
+        if (*ip >= iend)
+            return false;
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return true;
+}
+
+// === PUBLIC FUNCTIONS ===
+
+size_t lz_compress(const void* src, size_t n, void* dst, size_t cap) {
+    const uint8_t* in = src;
+    const uint8_t* iend = in + n;
+    const uint8_t* ip = in;
+    const uint8_t* anchor = in;
+    uint8_t* out = dst;
+    uint8_t* op = out;
+    uint8_t* oend = out + cap;
+
+    if (!src || !dst)
+        return 0;
+
+    if (n > MFLIMIT) {
+        // positions are offsets from in; a stale or zero entry is caught by
+        // the byte comparison below
+        uint32_t table[HASH_SIZE];
+        memset(table, 0, sizeof(table));
+
+        const uint8_t* mflimit = iend - MFLIMIT;
+        const uint8_t* matchlimit = iend - LAST_LITERALS;
+
+        ip++;
+        while (ip < mflimit) {
+            uint32_t seq = read32(ip);
+            uint32_t h = hash32(seq);
+            const uint8_t* ref = in + table[h];
+            table[h] = (uint32_t)(ip - in);
+
+            if (ref >= ip || (size_t)(ip - ref) > MAX_OFFSET || read32(ref) != seq) {
+                // step faster through data that keeps missing
+                ip += 1 + ((size_t)(ip - anchor) >> 6);
+                continue;
+            }
+
+            while (ip > anchor && ref > in && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+            }
+            const uint8_t* mp = ip + MIN_MATCH;
+            const uint8_t* rp = ref + MIN_MATCH;
+            while (mp < matchlimit && *mp == *rp) {
+                mp++;
+                rp++;
+            }
+
+            op = put_sequence(op, oend, anchor, (size_t)(ip - anchor),
+                              (size_t)(ip - ref), (size_t)(mp - ip));
+            if (!op)
+                return 0;
+
+            // index a position inside the match so the next one chains on
+            if (mp - 2 > ip)
+                table[hash32(read32(mp - 2))] = (uint32_t)(mp - 2 - in);
+            ip = anchor = mp;
+        }
+    }
+
+    op = put_sequence(op, oend, anchor, (size_t)(iend - anchor), 0, 0);
+    return op ? (size_t)(op - out) : 0;
+}
+
+int lz_decompress(const void* src, size_t n, void* dst, size_t cap) {
+    const uint8_t* ip = src;
+    const uint8_t* iend = ip + n;
+    uint8_t* out = dst;
+    uint8_t* op = out;
+    uint8_t* oend = out + cap;
+
+    if (!src || !dst || n == 0)
+        return -1;
+
+    for (;;) {
+        if (ip >= iend)
+            return -1;
+        uint8_t token = *ip++;
+
+        size_t lit = token >> 4;
+        if (lit == RUN_MASK && !get_length(&ip, iend, &lit))
+            return -1;
+        if (lit > (size_t)(iend - ip) || lit > (size_t)(oend - op))
+            return -1;
+        memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+
+        // the last sequence has literals only
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return -1;
+        size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - out))
+            return -1;
+
+        size_t mlen = token & RUN_MASK;
+        if (mlen == RUN_MASK && !get_length(&ip, iend, &mlen))
+            return -1;
+        mlen += MIN_MATCH;
+        if (mlen > (size_t)(oend - op))
+            return -1;
+
+        // byte by byte: the source may overlap what is being written
+        const uint8_t* match = op - offset;
+        for (size_t i = 0; i < mlen; i++)
+            op[i] = match[i];
+        op += mlen;
+    }
+    return (int)(op - out);
+}
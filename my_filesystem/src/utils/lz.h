@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stddef.h>
+
+/*
+    LZ4 block-format codec for file compression (see fs_set_compression).
+
+    The encoder is a greedy single-pass matcher with a small hash table:
+    fast, reentrant, no allocation. Its output is a plain LZ4 block (no
+    frame header), readable by any LZ4 decoder given the original size.
+ */
+
+// matches are searched with a 2^LZ_HASH_BITS entry table on the stack
+#define LZ_HASH_BITS 12
+
+// === PUBLIC FUNCTIONS ===
+
+// compresses n bytes of src into dst; returns the compressed length, or 0
+// when the result would not fit in cap bytes
+size_t lz_compress(const void* src, size_t n, void* dst, size_t cap);
+
+// decompresses an n-byte block into dst; returns the bytes produced, or -1
+// when the block is corrupt or would expand past cap bytes (cap < INT_MAX)
+int lz_decompress(const void* src, size_t n, void* dst, size_t cap);
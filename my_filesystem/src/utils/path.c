@@ -18,6 +18,33 @@ static void remove_trailing_slashes(char* path) {
     }
 }
 
+// checks one component of len bytes (see filename_is_valid)
+static bool name_is_valid(const char* name, size_t len) {
+    if (len == 0 || len >= MAX_FILENAME)
+        return false;
+
+    // disallow "." and ".."
+    if ((len == 1 && name[0] == '.') || (len == 2 && name[0] == '.' && name[1] == '.'))
+        return false;
+
+    // set of banned characters
+    const char* forbidden = "<>:\"'|?*";
+
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = name[i];
+
+        // disallow control chars (NUL included) and the separator
+        if (c < 32 || c == PATH_SEPARATOR)
+            return false;
+
+        // disallow characters in forbidden list
+        if (strchr(forbidden, c))
+            return false;
+    }
+
+    return true;
+}
+
 // === PATH PARSING ===
 
 struct path_components* path_parse(const char* path) {
@@ -39,14 +66,16 @@ struct path_components* path_parse(const char* path) {
     
     // count components (non-empty tokens between separators)
     char temp_count[MAX_PATH];
-    strncpy(temp_count, temp, MAX_PATH - 1);
+    memcpy(temp_count, temp, MAX_PATH);
     
-    char* token = strtok(temp_count, "/");
+    // strtok_r: paths are parsed from several threads at once
+    char* save = NULL;
+    char* token = strtok_r(temp_count, "/", &save);
     int count = 0;
     while (token) {
         if (token[0] != '\0')  // skip empty tokens
             count++;
-        token = strtok(NULL, "/");
+        token = strtok_r(NULL, "/", &save);
     }
     
     if (count == 0) {
@@ -62,7 +91,7 @@ struct path_components* path_parse(const char* path) {
     }
     
     // fill components
-    token = strtok(temp, "/");
+    token = strtok_r(temp, "/", &save);
     int idx = 0;
     while (token) {
         if (token[0] != '\0') {
@@ -77,7 +106,7 @@ struct path_components* path_parse(const char* path) {
             }
             idx++;
         }
-        token = strtok(NULL, "/");
+        token = strtok_r(NULL, "/", &save);
     }
     
     pc->count = count;
@@ -152,6 +181,33 @@ void path_components_free(struct path_components* pc) {
     free(pc);
 }
 
+void path_iter_init(struct path_iter* it, const char* path) {
+    it->pos = path ? path : "";
+}
+
+bool path_iter_next(struct path_iter* it, struct path_token* out) {
+    const char* p = it->pos;
+    while (*p == PATH_SEPARATOR)
+        p++;
+    if (*p == '\0') {
+        it->pos = p;
+        return false;
+    }
+
+    const char* end = p;
+    while (*end && *end != PATH_SEPARATOR)
+        end++;
+
+    out->name = p;
+    out->len = (size_t)(end - p);
+    it->pos = end;
+    return true;
+}
+
+bool path_token_equals(const struct path_token* tok, const char* s) {
+    return strncmp(tok->name, s, tok->len) == 0 && s[tok->len] == '\0';
+}
+
 // === PATH VALIDATION ===
 
 bool path_is_absolute(const char* path) {
@@ -190,57 +246,25 @@ bool path_is_valid(const char* path) {
             return false;
     }
     
-    // parse and validate each component
-    struct path_components* pc = path_parse(path);
-    if (!pc)
-        return false;
-    
-    bool valid = true;
-    for (int i = 0; i < pc->count; i++) {
-        if (!filename_is_valid(pc->components[i]) &&
-            strcmp(pc->components[i], CURRENT_DIR) != 0 &&
-            strcmp(pc->components[i], PARENT_DIR) != 0) {
-            valid = false;
-            break;
-        }
+    // validate each component in place
+    struct path_iter it;
+    struct path_token tok;
+    path_iter_init(&it, path);
+    while (path_iter_next(&it, &tok)) {
+        if (!name_is_valid(tok.name, tok.len) &&
+            !path_token_equals(&tok, CURRENT_DIR) &&
+            !path_token_equals(&tok, PARENT_DIR))
+            return false;
     }
-    
-    path_components_free(pc);
-    return valid;
+
+    return true;
 }
 
 bool filename_is_valid(const char* filename) {
-    if (!filename || filename[0] == '\0')
-        return false;
-
-    size_t len = strlen(filename);
-    if (len >= MAX_FILENAME)
-        return false;
-
-    // disallow "." and ".."
-    if (strcmp(filename, ".") == 0 || strcmp(filename, "..") == 0)
+    if (!filename)
         return false;
 
-    // disallow path separator
-    if (strchr(filename, '/') != NULL)
-        return false;
-
-    // set of banned characters
-    const char* forbidden = "<>:\"'|?*";
-
-    for (size_t i = 0; i < len; i++) {
-        unsigned char c = filename[i];
-
-        // disallow control chars
-        if (c < 32)
-            return false;
-
-        // disallow characters in forbidden list
-        if (strchr(forbidden, c))
-            return false;
-    }
-
-    return true;
+    return name_is_valid(filename, strnlen(filename, MAX_FILENAME));
 }
 
 // === PATH EXTRACTION ===
@@ -311,76 +335,66 @@ char* path_get_dirname(const char* path) {
 // === PATH NORMALIZATION ===
 
 char* path_normalize(const char* path) {
-    if (!path)
-        return NULL;
-    
-    struct path_components* pc = path_parse(path);
-    if (!pc)
+    char* result = malloc(MAX_PATH);
+    if (!result)
         return NULL;
-    
-    // allocate array for normalized components
-    char** normalized = malloc(pc->count * sizeof(char*));
-    if (!normalized) {
-        path_components_free(pc);
+
+    if (path_normalize_into(path, result, MAX_PATH) != SUCCESS) {
+        free(result);
         return NULL;
     }
-    
-    int norm_count = 0;
-    
-    // process each component
-    for (int i = 0; i < pc->count; i++) {
-        if (strcmp(pc->components[i], CURRENT_DIR) == 0) {
-            // skip "."
+    return result;
+}
+
+int path_normalize_into(const char* path, char* out, size_t size) {
+    if (!path || path[0] == '\0' || !out || size < 2)
+        return ERROR_INVALID;
+
+    bool is_absolute = (path[0] == PATH_SEPARATOR);
+    size_t base = is_absolute ? 1 : 0;   // components start here
+    size_t len = base;
+    int depth = 0;                       // components ".." can still remove
+    out[0] = PATH_SEPARATOR;
+
+    struct path_iter it;
+    struct path_token tok;
+    path_iter_init(&it, path);
+    while (path_iter_next(&it, &tok)) {
+        if (path_token_equals(&tok, CURRENT_DIR))
             continue;
-        } else if (strcmp(pc->components[i], PARENT_DIR) == 0) {
-            // go back one level (if possible)
-            if (norm_count > 0 && strcmp(normalized[norm_count - 1], PARENT_DIR) != 0) {
-                free(normalized[norm_count - 1]);
-                norm_count--;
-            } else if (!pc->is_absolute) {
-                // for relative paths, keep ".." if can't go back
-                normalized[norm_count++] = strdup(PARENT_DIR);
+
+        if (path_token_equals(&tok, PARENT_DIR)) {
+            if (depth > 0) {
+                // drop the last component, and its separator
+                while (len > base && out[len - 1] != PATH_SEPARATOR)
+                    len--;
+                if (len > base)
+                    len--;
+                depth--;
+                continue;
             }
             // for absolute paths, ignore ".." at root
+            if (is_absolute)
+                continue;
         } else {
-            // normal component
-            normalized[norm_count++] = strdup(pc->components[i]);
-        }
-    }
-    
-    // build result path
-    char* result = malloc(MAX_PATH);
-    if (!result) {
-        for (int i = 0; i < norm_count; i++)
-            free(normalized[i]);
-        free(normalized);
-        path_components_free(pc);
-        return NULL;
-    }
-    
-    result[0] = '\0';
-    
-    if (pc->is_absolute) {
-        strcpy(result, "/");
-    }
-    
-    for (int i = 0; i < norm_count; i++) {
-        if (i > 0) {
-            strcat(result, "/");
+            depth++;
         }
-        strcat(result, normalized[i]);
-        free(normalized[i]);
+
+        // ".." that can't go back is kept for relative paths
+        size_t sep = (len > base) ? 1 : 0;
+        if (len + sep + tok.len >= size)
+            return ERROR_NO_SPACE;
+        if (sep)
+            out[len++] = PATH_SEPARATOR;
+        memcpy(out + len, tok.name, tok.len);
+        len += tok.len;
     }
-    
+
     // handle empty result
-    if (result[0] == '\0') {
-        strcpy(result, pc->is_absolute ? "/" : ".");
-    }
-    
-    free(normalized);
-    path_components_free(pc);
-    
-    return result;
+    if (len == 0)
+        out[len++] = '.';
+    out[len] = '\0';
+    return SUCCESS;
 }
 
 // === UTILITY FUNCTIONS ===
@@ -406,16 +420,16 @@ void path_print_components(const struct path_components* pc) {
 }
 
 int path_depth(const char* path) {
-    if (!path)
-        return -1;
-    
-    struct path_components* pc = path_parse(path);
-    if (!pc)
+    if (!path || path[0] == '\0')
         return -1;
-    
-    int depth = pc->count;
-    path_components_free(pc);
-    
+
+    struct path_iter it;
+    struct path_token tok;
+    int depth = 0;
+    path_iter_init(&it, path);
+    while (path_iter_next(&it, &tok))
+        depth++;
+
     return depth;
 }
 
@@ -424,18 +438,15 @@ bool path_starts_with(const char* path, const char* prefix) {
         return false;
     
     // normalize both paths first
-    char* norm_path = path_normalize(path);
-    char* norm_prefix = path_normalize(prefix);
-    
-    if (!norm_path || !norm_prefix) {
-        free(norm_path);
-        free(norm_prefix);
+    char norm_path[MAX_PATH];
+    char norm_prefix[MAX_PATH];
+    if (path_normalize_into(path, norm_path, sizeof(norm_path)) != SUCCESS ||
+        path_normalize_into(prefix, norm_prefix, sizeof(norm_prefix)) != SUCCESS)
         return false;
-    }
-    
+
     size_t prefix_len = strlen(norm_prefix);
     bool result = (strncmp(norm_path, norm_prefix, prefix_len) == 0);
-    
+
     // if prefix doesn't end with '/', ensure path has '/' after prefix
     if (result && prefix_len < strlen(norm_path)) {
         if (norm_prefix[prefix_len - 1] != PATH_SEPARATOR &&
@@ -443,10 +454,7 @@ bool path_starts_with(const char* path, const char* prefix) {
             result = false;
         }
     }
-    
-    free(norm_path);
-    free(norm_prefix);
-    
+
     return result;
 }
 
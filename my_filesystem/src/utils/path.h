@@ -15,6 +15,20 @@ struct path_components {
     bool is_absolute;       // true if it starts with /
 };
 
+// === COMPONENT VIEWS ===
+
+// one path component, viewed in place in the path (not NUL-terminated)
+struct path_token {
+    const char* name;
+    size_t len;
+};
+
+// walks the components of a path without copying or allocating; the path
+// must outlive the iterator
+struct path_iter {
+    const char* pos;
+};
+
 // === PUBLIC FUNCTIONS ===
 
 // path parsing
@@ -22,6 +36,12 @@ struct path_components* path_parse(const char* path);
 int path_split(const char* path, char* parent, char* filename);
 void path_components_free(struct path_components* pc);
 
+// allocation-free tokenizer: empty components ("//") are skipped, "." and
+// ".." are returned like any other name
+void path_iter_init(struct path_iter* it, const char* path);
+bool path_iter_next(struct path_iter* it, struct path_token* out);
+bool path_token_equals(const struct path_token* tok, const char* s);
+
 // validation
 bool path_is_absolute(const char* path);
 bool path_is_root(const char* path);
@@ -34,6 +54,9 @@ char* path_get_dirname(const char* path);
 
 // path normalization
 char* path_normalize(const char* path);
+// same result written to out (size bytes); ERROR_INVALID on an empty path,
+// ERROR_NO_SPACE when it does not fit
+int path_normalize_into(const char* path, char* out, size_t size);
 
 // utility functions
 void path_print_components(const struct path_components* pc);
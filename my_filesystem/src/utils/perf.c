@@ -0,0 +1,174 @@
+#include "perf.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// === STORAGE ===
+
+uint64_t perf_counters[PERF_NUM_COUNTERS];
+static struct perf_op_stats perf_ops[PERF_NUM_OPS];
+
+static const char* const counter_names[PERF_NUM_COUNTERS] = {
+    [PERF_DISK_BLOCKS_READ]      = "disk_blocks_read",
+    [PERF_DISK_BLOCKS_WRITTEN]   = "disk_blocks_written",
+    [PERF_DISK_BLOCKS_BORROWED]  = "disk_blocks_borrowed",
+    [PERF_DISK_SYNCS]            = "disk_syncs",
+    [PERF_SUPERBLOCK_READS]      = "superblock_reads",
+    [PERF_SUPERBLOCK_WRITES]     = "superblock_writes",
+    [PERF_INODE_READS]           = "inode_reads",
+    [PERF_INODE_WRITES]          = "inode_writes",
+    [PERF_INODE_TABLE_LOADS]     = "inode_table_loads",
+    [PERF_INODE_TABLE_STORES]    = "inode_table_stores",
+    [PERF_DENTRY_BLOCKS_SCANNED] = "dentry_blocks_scanned",
+    [PERF_BITMAP_BITS_SCANNED]   = "bitmap_bits_scanned",
+    [PERF_PATH_COMPONENTS]       = "path_components",
+};
+
+static const char* const op_names[PERF_NUM_OPS] = {
+    [PERF_OP_OPEN]      = "open",
+    [PERF_OP_CLOSE]     = "close",
+    [PERF_OP_READ]      = "read",
+    [PERF_OP_WRITE]     = "write",
+    [PERF_OP_PREAD]     = "pread",
+    [PERF_OP_PWRITE]    = "pwrite",
+    [PERF_OP_FSYNC]     = "fsync",
+    [PERF_OP_TRUNCATE]  = "truncate",
+    [PERF_OP_FALLOCATE] = "fallocate",
+    [PERF_OP_CREATE]    = "create",
+    [PERF_OP_UNLINK]    = "unlink",
+    [PERF_OP_LINK]      = "link",
+    [PERF_OP_MKDIR]     = "mkdir",
+    [PERF_OP_RMDIR]     = "rmdir",
+    [PERF_OP_LIST]      = "list",
+    [PERF_OP_READDIR]   = "readdir",
+    [PERF_OP_STAT]      = "stat",
+    [PERF_OP_CD]        = "cd",
+    [PERF_OP_SYNC]      = "sync",
+    [PERF_OP_CLONE]     = "clone",
+};
+
+// === HOOKS ===
+
+#ifdef FS_PERF
+
+uint64_t perf_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void perf_timer_stop(struct perf_timer* t) {
+    uint64_t ns = perf_now_ns() - t->start_ns;
+    struct perf_op_stats* s = &perf_ops[t->op];
+
+    // floor(log2(ns)), with 0 and 1 ns both in bucket 0
+    unsigned bucket = ns > 1 ? 63 - (unsigned)__builtin_clzll(ns) : 0;
+    if (bucket >= PERF_HIST_BUCKETS)
+        bucket = PERF_HIST_BUCKETS - 1;
+
+    __atomic_fetch_add(&s->calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->total_ns, ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s->hist[bucket], 1, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n(&s->max_ns, __ATOMIC_RELAXED);
+    while (ns > max &&
+           !__atomic_compare_exchange_n(&s->max_ns, &max, ns, true,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+#endif
+
+// === PUBLIC FUNCTIONS ===
+
+bool perf_enabled(void) {
+#ifdef FS_PERF
+    return true;
+#else
+    return false;
+#endif
+}
+
+// the per-operation stats are nothing but uint64_t fields
+#define OP_WORDS (sizeof(perf_ops) / (sizeof(uint64_t)))
+
+static void load_all(uint64_t* dst, uint64_t* src, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+}
+
+static void clear_all(uint64_t* words, size_t n) {
+    for (size_t i = 0; i < n; i++)
+        __atomic_store_n(&words[i], 0, __ATOMIC_RELAXED);
+}
+
+void perf_snapshot(struct perf_stats* out) {
+    if (!out)
+        return;
+
+    load_all(out->counters, perf_counters, PERF_NUM_COUNTERS);
+    load_all((uint64_t*)out->ops, (uint64_t*)perf_ops, OP_WORDS);
+}
+
+void perf_reset(void) {
+    clear_all(perf_counters, PERF_NUM_COUNTERS);
+    clear_all((uint64_t*)perf_ops, OP_WORDS);
+}
+
+const char* perf_counter_name(enum perf_counter c) {
+    return ((unsigned)c < PERF_NUM_COUNTERS) ? counter_names[c] : "unknown";
+}
+
+const char* perf_op_name(enum perf_op op) {
+    return ((unsigned)op < PERF_NUM_OPS) ? op_names[op] : "unknown";
+}
+
+uint64_t perf_op_percentile(const struct perf_op_stats* op, unsigned pct) {
+    if (!op || op->calls == 0)
+        return 0;
+
+    uint64_t rank = (op->calls * pct + 99) / 100;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < PERF_HIST_BUCKETS; i++) {
+        seen += op->hist[i];
+        if (seen >= rank && seen > 0) {
+            // no sample is above the largest one seen
+            uint64_t bound = (i + 1 < PERF_HIST_BUCKETS) ? (2ull << i) : op->max_ns;
+            return bound < op->max_ns ? bound : op->max_ns;
+        }
+    }
+    return op->max_ns;
+}
+
+void perf_print(const struct perf_stats* stats) {
+    if (!stats)
+        return;
+
+    if (!perf_enabled()) {
+        printf("Performance counters: not compiled in (build with FS_PERF=1)\n");
+        return;
+    }
+
+    printf("Counters:\n");
+    bool any = false;
+    for (int c = 0; c < PERF_NUM_COUNTERS; c++) {
+        if (stats->counters[c]) {
+            printf("  %-22s: %llu\n", counter_names[c], (unsigned long long)stats->counters[c]);
+            any = true;
+        }
+    }
+    if (!any)
+        printf("  (none)\n");
+
+    printf("Latency (ns)        calls        avg        p50        p99        max\n");
+    for (int i = 0; i < PERF_NUM_OPS; i++) {
+        const struct perf_op_stats* s = &stats->ops[i];
+        if (s->calls == 0)
+            continue;
+        printf("  %-12s %12llu %10llu %10llu %10llu %10llu\n", op_names[i],
+               (unsigned long long)s->calls, (unsigned long long)(s->total_ns / s->calls),
+               (unsigned long long)perf_op_percentile(s, 50),
+               (unsigned long long)perf_op_percentile(s, 99),
+               (unsigned long long)s->max_ns);
+    }
+}
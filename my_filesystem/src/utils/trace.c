@@ -0,0 +1,235 @@
+#include "trace.h"
+#include "common.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define RING_MASK (TRACE_RING_SIZE - 1)
+
+_Static_assert((TRACE_RING_SIZE & RING_MASK) == 0, "TRACE_RING_SIZE must be a power of two");
+
+// === STORAGE ===
+
+static struct trace_event ring[TRACE_RING_SIZE];
+static uint64_t ring_head;           // events ever claimed since the last clear
+static bool enabled;
+
+// === HOOKS ===
+
+#ifdef FS_TRACE
+
+__thread uint64_t trace_thread_blocks;
+
+static __thread uint16_t thread_number;
+static uint16_t next_thread_number;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// copies the last TRACE_PATH_LEN - 1 bytes of path, NUL-terminated
+static void copy_path_tail(char* dst, const char* path) {
+    if (!path) {
+        dst[0] = '\0';
+        return;
+    }
+    size_t len = strlen(path);
+    if (len >= TRACE_PATH_LEN)
+        path += len - (TRACE_PATH_LEN - 1);
+    strncpy(dst, path, TRACE_PATH_LEN - 1);
+    dst[TRACE_PATH_LEN - 1] = '\0';
+}
+
+void trace_span_begin(struct trace_span* s, enum perf_op op, const char* path) {
+    s->active = __atomic_load_n(&enabled, __ATOMIC_RELAXED);
+    if (!s->active)
+        return;
+
+    s->op = op;
+    s->path = path;
+    s->inode_num = TRACE_NO_INODE;
+    s->bytes = 0;
+    s->start_blocks = trace_thread_blocks;
+    s->start_ns = now_ns();
+}
+
+void trace_span_end(struct trace_span* s) {
+    if (!s->active)
+        return;
+
+    uint64_t end_ns = now_ns();
+    if (thread_number == 0)
+        thread_number = __atomic_add_fetch(&next_thread_number, 1, __ATOMIC_RELAXED);
+
+    uint64_t idx = __atomic_fetch_add(&ring_head, 1, __ATOMIC_RELAXED);
+    struct trace_event* e = &ring[idx & RING_MASK];
+
+    // a zero sequence marks the slot as being rewritten for readers
+    __atomic_store_n(&e->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    e->start_ns = s->start_ns;
+    e->duration_ns = end_ns - s->start_ns;
+    e->bytes = s->bytes;
+    e->inode_num = s->inode_num;
+    e->blocks = (uint32_t)(trace_thread_blocks - s->start_blocks);
+    e->op = (uint16_t)s->op;
+    e->thread = thread_number;
+    e->reserved = 0;
+    copy_path_tail(e->path, s->path);
+
+    __atomic_store_n(&e->seq, idx + 1, __ATOMIC_RELEASE);
+}
+
+#endif
+
+// === PUBLIC FUNCTIONS ===
+
+bool trace_compiled(void) {
+#ifdef FS_TRACE
+    return true;
+#else
+    return false;
+#endif
+}
+
+void trace_enable(bool on) {
+    __atomic_store_n(&enabled, on && trace_compiled(), __ATOMIC_RELAXED);
+}
+
+bool trace_is_enabled(void) {
+    return __atomic_load_n(&enabled, __ATOMIC_RELAXED);
+}
+
+void trace_clear(void) {
+    // writers still running may land one event in the cleared ring
+    for (size_t i = 0; i < TRACE_RING_SIZE; i++)
+        __atomic_store_n(&ring[i].seq, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&ring_head, 0, __ATOMIC_RELEASE);
+}
+
+size_t trace_snapshot(struct trace_event* out, size_t max) {
+    if (!out || max == 0)
+        return 0;
+
+    uint64_t head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+    uint64_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+    if (head - first > max)
+        first = head - max;
+
+    size_t n = 0;
+    for (uint64_t idx = first; idx < head; idx++) {
+        const struct trace_event* e = &ring[idx & RING_MASK];
+
+        // seqlock-style read: keep the copy only if nobody touched the slot
+        uint64_t seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+        if (seq != idx + 1)
+            continue;
+        memcpy(&out[n], e, sizeof(*e));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&e->seq, __ATOMIC_RELAXED) != seq)
+            continue;
+        out[n].seq = seq;
+        n++;
+    }
+    return n;
+}
+
+int trace_save(const char* path) {
+    if (!path)
+        return ERROR_INVALID;
+
+    struct trace_event* events = malloc(sizeof(struct trace_event) * TRACE_RING_SIZE);
+    if (!events)
+        return ERROR_NO_SPACE;
+    size_t count = trace_snapshot(events, TRACE_RING_SIZE);
+
+    struct trace_file_header hdr = { 0 };
+    memcpy(hdr.magic, TRACE_FILE_MAGIC, sizeof(TRACE_FILE_MAGIC));
+    hdr.version = TRACE_FILE_VERSION;
+    hdr.event_size = sizeof(struct trace_event);
+    hdr.count = count;
+
+    int res = ERROR_IO;
+    FILE* f = fopen(path, "wb");
+    if (!f)
+        goto cleanup;
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+        fwrite(events, sizeof(struct trace_event), count, f) != count) {
+        fclose(f);
+        goto cleanup;
+    }
+    if (fclose(f) == 0)
+        res = SUCCESS;
+
+cleanup:
+    free(events);
+    return res;
+}
+
+int trace_load(const char* path, struct trace_event** out_events, size_t* out_count) {
+    if (!path || !out_events || !out_count)
+        return ERROR_INVALID;
+
+    FILE* f = fopen(path, "rb");
+    if (!f)
+        return ERROR_IO;
+
+    int res = ERROR_INVALID;
+    struct trace_event* events = NULL;
+    struct trace_file_header hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1)
+        goto cleanup;
+    if (memcmp(hdr.magic, TRACE_FILE_MAGIC, sizeof(TRACE_FILE_MAGIC)) != 0 ||
+        hdr.version != TRACE_FILE_VERSION ||
+        hdr.event_size != sizeof(struct trace_event) ||
+        hdr.count > TRACE_RING_SIZE)
+        goto cleanup;
+
+    // calloc(0) may return NULL: always ask for at least one event
+    events = calloc(hdr.count ? hdr.count : 1, sizeof(struct trace_event));
+    if (!events) {
+        res = ERROR_NO_SPACE;
+        goto cleanup;
+    }
+    if (fread(events, sizeof(struct trace_event), hdr.count, f) != hdr.count) {
+        res = ERROR_IO;
+        goto cleanup;
+    }
+
+    *out_events = events;
+    *out_count = (size_t)hdr.count;
+    events = NULL;
+    res = SUCCESS;
+
+cleanup:
+    free(events);
+    fclose(f);
+    return res;
+}
+
+void trace_print(FILE* out, const struct trace_event* events, size_t count) {
+    if (!out || (!events && count > 0))
+        return;
+
+    fprintf(out, "%8s %12s %3s %-10s %10s %8s %10s %6s  %s\n",
+            "seq", "start_us", "thr", "op", "dur_ns", "inode", "bytes", "blocks", "path");
+    uint64_t base = UINT64_MAX;
+    for (size_t i = 0; i < count; i++)
+        if (events[i].start_ns < base)
+            base = events[i].start_ns;
+
+    for (size_t i = 0; i < count; i++) {
+        const struct trace_event* e = &events[i];
+        char inode[16] = "-";
+        if (e->inode_num != TRACE_NO_INODE)
+            snprintf(inode, sizeof(inode), "%u", e->inode_num);
+        fprintf(out, "%8llu %12.3f %3u %-10s %10llu %8s %10llu %6u  %s\n",
+                (unsigned long long)e->seq, (double)(int64_t)(e->start_ns - base) / 1000.0,
+                e->thread, perf_op_name((enum perf_op)e->op),
+                (unsigned long long)e->duration_ns, inode,
+                (unsigned long long)e->bytes, e->blocks, e->path[0] ? e->path : "-");
+    }
+}
@@ -4,8 +4,34 @@
 
 #include "bitmap.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
+// === SCALAR REFERENCES (bit by bit, via bitmap_get) ===
+
+static int ref_find_next_free(const struct bitmap* bmp, size_t start) {
+    for (size_t i = start; i < bmp->size_bits; i++) {
+        if (!bitmap_get(bmp, i)) return (int)i;
+    }
+    return ERROR_NOT_FOUND;
+}
+
+static int ref_find_first_used(const struct bitmap* bmp) {
+    for (size_t i = 0; i < bmp->size_bits; i++) {
+        if (bitmap_get(bmp, i)) return (int)i;
+    }
+    return ERROR_NOT_FOUND;
+}
+
+static int ref_count_used(const struct bitmap* bmp) {
+    int count = 0;
+    for (size_t i = 0; i < bmp->size_bits; i++) {
+        if (bitmap_get(bmp, i)) count++;
+    }
+    return count;
+}
+
 void test_create_destroy() {
     printf("Test: create and destroy... ");
     
@@ -108,6 +134,290 @@ void test_range_operations() {
     printf("OK\n");
 }
 
+void test_dirty_tracking() {
+    printf("Test: dirty chunk tracking... ");
+    
+    // 3 chunks of BITMAP_CHUNK_BYTES bytes
+    size_t bits = 3 * BITMAP_CHUNK_BYTES * 8;
+    struct bitmap* bmp = bitmap_create(bits);
+    assert(bitmap_chunk_count(bmp) == 3);
+    
+    // new bitmaps were never persisted
+    assert(bitmap_is_dirty(bmp));
+    assert(bitmap_chunk_is_dirty(bmp, 0) && bitmap_chunk_is_dirty(bmp, 2));
+    
+    bitmap_clear_dirty(bmp);
+    assert(!bitmap_is_dirty(bmp));
+    
+    // one bit only dirties its own chunk
+    bitmap_set(bmp, BITMAP_CHUNK_BYTES * 8 + 5);
+    assert(!bitmap_chunk_is_dirty(bmp, 0));
+    assert(bitmap_chunk_is_dirty(bmp, 1));
+    assert(!bitmap_chunk_is_dirty(bmp, 2));
+    
+    // ranges dirty every chunk they touch
+    bitmap_clear_dirty(bmp);
+    bitmap_clear_range(bmp, BITMAP_CHUNK_BYTES * 8 - 1, 2);
+    assert(bitmap_chunk_is_dirty(bmp, 0) && bitmap_chunk_is_dirty(bmp, 1));
+    assert(!bitmap_chunk_is_dirty(bmp, 2));
+    
+    // out of range chunk
+    assert(!bitmap_chunk_is_dirty(bmp, 3));
+    
+    bitmap_destroy(&bmp);
+    printf("OK\n");
+}
+
+void test_word_kernels_match_reference() {
+    printf("Test: word kernels vs scalar reference... ");
+    
+    // sizes around word and byte boundaries
+    const size_t sizes[] = { 1, 7, 8, 63, 64, 65, 127, 128, 200, 1000, 4097 };
+    srand(12345);
+    
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t n = sizes[s];
+        struct bitmap* bmp = bitmap_create(n);
+        
+        // densities from empty to full
+        for (int density = 0; density <= 100; density += 25) {
+            bitmap_clear_all(bmp);
+            for (size_t i = 0; i < n; i++) {
+                if (rand() % 100 < density) bitmap_set(bmp, i);
+            }
+            
+            assert(bitmap_count_used(bmp) == ref_count_used(bmp));
+            assert(bitmap_count_free(bmp) == (int)n - ref_count_used(bmp));
+            assert(bitmap_find_first_used(bmp) == ref_find_first_used(bmp));
+            for (size_t start = 0; start < n; start += 1 + n / 37) {
+                assert(bitmap_find_next_free(bmp, start) == ref_find_next_free(bmp, start));
+            }
+        }
+        
+        // full bitmap: no free bit, even in the padding of the last word
+        bitmap_set_all(bmp);
+        assert(bitmap_find_next_free(bmp, 0) == ERROR_NOT_FOUND);
+        assert(bitmap_count_free(bmp) == 0);
+        
+        // ranges crossing byte and word boundaries
+        if (n > 10) {
+            bitmap_clear_all(bmp);
+            size_t start = 3, count = n - 6;
+            assert(bitmap_set_range(bmp, start, count) == SUCCESS);
+            for (size_t i = 0; i < n; i++) {
+                assert(bitmap_get(bmp, i) == (i >= start && i < start + count));
+            }
+            assert(bitmap_clear_range(bmp, start + 1, count - 2) == SUCCESS);
+            assert(bitmap_count_used(bmp) == 2);
+        }
+        
+        bitmap_destroy(&bmp);
+    }
+    
+    printf("OK\n");
+}
+
+void test_summary_on_full_bitmap() {
+    printf("Test: free-space summary on a nearly full bitmap... ");
+    
+    // spans several summary_l2 words (4096 bits per summary_l1 word)
+    size_t n = 300000;
+    struct bitmap* bmp = bitmap_create(n);
+    bitmap_set_all(bmp);
+    assert(bitmap_find_first_free(bmp) == ERROR_NOT_FOUND);
+    assert(bitmap_count_free(bmp) == 0);
+    
+    // a few holes far apart
+    size_t holes[] = { 5, 4095, 4096, 70000, 262143, 262144, 299999 };
+    size_t num_holes = sizeof(holes) / sizeof(holes[0]);
+    for (size_t i = 0; i < num_holes; i++) {
+        bitmap_clear(bmp, holes[i]);
+    }
+    assert(bitmap_count_free(bmp) == (int)num_holes);
+    
+    // each search lands on the next hole
+    size_t pos = 0;
+    for (size_t i = 0; i < num_holes; i++) {
+        int found = bitmap_find_next_free(bmp, pos);
+        assert(found == (int)holes[i]);
+        pos = (size_t)found + 1;
+    }
+    assert(bitmap_find_next_free(bmp, pos) == ERROR_NOT_FOUND);
+    
+    // refilling a hole updates the summary
+    bitmap_set(bmp, 70000);
+    assert(bitmap_find_next_free(bmp, 4097) == 262143);
+    
+    // random churn against the scalar reference
+    srand(777);
+    for (int round = 0; round < 2000; round++) {
+        size_t bit = (size_t)rand() % n;
+        if (rand() % 2) bitmap_set(bmp, bit);
+        else bitmap_clear(bmp, bit);
+        if (round % 50 == 0) {
+            size_t r = (size_t)rand() % (n - 5000);
+            bitmap_set_range(bmp, r, 1 + rand() % 5000);
+        }
+        if (round % 100 == 0) {
+            size_t start = (size_t)rand() % n;
+            assert(bitmap_find_next_free(bmp, start) == ref_find_next_free(bmp, start));
+        }
+    }
+    assert(bitmap_count_used(bmp) == ref_count_used(bmp));
+    
+    bitmap_destroy(&bmp);
+    printf("OK\n");
+}
+
+void test_find_free_run() {
+    printf("Test: find free run... ");
+    
+    struct bitmap* bmp = bitmap_create(300);
+    bitmap_set_range(bmp, 0, 300);
+    
+    // holes of 3, 10 and 70 bits
+    bitmap_clear_range(bmp, 20, 3);
+    bitmap_clear_range(bmp, 60, 10);
+    bitmap_clear_range(bmp, 200, 70);
+    
+    assert(bitmap_find_free_run(bmp, 0, 1) == 20);
+    assert(bitmap_find_free_run(bmp, 0, 3) == 20);
+    assert(bitmap_find_free_run(bmp, 0, 4) == 60);
+    assert(bitmap_find_free_run(bmp, 0, 11) == 200);
+    assert(bitmap_find_free_run(bmp, 21, 2) == 21);
+    assert(bitmap_find_free_run(bmp, 65, 5) == 65);
+    assert(bitmap_find_free_run(bmp, 65, 6) == 200);
+    assert(bitmap_find_free_run(bmp, 0, 70) == 200);
+    assert(bitmap_find_free_run(bmp, 0, 71) == ERROR_NOT_FOUND);
+    assert(bitmap_find_free_run(bmp, 250, 30) == ERROR_NOT_FOUND);
+    
+    // run reaching the end of the bitmap
+    bitmap_clear_range(bmp, 290, 10);
+    assert(bitmap_find_free_run(bmp, 280, 10) == 290);
+    assert(bitmap_find_next_used(bmp, 290) == ERROR_NOT_FOUND);
+    assert(bitmap_find_next_used(bmp, 200) == 270);
+    
+    bitmap_destroy(&bmp);
+    printf("OK\n");
+}
+
+void test_load_bytes() {
+    printf("Test: load bytes rebuilds summary... ");
+    
+    struct bitmap* bmp = bitmap_create(100);
+    uint8_t raw[13];
+    memset(raw, 0xFF, sizeof(raw));
+    raw[5] = 0xF7;  // bit 43 free
+    
+    assert(bitmap_load_bytes(bmp, raw, sizeof(raw)) == SUCCESS);
+    assert(bitmap_count_free(bmp) == 1);
+    assert(bitmap_find_first_free(bmp) == 43);
+    
+    bitmap_destroy(&bmp);
+    printf("OK\n");
+}
+
+void test_bounded_searches() {
+    printf("Test: bounded searches... ");
+    
+    struct bitmap* bmp = bitmap_create(500);
+    bitmap_set_range(bmp, 0, 500);
+    bitmap_clear_range(bmp, 100, 5);
+    bitmap_clear_range(bmp, 300, 50);
+    
+    assert(bitmap_find_next_free_in(bmp, 0, 100) == ERROR_NOT_FOUND);
+    assert(bitmap_find_next_free_in(bmp, 0, 101) == 100);
+    assert(bitmap_find_next_free_in(bmp, 105, 300) == ERROR_NOT_FOUND);
+    assert(bitmap_find_next_used_in(bmp, 300, 350) == ERROR_NOT_FOUND);
+    assert(bitmap_find_next_used_in(bmp, 300, 351) == 350);
+    
+    // a run may not cross the end of the range
+    assert(bitmap_find_free_run_in(bmp, 0, 320, 10) == 300);
+    assert(bitmap_find_free_run_in(bmp, 0, 305, 10) == ERROR_NOT_FOUND);
+    assert(bitmap_find_free_run_in(bmp, 0, 500, 10) == 300);
+    
+    assert(bitmap_count_used_in(bmp, 0, 500) == 500 - 55);
+    assert(bitmap_count_used_in(bmp, 90, 110) == 15);
+    assert(bitmap_count_used_in(bmp, 320, 400) == 50);
+    assert(bitmap_count_used_in(bmp, 200, 200) == 0);
+    
+    bitmap_destroy(&bmp);
+    printf("OK\n");
+}
+
+void test_create_from_memory() {
+    printf("Test: bitmap over caller memory... ");
+
+    uint8_t raw[64];
+    memset(raw, 0, sizeof(raw));
+    raw[0] = 0x0F;                  // bits 0-3 used
+    raw[10] = 0x80;                 // bit 87 used
+
+    struct bitmap* bmp = bitmap_create_from_memory(raw, 500);
+    assert(bmp != NULL && bmp->data == raw);
+    assert(bitmap_count_used(bmp) == 5);
+    assert(bitmap_find_first_free(bmp) == 4);
+    assert(!bitmap_is_dirty(bmp));
+
+    // changes land in the caller's bytes and are tracked
+    assert(bitmap_set_range(bmp, 4, 4) == SUCCESS);
+    assert(raw[0] == 0xFF);
+    assert(bitmap_clear(bmp, 87) == SUCCESS);
+    assert(raw[10] == 0);
+    assert(bitmap_is_dirty(bmp) && bitmap_chunk_is_dirty(bmp, 0));
+    bitmap_clear_dirty(bmp);
+    assert(!bitmap_is_dirty(bmp));
+
+    // the memory outlives the bitmap
+    bitmap_destroy(&bmp);
+    assert(bmp == NULL && raw[0] == 0xFF);
+
+    assert(bitmap_create_from_memory(NULL, 10) == NULL);
+    assert(bitmap_create_from_memory(raw, 0) == NULL);
+    printf("OK\n");
+}
+
+void test_grow() {
+    printf("Test: grow keeps bits and adds free ones... ");
+
+    struct bitmap* bmp = bitmap_create(5003);
+    bitmap_set_range(bmp, 0, 5003);
+    bitmap_clear(bmp, 500);
+    bitmap_clear_dirty(bmp);
+
+    // stray bits past the end of the last byte must not become used
+    bmp->data[bmp->size_bytes - 1] = 0xFF;
+    assert(bitmap_grow(bmp, 20000) == SUCCESS);
+    assert(bmp->size_bits == 20000);
+    assert(bitmap_count_used(bmp) == 5002);
+    assert(bitmap_find_first_free(bmp) == 500);
+    assert(bitmap_find_next_free(bmp, 501) == 5003);
+    assert(bitmap_find_free_run(bmp, 0, 14000) == 5003);
+
+    // the chunk holding the old end and every new one must be written
+    assert(!bitmap_chunk_is_dirty(bmp, 0));
+    for (size_t c = 5003 / 8 / BITMAP_CHUNK_BYTES; c < bitmap_chunk_count(bmp); c++)
+        assert(bitmap_chunk_is_dirty(bmp, c));
+
+    // the summary covers the new words
+    bitmap_set_range(bmp, 5003, 20000 - 5003);
+    assert(bitmap_find_first_free(bmp) == 500);
+    bitmap_set(bmp, 500);
+    assert(bitmap_find_first_free(bmp) == ERROR_NOT_FOUND);
+
+    assert(bitmap_grow(bmp, 20000) == SUCCESS);
+    assert(bitmap_grow(bmp, 50) == ERROR_INVALID);
+
+    // caller memory cannot be extended
+    uint8_t raw[16] = { 0 };
+    struct bitmap* mapped = bitmap_create_from_memory(raw, 128);
+    assert(bitmap_grow(mapped, 256) == ERROR_INVALID);
+
+    bitmap_destroy(&mapped);
+    bitmap_destroy(&bmp);
+    printf("OK\n");
+}
+
 int main() {
     printf("=== Bitmap Tests ===\n\n");
     
@@ -116,6 +426,14 @@ int main() {
     test_find_operations();
     test_count();
     test_range_operations();
+    test_dirty_tracking();
+    test_word_kernels_match_reference();
+    test_summary_on_full_bitmap();
+    test_find_free_run();
+    test_load_bytes();
+    test_bounded_searches();
+    test_create_from_memory();
+    test_grow();
     
     printf("\nAll bitmap tests pass!\n");
     return 0;
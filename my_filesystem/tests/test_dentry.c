@@ -7,11 +7,22 @@
 #include "bitmap.h"
 #include "inode.h"
 #include "superblock.h"
+#include "fs.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
 
+// builds a minimal filesystem context around a freshly initialized superblock
+static void setup_fs(filesystem_t* fs, disk_t disk, const struct superblock* sb,
+                     struct bitmap* inode_bmp, struct bitmap* block_bmp) {
+    memset(fs, 0, sizeof(*fs));
+    fs->disk = disk;
+    fs->sb = *sb;
+    fs->inode_bitmap = inode_bmp;
+    fs->block_bitmap = block_bmp;
+}
+
 void test_dentry_create() {
     printf("Test: dentry create... ");
     
@@ -59,18 +70,20 @@ void test_dentry_find() {
     
     struct bitmap* inode_bmp = bitmap_create(256);
     struct bitmap* block_bmp = bitmap_create(2048);
+    filesystem_t fs;
+    setup_fs(&fs, disk, &sb, inode_bmp, block_bmp);
     
     // create directory inode
     struct inode dir;
     uint32_t dir_inode_num;
-    inode_alloc(disk, inode_bmp, INODE_TYPE_DIRECTORY, 0755, &dir, &dir_inode_num);
+    inode_alloc(&fs, INODE_TYPE_DIRECTORY, 0755, &dir, &dir_inode_num);
     
     // allocate one block for directory
     int block = bitmap_find_first_free(block_bmp);
     bitmap_set(block_bmp, block);
     dir.direct[0] = block;
     dir.blocks_used = 1;
-    inode_write(disk, dir_inode_num, &dir);
+    inode_write(&fs, dir_inode_num, &dir);
     
     // write some dentries
     char buffer[BLOCK_SIZE];
@@ -83,11 +96,11 @@ void test_dentry_find() {
     
     // find existing
     struct dentry found;
-    assert(dentry_find(disk, dir_inode_num, "file1.txt", &found, NULL) == SUCCESS);
+    assert(dentry_find(&fs, dir_inode_num, "file1.txt", &found, NULL) == SUCCESS);
     assert(found.inode_num == 10);
     
     // find non-existing
-    assert(dentry_find(disk, dir_inode_num, "nonexistent", &found, NULL) == ERROR_NOT_FOUND);
+    assert(dentry_find(&fs, dir_inode_num, "nonexistent", &found, NULL) == ERROR_NOT_FOUND);
     
     bitmap_destroy(&inode_bmp);
     bitmap_destroy(&block_bmp);
@@ -107,18 +120,20 @@ void test_dentry_add() {
     
     struct bitmap* inode_bmp = bitmap_create(256);
     struct bitmap* block_bmp = bitmap_create(2048);
+    filesystem_t fs;
+    setup_fs(&fs, disk, &sb, inode_bmp, block_bmp);
     
     // create directory
     struct inode dir;
     uint32_t dir_inode_num;
-    inode_alloc(disk, inode_bmp, INODE_TYPE_DIRECTORY, 0755, &dir, &dir_inode_num);
+    inode_alloc(&fs, INODE_TYPE_DIRECTORY, 0755, &dir, &dir_inode_num);
     
     // allocate block for directory
     int block = bitmap_find_first_free(block_bmp);
     bitmap_set(block_bmp, block);
     dir.direct[0] = block;
     dir.blocks_used = 1;
-    inode_write(disk, dir_inode_num, &dir);
+    inode_write(&fs, dir_inode_num, &dir);
     
     // initialize block
     char buffer[BLOCK_SIZE];
@@ -128,11 +143,11 @@ void test_dentry_add() {
     // add dentry
     struct dentry new_entry;
     dentry_create("newfile.txt", 20, INODE_TYPE_FILE, &new_entry);
-    assert(dentry_add(disk, dir_inode_num, &new_entry, block_bmp) == SUCCESS);
+    assert(dentry_add(&fs, dir_inode_num, &new_entry, NULL) == SUCCESS);
     
     // verify it exists
     struct dentry found;
-    assert(dentry_find(disk, dir_inode_num, "newfile.txt", &found, NULL) == SUCCESS);
+    assert(dentry_find(&fs, dir_inode_num, "newfile.txt", &found, NULL) == SUCCESS);
     assert(found.inode_num == 20);
     
     bitmap_destroy(&inode_bmp);
@@ -153,17 +168,19 @@ void test_dentry_remove() {
     
     struct bitmap* inode_bmp = bitmap_create(256);
     struct bitmap* block_bmp = bitmap_create(2048);
+    filesystem_t fs;
+    setup_fs(&fs, disk, &sb, inode_bmp, block_bmp);
     
     // create directory with entries
     struct inode dir;
     uint32_t dir_inode_num;
-    inode_alloc(disk, inode_bmp, INODE_TYPE_DIRECTORY, 0755, &dir, &dir_inode_num);
+    inode_alloc(&fs, INODE_TYPE_DIRECTORY, 0755, &dir, &dir_inode_num);
     
     int block = bitmap_find_first_free(block_bmp);
     bitmap_set(block_bmp, block);
     dir.direct[0] = block;
     dir.blocks_used = 1;
-    inode_write(disk, dir_inode_num, &dir);
+    inode_write(&fs, dir_inode_num, &dir);
     
     char buffer[BLOCK_SIZE];
     memset(buffer, 0, BLOCK_SIZE);
@@ -173,13 +190,13 @@ void test_dentry_remove() {
     disk_write_block(disk, block, buffer);
     
     // remove file1
-    assert(dentry_remove(disk, dir_inode_num, "file1.txt") == SUCCESS);
+    assert(dentry_remove(&fs, dir_inode_num, "file1.txt") == SUCCESS);
     
     // verify removed
-    assert(dentry_find(disk, dir_inode_num, "file1.txt", NULL, NULL) == ERROR_NOT_FOUND);
+    assert(dentry_find(&fs, dir_inode_num, "file1.txt", NULL, NULL) == ERROR_NOT_FOUND);
     
     // verify file2 still exists
-    assert(dentry_find(disk, dir_inode_num, "file2.txt", NULL, NULL) == SUCCESS);
+    assert(dentry_find(&fs, dir_inode_num, "file2.txt", NULL, NULL) == SUCCESS);
     
     bitmap_destroy(&inode_bmp);
     bitmap_destroy(&block_bmp);
@@ -199,17 +216,19 @@ void test_dentry_list() {
     
     struct bitmap* inode_bmp = bitmap_create(256);
     struct bitmap* block_bmp = bitmap_create(2048);
+    filesystem_t fs;
+    setup_fs(&fs, disk, &sb, inode_bmp, block_bmp);
     
     // create directory with entries
     struct inode dir;
     uint32_t dir_inode_num;
-    inode_alloc(disk, inode_bmp, INODE_TYPE_DIRECTORY, 0755, &dir, &dir_inode_num);
+    inode_alloc(&fs, INODE_TYPE_DIRECTORY, 0755, &dir, &dir_inode_num);
     
     int block = bitmap_find_first_free(block_bmp);
     bitmap_set(block_bmp, block);
     dir.direct[0] = block;
     dir.blocks_used = 1;
-    inode_write(disk, dir_inode_num, &dir);
+    inode_write(&fs, dir_inode_num, &dir);
     
     char buffer[BLOCK_SIZE];
     memset(buffer, 0, BLOCK_SIZE);
@@ -221,7 +240,7 @@ void test_dentry_list() {
     // list all
     struct dentry* list = NULL;
     uint32_t count = 0;
-    assert(dentry_list(disk, dir_inode_num, &list, &count) == SUCCESS);
+    assert(dentry_list(&fs, dir_inode_num, &list, &count) == SUCCESS);
     
     assert(count == 2);
     assert(list != NULL);
@@ -241,6 +260,74 @@ void test_dentry_list() {
     printf("OK\n");
 }
 
+void test_dentry_rec_len() {
+    printf("Test: dentry rec_len format... ");
+    
+    disk_t disk;
+    disk_attach("test_dentry5.img", 1024*1024, true, &disk);
+
+    struct superblock sb;
+    superblock_init(disk, &sb, 2048, 256);
+    sb.features |= FS_FEATURE_REC_LEN;
+    superblock_write(disk, &sb);
+    
+    struct bitmap* inode_bmp = bitmap_create(256);
+    struct bitmap* block_bmp = bitmap_create(2048);
+    for (uint32_t i = 0; i < sb.first_data_block; i++)
+        bitmap_set(block_bmp, i);
+    filesystem_t fs;
+    setup_fs(&fs, disk, &sb, inode_bmp, block_bmp);
+    
+    // empty directory: dentry_add allocates its blocks
+    struct inode dir;
+    uint32_t dir_inode_num;
+    inode_alloc(&fs, INODE_TYPE_DIRECTORY, 0755, &dir, &dir_inode_num);
+    inode_write(&fs, dir_inode_num, &dir);
+    
+    // 30 short names (16-byte records) share a single block
+    char name[64];
+    uint32_t allocated, total = 0;
+    for (int i = 0; i < 30; i++) {
+        struct dentry d;
+        snprintf(name, sizeof(name), "entry%02d", i);
+        dentry_create(name, 100 + i, INODE_TYPE_FILE, &d);
+        assert(dentry_add(&fs, dir_inode_num, &d, &allocated) == SUCCESS);
+        total += allocated;
+    }
+    assert(total == 1);
+    
+    // the holes left by two removals are too small alone for a long name:
+    // the block is compacted in place instead of growing the directory
+    assert(dentry_remove(&fs, dir_inode_num, "entry05") == SUCCESS);
+    assert(dentry_remove(&fs, dir_inode_num, "entry20") == SUCCESS);
+    struct dentry d;
+    dentry_create("a_name_longer_than_both_holes", 200, INODE_TYPE_FILE, &d);
+    assert(dentry_add(&fs, dir_inode_num, &d, &allocated) == SUCCESS);
+    assert(allocated == 0);
+    
+    struct dentry found;
+    assert(dentry_find(&fs, dir_inode_num, "a_name_longer_than_both_holes", &found, NULL) == SUCCESS);
+    assert(found.inode_num == 200 && found.name_len == strlen(found.name));
+    assert(dentry_find(&fs, dir_inode_num, "entry05", NULL, NULL) == ERROR_NOT_FOUND);
+    for (int i = 0; i < 30; i++) {
+        if (i == 5 || i == 20) continue;
+        snprintf(name, sizeof(name), "entry%02d", i);
+        assert(dentry_find(&fs, dir_inode_num, name, &found, NULL) == SUCCESS);
+        assert(found.inode_num == (uint32_t)(100 + i));
+    }
+    
+    struct dentry* list = NULL;
+    uint32_t count = 0;
+    assert(dentry_list(&fs, dir_inode_num, &list, &count) == SUCCESS);
+    assert(count == 29);
+    free(list);
+    
+    bitmap_destroy(&inode_bmp);
+    bitmap_destroy(&block_bmp);
+    disk_detach(disk);
+    printf("OK\n");
+}
+
 int main() {
     printf("=== Dentry Tests ===\n\n");
     
@@ -250,6 +337,7 @@ int main() {
     test_dentry_add();
     test_dentry_remove();
     test_dentry_list();
+    test_dentry_rec_len();
     
     printf("\nAll dentry tests pass!\n");
     return 0;
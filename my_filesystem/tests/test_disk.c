@@ -7,6 +7,107 @@
 #include <string.h>
 #include <assert.h>
 
+// same contract through every backend; unavailable ones are skipped
+static void test_backend(disk_backend_t backend, bool direct) {
+    disk_attach_options_t opts = { backend, direct };
+    disk_t disk;
+    int ret = disk_attach_with_options("test.img", 1024 * 1024, true, &opts, &disk);
+    if (ret == DISK_ERROR_UNSUPPORTED) {
+        printf("Backend %s%s unavailable, skipped\n", disk_backend_name(backend),
+               direct ? " (direct)" : "");
+        return;
+    }
+    assert(ret == DISK_SUCCESS);
+    assert(disk_get_backend(disk) == backend);
+
+    // single blocks, from an unaligned buffer
+    char buf[512 + 1];
+    char* block = buf + 1;
+    memset(block, 'b', 512);
+    assert(disk_write_block(disk, 5, block) == DISK_SUCCESS);
+    char read_buf[512] = {0};
+    assert(disk_read_block(disk, 5, read_buf) == DISK_SUCCESS);
+    assert(memcmp(read_buf, block, 512) == 0);
+
+    // batched requests
+    static char in[8][1024], out[8][1024];
+    struct disk_request reqs[8];
+    for (int i = 0; i < 8; i++) {
+        memset(in[i], 'A' + i, sizeof(in[i]));
+        reqs[i] = (struct disk_request){ 100 + 4 * i, 2, in[i] };
+    }
+    assert(disk_write_blocks(disk, reqs, 8) == DISK_SUCCESS);
+    for (int i = 0; i < 8; i++)
+        reqs[i].buffer = out[i];
+    assert(disk_read_blocks(disk, reqs, 8) == DISK_SUCCESS);
+    for (int i = 0; i < 8; i++)
+        assert(memcmp(in[i], out[i], sizeof(in[i])) == 0);
+    reqs[0].block_num = (int)disk_get_blocks(disk) - 1;
+    assert(disk_read_blocks(disk, reqs, 1) == DISK_ERROR_INVALID_BLOCK);
+
+    // borrows of one range share a copy, written back by the last release
+    void* a = NULL;
+    void* b = NULL;
+    assert(disk_borrow_blocks_mut(disk, 7, 2, &a) == DISK_SUCCESS);
+    assert(disk_borrow_blocks_mut(disk, 7, 2, &b) == DISK_SUCCESS);
+    assert(a == b);
+    memset(a, 'm', 1024);
+    disk_release_blocks(disk, 7, 2, true);
+    disk_release_blocks(disk, 7, 2, false);
+    assert(disk_read_block(disk, 8, read_buf) == DISK_SUCCESS);
+    assert(read_buf[0] == 'm' && read_buf[511] == 'm');
+
+    // byte-level access at any offset
+    assert(disk_write(disk, 3000, "unaligned", 9) == DISK_SUCCESS);
+    char word[10] = {0};
+    assert(disk_read(disk, 3000, word, 9) == DISK_SUCCESS);
+    assert(strcmp(word, "unaligned") == 0);
+
+    // access hints never change data; out-of-range ones are rejected
+    assert(disk_advise_blocks(disk, 100, 32, DISK_ADVICE_WILLNEED) == DISK_SUCCESS);
+    assert(disk_advise_blocks(disk, 1, 3, DISK_ADVICE_SEQUENTIAL) == DISK_SUCCESS);
+    assert(disk_advise_blocks(disk, 0, 16, DISK_ADVICE_RANDOM) == DISK_SUCCESS);
+    assert(disk_advise_blocks(disk, 0, 16, DISK_ADVICE_NORMAL) == DISK_SUCCESS);
+    assert(disk_advise_blocks(disk, (int)disk_get_blocks(disk) - 1, 2, DISK_ADVICE_WILLNEED) ==
+           DISK_ERROR_INVALID_BLOCK);
+    assert(disk_read_block(disk, 108, read_buf) == DISK_SUCCESS);
+    assert(read_buf[0] == 'C');
+
+    // growing keeps the contents and adds zeroed blocks; never shrinks, and
+    // a mapping that may move cannot grow under a borrow
+    assert(disk_grow(disk, 512 * 1024) == DISK_ERROR);
+    assert(disk_borrow_blocks(disk, 0, 1, (const void**)&a) == DISK_SUCCESS);
+    assert(disk_grow(disk, 2 * 1024 * 1024) ==
+           (disk_is_mapped(disk) ? DISK_ERROR : DISK_SUCCESS));
+    disk_release_blocks(disk, 0, 1, false);
+    assert(disk_grow(disk, 2 * 1024 * 1024) == DISK_SUCCESS);
+    assert(disk_get_blocks(disk) == 2 * 1024 * 1024 / 512);
+    assert(disk_read_block(disk, 108, read_buf) == DISK_SUCCESS);
+    assert(read_buf[0] == 'C');
+    int last = (int)disk_get_blocks(disk) - 1;
+    assert(disk_read_block(disk, last, read_buf) == DISK_SUCCESS);
+    assert(read_buf[0] == 0 && read_buf[511] == 0);
+    assert(disk_write_block(disk, last, block) == DISK_SUCCESS);
+    assert(disk_get_dirty_bytes(disk) > 0);
+
+    assert(disk_sync(disk) == DISK_SUCCESS);
+    assert(disk_get_dirty_bytes(disk) == 0);
+    assert(disk_detach(disk) == DISK_SUCCESS);
+
+    // what the backend wrote is in the file
+    assert(disk_attach("test.img", 0, false, &disk) == DISK_SUCCESS);
+    assert(disk_read_block(disk, 108, read_buf) == DISK_SUCCESS);
+    assert(read_buf[0] == 'C');
+    assert(disk_read(disk, 3000, word, 9) == DISK_SUCCESS);
+    assert(strcmp(word, "unaligned") == 0);
+    assert(disk_get_blocks(disk) == 2 * 1024 * 1024 / 512);
+    assert(disk_read_block(disk, last, read_buf) == DISK_SUCCESS);
+    assert(memcmp(read_buf, block, 512) == 0);
+    assert(disk_detach(disk) == DISK_SUCCESS);
+
+    printf("Backend %s%s works\n", disk_backend_name(backend), direct ? " (direct)" : "");
+}
+
 int main() {
     printf("=== Disk Emulator Test ===\n");
     
@@ -26,11 +127,79 @@ int main() {
     assert(strcmp(write_buf, read_buf) == 0);
     printf("Read block 0\n");
     
-    // test 4: detach
+    // test 4: zero-copy borrow sees the same bytes, no copy involved
+    const void* view = NULL;
+    assert(disk_borrow_blocks(disk, 0, 1, &view) == DISK_SUCCESS);
+    assert(strcmp((const char*)view, write_buf) == 0);
+    disk_release_blocks(disk, 0, 1, false);
+
+    // a block range is one contiguous pointer
+    void* range = NULL;
+    assert(disk_borrow_blocks_mut(disk, 1, 2, &range) == DISK_SUCCESS);
+    memset(range, 'x', 2 * 512);
+    disk_release_blocks(disk, 1, 2, true);
+    assert(disk_read_block(disk, 2, read_buf) == DISK_SUCCESS);
+    assert(read_buf[0] == 'x' && read_buf[511] == 'x');
+    printf("Borrowed blocks 0..2\n");
+
+    // out of range borrows are rejected
+    size_t blocks = disk_get_blocks(disk);
+    assert(disk_borrow_blocks(disk, (int)blocks, 1, &view) == DISK_ERROR_INVALID_BLOCK);
+    assert(disk_borrow_blocks(disk, (int)blocks - 1, 2, &view) == DISK_ERROR_INVALID_BLOCK);
+    assert(disk_borrow_blocks(disk, 0, 0, &view) == DISK_ERROR_INVALID_BLOCK);
+    assert(disk_borrow_blocks(disk, -1, 1, &view) == DISK_ERROR_INVALID_BLOCK);
+    printf("Rejected invalid borrows\n");
+
+    // block geometry: only powers of two in range, and never under a borrow
+    assert(disk_set_block_size(disk, 4096) == DISK_SUCCESS);
+    assert(disk_get_block_size(disk) == 4096);
+    assert(disk_get_blocks(disk) == 1024 * 1024 / 4096);
+    assert(disk_borrow_blocks(disk, 1, 1, &view) == DISK_SUCCESS);
+    assert((const char*)view == (const char*)range + 4096 - 512);
+    assert(disk_set_block_size(disk, 512) == DISK_ERROR);
+    disk_release_blocks(disk, 1, 1, false);
+    assert(disk_set_block_size(disk, 1000) == DISK_ERROR);
+    assert(disk_set_block_size(disk, 256) == DISK_ERROR);
+    assert(disk_set_block_size(disk, 512) == DISK_SUCCESS);
+    assert(disk_get_blocks(disk) == blocks);
+    printf("Changed block size\n");
+
+    // dirty tracking: a sync flushes only what was written
+    assert(disk_sync(disk) == DISK_SUCCESS);
+    assert(disk_get_dirty_bytes(disk) == 0);
+    assert(disk_write_block(disk, 3, write_buf) == DISK_SUCCESS);
+    assert(disk_write(disk, 512 * 1024, write_buf, 16) == DISK_SUCCESS);
+    size_t dirty = disk_get_dirty_bytes(disk);
+    assert(dirty > 0 && dirty < 1024 * 1024);
+
+    // async write-back does not make anything clean
+    assert(disk_sync_async(disk) == DISK_SUCCESS);
+    assert(disk_get_dirty_bytes(disk) == dirty);
+
+    // a range sync cleans its range only
+    assert(disk_sync_range(disk, 512 * 1024, 64 * 1024) == DISK_SUCCESS);
+    assert(disk_get_dirty_bytes(disk) > 0 && disk_get_dirty_bytes(disk) < dirty);
+    assert(disk_sync_range(disk, 1024 * 1024, 1) == DISK_ERROR_INVALID_BLOCK);
+    assert(disk_sync_range_async(disk, 0, 512) == DISK_SUCCESS);
+    assert(disk_sync_blocks(disk, 3, 1) == DISK_SUCCESS);
+    assert(disk_get_dirty_bytes(disk) == 0);
+
+    // dirty releases are tracked too
+    assert(disk_borrow_blocks_mut(disk, 1, 1, &range) == DISK_SUCCESS);
+    disk_release_blocks(disk, 1, 1, true);
+    assert(disk_get_dirty_bytes(disk) > 0);
+    assert(disk_sync(disk) == DISK_SUCCESS);
+    assert(disk_get_dirty_bytes(disk) == 0);
+    printf("Synced dirty ranges\n");
+
+    // restore block 0 content for the persistence check
+    assert(disk_write_block(disk, 0, write_buf) == DISK_SUCCESS);
+
+    // test 5: detach
     assert(disk_detach(disk) == DISK_SUCCESS);
     printf("Disk successfully detached\n");
     
-    // test 5: persistence
+    // test 6: persistence
     assert(disk_attach("test.img", 0, false, &disk) == DISK_SUCCESS);
 
     memset(read_buf, 0, 512);
@@ -39,6 +208,16 @@ int main() {
     printf("Persistent data\n");
     
     assert(disk_detach(disk) == DISK_SUCCESS);
+
+    // test 7: backends
+    disk_attach_options_t mmap_direct = { DISK_BACKEND_MMAP, true };
+    assert(disk_attach_with_options("test.img", 0, false, &mmap_direct, &disk) ==
+           DISK_ERROR_UNSUPPORTED);
+    test_backend(DISK_BACKEND_MMAP, false);
+    test_backend(DISK_BACKEND_PREAD, false);
+    test_backend(DISK_BACKEND_PREAD, true);
+    test_backend(DISK_BACKEND_URING, false);
+    test_backend(DISK_BACKEND_URING, true);
     
     printf("\nAll disk tests pass!\n");
     return 0;
@@ -6,7 +6,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <pthread.h>
 #include "fs.h"
+#include "fs_internal.h"
 #include "disk.h"
 
 #define TEST_DISK "test_disk.img"
@@ -55,8 +57,6 @@ void test_fs_mount() {
     assert(fs->is_mounted == true);
 
     fs_unmount(fs);
-    ret = disk_detach(disk);
-    assert(ret == DISK_SUCCESS);
 
     printf("test_fs_mount PASSED\n\n");
 } 
@@ -78,13 +78,11 @@ void test_fs_mkdir() {
     assert(ret == SUCCESS);
 
     struct inode st;
-    ret = fs_stat(fs, "/dir1", &st);
+    ret = fs_stat(fs, "/dir1", &st, NULL, NULL, 0);
     assert(ret == SUCCESS);
     assert(st.type == INODE_TYPE_DIRECTORY);
 
     fs_unmount(fs);
-    ret = disk_detach(disk);
-    assert(ret == DISK_SUCCESS);
 
     printf("test_fs_mkdir PASSED\n\n");
 }
@@ -106,12 +104,11 @@ void test_fs_create() {
     assert(ret == SUCCESS);
 
     struct inode st;
-    ret = fs_stat(fs, "/a.txt", &st);
+    ret = fs_stat(fs, "/a.txt", &st, NULL, NULL, 0);
     assert(ret == SUCCESS);
     assert(st.type == INODE_TYPE_FILE);
 
     fs_unmount(fs);
-    ret = disk_detach(disk);
 
     printf("test_fs_create PASSED\n\n");
 }
@@ -150,11 +147,50 @@ void test_fs_write_read() {
 
     fs_close(f);
     fs_unmount(fs);
-    disk_detach(disk);
 
     printf("test_fs_write_read PASSED\n\n");
 }
 
+void test_fs_large_read() {
+    printf("Running test_fs_large_read...\n");
+
+    remove(TEST_DISK);
+    disk_t disk = NULL;
+    int ret = disk_attach(TEST_DISK, 512 * 1000, true, &disk);
+    assert(ret == DISK_SUCCESS);
+    fs_format(disk, 1000, 128);
+
+    filesystem_t* fs = NULL;
+    fs_mount(disk, &fs);
+    fs_create(fs, "/big.bin", 0644);
+
+    // spans direct and indirect blocks
+    size_t len = 20 * BLOCK_SIZE + 123;
+    char* data = malloc(len);
+    char* back = malloc(len);
+    assert(data && back);
+    for (size_t i = 0; i < len; i++) data[i] = (char)(i * 31 + 7);
+
+    open_file_t* f = NULL;
+    assert(fs_open(fs, "/big.bin", FS_O_RDWR, &f) == SUCCESS);
+    size_t written = 0;
+    assert(fs_write(f, data, len, &written) == SUCCESS);
+    assert(written == len);
+
+    // unaligned read crossing several blocks
+    fs_seek(f, 700);
+    size_t read = 0;
+    assert(fs_read(f, back, len, &read) == SUCCESS);
+    assert(read == len - 700);
+    assert(memcmp(back, data + 700, read) == 0);
+
+    fs_close(f);
+    fs_unmount(fs);
+    free(data);
+    free(back);
+
+    printf("test_fs_large_read PASSED\n\n");
+}
 
 void test_fs_link() {
     printf("Running test_fs_link...\n");
@@ -200,10 +236,10 @@ void test_fs_link() {
     // checks inodes: links_count must be 2 on both
     struct inode st1, st2;
 
-    ret = fs_stat(fs, "/orig.txt", &st1);
+    ret = fs_stat(fs, "/orig.txt", &st1, NULL, NULL, 0);
     assert(ret == SUCCESS);
 
-    ret = fs_stat(fs, "/alias.txt", &st2);
+    ret = fs_stat(fs, "/alias.txt", &st2, NULL, NULL, 0);
     assert(ret == SUCCESS);
 
     assert(st1.links_count == 2);
@@ -228,8 +264,6 @@ void test_fs_link() {
     ret = fs_unmount(fs);
     assert(ret == SUCCESS);
 
-    ret = disk_detach(disk);
-    assert(ret == DISK_SUCCESS);
 
     printf("test_fs_link passed.\n");
 }
@@ -251,12 +285,10 @@ void test_fs_unlink() {
     assert(ret == SUCCESS);
 
     struct inode st;
-    ret = fs_stat(fs, "/tmp.txt", &st);
+    ret = fs_stat(fs, "/tmp.txt", &st, NULL, NULL, 0);
     assert(ret == ERROR_NOT_FOUND);
 
     fs_unmount(fs);
-    ret = disk_detach(disk);
-    assert(ret == DISK_SUCCESS);
 
     printf("test_fs_unlink PASSED\n\n");
 }
@@ -326,8 +358,6 @@ void test_fs_cd() {
     ret = fs_unmount(fs);
     assert(ret == SUCCESS);
 
-    ret = disk_detach(disk);
-    assert(ret == DISK_SUCCESS);
 
     printf("test_fs_cd passed.\n");
 }
@@ -349,25 +379,2830 @@ void test_fs_rmdir() {
     assert(ret == SUCCESS);
 
     struct inode st;
-    ret = fs_stat(fs, "/d", &st);
+    ret = fs_stat(fs, "/d", &st, NULL, NULL, 0);
     assert(ret == ERROR_NOT_FOUND);
 
     fs_unmount(fs);
-    ret = disk_detach(disk);
 
     printf("test_fs_rmdir PASSED\n\n");
 }
 
+void test_fs_flush_policy() {
+    printf("Running test_fs_flush_policy...\n");
+
+    remove(TEST_DISK);
+    disk_t disk = NULL;
+    int ret = disk_attach(TEST_DISK, 512 * 1000, true, &disk);
+    assert(ret == DISK_SUCCESS);
+    fs_format(disk, 1000, 128);
+
+    // every N must be positive
+    filesystem_t* fs = NULL;
+    fs_mount_options_t bad = { .flush_policy = FS_FLUSH_EVERY_N, .flush_interval = 0 };
+    assert(fs_mount_with_options(disk, &bad, &fs) == ERROR_INVALID);
+
+    // metadata stays in memory until sync
+    fs_mount_options_t opts = { .flush_policy = FS_FLUSH_ON_SYNC, .flush_interval = 0 };
+    ret = fs_mount_with_options(disk, &opts, &fs);
+    assert(ret == SUCCESS);
+
+    struct superblock on_disk;
+    superblock_read(disk, &on_disk);
+    uint32_t free_inodes_before = on_disk.free_inodes;
+
+    assert(fs_create(fs, "/lazy.txt", 0644) == SUCCESS);
+    superblock_read(disk, &on_disk);
+    assert(on_disk.free_inodes == free_inodes_before);
+    assert(bitmap_is_dirty(fs->inode_bitmap));
+
+    assert(fs_sync(fs) == SUCCESS);
+    superblock_read(disk, &on_disk);
+    assert(on_disk.free_inodes == free_inodes_before - 1);
+    assert(!bitmap_is_dirty(fs->inode_bitmap));
+    fs_unmount(fs);
+
+    // every 2 operations
+    ret = disk_attach(TEST_DISK, 0, false, &disk);
+    assert(ret == DISK_SUCCESS);
+    opts.flush_policy = FS_FLUSH_EVERY_N;
+    opts.flush_interval = 2;
+    ret = fs_mount_with_options(disk, &opts, &fs);
+    assert(ret == SUCCESS);
+
+    superblock_read(disk, &on_disk);
+    free_inodes_before = on_disk.free_inodes;
+
+    assert(fs_create(fs, "/a", 0644) == SUCCESS);
+    superblock_read(disk, &on_disk);
+    assert(on_disk.free_inodes == free_inodes_before);
+
+    assert(fs_create(fs, "/b", 0644) == SUCCESS);
+    superblock_read(disk, &on_disk);
+    assert(on_disk.free_inodes == free_inodes_before - 2);
+
+    fs_unmount(fs);
+
+    // everything survives a remount
+    ret = disk_attach(TEST_DISK, 0, false, &disk);
+    assert(ret == DISK_SUCCESS);
+    ret = fs_mount(disk, &fs);
+    assert(ret == SUCCESS);
+    struct inode st;
+    assert(fs_stat(fs, "/lazy.txt", &st, NULL, NULL, 0) == SUCCESS);
+    assert(fs_stat(fs, "/b", &st, NULL, NULL, 0) == SUCCESS);
+    fs_unmount(fs);
+
+    printf("test_fs_flush_policy PASSED\n\n");
+}
+
+// fills out with the i * 7 % 251 pattern the file tests write and check
+static void fill_pattern(uint8_t* out, size_t len) {
+    for (size_t i = 0; i < len; i++)
+        out[i] = (uint8_t)(i * 7 % 251);
+}
+
+// writes len bytes of filler to a new file
+static void write_new_file(filesystem_t* fs, const char* path, size_t len) {
+    char* data = malloc(len);
+    assert(data);
+    memset(data, 'z', len);
+
+    assert(fs_create(fs, path, 0644) == SUCCESS);
+    open_file_t* f = NULL;
+    assert(fs_open(fs, path, FS_O_RDWR, &f) == SUCCESS);
+    size_t written = 0;
+    assert(fs_write(f, data, len, &written) == SUCCESS);
+    assert(written == len);
+    fs_close(f);
+    free(data);
+}
+
+// writes len pattern bytes through an open handle
+static void write_pattern(open_file_t* f, size_t len) {
+    uint8_t* data = malloc(len);
+    assert(data);
+    fill_pattern(data, len);
+    size_t written = 0;
+    assert(fs_write(f, data, len, &written) == SUCCESS && written == len);
+    free(data);
+}
+
+// writes len pattern bytes to a new file
+static void create_pattern_file(filesystem_t* fs, const char* path, size_t len) {
+    assert(fs_create(fs, path, 0644) == SUCCESS);
+    open_file_t* f = NULL;
+    assert(fs_open(fs, path, FS_O_WRONLY, &f) == SUCCESS);
+    write_pattern(f, len);
+    fs_close(f);
+}
+
+// reads the whole of path into out, which has room for len + 1 bytes,
+// and checks that the file holds exactly len
+static void read_file(filesystem_t* fs, const char* path, uint8_t* out, size_t len) {
+    open_file_t* f = NULL;
+    assert(fs_open(fs, path, FS_O_RDONLY, &f) == SUCCESS);
+    size_t got = 0;
+    assert(fs_read(f, out, len + 1, &got) == SUCCESS && got == len);
+    fs_close(f);
+}
+
+// checks that path holds exactly the len bytes of want
+static void check_contents(filesystem_t* fs, const char* path, const uint8_t* want, size_t len) {
+    uint8_t* back = malloc(len + 1);
+    assert(back);
+    read_file(fs, path, back, len);
+    assert(memcmp(back, want, len) == 0);
+    free(back);
+}
+
+// checks that path starts with len pattern bytes
+static void check_pattern_file(filesystem_t* fs, const char* path, size_t len) {
+    uint8_t* want = malloc(len);
+    uint8_t* back = malloc(len);
+    assert(want && back);
+    fill_pattern(want, len);
+    open_file_t* f = NULL;
+    assert(fs_open(fs, path, FS_O_RDONLY, &f) == SUCCESS);
+    size_t read = 0;
+    assert(fs_read(f, back, len, &read) == SUCCESS && read == len);
+    assert(memcmp(back, want, len) == 0);
+    fs_close(f);
+    free(back);
+    free(want);
+}
+
+// writes data at offset through a fresh handle
+static void pwrite_at(filesystem_t* fs, const char* path, const void* data, size_t len,
+                      uint32_t offset) {
+    open_file_t* f = NULL;
+    assert(fs_open(fs, path, FS_O_RDWR, &f) == SUCCESS);
+    size_t n = 0;
+    assert(fs_pwrite(f, data, len, offset, &n) == SUCCESS && n == len);
+    fs_close(f);
+}
+
+void test_fs_contiguous_alloc() {
+    printf("Running test_fs_contiguous_alloc...\n");
+
+    remove(TEST_DISK);
+    disk_t disk = NULL;
+    int ret = disk_attach(TEST_DISK, 512 * 1000, true, &disk);
+    assert(ret == DISK_SUCCESS);
+    fs_format(disk, 1000, 128);
+
+    filesystem_t* fs = NULL;
+    fs_mount(disk, &fs);
+
+    // leave a one-block hole between two files
+    write_new_file(fs, "/a", BLOCK_SIZE);
+    write_new_file(fs, "/b", BLOCK_SIZE);
+    assert(fs_unlink(fs, "/a") == SUCCESS);
+
+    // a multi-block write claims one contiguous run, skipping the hole
+    write_new_file(fs, "/c", 8 * BLOCK_SIZE);
+    struct inode st;
+    assert(fs_stat(fs, "/c", &st, NULL, NULL, 0) == SUCCESS);
+    for (int i = 1; i < 8; i++) {
+        assert(st.direct[i] == st.direct[0] + (uint32_t)i);
+    }
+
+    // appends continue right after the last block
+    open_file_t* f = NULL;
+    assert(fs_open(fs, "/c", FS_O_WRONLY | FS_O_APPEND, &f) == SUCCESS);
+    char more[2 * BLOCK_SIZE];
+    memset(more, 'y', sizeof(more));
+    size_t written = 0;
+    assert(fs_write(f, more, sizeof(more), &written) == SUCCESS);
+    fs_close(f);
+
+    assert(fs_stat(fs, "/c", &st, NULL, NULL, 0) == SUCCESS);
+    assert(st.direct[8] == st.direct[7] + 1);
+    assert(st.direct[9] == st.direct[8] + 1);
+
+    fs_unmount(fs);
+
+    printf("test_fs_contiguous_alloc PASSED\n\n");
+}
+
+// appends one block to each of two files in turn, so their data interleaves
+static void append_block(filesystem_t* fs, const char* path, char fill) {
+    char block[BLOCK_SIZE];
+    memset(block, fill, sizeof(block));
+
+    open_file_t* f = NULL;
+    assert(fs_open(fs, path, FS_O_WRONLY | FS_O_APPEND, &f) == SUCCESS);
+    size_t written = 0;
+    assert(fs_write(f, block, sizeof(block), &written) == SUCCESS);
+    fs_close(f);
+}
+
+void test_fs_extents() {
+    printf("Running test_fs_extents...\n");
+
+    remove(TEST_DISK);
+    disk_t disk = NULL;
+    int ret = disk_attach(TEST_DISK, 512 * 1000, true, &disk);
+    assert(ret == DISK_SUCCESS);
+    fs_format_options_t fopts = { .extents = true };
+    assert(fs_format_with_options(disk, 1000, 128, &fopts) == SUCCESS);
+
+    filesystem_t* fs = NULL;
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    struct inode root;
+    assert(fs_stat(fs, "/", &root, NULL, NULL, 0) == SUCCESS);
+    uint32_t free_before = fs->sb.free_blocks + root.blocks_used;  // directory blocks never shrink
+
+    // larger than the 140 blocks block pointers can address, in a single extent
+    size_t len = 200 * BLOCK_SIZE + 77;
+    char* data = malloc(len);
+    char* back = malloc(len);
+    assert(data && back);
+    for (size_t i = 0; i < len; i++) data[i] = (char)(i * 13 + 5);
+
+    assert(fs_create(fs, "/big", 0644) == SUCCESS);
+    open_file_t* f = NULL;
+    assert(fs_open(fs, "/big", FS_O_RDWR, &f) == SUCCESS);
+    size_t written = 0;
+    assert(fs_write(f, data, len, &written) == SUCCESS);
+    assert(written == len);
+
+    fs_seek(f, 1000);
+    size_t read = 0;
+    assert(fs_read(f, back, len, &read) == SUCCESS);
+    assert(read == len - 1000);
+    assert(memcmp(back, data + 1000, read) == 0);
+    fs_close(f);
+
+    struct inode st;
+    assert(fs_stat(fs, "/big", &st, NULL, NULL, 0) == SUCCESS);
+    assert(st.flags & INODE_FLAG_EXTENTS);
+    assert(st.blocks_used == 201);
+    assert(st.indirect == 0);
+
+    struct extent ext[BMAP_MAX_EXTENTS];
+    uint32_t count = 0;
+    assert(bmap_get_extents(fs, &st, ext, BMAP_MAX_EXTENTS, &count) == SUCCESS);
+    assert(count == 1);
+    assert(ext[0].logical == 0 && ext[0].length == 201);
+
+    // truncation returns every block
+    assert(fs_open(fs, "/big", FS_O_RDWR | FS_O_TRUNC, &f) == SUCCESS);
+    fs_close(f);
+    assert(fs_stat(fs, "/big", &st, NULL, NULL, 0) == SUCCESS);
+    assert(st.size == 0 && st.blocks_used == 0);
+    assert(fs_stat(fs, "/", &root, NULL, NULL, 0) == SUCCESS);
+    assert(fs->sb.free_blocks + root.blocks_used == free_before);
+
+    // interleaved appends fragment both files past the in-inode records
+    write_new_file(fs, "/x", BLOCK_SIZE);
+    write_new_file(fs, "/y", BLOCK_SIZE);
+    for (int i = 0; i < 8; i++) {
+        append_block(fs, "/x", 'x');
+        append_block(fs, "/y", 'y');
+    }
+
+    assert(fs_stat(fs, "/x", &st, NULL, NULL, 0) == SUCCESS);
+    assert(st.size == 9 * BLOCK_SIZE);
+    assert(st.indirect != 0);                       // extent block in use
+    assert(st.blocks_used == 9 + 1);
+    assert(bmap_get_extents(fs, &st, ext, BMAP_MAX_EXTENTS, &count) == SUCCESS);
+    assert(count > BMAP_INODE_EXTENTS);
+
+    char buf[9 * BLOCK_SIZE];
+    assert(fs_open(fs, "/x", FS_O_RDONLY, &f) == SUCCESS);
+    assert(fs_read(f, buf, sizeof(buf), &read) == SUCCESS);
+    assert(read == sizeof(buf));
+    for (size_t i = BLOCK_SIZE; i < sizeof(buf); i++) assert(buf[i] == 'x');
+    fs_close(f);
+
+    // deleting both gives back data and extent blocks
+    assert(fs_unlink(fs, "/x") == SUCCESS);
+    assert(fs_unlink(fs, "/y") == SUCCESS);
+    assert(fs_unlink(fs, "/big") == SUCCESS);
+    assert(fs_stat(fs, "/", &root, NULL, NULL, 0) == SUCCESS);
+    assert(fs->sb.free_blocks + root.blocks_used == free_before);
+
+    fs_unmount(fs);
+    free(data);
+    free(back);
+
+    printf("test_fs_extents PASSED\n\n");
+}
+
+void test_fs_multi_mb_file() {
+    printf("Running test_fs_multi_mb_file...\n");
+
+    // big enough for a file reaching into the triple-indirect tree
+    const size_t disk_blocks = 18000;
+    remove(TEST_DISK);
+    disk_t disk = NULL;
+    int ret = disk_attach(TEST_DISK, BLOCK_SIZE * disk_blocks, true, &disk);
+    assert(ret == DISK_SUCCESS);
+    assert(fs_format(disk, disk_blocks, 128) == SUCCESS);
+
+    filesystem_t* fs = NULL;
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    assert(fs_create(fs, "/log", 0644) == SUCCESS);
+    uint32_t free_before = fs->sb.free_blocks;
+
+    // 12 direct + 128 single + 16384 double, the rest in the triple tree
+    const uint32_t data_blocks = 17000;
+    const size_t chunk = 64 * 1024;
+    const size_t len = (size_t)data_blocks * BLOCK_SIZE;
+    char* buf = malloc(chunk);
+    assert(buf);
+
+    open_file_t* f = NULL;
+    assert(fs_open(fs, "/log", FS_O_RDWR, &f) == SUCCESS);
+    for (size_t off = 0; off < len; off += chunk) {
+        size_t n = MIN(chunk, len - off);
+        for (size_t i = 0; i < n; i++) buf[i] = (char)((off + i) * 7 + 3);
+        size_t written = 0;
+        assert(fs_write(f, buf, n, &written) == SUCCESS);
+        assert(written == n);
+    }
+
+    struct inode st;
+    assert(fs_stat(fs, "/log", &st, NULL, NULL, 0) == SUCCESS);
+    assert(st.size == len);
+    assert(st.indirect != 0 && st.double_indirect != 0 && st.triple_indirect != 0);
+
+    // pointer blocks: indirect, double root + 128 leaves, triple root + 1 interior + 4 leaves
+    uint32_t meta_blocks = 1 + (1 + 128) + (1 + 1 + 4);
+    assert(st.blocks_used == data_blocks + meta_blocks);
+    assert(fs->sb.free_blocks == free_before - st.blocks_used);
+
+    // read back across every tree boundary
+    fs_seek(f, 0);
+    for (size_t off = 0; off < len; off += chunk) {
+        size_t n = MIN(chunk, len - off);
+        size_t read = 0;
+        assert(fs_read(f, buf, n, &read) == SUCCESS);
+        assert(read == n);
+        for (size_t i = 0; i < n; i++) assert(buf[i] == (char)((off + i) * 7 + 3));
+    }
+    fs_close(f);
+
+    // truncation releases data and pointer blocks alike
+    assert(fs_open(fs, "/log", FS_O_WRONLY | FS_O_TRUNC, &f) == SUCCESS);
+    fs_close(f);
+    assert(fs_stat(fs, "/log", &st, NULL, NULL, 0) == SUCCESS);
+    assert(st.size == 0 && st.blocks_used == 0);
+    assert(st.indirect == 0 && st.double_indirect == 0 && st.triple_indirect == 0);
+    assert(fs->sb.free_blocks == free_before);
+
+    fs_unmount(fs);
+    free(buf);
+
+    printf("test_fs_multi_mb_file PASSED\n\n");
+}
+
+void test_fs_sequential_cursor() {
+    printf("Running test_fs_sequential_cursor...\n");
+
+    remove(TEST_DISK);
+    disk_t disk = NULL;
+    int ret = disk_attach(TEST_DISK, 512 * 1000, true, &disk);
+    assert(ret == DISK_SUCCESS);
+    fs_format(disk, 1000, 128);
+
+    filesystem_t* fs = NULL;
+    fs_mount(disk, &fs);
+    fs_create(fs, "/seq", 0644);
+
+    // reaches into the double-indirect tree
+    size_t len = 300 * BLOCK_SIZE;
+    char* data = malloc(len);
+    char* back = malloc(len);
+    assert(data && back);
+    for (size_t i = 0; i < len; i++) data[i] = (char)(i * 17 + 1);
+
+    // odd-sized pieces so calls start and end inside leaves
+    open_file_t* f = NULL;
+    assert(fs_open(fs, "/seq", FS_O_RDWR, &f) == SUCCESS);
+    for (size_t off = 0; off < len; ) {
+        size_t n = MIN((size_t)1000, len - off);
+        size_t written = 0;
+        assert(fs_write(f, data + off, n, &written) == SUCCESS);
+        assert(written == n);
+        // nothing stays borrowed between calls
+        assert(!f->cursor.leaf_valid && f->cursor.leaf_ptrs == NULL);
+        off += n;
+    }
+
+    fs_seek(f, 0);
+    for (size_t off = 0; off < len; ) {
+        size_t n = MIN((size_t)3333, len - off);
+        size_t read = 0;
+        assert(fs_read(f, back + off, n, &read) == SUCCESS);
+        assert(read == n);
+        assert(!f->cursor.leaf_valid && f->cursor.leaf_ptrs == NULL);
+        off += n;
+    }
+    assert(memcmp(back, data, len) == 0);
+    fs_close(f);
+
+    fs_unmount(fs);
+    free(data);
+    free(back);
+
+    printf("test_fs_sequential_cursor PASSED\n\n");
+}
+
+void test_fs_dir_index() {
+    printf("Running test_fs_dir_index...\n");
+
+    remove(TEST_DISK);
+    disk_t disk = NULL;
+    int ret = disk_attach(TEST_DISK, 512 * 2000, true, &disk);
+    assert(ret == DISK_SUCCESS);
+    fs_format_options_t fopts = { .dir_index = true };
+    assert(fs_format_with_options(disk, 2000, 512, &fopts) == SUCCESS);
+
+    filesystem_t* fs = NULL;
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    struct inode root, st;
+    assert(fs_stat(fs, "/", &root, NULL, NULL, 0) == SUCCESS);
+    uint32_t free_before = fs->sb.free_blocks + root.blocks_used;
+
+    // a few entries stay a linear directory
+    assert(fs_mkdir(fs, "/small", 0755) == SUCCESS);
+    assert(fs_create(fs, "/small/a", 0644) == SUCCESS);
+    assert(fs_stat(fs, "/small", &st, NULL, NULL, 0) == SUCCESS);
+    assert(!(st.flags & INODE_FLAG_DIR_INDEX));
+
+    // enough entries to build the index and grow it more than once
+    const int n = 250;
+    char path[64];
+    assert(fs_mkdir(fs, "/big", 0755) == SUCCESS);
+    for (int i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "/big/file%03d", i);
+        assert(fs_create(fs, path, 0644) == SUCCESS);
+    }
+    assert(fs_stat(fs, "/big", &st, NULL, NULL, 0) == SUCCESS);
+    assert(st.flags & INODE_FLAG_DIR_INDEX);
+    assert(fs_create(fs, "/big/file007", 0644) != SUCCESS);     // duplicate
+
+    for (int i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "/big/file%03d", i);
+        assert(fs_stat(fs, path, &st, NULL, NULL, 0) == SUCCESS);
+    }
+    assert(fs_stat(fs, "/big/nope", &st, NULL, NULL, 0) == ERROR_NOT_FOUND);
+
+    // removals leave tombstones and holes; the rest stays reachable
+    for (int i = 0; i < n; i += 2) {
+        snprintf(path, sizeof(path), "/big/file%03d", i);
+        assert(fs_unlink(fs, path) == SUCCESS);
+    }
+    for (int i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "/big/file%03d", i);
+        assert(fs_stat(fs, path, &st, NULL, NULL, 0) == ((i % 2) ? SUCCESS : ERROR_NOT_FOUND));
+    }
+
+    // freed slots are reused
+    for (int i = 0; i < n; i += 2) {
+        snprintf(path, sizeof(path), "/big/again%03d", i);
+        assert(fs_create(fs, path, 0644) == SUCCESS);
+    }
+    struct dentry* list = NULL;
+    uint32_t count = 0;
+    assert(fs_list(fs, "/big", &list, &count) == SUCCESS);
+    assert(count == (uint32_t)n + 2);                           // plus "." and ".."
+    free(list);
+
+    // emptying and removing the directories frees the index with them
+    for (int i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), (i % 2) ? "/big/file%03d" : "/big/again%03d", i);
+        assert(fs_unlink(fs, path) == SUCCESS);
+    }
+    assert(fs_rmdir(fs, "/big") == SUCCESS);
+    assert(fs_unlink(fs, "/small/a") == SUCCESS);
+    assert(fs_rmdir(fs, "/small") == SUCCESS);
+    assert(fs_stat(fs, "/", &root, NULL, NULL, 0) == SUCCESS);
+    assert(fs->sb.free_blocks + root.blocks_used == free_before);
+
+    fs_unmount(fs);
+
+    printf("test_fs_dir_index PASSED\n\n");
+}
+
+void test_fs_rec_len_dentries() {
+    printf("Running test_fs_rec_len_dentries...\n");
+
+    remove(TEST_DISK);
+    disk_t disk = NULL;
+    int ret = disk_attach(TEST_DISK, 512 * 2000, true, &disk);
+    assert(ret == DISK_SUCCESS);
+    fs_format_options_t fopts = { .rec_len = true, .dir_index = true };
+    assert(fs_format_with_options(disk, 2000, 512, &fopts) == SUCCESS);
+
+    filesystem_t* fs = NULL;
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    assert(fs->sb.features & FS_FEATURE_REC_LEN);
+
+    // 300 entries: more than the 280 fixed-size dentries a directory can hold
+    const int n = 300;
+    char path[64];
+    assert(fs_mkdir(fs, "/d", 0755) == SUCCESS);
+    for (int i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "/d/f%03d", i);
+        assert(fs_create(fs, path, 0644) == SUCCESS);
+    }
+
+    struct inode st;
+    assert(fs_stat(fs, "/d", &st, NULL, NULL, 0) == SUCCESS);
+    assert(st.size == 8 * BLOCK_SIZE);                      // 42 records per block
+    assert(st.flags & INODE_FLAG_DIR_INDEX);
+
+    for (int i = 0; i < n; i += 3) {
+        snprintf(path, sizeof(path), "/d/f%03d", i);
+        assert(fs_unlink(fs, path) == SUCCESS);
+    }
+    for (int i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "/d/f%03d", i);
+        assert(fs_stat(fs, path, &st, NULL, NULL, 0) == ((i % 3) ? SUCCESS : ERROR_NOT_FOUND));
+    }
+
+    struct dentry* list = NULL;
+    uint32_t count = 0;
+    assert(fs_list(fs, "/d", &list, &count) == SUCCESS);
+    assert(count == (uint32_t)(n - n / 3) + 2);
+    free(list);
+
+    // a file in the directory is read back through the new format
+    write_new_file(fs, "/d/data", 3 * BLOCK_SIZE);
+    assert(fs_stat(fs, "/d/data", &st, NULL, NULL, 0) == SUCCESS);
+    assert(st.size == 3 * BLOCK_SIZE);
+
+    fs_unmount(fs);
+
+    printf("test_fs_rec_len_dentries PASSED\n\n");
+}
+
+void test_fs_dcache() {
+    printf("Running test_fs_dcache...\n");
+
+    remove(TEST_DISK);
+    disk_t disk = NULL;
+    int ret = disk_attach(TEST_DISK, 512 * 1000, true, &disk);
+    assert(ret == DISK_SUCCESS);
+    assert(fs_format(disk, 1000, 128) == SUCCESS);
+
+    filesystem_t* fs = NULL;
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    assert(fs->dcache != NULL);
+
+    assert(fs_mkdir(fs, "/etc", 0755) == SUCCESS);
+    assert(fs_mkdir(fs, "/etc/app", 0755) == SUCCESS);
+    assert(fs_create(fs, "/etc/app/conf", 0644) == SUCCESS);
+
+    // once warm, resolving a hot path misses nothing
+    uint32_t ino, again;
+    assert(fs_path_to_inode(fs, "/etc/app/conf", &ino) == SUCCESS);
+    uint64_t misses = fs->dcache->misses;
+    for (int i = 0; i < 10; i++) {
+        assert(fs_path_to_inode(fs, "/etc/app/conf", &again) == SUCCESS);
+        assert(again == ino);
+    }
+    assert(fs->dcache->misses == misses);
+
+    // misses are cached as negative entries...
+    assert(fs_path_to_inode(fs, "/etc/app/missing", &again) == ERROR_NOT_FOUND);
+    uint64_t negative = fs->dcache->negative_hits;
+    assert(fs_path_to_inode(fs, "/etc/app/missing", &again) == ERROR_NOT_FOUND);
+    assert(fs->dcache->negative_hits == negative + 1);
+
+    // ...and dropped when the name appears or goes away
+    assert(fs_create(fs, "/etc/app/missing", 0644) == SUCCESS);
+    assert(fs_path_to_inode(fs, "/etc/app/missing", &again) == SUCCESS);
+    assert(fs_unlink(fs, "/etc/app/missing") == SUCCESS);
+    assert(fs_path_to_inode(fs, "/etc/app/missing", &again) == ERROR_NOT_FOUND);
+
+    // a hard link is visible right away
+    assert(fs_path_to_inode(fs, "/etc/alias", &again) == ERROR_NOT_FOUND);
+    assert(fs_link(fs, "/etc/app/conf", "/etc/alias") == SUCCESS);
+    assert(fs_path_to_inode(fs, "/etc/alias", &again) == SUCCESS);
+    assert(again == ino);
+
+    // a directory recreated under the same name (and likely the same inode)
+    // does not inherit the old names
+    assert(fs_mkdir(fs, "/tmp", 0755) == SUCCESS);
+    assert(fs_create(fs, "/tmp/f", 0644) == SUCCESS);
+    assert(fs_path_to_inode(fs, "/tmp/f", &again) == SUCCESS);
+    assert(fs_unlink(fs, "/tmp/f") == SUCCESS);
+    assert(fs_rmdir(fs, "/tmp") == SUCCESS);
+    assert(fs_path_to_inode(fs, "/tmp", &again) == ERROR_NOT_FOUND);
+    assert(fs_mkdir(fs, "/tmp", 0755) == SUCCESS);
+    assert(fs_path_to_inode(fs, "/tmp/f", &again) == ERROR_NOT_FOUND);
+    assert(fs_path_to_inode(fs, "/tmp/..", &again) == SUCCESS);
+    assert(again == ROOT_INODE_NUM);
+
+    fs_unmount(fs);
+
+    printf("test_fs_dcache PASSED\n\n");
+}
+
+void test_fs_parent_pointer() {
+    printf("Running test_fs_parent_pointer...\n");
+
+    remove(TEST_DISK);
+    disk_t disk = NULL;
+    int ret = disk_attach(TEST_DISK, 512 * 1000, true, &disk);
+    assert(ret == DISK_SUCCESS);
+    assert(fs_format(disk, 1000, 128) == SUCCESS);
+
+    filesystem_t* fs = NULL;
+    assert(fs_mount(disk, &fs) == SUCCESS);
+
+    assert(fs_mkdir(fs, "/a", 0755) == SUCCESS);
+    assert(fs_mkdir(fs, "/a/b", 0755) == SUCCESS);
+    assert(fs_create(fs, "/a/b/f", 0644) == SUCCESS);
+
+    uint32_t dir_b, ino;
+    assert(fs_path_to_inode(fs, "/a/b", &dir_b) == SUCCESS);
+    assert(fs_path_to_inode(fs, "/a/b/f", &ino) == SUCCESS);
+
+    // files and directories remember where they were created
+    struct inode inode;
+    assert(inode_read(fs, ino, &inode) == SUCCESS);
+    assert(inode.parent == dir_b);
+    assert(inode_read(fs, dir_b, &inode) == SUCCESS);
+    assert(inode.parent != INVALID_INODE_NUM);
+
+    char path[MAX_PATH];
+    assert(fs_inode_to_path(fs, ino, path, sizeof(path)) == SUCCESS);
+    assert(strcmp(path, "/a/b/f") == 0);
+
+    // a second link keeps the primary parent
+    assert(fs_link(fs, "/a/b/f", "/a/g") == SUCCESS);
+    assert(inode_read(fs, ino, &inode) == SUCCESS);
+    assert(inode.parent == dir_b);
+
+    // dropping the primary name clears the hint, and the next reverse
+    // lookup finds the remaining name and records it
+    assert(fs_unlink(fs, "/a/b/f") == SUCCESS);
+    assert(inode_read(fs, ino, &inode) == SUCCESS);
+    assert(inode.parent == INVALID_INODE_NUM);
+    assert(fs_inode_to_path(fs, ino, path, sizeof(path)) == SUCCESS);
+    assert(strcmp(path, "/a/g") == 0);
+
+    uint32_t dir_a;
+    assert(fs_path_to_inode(fs, "/a", &dir_a) == SUCCESS);
+    assert(inode_read(fs, ino, &inode) == SUCCESS);
+    assert(inode.parent == dir_a);
+
+    assert(fs_cd(fs, "/a/b") == SUCCESS);
+    assert(fs_getcwd(fs, path, sizeof(path)) == SUCCESS);
+    assert(strcmp(path, "/a/b") == 0);
+
+    fs_unmount(fs);
+
+    printf("test_fs_parent_pointer PASSED\n\n");
+}
+
+void test_fs_block_size() {
+    printf("Running test_fs_block_size...\n");
+
+    remove(TEST_DISK);
+    disk_t disk = NULL;
+    int ret = disk_attach(TEST_DISK, 8 * 1024 * 1024, true, &disk);
+    assert(ret == DISK_SUCCESS);
+
+    // not a power of two / rec_len records cannot span 64 KiB
+    fs_format_options_t bad = { .block_size = 1000 };
+    assert(fs_format_with_options(disk, 2048, 512, &bad) == ERROR_INVALID);
+    bad = (fs_format_options_t){ .block_size = 65536, .rec_len = true };
+    assert(fs_format_with_options(disk, 128, 512, &bad) == ERROR_INVALID);
+
+    fs_format_options_t fopts = { .block_size = 4096, .rec_len = true, .dir_index = true };
+    assert(fs_format_with_options(disk, 2048, 512, &fopts) == SUCCESS);
+
+    filesystem_t* fs = NULL;
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    assert(fs->sb.block_size == 4096);
+    assert(disk_get_block_size(disk) == 4096);
+
+    // past direct[] and well into the single-indirect tree
+    const size_t len = 3 * 1024 * 1024 + 123;
+    uint8_t* data = malloc(len);
+    assert(data);
+    for (size_t i = 0; i < len; i++)
+        data[i] = (uint8_t)(i * 7 % 251);
+
+    assert(fs_create(fs, "/big", 0644) == SUCCESS);
+    open_file_t* f = NULL;
+    assert(fs_open(fs, "/big", FS_O_RDWR, &f) == SUCCESS);
+    size_t written = 0;
+    assert(fs_write(f, data, len, &written) == SUCCESS);
+    assert(written == len);
+    fs_close(f);
+    free(data);
+
+    struct inode st;
+    assert(fs_stat(fs, "/big", &st, NULL, NULL, 0) == SUCCESS);
+    assert(st.size == len);
+    assert(st.blocks_used == (len + 4095) / 4096 + 1);      // data + one pointer block
+    check_pattern_file(fs, "/big", len);
+
+    assert(fs_mkdir(fs, "/d", 0755) == SUCCESS);
+    char name[32];
+    for (int i = 0; i < 400; i++) {
+        snprintf(name, sizeof(name), "/d/f%03d", i);
+        assert(fs_create(fs, name, 0644) == SUCCESS);
+    }
+    assert(fs_stat(fs, "/d", &st, NULL, NULL, 0) == SUCCESS);
+    assert(st.size == 2 * 4096);                            // 341 records per block
+
+    fs_unmount(fs);
+
+    // the geometry comes back from the superblock
+    ret = disk_attach(TEST_DISK, 0, false, &disk);
+    assert(ret == DISK_SUCCESS);
+    assert(disk_get_block_size(disk) == BLOCK_SIZE);
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    assert(disk_get_block_size(disk) == 4096);
+
+    check_pattern_file(fs, "/big", len);
+    uint32_t ino;
+    assert(fs_path_to_inode(fs, "/d/f399", &ino) == SUCCESS);
+
+    fs_unmount(fs);
+
+    printf("test_fs_block_size PASSED\n\n");
+}
+
+// drops a mounted filesystem the way a crash would: nothing is flushed
+static void simulate_crash(filesystem_t* fs) {
+    inode_cache_destroy(&fs->icache);
+    dcache_destroy(&fs->dcache);
+    chunk_cache_destroy(&fs->ccache);
+    journal_destroy(&fs->journal);
+    block_groups_destroy(fs);
+    bitmap_destroy(&fs->block_bitmap);
+    bitmap_destroy(&fs->inode_bitmap);
+    disk_detach(fs->disk);
+    free(fs);
+}
+
+void test_fs_journal() {
+    printf("Running test_fs_journal...\n");
+
+    remove(TEST_DISK);
+    disk_t disk = NULL;
+    int ret = disk_attach(TEST_DISK, 512 * 1000, true, &disk);
+    assert(ret == DISK_SUCCESS);
+
+    // the log needs a header and at least one log block
+    fs_format_options_t bad = { .journal_blocks = 1 };
+    assert(fs_format_with_options(disk, 1000, 128, &bad) == ERROR_INVALID);
+
+    fs_format_options_t fopts = { .journal_blocks = 64 };
+    assert(fs_format_with_options(disk, 1000, 128, &fopts) == SUCCESS);
+
+    filesystem_t* fs = NULL;
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    assert(fs->sb.features & FS_FEATURE_JOURNAL);
+    assert(fs->journal && fs->journal->blocks == 64);
+    assert(bitmap_get(fs->block_bitmap, fs->sb.journal_start));
+
+    // every operation commits one transaction
+    assert(fs_create(fs, "/a", 0644) == SUCCESS);
+    assert(fs_mkdir(fs, "/d", 0755) == SUCCESS);
+    assert(fs->journal->commits == 2);
+    assert(fs->journal->head > 1);
+
+    // a committed change torn in place after its commit comes back from the log
+    struct inode root;
+    assert(inode_read(fs, ROOT_INODE_NUM, &root) == SUCCESS);
+    uint32_t dir_block = root.direct[0];
+    simulate_crash(fs);
+
+    ret = disk_attach(TEST_DISK, 0, false, &disk);
+    assert(ret == DISK_SUCCESS);
+    char junk[512];
+    memset(junk, 0xA5, sizeof(junk));
+    assert(disk_write_block(disk, dir_block, junk) == DISK_SUCCESS);
+
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    struct inode st;
+    assert(fs_stat(fs, "/a", &st, NULL, NULL, 0) == SUCCESS);
+    assert(fs_stat(fs, "/d", &st, NULL, NULL, 0) == SUCCESS);
+    assert(st.type == INODE_TYPE_DIRECTORY);
+
+    // the log wraps with a checkpoint instead of growing
+    char name[32];
+    for (int i = 0; i < 40; i++) {
+        snprintf(name, sizeof(name), "/d/f%02d", i);
+        assert(fs_create(fs, name, 0644) == SUCCESS);
+    }
+    assert(fs->journal->checkpoints > 0);
+    assert(fs->journal->head <= fs->journal->blocks);
+    fs_unmount(fs);
+
+    // a clean unmount leaves nothing to replay
+    ret = disk_attach(TEST_DISK, 0, false, &disk);
+    assert(ret == DISK_SUCCESS);
+    struct superblock sb;
+    assert(superblock_read(disk, &sb) == SUCCESS);
+    struct journal* j = NULL;
+    uint32_t replayed = 1;
+    assert(journal_open(disk, &sb, &j, &replayed) == SUCCESS);
+    assert(replayed == 0);
+    journal_destroy(&j);
+
+    // group commit: one transaction per flush interval
+    fs_mount_options_t mopts = { .flush_policy = FS_FLUSH_EVERY_N, .flush_interval = 8 };
+    assert(fs_mount_with_options(disk, &mopts, &fs) == SUCCESS);
+    for (int i = 0; i < 16; i++) {
+        snprintf(name, sizeof(name), "/g%02d", i);
+        assert(fs_create(fs, name, 0644) == SUCCESS);
+    }
+    assert(fs->journal->commits == 2);
+    simulate_crash(fs);
+
+    ret = disk_attach(TEST_DISK, 0, false, &disk);
+    assert(ret == DISK_SUCCESS);
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    assert(fs_stat(fs, "/g15", &st, NULL, NULL, 0) == SUCCESS);
+    assert(fs_stat(fs, "/d/f39", &st, NULL, NULL, 0) == SUCCESS);
+    fs_unmount(fs);
+
+    // a transaction larger than the log is synced in place
+    ret = disk_attach(TEST_DISK, 512 * 1000, true, &disk);
+    assert(ret == DISK_SUCCESS);
+    fopts.journal_blocks = 4;
+    assert(fs_format_with_options(disk, 1000, 128, &fopts) == SUCCESS);
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    assert(fs_mkdir(fs, "/big", 0755) == SUCCESS);
+    assert(fs->journal->overflows > 0);
+    fs_unmount(fs);
+
+    ret = disk_attach(TEST_DISK, 0, false, &disk);
+    assert(ret == DISK_SUCCESS);
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    assert(fs_stat(fs, "/big", &st, NULL, NULL, 0) == SUCCESS);
+    fs_unmount(fs);
+
+    printf("test_fs_journal PASSED\n\n");
+}
+
+void test_fs_backends() {
+    printf("Running test_fs_backends...\n");
+
+    const disk_backend_t backends[] = { DISK_BACKEND_PREAD, DISK_BACKEND_URING };
+    for (int b = 0; b < 2; b++) {
+        remove(TEST_DISK);
+        disk_attach_options_t dopts = { backends[b], false };
+        disk_t disk = NULL;
+        int ret = disk_attach_with_options(TEST_DISK, 4 * 1024 * 1024, true, &dopts, &disk);
+        if (ret == DISK_ERROR_UNSUPPORTED) {
+            printf("Backend %s unavailable, skipped\n", disk_backend_name(backends[b]));
+            continue;
+        }
+        assert(ret == DISK_SUCCESS);
+
+        // the whole filesystem runs on buffered borrows
+        fs_format_options_t fopts = { .dir_index = true, .journal_blocks = 32 };
+        assert(fs_format_with_options(disk, 8192, 1024, &fopts) == SUCCESS);
+        filesystem_t* fs = NULL;
+        assert(fs_mount(disk, &fs) == SUCCESS);
+
+        assert(fs_mkdir(fs, "/d", 0755) == SUCCESS);
+        char name[32];
+        for (int i = 0; i < 100; i++) {
+            snprintf(name, sizeof(name), "/d/f%03d", i);
+            assert(fs_create(fs, name, 0644) == SUCCESS);
+        }
+        const size_t len = 300 * 1024 + 17;
+        uint8_t* data = malloc(len);
+        assert(data);
+        for (size_t i = 0; i < len; i++)
+            data[i] = (uint8_t)(i * 7 % 251);
+        assert(fs_create(fs, "/big", 0644) == SUCCESS);
+        open_file_t* f = NULL;
+        assert(fs_open(fs, "/big", FS_O_RDWR, &f) == SUCCESS);
+        size_t written = 0;
+        assert(fs_write(f, data, len, &written) == SUCCESS);
+        assert(written == len);
+        fs_close(f);
+        free(data);
+        check_pattern_file(fs, "/big", len);
+        assert(fs_unlink(fs, "/d/f050") == SUCCESS);
+        fs_unmount(fs);
+
+        // the image reads back the same through the mapping
+        assert(disk_attach(TEST_DISK, 0, false, &disk) == DISK_SUCCESS);
+        assert(fs_mount(disk, &fs) == SUCCESS);
+        check_pattern_file(fs, "/big", len);
+        uint32_t ino;
+        assert(fs_path_to_inode(fs, "/d/f099", &ino) == SUCCESS);
+        assert(fs_path_to_inode(fs, "/d/f050", &ino) == ERROR_NOT_FOUND);
+        fs_unmount(fs);
+
+        printf("Backend %s works\n", disk_backend_name(backends[b]));
+    }
+
+    printf("test_fs_backends PASSED\n\n");
+}
+
+void test_fs_readahead() {
+    printf("Running test_fs_readahead...\n");
+
+    remove(TEST_DISK);
+    disk_t disk = NULL;
+    assert(disk_attach(TEST_DISK, 4 * 1024 * 1024, true, &disk) == DISK_SUCCESS);
+    fs_format_options_t fopts = { .extents = true };
+    assert(fs_format_with_options(disk, 8192, 128, &fopts) == SUCCESS);
+    filesystem_t* fs = NULL;
+    assert(fs_mount(disk, &fs) == SUCCESS);
+
+    const size_t len = 2 * 1024 * 1024;
+    write_new_file(fs, "/big", len);
+    uint32_t file_blocks = (uint32_t)(len / BLOCK_SIZE);
+
+    // a stream: readahead starts at the first read and its window grows
+    open_file_t* f = NULL;
+    assert(fs_open(fs, "/big", FS_O_RDONLY, &f) == SUCCESS);
+    char buf[4096];
+    size_t got = 0;
+    assert(fs_read(f, buf, sizeof(buf), &got) == SUCCESS && got == sizeof(buf));
+    assert(f->ra.window > 0);
+    assert(f->ra.ahead_end > sizeof(buf) / BLOCK_SIZE);
+    uint32_t first_window = f->ra.window;
+
+    size_t total = got;
+    while (fs_read(f, buf, sizeof(buf), &got) == SUCCESS && got > 0) {
+        total += got;
+        assert(f->ra.ahead_end <= file_blocks);
+    }
+    assert(total == len);
+    assert(f->ra.window > first_window);
+    assert(f->ra.window <= FS_READAHEAD_MAX / BLOCK_SIZE);
+    assert(f->ra.ahead_end == file_blocks);
+    // every block past the first read was hinted, none twice
+    assert(f->ra.blocks == file_blocks - sizeof(buf) / BLOCK_SIZE);
+
+    // a seek elsewhere ends the stream, another read right after resumes one
+    assert(fs_seek(f, 1000 * 1000) == SUCCESS);
+    assert(fs_read(f, buf, 100, &got) == SUCCESS && got == 100);
+    assert(f->ra.window == 0);
+    uint64_t before = f->ra.blocks;
+    assert(fs_read(f, buf, 100, &got) == SUCCESS && got == 100);
+    assert(f->ra.window > 0 && f->ra.blocks > before);
+    fs_close(f);
+
+    // random reads never read ahead
+    assert(fs_open(fs, "/big", FS_O_RDONLY, &f) == SUCCESS);
+    for (int i = 0; i < 20; i++) {
+        assert(fs_seek(f, (uint32_t)((i * 7919 % 4000) * BLOCK_SIZE + 1)) == SUCCESS);
+        assert(fs_read(f, buf, 64, &got) == SUCCESS && got == 64);
+        assert(f->ra.window == 0);
+    }
+    assert(f->ra.blocks == 0);
+    assert(f->ra.random == 20);
+    fs_close(f);
+
+    fs_unmount(fs);
+
+    printf("test_fs_readahead PASSED\n\n");
+}
+
+#define CONCURRENT_WRITERS 4
+#define CONCURRENT_READERS 2
+#define CONCURRENT_FILES   16
+
+struct worker {
+    filesystem_t* fs;
+    int id;
+};
+
+static size_t concurrent_len(int id, int k) {
+    return 3000 + (size_t)k * 517 + (size_t)id * 61;
+}
+
+// creates, writes, verifies its own files, and unlinks every other one
+static void* concurrent_writer(void* arg) {
+    struct worker* w = arg;
+    char path[64];
+    snprintf(path, sizeof(path), "/w%d", w->id);
+    assert(fs_mkdir(w->fs, path, 0755) == SUCCESS);
+
+    uint8_t chunk[1000];
+    for (int k = 0; k < CONCURRENT_FILES; k++) {
+        snprintf(path, sizeof(path), "/w%d/f%02d", w->id, k);
+        open_file_t* f = NULL;
+        assert(fs_open(w->fs, path, FS_O_RDWR | FS_O_CREAT, &f) == SUCCESS);
+
+        size_t len = concurrent_len(w->id, k);
+        for (size_t pos = 0; pos < len; ) {
+            size_t n = (len - pos < sizeof(chunk)) ? len - pos : sizeof(chunk);
+            for (size_t i = 0; i < n; i++)
+                chunk[i] = (uint8_t)((pos + i) * 7 % 251);
+            size_t written = 0;
+            assert(fs_write(f, chunk, n, &written) == SUCCESS && written == n);
+            pos += n;
+        }
+        fs_close(f);
+
+        check_pattern_file(w->fs, path, len);
+        if (k % 2 == 1)
+            assert(fs_unlink(w->fs, path) == SUCCESS);
+    }
+    return NULL;
+}
+
+// reads a shared file over and over while the writers run
+static void* concurrent_reader(void* arg) {
+    struct worker* w = arg;
+    for (int round = 0; round < 20; round++) {
+        check_pattern_file(w->fs, "/shared", 64 * 1024);
+        struct inode st;
+        assert(fs_stat(w->fs, "/shared", &st, NULL, NULL, 0) == SUCCESS);
+        assert(st.size == 64 * 1024);
+    }
+    return NULL;
+}
+
+static void check_concurrent_result(filesystem_t* fs) {
+    char path[64];
+    for (int id = 0; id < CONCURRENT_WRITERS; id++) {
+        for (int k = 0; k < CONCURRENT_FILES; k++) {
+            snprintf(path, sizeof(path), "/w%d/f%02d", id, k);
+            uint32_t ino;
+            if (k % 2 == 1) {
+                assert(fs_path_to_inode(fs, path, &ino) == ERROR_NOT_FOUND);
+            } else {
+                check_pattern_file(fs, path, concurrent_len(id, k));
+            }
+        }
+    }
+
+    // the counters agree with the bitmaps
+    assert(fs->sb.free_blocks == (uint32_t)bitmap_count_free(fs->block_bitmap));
+    assert(fs->sb.free_inodes == (uint32_t)bitmap_count_free(fs->inode_bitmap));
+}
+
+static void run_concurrent(const fs_format_options_t* fopts) {
+    remove(TEST_DISK);
+    disk_t disk = NULL;
+    assert(disk_attach(TEST_DISK, 8 * 1024 * 1024, true, &disk) == DISK_SUCCESS);
+    assert(fs_format_with_options(disk, 16384, 512, fopts) == SUCCESS);
+    filesystem_t* fs = NULL;
+    assert(fs_mount(disk, &fs) == SUCCESS);
+
+    const size_t shared_len = 64 * 1024;
+    uint8_t* data = malloc(shared_len);
+    assert(data);
+    for (size_t i = 0; i < shared_len; i++)
+        data[i] = (uint8_t)(i * 7 % 251);
+    open_file_t* f = NULL;
+    assert(fs_open(fs, "/shared", FS_O_RDWR | FS_O_CREAT, &f) == SUCCESS);
+    size_t written = 0;
+    assert(fs_write(f, data, shared_len, &written) == SUCCESS && written == shared_len);
+    fs_close(f);
+    free(data);
+
+    pthread_t threads[CONCURRENT_WRITERS + CONCURRENT_READERS];
+    struct worker workers[CONCURRENT_WRITERS + CONCURRENT_READERS];
+    for (int i = 0; i < CONCURRENT_WRITERS + CONCURRENT_READERS; i++) {
+        workers[i] = (struct worker){ fs, i };
+        void* (*fn)(void*) = (i < CONCURRENT_WRITERS) ? concurrent_writer : concurrent_reader;
+        assert(pthread_create(&threads[i], NULL, fn, &workers[i]) == 0);
+    }
+    for (int i = 0; i < CONCURRENT_WRITERS + CONCURRENT_READERS; i++)
+        assert(pthread_join(threads[i], NULL) == 0);
+
+    check_concurrent_result(fs);
+    fs_unmount(fs);
+
+    // what every thread did reached the image
+    assert(disk_attach(TEST_DISK, 0, false, &disk) == DISK_SUCCESS);
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    check_concurrent_result(fs);
+    fs_unmount(fs);
+}
+
+void test_fs_concurrent() {
+    printf("Running test_fs_concurrent...\n");
+
+    fs_format_options_t fopts = { .dir_index = true, .journal_blocks = 64 };
+    run_concurrent(&fopts);
+
+    // each writer's directory gets a group of its own
+    fopts.block_groups = true;
+    fopts.blocks_per_group = 4096;
+    run_concurrent(&fopts);
+
+    printf("test_fs_concurrent PASSED\n\n");
+}
+
+#define GROUP_DIRS 3
+
+static uint32_t group_of(const filesystem_t* fs, uint32_t block) {
+    return block / fs->sb.blocks_per_group;
+}
+
+// the descriptors agree with the bitmaps and the superblock
+static void check_group_counters(filesystem_t* fs, uint32_t expect_dirs) {
+    uint32_t ipg = fs->sb.inodes_per_group;
+    uint64_t free_blocks = 0, free_inodes = 0, dirs = 0;
+    for (uint32_t g = 0; g < fs->sb.group_count; g++) {
+        const struct block_group* grp = &fs->groups[g];
+        uint32_t first = g * fs->sb.blocks_per_group;
+        assert(grp->desc.free_blocks == (grp->end_block - first) -
+               (uint32_t)bitmap_count_used_in(fs->block_bitmap, first, grp->end_block));
+        assert(grp->desc.free_inodes == ipg -
+               (uint32_t)bitmap_count_used_in(fs->inode_bitmap, g * ipg, (g + 1) * ipg));
+        free_blocks += grp->desc.free_blocks;
+        free_inodes += grp->desc.free_inodes;
+        dirs += grp->desc.used_dirs;
+    }
+    assert(free_blocks == fs->sb.free_blocks);
+    assert(free_inodes == fs->sb.free_inodes);
+    assert(dirs == expect_dirs);
+}
+
+void test_fs_block_groups() {
+    printf("Running test_fs_block_groups...\n");
+
+    remove(TEST_DISK);
+    disk_t disk = NULL;
+    assert(disk_attach(TEST_DISK, 8 * 1024 * 1024, true, &disk) == DISK_SUCCESS);
+
+    fs_format_options_t bad = { .block_groups = true, .blocks_per_group = 1000 };
+    assert(fs_format_with_options(disk, 16384, 1024, &bad) == ERROR_INVALID);
+
+    fs_format_options_t fopts = { .block_groups = true, .blocks_per_group = 4096,
+                                  .journal_blocks = 32 };
+    assert(fs_format_with_options(disk, 16384, 1024, &fopts) == SUCCESS);
+    filesystem_t* fs = NULL;
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    assert(fs->sb.group_count == 4);
+    assert(fs->sb.inodes_per_group == 256);
+    check_group_counters(fs, 1);
+
+    // top-level directories are spread over different groups, and the
+    // files inside them stay with their directory
+    char path[64];
+    uint32_t dir_group[GROUP_DIRS];
+    for (int d = 0; d < GROUP_DIRS; d++) {
+        snprintf(path, sizeof(path), "/d%d", d);
+        assert(fs_mkdir(fs, path, 0755) == SUCCESS);
+        uint32_t ino;
+        assert(fs_path_to_inode(fs, path, &ino) == SUCCESS);
+        dir_group[d] = ino / fs->sb.inodes_per_group;
+        for (int e = 0; e < d; e++)
+            assert(dir_group[e] != dir_group[d]);
+
+        for (int k = 0; k < 4; k++) {
+            snprintf(path, sizeof(path), "/d%d/f%d", d, k);
+            write_new_file(fs, path, 20000);
+            assert(fs_path_to_inode(fs, path, &ino) == SUCCESS);
+            assert(ino / fs->sb.inodes_per_group == dir_group[d]);
+
+            struct inode node;
+            assert(inode_read(fs, ino, &node) == SUCCESS);
+            assert(group_of(fs, node.direct[0]) == dir_group[d]);
+            assert(group_of(fs, node.direct[0] + node.blocks_used - 1) == dir_group[d]);
+        }
+    }
+    check_group_counters(fs, 1 + GROUP_DIRS);
+
+    // a file larger than a group moves on to the next ones
+    snprintf(path, sizeof(path), "/d%d/big", GROUP_DIRS - 1);
+    const size_t big_len = 2500 * 1024;
+    uint8_t* data = malloc(big_len);
+    assert(data);
+    for (size_t i = 0; i < big_len; i++)
+        data[i] = (uint8_t)(i * 7 % 251);
+    open_file_t* f = NULL;
+    assert(fs_open(fs, path, FS_O_RDWR | FS_O_CREAT, &f) == SUCCESS);
+    size_t written = 0;
+    assert(fs_write(f, data, big_len, &written) == SUCCESS && written == big_len);
+    fs_close(f);
+    free(data);
+    check_pattern_file(fs, path, big_len);
+
+    assert(fs_unlink(fs, "/d0/f1") == SUCCESS);
+    assert(fs_rmdir(fs, "/d1") == ERROR_GENERIC);
+    for (int k = 0; k < 4; k++) {
+        snprintf(path, sizeof(path), "/d1/f%d", k);
+        assert(fs_unlink(fs, path) == SUCCESS);
+    }
+    assert(fs_rmdir(fs, "/d1") == SUCCESS);
+    check_group_counters(fs, GROUP_DIRS);
+    fs_unmount(fs);
+
+    // the descriptor table survives a remount
+    assert(disk_attach(TEST_DISK, 0, false, &disk) == DISK_SUCCESS);
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    check_group_counters(fs, GROUP_DIRS);
+    snprintf(path, sizeof(path), "/d%d/big", GROUP_DIRS - 1);
+    check_pattern_file(fs, path, big_len);
+    fs_unmount(fs);
+
+    printf("test_fs_block_groups PASSED\n\n");
+}
+
+#define POSITIONAL_THREADS 4
+#define POSITIONAL_RECORD  700
+
+struct positional_worker {
+    open_file_t* file;
+    int id;
+};
+
+// each thread fills and checks every POSITIONAL_THREADS-th record of a shared handle
+static void* positional_worker(void* arg) {
+    struct positional_worker* w = arg;
+    uint8_t rec[POSITIONAL_RECORD], back[POSITIONAL_RECORD];
+    for (int r = w->id; r < 64; r += POSITIONAL_THREADS) {
+        uint32_t off = (uint32_t)r * POSITIONAL_RECORD;
+        for (int i = 0; i < POSITIONAL_RECORD; i++)
+            rec[i] = (uint8_t)((off + i) * 7 % 251);
+        size_t n = 0;
+        assert(fs_pwrite(w->file, rec, sizeof(rec), off, &n) == SUCCESS && n == sizeof(rec));
+        assert(fs_pread(w->file, back, sizeof(back), off, &n) == SUCCESS && n == sizeof(back));
+        assert(memcmp(rec, back, sizeof(rec)) == 0);
+    }
+    return NULL;
+}
+
+void test_fs_positional_io() {
+    printf("Running test_fs_positional_io...\n");
+
+    remove(TEST_DISK);
+    disk_t disk = NULL;
+    assert(disk_attach(TEST_DISK, 4 * 1024 * 1024, true, &disk) == DISK_SUCCESS);
+    assert(fs_format(disk, 8192, 256) == SUCCESS);
+    filesystem_t* fs = NULL;
+    fs_mount_options_t mopts = { .flush_policy = FS_FLUSH_ON_SYNC, .flush_interval = 0 };
+    assert(fs_mount_with_options(disk, &mopts, &fs) == SUCCESS);
+
+    // records written out of order through one shared handle
+    open_file_t* f = NULL;
+    assert(fs_open(fs, "/records", FS_O_RDWR | FS_O_CREAT, &f) == SUCCESS);
+    pthread_t threads[POSITIONAL_THREADS];
+    struct positional_worker workers[POSITIONAL_THREADS];
+    for (int i = 0; i < POSITIONAL_THREADS; i++) {
+        workers[i] = (struct positional_worker){ f, POSITIONAL_THREADS - 1 - i };
+        assert(pthread_create(&threads[i], NULL, positional_worker, &workers[i]) == 0);
+    }
+    for (int i = 0; i < POSITIONAL_THREADS; i++)
+        assert(pthread_join(threads[i], NULL) == 0);
+    assert(f->offset == 0);
+    check_pattern_file(fs, "/records", 64 * POSITIONAL_RECORD);
+
+    // short read at the end, nothing past it
+    uint8_t buf[100];
+    size_t n = 0;
+    assert(fs_pread(f, buf, sizeof(buf), 64 * POSITIONAL_RECORD - 40, &n) == SUCCESS && n == 40);
+    assert(fs_pread(f, buf, sizeof(buf), 64 * POSITIONAL_RECORD + 5, &n) == SUCCESS && n == 0);
+    fs_close(f);
+
+    // a batch of records is one metadata commit
+    char a[300], b[1500], c[5];
+    memset(a, 'a', sizeof(a));
+    memset(b, 'b', sizeof(b));
+    memset(c, 'c', sizeof(c));
+    struct iovec batch[] = { { a, sizeof(a) }, { NULL, 0 }, { b, sizeof(b) }, { c, sizeof(c) } };
+    assert(fs_open(fs, "/batch", FS_O_RDWR | FS_O_CREAT, &f) == SUCCESS);
+    uint32_t ops_before = fs->ops_since_flush;
+    assert(fs_writev(f, batch, 4, &n) == SUCCESS);
+    assert(n == sizeof(a) + sizeof(b) + sizeof(c));
+    assert(fs->ops_since_flush == ops_before + 1);
+    assert(f->offset == n);
+
+    // read back across the buffer boundaries, the last one short
+    char x[1000], y[1000];
+    struct iovec out[] = { { x, sizeof(x) }, { y, sizeof(y) } };
+    assert(fs_seek(f, 0) == SUCCESS);
+    assert(fs_readv(f, out, 2, &n) == SUCCESS);
+    assert(n == sizeof(a) + sizeof(b) + sizeof(c));
+    assert(f->offset == n);
+    assert(memcmp(x, a, sizeof(a)) == 0);
+    assert(memcmp(x + sizeof(a), b, sizeof(x) - sizeof(a)) == 0);
+    assert(memcmp(y, b + sizeof(x) - sizeof(a), sizeof(b) - (sizeof(x) - sizeof(a))) == 0);
+    assert(memcmp(y + n - sizeof(x) - sizeof(c), c, sizeof(c)) == 0);
+
+    struct iovec bad[] = { { NULL, 10 } };
+    assert(fs_writev(f, bad, 1, &n) == ERROR_INVALID);
+    assert(fs_readv(f, out, -1, &n) == ERROR_INVALID);
+    fs_close(f);
+
+    assert(fs_open(fs, "/batch", FS_O_RDONLY, &f) == SUCCESS);
+    assert(fs_pwrite(f, a, sizeof(a), 0, &n) == ERROR_PERMISSION);
+    fs_close(f);
+    fs_unmount(fs);
+
+    // everything reached the image
+    assert(disk_attach(TEST_DISK, 0, false, &disk) == DISK_SUCCESS);
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    check_pattern_file(fs, "/records", 64 * POSITIONAL_RECORD);
+    struct inode st;
+    assert(fs_stat(fs, "/batch", &st, NULL, NULL, 0) == SUCCESS);
+    assert(st.size == sizeof(a) + sizeof(b) + sizeof(c));
+    fs_unmount(fs);
+
+    printf("test_fs_positional_io PASSED\n\n");
+}
+
+// reads the first bytes of an open file
+static void read_some(open_file_t* f) {
+    char buf[16];
+    size_t n = 0;
+    assert(fs_pread(f, buf, sizeof(buf), 0, &n) == SUCCESS && n == sizeof(buf));
+}
+
+// access time in the inode table, bypassing the cache
+static time_t disk_atime(filesystem_t* fs, uint32_t ino) {
+    struct inode node;
+    assert(inode_load(fs, ino, &node) == SUCCESS);
+    return node.accessed_time;
+}
+
+void test_fs_atime() {
+    printf("Running test_fs_atime...\n");
+
+    remove(TEST_DISK);
+    disk_t disk = NULL;
+    assert(disk_attach(TEST_DISK, 512 * 1000, true, &disk) == DISK_SUCCESS);
+    assert(fs_format(disk, 1000, 128) == SUCCESS);
+
+    filesystem_t* fs = NULL;
+    fs_mount_options_t bad = { .flush_policy = FS_FLUSH_PER_OP, .flush_interval = 1, .atime = (fs_atime_mode_t)7, .lazytime = false };
+    assert(fs_mount_with_options(disk, &bad, &fs) == ERROR_INVALID);
+
+    // noatime: reads leave the inode alone
+    fs_mount_options_t opts = { .flush_policy = FS_FLUSH_PER_OP, .flush_interval = 1, .atime = FS_ATIME_NOATIME, .lazytime = false };
+    assert(fs_mount_with_options(disk, &opts, &fs) == SUCCESS);
+    write_new_file(fs, "/f", 100);
+    uint32_t ino;
+    assert(fs_path_to_inode(fs, "/f", &ino) == SUCCESS);
+    open_file_t* f = NULL;
+    assert(fs_open(fs, "/f", FS_O_RDONLY, &f) == SUCCESS);
+    f->inode->accessed_time = 1000;
+    f->inode->modified_time = 2000;
+    inode_cache_mark_dirty(fs, ino);
+    assert(fs_sync(fs) == SUCCESS);
+    read_some(f);
+    assert(f->inode->accessed_time == 1000);
+    fs_close(f);
+    fs_unmount(fs);
+
+    // relatime: only an access time not newer than the last change, or a day old
+    assert(disk_attach(TEST_DISK, 0, false, &disk) == DISK_SUCCESS);
+    opts.atime = FS_ATIME_RELATIME;
+    assert(fs_mount_with_options(disk, &opts, &fs) == SUCCESS);
+    assert(fs_open(fs, "/f", FS_O_RDONLY, &f) == SUCCESS);
+    assert(f->inode->accessed_time == 1000);
+    read_some(f);
+    assert(f->inode->accessed_time > 2000);   // older than the modification
+
+    time_t recent = time(NULL) - 60;
+    f->inode->accessed_time = recent;
+    read_some(f);
+    assert(f->inode->accessed_time == recent);
+
+    f->inode->accessed_time = time(NULL) - FS_RELATIME_INTERVAL - 1;
+    read_some(f);
+    assert(f->inode->accessed_time >= time(NULL) - 1);
+    fs_close(f);
+    fs_unmount(fs);
+
+    // lazytime: kept in memory while the file is open, even across flushes
+    assert(disk_attach(TEST_DISK, 0, false, &disk) == DISK_SUCCESS);
+    opts.atime = FS_ATIME_STRICT;
+    opts.lazytime = true;
+    assert(fs_mount_with_options(disk, &opts, &fs) == SUCCESS);
+    assert(fs_open(fs, "/f", FS_O_RDONLY, &f) == SUCCESS);
+    f->inode->accessed_time = 1000;
+    inode_cache_mark_dirty(fs, ino);
+    assert(fs_create(fs, "/flush1", 0644) == SUCCESS);
+    assert(disk_atime(fs, ino) == 1000);
+
+    read_some(f);
+    time_t stamped = f->inode->accessed_time;
+    assert(stamped > 1000);
+    assert(fs_create(fs, "/flush2", 0644) == SUCCESS);
+    assert(disk_atime(fs, ino) == 1000);
+
+    // fs_sync writes it
+    assert(fs_sync(fs) == SUCCESS);
+    assert(disk_atime(fs, ino) == stamped);
+
+    // and so does the first flush after the last close
+    f->inode->accessed_time = 1000;
+    read_some(f);
+    time_t on_disk = disk_atime(fs, ino);
+    stamped = f->inode->accessed_time;
+    fs_close(f);
+    assert(disk_atime(fs, ino) == on_disk);
+    assert(fs_create(fs, "/flush3", 0644) == SUCCESS);
+    assert(disk_atime(fs, ino) == stamped);
+    fs_unmount(fs);
+
+    printf("test_fs_atime PASSED\n\n");
+}
+
+void test_fs_write_buffer() {
+    printf("Running test_fs_write_buffer...\n");
+
+    remove(TEST_DISK);
+    disk_t disk = NULL;
+    assert(disk_attach(TEST_DISK, 4 * 1024 * 1024, true, &disk) == DISK_SUCCESS);
+    fs_format_options_t fopts = { .extents = true };
+    assert(fs_format_with_options(disk, 8192, 256, &fopts) == SUCCESS);
+    filesystem_t* fs = NULL;
+    fs_mount_options_t mopts = { FS_FLUSH_ON_SYNC, 0, FS_ATIME_STRICT, false, false };
+    assert(fs_mount_with_options(disk, &mopts, &fs) == SUCCESS);
+
+    // 100-byte appends touch the file only when the buffer fills
+    const size_t record = 100, records = 1000, total = record * records;
+    open_file_t* f = NULL;
+    assert(fs_open(fs, "/log", FS_O_WRONLY | FS_O_CREAT | FS_O_BUFFERED, &f) == SUCCESS);
+    uint32_t ops_before = fs->ops_since_flush;
+    uint8_t rec[100];
+    for (size_t r = 0; r < records; r++) {
+        for (size_t i = 0; i < record; i++)
+            rec[i] = (uint8_t)((r * record + i) * 7 % 251);
+        size_t n = 0;
+        assert(fs_write(f, rec, record, &n) == SUCCESS && n == record);
+    }
+    assert(fs->ops_since_flush == ops_before + total / FS_WRITE_BUFFER);
+    assert(f->offset == total);
+
+    struct inode st;
+    assert(fs_stat(fs, "/log", &st, NULL, NULL, 0) == SUCCESS);
+    assert(st.size == (total / FS_WRITE_BUFFER) * FS_WRITE_BUFFER);
+
+    // the rest lands on close, in one run of blocks
+    assert(fs_close(f) == SUCCESS);
+    check_pattern_file(fs, "/log", total);
+    uint32_t ino, phys, run;
+    assert(fs_path_to_inode(fs, "/log", &ino) == SUCCESS);
+    assert(inode_read(fs, ino, &st) == SUCCESS);
+    uint32_t blocks = (uint32_t)((total + fs_block_size(fs) - 1) / fs_block_size(fs));
+    assert(bmap_lookup(fs, &st, NULL, 0, blocks, &phys, &run) == SUCCESS);
+    assert(phys != 0 && run == blocks);
+
+    // reads and seeks through the handle see the pending bytes
+    assert(fs_open(fs, "/log", FS_O_RDWR | FS_O_APPEND | FS_O_BUFFERED, &f) == SUCCESS);
+    size_t n = 0;
+    assert(fs_write(f, "tail", 4, &n) == SUCCESS && n == 4);
+    char back[4];
+    assert(fs_pread(f, back, 4, (uint32_t)total, &n) == SUCCESS && n == 4);
+    assert(memcmp(back, "tail", 4) == 0);
+
+    assert(fs_write(f, "more", 4, &n) == SUCCESS);
+    assert(fs_seek(f, 0) == SUCCESS);
+    assert(fs_stat(fs, "/log", &st, NULL, NULL, 0) == SUCCESS);
+    assert(st.size == total + 8);
+
+    // a write elsewhere flushes first, and fs_fsync makes it durable
+    assert(fs_write(f, rec, 10, &n) == SUCCESS);
+    assert(fs_pwrite(f, "TAIL", 4, (uint32_t)total, &n) == SUCCESS);
+    assert(fs_fsync(f) == SUCCESS);
+    fs_close(f);
+    fs_unmount(fs);
+
+    assert(disk_attach(TEST_DISK, 0, false, &disk) == DISK_SUCCESS);
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    assert(fs_open(fs, "/log", FS_O_RDONLY, &f) == SUCCESS);
+    char head[10], end[8];
+    assert(fs_read(f, head, sizeof(head), &n) == SUCCESS && n == sizeof(head));
+    assert(memcmp(head, rec, sizeof(head)) == 0);
+    assert(fs_pread(f, end, sizeof(end), (uint32_t)total, &n) == SUCCESS && n == sizeof(end));
+    assert(memcmp(end, "TAILmore", 8) == 0);
+    fs_close(f);
+    fs_unmount(fs);
+
+    printf("test_fs_write_buffer PASSED\n\n");
+}
+
+void test_fs_truncate_fallocate() {
+    printf("Running test_fs_truncate_fallocate...\n");
+
+    remove(TEST_DISK);
+    disk_t disk = NULL;
+    assert(disk_attach(TEST_DISK, 4 * 1024 * 1024, true, &disk) == DISK_SUCCESS);
+    fs_format_options_t fopts = { .extents = true };
+    assert(fs_format_with_options(disk, 8192, 256, &fopts) == SUCCESS);
+    filesystem_t* fs = NULL;
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    assert(fs_create(fs, "/f", 0644) == SUCCESS);
+    assert(fs_create(fs, "/big", 0644) == SUCCESS);
+    uint32_t baseline = fs->sb.free_blocks;
+
+    // shrinking to a partial block keeps the head and zeroes the rest
+    open_file_t* f = NULL;
+    assert(fs_open(fs, "/f", FS_O_RDWR, &f) == SUCCESS);
+    write_pattern(f, 10000);
+    fs_close(f);
+    assert(fs->sb.free_blocks == baseline - 20);
+
+    assert(fs_truncate(fs, "/f", 3000) == SUCCESS);
+    assert(fs->sb.free_blocks == baseline - 6);
+    check_pattern_file(fs, "/f", 3000);
+
+    assert(fs_truncate(fs, "/f", 5000) == SUCCESS);
+    assert(fs->sb.free_blocks == baseline - 6);
+    struct inode st;
+    assert(fs_stat(fs, "/f", &st, NULL, NULL, 0) == SUCCESS && st.size == 5000);
+    uint8_t tail[4096];
+    size_t n = 0;
+    assert(fs_open(fs, "/f", FS_O_RDWR, &f) == SUCCESS);
+    assert(fs_pread(f, tail, 2000, 3000, &n) == SUCCESS && n == 2000);
+    for (size_t i = 0; i < 2000; i++)
+        assert(tail[i] == 0);
+
+    assert(fs_ftruncate(f, 0) == SUCCESS);
+    assert(fs->sb.free_blocks == baseline);
+    fs_close(f);
+
+    assert(fs_truncate(fs, "/", 0) == ERROR_INVALID);
+    assert(fs_truncate(fs, "/missing", 0) == ERROR_NOT_FOUND);
+
+    // a preallocated file is one extent, and writing it allocates nothing
+    const uint32_t big = 1024 * 1024;
+    assert(fs_open(fs, "/big", FS_O_RDWR, &f) == SUCCESS);
+    assert(fs_fallocate(f, 0, 0, 0) == ERROR_INVALID);
+    assert(fs_fallocate(f, 0, big, 2) == ERROR_INVALID);
+    assert(fs_fallocate(f, 0, big, 0) == SUCCESS);
+    assert(fs->sb.free_blocks == baseline - big / 512);
+    assert(fs_stat(fs, "/big", &st, NULL, NULL, 0) == SUCCESS && st.size == big);
+
+    struct extent ext[BMAP_MAX_EXTENTS];
+    uint32_t count = 0;
+    assert(bmap_get_extents(fs, f->inode, ext, BMAP_MAX_EXTENTS, &count) == SUCCESS);
+    assert(count == 1 && ext[0].length == big / 512);
+
+    uint32_t free_before_write = fs->sb.free_blocks;
+    write_pattern(f, big);
+    assert(fs->sb.free_blocks == free_before_write);
+    check_pattern_file(fs, "/big", big);
+
+    // past the end without growing the file: appends use the reserve
+    assert(fs_fallocate(f, big, 8192, FS_FALLOC_KEEP_SIZE) == SUCCESS);
+    assert(fs->sb.free_blocks == free_before_write - 16);
+    assert(fs_stat(fs, "/big", &st, NULL, NULL, 0) == SUCCESS && st.size == big);
+    assert(fs_pread(f, tail, sizeof(tail), big, &n) == SUCCESS && n == 0);
+    assert(fs_pwrite(f, tail, sizeof(tail), big, &n) == SUCCESS && n == sizeof(tail));
+    assert(fs->sb.free_blocks == free_before_write - 16);
+
+    // truncating to the size drops the unused part of the reserve
+    assert(fs_ftruncate(f, big + 4096) == SUCCESS);
+    assert(fs->sb.free_blocks == free_before_write - 8);
+    fs_close(f);
+
+    assert(fs_open(fs, "/big", FS_O_RDONLY, &f) == SUCCESS);
+    assert(fs_fallocate(f, 0, 10, 0) == ERROR_PERMISSION);
+    assert(fs_ftruncate(f, 0) == ERROR_PERMISSION);
+    fs_close(f);
+    fs_unmount(fs);
+
+    // the counters agree with the bitmaps after a remount
+    assert(disk_attach(TEST_DISK, 0, false, &disk) == DISK_SUCCESS);
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    assert(fs->sb.free_blocks == (uint32_t)bitmap_count_free(fs->block_bitmap));
+    check_pattern_file(fs, "/big", big);
+    fs_unmount(fs);
+
+    printf("test_fs_truncate_fallocate PASSED\n\n");
+}
+
+// reads the rest of a directory stream in batches of `batch`, marking each
+// "fNNN" entry in seen (and failing on duplicates); returns the entry count
+static uint32_t drain_dir(fs_dir_t* dir, uint32_t batch, bool* seen) {
+    struct dentry buf[8];
+    uint32_t total = 0, count;
+    while (true) {
+        assert(fs_readdir(dir, buf, batch, &count) == SUCCESS);
+        if (count == 0)
+            break;
+        assert(count <= batch);
+        for (uint32_t i = 0; i < count; i++) {
+            if (buf[i].name[0] == 'f') {
+                int k = atoi(buf[i].name + 1);
+                assert(!seen[k]);
+                seen[k] = true;
+            }
+        }
+        total += count;
+    }
+    return total;
+}
+
+static void check_readdir(const fs_format_options_t* fopts) {
+    remove(TEST_DISK);
+    disk_t disk = NULL;
+    assert(disk_attach(TEST_DISK, 512 * 2000, true, &disk) == DISK_SUCCESS);
+    assert(fs_format_with_options(disk, 2000, 512, fopts) == SUCCESS);
+    filesystem_t* fs = NULL;
+    assert(fs_mount(disk, &fs) == SUCCESS);
+
+    const int n = 100;
+    char path[64];
+    assert(fs_mkdir(fs, "/d", 0755) == SUCCESS);
+    for (int i = 0; i < n; i++) {
+        snprintf(path, sizeof(path), "/d/f%03d", i);
+        assert(fs_create(fs, path, 0644) == SUCCESS);
+    }
+    // emptied blocks become holes the stream has to step over
+    for (int i = 20; i < 60; i++) {
+        snprintf(path, sizeof(path), "/d/f%03d", i);
+        assert(fs_unlink(fs, path) == SUCCESS);
+    }
+
+    // every batch size yields each entry exactly once
+    fs_dir_t* dir = NULL;
+    assert(fs_opendir(fs, "/d", &dir) == SUCCESS);
+    for (uint32_t batch = 1; batch <= 8; batch += 7) {
+        bool seen[100] = { false };
+        fs_seekdir(dir, 0);
+        assert(drain_dir(dir, batch, seen) == (uint32_t)(n - 40) + 2);
+        for (int i = 0; i < n; i++)
+            assert(seen[i] == (i < 20 || i >= 60));
+    }
+
+    // a saved position resumes where it was taken, on another stream too
+    fs_seekdir(dir, 0);
+    bool rest[100] = { false }, again[100] = { false };
+    struct dentry buf[8];
+    uint32_t count;
+    assert(fs_readdir(dir, buf, 8, &count) == SUCCESS && count == 8);
+    uint32_t mark = fs_telldir(dir);
+    uint32_t tail = drain_dir(dir, 3, rest);
+    fs_dir_t* other = NULL;
+    assert(fs_opendir(fs, "/d", &other) == SUCCESS);
+    fs_seekdir(other, mark);
+    assert(drain_dir(other, 5, again) == tail);
+    assert(memcmp(rest, again, sizeof(rest)) == 0);
+    fs_closedir(other);
+
+    // at the end the stream keeps returning nothing
+    assert(fs_readdir(dir, buf, 8, &count) == SUCCESS && count == 0);
+    fs_closedir(dir);
+
+    assert(fs_opendir(fs, "/d/f000", &dir) == ERROR_INVALID);
+    assert(fs_opendir(fs, "/nope", &dir) == ERROR_NOT_FOUND);
+
+    fs_unmount(fs);
+}
+
+void test_fs_readdir() {
+    printf("Running test_fs_readdir...\n");
+
+    fs_format_options_t fixed = { 0 };
+    check_readdir(&fixed);
+    fs_format_options_t rec_len = { .rec_len = true, .dir_index = true };
+    check_readdir(&rec_len);
+
+    printf("test_fs_readdir PASSED\n\n");
+}
+
+static uint64_t hist_total(const struct perf_op_stats* op) {
+    uint64_t total = 0;
+    for (int i = 0; i < PERF_HIST_BUCKETS; i++)
+        total += op->hist[i];
+    return total;
+}
+
+void test_fs_perf() {
+    printf("Running test_fs_perf...\n");
+    if (!perf_enabled()) {
+        printf("test_fs_perf SKIPPED (built without FS_PERF)\n\n");
+        return;
+    }
+
+    remove(TEST_DISK);
+    disk_t disk = NULL;
+    assert(disk_attach(TEST_DISK, 512 * 2000, true, &disk) == DISK_SUCCESS);
+    assert(fs_format(disk, 2000, 256) == SUCCESS);
+    filesystem_t* fs = NULL;
+    assert(fs_mount(disk, &fs) == SUCCESS);
+
+    perf_reset();
+    assert(fs_mkdir(fs, "/d", 0755) == SUCCESS);
+    assert(fs_create(fs, "/d/a", 0644) == SUCCESS);
+    assert(fs_create(fs, "/d/b", 0644) == SUCCESS);
+    assert(fs_create(fs, "/d/c", 0644) == SUCCESS);
+    assert(fs_create(fs, "/d/a", 0644) == ERROR_EXISTS);
+
+    open_file_t* f = NULL;
+    assert(fs_open(fs, "/d/a", FS_O_RDWR, &f) == SUCCESS);
+    write_pattern(f, 3000);
+    fs_close(f);
+    check_pattern_file(fs, "/d/a", 3000);
+    struct inode st;
+    assert(fs_stat(fs, "/d/b", &st, NULL, NULL, 0) == SUCCESS);
+    assert(fs_sync(fs) == SUCCESS);
+
+    // failed calls are timed too, and every call lands in one bucket
+    struct perf_stats stats;
+    perf_snapshot(&stats);
+    assert(stats.ops[PERF_OP_CREATE].calls == 4);
+    assert(stats.ops[PERF_OP_MKDIR].calls == 1);
+    assert(stats.ops[PERF_OP_OPEN].calls == 2);
+    assert(stats.ops[PERF_OP_CLOSE].calls == 2);
+    assert(stats.ops[PERF_OP_STAT].calls == 1);
+    assert(stats.ops[PERF_OP_UNLINK].calls == 0);
+    for (int op = 0; op < PERF_NUM_OPS; op++) {
+        const struct perf_op_stats* o = &stats.ops[op];
+        assert(hist_total(o) == o->calls);
+        assert(o->max_ns <= o->total_ns);
+        if (o->calls > 0)
+            assert(perf_op_percentile(o, 50) <= perf_op_percentile(o, 99));
+    }
+
+    // each layer below the api saw some work
+    assert(stats.counters[PERF_DISK_BLOCKS_WRITTEN] > 0);
+    assert(stats.counters[PERF_INODE_WRITES] > 0);
+    assert(stats.counters[PERF_DENTRY_BLOCKS_SCANNED] > 0);
+    assert(stats.counters[PERF_BITMAP_BITS_SCANNED] > 0);
+    assert(stats.counters[PERF_PATH_COMPONENTS] >= 4 * 2);
+    assert(stats.counters[PERF_DISK_SYNCS] > 0);
+
+    perf_reset();
+    perf_snapshot(&stats);
+    for (int c = 0; c < PERF_NUM_COUNTERS; c++)
+        assert(stats.counters[c] == 0);
+    for (int op = 0; op < PERF_NUM_OPS; op++)
+        assert(stats.ops[op].calls == 0 && hist_total(&stats.ops[op]) == 0);
+
+    fs_unmount(fs);
+    printf("test_fs_perf PASSED\n\n");
+}
+
+void test_fs_trace() {
+    printf("Running test_fs_trace...\n");
+    if (!trace_compiled()) {
+        printf("test_fs_trace SKIPPED (built without FS_TRACE)\n\n");
+        return;
+    }
+
+    remove(TEST_DISK);
+    disk_t disk = NULL;
+    assert(disk_attach(TEST_DISK, 512 * 2000, true, &disk) == DISK_SUCCESS);
+    assert(fs_format(disk, 2000, 256) == SUCCESS);
+    filesystem_t* fs = NULL;
+    assert(fs_mount(disk, &fs) == SUCCESS);
+
+    // nothing is recorded until tracing is switched on
+    trace_clear();
+    assert(fs_mkdir(fs, "/t", 0755) == SUCCESS);
+    struct trace_event* events = malloc(sizeof(struct trace_event) * TRACE_RING_SIZE);
+    assert(events);
+    assert(trace_snapshot(events, TRACE_RING_SIZE) == 0);
+
+    trace_enable(true);
+    assert(fs_create(fs, "/t/f", 0644) == SUCCESS);
+    open_file_t* f = NULL;
+    assert(fs_open(fs, "/t/f", FS_O_RDWR, &f) == SUCCESS);
+    write_pattern(f, 5000);
+    uint8_t buf[1000];
+    size_t n = 0;
+    assert(fs_pread(f, buf, sizeof(buf), 100, &n) == SUCCESS && n == sizeof(buf));
+    uint32_t ino = f->inode_num;
+    struct inode st;
+    fs_close(f);
+    assert(fs_unlink(fs, "/t/missing") == ERROR_NOT_FOUND);
+    trace_enable(false);
+    assert(fs_stat(fs, "/t/f", &st, NULL, NULL, 0) == SUCCESS);
+
+    // one event per call, in call order, with what each call did
+    size_t count = trace_snapshot(events, TRACE_RING_SIZE);
+    assert(count == 5);
+    const uint16_t ops[] = { PERF_OP_CREATE, PERF_OP_OPEN, PERF_OP_WRITE, PERF_OP_PREAD, PERF_OP_UNLINK };
+    for (size_t i = 0; i < count; i++) {
+        assert(events[i].seq == i + 1);
+        assert(events[i].op == ops[i]);
+        assert(events[i].thread > 0);
+    }
+    assert(strcmp(events[0].path, "/t/f") == 0);
+    assert(events[1].inode_num == ino && events[1].bytes == 0);
+    assert(events[2].inode_num == ino && events[2].bytes == 5000 && events[2].path[0] == '\0');
+    assert(events[2].blocks >= 10);
+    assert(events[3].bytes == sizeof(buf) && events[3].blocks > 0);
+    assert(events[4].inode_num == TRACE_NO_INODE && strcmp(events[4].path, "/t/missing") == 0);
+
+    // the binary file holds exactly the ring
+    const char* trace_file = "test_trace.bin";
+    assert(trace_save(trace_file) == SUCCESS);
+    struct trace_event* loaded = NULL;
+    size_t loaded_count = 0;
+    assert(trace_load(trace_file, &loaded, &loaded_count) == SUCCESS);
+    assert(loaded_count == count && memcmp(loaded, events, count * sizeof(*events)) == 0);
+    free(loaded);
+    assert(trace_load(TEST_DISK, &loaded, &loaded_count) == ERROR_INVALID);
+    remove(trace_file);
+
+    // long paths keep their tail
+    char path[128] = "/t/";
+    memset(path + 3, 'x', 80);
+    path[83] = '\0';
+    trace_clear();
+    trace_enable(true);
+    assert(fs_stat(fs, path, &st, NULL, NULL, 0) == ERROR_NOT_FOUND);
+    assert(trace_snapshot(events, TRACE_RING_SIZE) == 1);
+    assert(strlen(events[0].path) == TRACE_PATH_LEN - 1);
+    assert(strcmp(events[0].path, path + 84 - TRACE_PATH_LEN) == 0);
+
+    // a full ring keeps the newest events
+    for (int i = 0; i < TRACE_RING_SIZE + 10; i++)
+        assert(fs_stat(fs, "/t/f", &st, NULL, NULL, 0) == SUCCESS);
+    trace_enable(false);
+    count = trace_snapshot(events, TRACE_RING_SIZE);
+    assert(count == TRACE_RING_SIZE);
+    for (size_t i = 0; i < count; i++)
+        assert(events[i].seq == 12 + i && events[i].op == PERF_OP_STAT);
+    assert(trace_snapshot(events, 3) == 3 && events[2].seq == TRACE_RING_SIZE + 11);
+
+    trace_clear();
+    assert(trace_snapshot(events, TRACE_RING_SIZE) == 0);
+    free(events);
+    fs_unmount(fs);
+    printf("test_fs_trace PASSED\n\n");
+}
+
+// mounts TEST_DISK with map_bitmaps through the given backend
+static filesystem_t* mount_mapped(disk_backend_t backend) {
+    disk_attach_options_t dopts = { backend, false };
+    disk_t disk = NULL;
+    assert(disk_attach_with_options(TEST_DISK, 0, false, &dopts, &disk) == DISK_SUCCESS);
+    fs_mount_options_t mopts = { .map_bitmaps = true };
+    filesystem_t* fs = NULL;
+    assert(fs_mount_with_options(disk, &mopts, &fs) == SUCCESS);
+    return fs;
+}
+
+void test_fs_mapped_bitmaps() {
+    printf("Running test_fs_mapped_bitmaps...\n");
+
+    remove(TEST_DISK);
+    disk_t disk = NULL;
+    assert(disk_attach(TEST_DISK, 4 * 1024 * 1024, true, &disk) == DISK_SUCCESS);
+    assert(fs_format(disk, 8192, 512) == SUCCESS);
+    disk_detach(disk);
+
+    // the bitmaps are the image's own bitmap blocks
+    filesystem_t* fs = mount_mapped(DISK_BACKEND_MMAP);
+    assert(fs->bitmaps_mapped);
+    const void* region;
+    assert(disk_borrow_blocks(fs->disk, fs->sb.block_bitmap_start, 1, &region) == DISK_SUCCESS);
+    assert((const void*)fs->block_bitmap->data == region);
+    disk_release_blocks(fs->disk, fs->sb.block_bitmap_start, 1, false);
+    assert(fs->sb.free_blocks == (uint32_t)bitmap_count_free(fs->block_bitmap));
+
+    assert(fs_mkdir(fs, "/d", 0755) == SUCCESS);
+    char name[32];
+    for (int i = 0; i < 50; i++) {
+        snprintf(name, sizeof(name), "/d/f%02d", i);
+        assert(fs_create(fs, name, 0644) == SUCCESS);
+    }
+    create_pattern_file(fs, "/big", 200 * 1024);
+    assert(fs_unlink(fs, "/d/f10") == SUCCESS);
+    uint32_t free_blocks = fs->sb.free_blocks;
+    uint32_t free_inodes = fs->sb.free_inodes;
+    assert(!bitmap_is_dirty(fs->block_bitmap) && !bitmap_is_dirty(fs->inode_bitmap));
+    fs_unmount(fs);
+
+    // a copying mount reads back what was changed in place
+    assert(disk_attach(TEST_DISK, 0, false, &disk) == DISK_SUCCESS);
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    assert(!fs->bitmaps_mapped);
+    assert(fs->sb.free_blocks == free_blocks && fs->sb.free_inodes == free_inodes);
+    assert(fs->sb.free_blocks == (uint32_t)bitmap_count_free(fs->block_bitmap));
+    assert(fs->sb.free_inodes == (uint32_t)bitmap_count_free(fs->inode_bitmap));
+    check_pattern_file(fs, "/big", 200 * 1024);
+    fs_unmount(fs);
+
+    // without a mapping the option falls back to copies
+    fs = mount_mapped(DISK_BACKEND_PREAD);
+    assert(!fs->bitmaps_mapped);
+    assert(fs_create(fs, "/after", 0644) == SUCCESS);
+    fs_unmount(fs);
+
+    // and so do the journal and block groups
+    fs_format_options_t layouts[] = { { .journal_blocks = 32 }, { .block_groups = true } };
+    for (int l = 0; l < 2; l++) {
+        remove(TEST_DISK);
+        assert(disk_attach(TEST_DISK, 4 * 1024 * 1024, true, &disk) == DISK_SUCCESS);
+        assert(fs_format_with_options(disk, 8192, 512, &layouts[l]) == SUCCESS);
+        disk_detach(disk);
+        fs = mount_mapped(DISK_BACKEND_MMAP);
+        assert(!fs->bitmaps_mapped);
+        assert(fs_create(fs, "/f", 0644) == SUCCESS);
+        fs_unmount(fs);
+    }
+
+    printf("test_fs_mapped_bitmaps PASSED\n\n");
+}
+
+static fs_check_report_t run_check(filesystem_t* fs, uint32_t threads, bool repair) {
+    fs_check_options_t opts = { threads, repair, false };
+    fs_check_report_t report;
+    assert(fs_check(fs, &opts, &report) == SUCCESS);
+    return report;
+}
+
+// a tree with subdirectories, hard links, holes, large and removed files
+static void populate_for_check(filesystem_t* fs) {
+    assert(fs_mkdir(fs, "/a", 0755) == SUCCESS);
+    assert(fs_mkdir(fs, "/a/b", 0755) == SUCCESS);
+    assert(fs_mkdir(fs, "/many", 0755) == SUCCESS);
+    char name[32];
+    for (int i = 0; i < 120; i++) {
+        snprintf(name, sizeof(name), "/many/f%03d", i);
+        assert(fs_create(fs, name, 0644) == SUCCESS);
+    }
+    for (int i = 0; i < 120; i += 3) {
+        snprintf(name, sizeof(name), "/many/f%03d", i);
+        assert(fs_unlink(fs, name) == SUCCESS);
+    }
+
+    assert(fs_create(fs, "/a/b/big", 0644) == SUCCESS);
+    open_file_t* f = NULL;
+    assert(fs_open(fs, "/a/b/big", FS_O_RDWR, &f) == SUCCESS);
+    write_pattern(f, 300 * 1024);
+    size_t written;
+    assert(fs_pwrite(f, "x", 1, 900 * 1024, &written) == SUCCESS);
+    fs_close(f);
+    assert(fs_link(fs, "/a/b/big", "/a/alias") == SUCCESS);
+    assert(fs_link(fs, "/a/b/big", "/many/alias") == SUCCESS);
+    assert(fs_unlink(fs, "/many/alias") == SUCCESS);
+}
+
+void test_fs_check() {
+    printf("Running test_fs_check...\n");
+
+    // healthy trees check clean in every layout, with any number of threads
+    fs_format_options_t layouts[] = {
+        { 0 },
+        { .extents = true, .dir_index = true },
+        { .rec_len = true, .block_size = 1024 },
+        { .journal_blocks = 32 },
+        { .block_groups = true, .extents = true, .blocks_per_group = 4096 },
+    };
+    disk_t disk = NULL;
+    filesystem_t* fs = NULL;
+    for (size_t l = 0; l < sizeof(layouts) / sizeof(layouts[0]); l++) {
+        remove(TEST_DISK);
+        assert(disk_attach(TEST_DISK, 8 * 1024 * 1024, true, &disk) == DISK_SUCCESS);
+        assert(fs_format_with_options(disk, 8192, 1024, &layouts[l]) == SUCCESS);
+        assert(fs_mount(disk, &fs) == SUCCESS);
+        populate_for_check(fs);
+
+        fs_check_report_t one = run_check(fs, 1, false);
+        fs_check_report_t many = run_check(fs, 4, false);
+        assert(one.errors == 0 && many.errors == 0);
+        assert(one.threads == 1 && many.threads == 4);
+        assert(one.inodes_used == many.inodes_used && one.blocks_owned == many.blocks_owned);
+        assert(one.inodes_used == fs->sb.total_inodes - 1 - fs->sb.free_inodes);
+        assert(one.directories == 4);
+        if (!(fs->sb.features & FS_FEATURE_GROUPS))
+            assert(one.blocks_owned + fs->sb.first_data_block ==
+                   fs->sb.total_blocks - fs->sb.free_blocks);
+        fs_unmount(fs);
+    }
+
+    // corruptions are reported and repaired, on top of unflushed changes
+    remove(TEST_DISK);
+    assert(disk_attach(TEST_DISK, 8 * 1024 * 1024, true, &disk) == DISK_SUCCESS);
+    assert(fs_format(disk, 8192, 1024) == SUCCESS);
+    fs_mount_options_t mopts = { .flush_policy = FS_FLUSH_ON_SYNC };
+    assert(fs_mount_with_options(disk, &mopts, &fs) == SUCCESS);
+    populate_for_check(fs);
+
+    struct inode big, b;
+    uint32_t big_ino, b_ino, a_ino;
+    assert(fs_stat(fs, "/a/b/big", &big, &big_ino, NULL, 0) == SUCCESS);
+    assert(fs_stat(fs, "/a/b", &b, &b_ino, NULL, 0) == SUCCESS);
+    assert(fs_path_to_inode(fs, "/a", &a_ino) == SUCCESS);
+
+    // a wrong link count, an entry naming a free inode, a '..' pointing elsewhere
+    big.links_count = 7;
+    assert(inode_write(fs, big_ino, &big) == SUCCESS);
+    struct dentry stale;
+    int free_ino = bitmap_find_next_free(fs->inode_bitmap, 1);
+    assert(free_ino > 0);
+    assert(dentry_create("stale", (uint32_t)free_ino, INODE_TYPE_FILE, &stale) == SUCCESS);
+    uint32_t added;
+    assert(dentry_add(fs, a_ino, &stale, &added) == SUCCESS);
+    fs->sb.free_blocks -= added;
+    struct dentry dotdot;
+    assert(dentry_remove(fs, b_ino, "..") == SUCCESS);
+    assert(dentry_create("..", ROOT_INODE_NUM, INODE_TYPE_DIRECTORY, &dotdot) == SUCCESS);
+    assert(dentry_add(fs, b_ino, &dotdot, &added) == SUCCESS);
+    fs->sb.free_blocks -= added;
+    struct inode root;
+    assert(inode_read(fs, ROOT_INODE_NUM, &root) == SUCCESS);
+    root.links_count++;
+    assert(inode_write(fs, ROOT_INODE_NUM, &root) == SUCCESS);
+    struct inode a;
+    assert(inode_read(fs, a_ino, &a) == SUCCESS);
+    a.links_count--;
+    assert(inode_write(fs, a_ino, &a) == SUCCESS);
+
+    // last, so that no allocation above takes them: a data block marked free, a free block marked used
+    bitmap_clear(fs->block_bitmap, big.direct[3]);
+    int leak = bitmap_find_next_free(fs->block_bitmap, big.direct[0] + 2000);
+    assert(leak > 0);
+    bitmap_set(fs->block_bitmap, (size_t)leak);
+
+    fs_check_report_t r = run_check(fs, 4, false);
+    assert(r.blocks_unmarked == 1 && r.block_leaks == 1);
+    assert(r.link_count_errors == 1 && r.dangling_entries == 1 && r.dir_errors == 1);
+    assert(r.duplicate_blocks == 0 && r.orphans == 0 && r.repaired == 0);
+    assert(r.errors == 5);
+    assert(run_check(fs, 2, false).errors == 5);   // checking changes nothing
+
+    r = run_check(fs, 4, true);
+    assert(r.errors == 5 && r.repaired >= 5);
+    r = run_check(fs, 3, false);
+    assert(r.errors == 0);
+    uint32_t ino;
+    assert(fs_path_to_inode(fs, "/a/stale", &ino) == ERROR_NOT_FOUND);
+    assert(fs_path_to_inode(fs, "/a/b/..", &ino) == SUCCESS && ino == a_ino);
+    assert(fs_stat(fs, "/a/alias", &big, NULL, NULL, 0) == SUCCESS && big.links_count == 2);
+    check_pattern_file(fs, "/a/b/big", 300 * 1024);
+    fs_unmount(fs);
+
+    // the repairs are on disk
+    assert(disk_attach(TEST_DISK, 0, false, &disk) == DISK_SUCCESS);
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    assert(run_check(fs, 0, false).errors == 0);
+
+    // a block mapped by two files is reported and left alone
+    struct inode other;
+    uint32_t other_ino;
+    assert(fs_create(fs, "/other", 0644) == SUCCESS);
+    assert(fs_stat(fs, "/other", &other, &other_ino, NULL, 0) == SUCCESS);
+    assert(fs_stat(fs, "/a/b/big", &big, NULL, NULL, 0) == SUCCESS);
+    other.direct[0] = big.direct[5];
+    other.blocks_used = 1;
+    other.size = 100;
+    assert(inode_write(fs, other_ino, &other) == SUCCESS);
+    r = run_check(fs, 4, true);
+    assert(r.duplicate_blocks == 1 && r.errors == 1);
+    assert(run_check(fs, 4, false).duplicate_blocks == 1);
+    fs_unmount(fs);
+
+    printf("test_fs_check PASSED\n\n");
+}
+
+// an image whose every block holds garbage, as a reused one would
+static disk_t dirty_image(uint32_t blocks) {
+    remove(TEST_DISK);
+    disk_t disk = NULL;
+    assert(disk_attach(TEST_DISK, (size_t)blocks * BLOCK_SIZE, true, &disk) == DISK_SUCCESS);
+    void* ptr;
+    assert(disk_borrow_blocks_mut(disk, 0, (int)blocks, &ptr) == DISK_SUCCESS);
+    memset(ptr, 0xA5, (size_t)blocks * BLOCK_SIZE);
+    disk_release_blocks(disk, 0, (int)blocks, true);
+    disk_detach(disk);
+
+    assert(disk_attach(TEST_DISK, 0, false, &disk) == DISK_SUCCESS);
+    return disk;
+}
+
+void test_fs_lazy_itable() {
+    printf("Running test_fs_lazy_itable...\n");
+    struct inode zero, ino;
+    memset(&zero, 0, sizeof(zero));
+
+    // a full format zeroes the table over whatever the image held
+    disk_t disk = dirty_image(8192);
+    assert(fs_format(disk, 8192, 2048) == SUCCESS);
+    disk_detach(disk);
+    assert(disk_attach(TEST_DISK, 0, false, &disk) == DISK_SUCCESS);
+    filesystem_t* fs = NULL;
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    assert(!(fs->sb.features & FS_FEATURE_LAZY_ITABLE));
+    assert(inode_load(fs, 1000, &ino) == SUCCESS && memcmp(&ino, &zero, sizeof(ino)) == 0);
+    assert(run_check(fs, 1, false).errors == 0);
+    fs_unmount(fs);
+
+    // a lazy one initialises only the root inode's block
+    disk = dirty_image(8192);
+    fs_format_options_t lazy = { .lazy_itable = true };
+    assert(fs_format_with_options(disk, 8192, 2048, &lazy) == SUCCESS);
+    disk_detach(disk);
+    assert(disk_attach(TEST_DISK, 0, false, &disk) == DISK_SUCCESS);
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    uint32_t per_block = fs->sb.block_size / fs->sb.inode_size;
+    assert(fs->sb.features & FS_FEATURE_LAZY_ITABLE);
+    assert(fs->sb.itable_zeroed == 1);
+    assert(inode_load(fs, 1000, &ino) == SUCCESS && memcmp(&ino, &zero, sizeof(ino)) == 0);
+
+    // allocating inodes zeroes their blocks first
+    char name[32];
+    for (int i = 0; i < 10; i++) {
+        snprintf(name, sizeof(name), "/f%d", i);
+        assert(fs_create(fs, name, 0644) == SUCCESS);
+    }
+    assert(fs->sb.itable_zeroed == (ROOT_INODE_NUM + 10) / per_block + 1);
+    assert(fs_mkdir(fs, "/d", 0755) == SUCCESS);
+    assert(fs_create(fs, "/d/g", 0644) == SUCCESS);
+    assert(run_check(fs, 2, false).errors == 0);
+    uint32_t mark = fs->sb.itable_zeroed;
+    fs_unmount(fs);
+
+    // the mark persists, and the rest of the table can be finished later
+    assert(disk_attach(TEST_DISK, 0, false, &disk) == DISK_SUCCESS);
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    assert(fs->sb.itable_zeroed == mark);
+    uint32_t remaining = 0;
+    assert(fs_itable_init(fs, 100, &remaining) == SUCCESS);
+    assert(remaining == fs->sb.inode_table_blocks - mark - 100);
+    while (remaining > 0)
+        assert(fs_itable_init(fs, 128, &remaining) == SUCCESS);
+    assert(fs->sb.itable_zeroed == fs->sb.inode_table_blocks);
+    assert(fs_stat(fs, "/d/g", &ino, NULL, NULL, 0) == SUCCESS);
+    assert(run_check(fs, 1, false).errors == 0);
+    fs_unmount(fs);
+
+    // with block groups every group keeps its own mark
+    disk = dirty_image(8192);
+    fs_format_options_t grouped = { .lazy_itable = true, .block_groups = true,
+                                    .blocks_per_group = 4096 };
+    assert(fs_format_with_options(disk, 8192, 2048, &grouped) == SUCCESS);
+    disk_detach(disk);
+    assert(disk_attach(TEST_DISK, 0, false, &disk) == DISK_SUCCESS);
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    assert(fs->groups[0].desc.itable_zeroed == 1);
+    for (uint32_t g = 1; g < fs->sb.group_count; g++)
+        assert(fs->groups[g].desc.itable_zeroed == 0);
+    for (int i = 0; i < 4; i++) {
+        snprintf(name, sizeof(name), "/dir%d", i);
+        assert(fs_mkdir(fs, name, 0755) == SUCCESS);
+        snprintf(name, sizeof(name), "/dir%d/f", i);
+        assert(fs_create(fs, name, 0644) == SUCCESS);
+    }
+    uint32_t marked = 0;
+    for (uint32_t g = 0; g < fs->sb.group_count; g++) {
+        assert(fs->groups[g].desc.itable_zeroed <= 2);
+        marked += fs->groups[g].desc.itable_zeroed;
+    }
+    assert(marked > 1 && marked < fs->sb.inode_table_blocks);
+    assert(run_check(fs, 4, false).errors == 0);
+    fs_unmount(fs);
+
+    assert(disk_attach(TEST_DISK, 0, false, &disk) == DISK_SUCCESS);
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    assert(fs_stat(fs, "/dir3/f", &ino, NULL, NULL, 0) == SUCCESS);
+    assert(run_check(fs, 1, false).errors == 0);
+    fs_unmount(fs);
+
+    printf("test_fs_lazy_itable PASSED\n\n");
+}
+
+void test_fs_inline_data() {
+    printf("Running test_fs_inline_data...\n");
+    assert(BMAP_INLINE_MAX >= 64);
+
+    fs_format_options_t layouts[] = { { .inline_data = true },
+                                      { .inline_data = true, .extents = true } };
+    for (int l = 0; l < 2; l++) {
+        remove(TEST_DISK);
+        disk_t disk = NULL;
+        assert(disk_attach(TEST_DISK, 4 * 1024 * 1024, true, &disk) == DISK_SUCCESS);
+        assert(fs_format_with_options(disk, 8192, 512, &layouts[l]) == SUCCESS);
+        filesystem_t* fs = NULL;
+        assert(fs_mount(disk, &fs) == SUCCESS);
+
+        // a small file takes no block, and reads back from the inode
+        uint8_t data[256], back[4096];
+        fill_pattern(data, sizeof(data));
+        assert(fs_create(fs, "/small", 0644) == SUCCESS);
+        uint32_t free_blocks = fs->sb.free_blocks;
+        open_file_t* f = NULL;
+        assert(fs_open(fs, "/small", FS_O_RDWR, &f) == SUCCESS);
+        size_t n = 0;
+        assert(fs_write(f, data, 40, &n) == SUCCESS && n == 40);
+        assert(fs_pwrite(f, data + 60, 20, 60, &n) == SUCCESS && n == 20);
+        fs_close(f);
+        struct inode st;
+        assert(fs_stat(fs, "/small", &st, NULL, NULL, 0) == SUCCESS);
+        assert((st.flags & INODE_FLAG_INLINE_DATA) && st.size == 80 && st.blocks_used == 0);
+        assert(fs->sb.free_blocks == free_blocks);
+        read_file(fs, "/small", back, 80);
+        assert(memcmp(back, data, 40) == 0 && memcmp(back + 60, data + 60, 20) == 0);
+        for (int i = 40; i < 60; i++)
+            assert(back[i] == 0);
+
+        // outgrowing the inode moves the contents to a block
+        assert(fs_open(fs, "/small", FS_O_RDWR, &f) == SUCCESS);
+        assert(fs_pwrite(f, data + 80, 120, 80, &n) == SUCCESS && n == 120);
+        fs_close(f);
+        assert(fs_stat(fs, "/small", &st, NULL, NULL, 0) == SUCCESS);
+        assert(!(st.flags & INODE_FLAG_INLINE_DATA) && st.size == 200 && st.blocks_used == 1);
+        assert(((st.flags & INODE_FLAG_EXTENTS) != 0) == layouts[l].extents);
+        assert(fs->sb.free_blocks == free_blocks - 1);
+        read_file(fs, "/small", back, 200);
+        assert(memcmp(back, data, 40) == 0 && memcmp(back + 60, data + 60, 140) == 0);
+
+        // shrinking an inline file zeroes what it drops; growing past the limit spills
+        assert(fs_create(fs, "/t", 0644) == SUCCESS);
+        assert(fs_open(fs, "/t", FS_O_RDWR, &f) == SUCCESS);
+        assert(fs_write(f, data, 80, &n) == SUCCESS && n == 80);
+        assert(fs_ftruncate(f, 10) == SUCCESS);
+        assert(fs_ftruncate(f, 50) == SUCCESS);
+        fs_close(f);
+        assert(fs_stat(fs, "/t", &st, NULL, NULL, 0) == SUCCESS);
+        assert((st.flags & INODE_FLAG_INLINE_DATA) && st.size == 50);
+        read_file(fs, "/t", back, 50);
+        assert(memcmp(back, data, 10) == 0);
+        for (int i = 10; i < 50; i++)
+            assert(back[i] == 0);
+        assert(fs_truncate(fs, "/t", 3000) == SUCCESS);
+        assert(fs_stat(fs, "/t", &st, NULL, NULL, 0) == SUCCESS);
+        assert(!(st.flags & INODE_FLAG_INLINE_DATA) && st.size == 3000 && st.blocks_used == 1);
+        read_file(fs, "/t", back, 3000);
+        assert(memcmp(back, data, 10) == 0);
+        for (int i = 10; i < 3000; i++)
+            assert(back[i] == 0);
+
+        // preallocation leaves the inode too
+        assert(fs_create(fs, "/pre", 0644) == SUCCESS);
+        assert(fs_open(fs, "/pre", FS_O_RDWR, &f) == SUCCESS);
+        assert(fs_write(f, data, 30, &n) == SUCCESS && n == 30);
+        assert(fs_fallocate(f, 0, 2048, 0) == SUCCESS);
+        fs_close(f);
+        assert(fs_stat(fs, "/pre", &st, NULL, NULL, 0) == SUCCESS);
+        assert(!(st.flags & INODE_FLAG_INLINE_DATA) && st.size == 2048);
+        read_file(fs, "/pre", back, 2048);
+        assert(memcmp(back, data, 30) == 0);
+        for (int i = 30; i < 2048; i++)
+            assert(back[i] == 0);
+
+        // buffered small writes, many small files
+        free_blocks = fs->sb.free_blocks;
+        assert(fs_mkdir(fs, "/cfg", 0755) == SUCCESS);
+        char name[32];
+        for (int i = 0; i < 40; i++) {
+            snprintf(name, sizeof(name), "/cfg/c%02d", i);
+            assert(fs_create(fs, name, 0644) == SUCCESS);
+            assert(fs_open(fs, name, FS_O_WRONLY | FS_O_BUFFERED, &f) == SUCCESS);
+            assert(fs_write(f, data + i, 16, &n) == SUCCESS);
+            assert(fs_write(f, data + i + 16, 16, &n) == SUCCESS);
+            fs_close(f);
+        }
+        uint32_t dir_blocks = free_blocks - fs->sb.free_blocks;
+        assert(fs_stat(fs, "/cfg", &st, NULL, NULL, 0) == SUCCESS);
+        assert(dir_blocks == st.blocks_used);
+        assert(fs_unlink(fs, "/cfg/c07") == SUCCESS);
+        assert(run_check(fs, 2, false).errors == 0);
+        fs_unmount(fs);
+
+        // everything persists
+        assert(disk_attach(TEST_DISK, 0, false, &disk) == DISK_SUCCESS);
+        assert(fs_mount(disk, &fs) == SUCCESS);
+        read_file(fs, "/cfg/c39", back, 32);
+        assert(memcmp(back, data + 39, 32) == 0);
+        read_file(fs, "/small", back, 200);
+        assert(memcmp(back + 60, data + 60, 140) == 0);
+        assert(run_check(fs, 1, false).errors == 0);
+        fs_unmount(fs);
+    }
+
+    // without the feature files are mapped from the start
+    remove(TEST_DISK);
+    disk_t disk = NULL;
+    assert(disk_attach(TEST_DISK, 4 * 1024 * 1024, true, &disk) == DISK_SUCCESS);
+    assert(fs_format(disk, 8192, 512) == SUCCESS);
+    filesystem_t* fs = NULL;
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    assert(fs_create(fs, "/f", 0644) == SUCCESS);
+    struct inode st;
+    assert(fs_stat(fs, "/f", &st, NULL, NULL, 0) == SUCCESS);
+    assert(!(st.flags & INODE_FLAG_INLINE_DATA));
+    fs_unmount(fs);
+
+    printf("test_fs_inline_data PASSED\n\n");
+}
+
+// no block of the table is left with an extra reference
+static bool refcounts_clear(filesystem_t* fs) {
+    uint16_t* refs = malloc(fs->sb.total_blocks * sizeof(uint16_t));
+    assert(refs);
+    assert(block_refs_get(fs, 0, fs->sb.total_blocks, refs) == SUCCESS);
+    bool clear = true;
+    for (uint32_t b = 0; b < fs->sb.total_blocks; b++)
+        clear = clear && refs[b] == 0;
+    free(refs);
+    return clear;
+}
+
+void test_fs_reflink() {
+    printf("Running test_fs_reflink...\n");
+    const size_t len = 100 * 1024;     // past direct[] and the first pointer tree
+
+    fs_format_options_t layouts[] = { { .reflink = true },
+                                      { .reflink = true, .extents = true },
+                                      { .reflink = true, .extents = true,
+                                        .journal_blocks = 64, .inline_data = true } };
+    for (int l = 0; l < 3; l++) {
+        remove(TEST_DISK);
+        disk_t disk = NULL;
+        assert(disk_attach(TEST_DISK, 4 * 1024 * 1024, true, &disk) == DISK_SUCCESS);
+        assert(fs_format_with_options(disk, 8192, 512, &layouts[l]) == SUCCESS);
+        filesystem_t* fs = NULL;
+        assert(fs_mount(disk, &fs) == SUCCESS);
+        assert(fs->sb.features & FS_FEATURE_REFLINK);
+        assert(fs->sb.refcount_blocks * fs->sb.block_size >= fs->sb.total_blocks * 2);
+
+        uint32_t free_base = fs->sb.free_blocks;
+        assert(fs_create(fs, "/src", 0640) == SUCCESS);
+        open_file_t* f = NULL;
+        assert(fs_open(fs, "/src", FS_O_WRONLY, &f) == SUCCESS);
+        write_pattern(f, len);
+        fs_close(f);
+        struct inode src, dst;
+        assert(fs_stat(fs, "/src", &src, NULL, NULL, 0) == SUCCESS);
+
+        // a clone takes copies of the mapping blocks only
+        uint32_t free_before = fs->sb.free_blocks;
+        assert(fs_clone(fs, "/src", "/copy") == SUCCESS);
+        assert(fs_stat(fs, "/copy", &dst, NULL, NULL, 0) == SUCCESS);
+        assert(dst.size == len && dst.blocks_used == src.blocks_used);
+        assert(dst.permissions == src.permissions);
+        assert(free_before - fs->sb.free_blocks <= 3);
+        check_pattern_file(fs, "/copy", len);
+        assert(run_check(fs, 2, false).errors == 0);
+
+        assert(fs_clone(fs, "/src", "/copy") == ERROR_EXISTS);
+        assert(fs_clone(fs, "/missing", "/x") == ERROR_NOT_FOUND);
+        assert(fs_mkdir(fs, "/d", 0755) == SUCCESS);
+        assert(fs_clone(fs, "/d", "/d2") == ERROR_INVALID);
+        assert(fs_stat(fs, "/d2", &dst, NULL, NULL, 0) == ERROR_NOT_FOUND);
+        fs_unmount(fs);
+
+        // the references persist
+        assert(disk_attach(TEST_DISK, 0, false, &disk) == DISK_SUCCESS);
+        assert(fs_mount(disk, &fs) == SUCCESS);
+        check_pattern_file(fs, "/copy", len);
+        assert(run_check(fs, 1, false).errors == 0);
+
+        // a write to the clone copies the block it lands in, the original keeps its bytes
+        free_before = fs->sb.free_blocks;
+        assert(fs_open(fs, "/copy", FS_O_RDWR, &f) == SUCCESS);
+        size_t n = 0;
+        assert(fs_pwrite(f, "XXXXXXXXXX", 10, 1000, &n) == SUCCESS && n == 10);
+        fs_close(f);
+        assert(free_before - fs->sb.free_blocks >= 1 && free_before - fs->sb.free_blocks <= 2);
+        check_pattern_file(fs, "/src", len);
+        uint8_t* back = malloc(len + 1);
+        assert(back);
+        read_file(fs, "/copy", back, len);
+        for (size_t i = 0; i < len; i++)
+            assert(back[i] == ((i >= 1000 && i < 1010) ? 'X' : (uint8_t)(i * 7 % 251)));
+        assert(run_check(fs, 2, false).errors == 0);
+
+        // a clone of the clone: three files on the untouched blocks
+        assert(fs_clone(fs, "/copy", "/copy2") == SUCCESS);
+        assert(fs_truncate(fs, "/copy", 5000) == SUCCESS);
+        check_pattern_file(fs, "/src", len);
+        read_file(fs, "/copy2", back, len);
+        assert(back[1005] == 'X' && back[2000] == (uint8_t)(2000 * 7 % 251));
+        read_file(fs, "/copy", back, 5000);
+        assert(back[1005] == 'X' && back[4999] == (uint8_t)(4999 * 7 % 251));
+        assert(fs_truncate(fs, "/copy", 6000) == SUCCESS);
+        read_file(fs, "/copy", back, 6000);
+        for (size_t i = 5000; i < 6000; i++)
+            assert(back[i] == 0);
+        read_file(fs, "/copy2", back, len);
+        assert(back[5500] == (uint8_t)(5500 * 7 % 251));
+        assert(run_check(fs, 4, false).errors == 0);
+
+        // blocks go back with their last reference
+        assert(fs_unlink(fs, "/src") == SUCCESS);
+        read_file(fs, "/copy2", back, len);
+        assert(back[len - 1] == (uint8_t)((len - 1) * 7 % 251));
+        assert(fs_unlink(fs, "/copy2") == SUCCESS);
+        assert(fs_unlink(fs, "/copy") == SUCCESS);
+        assert(fs_rmdir(fs, "/d") == SUCCESS);
+        assert(fs->sb.free_blocks == free_base);
+        assert(refcounts_clear(fs));
+        assert(run_check(fs, 2, false).errors == 0);
+
+        // a wrong count is found and repaired
+        create_pattern_file(fs, "/a", 4096);
+        assert(fs_clone(fs, "/a", "/b") == SUCCESS);
+        assert(fs_stat(fs, "/a", &src, NULL, NULL, 0) == SUCCESS);
+        uint32_t phys, run;
+        assert(bmap_lookup(fs, &src, NULL, 0, 1, &phys, &run) == SUCCESS && phys != 0);
+        assert(block_refs_set(fs, phys, 0) == SUCCESS);
+        assert(block_refs_set(fs, fs->sb.total_blocks - 1, 2) == SUCCESS);
+        assert(run_check(fs, 2, false).refcount_errors == 2);
+        assert(run_check(fs, 2, true).repaired >= 2);
+        assert(run_check(fs, 1, false).errors == 0);
+        free(back);
+        fs_unmount(fs);
+    }
+
+    // without the feature only files without blocks can be cloned
+    remove(TEST_DISK);
+    disk_t disk = NULL;
+    assert(disk_attach(TEST_DISK, 4 * 1024 * 1024, true, &disk) == DISK_SUCCESS);
+    fs_format_options_t plain = { .inline_data = true };
+    assert(fs_format_with_options(disk, 8192, 512, &plain) == SUCCESS);
+    filesystem_t* fs = NULL;
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    assert(!(fs->sb.features & FS_FEATURE_REFLINK));
+    create_pattern_file(fs, "/small", 40);
+    create_pattern_file(fs, "/big", 2048);
+    assert(fs_clone(fs, "/small", "/small2") == SUCCESS);
+    check_pattern_file(fs, "/small2", 40);
+    uint32_t free_before = fs->sb.free_blocks;
+    assert(fs_clone(fs, "/big", "/big2") == ERROR_INVALID);
+    struct inode st;
+    assert(fs_stat(fs, "/big2", &st, NULL, NULL, 0) == ERROR_NOT_FOUND);
+    assert(fs->sb.free_blocks == free_before);
+    assert(run_check(fs, 1, false).errors == 0);
+    fs_unmount(fs);
+
+    printf("test_fs_reflink PASSED\n\n");
+}
+
+// text-like bytes: a few words in a varying order, compressing well
+static void fill_text(uint8_t* out, size_t len, uint32_t seed) {
+    static const char* words[] = { "block ", "inode ", "extent ", "journal ", "chunk ", "\n" };
+    size_t i = 0;
+    while (i < len) {
+        seed = seed * 1103515245u + 12345u;
+        const char* w = words[(seed >> 16) % 6];
+        for (size_t k = 0; w[k] && i < len; k++)
+            out[i++] = (uint8_t)w[k];
+    }
+}
+
+void test_fs_compression() {
+    printf("Running test_fs_compression...\n");
+    const size_t max = 400 * 1024;
+
+    fs_format_options_t layouts[] = { { 0 },
+                                      { .extents = true, .inline_data = true, .reflink = true },
+                                      { .block_size = 4096, .block_groups = true,
+                                        .journal_blocks = 64, .reflink = true } };
+    uint32_t blocks[] = { 16384, 16384, 2048 };
+    for (int l = 0; l < 3; l++) {
+        remove(TEST_DISK);
+        disk_t disk = NULL;
+        assert(disk_attach(TEST_DISK, 8 * 1024 * 1024, true, &disk) == DISK_SUCCESS);
+        assert(fs_format_with_options(disk, blocks[l], 512, &layouts[l]) == SUCCESS);
+        filesystem_t* fs = NULL;
+        assert(fs_mount(disk, &fs) == SUCCESS);
+        const uint32_t bs = fs->sb.block_size;
+        uint32_t free_base = fs->sb.free_blocks;
+
+        uint8_t* model = calloc(1, max + 1);
+        assert(model);
+        size_t len = 200 * 1024 + 77;
+        fill_text(model, len, 1);
+
+        // a plain file converted: the same bytes in far fewer blocks
+        struct inode st;
+        assert(fs_create(fs, "/log", 0644) == SUCCESS);
+        pwrite_at(fs, "/log", model, len, 0);
+        assert(fs_stat(fs, "/log", &st, NULL, NULL, 0) == SUCCESS);
+        uint32_t plain_blocks = st.blocks_used;
+        assert(fs_set_compression(fs, "/log", true) == SUCCESS);
+        assert(fs_stat(fs, "/log", &st, NULL, NULL, 0) == SUCCESS);
+        assert(st.flags & INODE_FLAG_COMPRESSED);
+        assert(!(st.flags & INODE_FLAG_EXTENTS));
+        assert(st.size == len && st.blocks_used * 3 < plain_blocks * 2);
+        assert(fs_set_compression(fs, "/log", true) == SUCCESS);
+        check_contents(fs, "/log", model, len);
+
+        // reads inside and across chunks
+        open_file_t* f = NULL;
+        assert(fs_open(fs, "/log", FS_O_RDONLY, &f) == SUCCESS);
+        uint8_t part[5000];
+        uint32_t offsets[] = { 0, 1, FS_COMPRESS_CHUNK - 100, 3 * FS_COMPRESS_CHUNK + 5,
+                               (uint32_t)len - 300 };
+        for (int i = 0; i < 5; i++) {
+            size_t got = 0;
+            assert(fs_pread(f, part, sizeof(part), offsets[i], &got) == SUCCESS);
+            size_t want = (len - offsets[i] < sizeof(part)) ? len - offsets[i] : sizeof(part);
+            assert(got == want && memcmp(part, model + offsets[i], got) == 0);
+        }
+        fs_close(f);
+
+        // overwrites in the middle, across a chunk boundary, and appends
+        pwrite_at(fs, "/log", "HELLO", 5, 40000);
+        memcpy(model + 40000, "HELLO", 5);
+        memset(part, 'Q', sizeof(part));
+        pwrite_at(fs, "/log", part, sizeof(part), 2 * FS_COMPRESS_CHUNK - 2000);
+        memset(model + 2 * FS_COMPRESS_CHUNK - 2000, 'Q', sizeof(part));
+        assert(fs_open(fs, "/log", FS_O_WRONLY | FS_O_APPEND, &f) == SUCCESS);
+        for (int i = 0; i < 20; i++) {
+            size_t n = 0;
+            fill_text(model + len, 3001, 100 + i);
+            assert(fs_write(f, model + len, 3001, &n) == SUCCESS && n == 3001);
+            len += 3001;
+        }
+        fs_close(f);
+        check_contents(fs, "/log", model, len);
+        assert(run_check(fs, 2, false).errors == 0);
+
+        // a write past the end leaves zero chunks without blocks
+        assert(fs_stat(fs, "/log", &st, NULL, NULL, 0) == SUCCESS);
+        uint32_t before = st.blocks_used;
+        pwrite_at(fs, "/log", "END", 3, (uint32_t)max - 3);
+        memcpy(model + max - 3, "END", 3);
+        assert(fs_stat(fs, "/log", &st, NULL, NULL, 0) == SUCCESS);
+        assert(st.size == max && st.blocks_used <= before + 2 * FS_COMPRESS_CHUNK / bs);
+        check_contents(fs, "/log", model, max);
+
+        // shrinking into a chunk and growing again reads zeros
+        assert(fs_truncate(fs, "/log", 70001) == SUCCESS);
+        check_contents(fs, "/log", model, 70001);
+        assert(fs_truncate(fs, "/log", 90000) == SUCCESS);
+        memset(model + 70001, 0, max - 70001);
+        check_contents(fs, "/log", model, 90000);
+        assert(fs_open(fs, "/log", FS_O_RDWR, &f) == SUCCESS);
+        assert(fs_fallocate(f, 0, 100000, 0) == SUCCESS);
+        assert(fs_fallocate(f, 0, 200000, FS_FALLOC_KEEP_SIZE) == SUCCESS);
+        fs_close(f);
+        len = 100000;
+        check_contents(fs, "/log", model, len);
+        assert(run_check(fs, 1, false).errors == 0);
+
+        // incompressible chunks are stored as they are
+        uint8_t* noise = malloc(64 * 1024);
+        assert(noise);
+        uint32_t seed = 7;
+        for (size_t i = 0; i < 64 * 1024; i++) {
+            seed = seed * 1103515245u + 12345u;
+            noise[i] = (uint8_t)(seed >> 16);
+        }
+        assert(fs_create(fs, "/noise", 0644) == SUCCESS);
+        assert(fs_set_compression(fs, "/noise", true) == SUCCESS);
+        pwrite_at(fs, "/noise", noise, 64 * 1024, 0);
+        assert(fs_stat(fs, "/noise", &st, NULL, NULL, 0) == SUCCESS);
+        assert(st.blocks_used >= 64 * 1024 / bs);
+        check_contents(fs, "/noise", noise, 64 * 1024);
+        fs_unmount(fs);
+
+        // everything persists
+        assert(disk_attach(TEST_DISK, 0, false, &disk) == DISK_SUCCESS);
+        assert(fs_mount(disk, &fs) == SUCCESS);
+        check_contents(fs, "/log", model, len);
+        check_contents(fs, "/noise", noise, 64 * 1024);
+        assert(run_check(fs, 2, false).errors == 0);
+
+        // a clone shares the compressed chunks; writes give it its own
+        if (fs->sb.features & FS_FEATURE_REFLINK) {
+            assert(fs_clone(fs, "/log", "/copy") == SUCCESS);
+            assert(fs_stat(fs, "/copy", &st, NULL, NULL, 0) == SUCCESS);
+            assert(st.flags & INODE_FLAG_COMPRESSED);
+            pwrite_at(fs, "/copy", "CLONE", 5, 10);
+            check_contents(fs, "/log", model, len);
+            uint8_t* copy = malloc(len);
+            assert(copy);
+            memcpy(copy, model, len);
+            memcpy(copy + 10, "CLONE", 5);
+            check_contents(fs, "/copy", copy, len);
+            free(copy);
+            assert(run_check(fs, 2, false).errors == 0);
+            assert(fs_unlink(fs, "/copy") == SUCCESS);
+        }
+
+        // and back to plain storage
+        assert(fs_set_compression(fs, "/log", false) == SUCCESS);
+        assert(fs_stat(fs, "/log", &st, NULL, NULL, 0) == SUCCESS);
+        assert(!(st.flags & INODE_FLAG_COMPRESSED));
+        assert(!(st.flags & INODE_FLAG_EXTENTS) == !layouts[l].extents);
+        check_contents(fs, "/log", model, len);
+        assert(run_check(fs, 2, false).errors == 0);
+
+        // an inline file only takes the flag until it leaves the inode
+        if (fs->sb.features & FS_FEATURE_INLINE_DATA) {
+            assert(fs_create(fs, "/tiny", 0644) == SUCCESS);
+            pwrite_at(fs, "/tiny", "tiny", 4, 0);
+            assert(fs_set_compression(fs, "/tiny", true) == SUCCESS);
+            assert(fs_stat(fs, "/tiny", &st, NULL, NULL, 0) == SUCCESS);
+            assert(bmap_is_inline(&st) && (st.flags & INODE_FLAG_COMPRESSED));
+            memcpy(model, "tiny", 4);
+            pwrite_at(fs, "/tiny", model + 4, 50000, 4);
+            assert(fs_stat(fs, "/tiny", &st, NULL, NULL, 0) == SUCCESS);
+            assert(!bmap_is_inline(&st) && st.blocks_used * bs < 25000);
+            check_contents(fs, "/tiny", model, 50004);
+            assert(fs_unlink(fs, "/tiny") == SUCCESS);
+        }
+
+        assert(fs_set_compression(fs, "/", true) == ERROR_INVALID);
+        assert(fs_set_compression(fs, "/missing", true) == ERROR_NOT_FOUND);
+
+        // nothing leaks
+        assert(fs_unlink(fs, "/log") == SUCCESS);
+        assert(fs_unlink(fs, "/noise") == SUCCESS);
+        assert(fs->sb.free_blocks == free_base);
+        assert(run_check(fs, 1, false).errors == 0);
+        free(noise);
+        free(model);
+        fs_unmount(fs);
+    }
+
+    printf("test_fs_compression PASSED\n\n");
+}
+
+void test_fs_grow() {
+    printf("Running test_fs_grow...\n");
+
+    // flat, flat with the bitmaps mapped in place
+    fs_mount_options_t mapped = { .map_bitmaps = true };
+    const fs_mount_options_t* mounts[] = { NULL, &mapped };
+    for (int m = 0; m < 2; m++) {
+        remove(TEST_DISK);
+        disk_t disk = NULL;
+        assert(disk_attach(TEST_DISK, 2048 * 512, true, &disk) == DISK_SUCCESS);
+        assert(fs_format(disk, 2048, 128) == SUCCESS);
+        filesystem_t* fs = NULL;
+        assert(fs_mount_with_options(disk, mounts[m], &fs) == SUCCESS);
+        assert(fs->bitmaps_mapped == (m == 1));
+
+        // nearly full before
+        size_t fill = (size_t)(fs->sb.free_blocks - 60) * 512;
+        create_pattern_file(fs, "/fill", fill);
+        uint32_t free_before = fs->sb.free_blocks;
+        assert(free_before < 100);
+
+        // one bitmap block addresses 4096 blocks
+        assert(fs_grow_limit(fs) == 4096 * 512);
+        assert(fs_grow(fs, 4096 * 512 + 512) == ERROR_NO_SPACE);
+        assert(fs_grow(fs, 1024 * 512) == ERROR_INVALID);
+        assert(fs->sb.total_blocks == 2048);
+
+        assert(fs_grow(fs, 4096 * 512) == SUCCESS);
+        assert(fs->sb.total_blocks == 4096 && disk_get_blocks(disk) == 4096);
+        assert(fs->sb.free_blocks == free_before + 2048);
+        assert(fs->bitmaps_mapped == (m == 1));
+
+        // the new blocks are allocated from, next to the old ones
+        create_pattern_file(fs, "/after", 800 * 512);
+        check_pattern_file(fs, "/fill", fill);
+        check_pattern_file(fs, "/after", 800 * 512);
+        assert(run_check(fs, 2, false).errors == 0);
+        fs_unmount(fs);
+
+        assert(disk_attach(TEST_DISK, 0, false, &disk) == DISK_SUCCESS);
+        assert(fs_mount_with_options(disk, mounts[m], &fs) == SUCCESS);
+        assert(fs->sb.total_blocks == 4096);
+        check_pattern_file(fs, "/after", 800 * 512);
+        assert(run_check(fs, 1, false).errors == 0);
+        fs_unmount(fs);
+    }
+
+    // block groups: the tail group fills up and whole groups follow, with
+    // the journal committing the new geometry
+    fs_format_options_t layouts[] = { { .block_groups = true, .blocks_per_group = 4096,
+                                        .journal_blocks = 64 },
+                                      { .block_groups = true, .blocks_per_group = 4096,
+                                        .lazy_itable = true, .extents = true } };
+    for (int l = 0; l < 2; l++) {
+        remove(TEST_DISK);
+        disk_t disk = NULL;
+        assert(disk_attach(TEST_DISK, 10000 * 512, true, &disk) == DISK_SUCCESS);
+        assert(fs_format_with_options(disk, 10000, 512, &layouts[l]) == SUCCESS);
+        filesystem_t* fs = NULL;
+        assert(fs_mount(disk, &fs) == SUCCESS);
+        assert(fs->sb.group_count == 3);
+        uint32_t ipg = fs->sb.inodes_per_group;
+        create_pattern_file(fs, "/old", 300 * 1024);
+
+        // one 512-byte descriptor block holds 16 descriptors
+        assert(fs_grow_limit(fs) == (size_t)16 * 4096 * 512);
+        assert(fs_grow(fs, 20000 * 512) == SUCCESS);
+        assert(fs->sb.group_count == 5 && fs->sb.total_blocks == 20000);
+        assert(fs->sb.total_inodes == 5 * ipg);
+        assert(fs->groups[4].end_block == 20000);
+        assert(run_check(fs, 2, false).errors == 0);
+        uint32_t new_free = fs->groups[3].desc.free_blocks + fs->groups[4].desc.free_blocks;
+
+        // new directories go to the emptiest groups, their files with them
+        char path[32];
+        for (int i = 0; i < 4; i++) {
+            snprintf(path, sizeof(path), "/d%d", i);
+            assert(fs_mkdir(fs, path, 0755) == SUCCESS);
+            snprintf(path, sizeof(path), "/d%d/f", i);
+            create_pattern_file(fs, path, 200 * 1024);
+        }
+        assert(fs->groups[3].desc.used_dirs + fs->groups[4].desc.used_dirs > 0);
+        assert(fs->groups[3].desc.free_blocks + fs->groups[4].desc.free_blocks < new_free);
+        check_pattern_file(fs, "/old", 300 * 1024);
+        assert(run_check(fs, 2, false).errors == 0);
+
+        // the short last group fills up; a remainder smaller than a group's
+        // metadata is left out
+        assert(fs_grow(fs, (5 * 4096 + 40) * 512) == SUCCESS);
+        assert(fs->sb.group_count == 5 && fs->sb.total_blocks == 5 * 4096);
+        assert(fs->groups[4].end_block == 5 * 4096);
+        assert(run_check(fs, 1, false).errors == 0);
+
+        // with the journal, the committed geometry survives a crash
+        if (layouts[l].journal_blocks)
+            simulate_crash(fs);
+        else
+            fs_unmount(fs);
+
+        assert(disk_attach(TEST_DISK, 0, false, &disk) == DISK_SUCCESS);
+        assert(fs_mount(disk, &fs) == SUCCESS);
+        assert(fs->sb.group_count == 5);
+        for (int i = 0; i < 4; i++) {
+            snprintf(path, sizeof(path), "/d%d/f", i);
+            check_pattern_file(fs, path, 200 * 1024);
+        }
+        assert(run_check(fs, 1, false).errors == 0);
+        fs_unmount(fs);
+    }
+
+    printf("test_fs_grow PASSED\n\n");
+}
+
+// readahead advises parts of a mapped image, splitting the mapping into
+// several areas: growth must still work after a file was read in pieces
+void test_fs_grow_after_reads() {
+    printf("Running test_fs_grow_after_reads...\n");
+
+    remove(TEST_DISK);
+    disk_t disk = NULL;
+    assert(disk_attach(TEST_DISK, 32 * 1024 * 1024, true, &disk) == DISK_SUCCESS);
+    fs_format_options_t opts = { .block_size = 4096, .block_groups = true };
+    assert(fs_format_with_options(disk, 8192, 2048, &opts) == SUCCESS);
+    filesystem_t* fs = NULL;
+    assert(fs_mount(disk, &fs) == SUCCESS);
+    assert(disk_get_backend(disk) == DISK_BACKEND_MMAP);
+
+    size_t len = 100 * 1000;
+    create_pattern_file(fs, "/seq", len);
+
+    // 4 KiB at a time: the handle sees a sequential stream
+    open_file_t* f = NULL;
+    assert(fs_open(fs, "/seq", FS_O_RDONLY, &f) == SUCCESS);
+    uint8_t buf[4096];
+    size_t total = 0, n = 0;
+    while (fs_read(f, buf, sizeof(buf), &n) == SUCCESS && n > 0) {
+        for (size_t i = 0; i < n; i++)
+            assert(buf[i] == (uint8_t)((total + i) * 7 % 251));
+        total += n;
+    }
+    assert(total == len);
+    assert(f->ra.blocks > 0);
+    fs_close(f);
+
+    assert(fs_grow(fs, 33 * 1024 * 1024) == SUCCESS);
+    assert(fs->sb.total_blocks == 8448 && disk_get_blocks(disk) == 8448);
+    check_pattern_file(fs, "/seq", len);
+    create_pattern_file(fs, "/after", len);
+    assert(run_check(fs, 1, false).errors == 0);
+    fs_unmount(fs);
+
+    printf("test_fs_grow_after_reads PASSED\n\n");
+}
+
 int main() {
     test_fs_format();
     test_fs_mount();
     test_fs_mkdir();
     test_fs_create();
     test_fs_write_read();
+    test_fs_large_read();
     test_fs_link();
     test_fs_unlink();
     test_fs_cd();
     test_fs_rmdir();
+    test_fs_flush_policy();
+    test_fs_contiguous_alloc();
+    test_fs_extents();
+    test_fs_multi_mb_file();
+    test_fs_sequential_cursor();
+    test_fs_dir_index();
+    test_fs_rec_len_dentries();
+    test_fs_dcache();
+    test_fs_parent_pointer();
+    test_fs_block_size();
+    test_fs_journal();
+    test_fs_backends();
+    test_fs_readahead();
+    test_fs_concurrent();
+    test_fs_block_groups();
+    test_fs_positional_io();
+    test_fs_atime();
+    test_fs_write_buffer();
+    test_fs_truncate_fallocate();
+    test_fs_readdir();
+    test_fs_perf();
+    test_fs_trace();
+    test_fs_mapped_bitmaps();
+    test_fs_check();
+    test_fs_lazy_itable();
+    test_fs_inline_data();
+    test_fs_reflink();
+    test_fs_compression();
+    test_fs_grow();
+    test_fs_grow_after_reads();
 
     printf("\n===== ALL FS TESTS PASSED SUCCESSFULLY =====\n");
     return 0;
@@ -6,10 +6,21 @@
 #include "disk.h"
 #include "bitmap.h"
 #include "superblock.h"
+#include "fs.h"
 #include <stdio.h>
 #include <assert.h>
 #include <string.h>
 
+// builds a minimal filesystem context around a freshly initialized superblock
+static void setup_fs(filesystem_t* fs, disk_t disk, const struct superblock* sb,
+                     struct bitmap* inode_bmp, struct bitmap* block_bmp) {
+    memset(fs, 0, sizeof(*fs));
+    fs->disk = disk;
+    fs->sb = *sb;
+    fs->inode_bitmap = inode_bmp;
+    fs->block_bitmap = block_bmp;
+}
+
 void test_inode_alloc() {
     printf("Test: inode allocation... ");
     
@@ -21,11 +32,13 @@ void test_inode_alloc() {
     superblock_write(disk, &sb);
     
     struct bitmap* inode_bmp = bitmap_create(256);
+    filesystem_t fs;
+    setup_fs(&fs, disk, &sb, inode_bmp, NULL);
     bitmap_set(inode_bmp, 0);
     
     struct inode in;
     uint32_t inode_num;
-    int result = inode_alloc(disk, inode_bmp, INODE_TYPE_FILE, 0644, &in, &inode_num);
+    int result = inode_alloc(&fs, INODE_TYPE_FILE, 0644, &in, &inode_num);
     
     assert(result == SUCCESS);
     assert(inode_num == 1);  // first allocatable
@@ -55,6 +68,8 @@ void test_inode_zero_reserved() {
     superblock_write(disk, &sb);
     
     struct bitmap* inode_bmp = bitmap_create(256);
+    filesystem_t fs;
+    setup_fs(&fs, disk, &sb, inode_bmp, NULL);
     
     bitmap_set(inode_bmp, 0);
     
@@ -62,7 +77,7 @@ void test_inode_zero_reserved() {
     uint32_t inodes[3];
     for (int i = 0; i < 3; i++) {
         struct inode in;
-        inode_alloc(disk, inode_bmp, INODE_TYPE_FILE, 0644, &in, &inodes[i]);
+        inode_alloc(&fs, INODE_TYPE_FILE, 0644, &in, &inodes[i]);
     }
     
     // checks that none of them is inode 0
@@ -86,6 +101,9 @@ void test_inode_read_write() {
     struct superblock sb;
     superblock_init(disk, &sb, 2048, 256);
     superblock_write(disk, &sb);
+
+    filesystem_t fs;
+    setup_fs(&fs, disk, &sb, NULL, NULL);
     
     struct inode in_write;
     memset(&in_write, 0, sizeof(in_write));
@@ -95,10 +113,10 @@ void test_inode_read_write() {
     in_write.direct[0] = 100;
     in_write.direct[1] = 101;
     
-    assert(inode_write(disk, 5, &in_write) == SUCCESS);
+    assert(inode_write(&fs, 5, &in_write) == SUCCESS);
     
     struct inode in_read;
-    assert(inode_read(disk, 5, &in_read) == SUCCESS);
+    assert(inode_read(&fs, 5, &in_read) == SUCCESS);
     
     assert(in_read.type == INODE_TYPE_FILE);
     assert(in_read.size == 1024);
@@ -122,21 +140,23 @@ void test_inode_free() {
     
     struct bitmap* inode_bmp = bitmap_create(256);
     struct bitmap* block_bmp = bitmap_create(2048);
+    filesystem_t fs;
+    setup_fs(&fs, disk, &sb, inode_bmp, block_bmp);
     
     // allocate an inode
     struct inode in;
     uint32_t inode_num;
-    inode_alloc(disk, inode_bmp, INODE_TYPE_FILE, 0644, &in, &inode_num);
+    inode_alloc(&fs, INODE_TYPE_FILE, 0644, &in, &inode_num);
     assert(bitmap_get(inode_bmp, inode_num) == true);
     
     // verify initial state
     struct inode in_alloc;
-    inode_read(disk, inode_num, &in_alloc);
+    inode_read(&fs, inode_num, &in_alloc);
     assert(in_alloc.type == INODE_TYPE_FILE);
     
     // free the inode and track blocks freed
     uint32_t freed_blocks = 0;
-    assert(inode_free(disk, inode_bmp, block_bmp, inode_num, &freed_blocks) == SUCCESS);
+    assert(inode_free(&fs, inode_num, &freed_blocks) == SUCCESS);
     
     // verify inode bitmap is updated
     assert(bitmap_get(inode_bmp, inode_num) == false);
@@ -148,7 +168,7 @@ void test_inode_free() {
     
     // verify inode is zeroed on disk
     struct inode in_freed;
-    inode_read(disk, inode_num, &in_freed);
+    inode_read(&fs, inode_num, &in_freed);
     assert(in_freed.type == INODE_TYPE_FREE);
     
     // verify freed blocks count (should be 0 for newly allocated inode with no data)
@@ -173,22 +193,24 @@ void test_inode_free_with_blocks() {
     
     struct bitmap* inode_bmp = bitmap_create(256);
     struct bitmap* block_bmp = bitmap_create(2048);
+    filesystem_t fs;
+    setup_fs(&fs, disk, &sb, inode_bmp, block_bmp);
     
     // allocate an inode
     struct inode in;
     uint32_t inode_num;
-    inode_alloc(disk, inode_bmp, INODE_TYPE_FILE, 0644, &in, &inode_num);
+    inode_alloc(&fs, INODE_TYPE_FILE, 0644, &in, &inode_num);
     
     // manually allocate some direct blocks to the inode
     for (int i = 0; i < 3; i++) {
         in.direct[i] = 100 + i;  // Assume blocks 100, 101, 102
         bitmap_set(block_bmp, 100 + i);
     }
-    inode_write(disk, inode_num, &in);
+    inode_write(&fs, inode_num, &in);
     
     // free the inode
     uint32_t freed_blocks = 0;
-    assert(inode_free(disk, inode_bmp, block_bmp, inode_num, &freed_blocks) == SUCCESS);
+    assert(inode_free(&fs, inode_num, &freed_blocks) == SUCCESS);
     
     // verify 3 data blocks were freed
     assert(freed_blocks == 3);
@@ -220,13 +242,15 @@ void test_inode_multiple_allocations() {
     superblock_write(disk, &sb);
     
     struct bitmap* inode_bmp = bitmap_create(256);
+    filesystem_t fs;
+    setup_fs(&fs, disk, &sb, inode_bmp, NULL);
     
     bitmap_set(inode_bmp, 0);
     
     uint32_t inodes[10];
     for (uint32_t i = 0; i < 10; i++) {
         struct inode in;
-        inode_alloc(disk, inode_bmp, INODE_TYPE_FILE, 0644, &in, &inodes[i]);
+        inode_alloc(&fs, INODE_TYPE_FILE, 0644, &in, &inodes[i]);
         assert(inodes[i] == i + 1);  // should be 1, 2, ..., 10
     }
     
@@ -247,6 +271,9 @@ void test_inode_persistence() {
     struct superblock sb;
     superblock_init(disk, &sb, 2048, 256);
     superblock_write(disk, &sb);
+
+    filesystem_t fs;
+    setup_fs(&fs, disk, &sb, NULL, NULL);
     
     // write inode
     struct inode in1;
@@ -254,13 +281,14 @@ void test_inode_persistence() {
     in1.type = INODE_TYPE_DIRECTORY;
     in1.size = 2048;
     in1.direct[0] = 42;
-    inode_write(disk, 10, &in1);
+    inode_write(&fs, 10, &in1);
     disk_detach(disk);
     
     // read back
     disk_attach("test_inode5.img", 0, false, &disk);
+    fs.disk = disk;
     struct inode in2;
-    inode_read(disk, 10, &in2);
+    inode_read(&fs, 10, &in2);
     
     assert(in2.type == INODE_TYPE_DIRECTORY);
     assert(in2.size == 2048);
@@ -270,6 +298,41 @@ void test_inode_persistence() {
     printf("OK\n");
 }
 
+void test_inode_layout_from_context() {
+    printf("Test: inode layout from in-memory superblock... ");
+    
+    disk_t disk;
+    disk_attach("test_inode6.img", 1024*1024, true, &disk);
+
+    struct superblock sb;
+    superblock_init(disk, &sb, 2048, 256);
+    superblock_write(disk, &sb);
+
+    filesystem_t fs;
+    setup_fs(&fs, disk, &sb, NULL, NULL);
+
+    // wipe block 0: inode I/O must only rely on fs.sb
+    char zero[BLOCK_SIZE] = {0};
+    disk_write_block(disk, SUPERBLOCK_BLOCK_NUM, zero);
+
+    struct inode in_write;
+    memset(&in_write, 0, sizeof(in_write));
+    in_write.type = INODE_TYPE_FILE;
+    in_write.size = 77;
+    assert(inode_write(&fs, 7, &in_write) == SUCCESS);
+
+    struct inode in_read;
+    assert(inode_read(&fs, 7, &in_read) == SUCCESS);
+    assert(in_read.size == 77);
+
+    // inode numbers past the inode table are rejected
+    assert(inode_read(&fs, 256, &in_read) == ERROR_INVALID);
+    assert(inode_write(&fs, 256, &in_write) == ERROR_INVALID);
+    
+    disk_detach(disk);
+    printf("OK\n");
+}
+
 int main() {
     printf("=== Inode Tests ===\n\n");
     
@@ -280,6 +343,7 @@ int main() {
     test_inode_free_with_blocks();
     test_inode_multiple_allocations();
     test_inode_persistence();
+    test_inode_layout_from_context();
     
     printf("\nAll inode tests pass!\n");
     return 0;
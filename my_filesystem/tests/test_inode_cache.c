@@ -0,0 +1,209 @@
+/*
+    Test for inode cache module
+*/
+
+#include "inode_cache.h"
+#include "inode.h"
+#include "disk.h"
+#include "bitmap.h"
+#include "superblock.h"
+#include "fs.h"
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+
+// builds a filesystem context with an attached inode cache
+static void setup_fs(filesystem_t* fs, disk_t disk, const struct superblock* sb,
+                     struct bitmap* inode_bmp) {
+    memset(fs, 0, sizeof(*fs));
+    fs->disk = disk;
+    fs->sb = *sb;
+    fs->inode_bitmap = inode_bmp;
+    fs->icache = inode_cache_create();
+    assert(fs->icache != NULL);
+}
+
+static void make_file_inode(struct inode* in, uint32_t size) {
+    memset(in, 0, sizeof(*in));
+    in->type = INODE_TYPE_FILE;
+    in->permissions = 0644;
+    in->links_count = 1;
+    in->size = size;
+}
+
+static void teardown_fs(filesystem_t* fs, struct bitmap** inode_bmp) {
+    inode_cache_destroy(&fs->icache);
+    bitmap_destroy(inode_bmp);
+    disk_detach(fs->disk);
+}
+
+void test_cache_write_back() {
+    printf("Test: inode cache defers writes until flush... ");
+
+    disk_t disk;
+    disk_attach("test_icache.img", 1024*1024, true, &disk);
+
+    struct superblock sb;
+    superblock_init(disk, &sb, 2048, 256);
+    superblock_write(disk, &sb);
+
+    struct bitmap* inode_bmp = bitmap_create(256);
+    filesystem_t fs;
+    setup_fs(&fs, disk, &sb, inode_bmp);
+
+    struct inode in;
+    make_file_inode(&in, 4242);
+    assert(inode_write(&fs, 5, &in) == SUCCESS);
+
+    // served from memory, disk untouched
+    struct inode cached, raw;
+    assert(inode_read(&fs, 5, &cached) == SUCCESS);
+    assert(cached.size == 4242);
+    assert(inode_load(&fs, 5, &raw) == SUCCESS);
+    assert(raw.size == 0);
+    assert(fs.icache->hits >= 1);
+
+    // flush persists it
+    assert(inode_cache_flush(&fs) == SUCCESS);
+    assert(inode_load(&fs, 5, &raw) == SUCCESS);
+    assert(raw.size == 4242);
+
+    teardown_fs(&fs, &inode_bmp);
+    printf("OK\n");
+}
+
+void test_cache_flush_batches_blocks() {
+    printf("Test: inode cache flush batches per table block... ");
+
+    disk_t disk;
+    disk_attach("test_icache2.img", 1024*1024, true, &disk);
+
+    struct superblock sb;
+    superblock_init(disk, &sb, 2048, 256);
+    superblock_write(disk, &sb);
+
+    struct bitmap* inode_bmp = bitmap_create(256);
+    filesystem_t fs;
+    setup_fs(&fs, disk, &sb, inode_bmp);
+
+    // 4 inodes per 512-byte block: inodes 8..15 span exactly two blocks
+    for (uint32_t i = 15; i >= 8; i--) {
+        struct inode in;
+        make_file_inode(&in, i * 10);
+        assert(inode_write(&fs, i, &in) == SUCCESS);
+    }
+
+    uint64_t before = fs.icache->writebacks;
+    assert(inode_cache_flush(&fs) == SUCCESS);
+    assert(fs.icache->writebacks - before == 2);
+
+    for (uint32_t i = 8; i <= 15; i++) {
+        struct inode raw;
+        assert(inode_load(&fs, i, &raw) == SUCCESS);
+        assert(raw.size == i * 10);
+    }
+
+    // nothing left dirty
+    before = fs.icache->writebacks;
+    assert(inode_cache_flush(&fs) == SUCCESS);
+    assert(fs.icache->writebacks == before);
+
+    teardown_fs(&fs, &inode_bmp);
+    printf("OK\n");
+}
+
+void test_cache_eviction_writes_back() {
+    printf("Test: inode cache eviction writes dirty slots... ");
+
+    disk_t disk;
+    disk_attach("test_icache3.img", 1024*1024, true, &disk);
+
+    struct superblock sb;
+    superblock_init(disk, &sb, 2048, 512);
+    superblock_write(disk, &sb);
+
+    struct bitmap* inode_bmp = bitmap_create(512);
+    filesystem_t fs;
+    setup_fs(&fs, disk, &sb, inode_bmp);
+
+    // dirty more inodes than there are slots
+    for (uint32_t i = 1; i <= INODE_CACHE_CAPACITY + 10; i++) {
+        struct inode in;
+        make_file_inode(&in, i);
+        assert(inode_write(&fs, i, &in) == SUCCESS);
+    }
+
+    // the oldest ones were evicted and must already be on disk
+    struct inode raw;
+    assert(inode_load(&fs, 1, &raw) == SUCCESS);
+    assert(raw.size == 1);
+
+    // every inode reads back correctly through the cache
+    for (uint32_t i = 1; i <= INODE_CACHE_CAPACITY + 10; i++) {
+        struct inode in;
+        assert(inode_read(&fs, i, &in) == SUCCESS);
+        assert(in.size == i);
+    }
+
+    teardown_fs(&fs, &inode_bmp);
+    printf("OK\n");
+}
+
+void test_cache_pin_shares_copy() {
+    printf("Test: inode cache pinning... ");
+
+    disk_t disk;
+    disk_attach("test_icache4.img", 1024*1024, true, &disk);
+
+    struct superblock sb;
+    superblock_init(disk, &sb, 2048, 512);
+    superblock_write(disk, &sb);
+
+    struct bitmap* inode_bmp = bitmap_create(512);
+    filesystem_t fs;
+    setup_fs(&fs, disk, &sb, inode_bmp);
+
+    struct inode* a = NULL;
+    struct inode* b = NULL;
+    assert(inode_cache_pin(&fs, 3, &a) == SUCCESS);
+    assert(inode_cache_pin(&fs, 3, &b) == SUCCESS);
+    assert(a == b);
+
+    // a change through one handle is visible to readers
+    a->size = 777;
+    inode_cache_mark_dirty(&fs, 3);
+    struct inode in;
+    assert(inode_read(&fs, 3, &in) == SUCCESS);
+    assert(in.size == 777);
+
+    // a pinned slot survives a full sweep of the cache
+    for (uint32_t i = 10; i < 10 + 2 * INODE_CACHE_CAPACITY; i++)
+        assert(inode_read(&fs, i, &in) == SUCCESS);
+    assert(a->size == 777);
+
+    inode_cache_unpin(&fs, 3);
+    inode_cache_unpin(&fs, 3);
+
+    // out of range
+    assert(inode_cache_pin(&fs, 512, &a) == ERROR_INVALID);
+
+    assert(inode_cache_flush(&fs) == SUCCESS);
+    struct inode raw;
+    assert(inode_load(&fs, 3, &raw) == SUCCESS);
+    assert(raw.size == 777);
+
+    teardown_fs(&fs, &inode_bmp);
+    printf("OK\n");
+}
+
+int main() {
+    printf("=== Inode Cache Tests ===\n\n");
+
+    test_cache_write_back();
+    test_cache_flush_batches_blocks();
+    test_cache_eviction_writes_back();
+    test_cache_pin_shares_copy();
+
+    printf("\nAll inode cache tests pass!\n");
+    return 0;
+}
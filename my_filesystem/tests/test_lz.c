@@ -0,0 +1,214 @@
+/*
+    test for the lz codec module
+*/
+
+#include "lz.h"
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+// worst case of the format: incompressible input grows by 1/255 plus a token
+#define BOUND(n) ((n) + (n) / 255 + 16)
+
+// === HELPERS ===
+
+static uint32_t rng = 12345;
+
+static uint32_t next_rand(void) {
+    rng = rng * 1103515245u + 12345u;
+    return rng >> 8;
+}
+
+// compresses and decompresses buf, checking the round trip; returns the
+// compressed length
+static size_t round_trip(const uint8_t* buf, size_t n) {
+    uint8_t* packed = malloc(BOUND(n));
+    uint8_t* unpacked = malloc(n + 1);
+    assert(packed && unpacked);
+
+    size_t clen = lz_compress(buf, n, packed, BOUND(n));
+    assert(clen > 0);
+    int out = lz_decompress(packed, clen, unpacked, n);
+    assert(out == (int)n);
+    assert(memcmp(buf, unpacked, n) == 0);
+
+    free(packed);
+    free(unpacked);
+    return clen;
+}
+
+// === TEST FUNCTIONS ===
+
+void test_lz_text() {
+    printf("test: lz round trip of text... ");
+
+    const char* line = "the quick brown fox jumps over the lazy dog, again and again\n";
+    size_t n = 32 * 1024;
+    uint8_t* buf = malloc(n);
+    for (size_t i = 0; i < n; i++)
+        buf[i] = (uint8_t)line[i % strlen(line)];
+
+    size_t clen = round_trip(buf, n);
+    assert(clen < n / 10);
+
+    free(buf);
+    printf("OK\n");
+}
+
+void test_lz_runs() {
+    printf("test: lz overlapping matches... ");
+
+    // one repeated byte: every match overlaps its own output
+    size_t n = 70000;
+    uint8_t* buf = malloc(n);
+    memset(buf, 'z', n);
+    assert(round_trip(buf, n) < 400);
+
+    // short periods, and a run longer than the 64 KiB offset window
+    for (size_t i = 0; i < n; i++)
+        buf[i] = (uint8_t)(i % 3);
+    round_trip(buf, n);
+    for (size_t i = 0; i < n; i++)
+        buf[i] = (uint8_t)((i / 70) % 7);
+    round_trip(buf, n);
+
+    free(buf);
+    printf("OK\n");
+}
+
+void test_lz_incompressible() {
+    printf("test: lz incompressible data... ");
+
+    size_t n = 8192;
+    uint8_t* buf = malloc(n);
+    uint8_t* packed = malloc(BOUND(n));
+    for (size_t i = 0; i < n; i++)
+        buf[i] = (uint8_t)next_rand();
+
+    // round trips within the bound, but not within the input size
+    round_trip(buf, n);
+    assert(lz_compress(buf, n, packed, n) == 0);
+    assert(lz_compress(buf, n, packed, BOUND(n)) > n);
+
+    free(buf);
+    free(packed);
+    printf("OK\n");
+}
+
+void test_lz_small() {
+    printf("test: lz small inputs... ");
+
+    // every length around the format limits, including empty
+    uint8_t buf[64];
+    for (size_t n = 0; n <= sizeof(buf); n++) {
+        for (size_t i = 0; i < n; i++)
+            buf[i] = (uint8_t)(i % 4 == 0 ? next_rand() : 'a');
+        uint8_t packed[BOUND(64)];
+        uint8_t out[64];
+        size_t clen = lz_compress(buf, n, packed, sizeof(packed));
+        assert(clen > 0);
+        assert(lz_decompress(packed, clen, out, sizeof(out)) == (int)n);
+        assert(memcmp(buf, out, n) == 0);
+    }
+
+    printf("OK\n");
+}
+
+void test_lz_mixed() {
+    printf("test: lz mixed content... ");
+
+    // random stretches separated by repeats of earlier data
+    size_t n = 64 * 1024;
+    uint8_t* buf = malloc(n);
+    size_t i = 0;
+    while (i < n) {
+        size_t len = 1 + next_rand() % 300;
+        if (len > n - i)
+            len = n - i;
+        if (i > 0 && next_rand() % 2) {
+            size_t from = next_rand() % i;
+            for (size_t k = 0; k < len; k++)
+                buf[i + k] = buf[from + k];
+        } else {
+            for (size_t k = 0; k < len; k++)
+                buf[i + k] = (uint8_t)next_rand();
+        }
+        i += len;
+    }
+    assert(round_trip(buf, n) < n);
+
+    free(buf);
+    printf("OK\n");
+}
+
+void test_lz_known_block() {
+    printf("test: lz decodes a reference block... ");
+
+    // 3 literals, a 14-byte match at offset 3 that overlaps itself, then
+    // the mandatory trailing literals
+    const uint8_t block[] = { 0x3A, 'a', 'b', 'c', 0x03, 0x00, 0x50, 'c', 'a', 'b', 'c', 'd' };
+    char out[32];
+    int n = lz_decompress(block, sizeof(block), out, sizeof(out));
+    assert(n == 22);
+    assert(memcmp(out, "abcabcabcabcabcabcabcd", 22) == 0);
+
+    printf("OK\n");
+}
+
+void test_lz_corrupt() {
+    printf("test: lz rejects corrupt blocks... ");
+
+    const char* line = "some compressible text, some compressible text, some more\n";
+    size_t n = 4096;
+    uint8_t* buf = malloc(n);
+    uint8_t* packed = malloc(BOUND(n));
+    uint8_t* out = malloc(n);
+    for (size_t i = 0; i < n; i++)
+        buf[i] = (uint8_t)line[i % strlen(line)];
+    size_t clen = lz_compress(buf, n, packed, BOUND(n));
+    assert(clen > 0);
+
+    // too small an output, a truncated block, an empty one
+    assert(lz_decompress(packed, clen, out, n - 1) == -1);
+    assert(lz_decompress(packed, clen - 1, out, n) == -1);
+    assert(lz_decompress(packed, 0, out, n) == -1);
+
+    // an offset pointing before the output
+    const uint8_t bad_offset[] = { 0x10, 'a', 0x05, 0x00, 0x00 };
+    assert(lz_decompress(bad_offset, sizeof(bad_offset), out, n) == -1);
+
+    // random damage never writes past the output or reports more than it
+    for (int round = 0; round < 2000; round++) {
+        uint8_t* copy = malloc(clen);
+        memcpy(copy, packed, clen);
+        for (int k = 0; k < 1 + round % 4; k++)
+            copy[next_rand() % clen] = (uint8_t)next_rand();
+        int res = lz_decompress(copy, clen, out, n);
+        assert(res >= -1 && res <= (int)n);
+        free(copy);
+    }
+
+    free(buf);
+    free(packed);
+    free(out);
+    printf("OK\n");
+}
+
+// === MAIN ===
+
+int main() {
+    printf("=== LZ Codec Tests ===\n\n");
+
+    test_lz_text();
+    test_lz_runs();
+    test_lz_incompressible();
+    test_lz_small();
+    test_lz_mixed();
+    test_lz_known_block();
+    test_lz_corrupt();
+
+    printf("\nAll lz tests pass!\n");
+    return 0;
+}
@@ -308,6 +308,83 @@ void test_path_normalize() {
     printf("OK\n");
 }
 
+void test_path_iter() {
+    printf("test: path_iter_next()... ");
+
+    const char* path = "//home/./user//..//file.txt/";
+    const char* expected[] = { "home", ".", "user", "..", "file.txt" };
+    struct path_iter it;
+    struct path_token tok;
+    path_iter_init(&it, path);
+    for (int i = 0; i < 5; i++) {
+        assert(path_iter_next(&it, &tok));
+        assert(tok.len == strlen(expected[i]));
+        assert(memcmp(tok.name, expected[i], tok.len) == 0);
+        assert(path_token_equals(&tok, expected[i]));
+        // a view into the path itself, not a copy
+        assert(tok.name >= path && tok.name + tok.len <= path + strlen(path));
+    }
+    assert(!path_iter_next(&it, &tok));
+    assert(!path_iter_next(&it, &tok));
+
+    // prefixes of the token are not equal to it, nor longer names
+    path_iter_init(&it, "ab/c");
+    assert(path_iter_next(&it, &tok));
+    assert(!path_token_equals(&tok, "a"));
+    assert(!path_token_equals(&tok, "abc"));
+    assert(path_token_equals(&tok, "ab"));
+
+    // root, empty and NULL yield nothing
+    path_iter_init(&it, "/");
+    assert(!path_iter_next(&it, &tok));
+    path_iter_init(&it, "");
+    assert(!path_iter_next(&it, &tok));
+    path_iter_init(&it, NULL);
+    assert(!path_iter_next(&it, &tok));
+
+    printf("OK\n");
+}
+
+void test_path_normalize_into() {
+    printf("test: path_normalize_into()... ");
+
+    const char* cases[][2] = {
+        { "/home/./user/../root", "/home/root" },
+        { "docs/../src/./file.c", "src/file.c" },
+        { "//usr///bin/", "/usr/bin" },
+        { "/", "/" },
+        { "/../..", "/" },
+        { "./", "." },
+        { "a/..", "." },
+        { "../../a/../b", "../../b" },
+        { "a/b/../../..", ".." },
+    };
+    char out[MAX_PATH];
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        assert(path_normalize_into(cases[i][0], out, sizeof(out)) == SUCCESS);
+        assert(strcmp(out, cases[i][1]) == 0);
+
+        // path_normalize gives the same result
+        char* norm = path_normalize(cases[i][0]);
+        assert(strcmp(norm, out) == 0);
+        free(norm);
+    }
+
+    // the result must fit, terminator included, and so must every step on the way
+    char small[8];
+    assert(path_normalize_into("/abcdef", small, sizeof(small)) == SUCCESS);
+    assert(strcmp(small, "/abcdef") == 0);
+    assert(path_normalize_into("/abcdefg", small, sizeof(small)) == ERROR_NO_SPACE);
+    assert(path_normalize_into("/abcdefghij/../x", small, sizeof(small)) == ERROR_NO_SPACE);
+    assert(path_normalize_into("/abc/../defghi", small, sizeof(small)) == SUCCESS);
+    assert(strcmp(small, "/defghi") == 0);
+
+    assert(path_normalize_into("", out, sizeof(out)) == ERROR_INVALID);
+    assert(path_normalize_into(NULL, out, sizeof(out)) == ERROR_INVALID);
+
+    printf("OK\n");
+}
+
 void test_path_print_components() {
     printf("test: path_print_components()... ");
     
@@ -446,6 +523,8 @@ int main() {
     test_path_get_basename();
     test_path_get_dirname();
     test_path_normalize();
+    test_path_iter();
+    test_path_normalize_into();
     test_path_print_components();
     test_path_depth();
     test_path_starts_with();
@@ -0,0 +1,139 @@
+/*
+    test for the shell's batch mode and host transfers
+*/
+
+#include "shell.h"
+#include "common.h"
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#define TEST_IMG  "test_shell.img"
+#define HOST_IN   "test_shell_in.bin"
+#define HOST_OUT  "test_shell_out.bin"
+
+// larger than the 1 MiB TRANSFER_BUFFER, and not a multiple of it
+#define BIG_SIZE  (2 * 1024 * 1024 + 512 * 1024 + 123)
+
+// === HELPERS ===
+
+// runs the script text in batch mode; returns the failed command count
+static int run_script(const char* script) {
+    FILE* in = fmemopen((void*)script, strlen(script), "r");
+    assert(in != NULL);
+    int failed = shell_run_batch(in);
+    fclose(in);
+    return failed;
+}
+
+static uint8_t* read_host_file(const char* path, size_t* out_len) {
+    FILE* f = fopen(path, "rb");
+    assert(f != NULL);
+    fseek(f, 0, SEEK_END);
+    long len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t* buf = malloc(len > 0 ? (size_t)len : 1);
+    assert(buf != NULL);
+    assert(fread(buf, 1, (size_t)len, f) == (size_t)len);
+    fclose(f);
+    *out_len = (size_t)len;
+    return buf;
+}
+
+// === TEST FUNCTIONS ===
+
+void test_batch_transfer() {
+    printf("test: import / export round trip in batch mode...\n");
+
+    // patterned, not compressible into an accidental match
+    uint8_t* data = malloc(BIG_SIZE);
+    assert(data != NULL);
+    uint32_t rng = 12345;
+    for (size_t i = 0; i < BIG_SIZE; i++) {
+        rng = rng * 1103515245u + 12345u;
+        data[i] = (uint8_t)(rng >> 16);
+    }
+    FILE* f = fopen(HOST_IN, "wb");
+    assert(f != NULL);
+    assert(fwrite(data, 1, BIG_SIZE, f) == BIG_SIZE);
+    fclose(f);
+    remove(HOST_OUT);
+
+    int failed = run_script("format " TEST_IMG " 8388608 extents\n"
+                            "mount " TEST_IMG "\n"
+                            "import " HOST_IN " /big\n"
+                            "unmount\n"
+                            "mount " TEST_IMG "\n"
+                            "export /big " HOST_OUT "\n"
+                            "fsck\n"
+                            "unmount\n");
+    assert(failed == 0);
+
+    // the bytes came back unchanged, across a remount
+    size_t len;
+    uint8_t* back = read_host_file(HOST_OUT, &len);
+    assert(len == BIG_SIZE);
+    assert(memcmp(back, data, BIG_SIZE) == 0);
+
+    free(back);
+    free(data);
+    remove(HOST_IN);
+    remove(HOST_OUT);
+    remove(TEST_IMG);
+    printf("OK\n");
+}
+
+void test_batch_errors() {
+    printf("test: batch mode counts failed commands...\n");
+
+    // comments and blank lines are not commands
+    assert(run_script("# a comment\n"
+                      "   # an indented one\n"
+                      "\n"
+                      "help\n") == 0);
+
+    // unknown commands, and commands needing a mounted filesystem
+    assert(run_script("# comment\n"
+                      "bogus\n") == 1);
+    assert(run_script("cat /x\n"
+                      "mount nonexist.img\n"
+                      "import " HOST_IN " /x\n"
+                      "bogus\n") == 4);
+
+    // failures of the commands themselves; the script goes on after each
+    remove(HOST_IN);
+    assert(run_script("format " TEST_IMG " 1048576\n"
+                      "mount " TEST_IMG "\n"
+                      "cat /nonexistent\n"
+                      "rm /nonexistent\n"
+                      "touch /a\n"
+                      "touch /a\n"
+                      "cat /a\n"
+                      "import " HOST_IN " /b\n"
+                      "export /nonexistent " HOST_OUT "\n"
+                      "write /a \"unclosed\n"
+                      "unmount\n") == 6);
+
+    // nothing runs after exit
+    assert(run_script("bogus\n"
+                      "exit\n"
+                      "bogus\n") == 1);
+
+    remove(HOST_OUT);
+    remove(TEST_IMG);
+    printf("OK\n");
+}
+
+// === MAIN ===
+
+int main() {
+    printf("=== Shell Tests ===\n\n");
+
+    test_batch_transfer();
+    test_batch_errors();
+
+    printf("\nAll shell tests pass!\n");
+    return 0;
+}
@@ -125,6 +125,82 @@ void test_superblock_update_counters() {
     printf("OK\n");
 }
 
+void test_superblock_init_grouped() {
+    printf("Test: superblock init with block groups... ");
+    
+    disk_t disk;
+    assert(disk_attach("test_sb_init.img", 10000 * 512, true, &disk) == DISK_SUCCESS);
+    
+    // 2 full groups and a 1808-block tail, inodes rounded up per group
+    struct superblock sb;
+    assert(superblock_init_grouped(disk, &sb, 10000, 1000, 4096) == SUCCESS);
+    assert(sb.features & FS_FEATURE_GROUPS);
+    assert(sb.group_count == 3);
+    assert(sb.total_blocks == 10000);
+    assert(sb.inodes_per_group == 336);
+    assert(sb.total_inodes == 3 * 336);
+    assert(sb.group_desc_blocks == 1);
+    assert(sb.block_bitmap_start == 2);
+    assert(superblock_group_blocks(&sb, 2) == 10000 - 2 * 4096);
+    assert(superblock_group_blocks(&sb, 3) == 0);
+    
+    struct group_desc d;
+    superblock_group_desc(&sb, 1, &d);
+    assert(d.block_bitmap == 4096);
+    assert(d.inode_bitmap == d.block_bitmap + sb.block_bitmap_blocks);
+    assert(d.first_data_block == d.inode_table + sb.inode_table_blocks);
+    assert(superblock_is_valid(&sb));
+    
+    // a tail too small for its own metadata is dropped
+    assert(superblock_init_grouped(disk, &sb, 8192 + 20, 1000, 4096) == SUCCESS);
+    assert(sb.group_count == 2);
+    assert(sb.total_blocks == 8192);
+    
+    // groups must be a whole number of bitmap chunks
+    assert(superblock_init_grouped(disk, &sb, 10000, 1000, 1000) == ERROR_INVALID);
+    
+    disk_detach(disk);
+    printf("OK\n");
+}
+
+void test_superblock_grow() {
+    printf("Test: superblock grow... ");
+
+    disk_t disk;
+    assert(disk_attach("test_sb_init.img", 10000 * 512, true, &disk) == DISK_SUCCESS);
+
+    // flat: up to the spare bits of the one block bitmap block
+    struct superblock sb;
+    assert(superblock_init(disk, &sb, 2048, 256) == SUCCESS);
+    uint32_t free_blocks = sb.free_blocks;
+    assert(superblock_max_blocks(&sb) == 512 * 8);
+    assert(superblock_grow(&sb, 3000) == SUCCESS);
+    assert(sb.total_blocks == 3000 && sb.total_inodes == 256);
+    assert(sb.free_blocks == free_blocks + 952);
+    assert(superblock_grow(&sb, 5000) == ERROR_NO_SPACE);
+    assert(superblock_grow(&sb, 1000) == ERROR_INVALID);
+    assert(sb.total_blocks == 3000);
+    assert(superblock_is_valid(&sb));
+
+    // groups: the tail group fills up, a new group follows, and a remainder
+    // too short for its metadata is left out
+    assert(superblock_init_grouped(disk, &sb, 10000, 1000, 4096) == SUCCESS);
+    free_blocks = sb.free_blocks;
+    uint32_t overhead = sb.block_bitmap_blocks + sb.inode_bitmap_blocks + sb.inode_table_blocks;
+    assert(superblock_max_blocks(&sb) == 16 * 4096);
+    assert(superblock_grow(&sb, 4 * 4096 + 50) == SUCCESS);
+    assert(sb.group_count == 4);
+    assert(sb.total_blocks == 4 * 4096);
+    assert(sb.total_inodes == 4 * 336 && sb.free_inodes == 4 * 336 - 1);
+    assert(sb.free_blocks == free_blocks + (3 * 4096 - 10000) + (4096 - overhead));
+    assert(superblock_group_blocks(&sb, 3) == 4096);
+    assert(superblock_is_valid(&sb));
+    assert(superblock_grow(&sb, 17 * 4096) == ERROR_NO_SPACE);
+
+    disk_detach(disk);
+    printf("OK\n");
+}
+
 int main() {
     printf("=== Superblock Tests ===\n\n");
     
@@ -133,6 +209,8 @@ int main() {
     test_superblock_validation();
     test_superblock_persistence();
     test_superblock_update_counters();
+    test_superblock_init_grouped();
+    test_superblock_grow();
     
     printf("\nAll superblock tests pass!\n");
     return 0;
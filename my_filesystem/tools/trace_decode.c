@@ -0,0 +1,75 @@
+/*
+    Decoder for the trace files written by trace_save() (shell: trace save).
+
+    Usage: trace_decode [-s] [-m min_ns] <file>
+      -s         slowest events first instead of in sequence order
+      -m min_ns  only events that took at least min_ns
+*/
+
+#include "trace.h"
+#include "common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int by_duration_desc(const void* a, const void* b) {
+    const struct trace_event* ea = a;
+    const struct trace_event* eb = b;
+    return (ea->duration_ns < eb->duration_ns) - (ea->duration_ns > eb->duration_ns);
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-s] [-m min_ns] <file>\n", prog);
+}
+
+int main(int argc, char** argv) {
+    bool sort_slowest = false;
+    unsigned long long min_ns = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "sm:")) != -1) {
+        switch (opt) {
+        case 's':
+            sort_slowest = true;
+            break;
+        case 'm':
+            min_ns = strtoull(optarg, NULL, 10);
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    struct trace_event* events = NULL;
+    size_t count = 0;
+    int res = trace_load(argv[optind], &events, &count);
+    if (res != SUCCESS) {
+        fprintf(stderr, "%s: cannot read %s: %s\n", argv[0], argv[optind],
+                res == ERROR_INVALID ? "not a trace file" : error_string(res));
+        return 1;
+    }
+
+    // filter in place, keeping sequence order
+    size_t kept = 0;
+    uint64_t total_ns = 0;
+    for (size_t i = 0; i < count; i++) {
+        total_ns += events[i].duration_ns;
+        if (events[i].duration_ns >= min_ns)
+            events[kept++] = events[i];
+    }
+    if (sort_slowest)
+        qsort(events, kept, sizeof(events[0]), by_duration_desc);
+
+    trace_print(stdout, events, kept);
+    printf("%zu of %zu events shown, %.3f ms traced in total\n",
+           kept, count, (double)total_ns / 1e6);
+
+    free(events);
+    return 0;
+}